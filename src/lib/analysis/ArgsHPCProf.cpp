@@ -159,6 +159,10 @@ Options: Output:\n\
                        Eliminate procedure name redundancy in experiment.xml\n\
   --struct-id          Add 'str=nnn' field to profile data with the hpcstruct\n\
                        node id (for debug, default no).\n\
+  --checkpoint <file>  (hpcprof only) Keep the merged measurements in <file>\n\
+                       across runs. Measurement files already merged into\n\
+                       <file> are not read again; new ones are merged into\n\
+                       it and the database is generated from the result.\n\
 ";
 
 
@@ -216,6 +220,8 @@ CmdLineParser::OptArgDesc Analysis::ArgsHPCProf::optArgs[] = {
      NULL },
   { 0, "remove-redundancy", CLP::ARG_NONE, CLP::DUPOPT_CLOB, NULL,
      NULL },
+  {  0 , "checkpoint",      CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     NULL },
   {  0 , "debug",           CLP::ARG_OPT,  CLP::DUPOPT_CLOB, NULL,  // hidden
      CLP::isOptArg_long },
   CmdLineParser_OptArgDesc_NULL_MACRO // SGI's compiler requires this version
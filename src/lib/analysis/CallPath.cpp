@@ -71,10 +71,17 @@ using std::string;
 #include <climits>
 #include <cstring>
 
+#include <map>
+#include <vector>
+
 #include <typeinfo>
 
 #include <sys/stat.h>
 
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
 //*************************** User Include Files ****************************
 
 #include <include/uint.h>
@@ -91,6 +98,8 @@ using std::string;
 #include <lib/profxml/XercesUtil.hpp>
 #include <lib/profxml/PGMReader.hpp>
 
+#include <lib/prof-lean/hpcfmt.h>
+#include <lib/prof-lean/hpcio.h>
 #include <lib/prof-lean/hpcrun-metric.h>
 #include <lib/prof/LoadMap.hpp>
 #include <lib/binutils/LM.hpp>
@@ -100,6 +109,7 @@ using std::string;
 using namespace xml;
 
 #include <lib/support/diagnostics.h>
+#include <lib/support/FileUtil.hpp>
 #include <lib/support/Logic.hpp>
 #include <lib/support/IOUtil.hpp>
 #include <lib/support/StrUtil.hpp>
@@ -206,6 +216,514 @@ read(const char* prof_fnm, uint groupId, uint rFlags)
 }
 
 
+//****************************************************************************
+// Incremental analysis
+//****************************************************************************
+
+// A checkpoint file holds:
+//   - CheckpointMagic and CheckpointVersion
+//   - the rFlags, mergeTy and mrgFlags the profile was read with
+//   - one record per measurement file merged so far: its real path,
+//     group id, size and modification time (ns)
+//   - the profile's name, directory set, trace file set and snapshot
+//     series, which the hpcrun format does not record
+//   - the profile's metric descriptors (ckptMetricDesc_fwrite), of which
+//     the hpcrun format records only a part
+//   - the merged profile in hpcrun format (Profile::fmt_fwrite) with
+//     metric values, before static structure is overlaid and before
+//     mergePerfEventStatistics_finalize()
+static const char* CheckpointMagic   = "HPCPROF-checkpoint";
+static const char* CheckpointVersion = "2.1";
+
+
+// CkptFile: identifies one measurement file by the contents hpcprof saw
+struct CkptFile {
+  CkptFile()
+    : groupId(0), size(0), mtimeNs(0)
+  { }
+
+  bool
+  operator==(const CkptFile& x) const
+  {
+    return (path == x.path && groupId == x.groupId && size == x.size
+	    && mtimeNs == x.mtimeNs);
+  }
+
+  bool
+  operator!=(const CkptFile& x) const
+  { return !(*this == x); }
+
+  string path;
+  uint groupId;
+  uint64_t size;
+  uint64_t mtimeNs;
+};
+
+typedef std::map<string, CkptFile> CkptFileMap;
+
+
+static void
+ckptFile_stat(const string& fnm, uint groupId, CkptFile& file)
+{
+  char* rp = ::realpath(fnm.c_str(), NULL);
+  if (rp) {
+    file.path = rp;
+    free(rp);
+  }
+  else {
+    file.path = fnm;
+  }
+  file.groupId = groupId;
+
+  struct stat st;
+  if (stat(file.path.c_str(), &st) == 0) {
+    file.size = st.st_size;
+    file.mtimeNs = ((uint64_t)st.st_mtim.tv_sec * 1000000000
+		    + (uint64_t)st.st_mtim.tv_nsec);
+  }
+}
+
+
+static bool
+readCheckpointStr(FILE* fs, string& str)
+{
+  char* cstr = NULL;
+  if (hpcfmt_str_fread(&cstr, fs, malloc) != HPCFMT_OK) {
+    return false;
+  }
+  str = cstr;
+  free(cstr);
+  return true;
+}
+
+
+static bool
+readCheckpointSet(FILE* fs, StringSet& set)
+{
+  StringSet* x = NULL;
+  int ret = StringSet::fmt_fread(x, fs);
+  if (ret == HPCFMT_OK) {
+    set = *x;
+  }
+  delete x;
+  return (ret == HPCFMT_OK);
+}
+
+
+static bool
+readCheckpointFiles(FILE* fs, CkptFileMap& files)
+{
+  uint32_t n, groupId;
+  if (hpcfmt_int4_fread(&n, fs) != HPCFMT_OK) {
+    return false;
+  }
+  for (uint i = 0; i < n; ++i) {
+    CkptFile file;
+    if (!(readCheckpointStr(fs, file.path)
+	  && hpcfmt_int4_fread(&groupId, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fread(&file.size, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fread(&file.mtimeNs, fs) == HPCFMT_OK)) {
+      return false;
+    }
+    file.groupId = groupId;
+    files[file.path] = file;
+  }
+  return true;
+}
+
+
+static bool
+writeCheckpointFiles(FILE* fs, const CkptFileMap& files)
+{
+  if (hpcfmt_int4_fwrite(files.size(), fs) != HPCFMT_OK) {
+    return false;
+  }
+  for (CkptFileMap::const_iterator it = files.begin();
+       it != files.end(); ++it) {
+    const CkptFile& file = it->second;
+    if (!(hpcfmt_str_fwrite(file.path.c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(file.groupId, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(file.size, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(file.mtimeNs, fs) == HPCFMT_OK)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static bool
+readCheckpointSeries(FILE* fs, Prof::CallPath::Profile::SnapshotSeriesMap& series)
+{
+  uint32_t n, mIdx;
+  if (hpcfmt_int4_fread(&n, fs) != HPCFMT_OK) {
+    return false;
+  }
+  for (uint i = 0; i < n; ++i) {
+    string key;
+    if (!(readCheckpointStr(fs, key)
+	  && hpcfmt_int4_fread(&mIdx, fs) == HPCFMT_OK)) {
+      return false;
+    }
+    series[key] = mIdx;
+  }
+  return true;
+}
+
+
+static bool
+writeCheckpointSeries(FILE* fs,
+		      const Prof::CallPath::Profile::SnapshotSeriesMap& series)
+{
+  if (hpcfmt_int4_fwrite(series.size(), fs) != HPCFMT_OK) {
+    return false;
+  }
+  for (Prof::CallPath::Profile::SnapshotSeriesMap::const_iterator it =
+	 series.begin(); it != series.end(); ++it) {
+    if (!(hpcfmt_str_fwrite(it->first.c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(it->second, fs) == HPCFMT_OK)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// ckptMetricDesc_fwrite: Writes what Profile::fmt_fwrite() drops from
+// each (sampled) metric descriptor.  The hpcrun format writes the
+// values of a merged profile as final values with a period of 1 and
+// keeps only the name, description and value type of each metric.
+static bool
+ckptMetricDesc_fwrite(FILE* fs, const Prof::Metric::Mgr& mMgr)
+{
+  if (hpcfmt_int4_fwrite(mMgr.size(), fs) != HPCFMT_OK) {
+    return false;
+  }
+  for (uint i = 0; i < mMgr.size(); ++i) {
+    const Prof::Metric::SampledDesc* m =
+      dynamic_cast<const Prof::Metric::SampledDesc*>(mMgr.metric(i));
+    if (!m) {
+      return false;
+    }
+    hpcrun_metricFlags_t flags = m->flags();
+    if (!(hpcfmt_int4_fwrite(m->type(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->nameBase().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->namePfx().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->nameSfx().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->description().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(m->period(), fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(flags.bits_big[0], fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(flags.bits_big[1], fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->isUnitsEvents(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->isVisible(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->isSortKey(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->doDispPercent(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->computedType(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->sampling_type(), fs) == HPCFMT_OK
+	  && hpcfmt_int4_fwrite(m->isMultiplexed(), fs) == HPCFMT_OK
+	  && hpcfmt_real8_fwrite(m->periodMean(), fs) == HPCFMT_OK
+	  && hpcfmt_int8_fwrite(m->num_samples(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->profileName().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->profileRelId().c_str(), fs) == HPCFMT_OK
+	  && hpcfmt_str_fwrite(m->profileType().c_str(), fs) == HPCFMT_OK)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static bool
+ckptMetricDesc_fread(FILE* fs, std::vector<Prof::Metric::SampledDesc>& descs)
+{
+  uint32_t n;
+  if (hpcfmt_int4_fread(&n, fs) != HPCFMT_OK) {
+    return false;
+  }
+  descs.resize(n);
+  for (uint i = 0; i < n; ++i) {
+    Prof::Metric::SampledDesc& m = descs[i];
+
+    uint32_t type, isUnitsEvents, isVisible, isSortKey, doDispPercent;
+    uint32_t computedTy, samplingType, isMultiplexed;
+    uint64_t period, numSamples;
+    double periodMean;
+    hpcrun_metricFlags_t flags = hpcrun_metricFlags_NULL;
+    string nameBase, namePfx, nameSfx, desc, profName, profRelId, profType;
+
+    if (!(hpcfmt_int4_fread(&type, fs) == HPCFMT_OK
+	  && readCheckpointStr(fs, nameBase)
+	  && readCheckpointStr(fs, namePfx)
+	  && readCheckpointStr(fs, nameSfx)
+	  && readCheckpointStr(fs, desc)
+	  && hpcfmt_int8_fread(&period, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fread(&flags.bits_big[0], fs) == HPCFMT_OK
+	  && hpcfmt_int8_fread(&flags.bits_big[1], fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&isUnitsEvents, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&isVisible, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&isSortKey, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&doDispPercent, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&computedTy, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&samplingType, fs) == HPCFMT_OK
+	  && hpcfmt_int4_fread(&isMultiplexed, fs) == HPCFMT_OK
+	  && hpcfmt_real8_fread(&periodMean, fs) == HPCFMT_OK
+	  && hpcfmt_int8_fread(&numSamples, fs) == HPCFMT_OK
+	  && readCheckpointStr(fs, profName)
+	  && readCheckpointStr(fs, profRelId)
+	  && readCheckpointStr(fs, profType))) {
+      return false;
+    }
+
+    m.type((Prof::Metric::ADesc::ADescTy)type);
+    m.nameBase(nameBase);
+    m.namePfx(namePfx);
+    m.nameSfx(nameSfx);
+    m.description(desc);
+    m.period(period);
+    m.flags(flags);
+    m.isUnitsEvents(isUnitsEvents);
+    m.isVisible(isVisible);
+    m.isSortKey(isSortKey);
+    m.doDispPercent(doDispPercent);
+    m.computedType((Prof::Metric::ADesc::ComputedTy)computedTy);
+    m.sampling_type((Prof::Metric::SamplingType_t)samplingType);
+    m.isMultiplexed(isMultiplexed);
+    m.periodMean(periodMean);
+    m.num_samples(numSamples);
+    m.profileName(profName);
+    m.profileRelId(profRelId);
+    m.profileType(profType);
+  }
+  return true;
+}
+
+
+// ckptMetricDesc_restore: Replaces the descriptors fmt_fread() made for
+// 'prof' with 'descs', keeping the ids and metric DB info of the former.
+static bool
+ckptMetricDesc_restore(Prof::CallPath::Profile& prof,
+		       const std::vector<Prof::Metric::SampledDesc>& descs)
+{
+  Prof::Metric::Mgr* mMgr = prof.metricMgr();
+  if (mMgr->size() != descs.size()) {
+    return false;
+  }
+  for (uint i = 0; i < mMgr->size(); ++i) {
+    Prof::Metric::SampledDesc* m =
+      dynamic_cast<Prof::Metric::SampledDesc*>(mMgr->metric(i));
+    if (!m) {
+      return false;
+    }
+    uint id = m->id(), dbId = m->dbId(), dbNumMetrics = m->dbNumMetrics();
+    *m = descs[i];
+    m->id(id);
+    m->dbId(dbId);
+    m->dbNumMetrics(dbNumMetrics);
+  }
+  mMgr->recomputeMaps();
+  return true;
+}
+
+
+// readCheckpoint: Returns the profile saved in 'fnm' and the measurement
+// files it was merged from, or NULL if 'fnm' is not a usable checkpoint
+// or was made with read or merge flags other than the given ones.
+static Prof::CallPath::Profile*
+readCheckpoint(const string& fnm, CkptFileMap& mergedFiles,
+	       uint rFlags, int mergeTy, uint mrgFlags)
+{
+  FILE* fs = hpcio_fopen_r(fnm.c_str());
+  if (!fs) {
+    return NULL;
+  }
+
+  string magic, version, name;
+  uint32_t ckptRFlags = 0, ckptMergeTy = 0, ckptMrgFlags = 0;
+  StringSet directories, traceFiles;
+  Prof::CallPath::Profile::SnapshotSeriesMap series;
+  std::vector<Prof::Metric::SampledDesc> descs;
+
+  bool isCkpt = (readCheckpointStr(fs, magic) && magic == CheckpointMagic
+		 && readCheckpointStr(fs, version)
+		 && version == CheckpointVersion);
+  bool isSameFlags = (hpcfmt_int4_fread(&ckptRFlags, fs) == HPCFMT_OK
+		      && hpcfmt_int4_fread(&ckptMergeTy, fs) == HPCFMT_OK
+		      && hpcfmt_int4_fread(&ckptMrgFlags, fs) == HPCFMT_OK
+		      && ckptRFlags == rFlags && (int)ckptMergeTy == mergeTy
+		      && ckptMrgFlags == mrgFlags);
+
+  Prof::CallPath::Profile* prof = NULL;
+  if (!isCkpt) {
+    DIAG_WMsg(1, "'" << fnm << "' is not an hpcprof checkpoint (version "
+	      << CheckpointVersion << "); ignoring it");
+  }
+  else if (!isSameFlags) {
+    DIAG_WMsg(1, "Checkpoint '" << fnm << "' was made with other metric "
+	      "options; rebuilding it");
+  }
+  else if (readCheckpointFiles(fs, mergedFiles)
+	   && readCheckpointStr(fs, name)
+	   && readCheckpointSet(fs, directories)
+	   && readCheckpointSet(fs, traceFiles)
+	   && readCheckpointSeries(fs, series)
+	   && ckptMetricDesc_fread(fs, descs)) {
+    try {
+      // The values are final and the descriptors 'rFlags' made are
+      // restored below, so the only read flag that applies to the
+      // profile itself is whether it has values at all.
+      Prof::CallPath::Profile::fmt_fread(prof, fs,
+					 rFlags & Prof::CallPath::Profile::RFlg_VirtualMetrics,
+					 "(checkpoint)", fnm.c_str(), NULL);
+      if (!ckptMetricDesc_restore(*prof, descs)) {
+	DIAG_Throw("metric table does not match its descriptors");
+      }
+      prof->name(name);
+      prof->copyDirectory(directories);
+      prof->traceFileNameSet() += traceFiles;
+      prof->snapshotSeries() = series;
+    }
+    catch (const Diagnostics::Exception& x) {
+      DIAG_WMsg(1, "While reading checkpoint '" << fnm << "': " << x.what());
+      delete prof;
+      prof = NULL;
+    }
+  }
+  else {
+    DIAG_WMsg(1, "Checkpoint '" << fnm << "' is truncated; ignoring it");
+  }
+
+  hpcio_fclose(fs);
+
+  if (!prof) {
+    mergedFiles.clear();
+  }
+  return prof;
+}
+
+
+// writeCheckpoint: Writes to a temporary file first so that an
+// interrupted run leaves the previous checkpoint intact.
+static void
+writeCheckpoint(const string& fnm, Prof::CallPath::Profile& prof,
+		const CkptFileMap& mergedFiles,
+		uint rFlags, int mergeTy, uint mrgFlags)
+{
+  string tmpFnm = fnm + ".tmp";
+  FILE* fs = hpcio_fopen_w(tmpFnm.c_str(), 1 /*overwrite*/);
+  if (!fs) {
+    DIAG_WMsg(1, "Could not write checkpoint '" << tmpFnm << "': "
+	      << strerror(errno));
+    return;
+  }
+
+  bool ok = (hpcfmt_str_fwrite(CheckpointMagic, fs) == HPCFMT_OK
+	     && hpcfmt_str_fwrite(CheckpointVersion, fs) == HPCFMT_OK
+	     && hpcfmt_int4_fwrite(rFlags, fs) == HPCFMT_OK
+	     && hpcfmt_int4_fwrite(mergeTy, fs) == HPCFMT_OK
+	     && hpcfmt_int4_fwrite(mrgFlags, fs) == HPCFMT_OK
+	     && writeCheckpointFiles(fs, mergedFiles)
+	     && hpcfmt_str_fwrite(prof.name().c_str(), fs) == HPCFMT_OK
+	     && StringSet::fmt_fwrite(prof.directorySet(), fs) == HPCFMT_OK
+	     && StringSet::fmt_fwrite(prof.traceFileNameSet(), fs) == HPCFMT_OK
+	     && writeCheckpointSeries(fs, prof.snapshotSeries())
+	     && ckptMetricDesc_fwrite(fs, *prof.metricMgr())
+	     && Prof::CallPath::Profile::fmt_fwrite(prof, fs, 0) == HPCFMT_OK);
+
+  ok = (hpcio_fclose(fs) == 0) && ok;
+
+  if (ok && ::rename(tmpFnm.c_str(), fnm.c_str()) == 0) {
+    DIAG_Msg(1, "Checkpoint: " << mergedFiles.size()
+	     << " measurement files in '" << fnm << "'");
+  }
+  else {
+    DIAG_WMsg(1, "Could not write checkpoint '" << fnm << "'");
+    FileUtil::remove(tmpFnm.c_str());
+  }
+}
+
+
+Prof::CallPath::Profile*
+readIncremental(const Util::StringVec& profileFiles,
+		const Util::UIntVec* groupMap,
+		int mergeTy, uint rFlags, uint mrgFlags,
+		const string& checkpointFnm)
+{
+  std::vector<CkptFile> files(profileFiles.size());
+  CkptFileMap inputFiles;
+  for (uint i = 0; i < profileFiles.size(); ++i) {
+    uint groupId = (groupMap) ? (*groupMap)[i] : 0;
+    ckptFile_stat(profileFiles[i], groupId, files[i]);
+    inputFiles[files[i].path] = files[i];
+  }
+
+  CkptFileMap mergedFiles;
+  Prof::CallPath::Profile* prof =
+    readCheckpoint(checkpointFnm, mergedFiles, rFlags, mergeTy, mrgFlags);
+
+  // The checkpoint is reusable only if each of its measurement files is
+  // still an input with the same group, size and modification time: a
+  // file cannot be taken back out of the merged profile, so one that
+  // changed (e.g., a rerun into the same measurement directory) or is
+  // no longer an input means rebuilding from the current inputs.
+  if (prof) {
+    for (CkptFileMap::const_iterator it = mergedFiles.begin();
+	 it != mergedFiles.end(); ++it) {
+      CkptFileMap::const_iterator in = inputFiles.find(it->first);
+      if (in == inputFiles.end() || in->second != it->second) {
+	DIAG_WMsg(1, "'" << it->first << "' "
+		  << ((in == inputFiles.end()) ? "is not an input" : "changed")
+		  << " since checkpoint '" << checkpointFnm
+		  << "' was written; rebuilding it");
+	delete prof;
+	prof = NULL;
+	mergedFiles.clear();
+	break;
+      }
+    }
+  }
+
+  uint numReused = mergedFiles.size();
+  uint numNew = 0;
+
+  for (uint i = 0; i < profileFiles.size(); ++i) {
+    if (mergedFiles.find(files[i].path) != mergedFiles.end()) {
+      continue;
+    }
+
+    Prof::CallPath::Profile* p =
+      read(profileFiles[i], files[i].groupId, rFlags);
+    if (!prof) {
+      prof = p;
+    }
+    else {
+      prof->merge(*p, mergeTy, mrgFlags);
+      prof->metricMgr()->mergePerfEventStatistics(p->metricMgr());
+      delete p;
+    }
+    prof->addDirectory(profileFiles[i]);
+
+    mergedFiles[files[i].path] = files[i];
+    numNew++;
+  }
+
+  if (!prof) {
+    return Prof::CallPath::Profile::make(rFlags);
+  }
+
+  DIAG_Msg(1, "Checkpoint: reused " << numReused << " and merged " << numNew
+	   << " measurement files");
+
+  if (numNew > 0) {
+    writeCheckpoint(checkpointFnm, *prof, mergedFiles,
+		    rFlags, mergeTy, mrgFlags);
+  }
+
+  prof->metricMgr()->mergePerfEventStatistics_finalize(mergedFiles.size());
+
+  return prof;
+}
+
+
 void
 readStructure(Prof::Struct::Tree* structure, const Analysis::Args& args)
 {
@@ -108,6 +108,26 @@ read(const string& prof_fnm, uint groupId, uint rFlags = 0)
 }
 
 
+// readIncremental: Same as read() but keeps the merged canonical CCT
+// in 'checkpointFnm' across runs. Measurement files already merged
+// into the checkpoint are skipped, and the others are merged into the
+// checkpointed profile (in 'profileFiles' order), after which the
+// checkpoint is rewritten. The checkpoint is rebuilt from scratch if any
+// of its measurement files changed (size or modification time) or is not
+// in 'profileFiles', or if it was made with other rFlags, mergeTy or
+// mrgFlags.
+//
+// N.B.: With Merge_CreateMetric, the metrics of the newly merged files
+// follow those of the checkpoint.  The result is that of read() when the
+// checkpointed files come first in 'profileFiles'; otherwise the metric
+// order can differ.
+Prof::CallPath::Profile*
+readIncremental(const Util::StringVec& profileFiles,
+		const Util::UIntVec* groupMap,
+		int mergeTy, uint rFlags, uint mrgFlags,
+		const string& checkpointFnm);
+
+
 void
 readStructure(Prof::Struct::Tree* structure, const Analysis::Args& args);
 
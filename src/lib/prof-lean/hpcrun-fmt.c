@@ -865,6 +865,8 @@ hpctrace_fmt_hdr_fprint(hpctrace_fmt_hdr_t* hdr, FILE* fs)
   fprintf(fs, "  (version: %s)\n", hdr->versionStr);
   fprintf(fs, "  (endian: %c)\n", hdr->endian);
   fprintf(fs, "  (flags: 0x%"PRIx64")\n", hdr->flags.bits);
+  fprintf(fs, "  (time units/s: %"PRIu64")\n",
+	  hpctrace_hdr_flags_timeUnits(hdr->flags));
   fprintf(fs, "]\n");
 
   return HPCFMT_OK;
@@ -1043,3 +1045,219 @@ hpcmetricDB_fmt_hdr_fprint(hpcmetricDB_fmt_hdr_t* hdr, FILE* outfs)
   return HPCFMT_OK;
 }
 
+
+
+//***************************************************************************
+// hpccomm: ComDetective communication matrices (located here for now)
+//***************************************************************************
+
+//***************************************************************************
+// [hpccomm] hdr
+//***************************************************************************
+
+int
+hpccomm_fmt_hdr_fread(hpccomm_fmt_hdr_t* hdr, FILE* infs,
+		      hpcfmt_alloc_fn alloc)
+{
+  char tag[HPCCOMM_FMT_MagicLen + 1];
+
+  int nr = fread(tag, 1, HPCCOMM_FMT_MagicLen, infs);
+  tag[HPCCOMM_FMT_MagicLen] = '\0';
+
+  if (nr != HPCCOMM_FMT_MagicLen) {
+    return HPCFMT_ERR;
+  }
+  if (strcmp(tag, HPCCOMM_FMT_Magic) != 0) {
+    return HPCFMT_ERR;
+  }
+
+  nr = fread(hdr->versionStr, 1, HPCCOMM_FMT_VersionLen, infs);
+  hdr->versionStr[HPCCOMM_FMT_VersionLen] = '\0';
+  if (nr != HPCCOMM_FMT_VersionLen) {
+    return HPCFMT_ERR;
+  }
+  hdr->version = atof(hdr->versionStr);
+
+  nr = fread(&hdr->endian, 1, HPCCOMM_FMT_EndianLen, infs);
+  if (nr != HPCCOMM_FMT_EndianLen) {
+    return HPCFMT_ERR;
+  }
+
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread((uint32_t*)&(hdr->rank), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(hdr->pid), infs));
+
+  nr = fread(hdr->hostname, 1, HPCCOMM_FMT_HostLen, infs);
+  if (nr != HPCCOMM_FMT_HostLen) {
+    return HPCFMT_ERR;
+  }
+  hdr->hostname[HPCCOMM_FMT_HostLen - 1] = '\0';
+
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(hdr->numMatrices), infs));
+
+  hdr->cpuToNUMA = NULL;
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(hdr->numCPUs), infs));
+  if (hdr->numCPUs > HPCCOMM_FMT_MaxCPUs) {
+    // corrupt or foreign file: do not trust the count with an allocation
+    return HPCFMT_ERR;
+  }
+
+  if (hdr->numCPUs > 0) {
+    hdr->cpuToNUMA = (uint32_t*) alloc(hdr->numCPUs * sizeof(uint32_t));
+    if (!hdr->cpuToNUMA) {
+      return HPCFMT_ERR;
+    }
+    for (uint32_t i = 0; i < hdr->numCPUs; ++i) {
+      HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(hdr->cpuToNUMA[i]), infs));
+    }
+  }
+
+  return HPCFMT_OK;
+}
+
+
+// N.B.: not async safe
+int
+hpccomm_fmt_hdr_fwrite(hpccomm_fmt_hdr_t* hdr, FILE* outfs)
+{
+  int nw;
+
+  // readers reject the header beyond this
+  if (hdr->numCPUs > HPCCOMM_FMT_MaxCPUs) return HPCFMT_ERR;
+
+  nw = fwrite(HPCCOMM_FMT_Magic,   1, HPCCOMM_FMT_MagicLen, outfs);
+  if (nw != HPCCOMM_FMT_MagicLen) return HPCFMT_ERR;
+
+  nw = fwrite(HPCCOMM_FMT_Version, 1, HPCCOMM_FMT_VersionLen, outfs);
+  if (nw != HPCCOMM_FMT_VersionLen) return HPCFMT_ERR;
+
+  nw = fwrite(HPCCOMM_FMT_Endian,  1, HPCCOMM_FMT_EndianLen, outfs);
+  if (nw != HPCCOMM_FMT_EndianLen) return HPCFMT_ERR;
+
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite((uint32_t)hdr->rank, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(hdr->pid, outfs));
+
+  nw = fwrite(hdr->hostname, 1, HPCCOMM_FMT_HostLen, outfs);
+  if (nw != HPCCOMM_FMT_HostLen) return HPCFMT_ERR;
+
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(hdr->numMatrices, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(hdr->numCPUs, outfs));
+  for (uint32_t i = 0; i < hdr->numCPUs; ++i) {
+    HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(hdr->cpuToNUMA[i], outfs));
+  }
+
+  return HPCFMT_OK;
+}
+
+
+int
+hpccomm_fmt_hdr_fprint(hpccomm_fmt_hdr_t* hdr, FILE* outfs)
+{
+  fprintf(outfs, "%s\n", HPCCOMM_FMT_Magic);
+
+  fprintf(outfs, "[hdr:\n");
+  fprintf(outfs, "  (version: %s)\n", hdr->versionStr);
+  fprintf(outfs, "  (endian: %c)\n", hdr->endian);
+  fprintf(outfs, "  (rank: %d) (pid: %"PRIu64") (host: %s)\n",
+	  hdr->rank, hdr->pid, hdr->hostname);
+  fprintf(outfs, "  (num-matrices: %u) (num-cpus: %u)\n",
+	  hdr->numMatrices, hdr->numCPUs);
+  fprintf(outfs, "]\n");
+
+  return HPCFMT_OK;
+}
+
+
+void
+hpccomm_fmt_hdr_free(hpccomm_fmt_hdr_t* hdr, hpcfmt_free_fn dealloc)
+{
+  if (hdr->cpuToNUMA) {
+    dealloc(hdr->cpuToNUMA);
+    hdr->cpuToNUMA = NULL;
+  }
+}
+
+
+//***************************************************************************
+// [hpccomm] matrix
+//***************************************************************************
+
+int
+hpccomm_fmt_matrix_fread(hpccomm_fmt_matrix_t* x, FILE* infs)
+{
+  int ret = hpcfmt_int4_fread(&(x->kind), infs);
+  if (ret != HPCFMT_OK) {
+    return ret; // can be HPCFMT_EOF
+  }
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->domain), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->access), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->objId), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->dim), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(x->nnz), infs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fread(&(x->total), infs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fread(&(x->scale), infs));
+
+  if (x->kind >= HPCCOMM_NUM_KINDS || x->domain >= HPCCOMM_NUM_DOMAINS
+      || x->access >= HPCCOMM_NUM_ACCESSES) {
+    return HPCFMT_ERR;
+  }
+  return HPCFMT_OK;
+}
+
+
+int
+hpccomm_fmt_matrix_fwrite(hpccomm_fmt_matrix_t* x, FILE* outfs)
+{
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->kind, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->domain, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->access, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->objId, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->dim, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(x->nnz, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fwrite(x->total, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fwrite(x->scale, outfs));
+
+  return HPCFMT_OK;
+}
+
+
+const char*
+hpccomm_fmt_matrix_name(uint32_t kind, uint32_t domain, uint32_t access)
+{
+  static const char* names[HPCCOMM_NUM_ACCESSES][HPCCOMM_NUM_KINDS]
+                          [HPCCOMM_NUM_DOMAINS] = {
+    { { "fs",     "fs_core" },     { "ts",     "ts_core" },
+      { "as",     "as_core" } },
+    { { "war_fs", "war_fs_core" }, { "war_ts", "war_ts_core" },
+      { "war_as", "war_as_core" } },
+    { { "waw_fs", "waw_fs_core" }, { "waw_ts", "waw_ts_core" },
+      { "waw_as", "waw_as_core" } },
+  };
+
+  if (kind >= HPCCOMM_NUM_KINDS || domain >= HPCCOMM_NUM_DOMAINS
+      || access >= HPCCOMM_NUM_ACCESSES) {
+    return "unknown";
+  }
+  return names[access][kind][domain];
+}
+
+
+int
+hpccomm_fmt_entry_fread(hpccomm_fmt_entry_t* x, FILE* infs)
+{
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->row), infs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(x->col), infs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fread(&(x->value), infs));
+
+  return HPCFMT_OK;
+}
+
+
+int
+hpccomm_fmt_entry_fwrite(hpccomm_fmt_entry_t* x, FILE* outfs)
+{
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->row, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_int4_fwrite(x->col, outfs));
+  HPCFMT_ThrowIfError(hpcfmt_real8_fwrite(x->value, outfs));
+
+  return HPCFMT_OK;
+}
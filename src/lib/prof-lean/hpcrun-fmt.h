@@ -98,6 +98,9 @@ static const char HPCRUN_TraceFnmSfx[] = "hpctrace";
 // hpcrun log filename suffix
 static const char HPCRUN_LogFnmSfx[] = "log";
 
+// hpcrun snapshot filename infix: <name>.snapshot-<n>.hpcrun
+static const char HPCRUN_SnapshotFnmSfx[] = "snapshot";
+
 // hpcprof metric db filename suffix
 static const char HPCPROF_MetricDBSfx[] = "metric-db";
 
@@ -162,12 +165,29 @@ hpcrun_fmt_hdr_free(hpcrun_fmt_hdr_t* hdr, hpcfmt_free_fn dealloc);
 #define HPCRUN_FMT_NV_traceMinTime "trace-min-time"
 #define HPCRUN_FMT_NV_traceMaxTime "trace-max-time"
 
+// trace time stamp units per second (absent: microseconds) and the
+// clock they were taken with, e.g. "tsc 2893.412 MHz"
+#define HPCRUN_FMT_NV_traceTimeUnit "trace-time-unit"
+#define HPCRUN_FMT_NV_traceClock    "trace-clock"
+
+// in-flight snapshots: a thread's n-th snapshot file holds the metric
+// deltas since its (n-1)-th; the final profile carries the index after
+// the last snapshot. empty when snapshots are off.
+#define HPCRUN_FMT_NV_snapshot     "snapshot-index"
+#define HPCRUN_FMT_NV_snapshotTime "snapshot-time"
+
 
 //***************************************************************************
 // epoch-hdr
 //***************************************************************************
 
 static const char HPCRUN_FMT_EpochTag[] = "EPOCH___";
+
+// cct pruning under a memory budget: subtrees folded into "pruned"
+// children and the cct memory that reclaimed
+#define HPCRUN_FMT_NV_cctPrunedFolds "cct-pruned-folds"
+#define HPCRUN_FMT_NV_cctPrunedBytes "cct-pruned-bytes"
+
 static const int  HPCRUN_FMT_EpochTagLen = (sizeof(HPCRUN_FMT_EpochTag) - 1);
 
 
@@ -598,7 +618,8 @@ static const char HPCTRACE_FMT_Endian[]  = "b";                  // 1 byte
 
 typedef struct hpctrace_hdr_flags_bitfield {
   bool isDataCentric : 1;
-  uint64_t unused    : 63;
+  bool isNanosecond  : 1; // datum times are nanoseconds, not microseconds
+  uint64_t unused    : 62;
 } hpctrace_hdr_flags_bitfield;
 
 
@@ -610,6 +631,14 @@ typedef union hpctrace_hdr_flags_t {
 extern const hpctrace_hdr_flags_t hpctrace_hdr_flags_NULL;
 
 
+// time stamp units per second of the trace records
+static inline uint64_t
+hpctrace_hdr_flags_timeUnits(hpctrace_hdr_flags_t flags)
+{
+  return (flags.fields.isNanosecond) ? 1000000000 : 1000000;
+}
+
+
 #define HPCTRACE_FMT_MagicLenX   (sizeof(HPCTRACE_FMT_Magic) - 1)
 #define HPCTRACE_FMT_VersionLenX (sizeof(HPCTRACE_FMT_Version) - 1)
 #define HPCTRACE_FMT_EndianLenX  (sizeof(HPCTRACE_FMT_Endian) - 1)
@@ -660,7 +689,7 @@ hpctrace_fmt_hdr_fprint(hpctrace_fmt_hdr_t* hdr, FILE* fs);
 #define HPCRUN_FMT_MetricId_NULL (INT_MAX) // for Java, no UINT32_MAX
 
 typedef struct hpctrace_fmt_datum_t {
-  uint64_t time; // microseconds
+  uint64_t time; // microseconds; nanoseconds if hdr flags isNanosecond
   uint32_t cpId; // call path id (CCT leaf id); cf. HPCRUN_FMT_CCTNodeId_NULL
   uint32_t metricId;
 } hpctrace_fmt_datum_t;
@@ -731,6 +760,141 @@ hpcmetricDB_fmt_hdr_fwrite(hpcmetricDB_fmt_hdr_t* hdr, FILE* outfs);
 int
 hpcmetricDB_fmt_hdr_fprint(hpcmetricDB_fmt_hdr_t* hdr, FILE* outfs);
 
+
+//***************************************************************************
+// hpccomm: ComDetective communication matrices (located here for now)
+//***************************************************************************
+
+// One file per process:
+//
+//   <hdr> <matrix>*
+//
+//   <hdr>    ::= magic version endian rank pid hostname numMatrices
+//                numCPUs cpuToNUMA[numCPUs]
+//   <matrix> ::= kind domain access objId dim nnz total scale <entry>*nnz
+//   <entry>  ::= row col value
+//
+// A matrix is stored sparse and symmetrized: only cells with row <= col
+// and a non-zero value are written, and an off-diagonal entry holds
+// M[row][col] + M[col][row].  Hence the entries of a matrix sum to its
+// 'total'.  'scale' has already been applied to both.
+
+//***************************************************************************
+// [hpccomm] hdr
+//***************************************************************************
+
+static const char HPCCOMM_FMT_Magic[]   = "HPCRUN-comm_______"; // 18 bytes
+static const char HPCCOMM_FMT_Version[] = "01.00";              // 5 bytes
+static const char HPCCOMM_FMT_Endian[]  = "b";                  // 1 byte
+
+#define HPCCOMM_FMT_MagicLenX   (sizeof(HPCCOMM_FMT_Magic) - 1)
+#define HPCCOMM_FMT_VersionLenX (sizeof(HPCCOMM_FMT_Version) - 1)
+#define HPCCOMM_FMT_EndianLenX  (sizeof(HPCCOMM_FMT_Endian) - 1)
+
+static const int HPCCOMM_FMT_MagicLen   = HPCCOMM_FMT_MagicLenX;
+static const int HPCCOMM_FMT_VersionLen = HPCCOMM_FMT_VersionLenX;
+static const int HPCCOMM_FMT_EndianLen  = HPCCOMM_FMT_EndianLenX;
+
+#define HPCCOMM_FMT_HostLen   64
+#define HPCCOMM_FMT_NUMA_NULL (UINT32_MAX) // cpu with unknown NUMA domain
+#define HPCCOMM_FMT_MaxCPUs   (1u << 20)   // larger headers are rejected
+
+
+typedef struct hpccomm_fmt_hdr_t {
+
+  char versionStr[sizeof(HPCCOMM_FMT_Version)];
+  double version;
+  char endian;
+
+  int32_t  rank;      // MPI rank, or -1
+  uint64_t pid;
+  char     hostname[HPCCOMM_FMT_HostLen];
+  uint32_t numMatrices;
+
+  uint32_t  numCPUs;
+  uint32_t* cpuToNUMA; // numCPUs entries
+
+} hpccomm_fmt_hdr_t;
+
+
+int
+hpccomm_fmt_hdr_fread(hpccomm_fmt_hdr_t* hdr, FILE* infs,
+		      hpcfmt_alloc_fn alloc);
+
+// N.B.: not async safe
+int
+hpccomm_fmt_hdr_fwrite(hpccomm_fmt_hdr_t* hdr, FILE* outfs);
+
+int
+hpccomm_fmt_hdr_fprint(hpccomm_fmt_hdr_t* hdr, FILE* outfs);
+
+void
+hpccomm_fmt_hdr_free(hpccomm_fmt_hdr_t* hdr, hpcfmt_free_fn dealloc);
+
+
+//***************************************************************************
+// [hpccomm] matrix
+//***************************************************************************
+
+typedef enum {
+  HPCCOMM_KIND_FS,  // false sharing
+  HPCCOMM_KIND_TS,  // true sharing
+  HPCCOMM_KIND_AS,  // any sharing
+  HPCCOMM_NUM_KINDS
+} hpccomm_kind_t;
+
+typedef enum {
+  HPCCOMM_DOMAIN_THREAD,
+  HPCCOMM_DOMAIN_CORE,
+  HPCCOMM_NUM_DOMAINS
+} hpccomm_domain_t;
+
+typedef enum {
+  HPCCOMM_ACCESS_ANY,  // every trapping access
+  HPCCOMM_ACCESS_WAR,  // write after read
+  HPCCOMM_ACCESS_WAW,  // write after write
+  HPCCOMM_NUM_ACCESSES
+} hpccomm_access_t;
+
+#define HPCCOMM_FMT_ObjId_NULL (UINT32_MAX) // whole-program matrix
+
+
+typedef struct hpccomm_fmt_matrix_t {
+  uint32_t kind;    // hpccomm_kind_t
+  uint32_t domain;  // hpccomm_domain_t
+  uint32_t access;  // hpccomm_access_t
+  uint32_t objId;
+  uint32_t dim;     // rows (== columns)
+  uint64_t nnz;     // entries that follow
+  double   total;
+  double   scale;
+} hpccomm_fmt_matrix_t;
+
+
+typedef struct hpccomm_fmt_entry_t {
+  uint32_t row;
+  uint32_t col;
+  double   value;
+} hpccomm_fmt_entry_t;
+
+
+int
+hpccomm_fmt_matrix_fread(hpccomm_fmt_matrix_t* x, FILE* infs);
+
+int
+hpccomm_fmt_matrix_fwrite(hpccomm_fmt_matrix_t* x, FILE* outfs);
+
+// name used for the matrix in file names, e.g. "war_fs_core"
+const char*
+hpccomm_fmt_matrix_name(uint32_t kind, uint32_t domain, uint32_t access);
+
+int
+hpccomm_fmt_entry_fread(hpccomm_fmt_entry_t* x, FILE* infs);
+
+int
+hpccomm_fmt_entry_fwrite(hpccomm_fmt_entry_t* x, FILE* outfs);
+
+
 // --------------------------------------------------------------------------
 // additional sampling info
 // --------------------------------------------------------------------------
@@ -168,6 +168,7 @@ Profile::Profile(const std::string name)
 
   m_traceMinTime = UINT64_MAX;
   m_traceMaxTime = 0;
+  m_traceTimeUnits = 1000000;
 
   m_mMgr = new Metric::Mgr;
   m_isMetricMgrVirtual = false;
@@ -191,6 +192,34 @@ Profile::~Profile()
 }
 
 
+// convertTraceTime: trace time units are powers of ten (microseconds or
+// nanoseconds per second), so one divides the other
+static uint64_t
+convertTraceTime(uint64_t time, uint64_t fromUnits, uint64_t toUnits)
+{
+  if (fromUnits < toUnits) {
+    return time * (toUnits / fromUnits);
+  }
+  return time / (fromUnits / toUnits);
+}
+
+
+// isSameMetricLayout: whether y's metrics match x's beginning at 'xBeg'
+static bool
+isSameMetricLayout(const Metric::Mgr& x, uint xBeg, const Metric::Mgr& y)
+{
+  if (xBeg + y.size() > x.size()) {
+    return false;
+  }
+  for (uint i = 0; i < y.size(); ++i) {
+    if (x.metric(xBeg + i)->nameBase() != y.metric(i)->nameBase()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
 uint
 Profile::merge(Profile& y, int mergeTy, uint mrgFlag)
 {
@@ -238,15 +267,52 @@ Profile::merge(Profile& y, int mergeTy, uint mrgFlag)
   x.m_traceFileName = "";
   x.m_traceFileNameSet.insert(y.m_traceFileNameSet.begin(),
 			      y.m_traceFileNameSet.end());
-  x.m_traceMinTime = std::min(x.m_traceMinTime, y.m_traceMinTime);
-  x.m_traceMaxTime = std::max(x.m_traceMaxTime, y.m_traceMaxTime);
+  // the database's trace time line is in the unit of the first trace;
+  // the times of y's trace are converted to it (as hpcserver converts
+  // the trace records)
+  bool x_hasTrace = (x.m_traceMaxTime != 0);
+  bool y_hasTrace = (y.m_traceMaxTime != 0);
+  if (!x_hasTrace && y_hasTrace) {
+    x.m_traceTimeUnits = y.m_traceTimeUnits;
+  }
+  uint64_t y_traceMinTime = y.m_traceMinTime;
+  uint64_t y_traceMaxTime = y.m_traceMaxTime;
+  if (y_hasTrace && x.m_traceTimeUnits != y.m_traceTimeUnits) {
+    DIAG_WMsg(1, "CallPath::Profile::merge(): converting trace times from "
+	      << y.m_traceTimeUnits << " to " << x.m_traceTimeUnits
+	      << " units per second");
+    y_traceMinTime = convertTraceTime(y_traceMinTime, y.m_traceTimeUnits,
+				      x.m_traceTimeUnits);
+    y_traceMaxTime = convertTraceTime(y_traceMaxTime, y.m_traceTimeUnits,
+				      x.m_traceTimeUnits);
+  }
+  x.m_traceMinTime = std::min(x.m_traceMinTime, y_traceMinTime);
+  x.m_traceMaxTime = std::max(x.m_traceMaxTime, y_traceMaxTime);
 
 
   // -------------------------------------------------------
   // merge metrics
   // -------------------------------------------------------
+
+  // the snapshots and the final profile of a thread hold disjoint
+  // intervals of its run: add them into the thread's metrics
+  if (mergeTy == Merge_CreateMetric && y.m_snapshotSeries.size() == 1) {
+    SnapshotSeriesMap::const_iterator it =
+      x.m_snapshotSeries.find(y.m_snapshotSeries.begin()->first);
+    if (it != x.m_snapshotSeries.end()
+	&& isSameMetricLayout(*x.metricMgr(), it->second, *y.metricMgr())) {
+      mergeTy = (int)it->second;
+    }
+  }
+
   uint x_newMetricBegIdx = 0;
   uint firstMergedMetric = mergeMetrics(y, mergeTy, x_newMetricBegIdx);
+
+  for (SnapshotSeriesMap::const_iterator it = y.m_snapshotSeries.begin();
+       it != y.m_snapshotSeries.end(); ++it) {
+    x.m_snapshotSeries.insert(std::make_pair(it->first,
+					     firstMergedMetric + it->second));
+  }
   
   // -------------------------------------------------------
   // merge LoadMaps
@@ -851,6 +917,7 @@ Profile::writeXML_hdr(std::ostream& os, uint metricBeg, uint metricEnd,
        << " db-min-time=\"" << m_traceMinTime << "\""
        << " db-max-time=\"" << m_traceMaxTime << "\""
        << " db-header-sz=\"" << HPCTRACE_FMT_HeaderLen << "\""
+       << " u=\"" << m_traceTimeUnits << "\""
        << "/>\n";
     os << "  </TraceDBTable>\n";
   }
@@ -1175,6 +1242,23 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
     tidStr = val;
   }
 
+  // -------------------------
+  // in-flight snapshot: one interval of a thread's run
+  // -------------------------
+  string snapshotStr, threadKey;
+
+  val = hpcfmt_nvpairList_search(&(hdr.nvps), HPCRUN_FMT_NV_snapshot);
+  if (val) {
+    snapshotStr = val;
+  }
+
+  if (!snapshotStr.empty()) {
+    const char* hostStr = hpcfmt_nvpairList_search(&(hdr.nvps), HPCRUN_FMT_NV_hostid);
+    const char* pidStr = hpcfmt_nvpairList_search(&(hdr.nvps), HPCRUN_FMT_NV_pid);
+    threadKey = string((hostStr) ? hostStr : "") + ":" + ((pidStr) ? pidStr : "")
+      + ":" + tidStr;
+  }
+
   // -------------------------
   // trace information
   // -------------------------
@@ -1197,6 +1281,13 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
     if (val[0] != '\0') { traceMaxTime = StrUtil::toUInt64(traceMaxTimeStr); }
   }
 
+  // absent in profiles of older hpcruns: microseconds
+  uint64_t traceTimeUnits = 1000000;
+  val = hpcfmt_nvpairList_search(&(hdr.nvps), HPCRUN_FMT_NV_traceTimeUnit);
+  if (val && val[0] != '\0') {
+    traceTimeUnits = StrUtil::toUInt64(val);
+  }
+
   haveTrace = (traceMinTime != 0 && traceMaxTime != 0);
 
   // Note: 'profFileName' can be empty when reading from a memory stream
@@ -1248,6 +1339,11 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
     }
     prof->m_traceMinTime = traceMinTime;
     prof->m_traceMaxTime = traceMaxTime;
+    prof->m_traceTimeUnits = traceTimeUnits;
+  }
+
+  if (!threadKey.empty()) {
+    prof->m_snapshotSeries[threadKey] = 0;
   }
 
 
@@ -1583,11 +1679,13 @@ Profile::fmt_fwrite(const Profile& prof, FILE* fs, uint wFlags)
 
   string traceMinTimeStr = StrUtil::toStr(prof.m_traceMinTime);
   string traceMaxTimeStr = StrUtil::toStr(prof.m_traceMaxTime);
+  string traceTimeUnitStr = StrUtil::toStr(prof.m_traceTimeUnits);
 
   ret = hpcrun_fmt_hdr_fwrite(fs,
 			"TODO:hdr-name","TODO:hdr-value",
 			HPCRUN_FMT_NV_traceMinTime, traceMinTimeStr.c_str(),
 			HPCRUN_FMT_NV_traceMaxTime, traceMaxTimeStr.c_str(),
+			HPCRUN_FMT_NV_traceTimeUnit, traceTimeUnitStr.c_str(),
 			NULL);
   if (ret == HPCFMT_ERR) return HPCFMT_ERR;
 
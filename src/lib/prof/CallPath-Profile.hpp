@@ -67,6 +67,7 @@
 
 #include <vector>
 #include <set>
+#include <map>
 #include <string>
 
 
@@ -131,6 +132,21 @@ public:
   traceFileNameSet()
   { return m_traceFileNameSet; }
 
+
+  // snapshotSeries: For each thread whose profile is part of a series of
+  //   in-flight snapshots (host-id:process-id:thread-id), the index of
+  //   its first metric.  Merging another part of the series adds into
+  //   these metrics instead of creating new ones.
+  typedef std::map<std::string, uint> SnapshotSeriesMap;
+
+  const SnapshotSeriesMap&
+  snapshotSeries() const
+  { return m_snapshotSeries; }
+
+  SnapshotSeriesMap&
+  snapshotSeries()
+  { return m_snapshotSeries; }
+
   // enable/disable redundancy of procedure names
   // @param flag: true  -- redundancy is eliminated
   // 		  false -- redundancy is allowed
@@ -375,6 +391,9 @@ private:
   std::string m_traceFileName;   // non-empty, if relevant
   StringSet m_traceFileNameSet;
   uint64_t m_traceMinTime, m_traceMaxTime;
+  uint64_t m_traceTimeUnits; // trace time stamp units per second
+
+  SnapshotSeriesMap m_snapshotSeries;
 
   //typedef std::map<std::string, std::string> StrToStrMap;
   //StrToStrMap m_nvPairMap;
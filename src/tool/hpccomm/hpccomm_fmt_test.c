@@ -0,0 +1,259 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Round-trip test of the hpccomm file format (hpcrun-fmt.h): writes a
+// header, matrix records and entries the way hpcrun does, reads them
+// back the way hpccomm does and compares; then checks that damaged
+// headers are rejected rather than trusted. Run by 'make check'.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lib/prof-lean/hpcio.h>
+#include <lib/prof-lean/hpcfmt.h>
+#include <lib/prof-lean/hpcrun-fmt.h>
+
+static int failures = 0;
+
+#define CHECK(cond)							\
+  do {									\
+    if (!(cond)) {							\
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;							\
+    }									\
+  } while (0)
+
+static size_t allocs = 0;
+
+static void*
+countingAlloc(size_t nbytes)
+{
+  allocs++;
+  return malloc(nbytes);
+}
+
+
+static void
+makeHeader(hpccomm_fmt_hdr_t* hdr, uint32_t* numa, uint32_t numCPUs)
+{
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->rank = 3;
+  hdr->pid = 0x123456789aULL;
+  strcpy(hdr->hostname, "node017");
+  hdr->numMatrices = 2;
+  hdr->numCPUs = numCPUs;
+  for (uint32_t i = 0; i < numCPUs; i++) {
+    numa[i] = (i % 5 == 4) ? HPCCOMM_FMT_NUMA_NULL : i / 8;
+  }
+  hdr->cpuToNUMA = numa;
+}
+
+
+static void
+testRoundTrip(void)
+{
+  uint32_t numa[16];
+  hpccomm_fmt_hdr_t hdr;
+  makeHeader(&hdr, numa, 16);
+
+  hpccomm_fmt_matrix_t mats[2] = {
+    { .kind = HPCCOMM_KIND_FS, .domain = HPCCOMM_DOMAIN_THREAD,
+      .access = HPCCOMM_ACCESS_ANY, .objId = HPCCOMM_FMT_ObjId_NULL,
+      .dim = 16, .nnz = 3, .total = 42.5, .scale = 1.0 },
+    { .kind = HPCCOMM_KIND_TS, .domain = HPCCOMM_DOMAIN_CORE,
+      .access = HPCCOMM_ACCESS_WAW, .objId = 7,
+      .dim = 8, .nnz = 1, .total = 0.25, .scale = 2.5 },
+  };
+  hpccomm_fmt_entry_t entries[4] = {
+    { .row = 0,  .col = 1,  .value = 10.0 },
+    { .row = 15, .col = 2,  .value = 32.0 },
+    { .row = 7,  .col = 7,  .value = 0.5 },
+    { .row = 1,  .col = 0,  .value = 0.25 },
+  };
+
+  FILE* fs = tmpfile();
+  CHECK(fs != NULL);
+  if (!fs) return;
+
+  CHECK(hpccomm_fmt_hdr_fwrite(&hdr, fs) == HPCFMT_OK);
+  int e = 0;
+  for (int m = 0; m < 2; m++) {
+    CHECK(hpccomm_fmt_matrix_fwrite(&mats[m], fs) == HPCFMT_OK);
+    for (uint64_t k = 0; k < mats[m].nnz; k++) {
+      CHECK(hpccomm_fmt_entry_fwrite(&entries[e++], fs) == HPCFMT_OK);
+    }
+  }
+  rewind(fs);
+
+  hpccomm_fmt_hdr_t in;
+  CHECK(hpccomm_fmt_hdr_fread(&in, fs, countingAlloc) == HPCFMT_OK);
+  CHECK(strcmp(in.versionStr, HPCCOMM_FMT_Version) == 0);
+  CHECK(in.endian == HPCCOMM_FMT_Endian[0]);
+  CHECK(in.rank == hdr.rank);
+  CHECK(in.pid == hdr.pid);
+  CHECK(strcmp(in.hostname, hdr.hostname) == 0);
+  CHECK(in.numMatrices == hdr.numMatrices);
+  CHECK(in.numCPUs == hdr.numCPUs);
+  CHECK(in.cpuToNUMA != NULL
+	&& memcmp(in.cpuToNUMA, numa, sizeof(numa)) == 0);
+  hpccomm_fmt_hdr_free(&in, free);
+
+  e = 0;
+  for (uint32_t m = 0; m < in.numMatrices; m++) {
+    hpccomm_fmt_matrix_t rec;
+    CHECK(hpccomm_fmt_matrix_fread(&rec, fs) == HPCFMT_OK);
+    CHECK(memcmp(&rec, &mats[m], sizeof(rec)) == 0);
+    for (uint64_t k = 0; k < rec.nnz; k++) {
+      hpccomm_fmt_entry_t x;
+      CHECK(hpccomm_fmt_entry_fread(&x, fs) == HPCFMT_OK);
+      CHECK(x.row == entries[e].row && x.col == entries[e].col
+	    && x.value == entries[e].value);
+      e++;
+    }
+  }
+  // the matrix list ends at end of file
+  hpccomm_fmt_matrix_t rec;
+  CHECK(hpccomm_fmt_matrix_fread(&rec, fs) == HPCFMT_EOF);
+
+  fclose(fs);
+}
+
+
+// a header whose cpu count is patched to 'numCPUs' after it is written
+static FILE*
+writePatchedHeader(uint32_t numCPUs)
+{
+  uint32_t numa[4];
+  hpccomm_fmt_hdr_t hdr;
+  makeHeader(&hdr, numa, 4);
+
+  FILE* fs = tmpfile();
+  if (!fs) return NULL;
+  hpccomm_fmt_hdr_fwrite(&hdr, fs);
+
+  // numCPUs follows magic, version, endian, rank, pid, host, numMatrices
+  long off = HPCCOMM_FMT_MagicLen + HPCCOMM_FMT_VersionLen
+    + HPCCOMM_FMT_EndianLen + 4 + 8 + HPCCOMM_FMT_HostLen + 4;
+  fseek(fs, off, SEEK_SET);
+  hpcfmt_int4_fwrite(numCPUs, fs);
+  rewind(fs);
+  return fs;
+}
+
+
+static void
+testRejects(void)
+{
+  hpccomm_fmt_hdr_t in;
+
+  // a cpu count beyond the bound is rejected without an allocation
+  FILE* fs = writePatchedHeader(UINT32_MAX);
+  CHECK(fs != NULL);
+  if (fs) {
+    allocs = 0;
+    CHECK(hpccomm_fmt_hdr_fread(&in, fs, countingAlloc) == HPCFMT_ERR);
+    CHECK(allocs == 0);
+    fclose(fs);
+  }
+
+  fs = writePatchedHeader(HPCCOMM_FMT_MaxCPUs + 1);
+  CHECK(fs != NULL);
+  if (fs) {
+    allocs = 0;
+    CHECK(hpccomm_fmt_hdr_fread(&in, fs, countingAlloc) == HPCFMT_ERR);
+    CHECK(allocs == 0);
+    fclose(fs);
+  }
+
+  // a count within the bound but past the end of the file
+  fs = writePatchedHeader(1000);
+  CHECK(fs != NULL);
+  if (fs) {
+    CHECK(hpccomm_fmt_hdr_fread(&in, fs, countingAlloc) == HPCFMT_ERR);
+    free(in.cpuToNUMA);
+    fclose(fs);
+  }
+
+  // the writer refuses what the reader would reject
+  uint32_t numa[4];
+  hpccomm_fmt_hdr_t hdr;
+  makeHeader(&hdr, numa, 4);
+  hdr.numCPUs = HPCCOMM_FMT_MaxCPUs + 1;
+  fs = tmpfile();
+  if (fs) {
+    CHECK(hpccomm_fmt_hdr_fwrite(&hdr, fs) == HPCFMT_ERR);
+    fclose(fs);
+  }
+
+  // bad magic
+  fs = tmpfile();
+  if (fs) {
+    fputs("HPCRUN-comX_______01.00b", fs);
+    rewind(fs);
+    CHECK(hpccomm_fmt_hdr_fread(&in, fs, countingAlloc) == HPCFMT_ERR);
+    fclose(fs);
+  }
+}
+
+
+int
+main(void)
+{
+  testRoundTrip();
+  testRejects();
+
+  if (failures) {
+    fprintf(stderr, "hpccomm_fmt_test: %d checks failed\n", failures);
+    return 1;
+  }
+  printf("hpccomm_fmt_test: ok\n");
+  return 0;
+}
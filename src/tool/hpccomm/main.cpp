@@ -0,0 +1,629 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   src/tool/hpccomm/main.cpp
+//
+// Purpose:
+//   merge ComDetective communication matrices across ranks and nodes
+//
+// Description:
+//   Reads the sparse <exe>-<pid>.hpccomm files written by hpcrun, and the
+//   per-object <exe>-<pid>-<obj>-<type>_matrix_rank_<r>.csv files, from
+//   one or more measurement directories in parallel and prints
+//     - every matrix kind summed over all processes,
+//     - the top communicating pairs of one matrix,
+//     - per-object totals,
+//     - a NUMA-domain rollup of the core-level matrix of each node.
+//
+//***************************************************************************
+
+//***************************************************************************
+// system include files
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <regex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//***************************************************************************
+// local include files
+//***************************************************************************
+
+#include <lib/prof-lean/hpcio.h>
+#include <lib/prof-lean/hpcfmt.h>
+#include <lib/prof-lean/hpcrun-fmt.h>
+
+
+
+//***************************************************************************
+// local types and data
+//***************************************************************************
+
+static const int NumMatrices =
+  HPCCOMM_NUM_ACCESSES * HPCCOMM_NUM_KINDS * HPCCOMM_NUM_DOMAINS;
+
+static inline int
+matrixIndex(uint32_t kind, uint32_t domain, uint32_t access)
+{
+  return (access * HPCCOMM_NUM_KINDS + kind) * HPCCOMM_NUM_DOMAINS + domain;
+}
+
+static inline const char*
+matrixName(int idx)
+{
+  uint32_t domain = idx % HPCCOMM_NUM_DOMAINS;
+  uint32_t kind   = (idx / HPCCOMM_NUM_DOMAINS) % HPCCOMM_NUM_KINDS;
+  uint32_t access = idx / (HPCCOMM_NUM_DOMAINS * HPCCOMM_NUM_KINDS);
+  return hpccomm_fmt_matrix_name(kind, domain, access);
+}
+
+// size of one hpccomm entry on disk: row, col, value
+static const long EntryFileSz = 4 + 4 + 8;
+
+
+// Everything kept from one <exe>-<pid>.hpccomm file.
+struct ProcessData {
+  std::string path;
+  bool ok;
+
+  int32_t rank;
+  uint64_t pid;
+  std::string host;
+  std::vector<uint32_t> cpuToNUMA;
+
+  double totals[NumMatrices];
+
+  // entries of the matrix selected for the pair report, and of its
+  // core-level counterpart for the NUMA rollup
+  std::vector<hpccomm_fmt_entry_t> pairEntries;
+  std::vector<hpccomm_fmt_entry_t> numaEntries;
+
+  // per-object matrices found in the file: (matrix, object id) -> total
+  std::map<std::pair<int, uint32_t>, double> objTotals;
+};
+
+
+// One per-object CSV matrix.
+struct ObjectData {
+  std::string path;
+  bool ok;
+
+  std::string matrix;
+  uint32_t objId;
+  double total;
+};
+
+
+struct Options {
+  int numThreads;
+  int topN;
+  int pairMatrix;
+  int numaMatrix;
+};
+
+
+//***************************************************************************
+// reading
+//***************************************************************************
+
+static void*
+allocFn(size_t nbytes)
+{
+  return malloc(nbytes);
+}
+
+
+static void
+readProcess(ProcessData& pd, const Options& opts)
+{
+  pd.ok = false;
+  std::fill(pd.totals, pd.totals + NumMatrices, 0.0);
+
+  FILE* fs = fopen(pd.path.c_str(), "r");
+  if (!fs) {
+    return;
+  }
+  std::vector<char> buf(HPCIO_RWBufferSz);
+  setvbuf(fs, buf.data(), _IOFBF, HPCIO_RWBufferSz);
+
+  hpccomm_fmt_hdr_t hdr;
+  if (hpccomm_fmt_hdr_fread(&hdr, fs, allocFn) != HPCFMT_OK) {
+    fclose(fs);
+    return;
+  }
+  pd.rank = hdr.rank;
+  pd.pid = hdr.pid;
+  pd.host = hdr.hostname;
+  pd.cpuToNUMA.assign(hdr.cpuToNUMA, hdr.cpuToNUMA + hdr.numCPUs);
+  uint32_t numMatrices = hdr.numMatrices;
+  hpccomm_fmt_hdr_free(&hdr, free);
+
+  for (uint32_t m = 0; m < numMatrices; ++m) {
+    hpccomm_fmt_matrix_t rec;
+    if (hpccomm_fmt_matrix_fread(&rec, fs) != HPCFMT_OK) {
+      fclose(fs);
+      return;
+    }
+    int idx = matrixIndex(rec.kind, rec.domain, rec.access);
+
+    std::vector<hpccomm_fmt_entry_t>* keep = NULL;
+    if (rec.objId == HPCCOMM_FMT_ObjId_NULL) {
+      pd.totals[idx] += rec.total;
+      if (idx == opts.pairMatrix) {
+	keep = &pd.pairEntries;
+      }
+      else if (idx == opts.numaMatrix) {
+	keep = &pd.numaEntries;
+      }
+    }
+    else {
+      pd.objTotals[std::make_pair(idx, rec.objId)] += rec.total;
+    }
+
+    if (!keep) {
+      // entries have a fixed size on disk; skip the ones we do not need
+      if (fseek(fs, (long)rec.nnz * EntryFileSz, SEEK_CUR) != 0) {
+	fclose(fs);
+	return;
+      }
+      continue;
+    }
+    keep->reserve(keep->size() + rec.nnz);
+    for (uint64_t e = 0; e < rec.nnz; ++e) {
+      hpccomm_fmt_entry_t entry;
+      if (hpccomm_fmt_entry_fread(&entry, fs) != HPCFMT_OK) {
+	fclose(fs);
+	return;
+      }
+      keep->push_back(entry);
+    }
+  }
+  if (opts.pairMatrix == opts.numaMatrix) {
+    pd.numaEntries = pd.pairEntries;
+  }
+
+  fclose(fs);
+  pd.ok = true;
+}
+
+
+// Per-object CSVs hold the dense symmetrized matrix (cell (i,j) is
+// M[i][j] + M[j][i]), so every communication is counted twice.
+static void
+readObject(ObjectData& od)
+{
+  od.ok = false;
+  od.total = 0;
+
+  FILE* fs = fopen(od.path.c_str(), "r");
+  if (!fs) {
+    return;
+  }
+  std::vector<char> buf(HPCIO_RWBufferSz);
+  setvbuf(fs, buf.data(), _IOFBF, HPCIO_RWBufferSz);
+
+  char cell[64];
+  int len = 0;
+  double sum = 0;
+  for (int c = fgetc(fs); ; c = fgetc(fs)) {
+    if (c == ',' || c == '\n' || c == EOF) {
+      cell[len] = '\0';
+      if (len > 0) {
+	sum += strtod(cell, NULL);
+      }
+      len = 0;
+      if (c == EOF) {
+	break;
+      }
+    }
+    else if (len < (int)sizeof(cell) - 1) {
+      cell[len++] = (char)c;
+    }
+  }
+  fclose(fs);
+
+  od.total = sum / 2;
+  od.ok = true;
+}
+
+
+//***************************************************************************
+// file discovery
+//***************************************************************************
+
+static const std::regex ProcessFileRE(".*-[0-9]+\\.hpccomm$");
+static const std::regex ObjectFileRE(
+  ".*-[0-9]+-([0-9]+)-([a-z_]+)_matrix_rank_[0-9]+\\.csv$");
+
+
+static void
+classifyFile(const std::string& path, std::vector<ProcessData>& procs,
+	     std::vector<ObjectData>& objs)
+{
+  std::smatch m;
+  if (std::regex_match(path, ProcessFileRE)) {
+    ProcessData pd;
+    pd.path = path;
+    procs.push_back(pd);
+  }
+  else if (std::regex_match(path, m, ObjectFileRE)) {
+    ObjectData od;
+    od.path = path;
+    od.objId = (uint32_t)strtoul(m[1].str().c_str(), NULL, 10);
+    od.matrix = m[2].str();
+    objs.push_back(od);
+  }
+}
+
+
+static void
+collectFiles(const char* arg, std::vector<ProcessData>& procs,
+	     std::vector<ObjectData>& objs)
+{
+  struct stat st;
+  if (stat(arg, &st) != 0) {
+    fprintf(stderr, "hpccomm: cannot access %s\n", arg);
+    exit(-1);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    classifyFile(arg, procs, objs);
+    return;
+  }
+
+  DIR* dir = opendir(arg);
+  if (!dir) {
+    fprintf(stderr, "hpccomm: cannot open directory %s\n", arg);
+    exit(-1);
+  }
+  std::vector<std::string> names;
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != NULL) {
+    names.push_back(ent->d_name);
+  }
+  closedir(dir);
+
+  // keep the output independent of directory order
+  std::sort(names.begin(), names.end());
+  for (const std::string& nm : names) {
+    classifyFile(std::string(arg) + "/" + nm, procs, objs);
+  }
+}
+
+
+//***************************************************************************
+// reports
+//***************************************************************************
+
+static void
+reportTotals(const std::vector<ProcessData>& procs)
+{
+  double totals[NumMatrices] = { 0 };
+  double maxProc[NumMatrices] = { 0 };
+  for (const ProcessData& pd : procs) {
+    for (int i = 0; i < NumMatrices; ++i) {
+      totals[i] += pd.totals[i];
+      maxProc[i] = std::max(maxProc[i], pd.totals[i]);
+    }
+  }
+
+  printf("== matrix totals over %zu processes ==\n", procs.size());
+  printf("%-14s %18s %18s\n", "matrix", "total", "max/process");
+  for (int i = 0; i < NumMatrices; ++i) {
+    printf("%-14s %18.2lf %18.2lf\n", matrixName(i), totals[i], maxProc[i]);
+  }
+  printf("\n");
+}
+
+
+// Core ids name the same hardware across processes on a node, so core
+// pairs are merged per host; thread ids are per process.
+static void
+reportTopPairs(const std::vector<ProcessData>& procs, const Options& opts)
+{
+  typedef std::tuple<std::string, uint32_t, uint32_t> PairKey;
+
+  bool isCore = (opts.pairMatrix % HPCCOMM_NUM_DOMAINS) == HPCCOMM_DOMAIN_CORE;
+  std::map<PairKey, double> pairs;
+  for (const ProcessData& pd : procs) {
+    std::string owner;
+    if (isCore) {
+      owner = pd.host;
+    }
+    else {
+      char buf[64];
+      snprintf(buf, sizeof(buf), (pd.rank >= 0) ? "rank %d" : "pid %d",
+	       (pd.rank >= 0) ? pd.rank : (int)pd.pid);
+      owner = buf;
+    }
+    for (const hpccomm_fmt_entry_t& e : pd.pairEntries) {
+      pairs[PairKey(owner, e.row, e.col)] += e.value;
+    }
+  }
+
+  std::vector<std::pair<double, PairKey> > ranked;
+  ranked.reserve(pairs.size());
+  for (const auto& p : pairs) {
+    ranked.push_back(std::make_pair(p.second, p.first));
+  }
+  size_t n = std::min(ranked.size(), (size_t)opts.topN);
+  std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+		    [](const std::pair<double, PairKey>& a,
+		       const std::pair<double, PairKey>& b) {
+		      return a.first > b.first;
+		    });
+
+  const char* unit = isCore ? "core" : "thread";
+  printf("== top %zu %s pairs of %s ==\n", n, unit, matrixName(opts.pairMatrix));
+  for (size_t i = 0; i < n; ++i) {
+    const PairKey& k = ranked[i].second;
+    printf("%4zu  %-24s %s %5u <-> %s %5u  %18.2lf\n", i + 1,
+	   std::get<0>(k).c_str(), unit, std::get<1>(k), unit, std::get<2>(k),
+	   ranked[i].first);
+  }
+  printf("\n");
+}
+
+
+static void
+reportObjects(const std::vector<ProcessData>& procs,
+	      const std::vector<ObjectData>& objs)
+{
+  // (matrix name, object id) -> (total, files)
+  std::map<std::pair<std::string, uint32_t>, std::pair<double, int> > agg;
+  for (const ProcessData& pd : procs) {
+    for (const auto& o : pd.objTotals) {
+      auto& a = agg[std::make_pair(std::string(matrixName(o.first.first)),
+				   o.first.second)];
+      a.first += o.second;
+      a.second++;
+    }
+  }
+  for (const ObjectData& od : objs) {
+    if (!od.ok) {
+      continue;
+    }
+    auto& a = agg[std::make_pair(od.matrix, od.objId)];
+    a.first += od.total;
+    a.second++;
+  }
+  if (agg.empty()) {
+    return;
+  }
+
+  std::vector<std::pair<std::pair<std::string, uint32_t>, std::pair<double, int> > >
+    rows(agg.begin(), agg.end());
+  std::stable_sort(rows.begin(), rows.end(),
+		   [](const decltype(rows)::value_type& a,
+		      const decltype(rows)::value_type& b) {
+		     if (a.first.first != b.first.first) {
+		       return a.first.first < b.first.first;
+		     }
+		     return a.second.first > b.second.first;
+		   });
+
+  printf("== per-object totals ==\n");
+  printf("%-14s %10s %18s %8s\n", "matrix", "object", "total", "files");
+  for (const auto& r : rows) {
+    printf("%-14s %10u %18.2lf %8d\n", r.first.first.c_str(), r.first.second,
+	   r.second.first, r.second.second);
+  }
+  printf("\n");
+}
+
+
+static void
+reportNUMA(const std::vector<ProcessData>& procs, const Options& opts)
+{
+  // host -> (numa a, numa b) -> volume, with a <= b
+  std::map<std::string, std::map<std::pair<uint32_t, uint32_t>, double> > hosts;
+  for (const ProcessData& pd : procs) {
+    auto& rollup = hosts[pd.host];
+    for (const hpccomm_fmt_entry_t& e : pd.numaEntries) {
+      uint32_t a = (e.row < pd.cpuToNUMA.size()) ? pd.cpuToNUMA[e.row]
+	                                          : HPCCOMM_FMT_NUMA_NULL;
+      uint32_t b = (e.col < pd.cpuToNUMA.size()) ? pd.cpuToNUMA[e.col]
+	                                          : HPCCOMM_FMT_NUMA_NULL;
+      rollup[std::make_pair(std::min(a, b), std::max(a, b))] += e.value;
+    }
+  }
+
+  printf("== NUMA rollup of %s ==\n", matrixName(opts.numaMatrix));
+  for (const auto& h : hosts) {
+    double intra = 0, inter = 0, unknown = 0;
+    for (const auto& c : h.second) {
+      if (c.first.second == HPCCOMM_FMT_NUMA_NULL) {
+	unknown += c.second;
+      }
+      else if (c.first.first == c.first.second) {
+	intra += c.second;
+      }
+      else {
+	inter += c.second;
+      }
+    }
+    double total = intra + inter + unknown;
+    printf("%s: total %.2lf, intra-NUMA %.2lf (%.1lf%%), inter-NUMA %.2lf (%.1lf%%)",
+	   h.first.c_str(), total, intra, total ? 100 * intra / total : 0.0,
+	   inter, total ? 100 * inter / total : 0.0);
+    if (unknown) {
+      printf(", unknown %.2lf", unknown);
+    }
+    printf("\n");
+    for (const auto& c : h.second) {
+      if (c.first.second == HPCCOMM_FMT_NUMA_NULL) {
+	continue;
+      }
+      printf("  node %u <-> node %u  %18.2lf\n", c.first.first,
+	     c.first.second, c.second);
+    }
+  }
+  printf("\n");
+}
+
+
+//***************************************************************************
+// interface functions
+//***************************************************************************
+
+static void
+usage(const char* cmd)
+{
+  fprintf(stderr,
+	  "usage: %s [-j threads] [-n top] [-m matrix] "
+	  "<measurement-dir | file>...\n"
+	  "  -j threads  threads used to read files\n"
+	  "  -n top      number of communicating pairs to report (default 10)\n"
+	  "  -m matrix   matrix for the pair report, e.g. as, war_fs_core\n"
+	  "              (default as_core)\n", cmd);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  Options opts;
+  opts.numThreads = 0;
+  opts.topN = 10;
+  opts.pairMatrix = matrixIndex(HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_CORE,
+				HPCCOMM_ACCESS_ANY);
+
+  int c;
+  while ((c = getopt(argc, argv, "j:n:m:h")) != -1) {
+    switch (c) {
+    case 'j':
+      opts.numThreads = atoi(optarg);
+      break;
+    case 'n':
+      opts.topN = atoi(optarg);
+      break;
+    case 'm': {
+      int idx = -1;
+      for (int i = 0; i < NumMatrices; ++i) {
+	if (strcmp(optarg, matrixName(i)) == 0) {
+	  idx = i;
+	}
+      }
+      if (idx < 0) {
+	fprintf(stderr, "%s: unknown matrix '%s'\n", argv[0], optarg);
+	exit(-1);
+      }
+      opts.pairMatrix = idx;
+      break;
+    }
+    default:
+      usage(argv[0]);
+      exit((c == 'h') ? 0 : -1);
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    exit(-1);
+  }
+
+  // the NUMA rollup uses the core-level counterpart of the pair matrix
+  opts.numaMatrix = opts.pairMatrix - (opts.pairMatrix % HPCCOMM_NUM_DOMAINS)
+    + HPCCOMM_DOMAIN_CORE;
+
+#ifdef _OPENMP
+  if (opts.numThreads > 0) {
+    omp_set_num_threads(opts.numThreads);
+  }
+#endif
+
+  std::vector<ProcessData> procs;
+  std::vector<ObjectData> objs;
+  for (int i = optind; i < argc; ++i) {
+    collectFiles(argv[i], procs, objs);
+  }
+  if (procs.empty() && objs.empty()) {
+    fprintf(stderr, "%s: no communication matrices found\n", argv[0]);
+    exit(-1);
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < procs.size(); ++i) {
+    readProcess(procs[i], opts);
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (size_t i = 0; i < objs.size(); ++i) {
+    readObject(objs[i]);
+  }
+
+  std::vector<ProcessData> good;
+  for (ProcessData& pd : procs) {
+    if (!pd.ok) {
+      fprintf(stderr, "%s: skipping unreadable file %s\n", argv[0],
+	      pd.path.c_str());
+      continue;
+    }
+    good.push_back(std::move(pd));
+  }
+
+  reportTotals(good);
+  reportTopPairs(good, opts);
+  reportObjects(good, objs);
+  reportNUMA(good, opts);
+
+  return 0;
+}
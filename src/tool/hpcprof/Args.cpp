@@ -111,6 +111,10 @@ Args::parse(int argc, const char* const argv[])
     hpcprof_forceMetrics = true;
   }
 
+  if (parser.isOpt("checkpoint")) {
+    hpcprof_checkpoint = parser.getOptArg("checkpoint");
+  }
+
   // Currently, hpcprof does not generate thread-level metric db
   db_makeMetricDB = false;
 }
@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Checks that 'hpcprof --checkpoint' gives the database of a plain run:
+# a checkpoint made from the first half of a measurement directory and
+# then updated with the second half must produce the same experiment.xml
+# as hpcprof over all of it, as must rereading the unchanged checkpoint
+# and rebuilding it after one measurement file was dropped.
+#
+# Measurements come from $HPCTOOLKIT_TEST_MEASUREMENTS if set (a
+# directory with at least two .hpcrun files); otherwise the test runs
+# $HPCRUN (default: hpcrun on PATH) over a few short processes.  The
+# test is skipped when neither is available.
+#
+# Run by 'make check' in src/tool/hpcprof; HPCPROF defaults to the
+# hpcprof-bin just built.
+#
+
+skip=77
+
+HPCRUN="${HPCRUN:-hpcrun}"
+HPCPROF="${HPCPROF:-./hpcprof-bin}"
+
+if ! "$HPCPROF" --version >/dev/null 2>&1 ; then
+    echo "$0: cannot run $HPCPROF, skipping"
+    exit $skip
+fi
+
+work=`mktemp -d "${TMPDIR:-/tmp}/hpcprof-ckpt.XXXXXX"` || exit 1
+trap 'rm -rf "$work"' 0
+
+meas="$HPCTOOLKIT_TEST_MEASUREMENTS"
+if test -z "$meas" ; then
+    if ! command -v "$HPCRUN" >/dev/null 2>&1 ; then
+        echo "$0: no $HPCRUN and no HPCTOOLKIT_TEST_MEASUREMENTS, skipping"
+        exit $skip
+    fi
+    meas="$work/measurements"
+    for n in 1 2 3 4 ; do
+        "$HPCRUN" -e CPUTIME@1000 -o "$meas" \
+            sh -c 'i=0; while test $i -lt 200000; do i=$((i+1)); done' \
+            >/dev/null 2>&1
+    done
+fi
+
+files=`ls "$meas"/*.hpcrun 2>/dev/null | sort`
+nfiles=`echo "$files" | grep -c .`
+if test "$nfiles" -lt 2 ; then
+    echo "$0: fewer than two measurement files in $meas, skipping"
+    exit $skip
+fi
+
+half=`expr $nfiles / 2`
+first=`echo "$files" | head -n $half`
+most=`echo "$files" | head -n \`expr $nfiles - 1\``
+ckpt="$work/checkpoint"
+
+prof() {
+    db="$1"; shift
+    "$HPCPROF" -o "$work/$db" "$@" >"$work/$db.log" 2>&1 || {
+        echo "$0: hpcprof failed for $db:"
+        cat "$work/$db.log"
+        exit 1
+    }
+}
+
+same() {
+    if ! cmp -s "$work/$1/experiment.xml" "$work/$2/experiment.xml" ; then
+        echo "$0: $2/experiment.xml differs from $1/experiment.xml:"
+        diff "$work/$1/experiment.xml" "$work/$2/experiment.xml" | head -n 40
+        exit 1
+    fi
+}
+
+prof fresh $files
+prof fresh-most $most
+
+# checkpoint the first half, then add the rest
+prof ckpt-first --checkpoint "$ckpt" $first
+prof ckpt-all --checkpoint "$ckpt" $files
+same fresh ckpt-all
+
+# all files are in the checkpoint: nothing is read again
+prof ckpt-again --checkpoint "$ckpt" $files
+same fresh ckpt-again
+
+# a file is no longer an input: the checkpoint is rebuilt without it
+prof ckpt-most --checkpoint "$ckpt" $most
+same fresh-most ckpt-most
+
+exit 0
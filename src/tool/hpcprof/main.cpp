@@ -177,8 +177,16 @@ realmain(int argc, char* const* argv)
   }
   uint mrgFlags = (Prof::CCT::MrgFlg_NormalizeTraceFileY);
 
-  Prof::CallPath::Profile* prof =
-    Analysis::CallPath::read(*nArgs.paths, groupMap, mergeTy, rFlags, mrgFlags);
+  Prof::CallPath::Profile* prof = NULL;
+  if (!args.hpcprof_checkpoint.empty()) {
+    prof = Analysis::CallPath::readIncremental(*nArgs.paths, groupMap, mergeTy,
+					       rFlags, mrgFlags,
+					       args.hpcprof_checkpoint);
+  }
+  else {
+    prof = Analysis::CallPath::read(*nArgs.paths, groupMap, mergeTy,
+				    rFlags, mrgFlags);
+  }
 
   prof->disable_redundancy(args.remove_redundancy);
 
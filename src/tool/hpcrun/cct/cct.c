@@ -82,13 +82,17 @@
 #include <lib/prof-lean/hpcrun-fmt.h>
 #include <lib/prof-lean/hpcrun-fmt.h>
 #include <hpcrun/hpcrun_return_codes.h>
+#include <lib/prof-lean/stdatomic.h>
 
 #include "cct.h"
 #include "cct_addr.h"
+#include "cct_prune.h"
 #include "cct2metrics.h"
 
 //***************************** concrete data structure definition **********
 
+#define CCT_NO_FOLD_MARKED  0x2   // not folded by the next fold pass
+
 struct cct_node_t {
 
   // ---------------------------------------------------------
@@ -104,6 +108,16 @@ struct cct_node_t {
   cct_addr_t addr;
 
   bool is_leaf;
+
+  // CCT_NO_FOLD_* bits: protection from folding by the cct pruner
+  uint8_t no_fold;
+
+  // hpcrun_cct_pin count: a pinned node is never folded
+  atomic_uint_least32_t pins;
+
+  // set while a snapshot is written: the node is on a path to a
+  // non-zero metric
+  bool delta_live;
   
   // ---------------------------------------------------------
   // tree structure
@@ -150,7 +164,10 @@ cct_node_create(cct_addr_t* addr, cct_node_t* parent)
 
   // FIXME: when multiple epochs really work, this will always be freeable.
   // WARN ME (krentel) if/when we really use freeable memory.
-  if (ENABLED(FREEABLE)) {
+  if (hpcrun_cct_budget()) {
+    node = hpcrun_cct_mem_alloc(sz);
+  }
+  else if (ENABLED(FREEABLE)) {
     node = hpcrun_malloc_freeable(sz);
   }
   else {
@@ -171,6 +188,9 @@ cct_node_create(cct_addr_t* addr, cct_node_t* parent)
   node->right = NULL;
 
   node->is_leaf = false;
+  node->no_fold = 0;
+  atomic_init(&node->pins, 0);
+  node->delta_live = false;
 
   return node;
 }
@@ -542,6 +562,32 @@ hpcrun_cct_retained(cct_node_t* x)
   return (x->persistent_id & HPCRUN_FMT_RetainIdFlag);
 }
 
+// a pinned node (and with it, its call path) is never folded by
+// hpcrun_cct_fold_cold. pin nodes that other data structures point
+// to, and nodes handed to other threads. pins are counted, and each
+// pin is dropped with hpcrun_cct_unpin when its reference goes away.
+// the owner of the cct pins a node before it becomes visible to
+// other threads; another thread may then take pins of its own on it
+// as long as it knows one is held.
+void
+hpcrun_cct_pin(cct_node_t* x)
+{
+  if (x) atomic_fetch_add_explicit(&x->pins, 1, memory_order_relaxed);
+}
+
+void
+hpcrun_cct_unpin(cct_node_t* x)
+{
+  if (x) atomic_fetch_sub_explicit(&x->pins, 1, memory_order_release);
+}
+
+// protect a node from the next fold pass only. the pass clears the mark.
+void
+hpcrun_cct_mark_no_fold(cct_node_t* x)
+{
+  x->no_fold |= CCT_NO_FOLD_MARKED;
+}
+
 //
 // Walking functions section:
 //
@@ -664,6 +710,94 @@ hpcrun_cct_fwrite(cct2metrics_t* cct2metrics_map, cct_node_t* cct, FILE* fs, epo
   return HPCRUN_OK;
 }
 
+//
+// Delta writing helpers: a snapshot writes only the paths that lead
+// to a non-zero metric or to a retained node
+//
+
+static bool delta_mark_l(cct_node_t* node, write_arg_t* wa, size_t* n);
+
+static void
+delta_mark_set_l(cct_node_t* set, write_arg_t* wa, size_t* n, bool* live)
+{
+  if (! set) return;
+  delta_mark_set_l(set->left, wa, n, live);
+  delta_mark_set_l(set->right, wa, n, live);
+  if (delta_mark_l(set, wa, n)) *live = true;
+}
+
+static bool
+delta_mark_l(cct_node_t* node, write_arg_t* wa, size_t* n)
+{
+  bool live = hpcrun_cct_retained(node) ||
+    ! hpcrun_metric_set_is_zero(hpcrun_get_metric_set_specific(&(wa->cct2metrics_map), node));
+  delta_mark_set_l(node->children, wa, n, &live);
+
+  node->delta_live = live;
+  if (live) (*n)++;
+  return live;
+}
+
+static void delta_write_l(cct_node_t* node, write_arg_t* wa);
+
+static void
+delta_write_set_l(cct_node_t* set, write_arg_t* wa)
+{
+  if (! set) return;
+  delta_write_set_l(set->left, wa);
+  delta_write_set_l(set->right, wa);
+  delta_write_l(set, wa);
+}
+
+// preorder, like hpcrun_cct_walk_node_1st, so parents precede children
+static void
+delta_write_l(cct_node_t* node, write_arg_t* wa)
+{
+  if (! node->delta_live) return;
+  node->delta_live = false;
+  lwrite(node, wa, 0);
+  delta_write_set_l(node->children, wa);
+}
+
+//
+// like hpcrun_cct_fwrite, but only for the nodes whose subtree has a
+// non-zero metric. node ids are those of the full tree, so successive
+// deltas of one thread line up.
+//
+int
+hpcrun_cct_fwrite_delta(cct2metrics_t* cct2metrics_map, cct_node_t* cct, FILE* fs, epoch_flags_t flags)
+{
+  if (!fs) return HPCRUN_ERR;
+
+  hpcfmt_uint_t num_metrics = hpcrun_get_num_metrics();
+  hpcrun_fmt_cct_node_t tmp_node;
+  hpcrun_metricVal_t metrics[num_metrics];
+  tmp_node.metrics = &(metrics[0]);
+
+  write_arg_t write_arg = {
+    .num_metrics = num_metrics,
+    .fs          = fs,
+    .flags       = flags,
+    .tmp_node    = &tmp_node,
+    .cct2metrics_map = cct2metrics_map
+  };
+
+  size_t n = 0;
+  delta_mark_l(cct, &write_arg, &n);
+  if (! cct->delta_live) {
+    // the root is always written
+    cct->delta_live = true;
+    n++;
+  }
+
+  hpcfmt_int8_fwrite((uint64_t) n, fs);
+  TMSG(DATA_WRITE, "num cct nodes in delta = %d", n);
+
+  delta_write_l(cct, &write_arg);
+
+  return HPCRUN_OK;
+}
+
 //
 // Utilities
 //
@@ -702,6 +836,281 @@ hpcrun_cct_find_addr(cct_node_t* cct, cct_addr_t* addr)
   return NULL;
 }
 
+//
+// Pruning operation: fold cold subtrees into a synthetic child
+//
+// A fold pass computes the inclusive weight of every node below 'cct'
+// (the sum of weight(n) over its subtree) and folds each maximal
+// subtree lighter than 'threshold' into the child of its parent whose
+// address is 'pruned', creating that child if needed. fold(into, n)
+// is called on every node of a folded subtree before the node is
+// freed, so the client can move the node's metrics to 'into'; since
+// the folded child of node x stays below x, the inclusive metric
+// totals of x are unchanged.
+//
+// Retained, pinned and marked nodes are never folded, nor are the
+// nodes on their paths to the root, nor 'cct' itself. The pass clears
+// all marks. Pruned children may absorb later folds but are never
+// folded into themselves.
+//
+// Children are visited in sibling order from a flattened sibling tree.
+// Neither walk recurses: the fold pass keeps one frame per cct level on
+// a freeable stack and a folded subtree is released from a work list,
+// so deep call paths cannot overflow the signal stack.
+//
+
+typedef struct {
+  cct_addr_t* pruned;
+  double threshold;
+  cct_weight_fn_t weight;
+  cct_fold_fn_t fold;
+  cct_op_arg_t arg;
+  size_t folds;
+} fold_arg_t;
+
+//
+// flatten a sibling splay tree into a list linked by 'right' in
+// ascending addr order, by right rotations
+//
+static cct_node_t*
+siblings_to_list(cct_node_t* root, size_t* n)
+{
+  cct_node_t head = { .right = root };
+  cct_node_t* tail = &head;
+  cct_node_t* rest = root;
+  *n = 0;
+
+  while (rest) {
+    if (rest->left) {
+      cct_node_t* l = rest->left;
+      rest->left = l->right;
+      l->right = rest;
+      rest = l;
+      tail->right = l;
+    }
+    else {
+      tail = rest;
+      rest = rest->right;
+      (*n)++;
+    }
+  }
+  return head.right;
+}
+
+//
+// rebuild a balanced sibling tree from the first n nodes of an
+// ascending list; *list advances past them
+//
+static cct_node_t*
+list_to_siblings(cct_node_t** list, size_t n)
+{
+  if (n == 0) return NULL;
+
+  cct_node_t* left = list_to_siblings(list, n / 2);
+  cct_node_t* root = *list;
+  *list = root->right;
+  root->left = left;
+  root->right = list_to_siblings(list, n - n / 2 - 1);
+  return root;
+}
+
+static cct_node_t*
+list_merge(cct_node_t* a, cct_node_t* b)
+{
+  cct_node_t* head = NULL;
+  cct_node_t** tail = &head;
+
+  while (a && b) {
+    if (cct_addr_lt(&(a->addr), &(b->addr))) {
+      *tail = a;
+      a = a->right;
+    }
+    else {
+      *tail = b;
+      b = b->right;
+    }
+    tail = &((*tail)->right);
+  }
+  *tail = a ? a : b;
+  return head;
+}
+
+//
+// fold a cold subtree into 'into'. the subtree's nodes form a work list
+// linked by 'right': a node's children are flattened onto the list
+// before the node is folded and freed, so no stack is needed.
+//
+static void
+fold_subtree_l(cct_node_t* into, cct_node_t* node, fold_arg_t* fa)
+{
+  node->right = NULL;
+  while (node) {
+    size_t n;
+    cct_node_t* child = siblings_to_list(node->children, &n);
+    cct_node_t* next = node->right;
+    if (child) {
+      cct_node_t* last = child;
+      while (last->right) last = last->right;
+      last->right = next;
+      next = child;
+    }
+    fa->fold(into, node, fa->arg);
+    hpcrun_cct_mem_free(node, sizeof(cct_node_t));
+    node = next;
+  }
+}
+
+//
+// one node of the fold walk: its inclusive weight so far, whether its
+// subtree holds a node that must not be folded, the children still to
+// visit and the visited children, sorted into warm and cold lists
+//
+typedef struct {
+  cct_node_t* node;
+  cct_node_t* next;
+  cct_node_t* warm;
+  cct_node_t* warm_last;
+  cct_node_t* cold;
+  cct_node_t* cold_last;
+  size_t n;
+  size_t n_warm;
+  double w;
+  bool k;
+} fold_frame_t;
+
+#define FOLD_STACK_INITIAL 64
+
+static void
+fold_enter(fold_frame_t* f, cct_node_t* node, fold_arg_t* fa, bool is_top)
+{
+  f->node = node;
+  f->w = fa->weight(node, fa->arg);
+  f->k = (is_top || node->no_fold || hpcrun_cct_retained(node)
+	  || atomic_load_explicit(&node->pins, memory_order_acquire) != 0);
+  node->no_fold &= ~CCT_NO_FOLD_MARKED;
+  f->next = siblings_to_list(node->children, &f->n);
+  f->warm = f->warm_last = NULL;
+  f->cold = f->cold_last = NULL;
+  f->n_warm = 0;
+}
+
+//
+// file a visited child of f->node as warm or cold
+//
+static void
+fold_file_child(fold_frame_t* f, cct_node_t* child, double cw, bool ck,
+		fold_arg_t* fa)
+{
+  f->w += cw;
+  f->k |= ck;
+
+  child->right = NULL;
+  if (! ck && cw < fa->threshold && ! cct_addr_eq(&(child->addr), fa->pruned)) {
+    if (f->cold_last) f->cold_last->right = child;
+    else f->cold = child;
+    f->cold_last = child;
+  }
+  else {
+    if (f->warm_last) f->warm_last->right = child;
+    else f->warm = child;
+    f->warm_last = child;
+    f->n_warm++;
+  }
+}
+
+//
+// all children of f->node are visited: fold its cold children if
+// f->node itself stays, so that a cold subtree is folded once, at its
+// top, and rebuild its sibling tree
+//
+static void
+fold_leave(fold_frame_t* f, fold_arg_t* fa)
+{
+  cct_node_t* node = f->node;
+  bool stays = f->k || f->w >= fa->threshold;
+  if (! stays || ! f->cold) {
+    // nothing is folded here: put the children back together
+    cct_node_t* list = list_merge(f->warm, f->cold);
+    node->children = list_to_siblings(&list, f->n);
+  }
+  else {
+    node->children = list_to_siblings(&f->warm, f->n_warm);
+    cct_node_t* into = hpcrun_cct_insert_addr(node, fa->pruned);
+    cct_node_t* cold = f->cold;
+    while (cold) {
+      cct_node_t* next = cold->right;
+      fold_subtree_l(into, cold, fa);
+      fa->folds++;
+      cold = next;
+    }
+  }
+}
+
+//
+// post-order walk of the cct below 'cct' on an explicit stack of
+// frames, one per level. the stack is grown by doubling; if it cannot
+// grow, the child that needs the new frame is kept whole, unvisited,
+// which keeps its ancestors too.
+//
+static void
+fold_cold_l(cct_node_t* cct, fold_arg_t* fa)
+{
+  size_t cap = FOLD_STACK_INITIAL;
+  fold_frame_t* stack = hpcrun_malloc_freeable(cap * sizeof(fold_frame_t));
+  if (! stack) return;
+
+  size_t top = 0;
+  fold_enter(&stack[0], cct, fa, true);
+
+  for (;;) {
+    fold_frame_t* f = &stack[top];
+    cct_node_t* child = f->next;
+    if (child) {
+      f->next = child->right;
+      if (top + 1 == cap) {
+	fold_frame_t* grown =
+	  hpcrun_malloc_freeable(2 * cap * sizeof(fold_frame_t));
+	if (! grown) {
+	  child->no_fold &= ~CCT_NO_FOLD_MARKED;
+	  fold_file_child(f, child, 0, true, fa);
+	  continue;
+	}
+	memcpy(grown, stack, cap * sizeof(fold_frame_t));
+	hpcrun_free(stack);
+	stack = grown;
+	cap *= 2;
+	f = &stack[top];
+      }
+      fold_enter(&stack[++top], child, fa, false);
+      continue;
+    }
+
+    fold_leave(f, fa);
+    if (top == 0) break;
+    top--;
+    fold_file_child(&stack[top], f->node, f->w, f->k, fa);
+  }
+  hpcrun_free(stack);
+}
+
+size_t
+hpcrun_cct_fold_cold(cct_node_t* cct, cct_addr_t* pruned, double threshold,
+		     cct_weight_fn_t weight, cct_fold_fn_t fold, cct_op_arg_t arg)
+{
+  if (! cct) return 0;
+
+  fold_arg_t fa = {
+    .pruned    = pruned,
+    .threshold = threshold,
+    .weight    = weight,
+    .fold      = fold,
+    .arg       = arg,
+    .folds     = 0
+  };
+  fold_cold_l(cct, &fa);
+  return fa.folds;
+}
+
 //
 // Merging operation: Given 2 ccts : CCT_A, CCT_B,
 //    merge means add all paths in CCT_B that are NOT in CCT_A
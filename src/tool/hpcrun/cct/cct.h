@@ -184,6 +184,14 @@ extern void hpcrun_cct_retain(cct_node_t* x);
 // call path.
 extern int hpcrun_cct_retained(cct_node_t* x);
 
+// never fold a node (nor its call path) when pruning, until each
+// hpcrun_cct_pin is matched by an hpcrun_cct_unpin
+extern void hpcrun_cct_pin(cct_node_t* x);
+extern void hpcrun_cct_unpin(cct_node_t* x);
+
+// protect a node (and its call path) from the next fold pass only
+extern void hpcrun_cct_mark_no_fold(cct_node_t* x);
+
 
 // Walking functions section:
 //
@@ -258,6 +266,9 @@ typedef struct cct2metrics_t cct2metrics_t;
 
 int hpcrun_cct_fwrite(cct2metrics_t* cct2metrics_map,
                       cct_node_t* cct, FILE* fs, epoch_flags_t flags);
+// write only the paths to nodes with non-zero metrics (snapshots)
+int hpcrun_cct_fwrite_delta(cct2metrics_t* cct2metrics_map,
+                            cct_node_t* cct, FILE* fs, epoch_flags_t flags);
 //
 // Utilities
 //
@@ -281,5 +292,22 @@ typedef void (*merge_op_t)(cct_node_t* a, cct_node_t*b, merge_op_arg_t arg);
 
 extern void hpcrun_cct_merge(cct_node_t* cct_a, cct_node_t* cct_b,
 			     merge_op_t merge, merge_op_arg_t arg);
+//
+// Pruning operation: fold every maximal subtree below 'cct' whose
+//    inclusive weight is below 'threshold' into the child of its
+//    parent with address 'pruned'. weight(n) gives the exclusive weight
+//    of n; fold(into, n) is called on each folded node before it is
+//    freed. Retained, pinned and marked nodes (and their call paths)
+//    are never folded. Returns the number of subtrees folded.
+//
+//    NOTE: only valid for ccts allocated with a cct memory budget
+//          (see cct_prune.h)
+//
+typedef double (*cct_weight_fn_t)(cct_node_t* node, cct_op_arg_t arg);
+typedef void (*cct_fold_fn_t)(cct_node_t* into, cct_node_t* node, cct_op_arg_t arg);
+
+extern size_t hpcrun_cct_fold_cold(cct_node_t* cct, cct_addr_t* pruned,
+				   double threshold, cct_weight_fn_t weight,
+				   cct_fold_fn_t fold, cct_op_arg_t arg);
 
 #endif // cct_h
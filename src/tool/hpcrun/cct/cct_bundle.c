@@ -86,6 +86,8 @@ hpcrun_cct_bundle_init(cct_bundle_t* bundle, cct_ctxt_t* ctxt)
   bundle->thread_root = bundle->tree_root;
   bundle->ctxt = ctxt;
   bundle->num_nodes = 0;
+  bundle->num_folds = 0;
+  bundle->bytes_reclaimed = 0;
   // FIXME: change to omp style here
   //
   // If there is a creation context (ie, this is a pthread),
@@ -110,7 +112,7 @@ hpcrun_cct_bundle_init(cct_bundle_t* bundle, cct_ctxt_t* ctxt)
 //
 int 
 hpcrun_cct_bundle_fwrite(FILE* fs, epoch_flags_t flags, cct_bundle_t* bndl,
-                         cct2metrics_t* cct2metrics_map)
+                         cct2metrics_t* cct2metrics_map, bool delta)
 {
   if (!fs) { return HPCRUN_ERR; }
 
@@ -120,8 +122,11 @@ hpcrun_cct_bundle_fwrite(FILE* fs, epoch_flags_t flags, cct_bundle_t* bndl,
 
   //
   // attach partial unwinds at appointed slot
+  // (only once: a bundle written by a snapshot is written again later)
   //
-  hpcrun_cct_insert_node(partial_insert, bndl->partial_unw_root);
+  if (! hpcrun_cct_parent(bndl->partial_unw_root)) {
+    hpcrun_cct_insert_node(partial_insert, bndl->partial_unw_root);
+  }
 
   //
   // 
@@ -129,6 +134,9 @@ hpcrun_cct_bundle_fwrite(FILE* fs, epoch_flags_t flags, cct_bundle_t* bndl,
 
   // write out newly constructed cct
 
+  if (delta) {
+    return hpcrun_cct_fwrite_delta(cct2metrics_map, bndl->top, fs, flags);
+  }
   return hpcrun_cct_fwrite(cct2metrics_map, bndl->top, fs, flags);
 }
 
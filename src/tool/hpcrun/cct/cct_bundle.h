@@ -80,6 +80,9 @@ typedef struct cct_bundle_t {
   cct_ctxt_t* ctxt;               // creation context for bundle
 
   unsigned long num_nodes;        // utility to count nodes. NB: MIGHT go away
+
+  unsigned long num_folds;        // subtrees folded by cct pruning
+  unsigned long bytes_reclaimed;  // cct memory reclaimed by those folds
 } cct_bundle_t;
 
 //
@@ -91,7 +94,7 @@ extern void hpcrun_cct_bundle_init(cct_bundle_t* bundle, cct_ctxt_t* ctxt);
 // IO for cct bundle
 //
 extern int hpcrun_cct_bundle_fwrite(FILE* fs, epoch_flags_t flags, cct_bundle_t* x,
-                                    cct2metrics_t* cct2metrics_map);
+                                    cct2metrics_t* cct2metrics_map, bool delta);
 
 //
 // utility functions
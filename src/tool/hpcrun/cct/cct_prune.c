@@ -0,0 +1,376 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Memory-bounded cct: budget accounting and the prune policy on top of
+// hpcrun_cct_fold_cold.
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+#include <utilities/ip-normalized.h>
+#include <hpcrun/cct2metrics.h>
+#include <hpcrun/env.h>
+#include <hpcrun/epoch.h>
+#include <hpcrun/hpcrun_stats.h>
+#include <hpcrun/metrics.h>
+#include <hpcrun/thread_data.h>
+
+#include "cct_prune.h"
+
+//***************************************************************************
+// local constants and data
+//***************************************************************************
+
+#define CCT_BUDGET_MIN (256 * 1024)
+
+// a prune round folds subtrees below this share of the thread's
+// metrics; each round that leaves the thread over its low water mark
+// retries with 4x the threshold, up to the max
+#define PRUNE_THRESHOLD_MIN (1.0 / 4096)
+#define PRUNE_THRESHOLD_MAX (1.0 / 16)
+
+#define MAX_PROTECT_FNS 8
+
+static size_t cct_budget = 0;
+
+static cct_prune_protect_fn_t protect_fns[MAX_PROTECT_FNS];
+static int num_protect_fns = 0;
+
+typedef struct prune_arg_t {
+  int n_metrics;
+  int n_active;                 // metrics with a nonzero total
+  MetricFlags_ValFmt_t* fmt;
+  double* total;                // per-metric sum over the thread's ccts
+} prune_arg_t;
+
+//***************************************************************************
+// placeholder function: the synthetic child that folded subtrees go to
+//***************************************************************************
+
+void
+PRUNED_CONTEXTS(void)
+{
+}
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+static inline double
+metric_value(prune_arg_t* pa, metric_set_t* set, int i)
+{
+  cct_metric_data_t* loc = hpcrun_metric_set_loc(set, i);
+  double v = 0;
+  if (pa->fmt[i] == MetricFlags_ValFmt_Real) v = loc->r;
+  else if (pa->fmt[i] == MetricFlags_ValFmt_Int) v = (double) loc->i;
+  return v < 0 ? -v : v;
+}
+
+static void
+prune_total_op(cct_node_t* node, cct_op_arg_t arg, size_t level)
+{
+  prune_arg_t* pa = (prune_arg_t*) arg;
+  metric_set_t* set = hpcrun_get_metric_set(node);
+  if (! set) return;
+
+  for (int i = 0; i < pa->n_metrics; i++) {
+    pa->total[i] += metric_value(pa, set, i);
+  }
+}
+
+//
+// a node's weight is its mean share of the thread total over the
+// metrics it could have, so metrics of different units compare and
+// the weights of all nodes sum to 1
+//
+static double
+prune_weight(cct_node_t* node, cct_op_arg_t arg)
+{
+  prune_arg_t* pa = (prune_arg_t*) arg;
+  metric_set_t* set = hpcrun_get_metric_set(node);
+  if (! set || pa->n_active == 0) return 0;
+
+  double w = 0;
+  for (int i = 0; i < pa->n_metrics; i++) {
+    if (pa->total[i] > 0) {
+      w += metric_value(pa, set, i) / pa->total[i];
+    }
+  }
+  return w / pa->n_active;
+}
+
+//
+// move a folded node's exclusive metrics to the pruned child and
+// release its metric set
+//
+static void
+prune_fold(cct_node_t* into, cct_node_t* node, cct_op_arg_t arg)
+{
+  prune_arg_t* pa = (prune_arg_t*) arg;
+  metric_set_t* set = hpcrun_cct2metrics_remove(node);
+  if (! set) return;
+
+  metric_set_t* into_set = hpcrun_reify_metric_set(into);
+  for (int i = 0; i < pa->n_metrics; i++) {
+    cct_metric_data_t* src = hpcrun_metric_set_loc(set, i);
+    cct_metric_data_t* dst = hpcrun_metric_set_loc(into_set, i);
+    if (pa->fmt[i] == MetricFlags_ValFmt_Real) dst->r += src->r;
+    else if (pa->fmt[i] == MetricFlags_ValFmt_Int) dst->i += src->i;
+  }
+  hpcrun_metric_set_free(set);
+}
+
+//
+// mark every node that must survive the next fold pass. marks only
+// last one pass, so this runs before each round.
+//
+static void
+prune_protect_all(thread_data_t* td)
+{
+  for (epoch_t* s = td->core_profile_trace_data.epoch; s; s = s->next) {
+    cct_bundle_t* b = &(s->csdata);
+    hpcrun_cct_mark_no_fold(b->tree_root);
+    hpcrun_cct_mark_no_fold(b->thread_root);
+    hpcrun_cct_mark_no_fold(b->partial_unw_root);
+    hpcrun_cct_mark_no_fold(b->special_idle_node);
+    hpcrun_cct_mark_no_fold(b->special_no_thread_node);
+  }
+  hpcrun_cct_prune_protect(td->tramp_cct_node);
+
+  for (int i = 0; i < num_protect_fns; i++) {
+    protect_fns[i]();
+  }
+}
+
+static unsigned long
+prune_bundle(cct_bundle_t* b, cct_addr_t* pruned, double threshold,
+	     prune_arg_t* pa)
+{
+  unsigned long folds =
+    hpcrun_cct_fold_cold(b->top, pruned, threshold, prune_weight, prune_fold, pa);
+
+  // partial unwinds join the main tree only when the profile is written
+  if (! hpcrun_cct_parent(b->partial_unw_root)) {
+    folds += hpcrun_cct_fold_cold(b->partial_unw_root, pruned, threshold,
+				  prune_weight, prune_fold, pa);
+  }
+  return folds;
+}
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_cct_prune_init(void)
+{
+  cct_budget = 0;
+
+  const char* str = getenv(HPCRUN_CCT_BUDGET);
+  if (str == NULL || *str == '\0') return;
+
+  char* end;
+  unsigned long long budget = strtoull(str, &end, 10);
+  switch (*end) {
+    case 'k': case 'K': budget <<= 10; end++; break;
+    case 'm': case 'M': budget <<= 20; end++; break;
+    case 'g': case 'G': budget <<= 30; end++; break;
+    default: break;
+  }
+  if (end == str || *end != '\0' || budget == 0) {
+    EMSG("%s: ignoring malformed value '%s'", HPCRUN_CCT_BUDGET, str);
+    return;
+  }
+  if (budget < CCT_BUDGET_MIN) {
+    budget = CCT_BUDGET_MIN;
+  }
+  cct_budget = budget;
+  TMSG(CCT_PRUNE, "per-thread cct budget = %zu bytes", cct_budget);
+}
+
+
+size_t
+hpcrun_cct_budget(void)
+{
+  return cct_budget;
+}
+
+
+void*
+hpcrun_cct_mem_alloc(size_t size)
+{
+  if (! cct_budget) {
+    return hpcrun_malloc(size);
+  }
+
+  void* ptr = hpcrun_malloc_freeable(size);
+  if (ptr && hpcrun_td_avail()) {
+    TD_GET(cct_bytes) += size;
+  }
+  return ptr;
+}
+
+
+void
+hpcrun_cct_mem_free(void* ptr, size_t size)
+{
+  if (! cct_budget || ! ptr) return;
+
+  hpcrun_free(ptr);
+  if (hpcrun_td_avail()) {
+    thread_data_t* td = hpcrun_get_thread_data();
+    td->cct_bytes = (td->cct_bytes > size) ? td->cct_bytes - size : 0;
+  }
+}
+
+
+void
+hpcrun_cct_prune_register_protect(cct_prune_protect_fn_t fn)
+{
+  if (num_protect_fns >= MAX_PROTECT_FNS) {
+    EMSG("cct prune: too many protect routines, ignoring %p", fn);
+    return;
+  }
+  protect_fns[num_protect_fns++] = fn;
+}
+
+
+//
+// protect a node of the calling thread's ccts from the current prune.
+// nodes of other threads' ccts are skipped: their owner does not prune
+// them now and must not see our marks. a node of another thread may
+// only be passed here if its owner pinned it, since the walk to the
+// root reads its path while the owner prunes.
+//
+void
+hpcrun_cct_prune_protect(cct_node_t* node)
+{
+  if (! node || ! cct_budget) return;
+
+  cct_node_t* root = node;
+  while (hpcrun_cct_parent(root)) {
+    root = hpcrun_cct_parent(root);
+  }
+
+  for (epoch_t* s = TD_GET(core_profile_trace_data.epoch); s; s = s->next) {
+    if (root == s->csdata.top || root == s->csdata.partial_unw_root) {
+      hpcrun_cct_mark_no_fold(node);
+      return;
+    }
+  }
+}
+
+
+void
+hpcrun_cct_prune(void)
+{
+  thread_data_t* td = hpcrun_get_thread_data();
+  if (! cct_budget || td->cct_bytes <= td->cct_prune_limit) return;
+
+  epoch_t* epoch = td->core_profile_trace_data.epoch;
+  size_t start_bytes = td->cct_bytes;
+  size_t low_water = cct_budget / 4 * 3;
+
+  int n_metrics = hpcrun_get_num_metrics();
+  MetricFlags_ValFmt_t fmt[n_metrics > 0 ? n_metrics : 1];
+  double total[n_metrics > 0 ? n_metrics : 1];
+  prune_arg_t pa = {
+    .n_metrics = n_metrics,
+    .n_active  = 0,
+    .fmt       = fmt,
+    .total     = total
+  };
+  for (int i = 0; i < n_metrics; i++) {
+    metric_desc_t* desc = hpcrun_id2metric(i);
+    fmt[i] = desc ? desc->flags.fields.valFmt : MetricFlags_ValFmt_NULL;
+    total[i] = 0;
+  }
+  for (epoch_t* s = epoch; s; s = s->next) {
+    hpcrun_cct_walk_node_1st(s->csdata.top, prune_total_op, &pa);
+    if (! hpcrun_cct_parent(s->csdata.partial_unw_root)) {
+      hpcrun_cct_walk_node_1st(s->csdata.partial_unw_root, prune_total_op, &pa);
+    }
+  }
+  for (int i = 0; i < n_metrics; i++) {
+    if (total[i] > 0) pa.n_active++;
+  }
+
+  ip_normalized_t ip = hpcrun_normalize_ip((void*) PRUNED_CONTEXTS, NULL);
+  cct_addr_t pruned = ADDR2(ip.lm_id, ip.lm_ip + 1);
+
+  unsigned long folds = 0;
+  for (double threshold = PRUNE_THRESHOLD_MIN;
+       td->cct_bytes > low_water && threshold <= PRUNE_THRESHOLD_MAX;
+       threshold *= 4) {
+    prune_protect_all(td);
+    for (epoch_t* s = epoch; s; s = s->next) {
+      size_t before = td->cct_bytes;
+      unsigned long n = prune_bundle(&(s->csdata), &pruned, threshold, &pa);
+      s->csdata.num_folds += n;
+      if (before > td->cct_bytes) {
+	s->csdata.bytes_reclaimed += before - td->cct_bytes;
+      }
+      folds += n;
+    }
+    TMSG(CCT_PRUNE, "threshold %g: %lu folds, %zu cct bytes",
+	 threshold, folds, td->cct_bytes);
+  }
+
+  size_t reclaimed = (start_bytes > td->cct_bytes) ? start_bytes - td->cct_bytes : 0;
+  hpcrun_stats_cct_prune_inc(folds, reclaimed);
+
+  // whatever stays is hot or protected: let the cct grow a quarter
+  // budget before trying again rather than pruning every sample
+  size_t retry = td->cct_bytes + cct_budget / 4;
+  td->cct_prune_limit = (retry > cct_budget) ? retry : cct_budget;
+  TMSG(CCT_PRUNE, "pruned %zu -> %zu cct bytes, next prune above %zu",
+       start_bytes, td->cct_bytes, td->cct_prune_limit);
+}
@@ -0,0 +1,96 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+#ifndef CCT_PRUNE_H
+#define CCT_PRUNE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cct.h"
+
+//
+// Memory-bounded cct.
+//
+// With HPCRUN_CCT_BUDGET=<bytes>[K|M|G] set, cct nodes, metric sets and
+// cct2metrics entries come from freeable memory and count against a
+// per-thread budget. When a thread's ccts grow past the budget, its
+// next sample folds cold subtrees, ranked by their share of each
+// metric's thread total, into synthetic "pruned" children until usage
+// drops to 3/4 of the budget. Folding keeps inclusive metric totals.
+//
+// Besides retained (traced) and pinned nodes, the nodes that sample
+// sources hold across samples must survive a prune: such sources
+// register a protect routine, which is called on the pruning thread
+// and hands each of that thread's live nodes to hpcrun_cct_prune_protect.
+// Nodes published for other threads to keep must be pinned by their
+// owner before they are published (see hpcrun_cct_pin), and unpinned
+// once they are withdrawn; a thread that keeps such a node takes a pin
+// of its own and drops it when it lets go.
+//
+
+typedef void (*cct_prune_protect_fn_t)(void);
+
+//
+// Interface routines
+//
+// read HPCRUN_CCT_BUDGET; must precede the first cct allocation
+extern void hpcrun_cct_prune_init(void);
+// per-thread budget in bytes, 0: unbounded
+extern size_t hpcrun_cct_budget(void);
+
+// cct memory: freeable and counted against the thread's budget when
+// there is one, hpcrun_malloc otherwise
+extern void* hpcrun_cct_mem_alloc(size_t size);
+extern void hpcrun_cct_mem_free(void* ptr, size_t size);
+
+extern void hpcrun_cct_prune_register_protect(cct_prune_protect_fn_t fn);
+extern void hpcrun_cct_prune_protect(cct_node_t* node);
+
+// fold cold subtrees of the calling thread's ccts if it is over budget
+extern void hpcrun_cct_prune(void);
+
+#endif // CCT_PRUNE_H
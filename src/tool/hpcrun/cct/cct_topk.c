@@ -0,0 +1,248 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Bounded min-heap top-K of cct nodes, shared by sample sources that
+// report their hottest calling contexts at exit.
+//
+
+#include <string.h>
+
+#include <memory/hpcrun-malloc.h>
+#include <cct2metrics.h>
+#include <messages/messages.h>
+#include "cct_topk.h"
+
+// first heap allocation, in items; the heap doubles up to k as needed
+#define TOPK_INITIAL_CAPACITY 1024
+
+typedef struct topk_walk_arg_t {
+  cct_topk_t* tk;
+  int n;
+} topk_walk_arg_t;
+
+static inline void
+heap_swap(cct_topk_item_t* a, cct_topk_item_t* b)
+{
+  cct_topk_item_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+static void
+heap_sift_down(cct_topk_item_t* heap, size_t n, size_t i)
+{
+  for (;;) {
+    size_t l = 2 * i + 1, r = l + 1, m = i;
+    if (l < n && heap[l].key < heap[m].key) m = l;
+    if (r < n && heap[r].key < heap[m].key) m = r;
+    if (m == i) return;
+    heap_swap(&heap[i], &heap[m]);
+    i = m;
+  }
+}
+
+static void
+heap_sift_up(cct_topk_item_t* heap, size_t i)
+{
+  while (i > 0) {
+    size_t p = (i - 1) / 2;
+    if (heap[p].key <= heap[i].key) return;
+    heap_swap(&heap[i], &heap[p]);
+    i = p;
+  }
+}
+
+// make room for one more item below k; false if out of memory, in
+// which case the collector keeps the items it has as its capacity
+static bool
+heap_grow(cct_topk_t* tk)
+{
+  size_t cap = tk->cap ? 2 * tk->cap : TOPK_INITIAL_CAPACITY;
+  if (cap > tk->k) cap = tk->k;
+
+  cct_topk_item_t* heap = hpcrun_malloc_freeable(cap * sizeof(cct_topk_item_t));
+  if (!heap) {
+    EMSG("top-%zu collector for metric %d: out of memory at %zu items",
+	 tk->k, tk->metric_id, tk->n);
+    tk->k = tk->n;
+    return false;
+  }
+  if (tk->n > 0) memcpy(heap, tk->heap, tk->n * sizeof(cct_topk_item_t));
+  hpcrun_free(tk->heap);
+  tk->heap = heap;
+  tk->cap = cap;
+  return true;
+}
+
+void
+hpcrun_cct_topk_init(cct_topk_t* tk, int metric_id, size_t k)
+{
+  memset(tk, 0, sizeof(*tk));
+  tk->metric_id = metric_id;
+  metric_desc_t* desc = hpcrun_id2metric(metric_id);
+  tk->fmt = desc ? desc->flags.fields.valFmt : MetricFlags_ValFmt_Int;
+  tk->k = k;
+}
+
+void
+hpcrun_cct_topk_fini(cct_topk_t* tk)
+{
+  hpcrun_free(tk->heap);
+  tk->heap = NULL;
+  tk->cap = tk->n = 0;
+}
+
+void
+hpcrun_cct_topk_offer(cct_topk_t* tk, cct_node_t* node, cct_metric_data_t val)
+{
+  double key = (tk->fmt == MetricFlags_ValFmt_Real) ? val.r : (double) val.i;
+  if (key == 0) return;
+
+  tk->total += key;
+  if (tk->n == tk->cap && tk->n < tk->k) heap_grow(tk);
+  if (tk->n < tk->k) {
+    tk->heap[tk->n] = (cct_topk_item_t) { .node = node, .key = key, .val = val };
+    heap_sift_up(tk->heap, tk->n++);
+  }
+  else if (tk->k > 0 && key > tk->heap[0].key) {
+    tk->heap[0] = (cct_topk_item_t) { .node = node, .key = key, .val = val };
+    heap_sift_down(tk->heap, tk->n, 0);
+  }
+}
+
+static void
+topk_walk_op(cct_node_t* node, cct_op_arg_t arg, size_t level)
+{
+  topk_walk_arg_t* w = (topk_walk_arg_t*) arg;
+  metric_set_t* set = hpcrun_get_metric_set(node);
+  if (!set) return;
+
+  for (int i = 0; i < w->n; i++) {
+    cct_metric_data_t* loc = hpcrun_metric_set_loc(set, w->tk[i].metric_id);
+    if (loc) hpcrun_cct_topk_offer(&w->tk[i], node, *loc);
+  }
+}
+
+void
+hpcrun_cct_topk_collect(cct_node_t* cct, cct_topk_t* tk, int n)
+{
+  if (!cct || n <= 0) return;
+  topk_walk_arg_t w = { .tk = tk, .n = n };
+  hpcrun_cct_walk_node_1st(cct, topk_walk_op, &w);
+}
+
+size_t
+hpcrun_cct_topk_sort(cct_topk_t* tk)
+{
+  // heapsort on the min-heap leaves the largest item first
+  for (size_t end = tk->n; end > 1; end--) {
+    heap_swap(&tk->heap[0], &tk->heap[end - 1]);
+    heap_sift_down(tk->heap, end - 1, 0);
+  }
+  return tk->n;
+}
+
+static void
+topk_fprint_path(FILE* fs, cct_node_t* node, int libmonitorId, int libhpcrunId)
+{
+  //FIXME: +1 not needed
+  fprintf(fs, "%d-%p", hpcrun_cct_addr(node)->ip_norm.lm_id,
+	  (void*) (hpcrun_cct_addr(node)->ip_norm.lm_ip + 1));
+  node = hpcrun_cct_parent(node);
+  bool lastWasSeparator = false;
+  while (node) {
+    int lm_id = hpcrun_cct_addr(node)->ip_norm.lm_id;
+    if (lm_id == 0) break;
+
+    if (lm_id != libmonitorId && lm_id != libhpcrunId) {
+      // the frame above an hpcrun frame is a call site, not a return
+      // address; print it +1 like the leaf
+      void* ip = (void*) (hpcrun_cct_addr(node)->ip_norm.lm_ip + (lastWasSeparator ? 1 : 0));
+      fprintf(fs, ",%d-%p", lm_id, ip);
+      lastWasSeparator = false;
+    }
+    else if (lm_id == libhpcrunId) {
+      fprintf(fs, ",SEP");
+      lastWasSeparator = true;
+    }
+    node = hpcrun_cct_parent(node);
+  }
+  fputc('\n', fs);
+}
+
+void
+hpcrun_cct_topk_fprint(FILE* fs, hpcrun_loadmap_t* loadmap, cct_topk_t* tk, int n)
+{
+  int libmonitorId = -1, libhpcrunId = -1;
+
+  fprintf(fs, "<LOADMODULES>\n");
+  for (load_module_t* lm = loadmap->lm_end; lm; lm = lm->prev) {
+    if (strstr(lm->name, "libmonitor")) libmonitorId = lm->id;
+    if (strstr(lm->name, "libhpcrun")) libhpcrunId = lm->id;
+    fprintf(fs, "%d:%p:%s\n", lm->id, (void*) lm->dso_info->start_to_ref_dist, lm->name);
+  }
+  fprintf(fs, "</LOADMODULES>\n");
+
+  for (int m = 0; m < n; m++) {
+    cct_topk_t* t = &tk[m];
+    double denom = (t->normalizer != 0) ? t->normalizer : t->total;
+
+    fprintf(fs, "<TOPN>\n");
+    for (size_t i = 0; i < t->n; i++) {
+      cct_topk_item_t* it = &t->heap[i];
+      if (t->fmt == MetricFlags_ValFmt_Real) {
+	fprintf(fs, "%lf:%lf:", it->val.r, denom ? it->key / denom : 0.0);
+      }
+      else {
+	fprintf(fs, "%lu:%lf:", it->val.i, denom ? it->key / denom : 0.0);
+      }
+      topk_fprint_path(fs, it->node, libmonitorId, libhpcrunId);
+    }
+    fprintf(fs, "</TOPN>\n");
+  }
+}
@@ -0,0 +1,100 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+#ifndef CCT_TOPK_H
+#define CCT_TOPK_H
+#include <stdint.h>
+#include <stdio.h>
+
+#include <cct/cct.h>
+#include <metrics.h>
+#include <loadmap.h>
+
+//
+// Bounded top-K collection of cct nodes by metric value.
+//
+// Each collector keeps the K largest nodes of one metric in a min-heap,
+// so one cct walk costs O(nodes * log K) and reads each node's metric
+// set once no matter how many collectors share the walk. The heap is
+// freeable memory that grows with the nodes offered, up to K items;
+// hpcrun_cct_topk_fini gives it back.
+//
+
+typedef struct cct_topk_item_t {
+  cct_node_t* node;
+  double key;                 // value used for ranking
+  cct_metric_data_t val;
+} cct_topk_item_t;
+
+typedef struct cct_topk_t {
+  int metric_id;
+  MetricFlags_ValFmt_t fmt;
+  size_t k;                   // items kept at most
+  size_t cap;                 // items allocated
+  size_t n;                   // items held
+  cct_topk_item_t* heap;      // min-heap until sorted
+  double total;               // sum over all nonzero nodes seen
+  double normalizer;          // share denominator in reports, 0: total
+} cct_topk_t;
+
+//
+// Interface routines
+//
+extern void hpcrun_cct_topk_init(cct_topk_t* tk, int metric_id, size_t k);
+extern void hpcrun_cct_topk_fini(cct_topk_t* tk);
+extern void hpcrun_cct_topk_offer(cct_topk_t* tk, cct_node_t* node,
+				  cct_metric_data_t val);
+// walk cct once, offering every node to each of the n collectors
+extern void hpcrun_cct_topk_collect(cct_node_t* cct, cct_topk_t* tk, int n);
+// turn the heap into an array ranked from largest to smallest
+extern size_t hpcrun_cct_topk_sort(cct_topk_t* tk);
+// write the loadmap and one ranked <TOPN> block per collector; each line
+// is value:share:call path from leaf to root
+extern void hpcrun_cct_topk_fprint(FILE* fs, hpcrun_loadmap_t* loadmap,
+				   cct_topk_t* tk, int n);
+
+#endif // CCT_TOPK_H
@@ -9,6 +9,7 @@
 #include <memory/hpcrun-malloc.h>
 #include <hpcrun/metrics.h>
 #include <cct/cct.h>
+#include <cct/cct_prune.h>
 #include <hpcrun/cct2metrics.h>
 #include <hpcrun/thread_data.h>
 #include <lib/prof-lean/splay-macros.h>
@@ -95,7 +96,7 @@ splay(cct2metrics_t* map, cct_node_id_t node)
 static cct2metrics_t*
 cct2metrics_new(cct_node_id_t node, metric_set_t* metrics)
 {
-  cct2metrics_t* rv = hpcrun_malloc(sizeof(cct2metrics_t));
+  cct2metrics_t* rv = hpcrun_cct_mem_alloc(sizeof(cct2metrics_t));
   rv->node = node;
   rv->metrics = metrics;
   rv->left = rv->right = NULL;
@@ -215,3 +216,73 @@ cct2metrics_assoc(cct_node_id_t node, metric_set_t* metrics)
   TMSG(CCT2METRICS, "METRICS_ASSOC final, THREAD_LOCAL_MAP = %p", THREAD_LOCAL_MAP());
   if (ENABLED(CCT2METRICS)) splay_tree_dump(THREAD_LOCAL_MAP());
 }
+
+//
+// remove the association of a cct node and return its metric set
+// (NULL if it has none). only for maps built under a cct memory
+// budget, whose entries are freeable.
+//
+metric_set_t*
+hpcrun_cct2metrics_remove(cct_node_id_t node)
+{
+  cct2metrics_t* map = THREAD_LOCAL_MAP();
+  if (! map) return NULL;
+
+  map = splay(map, node);
+  if (map->node != node) {
+    THREAD_LOCAL_MAP() = map;
+    return NULL;
+  }
+
+  cct2metrics_t* entry = map;
+  if (! map->left) {
+    map = map->right;
+  }
+  else {
+    // the largest key on the left becomes the root, with no right child
+    map = splay(map->left, node);
+    map->right = entry->right;
+  }
+  THREAD_LOCAL_MAP() = map;
+
+  metric_set_t* rv = entry->metrics;
+  hpcrun_cct_mem_free(entry, sizeof(cct2metrics_t));
+  return rv;
+}
+
+//
+// zero every metric set in a map; a snapshot starts the next
+// interval this way while keeping the cct and its node ids
+//
+// The splay tree can be as deep as it has entries, and this runs in the
+// sample handler, so the walk is an in-order threaded (Morris)
+// traversal: no recursion and no stack, and every link it borrows is
+// restored before it returns.
+//
+void
+hpcrun_cct2metrics_zero(cct2metrics_t* map)
+{
+  cct2metrics_t* cur = map;
+
+  while (cur) {
+    if (! cur->left) {
+      hpcrun_metric_set_zero(cur->metrics);
+      cur = cur->right;
+      continue;
+    }
+    // the in-order predecessor of cur, threaded back to cur on the way down
+    cct2metrics_t* pred = cur->left;
+    while (pred->right && pred->right != cur) {
+      pred = pred->right;
+    }
+    if (! pred->right) {
+      pred->right = cur;
+      cur = cur->left;
+    }
+    else {
+      pred->right = NULL;
+      hpcrun_metric_set_zero(cur->metrics);
+      cur = cur->right;
+    }
+  }
+}
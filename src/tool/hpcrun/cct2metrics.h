@@ -53,6 +53,16 @@ extern bool hpcrun_has_metric_set(cct_node_id_t cct_id);
 
 extern void cct2metrics_assoc(cct_node_t* node, metric_set_t* metrics);
 
+//
+// remove a node from the map, returning its metric set (used by cct pruning)
+//
+extern metric_set_t* hpcrun_cct2metrics_remove(cct_node_id_t node);
+
+//
+// zero all metric sets in a map (used by snapshots)
+//
+extern void hpcrun_cct2metrics_zero(cct2metrics_t* map);
+
 //extern cct2metrics_t* cct2metrics_new(cct_node_id_t node, metric_set_t* metrics);
 
 typedef enum {SET, INCR} update_metric_t;
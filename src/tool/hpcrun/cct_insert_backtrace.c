@@ -58,6 +58,7 @@
 #include <lib/prof-lean/placeholders.h>
 #include <lush/lush-backtrace.h>
 #include <thread_data.h>
+#include <hpcrun_overhead.h>
 #include <hpcrun_stats.h>
 #include <trace.h>
 #include <trampoline/common/trampoline.h>
@@ -84,6 +85,8 @@ static bool retain_recursion = false;
 
 static hpcrun_kernel_callpath_t hpcrun_kernel_callpath;
 
+static hpcrun_user_callpath_t hpcrun_user_callpath;
+
 
 void
 hpcrun_kernel_callpath_register(hpcrun_kernel_callpath_t kcp) 
@@ -91,6 +94,12 @@ hpcrun_kernel_callpath_register(hpcrun_kernel_callpath_t kcp)
 	hpcrun_kernel_callpath = kcp;
 }
 
+void
+hpcrun_user_callpath_register(hpcrun_user_callpath_t ucp)
+{
+	hpcrun_user_callpath = ucp;
+}
+
 static cct_node_t*
 cct_insert_raw_backtrace(cct_node_t* cct,
                             frame_t* path_beg, frame_t* path_end)
@@ -182,12 +191,15 @@ hpcrun_cct_insert_backtrace_w_metric(cct_node_t* treenode,
 				     frame_t* path_beg, frame_t* path_end,
 				     cct_metric_data_t datum, void *data_aux)
 {
+  uint64_t ovh_start = hpcrun_overhead_begin();
   cct_node_t* path = hpcrun_cct_insert_backtrace(treenode, path_beg, path_end);
 
   if (hpcrun_kernel_callpath) {
     path = hpcrun_kernel_callpath(path, data_aux);
   }
+  hpcrun_overhead_end(HPCRUN_OVH_CCT_INSERT, ovh_start);
 
+  ovh_start = hpcrun_overhead_begin();
   metric_set_t* mset = hpcrun_reify_metric_set(path);
 
   metric_upd_proc_t* upd_proc = hpcrun_get_metric_proc(metric_id);
@@ -200,6 +212,7 @@ hpcrun_cct_insert_backtrace_w_metric(cct_node_t* treenode,
     //fprintf(stderr, "value of metric: %d in path id: %d after increment: %0.2lf in thread %d\n", metric_id, hpcrun_cct_persistent_id(path), v->r, syscall(SYS_gettid));
     hpcrun_metricVal_t* loc = hpcrun_metric_set_loc(mset, metric_id);
   }
+  hpcrun_overhead_end(HPCRUN_OVH_METRIC, ovh_start);
 
   // POST-INVARIANT: metric set has been allocated for 'path'
 
@@ -385,7 +398,26 @@ help_hpcrun_backtrace2cct(cct_bundle_t* bundle, ucontext_t* context,
   thread_data_t* td = hpcrun_get_thread_data();
   backtrace_info_t bt;
 
-  bool success = hpcrun_generate_backtrace(&bt, context, skipInner);
+  bool success = false;
+  uint64_t ovh_start = hpcrun_overhead_begin();
+
+  //
+  // a call chain recorded with the sample replaces the unwind when it
+  // reaches a fence. trampolines need the unwinder's cached backtrace,
+  // so they always unwind.
+  //
+  if (hpcrun_user_callpath && data && ! skipInner && ! ENABLED(USE_TRAMP)) {
+    success = hpcrun_user_callpath(&bt, data);
+    if (success) {
+      hpcrun_stats_num_samples_callchain_inc();
+    } else {
+      hpcrun_stats_num_samples_callchain_fallback_inc();
+    }
+  }
+
+  if (! success) {
+    success = hpcrun_generate_backtrace(&bt, context, skipInner);
+  }
 
   assert(!success == bt.partial_unwind);
 
@@ -410,6 +442,7 @@ help_hpcrun_backtrace2cct(cct_bundle_t* bundle, ucontext_t* context,
  // bt.trace_pc = bt.begin->cursor.pc_unnorm;  // JMC
 
   cct_backtrace_finalize(&bt, isSync); 
+  hpcrun_overhead_end(HPCRUN_OVH_UNWIND, ovh_start);
 
   if (bt.partial_unwind) {
     if (ENABLED(NO_PARTIAL_UNW)){
@@ -54,6 +54,10 @@
 
 typedef  cct_node_t *(*hpcrun_kernel_callpath_t)(cct_node_t *path, void *data_aux);
 
+// fills the backtrace from a call chain carried by the sample (data_aux);
+// returns false if the sample has no usable chain
+typedef  bool (*hpcrun_user_callpath_t)(backtrace_info_t *bt, void *data_aux);
+
 //
 // interface routines
 //
@@ -103,6 +107,8 @@ extern cct_node_t* hpcrun_backtrace2cct(cct_bundle_t* cct, ucontext_t* context,
 
 extern void hpcrun_kernel_callpath_register(hpcrun_kernel_callpath_t kcp);
 
+extern void hpcrun_user_callpath_register(hpcrun_user_callpath_t ucp);
+
 //
 // debug version of hpcrun_backtrace2cct:
 //   simulates errors to test partial unwind capability
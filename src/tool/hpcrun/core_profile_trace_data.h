@@ -26,6 +26,7 @@ typedef struct core_profile_trace_data_t {
   // ----------------------------------------
   // tracing
   // ----------------------------------------
+  // in trace time units: microseconds, or nanoseconds with HPCRUN_TRACE_NS
   uint64_t trace_min_time_us;
   uint64_t trace_max_time_us;
 
@@ -36,6 +37,9 @@ typedef struct core_profile_trace_data_t {
   void* trace_buffer;
   hpcio_outbuf_t trace_outbuf;
 
+  // index of the next snapshot (snapshots taken so far)
+  int snapshot_index;
+
   // ----------------------------------------
   // Perf support
   // ----------------------------------------
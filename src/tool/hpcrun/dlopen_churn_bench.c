@@ -0,0 +1,251 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// dlopen churn benchmark for the loadmap read path
+//
+// Runs compute threads under hpcrun while another thread keeps
+// loading shared objects. Before the loadmap readers became lock-free
+// every sample that arrived while a dlopen held the dlopen lock was
+// dropped and counted under "blocks ... dlopen" in the SAMPLE
+// ANOMALIES line of the hpcrun log, and a dlclose still turned
+// samples away after that; now neither does, and the samples taken
+// during a dlopen are counted on the DLOPEN line.
+//
+// The program is its own plugin: built with -DPLUGIN it is a small
+// shared object with an init constructor. The driver copies the
+// plugin to a number of distinct paths so that every dlopen maps a
+// new load module, and opens them in turn; with -c it also closes
+// each one again, which exercises the deferred reclamation of what
+// dlclose unmaps.
+//
+// The driver reports the dlopen rate and the work done per compute
+// thread; compare the hpcrun log of a run against one without churn
+// (-n 0).
+//
+// 'make check' in src/tool/hpcrun builds the benchmark and its plugin
+// (.libs/dlopen_churn_plugin.so); by hand:
+//   cc -O2 -DPLUGIN -shared -fPIC -o dlopen_churn_plugin.so dlopen_churn_bench.c
+//   cc -O2 -pthread -o dlopen_churn_bench dlopen_churn_bench.c -ldl
+// Run:
+//   hpcrun -e CPUTIME@1000 ./dlopen_churn_bench [-n modules] [-t threads]
+//          [-s seconds] [-c] [plugin]
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#ifdef PLUGIN
+
+static volatile double plugin_sink;
+
+__attribute__((constructor))
+static void
+plugin_init(void)
+{
+  // a little work in the constructor: samples land in the new module
+  double x = 0;
+  for (int i = 1; i < 100000; i++) x += 1.0 / i;
+  plugin_sink = x;
+}
+
+double
+plugin_work(int n)
+{
+  double x = 0;
+  for (int i = 1; i < n; i++) x += 1.0 / i;
+  return x;
+}
+
+#else
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+
+static volatile bool done;
+static volatile double sink;
+static uint64_t work[MAX_THREADS];
+
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void*
+compute(void* arg)
+{
+  uint64_t* count = arg;
+  double x = 0;
+
+  while (! done) {
+    for (int i = 1; i < 10000; i++) x += 1.0 / i;
+    (*count)++;
+  }
+  sink = x;
+  return NULL;
+}
+
+
+static int
+copy_file(const char* from, const char* to)
+{
+  char buf[65536];
+  size_t n;
+  FILE* in = fopen(from, "r");
+  FILE* out = in ? fopen(to, "w") : NULL;
+
+  if (! out) {
+    if (in) fclose(in);
+    return -1;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+  return fclose(out);
+}
+
+
+int
+main(int argc, char** argv)
+{
+  const char* plugin = "./dlopen_churn_plugin.so";
+  int nmodules = 64, nthreads = 4, seconds = 5;
+  bool do_close = false;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:t:s:c")) != -1) {
+    switch (c) {
+    case 'n': nmodules = atoi(optarg); break;
+    case 't': nthreads = atoi(optarg); break;
+    case 's': seconds  = atoi(optarg); break;
+    case 'c': do_close = true; break;
+    default:
+      fprintf(stderr, "usage: %s [-n modules] [-t threads] [-s seconds] "
+	      "[-c] [plugin]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc) plugin = argv[optind];
+  if (nthreads < 1 || nthreads > MAX_THREADS) nthreads = 4;
+
+  char dir[] = "/tmp/dlopen_churn.XXXXXX";
+  if (nmodules > 0 && ! mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char (*paths)[PATH_MAX] = calloc(nmodules + 1, PATH_MAX);
+  for (int i = 0; i < nmodules; i++) {
+    snprintf(paths[i], PATH_MAX, "%s/plugin-%04d.so", dir, i);
+    if (copy_file(plugin, paths[i]) != 0) {
+      fprintf(stderr, "cannot copy %s to %s\n", plugin, paths[i]);
+      return 1;
+    }
+  }
+
+  pthread_t tid[MAX_THREADS];
+  for (int i = 0; i < nthreads; i++) {
+    pthread_create(&tid[i], NULL, compute, &work[i]);
+  }
+
+  // churn: open every copy in turn (closing it again with -c) until
+  // the time is up; without -c each copy stays mapped after its
+  // first open and later rounds only bump its reference count
+  uint64_t opens = 0, failures = 0;
+  double t0 = now(), t1 = t0;
+  while (t1 - t0 < seconds) {
+    for (int i = 0; i < nmodules; i++) {
+      void* h = dlopen(paths[i], RTLD_NOW | RTLD_LOCAL);
+      if (! h) {
+	failures++;
+	continue;
+      }
+      opens++;
+      double (*fn)(int) = (double (*)(int)) dlsym(h, "plugin_work");
+      if (fn) sink += fn(1000);
+      if (do_close) dlclose(h);
+    }
+    if (nmodules == 0) usleep(1000);
+    t1 = now();
+  }
+  done = true;
+
+  uint64_t total = 0;
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+    total += work[i];
+  }
+
+  printf("modules %d, threads %d, %s\n", nmodules, nthreads,
+	 do_close ? "dlopen+dlclose" : "dlopen");
+  printf("  dlopen:  %lu calls (%.0f/s), %lu failed\n",
+	 (unsigned long) opens, opens / (t1 - t0), (unsigned long) failures);
+  printf("  compute: %.0f iterations/s per thread\n",
+	 total / (t1 - t0) / nthreads);
+
+  for (int i = 0; i < nmodules; i++) unlink(paths[i]);
+  if (nmodules > 0) rmdir(dir);
+  free(paths);
+  return 0;
+}
+
+#endif
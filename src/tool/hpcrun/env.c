@@ -54,9 +54,15 @@ const char* OBJECT_SIZE_THRESHOLD        = "OBJECT_SIZE_THRESHOLD";
 const char* BULLETIN_BOARD_SIZE    = "BULLETIN_BOARD_SIZE";
 const char* WATCHPOINT_SIZE        = "WATCHPOINT_SIZE";
 const char* HPCRUN_TRACE           = "HPCRUN_TRACE";
+const char* HPCRUN_TRACE_NS        = "HPCRUN_TRACE_NS";
+const char* HPCRUN_CLOCK           = "HPCRUN_CLOCK";
 
 const char* PAPI_EVENT_LIST        = "PAPI_EVENT_LIST";
 
 const char* HPCRUN_EVENT_LIST      = "HPCRUN_EVENT_LIST";
 const char* HPCRUN_MEMSIZE         = "HPCRUN_MEMSIZE";
 const char* HPCRUN_LOW_MEMSIZE     = "HPCRUN_LOW_MEMSIZE";
+const char* HPCRUN_CCT_BUDGET      = "HPCRUN_CCT_BUDGET";
+const char* HPCRUN_SNAPSHOT_INTERVAL = "HPCRUN_SNAPSHOT_INTERVAL";
+const char* HPCRUN_SNAPSHOT_SIGNAL = "HPCRUN_SNAPSHOT_SIGNAL";
+const char* HPCRUN_OVERHEAD        = "HPCRUN_OVERHEAD";
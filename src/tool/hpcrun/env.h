@@ -90,9 +90,15 @@ extern const char* OBJECT_SIZE_THRESHOLD;
 extern const char* WATCHPOINT_SIZE;
 
 extern const char* HPCRUN_TRACE;
+extern const char* HPCRUN_TRACE_NS;
+extern const char* HPCRUN_CLOCK;
 
 extern const char* HPCRUN_EVENT_LIST;
 extern const char* HPCRUN_MEMSIZE;
 extern const char* HPCRUN_LOW_MEMSIZE;
+extern const char* HPCRUN_CCT_BUDGET;
+extern const char* HPCRUN_SNAPSHOT_INTERVAL;
+extern const char* HPCRUN_SNAPSHOT_SIGNAL;
+extern const char* HPCRUN_OVERHEAD;
 
 #endif /* hpcrun_env_h */
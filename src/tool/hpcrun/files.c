@@ -144,6 +144,7 @@
 
 #define FILES_EARLY  0x1
 #define FILES_LATE   0x2
+#define FILES_TRY    0x4
 
 struct fileid {
   int  done;
@@ -243,14 +244,19 @@ hpcrun_files_next_id(struct fileid *id)
 
 // Open the file with O_EXCL and try the next file id if it already
 // exists.  The log and trace files are opened early, the profile file
-// (hpcrun) is opened late.  Must hold the files lock.
+// (hpcrun) is opened late.  With FILES_TRY, a failed open is returned
+// to the caller and the id is left open for later files.  If path is
+// non-null, it receives the file name (PATH_MAX bytes).  Must hold the
+// files lock.
 
-// Returns: file descriptor, else die on failure.
+// Returns: file descriptor, else -1 (FILES_TRY) or die on failure.
 //
 static int
-hpcrun_open_file(int rank, int thread, const char *suffix, int flags)
+hpcrun_open_file(int rank, int thread, const char *suffix, int flags,
+		 char *path)
 {
-  char name[PATH_MAX];
+  char buf[PATH_MAX];
+  char *name = (path != NULL) ? path : buf;
   struct fileid *id;
   int fd, ret;
 
@@ -281,6 +287,9 @@ hpcrun_open_file(int rank, int thread, const char *suffix, int flags)
       break;
     }
   }
+  if (flags & FILES_TRY) {
+    return fd;
+  }
   id->done = 1;
   if (flags & FILES_EARLY) {
     // late id starts where early id is chosen
@@ -435,7 +444,7 @@ hpcrun_open_log_file(void)
 
   spinlock_lock(&files_lock);
   hpcrun_files_init();
-  ret = hpcrun_open_file(0, 0, HPCRUN_LogFnmSfx, FILES_EARLY);
+  ret = hpcrun_open_file(0, 0, HPCRUN_LogFnmSfx, FILES_EARLY, NULL);
   if (ret >= 0) {
     log_done = 1;
   }
@@ -456,7 +465,7 @@ hpcrun_open_trace_file(int thread)
   TMSG(TRACE, "Calling files init for %d", thread);
   hpcrun_files_init();
   TMSG(TRACE, "About to open file for %d", thread);
-  ret = hpcrun_open_file(0, thread, HPCRUN_TraceFnmSfx, FILES_EARLY);
+  ret = hpcrun_open_file(0, thread, HPCRUN_TraceFnmSfx, FILES_EARLY, NULL);
   TMSG(TRACE, "Back from open file %d, ret code = %d", thread, ret);
   spinlock_unlock(&files_lock);
   TMSG(TRACE, "Unlocked file lock for %d", thread);
@@ -473,7 +482,29 @@ hpcrun_open_profile_file(int rank, int thread)
   spinlock_lock(&files_lock);
   hpcrun_files_init();
   hpcrun_rename_log_file_early(rank);
-  ret = hpcrun_open_file(rank, thread, HPCRUN_ProfileFnmSfx, FILES_LATE);
+  ret = hpcrun_open_file(rank, thread, HPCRUN_ProfileFnmSfx, FILES_LATE, NULL);
+  spinlock_unlock(&files_lock);
+
+  return ret;
+}
+
+// Returns: file descriptor for a thread's n-th snapshot file, else -1
+// with errno set.  Snapshots are named like the profile file, with the
+// rank known at the time and the late id, but a snapshot does not pin
+// the late id, and a failed open is left to the caller; path receives
+// the file name so that a partial snapshot can be removed.
+int
+hpcrun_open_snapshot_file(int rank, int thread, int index, char *path)
+{
+  char suffix[64];
+  int ret;
+
+  snprintf(suffix, sizeof(suffix), "%s-%04d.%s", HPCRUN_SnapshotFnmSfx,
+	   index, HPCRUN_ProfileFnmSfx);
+  spinlock_lock(&files_lock);
+  hpcrun_files_init();
+  ret = hpcrun_open_file((rank < 0) ? 0 : rank, thread, suffix,
+			 FILES_LATE | FILES_TRY, path);
   spinlock_unlock(&files_lock);
 
   return ret;
@@ -184,15 +184,18 @@ fnbounds_init()
   return 0;
 }
 
+// Lock-free with respect to dlopen: the load map is read inside a
+// loadmap read section, so a sample is neither dropped nor spun while
+// another thread maps a new module.
 bool
 fnbounds_enclosing_addr(void* ip, void** start, void** end, load_module_t** lm)
 {
-  FNBOUNDS_LOCK;
+  int epoch = hpcrun_loadmap_read_begin();
 
   bool ret = false; // failure unless otherwise reset to 0 below
   
   load_module_t* lm_ = fnbounds_get_loadModule(ip);
-  dso_info_t* dso = (lm_) ? lm_->dso_info : NULL;
+  dso_info_t* dso = (lm_) ? hpcrun_loadModule_dso(lm_) : NULL;
   
   if (dso && dso->nsymbols > 0) {
     void* ip_norm = ip;
@@ -221,7 +224,7 @@ fnbounds_enclosing_addr(void* ip, void** start, void** end, load_module_t** lm)
     *lm = lm_;
   }
 
-  FNBOUNDS_UNLOCK;
+  hpcrun_loadmap_read_end(epoch);
 
   return ret;
 }
@@ -492,7 +495,7 @@ static load_module_t *
 fnbounds_get_loadModule(void *ip)
 {
   load_module_t* lm = hpcrun_loadmap_findByAddr(ip, ip);
-  dso_info_t* dso = (lm) ? lm->dso_info : NULL;
+  dso_info_t* dso = (lm) ? hpcrun_loadModule_dso(lm) : NULL;
 
   // We can't call dl_iterate_phdr() in general because catching a
   // sample at just the wrong point inside dlopen() will segfault or
@@ -501,16 +504,26 @@ fnbounds_get_loadModule(void *ip)
   // However, the risk is small, and if we're willing to take the
   // risk, then analyzing the new DSO here allows us to sample inside
   // an init constructor.
-  if (!dso && ENABLED(DLOPEN_RISKY) && hpcrun_dlopen_pending() > 0) {
+  //
+  // Mapping makes this sample a writer: take the fnbounds lock (unless
+  // this thread was interrupted holding it) and look again, another
+  // thread may have mapped the module meanwhile.
+  if (!dso && ENABLED(DLOPEN_RISKY) && hpcrun_dlopen_pending() > 0
+      && ! TD_GET(fnbounds_lock)) {
     char module_name[PATH_MAX];
     void *mstart, *mend;
     
-    if (dylib_find_module_containing_addr(ip, module_name, &mstart, &mend)) {
+    FNBOUNDS_LOCK;
+    lm = hpcrun_loadmap_findByAddr(ip, ip);
+    dso = (lm) ? lm->dso_info : NULL;
+    if (!dso
+	&& dylib_find_module_containing_addr(ip, module_name, &mstart, &mend)) {
       dso = fnbounds_compute(module_name, mstart, mend);
       if (dso) {
 	lm = hpcrun_loadmap_map(dso);
       }
     }
+    FNBOUNDS_UNLOCK;
   }
   
   return lm;
@@ -0,0 +1,254 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// TSC-based process clock.
+//
+// Calibration brackets each CLOCK_MONOTONIC read between two TSC reads
+// over a ~10 ms window and derives a 32.32 fixed point nanoseconds per
+// tick factor. Wall-clock time is the CLOCK_REALTIME read at
+// calibration plus the converted ticks since, so trace time stamps of
+// different processes stay comparable.
+//
+
+//***************************************************************************
+// system include files 
+//***************************************************************************
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+
+//***************************************************************************
+// user include files 
+//***************************************************************************
+
+#include "env.h"
+#include "hpcrun_clock.h"
+#include <messages/messages.h>
+
+
+//***************************************************************************
+// macros
+//***************************************************************************
+
+#define CALIBRATION_NS  10000000UL
+#define CLOCKSOURCE_PATH \
+  "/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+
+//***************************************************************************
+// local data
+//***************************************************************************
+
+bool hpcrun_clock_use_tsc = false;
+
+static bool calibrated = false;
+static uint64_t base_ticks;
+static uint64_t base_realtime_ns;
+static uint64_t ns_per_tick_fp = 1UL << 32; // 32.32 fixed point
+static char description[64] = "monotonic";
+
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+static uint64_t
+read_clock_ns(clockid_t id)
+{
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+
+// invariant TSC: constant rate, keeps running in deep C-states
+static bool
+tsc_is_invariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007
+      && __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return (edx & (1 << 8)) != 0;
+  }
+#endif
+  return false;
+}
+
+
+// the kernel only keeps the tsc clocksource if the TSCs of all cores
+// passed its synchronization checks
+static bool
+tsc_is_kernel_clocksource(void)
+{
+  char buf[32] = { 0 };
+  int fd = open(CLOCKSOURCE_PATH, O_RDONLY);
+  if (fd < 0) return false;
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  return n >= 3 && strncmp(buf, "tsc", 3) == 0 && (buf[3] == '\n' || buf[3] == '\0');
+}
+
+
+// one (ticks, monotonic ns) pair; the tick is the midpoint of the TSC
+// reads around the clock read, retried if they are far apart
+static void
+sample_pair(uint64_t* ticks, uint64_t* ns)
+{
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 8; i++) {
+    uint64_t t0 = hpcrun_clock_ticks();
+    uint64_t m = read_clock_ns(CLOCK_MONOTONIC);
+    uint64_t t1 = hpcrun_clock_ticks();
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      *ticks = t0 + (t1 - t0) / 2;
+      *ns = m;
+    }
+  }
+}
+
+
+static void
+calibrate_tsc(void)
+{
+  uint64_t t0, m0, t1, m1;
+
+  sample_pair(&t0, &m0);
+  while (read_clock_ns(CLOCK_MONOTONIC) - m0 < CALIBRATION_NS) ;
+  sample_pair(&t1, &m1);
+
+  if (t1 <= t0 || m1 <= m0) {
+    EMSG("TSC calibration failed, using CLOCK_MONOTONIC");
+    hpcrun_clock_use_tsc = false;
+    return;
+  }
+  ns_per_tick_fp = (uint64_t) ((((unsigned __int128) (m1 - m0)) << 32) / (t1 - t0));
+  snprintf(description, sizeof(description), "tsc %.3f MHz",
+	   (t1 - t0) * 1000.0 / (m1 - m0));
+}
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_clock_init(void)
+{
+  // the calibration holds for forked children too
+  if (calibrated) return;
+
+  const char* choice = getenv(HPCRUN_CLOCK);
+  bool invariant = tsc_is_invariant();
+  if (choice && strcmp(choice, "monotonic") == 0) {
+    hpcrun_clock_use_tsc = false;
+  }
+  else if (choice && strcmp(choice, "tsc") == 0) {
+    if (! invariant) {
+      EMSG("HPCRUN_CLOCK=tsc: the TSC is not invariant, time stamps may drift");
+    }
+    hpcrun_clock_use_tsc = true;
+  }
+  else {
+    if (choice) {
+      EMSG("HPCRUN_CLOCK: unknown clock '%s', choosing automatically", choice);
+    }
+    hpcrun_clock_use_tsc = invariant && tsc_is_kernel_clocksource();
+  }
+#if !(defined(__x86_64__) || defined(__i386__))
+  hpcrun_clock_use_tsc = false;
+#endif
+
+  if (hpcrun_clock_use_tsc) {
+    calibrate_tsc();
+  }
+  if (! hpcrun_clock_use_tsc) {
+    ns_per_tick_fp = 1UL << 32;
+    strcpy(description, "monotonic");
+  }
+
+  base_ticks = hpcrun_clock_ticks();
+  base_realtime_ns = read_clock_ns(CLOCK_REALTIME);
+  calibrated = true;
+  TMSG(TRACE, "clock: %s", description);
+}
+
+
+uint64_t
+hpcrun_clock_ticks_to_ns(uint64_t ticks)
+{
+  return (uint64_t) (((unsigned __int128) ticks * ns_per_tick_fp) >> 32);
+}
+
+
+uint64_t
+hpcrun_clock_ns(void)
+{
+  if (! calibrated) {
+    return read_clock_ns(CLOCK_REALTIME);
+  }
+  return base_realtime_ns + hpcrun_clock_ticks_to_ns(hpcrun_clock_ticks() - base_ticks);
+}
+
+
+const char*
+hpcrun_clock_describe(void)
+{
+  return description;
+}
@@ -0,0 +1,92 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+#ifndef HPCRUN_CLOCK_H
+#define HPCRUN_CLOCK_H
+
+//
+// Process-wide clock for trace time stamps and watchpoint timing.
+//
+// Ticks come from the invariant TSC when the kernel also trusts it
+// across cores (clocksource "tsc"), else from CLOCK_MONOTONIC through
+// the vDSO, where a tick is a nanosecond. The TSC rate is calibrated
+// against CLOCK_MONOTONIC once per process. HPCRUN_CLOCK=tsc or
+// monotonic overrides the choice.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+extern bool hpcrun_clock_use_tsc;
+
+extern void hpcrun_clock_init(void);
+
+// cheap time stamp; comparable between threads on any core
+static inline uint64_t
+hpcrun_clock_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (hpcrun_clock_use_tsc) {
+    unsigned int lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+  }
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+extern uint64_t hpcrun_clock_ticks_to_ns(uint64_t ticks);
+
+// wall-clock nanoseconds since the epoch, advancing with the ticks
+extern uint64_t hpcrun_clock_ns(void);
+
+// e.g. "tsc 2893.412 MHz" or "monotonic"
+extern const char* hpcrun_clock_describe(void);
+
+#endif // HPCRUN_CLOCK_H
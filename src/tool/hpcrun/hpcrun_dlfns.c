@@ -89,10 +89,18 @@
 // And if we could just separate dlopen() into mmap() and its init
 // constructor, then we'd only need to block the mmap part. :-(
 //
-// DLOPEN_RISKY disables the read locks (always succeed), so that
-// sampling will never be blocked in this case.  But we keep the write
+// DLOPEN_RISKY used to disable the read locks so that sampling was
+// never blocked; the read locks now always succeed.  We keep the write
 // locks for the benefit of the fnbounds functions.
 //
+// Writers no longer exclude readers.  Samples look up the load map
+// lock-free (see hpcrun_loadmap_read_begin()); dlopen only adds to it
+// and to the unwind recipe map, and the dsos and unwind intervals
+// dlclose removes are retired to the load map and freed only after
+// the samples that could be using them are done.  So neither dlopen
+// nor dlclose waits for readers or turns them away, and the writers
+// lock only serializes writers.
+//
 static spinlock_t dlopen_lock = SPINLOCK_UNLOCKED;
 static atomic_long dlopen_num_readers = ATOMIC_VAR_INIT(0);
 static volatile long dlopen_num_writers = 0;
@@ -125,11 +133,6 @@ hpcrun_dlopen_write_lock(void)
     }
     spinlock_unlock(&dlopen_lock);
   } while (! acquire);
-
-  // Wait for any readers to finish.
-  if (! ENABLED(DLOPEN_RISKY)) {
-    while (atomic_load_explicit(&dlopen_num_readers, memory_order_relaxed) > 0) ;
-  }
 }
 
 
@@ -150,21 +153,13 @@ hpcrun_dlopen_downgrade_lock(void)
 }
 
 
-// Readers try to acquire a lock, but they don't wait if that fails.
-// Returns: 1 if acquired, else 0 if not.
+// Readers are no longer shut out by writers, so this always succeeds.
+// Returns: 1 (acquired).
 int
 hpcrun_dlopen_read_lock(void)
 {
-  int acquire = 0;
-
-  spinlock_lock(&dlopen_lock);
-  if (dlopen_num_writers == 0 || ENABLED(DLOPEN_RISKY)) {
-    atomic_fetch_add_explicit(&dlopen_num_readers, 1L, memory_order_relaxed);
-    acquire = 1;
-  }
-  spinlock_unlock(&dlopen_lock);
-
-  return (acquire);
+  atomic_fetch_add_explicit(&dlopen_num_readers, 1L, memory_order_relaxed);
+  return 1;
 }
 
 
@@ -0,0 +1,293 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Per-thread overhead histograms, see hpcrun_overhead.h.
+//
+// Shards come from hpcrun_mmap_anon rather than the thread's memstore
+// so they outlive the thread and are still there to be written at
+// exit. They are pushed on a lock-free list that only grows.
+//
+
+//***************************************************************************
+// system include files 
+//***************************************************************************
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//***************************************************************************
+// user include files 
+//***************************************************************************
+
+#include "env.h"
+#include "files.h"
+#include "hpcrun_overhead.h"
+#include <memory/mmap.h>
+#include <messages/fmt.h>
+#include <messages/messages.h>
+
+
+//***************************************************************************
+// macros
+//***************************************************************************
+
+#define JSON_BUF_SIZE  16384
+#define JSON_BUF_SLACK 1024
+
+
+//***************************************************************************
+// local data
+//***************************************************************************
+
+bool hpcrun_overhead_enabled = false;
+__thread hpcrun_overhead_shard_t* hpcrun_overhead_shard = NULL;
+
+static _Atomic(hpcrun_overhead_shard_t*) shard_list = ATOMIC_VAR_INIT(NULL);
+
+static const char* phase_names[HPCRUN_OVH_NUM_PHASES] = {
+  [HPCRUN_OVH_SAMPLE]         = "sample",
+  [HPCRUN_OVH_UNWIND]         = "unwind",
+  [HPCRUN_OVH_CCT_INSERT]     = "cct_insert",
+  [HPCRUN_OVH_METRIC]         = "metric",
+  [HPCRUN_OVH_TRACE]          = "trace",
+  [HPCRUN_OVH_PERF_HANDLER]   = "perf_handler",
+  [HPCRUN_OVH_WP_TRAP]        = "wp_trap",
+  [HPCRUN_OVH_WP_ARM]         = "wp_arm",
+  [HPCRUN_OVH_WRITE_PROFILE]  = "write_profile",
+  [HPCRUN_OVH_WRITE_SNAPSHOT] = "write_snapshot",
+};
+
+// json output, written by one thread at exit
+static int json_fd = -1;
+static char json_buf[JSON_BUF_SIZE];
+static size_t json_len = 0;
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_overhead_init(void)
+{
+  const char* s = getenv(HPCRUN_OVERHEAD);
+  hpcrun_overhead_enabled = (s != NULL && atoi(s) != 0);
+
+  // a forked child starts over with only the forking thread
+  atomic_store_explicit(&shard_list, NULL, memory_order_relaxed);
+  hpcrun_overhead_shard = NULL;
+
+  if (hpcrun_overhead_enabled) {
+    AMSG("OVERHEAD: timing hpcrun phases with %s", hpcrun_clock_describe());
+  }
+}
+
+
+void
+hpcrun_overhead_thread_init(int id)
+{
+  if (! hpcrun_overhead_enabled || hpcrun_overhead_shard != NULL) {
+    return;
+  }
+  hpcrun_overhead_shard_t* shard = hpcrun_mmap_anon(sizeof(hpcrun_overhead_shard_t));
+  if (shard == NULL) {
+    EMSG("OVERHEAD: no memory for the histograms of thread %d", id);
+    return;
+  }
+  memset(shard, 0, sizeof(*shard));
+  shard->thread_id = id;
+
+  hpcrun_overhead_shard_t* head =
+    atomic_load_explicit(&shard_list, memory_order_relaxed);
+  do {
+    shard->next = head;
+  } while (! atomic_compare_exchange_weak_explicit(&shard_list, &head, shard,
+             memory_order_release, memory_order_relaxed));
+
+  hpcrun_overhead_shard = shard;
+}
+
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+static void
+json_flush(void)
+{
+  if (json_len > 0 && write(json_fd, json_buf, json_len) != (ssize_t) json_len) {
+    EMSG("OVERHEAD: short write of the overhead histograms");
+  }
+  json_len = 0;
+}
+
+
+// every item written is far shorter than JSON_BUF_SLACK
+#define json_put(...)                                                      \
+  do {                                                                     \
+    if (json_len > JSON_BUF_SIZE - JSON_BUF_SLACK) json_flush();           \
+    json_len += hpcrun_msg_ns(json_buf + json_len, JSON_BUF_SIZE - json_len, \
+                              __VA_ARGS__);                                \
+  } while (0)
+
+
+static void
+hist_load(hpcrun_overhead_hist_t* h, uint64_t* count, uint64_t* ticks, uint64_t* max)
+{
+  for (int b = 0; b < HPCRUN_OVERHEAD_BUCKETS; b++) {
+    count[b] = atomic_load_explicit(&h->count[b], memory_order_relaxed);
+  }
+  *ticks = atomic_load_explicit(&h->ticks, memory_order_relaxed);
+  *max = atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+
+// "sample":{"count":..,"total_ns":..,"max_ns":..,"buckets":[[lo_ns,count],..]}
+// where lo_ns is the lower bound of the bucket
+static void
+json_put_hist(int phase, const uint64_t* count, uint64_t ticks, uint64_t max, bool first)
+{
+  uint64_t n = 0;
+  for (int b = 0; b < HPCRUN_OVERHEAD_BUCKETS; b++) {
+    n += count[b];
+  }
+  json_put("%s\"%s\":{\"count\":%lu,\"total_ns\":%lu,\"max_ns\":%lu,\"buckets\":[",
+           first ? "" : ",", phase_names[phase], n,
+           hpcrun_clock_ticks_to_ns(ticks), hpcrun_clock_ticks_to_ns(max));
+  bool first_bucket = true;
+  for (int b = 0; b < HPCRUN_OVERHEAD_BUCKETS; b++) {
+    if (count[b] == 0) continue;
+    json_put("%s[%lu,%lu]", first_bucket ? "" : ",",
+             b ? hpcrun_clock_ticks_to_ns(1UL << b) : 0UL, count[b]);
+    first_bucket = false;
+  }
+  json_put("]}");
+}
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_overhead_fini(void)
+{
+  if (! hpcrun_overhead_enabled) {
+    return;
+  }
+
+  char path[PATH_MAX];
+  hpcrun_msg_ns(path, sizeof(path), "%s/%s-%d.overhead.json",
+                hpcrun_files_output_directory(), hpcrun_files_executable_name(),
+                (int) getpid());
+  json_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (json_fd < 0) {
+    EMSG("OVERHEAD: unable to open %s", path);
+    return;
+  }
+  json_len = 0;
+
+  uint64_t total_count[HPCRUN_OVH_NUM_PHASES][HPCRUN_OVERHEAD_BUCKETS];
+  uint64_t total_ticks[HPCRUN_OVH_NUM_PHASES];
+  uint64_t total_max[HPCRUN_OVH_NUM_PHASES];
+  memset(total_count, 0, sizeof(total_count));
+  memset(total_ticks, 0, sizeof(total_ticks));
+  memset(total_max, 0, sizeof(total_max));
+
+  json_put("{\"pid\":%d,\"clock\":\"%s\",\"threads\":[",
+           (int) getpid(), hpcrun_clock_describe());
+
+  hpcrun_overhead_shard_t* shard =
+    atomic_load_explicit(&shard_list, memory_order_acquire);
+  for (bool first = true; shard != NULL; shard = shard->next, first = false) {
+    json_put("%s{\"thread\":%d,\"phases\":{", first ? "" : ",", shard->thread_id);
+    bool first_phase = true;
+    for (int p = 0; p < HPCRUN_OVH_NUM_PHASES; p++) {
+      uint64_t count[HPCRUN_OVERHEAD_BUCKETS], ticks, max;
+      hist_load(&shard->hist[p], count, &ticks, &max);
+      if (ticks == 0 && count[0] == 0 && max == 0) continue;
+
+      json_put_hist(p, count, ticks, max, first_phase);
+      first_phase = false;
+
+      for (int b = 0; b < HPCRUN_OVERHEAD_BUCKETS; b++) {
+        total_count[p][b] += count[b];
+      }
+      total_ticks[p] += ticks;
+      if (max > total_max[p]) total_max[p] = max;
+    }
+    json_put("}}");
+  }
+
+  json_put("],\"total\":{");
+  bool first_phase = true;
+  for (int p = 0; p < HPCRUN_OVH_NUM_PHASES; p++) {
+    if (total_ticks[p] == 0 && total_count[p][0] == 0) continue;
+    json_put_hist(p, total_count[p], total_ticks[p], total_max[p], first_phase);
+    first_phase = false;
+
+    uint64_t n = 0;
+    for (int b = 0; b < HPCRUN_OVERHEAD_BUCKETS; b++) {
+      n += total_count[p][b];
+    }
+    AMSG("OVERHEAD: %s: %lu intervals, total %lu ns, mean %lu ns, max %lu ns",
+         phase_names[p], n, hpcrun_clock_ticks_to_ns(total_ticks[p]),
+         hpcrun_clock_ticks_to_ns(total_ticks[p]) / (n ? n : 1),
+         hpcrun_clock_ticks_to_ns(total_max[p]));
+  }
+  json_put("}}\n");
+  json_flush();
+
+  close(json_fd);
+  json_fd = -1;
+}
@@ -0,0 +1,138 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+#ifndef HPCRUN_OVERHEAD_H
+#define HPCRUN_OVERHEAD_H
+
+//
+// Optional accounting of hpcrun's own overhead (HPCRUN_OVERHEAD=1).
+//
+// Each thread owns one log2 latency histogram per phase of sample
+// handling, timed with hpcrun_clock_ticks. Only the owner updates its
+// histograms, with relaxed loads and stores, so recording takes no lock
+// and is safe in a signal handler. At exit the histograms of every
+// thread are written to <outdir>/<exe>-<pid>.overhead.json.
+//
+// Phases nest (a sample is part of a perf handler, an unwind part of a
+// sample), so their times do not add up.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <lib/prof-lean/stdatomic.h>
+
+#include "hpcrun_clock.h"
+
+#define HPCRUN_OVERHEAD_BUCKETS 64
+
+typedef enum hpcrun_overhead_phase_t {
+  HPCRUN_OVH_SAMPLE,          // hpcrun_sample_callpath, once admitted
+  HPCRUN_OVH_UNWIND,          // backtrace, from the unwinder or the kernel
+  HPCRUN_OVH_CCT_INSERT,
+  HPCRUN_OVH_METRIC,
+  HPCRUN_OVH_TRACE,
+  HPCRUN_OVH_PERF_HANDLER,
+  HPCRUN_OVH_WP_TRAP,
+  HPCRUN_OVH_WP_ARM,
+  HPCRUN_OVH_WRITE_PROFILE,
+  HPCRUN_OVH_WRITE_SNAPSHOT,
+  HPCRUN_OVH_NUM_PHASES
+} hpcrun_overhead_phase_t;
+
+// bucket b counts the intervals of [2^b, 2^(b+1)) ticks; 0 ticks go to 0
+typedef struct hpcrun_overhead_hist_t {
+  atomic_uint_least64_t count[HPCRUN_OVERHEAD_BUCKETS];
+  atomic_uint_least64_t ticks;
+  atomic_uint_least64_t max;
+} hpcrun_overhead_hist_t;
+
+typedef struct hpcrun_overhead_shard_t {
+  hpcrun_overhead_hist_t hist[HPCRUN_OVH_NUM_PHASES];
+  int thread_id;
+  struct hpcrun_overhead_shard_t* next;
+} hpcrun_overhead_shard_t;
+
+extern bool hpcrun_overhead_enabled;
+extern __thread hpcrun_overhead_shard_t* hpcrun_overhead_shard;
+
+// start of a phase; 0 when disabled
+static inline uint64_t
+hpcrun_overhead_begin(void)
+{
+  return hpcrun_overhead_enabled ? hpcrun_clock_ticks() : 0;
+}
+
+static inline void
+hpcrun_overhead_end(hpcrun_overhead_phase_t phase, uint64_t start)
+{
+  hpcrun_overhead_shard_t* shard = hpcrun_overhead_shard;
+  if (start == 0 || shard == NULL) {
+    return;
+  }
+  uint64_t ticks = hpcrun_clock_ticks() - start;
+  int b = ticks ? 63 - __builtin_clzll(ticks) : 0;
+
+  hpcrun_overhead_hist_t* h = &shard->hist[phase];
+  atomic_store_explicit(&h->count[b],
+    atomic_load_explicit(&h->count[b], memory_order_relaxed) + 1, memory_order_relaxed);
+  atomic_store_explicit(&h->ticks,
+    atomic_load_explicit(&h->ticks, memory_order_relaxed) + ticks, memory_order_relaxed);
+  if (ticks > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+    atomic_store_explicit(&h->max, ticks, memory_order_relaxed);
+  }
+}
+
+// read HPCRUN_OVERHEAD; in a forked child, forget the parent's threads
+extern void hpcrun_overhead_init(void);
+
+// give the calling thread its histograms
+extern void hpcrun_overhead_thread_init(int id);
+
+// write the json file and a summary line to the log
+extern void hpcrun_overhead_fini(void);
+
+#endif // HPCRUN_OVERHEAD_H
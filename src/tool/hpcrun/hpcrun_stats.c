@@ -64,6 +64,7 @@
 #endif
 #include "matrix.h"
 #include "env.h"
+#include "hpcrun_clock.h"
 #include "myposix.h"
 
 //***************************************************************************
@@ -74,9 +75,17 @@ static atomic_long num_samples_total = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_attempted = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_blocked_async = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_blocked_dlopen = ATOMIC_VAR_INIT(0);
+static atomic_long num_samples_during_dlopen = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_dropped = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_segv = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_partial = ATOMIC_VAR_INIT(0);
+static atomic_long num_samples_callchain = ATOMIC_VAR_INIT(0);
+static atomic_long num_samples_callchain_fallback = ATOMIC_VAR_INIT(0);
+static atomic_long num_cct_prunes = ATOMIC_VAR_INIT(0);
+static atomic_long num_cct_folds = ATOMIC_VAR_INIT(0);
+static atomic_long num_cct_bytes_reclaimed = ATOMIC_VAR_INIT(0);
+
+static atomic_long num_snapshots = ATOMIC_VAR_INIT(0);
 static atomic_long num_samples_yielded = ATOMIC_VAR_INIT(0);
 
 
@@ -89,6 +98,10 @@ static atomic_long num_watchpoints_imprecise_address = ATOMIC_VAR_INIT(0);
 static atomic_long num_watchpoints_imprecise_address_8_byte = ATOMIC_VAR_INIT(0);
 static atomic_long num_sample_triggering_watchpoints= ATOMIC_VAR_INIT(0);
 static atomic_long num_insane_ip= ATOMIC_VAR_INIT(0);
+static atomic_long num_watchpoint_arms = ATOMIC_VAR_INIT(0);
+static atomic_long num_watchpoint_arm_cycles = ATOMIC_VAR_INIT(0);
+static atomic_long num_watchpoint_disarms = ATOMIC_VAR_INIT(0);
+static atomic_long num_watchpoint_disarm_cycles = ATOMIC_VAR_INIT(0);
 
 static atomic_long num_writtenBytes = ATOMIC_VAR_INIT(0);
 static atomic_long num_usedBytes = ATOMIC_VAR_INIT(0);
@@ -158,8 +171,15 @@ hpcrun_stats_reinit(void)
   atomic_store_explicit(&num_samples_attempted, 0, memory_order_relaxed);
   atomic_store_explicit(&num_samples_blocked_async, 0, memory_order_relaxed);
   atomic_store_explicit(&num_samples_blocked_dlopen, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_samples_during_dlopen, 0, memory_order_relaxed);
   atomic_store_explicit(&num_samples_dropped, 0, memory_order_relaxed);
   atomic_store_explicit(&num_samples_segv, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_samples_callchain, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_samples_callchain_fallback, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_cct_prunes, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_cct_folds, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_cct_bytes_reclaimed, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_snapshots, 0, memory_order_relaxed);
   atomic_store_explicit(&num_unwind_intervals_total, 0, memory_order_relaxed);
   atomic_store_explicit(&num_unwind_intervals_suspicious, 0, memory_order_relaxed);
   atomic_store_explicit(&trolled, 0, memory_order_relaxed);
@@ -174,6 +194,10 @@ hpcrun_stats_reinit(void)
   atomic_store_explicit(&num_watchpoints_imprecise_address_8_byte, 0, memory_order_relaxed);
   atomic_store_explicit(&num_sample_triggering_watchpoints, 0, memory_order_relaxed);
   atomic_store_explicit(&num_insane_ip, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_watchpoint_arms, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_watchpoint_arm_cycles, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_watchpoint_disarms, 0, memory_order_relaxed);
+  atomic_store_explicit(&num_watchpoint_disarm_cycles, 0, memory_order_relaxed);
   atomic_store_explicit(&num_writtenBytes, 0, memory_order_relaxed);
   atomic_store_explicit(&num_usedBytes, 0, memory_order_relaxed);
   atomic_store_explicit(&num_deadBytes,0,  memory_order_relaxed);
@@ -324,6 +348,23 @@ hpcrun_stats_num_insane_ip(void)
 }                
 
 
+// cost of arming and disarming watchpoints, in rdtsc cycles
+void
+hpcrun_stats_watchpoint_arm_latency_inc(long arms, long cycles)
+{
+  atomic_fetch_add_explicit(&num_watchpoint_arms, arms, memory_order_relaxed);
+  atomic_fetch_add_explicit(&num_watchpoint_arm_cycles, cycles, memory_order_relaxed);
+}
+
+
+void
+hpcrun_stats_watchpoint_disarm_latency_inc(long disarms, long cycles)
+{
+  atomic_fetch_add_explicit(&num_watchpoint_disarms, disarms, memory_order_relaxed);
+  atomic_fetch_add_explicit(&num_watchpoint_disarm_cycles, cycles, memory_order_relaxed);
+}
+
+
 void
 hpcrun_stats_num_writtenBytes_inc(long val)
 {
@@ -519,6 +560,24 @@ hpcrun_stats_num_samples_blocked_dlopen(void)
 }
 
 
+//-----------------------------
+// samples taken during dlopen
+//-----------------------------
+
+void
+hpcrun_stats_num_samples_during_dlopen_inc(void)
+{
+  atomic_fetch_add_explicit(&num_samples_during_dlopen, 1L, memory_order_relaxed);
+}
+
+
+long
+hpcrun_stats_num_samples_during_dlopen(void)
+{
+  return atomic_load_explicit(&num_samples_during_dlopen, memory_order_relaxed);
+}
+
+
 
 //-----------------------------
 // samples dropped
@@ -552,6 +611,74 @@ hpcrun_stats_num_samples_partial(void)
   return atomic_load_explicit(&num_samples_partial, memory_order_relaxed);
 }
 
+//----------------------------
+// backtraces taken from a sample's call chain
+//----------------------------
+
+void
+hpcrun_stats_num_samples_callchain_inc(void)
+{
+  atomic_fetch_add_explicit(&num_samples_callchain, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_num_samples_callchain(void)
+{
+  return atomic_load_explicit(&num_samples_callchain, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_num_samples_callchain_fallback_inc(void)
+{
+  atomic_fetch_add_explicit(&num_samples_callchain_fallback, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_num_samples_callchain_fallback(void)
+{
+  return atomic_load_explicit(&num_samples_callchain_fallback, memory_order_relaxed);
+}
+
+//----------------------------
+// cct pruning under a memory budget
+//----------------------------
+
+void
+hpcrun_stats_cct_prune_inc(long folds, long bytes)
+{
+  atomic_fetch_add_explicit(&num_cct_prunes, 1L, memory_order_relaxed);
+  atomic_fetch_add_explicit(&num_cct_folds, folds, memory_order_relaxed);
+  atomic_fetch_add_explicit(&num_cct_bytes_reclaimed, bytes, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_num_cct_folds(void)
+{
+  return atomic_load_explicit(&num_cct_folds, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_num_cct_bytes_reclaimed(void)
+{
+  return atomic_load_explicit(&num_cct_bytes_reclaimed, memory_order_relaxed);
+}
+
+//----------------------------
+// in-flight profile snapshots
+//----------------------------
+
+void
+hpcrun_stats_num_snapshots_inc(long val)
+{
+  atomic_fetch_add_explicit(&num_snapshots, val, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_num_snapshots(void)
+{
+  return atomic_load_explicit(&num_snapshots, memory_order_relaxed);
+}
+
 //-----------------------------
 // samples segv
 //-----------------------------
@@ -708,10 +835,32 @@ hpcrun_stats_print_summary(void)
   //AMSG("WATCHPOINT ANOMALIES: samples:%ld, SM_imprecise:%ld, WP_Set:%ld, WP_triggered:%ld, WP_SampleTriggering:%ld, WP_ImpreciseIP:%ld, WP_InsaneIP:%ld, WP_Off8Addr:%ld, WP_ImpreciseAddr:%ld, WP_Dropped:%ld", num_samples_total, num_samples_imprecise, num_watchpoints_set, num_watchpoints_triggered, num_sample_triggering_watchpoints,  num_watchpoints_imprecise, num_insane_ip, num_watchpoints_imprecise_address_8_byte, num_watchpoints_imprecise_address, num_watchpoints_dropped);
   AMSG("WATCHPOINT ANOMALIES: samples:%.2e, SM_imprecise:%.2e, WP_Set:%.2e, WP_triggered:%.2e, WP_SampleTriggering:%.2e, WP_ImpreciseIP:%.2e, WP_InsaneIP:%.2e, WP_Off8Addr:%.2e, WP_ImpreciseAddr:%.2e, WP_Dropped:%.2e", (double)atomic_load(&num_samples_total), (double)atomic_load(&num_samples_imprecise), (double)atomic_load(&num_watchpoints_set), (double)atomic_load(&num_watchpoints_triggered), (double)atomic_load(&num_sample_triggering_watchpoints),  (double)atomic_load(&num_watchpoints_imprecise), (double)atomic_load(&num_insane_ip), (double)atomic_load(&num_watchpoints_imprecise_address_8_byte), (double)atomic_load(&num_watchpoints_imprecise_address), (double)atomic_load(&num_watchpoints_dropped));
 
+  long arms = atomic_load_explicit(&num_watchpoint_arms, memory_order_relaxed);
+  long disarms = atomic_load_explicit(&num_watchpoint_disarms, memory_order_relaxed);
+  if (arms > 0) {
+    AMSG("WATCHPOINT LATENCY: arms:%ld (avg %.0f cycles), disarms:%ld (avg %.0f cycles)",
+         arms, (double)atomic_load_explicit(&num_watchpoint_arm_cycles, memory_order_relaxed) / arms,
+         disarms, disarms ? (double)atomic_load_explicit(&num_watchpoint_disarm_cycles, memory_order_relaxed) / disarms : 0.0);
+  }
+
   AMSG("WATCHPOINT STATS: writtenBytes:%ld, usedBytes:%ld, deadBytes:%ld, newBytes:%ld, oldBytes:%ld, oldAppxBytes:%ld, loadedBytes:%ld, accessedIns:%ld, falseWWIns:%ld, falseRWIns:%ld, falseWRIns:%ld, trueWWIns:%ld, trueRWIns:%ld, trueWRIns:%ld, RSS:%ld, reuse:%ld, reuseTemporal:%ld, reuseSpatial:%ld, latency:%ld", num_writtenBytes, num_usedBytes, num_deadBytes, num_newBytes, num_oldBytes, num_oldAppxBytes, num_loadedBytes, num_accessedIns, num_falseWWIns, num_falseRWIns, num_falseWRIns, num_trueWWIns, num_trueRWIns, num_trueWRIns,  (size_t)(rusage.ru_maxrss), num_reuse, num_reuseTemporal, num_reuseSpatial, num_latency);
 
   AMSG("COMDETECTIVE STATS: fs_volume:%0.2lf, fs_core_volume:%0.2lf, ts_volume:%0.2lf, ts_core_volume:%0.2lf, as_volume:%0.2lf, as_core_volume:%0.2lf, cache_line_transfer:%0.2lf, cache_line_transfer_millions:%0.2lf, cache_line_transfer_gbytes:%0.2lf", fs_volume, fs_core_volume, ts_volume, ts_core_volume, as_volume, as_core_volume, cache_line_transfer, cache_line_transfer_millions, cache_line_transfer_gbytes);
 
+  if (as_core_volume > 0) {
+    const double* level_volumes[] = { fs_level_volume, ts_level_volume, as_level_volume };
+    const char* kinds[] = { "fs", "ts", "as" };
+    for (int k = 0; k < 3; k++) {
+      char buf[256];
+      int len = 0;
+      for (int l = 0; l < HPCRUN_TOPO_NUM_LEVELS && len < sizeof(buf); l++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s:%0.2lf", l ? ", " : "",
+                        hpcrun_topology_level_name(l), level_volumes[k][l]);
+      }
+      AMSG("COMDETECTIVE TOPOLOGY: %s_core_volume by level: %s", kinds[k], buf);
+    }
+  }
+
   AMSG("SAMPLE ANOMALIES: blocks: %ld (async: %ld, dlopen: %ld), "
        "errors: %ld (segv: %ld, soft: %ld)",
        blocked, num_samples_blocked_async, num_samples_blocked_dlopen,
@@ -724,6 +873,33 @@ hpcrun_stats_print_summary(void)
        frames_total, trolled_frames,
        num_unwind_intervals_total,  num_unwind_intervals_suspicious);
 
+  long callchain = atomic_load_explicit(&num_samples_callchain, memory_order_relaxed);
+  long callchain_fallback = atomic_load_explicit(&num_samples_callchain_fallback, memory_order_relaxed);
+  if (callchain + callchain_fallback > 0) {
+    AMSG("CALLCHAIN: samples: %ld (unwinder fallback: %ld)",
+         callchain, callchain_fallback);
+  }
+
+  AMSG("CLOCK: %s", hpcrun_clock_describe());
+
+  long during_dlopen = atomic_load_explicit(&num_samples_during_dlopen, memory_order_relaxed);
+  if (during_dlopen > 0) {
+    AMSG("DLOPEN: samples taken while a dlopen was pending: %ld", during_dlopen);
+  }
+
+  long cct_prunes = atomic_load_explicit(&num_cct_prunes, memory_order_relaxed);
+  if (cct_prunes > 0) {
+    AMSG("CCT PRUNE: prunes: %ld, folds: %ld, bytes reclaimed: %ld",
+         cct_prunes,
+         atomic_load_explicit(&num_cct_folds, memory_order_relaxed),
+         atomic_load_explicit(&num_cct_bytes_reclaimed, memory_order_relaxed));
+  }
+
+  long snapshots = atomic_load_explicit(&num_snapshots, memory_order_relaxed);
+  if (snapshots > 0) {
+    AMSG("SNAPSHOTS: thread snapshots written: %ld", snapshots);
+  }
+
   if (hpcrun_get_disabled()) {
     AMSG("SAMPLING HAS BEEN DISABLED");
   }
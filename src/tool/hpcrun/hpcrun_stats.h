@@ -72,6 +72,8 @@ void hpcrun_stats_num_sample_triggering_watchpoints_inc(long val);
 long hpcrun_stats_num_sample_triggering_watchpoints(void);
 void hpcrun_stats_num_insane_ip_inc(long val);
 long hpcrun_stats_num_insane_ip(void);
+void hpcrun_stats_watchpoint_arm_latency_inc(long arms, long cycles);
+void hpcrun_stats_watchpoint_disarm_latency_inc(long disarms, long cycles);
 void hpcrun_stats_num_corrected_reuse_distance_inc(long val);
 void hpcrun_stats_num_falseWWIns_inc(long val);
 void hpcrun_stats_num_falseRWIns_inc(long val);
@@ -124,6 +126,14 @@ void hpcrun_stats_num_samples_blocked_dlopen_inc(void);
 long hpcrun_stats_num_samples_blocked_dlopen(void);
 
 
+//-----------------------------
+// samples taken during dlopen
+//-----------------------------
+
+void hpcrun_stats_num_samples_during_dlopen_inc(void);
+long hpcrun_stats_num_samples_during_dlopen(void);
+
+
 //-----------------------------
 // samples dropped
 //-----------------------------
@@ -139,6 +149,32 @@ long hpcrun_stats_num_samples_dropped(void);
 void hpcrun_stats_num_samples_partial_inc(void);
 long hpcrun_stats_num_samples_partial(void);
 
+//-----------------------------
+// samples whose backtrace came from the sample's call chain,
+// and samples that fell back to the unwinder
+//-----------------------------
+
+void hpcrun_stats_num_samples_callchain_inc(void);
+long hpcrun_stats_num_samples_callchain(void);
+
+void hpcrun_stats_num_samples_callchain_fallback_inc(void);
+long hpcrun_stats_num_samples_callchain_fallback(void);
+
+//-----------------------------
+// cct prune passes, subtrees folded and cct bytes they reclaimed
+//-----------------------------
+
+void hpcrun_stats_cct_prune_inc(long folds, long bytes);
+long hpcrun_stats_num_cct_folds(void);
+long hpcrun_stats_num_cct_bytes_reclaimed(void);
+
+//-----------------------------
+// thread snapshots written
+//-----------------------------
+
+void hpcrun_stats_num_snapshots_inc(long val);
+long hpcrun_stats_num_snapshots(void);
+
 //----------------------------
 // samples yielded due to deadlock prevention
 //----------------------------
@@ -0,0 +1,263 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Machine topology from sysfs, see hpcrun_topology.h.
+//
+// Cache domains are keyed by the lowest cpu of the cache's
+// shared_cpu_list, which every kernel has, rather than by the cache
+// "id" file, which older ones lack; the keys are then numbered densely
+// in cpu order. Without an L2 the SMT siblings of a core stand in for
+// it, without an L3 the socket does.
+//
+
+//***************************************************************************
+// system include files 
+//***************************************************************************
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//***************************************************************************
+// user include files 
+//***************************************************************************
+
+#include "hpcrun_topology.h"
+#include <messages/messages.h>
+
+
+//***************************************************************************
+// macros
+//***************************************************************************
+
+#define CPU_PATH "/sys/devices/system/cpu"
+
+
+//***************************************************************************
+// local data
+//***************************************************************************
+
+hpcrun_cpu_topo_t hpcrun_topology_table[HPCRUN_TOPO_MAX_CPUS];
+int hpcrun_topology_num_cpus = 0;
+__thread int hpcrun_topology_cpu_cache = -1;
+
+static int num_domains[HPCRUN_TOPO_CROSS_SOCKET];
+
+static const char* level_names[HPCRUN_TOPO_NUM_LEVELS] = {
+  "l2", "l3", "numa", "socket", "cross_socket", "unknown"
+};
+
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+// first integer in a sysfs file, -1 if it cannot be read
+static int
+read_int(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  int v = -1;
+  if (f) {
+    if (fscanf(f, "%d", &v) != 1) v = -1;
+    fclose(f);
+  }
+  return v;
+}
+
+
+// first line of a sysfs file without the newline, cut to size - 1 chars
+static int
+read_word(const char* path, char* buf, size_t size)
+{
+  FILE* f = fopen(path, "r");
+  int ok = f && fgets(buf, size, f) != NULL;
+  if (f) fclose(f);
+  if (ok) buf[strcspn(buf, " \t\n")] = '\0';
+  return ok;
+}
+
+
+static int
+numa_node_of(int cpu)
+{
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), CPU_PATH "/cpu%d", cpu);
+  DIR* dir = opendir(path);
+  if (!dir) return -1;
+  int node = -1;
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (sscanf(ent->d_name, "node%d", &node) == 1) break;
+    node = -1;
+  }
+  closedir(dir);
+  return node;
+}
+
+
+// key (lowest sharing cpu) of the data or unified cache of the level
+static int
+cache_key_of(int cpu, int level)
+{
+  char path[PATH_MAX];
+  char type[32];
+  for (int i = 0; ; i++) {
+    snprintf(path, sizeof(path), CPU_PATH "/cpu%d/cache/index%d/level", cpu, i);
+    int l = read_int(path);
+    if (l < 0) return -1;
+    if (l != level) continue;
+    snprintf(path, sizeof(path), CPU_PATH "/cpu%d/cache/index%d/type", cpu, i);
+    if (read_word(path, type, sizeof(type)) && strcmp(type, "Instruction") == 0) continue;
+    snprintf(path, sizeof(path), CPU_PATH "/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+    return read_int(path);
+  }
+}
+
+
+// replace keys (< HPCRUN_TOPO_MAX_CPUS, or -1) by dense ids in order
+// of first appearance; returns the number of ids
+static int
+densify(int* keys, int n)
+{
+  static int id_of[HPCRUN_TOPO_MAX_CPUS];
+  int next = 0;
+  for (int k = 0; k < HPCRUN_TOPO_MAX_CPUS; k++) id_of[k] = -1;
+  for (int i = 0; i < n; i++) {
+    int k = keys[i];
+    if (k < 0 || k >= HPCRUN_TOPO_MAX_CPUS) {
+      keys[i] = -1;
+      continue;
+    }
+    if (id_of[k] < 0) id_of[k] = next++;
+    keys[i] = id_of[k];
+  }
+  return next;
+}
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_topology_init(void)
+{
+  static int keys[HPCRUN_TOPO_CROSS_SOCKET][HPCRUN_TOPO_MAX_CPUS];
+  char path[PATH_MAX];
+
+  long n = sysconf(_SC_NPROCESSORS_CONF);
+  if (n <= 0) n = 1;
+  if (n > HPCRUN_TOPO_MAX_CPUS) n = HPCRUN_TOPO_MAX_CPUS;
+
+  for (int cpu = 0; cpu < n; cpu++) {
+    snprintf(path, sizeof(path), CPU_PATH "/cpu%d/topology/physical_package_id", cpu);
+    int socket = read_int(path);
+    int l2 = cache_key_of(cpu, 2);
+    if (l2 < 0) {
+      snprintf(path, sizeof(path), CPU_PATH "/cpu%d/topology/thread_siblings_list", cpu);
+      l2 = read_int(path);
+    }
+    int l3 = cache_key_of(cpu, 3);
+    if (l3 < 0 && socket >= 0) {
+      // a key no cpu has, one per socket
+      l3 = HPCRUN_TOPO_MAX_CPUS - 1 - socket;
+    }
+    keys[HPCRUN_TOPO_SAME_L2][cpu] = l2;
+    keys[HPCRUN_TOPO_SAME_L3][cpu] = l3;
+    keys[HPCRUN_TOPO_SAME_NUMA][cpu] = numa_node_of(cpu);
+    keys[HPCRUN_TOPO_SAME_SOCKET][cpu] = socket;
+  }
+
+  for (int level = 0; level < HPCRUN_TOPO_CROSS_SOCKET; level++) {
+    num_domains[level] = densify(keys[level], n);
+  }
+  for (int cpu = 0; cpu < n; cpu++) {
+    hpcrun_topology_table[cpu] = (hpcrun_cpu_topo_t) {
+      .l2 = keys[HPCRUN_TOPO_SAME_L2][cpu],
+      .l3 = keys[HPCRUN_TOPO_SAME_L3][cpu],
+      .numa = keys[HPCRUN_TOPO_SAME_NUMA][cpu],
+      .socket = keys[HPCRUN_TOPO_SAME_SOCKET][cpu],
+    };
+  }
+  hpcrun_topology_num_cpus = n;
+
+  TMSG(TOPOLOGY, "cpus: %ld, l2: %d, l3: %d, numa: %d, sockets: %d", n,
+       num_domains[HPCRUN_TOPO_SAME_L2], num_domains[HPCRUN_TOPO_SAME_L3],
+       num_domains[HPCRUN_TOPO_SAME_NUMA], num_domains[HPCRUN_TOPO_SAME_SOCKET]);
+}
+
+
+int
+hpcrun_topology_num_domains(hpcrun_topo_level_t level)
+{
+  return (level < HPCRUN_TOPO_CROSS_SOCKET) ? num_domains[level] : 0;
+}
+
+
+const char*
+hpcrun_topology_level_name(hpcrun_topo_level_t level)
+{
+  return (level < HPCRUN_TOPO_NUM_LEVELS) ? level_names[level] : "unknown";
+}
+
+
+int
+hpcrun_topology_cpu_slow(void)
+{
+  hpcrun_topology_cpu_cache = sched_getcpu();
+  return hpcrun_topology_cpu_cache;
+}
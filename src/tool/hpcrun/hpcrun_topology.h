@@ -0,0 +1,154 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+#ifndef HPCRUN_TOPOLOGY_H
+#define HPCRUN_TOPOLOGY_H
+
+//
+// Cache, NUMA and socket topology of the machine.
+//
+// Read once from /sys/devices/system/cpu at init into a table that
+// maps a cpu to dense ids of its L2 and L3 domains, NUMA node and
+// socket, so that the watchpoint clients can place two cpus relative
+// to each other with two array lookups.
+//
+// The current cpu comes from the rseq area glibc registers for every
+// thread (a plain load), else from one getcpu per signal: the value is
+// cached until the next hpcrun_safe_enter_async.
+//
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__) && __GNUC__ >= 11
+#include <features.h>
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#include <sys/rseq.h>
+#define HPCRUN_TOPO_RSEQ 1
+#endif
+#endif
+
+#define HPCRUN_TOPO_MAX_CPUS 2048
+
+// how close two cpus are: the smallest domain they share
+typedef enum hpcrun_topo_level_t {
+  HPCRUN_TOPO_SAME_L2,
+  HPCRUN_TOPO_SAME_L3,
+  HPCRUN_TOPO_SAME_NUMA,
+  HPCRUN_TOPO_SAME_SOCKET,
+  HPCRUN_TOPO_CROSS_SOCKET,
+  HPCRUN_TOPO_UNKNOWN,          // a cpu not in the table
+  HPCRUN_TOPO_NUM_LEVELS
+} hpcrun_topo_level_t;
+
+// dense ids, -1 where sysfs does not tell
+typedef struct hpcrun_cpu_topo_t {
+  int16_t l2;
+  int16_t l3;
+  int16_t numa;
+  int16_t socket;
+} hpcrun_cpu_topo_t;
+
+extern hpcrun_cpu_topo_t hpcrun_topology_table[HPCRUN_TOPO_MAX_CPUS];
+extern int hpcrun_topology_num_cpus;
+extern __thread int hpcrun_topology_cpu_cache;
+
+extern void hpcrun_topology_init(void);
+
+// number of distinct domains of a level (SAME_L2 .. SAME_SOCKET)
+extern int hpcrun_topology_num_domains(hpcrun_topo_level_t level);
+
+// e.g. "l3", "cross_socket"
+extern const char* hpcrun_topology_level_name(hpcrun_topo_level_t level);
+
+extern int hpcrun_topology_cpu_slow(void);
+
+static inline const hpcrun_cpu_topo_t*
+hpcrun_topology_of(int cpu)
+{
+  static const hpcrun_cpu_topo_t unknown = { -1, -1, -1, -1 };
+  return (cpu >= 0 && cpu < hpcrun_topology_num_cpus) ?
+    &hpcrun_topology_table[cpu] : &unknown;
+}
+
+static inline hpcrun_topo_level_t
+hpcrun_topology_level(int cpu1, int cpu2)
+{
+  const hpcrun_cpu_topo_t* a = hpcrun_topology_of(cpu1);
+  const hpcrun_cpu_topo_t* b = hpcrun_topology_of(cpu2);
+  if (a->socket < 0 || b->socket < 0) return HPCRUN_TOPO_UNKNOWN;
+  if (a->l2 >= 0 && a->l2 == b->l2) return HPCRUN_TOPO_SAME_L2;
+  if (a->l3 >= 0 && a->l3 == b->l3) return HPCRUN_TOPO_SAME_L3;
+  if (a->numa >= 0 && a->numa == b->numa) return HPCRUN_TOPO_SAME_NUMA;
+  if (a->socket == b->socket) return HPCRUN_TOPO_SAME_SOCKET;
+  return HPCRUN_TOPO_CROSS_SOCKET;
+}
+
+// the cpu the calling thread runs on
+static inline int
+hpcrun_topology_current_cpu(void)
+{
+#ifdef HPCRUN_TOPO_RSEQ
+  if (__rseq_size > 0) {
+    const volatile struct rseq* rs = (const volatile struct rseq*)
+      ((char*) __builtin_thread_pointer() + __rseq_offset);
+    int cpu = (int) rs->cpu_id;
+    if (cpu >= 0) return cpu;
+  }
+#endif
+  if (hpcrun_topology_cpu_cache < 0) {
+    return hpcrun_topology_cpu_slow();
+  }
+  return hpcrun_topology_cpu_cache;
+}
+
+// called on signal entry: the thread may have migrated since the last
+static inline void
+hpcrun_topology_forget_cpu(void)
+{
+  hpcrun_topology_cpu_cache = -1;
+}
+
+#endif // HPCRUN_TOPOLOGY_H
@@ -57,6 +57,7 @@
 
 #include <lib/prof-lean/hpcfmt.h>
 #include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
 
 #define LOADMAP_DEBUG 0
 
@@ -111,6 +112,142 @@ hpcrun_loadmap_notify_unmap(void *start, void *end)
 }
 
 
+//***************************************************************************
+// lock-free readers and reclamation of retired dsos
+//
+// Samples read the load map without a lock while dlopen and dlclose
+// change it. Load modules are only prepended and never freed, and a
+// dso_info_t does not change once published in a load module.
+// Replacing or unmapping a module's dso retires the old dso_info_t to
+// the limbo list of the current epoch, as do the unwind intervals
+// dlclose removes (hpcrun_loadmap_retire). Readers announce themselves
+// in the epoch's parity.
+//
+// Reclamation works on the previous epoch: once no reader of its
+// parity remains, its retired objects are freed. The epoch then
+// advances only if no reader of that parity has come back since, so
+// that a reader left over from two epochs ago, which may hold an
+// object retired in the epoch being closed, is never counted in the
+// parity whose limbo is freed next. Writers are serialized by the
+// fnbounds lock.
+//
+// A thread announces itself once per outermost section: the sample
+// path opens one around the whole unwind, and the per-frame sections
+// of hpcrun_normalize_ip and fnbounds_enclosing_addr nested in it
+// only check a thread-local flag.
+//***************************************************************************
+
+#define DSO_READ_NESTED (-1)
+
+static atomic_ulong dso_epoch = ATOMIC_VAR_INIT(0);
+static atomic_long dso_readers[2] = { ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0) };
+static dso_info_t* dso_limbo[2] = { NULL, NULL };
+static loadmap_retired_t* retired_limbo[2] = { NULL, NULL };
+
+// parity of this thread's open section, or DSO_READ_NESTED if none
+static __thread int dso_read_epoch = DSO_READ_NESTED;
+
+
+int
+hpcrun_loadmap_read_begin(void)
+{
+  if (dso_read_epoch != DSO_READ_NESTED) {
+    return DSO_READ_NESTED;
+  }
+  for (;;) {
+    unsigned long e = atomic_load(&dso_epoch);
+    int p = e & 1;
+    atomic_fetch_add(&dso_readers[p], 1L);
+    // announced in time: a writer that advances the epoch from now on
+    // waits for us
+    if (atomic_load(&dso_epoch) == e) {
+      dso_read_epoch = p;
+      return p;
+    }
+    atomic_fetch_add(&dso_readers[p], -1L);
+  }
+}
+
+
+// A nested end is a no-op, so a siglongjmp out of the unwind that
+// skips the inner ends leaves the outer section intact.
+void
+hpcrun_loadmap_read_end(int epoch)
+{
+  if (epoch == DSO_READ_NESTED) {
+    return;
+  }
+  dso_read_epoch = DSO_READ_NESTED;
+  atomic_fetch_add_explicit(&dso_readers[epoch], -1L, memory_order_release);
+}
+
+
+static void
+dso_retire(dso_info_t* dso)
+{
+  int cur = atomic_load(&dso_epoch) & 1;
+  dso->prev = NULL;
+  dso->next = dso_limbo[cur];
+  dso_limbo[cur] = dso;
+}
+
+
+void
+hpcrun_loadmap_retire(loadmap_retired_t* r, void (*free_fn)(void*),
+		      void* arg)
+{
+  int cur = atomic_load(&dso_epoch) & 1;
+  r->free_fn = free_fn;
+  r->arg = arg;
+  r->next = retired_limbo[cur];
+  retired_limbo[cur] = r;
+}
+
+
+static void
+dso_reclaim(void)
+{
+  unsigned long e = atomic_load(&dso_epoch);
+  int cur = e & 1;
+  int old = cur ^ 1;
+
+  if (atomic_load(&dso_readers[old]) != 0) {
+    return;
+  }
+
+  if (dso_limbo[old]) {
+    dso_info_t* last = dso_limbo[old];
+    while (last->next) last = last->next;
+    last->next = s_dso_free_list;
+    if (s_dso_free_list) {
+      s_dso_free_list->prev = last;
+    }
+    s_dso_free_list = dso_limbo[old];
+    dso_limbo[old] = NULL;
+    TMSG(DSO, "reclaimed the dsos retired before epoch %lu", e);
+  }
+  while (retired_limbo[old]) {
+    loadmap_retired_t* r = retired_limbo[old];
+    retired_limbo[old] = r->next;
+    r->free_fn(r->arg);
+  }
+
+  // readers of the old parity are gone (checked above): advancing now
+  // cannot strand one of them in the parity reused for epoch e + 1
+  if (dso_limbo[cur] || retired_limbo[cur]) {
+    atomic_store(&dso_epoch, e + 1);
+  }
+}
+
+
+static void
+dso_publish(load_module_t* lm, dso_info_t* dso)
+{
+  atomic_thread_fence(memory_order_release);
+  *(dso_info_t* volatile*) &lm->dso_info = dso;
+}
+
+
 //***************************************************************************
 // 
 //***************************************************************************
@@ -120,6 +257,7 @@ hpcrun_dso_new()
 {
   dso_info_t* x = NULL;
 
+  dso_reclaim();
   if (s_dso_free_list) {
     x = s_dso_free_list;
     s_dso_free_list = s_dso_free_list->next;
@@ -302,18 +440,19 @@ load_module_t*
 hpcrun_loadmap_findByAddr(void* begin, void* end)
 {
   TMSG(LOADMAP, "find by address %p -- %p", begin, end);
-  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+  for (load_module_t* x = hpcrun_loadmap_head(s_loadmap_ptr); (x); x = x->next) {
     TMSG(LOADMAP, "\tload module %s", x->name);
-    if (x->dso_info) {
+    dso_info_t* dso = hpcrun_loadModule_dso(x);
+    if (dso) {
       TMSG(LOADMAP, "\t\t [%lx, %lx) table [%lx, %lx)", 
-	   (uintptr_t) x->dso_info->start_addr,
-	   (uintptr_t) x->dso_info->end_addr,
-	   ((uintptr_t) x->dso_info->table ? ((uintptr_t) x->dso_info->table[0] + 
-				  x->dso_info->start_to_ref_dist) : -1),
-	   ((uintptr_t) x->dso_info->table ? ((uintptr_t) x->dso_info->table[x->dso_info->nsymbols -1] +
-				  x->dso_info->start_to_ref_dist) : -1)
+	   (uintptr_t) dso->start_addr,
+	   (uintptr_t) dso->end_addr,
+	   ((uintptr_t) dso->table ? ((uintptr_t) dso->table[0] + 
+				  dso->start_to_ref_dist) : -1),
+	   ((uintptr_t) dso->table ? ((uintptr_t) dso->table[dso->nsymbols -1] +
+				  dso->start_to_ref_dist) : -1)
 	   );
-      if (x->dso_info->start_addr <= begin && end <= x->dso_info->end_addr) {
+      if (dso->start_addr <= begin && end <= dso->end_addr) {
 	TMSG(LOADMAP, "       --->%s", x->name);
 	return x;
       }
@@ -328,7 +467,7 @@ load_module_t*
 hpcrun_loadmap_findByName(const char* name)
 {
   TMSG(LOADMAP, "find by name: %s", name);
-  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+  for (load_module_t* x = hpcrun_loadmap_head(s_loadmap_ptr); (x); x = x->next) {
     if (strcmp(x->name, name) == 0) {
       TMSG(LOADMAP, "       --->FOUND", x->name);
       return x;
@@ -342,7 +481,7 @@ load_module_t*
 hpcrun_loadmap_findById(uint16_t id)
 {
   TMSG(LOADMAP, "find by id %d", id);
-  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+  for (load_module_t* x = hpcrun_loadmap_head(s_loadmap_ptr); (x); x = x->next) {
     if (x->id == id) {
       TMSG(LOADMAP, "       --->%s", x->name);
       return x;
@@ -356,7 +495,7 @@ const char*
 hpcrun_loadmap_findLoadName(const char* name)
 {
   TMSG(LOADMAP, "find load name: %s", name);
-  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+  for (load_module_t* x = hpcrun_loadmap_head(s_loadmap_ptr); (x); x = x->next) {
     if (strstr(x->name, name)) {
       TMSG(LOADMAP, "       --->%s", x->name);
       return x->name;
@@ -374,19 +513,22 @@ hpcrun_loadmap_pushFront(load_module_t* lm)
 {
   TMSG(LOADMAP, "push front: %s", lm->name);
   // link 'm' at the head of the list of loaded modules
-  if (s_loadmap_ptr->lm_head) {
-    TMSG(LOADMAP, "previous front = %s", s_loadmap_ptr->lm_head->name);
-    s_loadmap_ptr->lm_head->prev = lm;
-    lm->next = s_loadmap_ptr->lm_head;
-    lm->prev = NULL;
-    s_loadmap_ptr->lm_head = lm;
-  }
-  else {
+  // lock-free readers walk forward from lm_head: link 'lm' completely
+  // before it becomes the head
+  load_module_t* head = s_loadmap_ptr->lm_head;
+  lm->next = head;
+  lm->prev = NULL;
+  if (! head) {
     TMSG(LOADMAP, " ->First entry");
-    s_loadmap_ptr->lm_head = lm;
     s_loadmap_ptr->lm_end = lm;
-    lm->next = NULL;
-    lm->prev = NULL;
+  }
+  else {
+    TMSG(LOADMAP, "previous front = %s", head->name);
+  }
+  atomic_thread_fence(memory_order_release);
+  *(load_module_t* volatile*) &s_loadmap_ptr->lm_head = lm;
+  if (head) {
+    head->prev = lm;
   }
 }
 
@@ -442,7 +584,7 @@ hpcrun_loadmap_map(dso_info_t* dso)
     if (lm->dso_info != dso) {
       TMSG(LOADMAP, " !! Internal consistency check fires !!");
       hpcrun_loadmap_unmap(lm);
-      lm->dso_info = dso;
+      dso_publish(lm, dso);
     }
     else {
       EMSG("hpcrun_loadmap_map(): attempt to both map dso '%s' and place it on the free list!", dso->name);
@@ -482,7 +624,7 @@ hpcrun_loadmap_unmap(load_module_t* lm)
   void *start_addr = old_dso->start_addr;
   void *end_addr = old_dso->end_addr;
 
-  lm->dso_info = NULL;
+  dso_publish(lm, NULL);
 
   // tallent: For now, do not move the loadmap to the back of the
   //   list.  If we want to enable, this, we could have
@@ -490,13 +632,10 @@ hpcrun_loadmap_unmap(load_module_t* lm)
   //   of the list.
   //hpcrun_loadmap_moveToBack(lm);
 
-  // add old_dso to the head of the s_dso_free_list
-  old_dso->next = s_dso_free_list;
-  old_dso->prev = NULL;
-  if (s_dso_free_list) {
-    s_dso_free_list->prev = old_dso;
-  }
-  s_dso_free_list = old_dso;
+  // a sample may still read old_dso: it returns to the free list
+  // once the readers of this epoch are gone
+  dso_retire(old_dso);
+  dso_reclaim();
   TMSG(LOADMAP, "Deleting unw intervals");
 
 #if LOADMAP_DEBUG
@@ -535,6 +674,10 @@ hpcrun_initLoadmap()
   hpcrun_loadmap_init(s_loadmap_ptr);
 
   s_dso_free_list = NULL;
+  dso_limbo[0] = dso_limbo[1] = NULL;
+  retired_limbo[0] = retired_limbo[1] = NULL;
+  atomic_store(&dso_readers[0], 0L);
+  atomic_store(&dso_readers[1], 0L);
 }
 
 
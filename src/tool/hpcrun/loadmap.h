@@ -136,6 +136,16 @@ typedef struct load_module_t
 load_module_t*
 hpcrun_loadModule_new(const char* name);
 
+// Read a load module's dso once; pairs with the writer's release
+// fence so the dso is seen fully initialized. NULL if unmapped.
+static inline dso_info_t*
+hpcrun_loadModule_dso(load_module_t* lm)
+{
+  dso_info_t* dso = *(dso_info_t* volatile*) &lm->dso_info;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return dso;
+}
+
 // used only to add a load module for the kernel 
 uint16_t 
 hpcrun_loadModule_add(const char* name);
@@ -153,6 +163,48 @@ typedef struct hpcrun_loadmap_t
 } hpcrun_loadmap_t;
 
 
+static inline load_module_t*
+hpcrun_loadmap_head(hpcrun_loadmap_t* lm)
+{
+  load_module_t* head = *(load_module_t* volatile*) &lm->lm_head;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return head;
+}
+
+
+// ---------------------------------------------------------
+// lock-free read sections
+// ---------------------------------------------------------
+
+// A sample may look up load modules and dereference their dsos
+// without a lock while dlopen publishes new ones. Bracket the lookup
+// and every use of the dsos it returns with a read section; dsos
+// retired meanwhile are not recycled until it ends. Sections nest
+// within a thread and only the outermost one is announced, so open
+// one around a whole unwind rather than paying for it per frame.
+int
+hpcrun_loadmap_read_begin(void);
+
+void
+hpcrun_loadmap_read_end(int epoch);
+
+
+// Objects a reader may still hold that dlclose removes from other
+// tables (e.g., unwind intervals) are retired with the dsos: 'free_fn'
+// runs on 'arg' once no read section that could have seen it remains.
+// 'r' is owned by the caller and must stay valid until then. Only
+// writers (under the fnbounds lock) may retire.
+typedef struct loadmap_retired_t {
+  struct loadmap_retired_t* next;
+  void (*free_fn)(void* arg);
+  void* arg;
+} loadmap_retired_t;
+
+void
+hpcrun_loadmap_retire(loadmap_retired_t* r, void (*free_fn)(void*),
+		      void* arg);
+
+
 // ---------------------------------------------------------
 // 
 // ---------------------------------------------------------
@@ -87,6 +87,9 @@
 #include "files.h"
 #include "fnbounds_interface.h"
 #include "fnbounds_table_interface.h"
+#include "hpcrun_clock.h"
+#include "hpcrun_overhead.h"
+#include "hpcrun_topology.h"
 #include "hpcrun_dlfns.h"
 #include "hpcrun_options.h"
 #include "hpcrun_return_codes.h"
@@ -123,6 +126,8 @@
 #include <monitor-exts/monitor_ext.h>
 
 #include <cct/cct.h>
+#include <cct/cct_prune.h>
+#include "snapshot.h"
 
 #include <unwind/common/backtrace.h>
 #include <unwind/common/unwind.h>
@@ -388,10 +393,16 @@ dump_interval_handler(int sig, siginfo_t* info, void* ctxt)
 void
 hpcrun_init_internal(bool is_child)
 {
+  hpcrun_clock_init();
+  hpcrun_topology_init();
   hpcrun_initLoadmap();
 
   hpcrun_memory_reinit();
   hpcrun_mmap_init();
+  hpcrun_cct_prune_init();
+  hpcrun_snapshot_init();
+  hpcrun_overhead_init();
+  hpcrun_overhead_thread_init(0);
   hpcrun_thread_data_init(0, NULL, is_child, hpcrun_get_num_sample_sources());
 
   // must initialize unwind recipe map before initializing fnbounds
@@ -637,6 +648,7 @@ hpcrun_fini_internal()
     hpcrun_threadMgr_data_fini(hpcrun_get_thread_data());
 
     fnbounds_fini();
+    hpcrun_overhead_fini();
     hpcrun_stats_print_summary();
     messages_fini();
   }
@@ -691,6 +703,8 @@ hpcrun_thread_init(int id, local_thread_data_t* local_thread_data) // cct_ctxt_t
 
   td->inside_hpcrun = 1;  // safe enter, disable signals
 
+  hpcrun_overhead_thread_init(id);
+
   if (! thr_ctxt) EMSG("Thread id %d passes null context", id);
   
   if (ENABLED(THREAD_CTXT))
@@ -744,6 +758,13 @@ hpcrun_thread_fini(epoch_t *epoch)
     thread_data_t* td = hpcrun_get_thread_data();
     hpcrun_threadMgr_data_put(epoch, td);
 
+    // a compact thread's data, memory included, is reused as a whole;
+    // otherwise hand the freeable memory over to the next thread
+    if (hpcrun_threadMgr_compact_thread() == OPTION_NO_COMPACT_THREAD) {
+      hpcrun_snapshot_thread_fini();
+      hpcrun_memory_thread_fini();
+    }
+
     TMSG(PROCESS, "End of thread");
   }
 }
@@ -1,9 +1,17 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <dirent.h>
 #include "matrix.h"
 #include <limits.h>
 
+#include <lib/prof-lean/hpcio.h>
+#include <lib/prof-lean/hpcrun-fmt.h>
+#include <messages/messages.h>
+#include "rank.h"
+
 int fs_matrix_size;
 int ts_matrix_size;
 int as_matrix_size;
@@ -43,8 +51,6 @@ double waw_fs_core_matrix[2000][2000];
 double waw_ts_core_matrix[2000][2000];
 double waw_as_core_matrix[2000][2000];
 
-long number_of_traps;
-
 long global_store_sampling_period;
 long global_load_sampling_period;
 
@@ -59,11 +65,7 @@ __thread long number_of_store_sample = 0;
 __thread long number_of_load_store_sample = 0;
 __thread long number_of_load_store_sample_all_loads = 0;
 __thread long number_of_load_store_sample_all_stores = 0;
-__thread long number_of_arming = 0;
 __thread long number_of_caught_traps = 0;
-__thread long number_of_caught_read_traps = 0;
-__thread long number_of_caught_write_traps = 0;
-__thread long number_of_caught_read_write_traps = 0;
 __thread long number_of_bulletin_board_updates_before = 0;
 __thread long number_of_bulletin_board_updates = 0;
 __thread long number_of_residues = 0;
@@ -103,667 +105,204 @@ double waw_as_core_volume;
 double waw_cache_line_transfer;
 double waw_cache_line_transfer_millions;
 double waw_cache_line_transfer_gbytes;
+double fs_level_volume[HPCRUN_TOPO_NUM_LEVELS];
+double ts_level_volume[HPCRUN_TOPO_NUM_LEVELS];
+double as_level_volume[HPCRUN_TOPO_NUM_LEVELS];
 
 // comdetective stats end
 
+// scale factor recorded by adjust_communication_volume() and folded into
+// the "any access" matrices when they are written; 1.0 means unscaled.
+static double comm_matrix_scale = 1.0;
+
 void adjust_communication_volume(double scale_ratio) {
-	//double scale_ratio = mem_access_sample / sample_count;
-          fprintf(stderr, "scale_ratio: %0.2lf\n", scale_ratio);
-	  printf("as_matrix_size: %d\n", as_matrix_size);
-          for(int i = 0; i <= as_matrix_size; i++) {
-                  for(int j = 0; j <= as_matrix_size; j++) {
-                        as_matrix[i][j] = as_matrix[i][j] * scale_ratio;
-                        fprintf(stderr, "%0.2lf ", as_matrix[i][j]);
-                  }
-                  fprintf(stderr, "\n");
-          }
-          for(int i = 0; i <= as_core_matrix_size; i++) {
-                  for(int j = 0; j <= as_core_matrix_size; j++)
-                        as_core_matrix[i][j] = as_core_matrix[i][j] * scale_ratio;
-          }
-          for(int i = 0; i <= fs_matrix_size; i++) {
-                  for(int j = 0; j <= fs_matrix_size; j++)
-                        fs_matrix[i][j] = fs_matrix[i][j] * scale_ratio;
-          }
-          for(int i = 0; i <= fs_core_matrix_size; i++) {
-                  for(int j = 0; j <= fs_core_matrix_size; j++)
-                        fs_core_matrix[i][j] = fs_core_matrix[i][j] * scale_ratio;
-          }
-          for(int i = 0; i <= ts_matrix_size; i++) {
-                  for(int j = 0; j <= ts_matrix_size; j++)
-                        ts_matrix[i][j] = ts_matrix[i][j] * scale_ratio;
-          }
-          for(int i = 0; i <= ts_core_matrix_size; i++) {
-                  for(int j = 0; j <= ts_core_matrix_size; j++)
-                        ts_core_matrix[i][j] = ts_core_matrix[i][j] * scale_ratio;
-          }
+	comm_matrix_scale = scale_ratio;
 }
 
-	void 
-dump_fs_matrix()
+// every whole-program matrix ComDetective maintains, in dump order
+typedef struct comm_matrix_desc_t {
+	double (*cells)[2000];
+	int *size;
+	uint32_t kind;
+	uint32_t domain;
+	uint32_t access;
+	double *volume;
+	double *level_volume;   // per topology level, core matrices only
+} comm_matrix_desc_t;
+
+static const comm_matrix_desc_t comm_matrices[] = {
+	{ fs_matrix,          &fs_matrix_size,      HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_ANY, &fs_volume },
+	{ fs_core_matrix,     &fs_core_matrix_size, HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_ANY, &fs_core_volume, fs_level_volume },
+	{ ts_matrix,          &ts_matrix_size,      HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_ANY, &ts_volume },
+	{ ts_core_matrix,     &ts_core_matrix_size, HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_ANY, &ts_core_volume, ts_level_volume },
+	{ as_matrix,          &as_matrix_size,      HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_ANY, &as_volume },
+	{ as_core_matrix,     &as_core_matrix_size, HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_ANY, &as_core_volume, as_level_volume },
+	{ war_fs_matrix,      &fs_matrix_size,      HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAR, &war_fs_volume },
+	{ war_fs_core_matrix, &fs_core_matrix_size, HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAR, &war_fs_core_volume },
+	{ war_ts_matrix,      &ts_matrix_size,      HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAR, &war_ts_volume },
+	{ war_ts_core_matrix, &ts_core_matrix_size, HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAR, &war_ts_core_volume },
+	{ war_as_matrix,      &as_matrix_size,      HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAR, &war_as_volume },
+	{ war_as_core_matrix, &as_core_matrix_size, HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAR, &war_as_core_volume },
+	{ waw_fs_matrix,      &fs_matrix_size,      HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAW, &waw_fs_volume },
+	{ waw_fs_core_matrix, &fs_core_matrix_size, HPCCOMM_KIND_FS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAW, &waw_fs_core_volume },
+	{ waw_ts_matrix,      &ts_matrix_size,      HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAW, &waw_ts_volume },
+	{ waw_ts_core_matrix, &ts_core_matrix_size, HPCCOMM_KIND_TS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAW, &waw_ts_core_volume },
+	{ waw_as_matrix,      &as_matrix_size,      HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_THREAD, HPCCOMM_ACCESS_WAW, &waw_as_volume },
+	{ waw_as_core_matrix, &as_core_matrix_size, HPCCOMM_KIND_AS, HPCCOMM_DOMAIN_CORE,   HPCCOMM_ACCESS_WAW, &waw_as_core_volume },
+};
+
+#define NUM_COMM_MATRICES (sizeof(comm_matrices) / sizeof(comm_matrices[0]))
+
+static inline int
+comm_matrix_dim(const comm_matrix_desc_t *d)
 {
-	FILE * fp;
-	char file_name[PATH_MAX]; 
-	sprintf(file_name, "%s/%s-%ld-fs_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_matrix_size: %d\n", fs_matrix_size);
-	double total= 0;
-	for(int i = fs_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= fs_matrix_size; j++)
-		{
-			if(j < fs_matrix_size) {
-				fprintf(fp, "%0.2lf,", fs_matrix[i][j] + fs_matrix[j][i]);
-				total += fs_matrix[i][j];
-				//printf("%0.2lf,", fs_matrix[i][j] + fs_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", fs_matrix[i][j] + fs_matrix[j][i]);
-				total += fs_matrix[i][j];
-				//printf("%0.2lf", fs_matrix[i][j] + fs_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	fs_volume = total;
+	// sizes are the largest index seen, so the matrix is size + 1 wide
+	int dim = *d->size + 1;
+	return (dim > 2000) ? 2000 : dim;
 }
 
-	void 
-dump_fs_core_matrix()
+static inline double
+comm_matrix_scale_of(const comm_matrix_desc_t *d)
 {
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-fs_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_core_matrix_size: %d\n", fs_core_matrix_size);
-	double total= 0;
-	for(int i = fs_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= fs_core_matrix_size; j++)
-		{
-			if(j < fs_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-				total += fs_core_matrix[i][j];
-				//printf("%0.2lf,", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-				total += fs_core_matrix[i][j];
-				//printf("%0.2lf", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	fs_core_volume = total;
+	return (d->access == HPCCOMM_ACCESS_ANY) ? comm_matrix_scale : 1.0;
 }
 
-	void 
-dump_ts_matrix()
+// Map each cpu to its NUMA node from the topology table; cpus whose
+// node is not known get HPCCOMM_FMT_NUMA_NULL.
+static uint32_t
+comm_matrix_numa_map(uint32_t *map, uint32_t max_cpus)
 {
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-ts_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_matrix_size: %d\n", ts_matrix_size);
-	double total = 0;
-	for(int i = ts_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= ts_matrix_size; j++)
-		{
-			if(j < ts_matrix_size) {
-				fprintf(fp, "%0.2lf,", ts_matrix[i][j] + ts_matrix[j][i]);
-				total += ts_matrix[i][j];
-				//printf("%0.2lf,", ts_matrix[i][j] + ts_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", ts_matrix[i][j] + ts_matrix[j][i]);
-				total += ts_matrix[i][j];
-				//printf("%0.2lf", ts_matrix[i][j] + ts_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	ts_volume = total;
-}
+	uint32_t ncpus = hpcrun_topology_num_cpus;
+	if (ncpus > max_cpus) ncpus = max_cpus;
 
-	void 
-dump_ts_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-ts_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_core_matrix_size: %d\n", ts_core_matrix_size);
-	double total = 0;
-	for(int i = ts_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= ts_core_matrix_size; j++)
-		{
-			if(j < ts_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-				total += ts_core_matrix[i][j];
-				//printf("%0.2lf,", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-				total += ts_core_matrix[i][j];
-				//printf("%0.2lf", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
+	for (uint32_t cpu = 0; cpu < ncpus; cpu++) {
+		int node = hpcrun_topology_of(cpu)->numa;
+		map[cpu] = (node < 0) ? HPCCOMM_FMT_NUMA_NULL : (uint32_t) node;
 	}
-	fclose(fp);
-	ts_core_volume = total;
+	return ncpus;
 }
 
-	void 
-dump_as_matrix()
+// Dense CSV of one matrix in the historical layout (rows from the highest
+// index down, each cell symmetrized); skipped with HPCRUN_COMM_MATRIX_CSV=0.
+static void
+dump_comm_matrix_csv(const comm_matrix_desc_t *d, double scale)
 {
-	FILE * fp;
 	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-as_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_matrix_size; j++)
-		{
-			if(j < as_matrix_size) {
-				fprintf(fp, "%0.2lf,", as_matrix[i][j] + as_matrix[j][i]);
-				total += as_matrix[i][j];
-				//printf("%0.2lf,", as_matrix[i][j] + as_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", as_matrix[i][j] + as_matrix[j][i]);
-				total += as_matrix[i][j];
-				//printf("%0.2lf", as_matrix[i][j] + as_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
+	snprintf(file_name, sizeof(file_name), "%s/%s-%ld-%s_matrix.csv", output_directory,
+		 hpcrun_files_executable_name(), (long) getpid(),
+		 hpccomm_fmt_matrix_name(d->kind, d->domain, d->access));
+	FILE *fp = fopen(file_name, "w");
+	if (!fp) {
+		EMSG("ComDetective: could not open %s", file_name);
+		return;
 	}
-	as_volume = total;
-	fclose(fp);
-}
-
-	void 
-dump_as_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-as_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_core_matrix_size; j++)
-		{
-			if(j < as_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", as_core_matrix[i][j] + as_core_matrix[j][i]);
-				total += as_core_matrix[i][j];
-				//printf("%0.2lf,", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", as_core_matrix[i][j] + as_core_matrix[j][i]);
-				total += as_core_matrix[i][j];
-				//printf("%0.2lf", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			}
+	int dim = comm_matrix_dim(d);
+	for (int i = dim - 1; i >= 0; i--) {
+		for (int j = 0; j < dim; j++) {
+			fprintf(fp, (j + 1 < dim) ? "%0.2lf," : "%0.2lf",
+				(d->cells[i][j] + d->cells[j][i]) * scale);
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
+		fputc('\n', fp);
 	}
-	as_core_volume = total;
-	cache_line_transfer = total;
-	cache_line_transfer_millions = total/(1000000);
-	cache_line_transfer_gbytes = total*64/(1024*1024*1024);
 	fclose(fp);
 }
 
-	void 
-dump_war_fs_matrix()
+// Write every communication matrix of this process into a single sparse
+// binary file (see hpccomm in hpcrun-fmt.h) and set the volume statistics
+// reported by hpcrun_stats.  The dense per-matrix CSV files are written
+// as well unless HPCRUN_COMM_MATRIX_CSV=0.
+void
+dump_comm_matrices()
 {
-	FILE * fp;
-	char file_name[PATH_MAX]; 
-	sprintf(file_name, "%s/%s-%ld-war_fs_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_matrix_size: %d\n", fs_matrix_size);
-	double total= 0;
-	for(int i = fs_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= fs_matrix_size; j++)
-		{
-			if(j < fs_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_fs_matrix[i][j] + war_fs_matrix[j][i]);
-				total += war_fs_matrix[i][j];
-				//printf("%0.2lf,", fs_matrix[i][j] + fs_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_fs_matrix[i][j] + war_fs_matrix[j][i]);
-				total += war_fs_matrix[i][j];
-				//printf("%0.2lf", fs_matrix[i][j] + fs_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	war_fs_volume = total;
-}
+	static uint32_t numa_map[2000];
 
-	void 
-dump_war_fs_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-war_fs_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_core_matrix_size: %d\n", fs_core_matrix_size);
-	double total= 0;
-	for(int i = fs_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= fs_core_matrix_size; j++)
-		{
-			if(j < fs_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_fs_core_matrix[i][j] + war_fs_core_matrix[j][i]);
-				total += war_fs_core_matrix[i][j];
-				//printf("%0.2lf,", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_fs_core_matrix[i][j] + war_fs_core_matrix[j][i]);
-				total += war_fs_core_matrix[i][j];
-				//printf("%0.2lf", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	war_fs_core_volume = total;
-}
+	char *csv_str = getenv("HPCRUN_COMM_MATRIX_CSV");
+	bool csv = !csv_str || atoi(csv_str) != 0;
 
-	void 
-dump_war_ts_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-war_ts_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_matrix_size: %d\n", ts_matrix_size);
-	double total = 0;
-	for(int i = ts_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= ts_matrix_size; j++)
-		{
-			if(j < ts_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_ts_matrix[i][j] + war_ts_matrix[j][i]);
-				total += war_ts_matrix[i][j];
-				//printf("%0.2lf,", ts_matrix[i][j] + ts_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_ts_matrix[i][j] + war_ts_matrix[j][i]);
-				total += war_ts_matrix[i][j];
-				//printf("%0.2lf", ts_matrix[i][j] + ts_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	war_ts_volume = total;
-}
+	hpccomm_fmt_hdr_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.rank = hpcrun_get_rank();
+	hdr.pid = getpid();
+	gethostname(hdr.hostname, HPCCOMM_FMT_HostLen - 1);
+	hdr.numMatrices = NUM_COMM_MATRICES;
+	hdr.numCPUs = comm_matrix_numa_map(numa_map, 2000);
+	hdr.cpuToNUMA = numa_map;
 
-	void 
-dump_war_ts_core_matrix()
-{
-	FILE * fp;
 	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-war_ts_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_core_matrix_size: %d\n", ts_core_matrix_size);
-	double total = 0;
-	for(int i = ts_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= ts_core_matrix_size; j++)
-		{
-			if(j < ts_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_ts_core_matrix[i][j] + war_ts_core_matrix[j][i]);
-				total += war_ts_core_matrix[i][j];
-				//printf("%0.2lf,", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_ts_core_matrix[i][j] + war_ts_core_matrix[j][i]);
-				total += war_ts_core_matrix[i][j];
-				//printf("%0.2lf", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-			}
+	snprintf(file_name, sizeof(file_name), "%s/%s-%ld.hpccomm", output_directory,
+		 hpcrun_files_executable_name(), (long) getpid());
+	FILE *fp = fopen(file_name, "w");
+	char *fp_buf = NULL;
+	if (fp) {
+		fp_buf = malloc(HPCIO_RWBufferSz);
+		if (fp_buf) setvbuf(fp, fp_buf, _IOFBF, HPCIO_RWBufferSz);
+		if (hpccomm_fmt_hdr_fwrite(&hdr, fp) != HPCFMT_OK) {
+			fclose(fp);
+			fp = NULL;
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
 	}
-	fclose(fp);
-	war_ts_core_volume = total;
-}
-
-	void 
-dump_war_as_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-war_as_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_matrix_size; j++)
-		{
-			if(j < as_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_as_matrix[i][j] + war_as_matrix[j][i]);
-				total += war_as_matrix[i][j];
-				//printf("%0.2lf,", as_matrix[i][j] + as_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_as_matrix[i][j] + war_as_matrix[j][i]);
-				total += war_as_matrix[i][j];
-				//printf("%0.2lf", as_matrix[i][j] + as_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
+	if (!fp) {
+		EMSG("ComDetective: could not write %s", file_name);
 	}
-	war_as_volume = total;
-	fclose(fp);
-}
 
-	void
-dump_war_as_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-war_as_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_core_matrix_size; j++)
-		{
-			if(j < as_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", war_as_core_matrix[i][j] + war_as_core_matrix[j][i]);
-				total += war_as_core_matrix[i][j];
-				//printf("%0.2lf,", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", war_as_core_matrix[i][j] + war_as_core_matrix[j][i]);
-				total += war_as_core_matrix[i][j];
-				//printf("%0.2lf", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	war_as_core_volume = total;
-	war_cache_line_transfer = total;
-	war_cache_line_transfer_millions = total/(1000000);
-	war_cache_line_transfer_gbytes = total*64/(1024*1024*1024);
-	fclose(fp);
-}
-
-	void
-dump_invalidation_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-invalidation_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_matrix_size; j++)
-		{
-			if(j < as_matrix_size) {
-				fprintf(fp, "%0.2lf,", invalidation_matrix[i][j] + invalidation_matrix[j][i]);
-				total += invalidation_matrix[i][j];
-				//printf("%0.2lf,", as_matrix[i][j] + as_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", invalidation_matrix[i][j] + invalidation_matrix[j][i]);
-				total += invalidation_matrix[i][j];
-				//printf("%0.2lf", as_matrix[i][j] + as_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	invalidation_volume = total;
-	fclose(fp);
-}
-
-	void
-dump_invalidation_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	/////////////////////////////////// WAW
-	sprintf(file_name, "%s/%s-%ld-invalidation_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_core_matrix_size; j++)
-		{
-			if(j < as_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", invalidation_core_matrix[i][j] + invalidation_core_matrix[j][i]);
-				total += invalidation_core_matrix[i][j];
-				//printf("%0.2lf,", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", invalidation_core_matrix[i][j] + invalidation_core_matrix[j][i]);
-				total += invalidation_core_matrix[i][j];
-				//printf("%0.2lf", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	invalidation_core_volume = total;
-	fclose(fp);
-}
-
-	void 
-dump_waw_fs_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX]; 
-	sprintf(file_name, "%s/%s-%ld-waw_fs_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_matrix_size: %d\n", fs_matrix_size);
-	double total= 0;
-	for(int i = fs_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= fs_matrix_size; j++)
-		{
-			if(j < fs_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_fs_matrix[i][j] + waw_fs_matrix[j][i]);
-				total += waw_fs_matrix[i][j];
-				//printf("%0.2lf,", fs_matrix[i][j] + fs_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_fs_matrix[i][j] + waw_fs_matrix[j][i]);
-				total += waw_fs_matrix[i][j];
-				//printf("%0.2lf", fs_matrix[i][j] + fs_matrix[j][i]);
-			}
-		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	waw_fs_volume = total;
-}
-
-	void 
-dump_waw_fs_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-waw_fs_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("fs_core_matrix_size: %d\n", fs_core_matrix_size);
-	double total= 0;
-	for(int i = fs_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= fs_core_matrix_size; j++)
-		{
-			if(j < fs_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_fs_core_matrix[i][j] + waw_fs_core_matrix[j][i]);
-				total += waw_fs_core_matrix[i][j];
-				//printf("%0.2lf,", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_fs_core_matrix[i][j] + waw_fs_core_matrix[j][i]);
-				total += waw_fs_core_matrix[i][j];
-				//printf("%0.2lf", fs_core_matrix[i][j] + fs_core_matrix[j][i]);
-			}
+	for (size_t m = 0; m < NUM_COMM_MATRICES; m++) {
+		const comm_matrix_desc_t *d = &comm_matrices[m];
+		int dim = comm_matrix_dim(d);
+		double scale = comm_matrix_scale_of(d);
+
+		// first pass: the record header needs nnz and total up front
+		hpccomm_fmt_matrix_t rec = {
+			.kind = d->kind, .domain = d->domain, .access = d->access,
+			.objId = HPCCOMM_FMT_ObjId_NULL, .dim = dim, .scale = scale,
+		};
+		double total = 0;
+		if (d->level_volume) {
+			memset(d->level_volume, 0, HPCRUN_TOPO_NUM_LEVELS * sizeof(double));
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	waw_fs_core_volume = total;
-}
-
-	void 
-dump_waw_ts_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-waw_ts_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_matrix_size: %d\n", ts_matrix_size);
-	double total = 0;
-	for(int i = ts_matrix_size; i >= 0; i--) 
-	{
-		for (int j = 0; j <= ts_matrix_size; j++)
-		{
-			if(j < ts_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_ts_matrix[i][j] + waw_ts_matrix[j][i]);
-				total += waw_ts_matrix[i][j];
-				//printf("%0.2lf,", ts_matrix[i][j] + ts_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_ts_matrix[i][j] + waw_ts_matrix[j][i]);
-				total += waw_ts_matrix[i][j];
-				//printf("%0.2lf", ts_matrix[i][j] + ts_matrix[j][i]);
+		for (int i = 0; i < dim; i++) {
+			for (int j = i; j < dim; j++) {
+				double v = (i == j) ? d->cells[i][i] : d->cells[i][j] + d->cells[j][i];
+				if (v != 0) {
+					rec.nnz++;
+					total += v;
+					if (d->level_volume) {
+						d->level_volume[hpcrun_topology_level(i, j)] += v * scale;
+					}
+				}
 			}
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	waw_ts_volume = total;
-}
-
-	void 
-dump_waw_ts_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	sprintf(file_name, "%s/%s-%ld-waw_ts_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("ts_core_matrix_size: %d\n", ts_core_matrix_size);
-	double total = 0;
-	for(int i = ts_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= ts_core_matrix_size; j++)
-		{
-			if(j < ts_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_ts_core_matrix[i][j] + waw_ts_core_matrix[j][i]);
-				total += waw_ts_core_matrix[i][j];
-				//printf("%0.2lf,", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_ts_core_matrix[i][j] + waw_ts_core_matrix[j][i]);
-				total += waw_ts_core_matrix[i][j];
-				//printf("%0.2lf", ts_core_matrix[i][j] + ts_core_matrix[j][i]);
+		rec.total = total * scale;
+		*d->volume = rec.total;
+
+		if (fp && hpccomm_fmt_matrix_fwrite(&rec, fp) == HPCFMT_OK) {
+			for (int i = 0; i < dim && rec.nnz; i++) {
+				for (int j = i; j < dim; j++) {
+					double v = (i == j) ? d->cells[i][i] : d->cells[i][j] + d->cells[j][i];
+					if (v == 0) continue;
+					hpccomm_fmt_entry_t e = { .row = i, .col = j, .value = v * scale };
+					hpccomm_fmt_entry_fwrite(&e, fp);
+				}
 			}
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
-	}
-	fclose(fp);
-	waw_ts_core_volume = total;
-}
-
-	void 
-dump_waw_as_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-waw_as_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	//printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0;
-	//printf("all sharing matrix:\n");
-	for(int i = as_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_matrix_size; j++)
-		{
-			if(j < as_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_as_matrix[i][j] + waw_as_matrix[j][i]);
-				total += waw_as_matrix[i][j];
-				//printf("%0.2lf,", as_matrix[i][j] + as_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_as_matrix[i][j] + waw_as_matrix[j][i]);
-				total += waw_as_matrix[i][j];
-				//printf("%0.2lf", as_matrix[i][j] + as_matrix[j][i]);
-			}
+		if (csv) {
+			dump_comm_matrix_csv(d, scale);
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
 	}
-	waw_as_volume = total;
-	fclose(fp);
-}
 
-	void 
-dump_waw_as_core_matrix()
-{
-	FILE * fp;
-	char file_name[PATH_MAX];
-	long timeprint = (long) clock();
-	sprintf(file_name, "%s/%s-%ld-waw_as_core_matrix.csv", output_directory, hpcrun_files_executable_name(), getpid() );
-	fp = fopen (file_name, "w+");
-	///printf("as_matrix_size: %d\n", as_matrix_size);
-	double total = 0.0;
-	///printf("all sharing matrix:\n");
-	for(int i = as_core_matrix_size; i >= 0; i--)
-	{
-		for (int j = 0; j <= as_core_matrix_size; j++)
-		{
-			if(j < as_core_matrix_size) {
-				fprintf(fp, "%0.2lf,", waw_as_core_matrix[i][j] + waw_as_core_matrix[j][i]);
-				total += waw_as_core_matrix[i][j];
-				//printf("%0.2lf,", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			} else {
-				fprintf(fp, "%0.2lf", waw_as_core_matrix[i][j] + waw_as_core_matrix[j][i]);
-				total += waw_as_core_matrix[i][j];
-				//printf("%0.2lf", as_core_matrix[i][j] + as_core_matrix[j][i]);
-			}
+	if (fp) {
+		if (fclose(fp) != 0) {
+			EMSG("ComDetective: error writing %s", file_name);
 		}
-		fprintf(fp,"\n");
-		//printf("\n");
 	}
-	waw_as_core_volume = total;
-	waw_cache_line_transfer = total;
-	waw_cache_line_transfer_millions = total/(1000000);
-	waw_cache_line_transfer_gbytes = total*64/(1024*1024*1024);
-	fclose(fp);
+	free(fp_buf);
+
+	cache_line_transfer = as_core_volume;
+	cache_line_transfer_millions = as_core_volume / (1000000);
+	cache_line_transfer_gbytes = as_core_volume * 64 / (1024 * 1024 * 1024);
+	war_cache_line_transfer = war_as_core_volume;
+	war_cache_line_transfer_millions = war_as_core_volume / (1000000);
+	war_cache_line_transfer_gbytes = war_as_core_volume * 64 / (1024 * 1024 * 1024);
+	waw_cache_line_transfer = waw_as_core_volume;
+	waw_cache_line_transfer_millions = waw_as_core_volume / (1000000);
+	waw_cache_line_transfer_gbytes = waw_as_core_volume * 64 / (1024 * 1024 * 1024);
 }
-
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include "sample-sources/watchpoint_support.h"
+#include "hpcrun_topology.h"
 
 extern int HASHTABLESIZE;
 extern int fs_matrix_size;
@@ -44,8 +45,6 @@ extern int ** matrix;
 extern long global_store_sampling_period;
 extern long global_load_sampling_period;
 
-extern long number_of_traps;
-
 // before
 extern __thread long number_of_sample;
 extern __thread long number_of_load_sample;
@@ -53,12 +52,8 @@ extern __thread long number_of_store_sample;
 extern __thread long number_of_load_store_sample;
 extern __thread long number_of_load_store_sample_all_loads;
 extern __thread long number_of_load_store_sample_all_stores;
-extern __thread long number_of_arming;
 extern __thread long number_of_residues;
 extern __thread long number_of_caught_traps;
-extern __thread long number_of_caught_read_traps;
-extern __thread long number_of_caught_write_traps;
-extern __thread long number_of_caught_read_write_traps;
 extern __thread long number_of_bulletin_board_updates;
 extern __thread long number_of_bulletin_board_updates_before;
 
@@ -66,31 +61,7 @@ extern int consecutive_access_count_array[50];
 extern int consecutive_wasted_trap_array[50];
 // after
 
-void dump_fs_matrix();
-void dump_ts_matrix();
-void dump_as_matrix();
-void dump_invalidation_matrix();
-
-void dump_fs_core_matrix();
-void dump_ts_core_matrix();
-void dump_as_core_matrix();
-void dump_invalidation_core_matrix();
-
-void dump_war_fs_matrix();
-void dump_war_ts_matrix();
-void dump_war_as_matrix();
-
-void dump_war_fs_core_matrix();
-void dump_war_ts_core_matrix();
-void dump_war_as_core_matrix();
-
-void dump_waw_fs_matrix();
-void dump_waw_ts_matrix();
-void dump_waw_as_matrix();
-
-void dump_waw_fs_core_matrix();
-void dump_waw_ts_core_matrix();
-void dump_waw_as_core_matrix();
+void dump_comm_matrices();
 void adjust_communication_volume(double scale_ratio);
 
 void dump_matrix();
@@ -128,6 +99,11 @@ extern double waw_cache_line_transfer;
 extern double waw_cache_line_transfer_millions;
 extern double waw_cache_line_transfer_gbytes;
 
+// core matrix volumes split by the topology level of the two cpus
+extern double fs_level_volume[HPCRUN_TOPO_NUM_LEVELS];
+extern double ts_level_volume[HPCRUN_TOPO_NUM_LEVELS];
+extern double as_level_volume[HPCRUN_TOPO_NUM_LEVELS];
+
 typedef struct SharedEntry{
 	volatile uint64_t counter __attribute__((aligned(CACHE_LINE_SZ)));
 	uint64_t time __attribute__((aligned(CACHE_LINE_SZ)));
@@ -86,16 +86,29 @@ extern "C" {
 // NOTE: This memory cannot be freed! 
 //---------------------------------------------------------------------------
 void* hpcrun_malloc(size_t size);
+
+//---------------------------------------------------------------------------
+// Function: hpcrun_malloc_freeable, hpcrun_free
+//
+// Purpose: allocate memory that can be released with hpcrun_free(),
+//      from any thread.  Both are async-signal safe.  Returns NULL if
+//      there is no memory.
+//
+// NOTE: hpcrun_free() accepts only memory from hpcrun_malloc_freeable().
+//---------------------------------------------------------------------------
 void* hpcrun_malloc_freeable(size_t size);
+void hpcrun_free(void* ptr);
 
 #else
 #define hpcrun_malloc malloc
 #define hpcrun_malloc_freeable malloc
+#define hpcrun_free free
 
 #endif // VALGRIND
 
 void hpcrun_memory_reinit(void);
 void hpcrun_reclaim_freeable_mem(void);
+void hpcrun_memory_thread_fini(void);
 void hpcrun_memory_summary(void);
 
 #if defined(__cplusplus)
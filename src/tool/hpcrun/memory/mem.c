@@ -46,10 +46,10 @@
 
 //
 // The new memory allocator.  We mmap() a large, single region (4 Meg)
-// per thread and dole out pieces via hpcrun_malloc().  Pieces are
-// either freeable (CCT nodes) or not freeable (everything else).
-// When memory gets low, we write out an epoch and reclaim the CCT
-// nodes.
+// per thread and dole out pieces via hpcrun_malloc().  These pieces
+// are never freed.  Freeable pieces come from hpcrun_malloc_freeable()
+// and go back with hpcrun_free(); they are managed by the slab
+// allocator in slab.c.
 //
 
 #include <sys/mman.h>
@@ -211,6 +211,7 @@ hpcrun_mmap_anon(size_t size)
 void
 hpcrun_memory_reinit(void)
 {
+  hpcrun_slab_reinit();
   num_reclaims = 0;
   num_failures = 0;
   total_freeable = 0;
@@ -248,6 +249,7 @@ hpcrun_make_memstore(hpcrun_meminfo_t *mi, int is_child)
   }
 
   mi->mi_start = addr;
+  mi->mi_slab = NULL;
   mi->mi_size = memsize;
   mi->mi_low = mi->mi_start;
   mi->mi_high = mi->mi_start + memsize;
@@ -344,43 +346,46 @@ hpcrun_malloc(size_t size)
 }
 
 //
-// Returns: address of freeable region at the high end,
-// else NULL on failure.
+// Returns: address of a freeable block of at least 'size' bytes,
+// else NULL on failure.  The block goes back with hpcrun_free(),
+// from any thread.
 //
 void *
 hpcrun_malloc_freeable(size_t size)
 {
-  return hpcrun_malloc(size);
-
-  // For now, don't bother with freeable memory.
-#if 0
-  hpcrun_meminfo_t *mi = &TD_GET(memstore);
-  void *addr, *ans;
-
-  size = round_up(size);
-  addr = mi->mi_low + size;
-
-  // Recoverable out of memory.
-  if (addr >= mi->mi_high) {
-    TD_GET(mem_low) = 1;
-    TMSG(MALLOC, "%s: size = %ld, failure: temporary out of memory",
-	 __func__, size);
-    num_failures++;
+  if (size == 0) {
     return NULL;
   }
 
-  // Low on memory.
-  if (addr + low_memsize > mi->mi_high) {
-    TD_GET(mem_low) = 1;
-    TMSG(MALLOC, "%s: low on memory, setting epoch flush flag", __func__);
+  void *addr = hpcrun_slab_alloc(&TD_GET(memstore), size);
+  if (addr == NULL) {
+    TMSG(MALLOC, "%s: size = %ld, failure: out of memory", __func__, size);
+    num_failures++;
+    return NULL;
   }
-
-  ans = mi->mi_low;
-  mi->mi_low = addr;
   total_freeable += size;
   TMSG(MALLOC, "%s: size = %ld, addr = %p", __func__, size, addr);
-  return ans;
-#endif
+  return addr;
+}
+
+//
+// Release a block from hpcrun_malloc_freeable().  NULL is ignored.
+// Memory from hpcrun_malloc() must not be passed here.
+//
+void
+hpcrun_free(void *ptr)
+{
+  hpcrun_slab_free(&TD_GET(memstore), ptr);
+}
+
+//
+// The calling thread is finished with its freeable memory.  Its free
+// blocks (and blocks other threads free later) go to the next thread.
+//
+void
+hpcrun_memory_thread_fini(void)
+{
+  hpcrun_slab_thread_fini(&TD_GET(memstore));
 }
 
 void
@@ -395,4 +400,6 @@ hpcrun_memory_summary(void)
   AMSG("MEMORY: total freeable: %.1f meg, total non-freeable: %.1f meg, "
        "malloc failures: %ld",
        total_freeable/meg, total_non_freeable/meg, num_failures);
+
+  hpcrun_slab_summary();
 }
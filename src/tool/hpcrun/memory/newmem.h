@@ -54,15 +54,27 @@
 #ifndef _HPCRUN_NEWMEM_H_
 #define _HPCRUN_NEWMEM_H_
 
+#include <stddef.h>
+
+struct hpcrun_slab_heap;
+
 struct hpcrun_meminfo {
   void *mi_start;
   void *mi_low;
   void *mi_high;
   long  mi_size;
+  struct hpcrun_slab_heap *mi_slab;  // freeable memory (slab.c)
 };
 
 typedef struct hpcrun_meminfo hpcrun_meminfo_t;
 
 void hpcrun_make_memstore(hpcrun_meminfo_t *mi, int is_child);
 
+// slab allocator for freeable memory
+void *hpcrun_slab_alloc(hpcrun_meminfo_t *mi, size_t size);
+void hpcrun_slab_free(hpcrun_meminfo_t *mi, void *ptr);
+void hpcrun_slab_thread_fini(hpcrun_meminfo_t *mi);
+void hpcrun_slab_reinit(void);
+void hpcrun_slab_summary(void);
+
 #endif
@@ -0,0 +1,537 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Size-class slab allocator behind hpcrun_malloc_freeable() and
+// hpcrun_free().
+//
+// Each thread owns a heap of slabs.  A slab is a SLAB_SIZE region,
+// aligned to SLAB_SIZE, that holds objects of one size class; its
+// header is at the start, so the slab of an object is found by
+// masking its address.  The owner allocates and frees without locks
+// or atomics, under the same reentrancy rules as hpcrun_malloc()
+// (hpcrun code does not interrupt itself).  An object freed by
+// another thread is pushed onto the owner heap's remote-free stack
+// with a CAS and is recycled by the owner the next time a size class
+// runs out of free objects.
+//
+// Requests above SLAB_MAX_SMALL get a mapping of their own, which
+// hpcrun_free() unmaps from any thread.  Slabs that become empty are
+// kept for reuse up to SLAB_EMPTY_KEEP per heap (plus the last one of
+// each class) and unmapped beyond that.  When a thread exits, its heap is put on an orphan list and
+// adopted by the next thread that needs a heap, together with any
+// frees that arrive for it in the meantime.
+//
+
+//------------------------------------------------------------------
+// System includes
+//------------------------------------------------------------------
+
+#include <sys/mman.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//------------------------------------------------------------------
+// Local includes
+//------------------------------------------------------------------
+
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
+
+#include <messages/messages.h>
+
+#include "mmap.h"
+#include "newmem.h"
+
+//------------------------------------------------------------------
+// Internal constants
+//------------------------------------------------------------------
+
+#define SLAB_SIZE        (64 * 1024)    // power of 2, multiple of the page size
+#define SLAB_MAGIC       0x534c4142u    // "SLAB"
+#define SLAB_LARGE       0xffff         // class of a dedicated mapping
+#define SLAB_HEADER_SIZE 128            // keeps objects 16-byte aligned
+#define SLAB_MAX_SMALL   4096
+#define SLAB_EMPTY_KEEP  4
+
+static const uint32_t slab_class_size[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+  3072, 4096
+};
+
+#define SLAB_NUM_CLASSES \
+  ((int) (sizeof(slab_class_size) / sizeof(slab_class_size[0])))
+
+//------------------------------------------------------------------
+// Internal types
+//------------------------------------------------------------------
+
+typedef struct slab_obj_s {
+  struct slab_obj_s *next;
+} slab_obj_t;
+
+typedef struct slab_s {
+  uint32_t magic;
+  uint16_t cls;               // index into slab_class_size, or SLAB_LARGE
+  uint16_t pad;
+  uint32_t nobjs;             // objects in the slab
+  uint32_t nused;             // objects handed out
+  size_t   map_size;          // size of the mapping (SLAB_LARGE)
+  struct hpcrun_slab_heap *heap;  // owner
+  slab_obj_t *free;           // objects freed by the owner
+  char *bump;                 // first object never handed out
+  char *end;
+  struct slab_s *prev;        // links in the heap's list for the class,
+  struct slab_s *next;        // or in its list of empty slabs
+} slab_t;
+
+struct hpcrun_slab_heap {
+  slab_t *avail[SLAB_NUM_CLASSES];   // slabs with free objects
+  slab_t *empty;                     // empty slabs kept for reuse
+  int     nempty;
+
+  // objects freed by other threads, a stack linked through the objects
+  _Atomic(slab_obj_t *) remote;
+
+  struct hpcrun_slab_heap *next_orphan;
+  struct hpcrun_slab_heap *next_heap;  // list of all heaps, for the summary
+
+  // statistics, written by the owner only
+  long num_allocs;
+  long num_frees;
+  long num_remote_frees;
+  long num_large;
+};
+
+//------------------------------------------------------------------
+// Internal data
+//------------------------------------------------------------------
+
+static spinlock_t heap_lock = SPINLOCK_UNLOCKED;
+static struct hpcrun_slab_heap *orphan_heaps = NULL;
+static struct hpcrun_slab_heap *all_heaps = NULL;
+
+static atomic_long num_heaps = ATOMIC_VAR_INIT(0);
+static atomic_long num_slabs = ATOMIC_VAR_INIT(0);
+static atomic_long max_slabs = ATOMIC_VAR_INIT(0);
+static atomic_long num_slabs_unmapped = ATOMIC_VAR_INIT(0);
+static atomic_long large_bytes = ATOMIC_VAR_INIT(0);
+static atomic_long num_large_frees = ATOMIC_VAR_INIT(0);
+static atomic_long num_failures = ATOMIC_VAR_INIT(0);
+
+//------------------------------------------------------------------
+// Internal functions
+//------------------------------------------------------------------
+
+static inline slab_t *
+slab_of(void *ptr)
+{
+  return (slab_t *) ((uintptr_t) ptr & ~((uintptr_t) SLAB_SIZE - 1));
+}
+
+static inline int
+slab_class(size_t size)
+{
+  int cls = 0;
+  while (slab_class_size[cls] < size) {
+    cls++;
+  }
+  return cls;
+}
+
+// mmap 'size' bytes aligned to SLAB_SIZE by trimming an oversized
+// mapping.  'size' is a multiple of SLAB_SIZE.
+static void *
+slab_map_aligned(size_t size)
+{
+  char *addr = hpcrun_mmap_anon(size + SLAB_SIZE);
+  if (addr == NULL) {
+    return NULL;
+  }
+
+  char *start = (char *) (((uintptr_t) addr + SLAB_SIZE - 1)
+                          & ~((uintptr_t) SLAB_SIZE - 1));
+  size_t head = start - addr;
+  size_t tail = SLAB_SIZE - head;
+  if (head > 0) {
+    munmap(addr, head);
+  }
+  if (tail > 0) {
+    munmap(start + size, tail);
+  }
+  return start;
+}
+
+static inline void
+slab_count_mapped(void)
+{
+  long n = atomic_fetch_add_explicit(&num_slabs, 1, memory_order_relaxed) + 1;
+  long max = atomic_load_explicit(&max_slabs, memory_order_relaxed);
+  while (n > max
+         && ! atomic_compare_exchange_weak_explicit(&max_slabs, &max, n,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed));
+}
+
+static inline void
+slab_unmap(slab_t *slab)
+{
+  slab->magic = 0;
+  munmap(slab, SLAB_SIZE);
+  atomic_fetch_sub_explicit(&num_slabs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&num_slabs_unmapped, 1, memory_order_relaxed);
+}
+
+static inline void
+slab_list_push(slab_t **list, slab_t *slab)
+{
+  slab->prev = NULL;
+  slab->next = *list;
+  if (*list) {
+    (*list)->prev = slab;
+  }
+  *list = slab;
+}
+
+static inline void
+slab_list_remove(slab_t **list, slab_t *slab)
+{
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    *list = slab->next;
+  }
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+  slab->prev = slab->next = NULL;
+}
+
+static void
+slab_format(slab_t *slab, struct hpcrun_slab_heap *heap, int cls)
+{
+  slab->magic = SLAB_MAGIC;
+  slab->cls   = cls;
+  slab->map_size = SLAB_SIZE;
+  slab->heap  = heap;
+  slab->free  = NULL;
+  slab->bump  = (char *) slab + SLAB_HEADER_SIZE;
+  slab->nobjs = (SLAB_SIZE - SLAB_HEADER_SIZE) / slab_class_size[cls];
+  slab->nused = 0;
+  slab->end   = slab->bump + (size_t) slab->nobjs * slab_class_size[cls];
+}
+
+// a slab for class 'cls', from the heap's empty slabs if possible
+static slab_t *
+slab_new(struct hpcrun_slab_heap *heap, int cls)
+{
+  slab_t *slab = heap->empty;
+  if (slab) {
+    slab_list_remove(&heap->empty, slab);
+    heap->nempty--;
+  } else {
+    slab = slab_map_aligned(SLAB_SIZE);
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab_count_mapped();
+  }
+  slab_format(slab, heap, cls);
+  slab_list_push(&heap->avail[cls], slab);
+  return slab;
+}
+
+// return an object of a slab owned by 'heap'
+static void
+slab_free_local(struct hpcrun_slab_heap *heap, slab_t *slab, void *ptr)
+{
+  slab_obj_t *obj = (slab_obj_t *) ptr;
+  obj->next = slab->free;
+  slab->free = obj;
+
+  if (slab->nused == slab->nobjs) {
+    // it was full, so it is not in the avail list
+    slab_list_push(&heap->avail[slab->cls], slab);
+  }
+  slab->nused--;
+
+  // an empty slab stays in place if it is the only one of its class,
+  // so that a class that allocates and frees in turn does not map
+  // and unmap a slab each time
+  if (slab->nused == 0
+      && (heap->avail[slab->cls] != slab || slab->next != NULL)) {
+    slab_list_remove(&heap->avail[slab->cls], slab);
+    if (heap->nempty < SLAB_EMPTY_KEEP) {
+      slab_list_push(&heap->empty, slab);
+      heap->nempty++;
+    } else {
+      slab_unmap(slab);
+    }
+  }
+}
+
+// recycle the objects other threads have freed into 'heap'
+static void
+slab_drain_remote(struct hpcrun_slab_heap *heap)
+{
+  slab_obj_t *obj =
+    atomic_exchange_explicit(&heap->remote, NULL, memory_order_acquire);
+  while (obj) {
+    slab_obj_t *next = obj->next;
+    slab_free_local(heap, slab_of(obj), obj);
+    heap->num_remote_frees++;
+    obj = next;
+  }
+}
+
+static void *
+slab_alloc_large(struct hpcrun_slab_heap *heap, size_t size)
+{
+  size_t map_size = (SLAB_HEADER_SIZE + size + SLAB_SIZE - 1)
+                    & ~((size_t) SLAB_SIZE - 1);
+  slab_t *slab = slab_map_aligned(map_size);
+  if (slab == NULL) {
+    return NULL;
+  }
+  slab->magic = SLAB_MAGIC;
+  slab->cls   = SLAB_LARGE;
+  slab->map_size = map_size;
+  slab->heap  = heap;
+  slab->nobjs = slab->nused = 1;
+  atomic_fetch_add_explicit(&large_bytes, map_size, memory_order_relaxed);
+  heap->num_large++;
+  return (char *) slab + SLAB_HEADER_SIZE;
+}
+
+static struct hpcrun_slab_heap *
+slab_heap_get(void)
+{
+  struct hpcrun_slab_heap *heap = NULL;
+
+  spinlock_lock(&heap_lock);
+  if (orphan_heaps) {
+    heap = orphan_heaps;
+    orphan_heaps = heap->next_orphan;
+  }
+  spinlock_unlock(&heap_lock);
+
+  if (heap) {
+    heap->next_orphan = NULL;
+    TMSG(MALLOC, "%s: adopt slab heap %p", __func__, heap);
+    return heap;
+  }
+
+  // mmap-ed memory is zero, which is an empty heap
+  heap = hpcrun_mmap_anon(sizeof(struct hpcrun_slab_heap));
+  if (heap == NULL) {
+    return NULL;
+  }
+  atomic_init(&heap->remote, NULL);
+
+  spinlock_lock(&heap_lock);
+  heap->next_heap = all_heaps;
+  all_heaps = heap;
+  spinlock_unlock(&heap_lock);
+
+  atomic_fetch_add_explicit(&num_heaps, 1, memory_order_relaxed);
+  TMSG(MALLOC, "%s: new slab heap %p", __func__, heap);
+  return heap;
+}
+
+//------------------------------------------------------------------
+// Interface functions (see newmem.h)
+//------------------------------------------------------------------
+
+void *
+hpcrun_slab_alloc(hpcrun_meminfo_t *mi, size_t size)
+{
+  struct hpcrun_slab_heap *heap = mi->mi_slab;
+  if (heap == NULL) {
+    heap = mi->mi_slab = slab_heap_get();
+    if (heap == NULL) {
+      atomic_fetch_add_explicit(&num_failures, 1, memory_order_relaxed);
+      return NULL;
+    }
+  }
+
+  void *ptr;
+  if (size > SLAB_MAX_SMALL) {
+    ptr = slab_alloc_large(heap, size);
+  } else {
+    int cls = slab_class(size);
+    slab_t *slab = heap->avail[cls];
+    if (slab == NULL) {
+      slab_drain_remote(heap);
+      slab = heap->avail[cls];
+    }
+    if (slab == NULL) {
+      slab = slab_new(heap, cls);
+    }
+    if (slab == NULL) {
+      ptr = NULL;
+    } else {
+      if (slab->free) {
+        ptr = slab->free;
+        slab->free = slab->free->next;
+      } else {
+        ptr = slab->bump;
+        slab->bump += slab_class_size[cls];
+      }
+      slab->nused++;
+      if (slab->nused == slab->nobjs) {
+        slab_list_remove(&heap->avail[cls], slab);
+      }
+    }
+  }
+
+  if (ptr == NULL) {
+    atomic_fetch_add_explicit(&num_failures, 1, memory_order_relaxed);
+    return NULL;
+  }
+  heap->num_allocs++;
+  return ptr;
+}
+
+void
+hpcrun_slab_free(hpcrun_meminfo_t *mi, void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  slab_t *slab = slab_of(ptr);
+  if (slab->magic != SLAB_MAGIC) {
+    EMSG("%s: %p is not from hpcrun_malloc_freeable", __func__, ptr);
+    return;
+  }
+
+  if (slab->cls == SLAB_LARGE) {
+    atomic_fetch_sub_explicit(&large_bytes, slab->map_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&num_large_frees, 1, memory_order_relaxed);
+    slab->magic = 0;
+    munmap(slab, slab->map_size);
+    return;
+  }
+
+  struct hpcrun_slab_heap *heap = slab->heap;
+  if (heap == mi->mi_slab) {
+    slab_free_local(heap, slab, ptr);
+    heap->num_frees++;
+    return;
+  }
+
+  // another thread's object: hand it back to its owner
+  slab_obj_t *obj = (slab_obj_t *) ptr;
+  slab_obj_t *head = atomic_load_explicit(&heap->remote, memory_order_relaxed);
+  do {
+    obj->next = head;
+  } while (! atomic_compare_exchange_weak_explicit(&heap->remote, &head, obj,
+                                                   memory_order_release,
+                                                   memory_order_relaxed));
+}
+
+// the thread is done with its heap; the next thread that needs one
+// takes it over, with its free objects and pending remote frees
+void
+hpcrun_slab_thread_fini(hpcrun_meminfo_t *mi)
+{
+  struct hpcrun_slab_heap *heap = mi->mi_slab;
+  if (heap == NULL) {
+    return;
+  }
+  mi->mi_slab = NULL;
+
+  spinlock_lock(&heap_lock);
+  heap->next_orphan = orphan_heaps;
+  orphan_heaps = heap;
+  spinlock_unlock(&heap_lock);
+
+  TMSG(MALLOC, "%s: orphan slab heap %p", __func__, heap);
+}
+
+// after fork(), the lock may have been held by a thread that does
+// not exist in the child
+void
+hpcrun_slab_reinit(void)
+{
+  spinlock_unlock(&heap_lock);
+}
+
+void
+hpcrun_slab_summary(void)
+{
+  double meg = 1024.0 * 1024.0;
+  long allocs = 0, frees = 0, remote = 0, large = 0;
+
+  spinlock_lock(&heap_lock);
+  for (struct hpcrun_slab_heap *heap = all_heaps; heap; heap = heap->next_heap) {
+    allocs += heap->num_allocs;
+    frees  += heap->num_frees;
+    remote += heap->num_remote_frees;
+    large  += heap->num_large;
+  }
+  spinlock_unlock(&heap_lock);
+
+  frees += atomic_load_explicit(&num_large_frees, memory_order_relaxed);
+
+  long slabs = atomic_load_explicit(&num_slabs, memory_order_relaxed);
+  long bytes_large = atomic_load_explicit(&large_bytes, memory_order_relaxed);
+
+  AMSG("MEMORY: slab heaps: %ld, slabs: %ld (max %ld, unmapped %ld), "
+       "slab memory: %.1f meg",
+       atomic_load_explicit(&num_heaps, memory_order_relaxed), slabs,
+       atomic_load_explicit(&max_slabs, memory_order_relaxed),
+       atomic_load_explicit(&num_slabs_unmapped, memory_order_relaxed),
+       ((double) (slabs * (long) SLAB_SIZE) + bytes_large) / meg);
+
+  AMSG("MEMORY: freeable allocs: %ld (large: %ld), frees: %ld "
+       "(remote: %ld), slab failures: %ld",
+       allocs, large, frees + remote, remote,
+       atomic_load_explicit(&num_failures, memory_order_relaxed));
+}
@@ -61,6 +61,7 @@
 #include <messages/messages.h>
 
 #include <cct/cct.h>
+#include <cct/cct_prune.h>
 
 #include <lib/prof-lean/hpcio.h>
 #include <lib/prof-lean/hpcfmt.h>
@@ -425,7 +426,37 @@ hpcrun_set_metric_name(int metric_id, char* name)
 metric_set_t*
 hpcrun_metric_set_new(void)
 {
-  return hpcrun_malloc(n_metrics * sizeof(hpcrun_metricVal_t));
+  return hpcrun_cct_mem_alloc(n_metrics * sizeof(hpcrun_metricVal_t));
+}
+
+//
+// release a metric set; only sets allocated under a cct memory
+// budget are freeable
+//
+void
+hpcrun_metric_set_free(metric_set_t* s)
+{
+  hpcrun_cct_mem_free(s, n_metrics * sizeof(hpcrun_metricVal_t));
+}
+
+//
+// reset a metric set after its values were written to a snapshot
+//
+void
+hpcrun_metric_set_zero(metric_set_t* s)
+{
+  if (s) memset(s, 0, n_metrics * sizeof(hpcrun_metricVal_t));
+}
+
+bool
+hpcrun_metric_set_is_zero(metric_set_t* s)
+{
+  if (! s) return true;
+  hpcrun_metricVal_t* v = (hpcrun_metricVal_t*) s;
+  for (int i = 0; i < n_metrics; i++) {
+    if (v[i].bits != 0) return false;
+  }
+  return true;
 }
 
 //
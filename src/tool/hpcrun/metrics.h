@@ -157,6 +157,9 @@ hpcrun_get_weighted_metric_diff(int metric_id1, int metric_id2,
                                 metric_set_t* set, cct_metric_data_t * diff, 
                                 cct_metric_data_t * diffWithPeriod);
 extern metric_set_t* hpcrun_metric_set_new(void);
+extern void hpcrun_metric_set_free(metric_set_t* s);
+extern void hpcrun_metric_set_zero(metric_set_t* s);
+extern bool hpcrun_metric_set_is_zero(metric_set_t* s);
 extern cct_metric_data_t* hpcrun_metric_set_loc(metric_set_t* s, int id);
 extern void hpcrun_metric_std_set(int metric_id, metric_set_t* set,
 				  hpcrun_metricVal_t value);
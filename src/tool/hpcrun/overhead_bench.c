@@ -0,0 +1,669 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// synthetic overhead benchmarks for hpcrun
+//
+// Fixed amounts of work, each aimed at one part of hpcrun:
+//
+//   recursion:  deep call stacks, for the unwinder and long cct paths
+//   fanout:     256 distinct leaf functions, for wide cct nodes
+//   threads:    waves of 256 short-lived threads, for thread init/fini
+//               and the per-thread profile writes
+//   dlopen:     dlopen/dlclose of 500 distinct DSOs, for the loadmap
+//               and fnbounds
+//   malloc:     malloc/free churn of mixed sizes, for MEMLEAK
+//   falseshare: threads bumping counters in one cache line, for the
+//               WP_* sharing clients
+//   reuse:      sweeps over a buffer larger than the caches, for the
+//               reuse clients and the watchpoint backends
+//
+// The program is also the plugin of the dlopen workload: built with
+// -DPLUGIN it is a small shared object, which the workload copies to
+// 500 paths so that every dlopen maps a new load module.
+//
+// In driver mode it runs every workload without hpcrun and under
+// hpcrun with each event configuration, and prints one JSON object
+// with, per run, the best wall time of the repetitions, the slowdown
+// against the run without hpcrun, the samples (from the SUMMARY line
+// of the hpcrun logs) per second, the peak RSS and the size of the
+// measurement directory. A configuration is a list of hpcrun events
+// joined with '+', e.g. WP_FALSE_SHARING+MEM_UOPS_RETIRED:ALL_STORES@100000;
+// an item NAME=VALUE is set in the environment of the run instead, e.g.
+// WP_REUSETRACKER+MEM_UOPS_RETIRED:ALL_LOADS@100000+HPCRUN_WP_BACKEND=mprotect.
+// Configurations that hpcrun rejects show up with a nonzero status.
+//
+// 'make check' in src/tool/hpcrun builds the benchmark and its plugin
+// (.libs/overhead_bench_plugin.so); by hand:
+//   cc -O2 -DPLUGIN -shared -fPIC -o overhead_bench_plugin.so overhead_bench.c
+//   cc -O2 -g -pthread -o overhead_bench overhead_bench.c -ldl
+// Run:
+//   ./overhead_bench <workload> [-s scale] [-p plugin]
+//   ./overhead_bench driver [-H hpcrun] [-r reps] [-s scale] [-p plugin]
+//          [-w workload,...] [-e config,...] > overhead.json
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#ifdef PLUGIN
+
+double
+plugin_work(int n)
+{
+  double x = 0;
+  for (int i = 1; i < n; i++) x += 1.0 / i;
+  return x;
+}
+
+#else
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FANOUT        256
+#define WAVE_THREADS  256
+#define NUM_DSOS      500
+#define SHARE_THREADS 4
+#define REUSE_BYTES   (64 * 1024 * 1024)
+#define MAX_CONFIGS   32
+
+static volatile double sink;
+static int scale = 1;
+static const char* plugin = "./overhead_bench_plugin.so";
+
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static double
+spin(int n)
+{
+  double x = 0;
+  for (int i = 1; i < n; i++) x += 1.0 / i;
+  return x;
+}
+
+
+//***************************************************************************
+// workloads
+//***************************************************************************
+
+static double __attribute__((noinline))
+recurse(int depth)
+{
+  if (depth == 0) return spin(10000);
+  double x = recurse(depth - 1);
+  __asm__ __volatile__ ("" : "+g" (x));  // keep the call out of tail position
+  return x + depth;
+}
+
+
+static void
+workload_recursion(void)
+{
+  double x = 0;
+  for (int i = 0; i < 20000 * scale; i++) {
+    x += recurse(500 + i % 500);
+  }
+  sink = x;
+}
+
+
+#define LEAF(n) \
+  static double __attribute__((noinline)) leaf_##n(int k) { return spin(k + n % 7); }
+#define LEAF8(n) LEAF(n##0) LEAF(n##1) LEAF(n##2) LEAF(n##3) \
+                 LEAF(n##4) LEAF(n##5) LEAF(n##6) LEAF(n##7)
+#define LEAF64(n) LEAF8(n##0) LEAF8(n##1) LEAF8(n##2) LEAF8(n##3) \
+                  LEAF8(n##4) LEAF8(n##5) LEAF8(n##6) LEAF8(n##7)
+LEAF64(1) LEAF64(2) LEAF64(3) LEAF64(4)
+
+#define REF(n) leaf_##n,
+#define REF8(n) REF(n##0) REF(n##1) REF(n##2) REF(n##3) \
+                REF(n##4) REF(n##5) REF(n##6) REF(n##7)
+#define REF64(n) REF8(n##0) REF8(n##1) REF8(n##2) REF8(n##3) \
+                 REF8(n##4) REF8(n##5) REF8(n##6) REF8(n##7)
+
+static double (*const leaves[FANOUT])(int) = { REF64(1) REF64(2) REF64(3) REF64(4) };
+
+
+static void
+workload_fanout(void)
+{
+  double x = 0;
+  for (int i = 0; i < 4000 * scale; i++) {
+    for (int j = 0; j < FANOUT; j++) x += leaves[j](500);
+  }
+  sink = x;
+}
+
+
+static void*
+short_thread(void* arg)
+{
+  *(double*) arg = spin(200000);
+  return NULL;
+}
+
+
+static void
+workload_threads(void)
+{
+  pthread_t tid[WAVE_THREADS];
+  double res[WAVE_THREADS];
+  double x = 0;
+
+  for (int w = 0; w < 8 * scale; w++) {
+    for (int i = 0; i < WAVE_THREADS; i++) {
+      if (pthread_create(&tid[i], NULL, short_thread, &res[i]) != 0) {
+        perror("pthread_create");
+        exit(1);
+      }
+    }
+    for (int i = 0; i < WAVE_THREADS; i++) {
+      pthread_join(tid[i], NULL);
+      x += res[i];
+    }
+  }
+  sink = x;
+}
+
+
+static int
+copy_file(const char* from, const char* to)
+{
+  char buf[65536];
+  size_t n;
+  FILE* in = fopen(from, "r");
+  FILE* out = in ? fopen(to, "w") : NULL;
+
+  if (! out) {
+    if (in) fclose(in);
+    return -1;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+  return fclose(out);
+}
+
+
+static int
+remove_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftw)
+{
+  return remove(path);
+}
+
+
+static void
+workload_dlopen(void)
+{
+  char dir[] = "/tmp/overhead_bench.XXXXXX";
+  if (! mkdtemp(dir)) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  static char paths[NUM_DSOS][PATH_MAX];
+  for (int i = 0; i < NUM_DSOS; i++) {
+    snprintf(paths[i], PATH_MAX, "%s/plugin-%03d.so", dir, i);
+    if (copy_file(plugin, paths[i]) != 0) {
+      fprintf(stderr, "cannot copy %s to %s\n", plugin, paths[i]);
+      exit(1);
+    }
+  }
+
+  double x = 0;
+  for (int r = 0; r < 4 * scale; r++) {
+    for (int i = 0; i < NUM_DSOS; i++) {
+      void* h = dlopen(paths[i], RTLD_NOW | RTLD_LOCAL);
+      if (! h) {
+        fprintf(stderr, "dlopen: %s\n", dlerror());
+        exit(1);
+      }
+      double (*work)(int) = (double (*)(int)) dlsym(h, "plugin_work");
+      x += work(20000);
+      dlclose(h);
+    }
+  }
+  sink = x;
+  nftw(dir, remove_entry, 4, FTW_DEPTH | FTW_PHYS);
+}
+
+
+static void
+workload_malloc(void)
+{
+  enum { SLOTS = 4096 };
+  static void* slot[SLOTS];
+  uint64_t seed = 42;
+  double x = 0;
+
+  for (long i = 0; i < 16000000L * scale; i++) {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    int k = (seed >> 33) % SLOTS;
+    // mostly small blocks, now and then a large one
+    size_t size = (seed >> 20) % 16 == 0 ? 64 * 1024 : 16 + (seed >> 40) % 512;
+    free(slot[k]);
+    slot[k] = malloc(size);
+    ((char*) slot[k])[0] = (char) i;
+    x += ((char*) slot[k])[0];
+  }
+  for (int k = 0; k < SLOTS; k++) free(slot[k]);
+  sink = x;
+}
+
+
+static struct {
+  volatile uint64_t count[SHARE_THREADS];
+} __attribute__((aligned(64))) shared_line;
+
+
+static void*
+share_thread(void* arg)
+{
+  int me = (int) (intptr_t) arg;
+  for (long i = 0; i < 50000000L * scale; i++) {
+    shared_line.count[me]++;
+  }
+  return NULL;
+}
+
+
+static void
+workload_falseshare(void)
+{
+  pthread_t tid[SHARE_THREADS];
+  for (int i = 0; i < SHARE_THREADS; i++) {
+    pthread_create(&tid[i], NULL, share_thread, (void*) (intptr_t) i);
+  }
+  double x = 0;
+  for (int i = 0; i < SHARE_THREADS; i++) {
+    pthread_join(tid[i], NULL);
+    x += shared_line.count[i];
+  }
+  sink = x;
+}
+
+
+static void
+workload_reuse(void)
+{
+  long n = REUSE_BYTES / sizeof(long);
+  long* buf = malloc(REUSE_BYTES);
+  if (! buf) {
+    perror("malloc");
+    exit(1);
+  }
+  for (long i = 0; i < n; i++) buf[i] = i;
+
+  // a short-distance pass and a whole-buffer pass, so there are reuses
+  // both inside and beyond the caches
+  long x = 0;
+  for (int r = 0; r < 4 * scale; r++) {
+    for (long i = 0; i + 512 <= n; i += 512) {
+      for (int k = 0; k < 4; k++) {
+        for (long j = i; j < i + 512; j += 8) x += buf[j]++;
+      }
+    }
+    for (long i = 0; i < n; i += 8) x += buf[i];
+  }
+  free(buf);
+  sink = x;
+}
+
+
+#define REUSE_CONFIG "WP_REUSETRACKER+MEM_UOPS_RETIRED:ALL_LOADS@100000" \
+                     "+MEM_UOPS_RETIRED:ALL_STORES@100000"
+
+static const struct workload {
+  const char* name;
+  void (*run)(void);
+  const char* configs;   // default event configurations in the driver
+} workloads[] = {
+  { "recursion",  workload_recursion,  "CPUTIME@5000,REALTIME@5000,cpu-clock@1000000,task-clock@1000000" },
+  { "fanout",     workload_fanout,     "CPUTIME@5000,REALTIME@5000,cpu-clock@1000000,task-clock@1000000" },
+  { "threads",    workload_threads,    "CPUTIME@5000,REALTIME@5000,cpu-clock@1000000,task-clock@1000000" },
+  { "dlopen",     workload_dlopen,     "CPUTIME@5000,REALTIME@5000,cpu-clock@1000000,task-clock@1000000" },
+  { "malloc",     workload_malloc,     "CPUTIME@5000,cpu-clock@1000000,MEMLEAK,MEMLEAK+CPUTIME@5000" },
+  { "falseshare", workload_falseshare, "CPUTIME@5000,cpu-clock@1000000,"
+                                       "WP_FALSE_SHARING+MEM_UOPS_RETIRED:ALL_STORES@100000,"
+                                       "WP_COMDETECTIVE+MEM_UOPS_RETIRED:ALL_STORES@100000" },
+  { "reuse",      workload_reuse,      "CPUTIME@5000,"
+                                       REUSE_CONFIG "+HPCRUN_WP_BACKEND=hw,"
+                                       REUSE_CONFIG "+HPCRUN_WP_BACKEND=mprotect" },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+
+static const struct workload*
+find_workload(const char* name)
+{
+  for (int i = 0; i < NUM_WORKLOADS; i++) {
+    if (strcmp(workloads[i].name, name) == 0) return &workloads[i];
+  }
+  return NULL;
+}
+
+
+//***************************************************************************
+// driver
+//***************************************************************************
+
+typedef struct run_result {
+  int status;
+  double seconds;
+  long maxrss_kb;
+  long samples;
+  long long output_bytes;
+} run_result_t;
+
+static long long tree_bytes;
+static long tree_samples;
+
+
+static int
+add_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftw)
+{
+  if (flag != FTW_F) return 0;
+  tree_bytes += sb->st_size;
+
+  size_t len = strlen(path);
+  if (len > 4 && strcmp(path + len - 4, ".log") == 0) {
+    FILE* f = fopen(path, "r");
+    char line[1024];
+    long n;
+    while (f && fgets(line, sizeof(line), f)) {
+      char* s = strstr(line, "SUMMARY: samples: ");
+      if (s && sscanf(s, "SUMMARY: samples: %ld", &n) == 1) tree_samples += n;
+    }
+    if (f) fclose(f);
+  }
+  return 0;
+}
+
+
+// run argv with the NAME=VALUE strings of env added to its
+// environment, wait for it and fill in time, status and peak rss
+static void
+run_child(char** argv, char** env, run_result_t* res)
+{
+  fflush(stdout);
+  double start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    // keep the json on stdout clean
+    if (! freopen("/dev/null", "w", stdout)) _exit(127);
+    for (int i = 0; env[i]; i++) putenv(env[i]);
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+  int status = 0;
+  struct rusage ru;
+  memset(&ru, 0, sizeof(ru));
+  if (pid < 0 || wait4(pid, &status, 0, &ru) < 0) {
+    res->status = -1;
+    return;
+  }
+  res->seconds = now() - start;
+  res->maxrss_kb = ru.ru_maxrss;
+  res->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+
+// best of reps runs; config NULL runs without hpcrun
+static run_result_t
+measure(const char* self, const char* hpcrun, const char* workload,
+        const char* config, int reps)
+{
+  run_result_t best = { .status = -1 };
+  char scale_arg[16];
+  snprintf(scale_arg, sizeof(scale_arg), "%d", scale);
+
+  for (int r = 0; r < reps; r++) {
+    char* argv[64];
+    char* env[16];
+    int argc = 0;
+    int envc = 0;
+    char outdir[PATH_MAX] = "";
+    char events[1024];
+
+    if (config) {
+      char tmp[] = "/tmp/overhead_bench.XXXXXX";
+      if (! mkdtemp(tmp)) {
+        perror("mkdtemp");
+        exit(1);
+      }
+      snprintf(outdir, sizeof(outdir), "%s/measurements", tmp);
+      argv[argc++] = (char*) hpcrun;
+      snprintf(events, sizeof(events), "%s", config);
+      for (char* ev = strtok(events, "+"); ev && argc < 48; ev = strtok(NULL, "+")) {
+        if (strchr(ev, '=')) {
+          if (envc < 15) env[envc++] = ev;
+          continue;
+        }
+        argv[argc++] = "-e";
+        argv[argc++] = ev;
+      }
+      argv[argc++] = "-o";
+      argv[argc++] = outdir;
+    }
+    argv[argc++] = (char*) self;
+    argv[argc++] = (char*) workload;
+    argv[argc++] = "-s";
+    argv[argc++] = scale_arg;
+    argv[argc++] = "-p";
+    argv[argc++] = (char*) plugin;
+    argv[argc] = NULL;
+    env[envc] = NULL;
+
+    run_result_t res = { 0 };
+    run_child(argv, env, &res);
+
+    if (config) {
+      tree_bytes = 0;
+      tree_samples = 0;
+      nftw(outdir, add_entry, 16, FTW_PHYS);
+      res.output_bytes = tree_bytes;
+      res.samples = tree_samples;
+      *strrchr(outdir, '/') = '\0';
+      nftw(outdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    if (res.status != 0) {
+      return res;
+    }
+    if (best.status != 0 || res.seconds < best.seconds) {
+      best = res;
+    }
+  }
+  return best;
+}
+
+
+static int
+driver(int argc, char** argv)
+{
+  const char* hpcrun = "hpcrun";
+  const char* only_workloads = NULL;
+  const char* only_configs = NULL;
+  int reps = 3;
+  int c;
+
+  while ((c = getopt(argc, argv, "H:r:s:p:w:e:")) != -1) {
+    switch (c) {
+    case 'H': hpcrun = optarg; break;
+    case 'r': reps = atoi(optarg); break;
+    case 's': scale = atoi(optarg); break;
+    case 'p': plugin = optarg; break;
+    case 'w': only_workloads = optarg; break;
+    case 'e': only_configs = optarg; break;
+    default:
+      fprintf(stderr, "usage: overhead_bench driver [-H hpcrun] [-r reps] [-s scale] "
+              "[-p plugin] [-w workload,...] [-e config,...]\n");
+      return 1;
+    }
+  }
+  if (reps < 1) reps = 1;
+
+  char self[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (len < 0) {
+    perror("readlink");
+    return 1;
+  }
+  self[len] = '\0';
+
+  // hand the children an absolute plugin path
+  char plugin_path[PATH_MAX];
+  if (realpath(plugin, plugin_path)) plugin = plugin_path;
+
+  printf("{\"hpcrun\":\"%s\",\"reps\":%d,\"scale\":%d,\"results\":[", hpcrun, reps, scale);
+  bool first = true;
+  for (int w = 0; w < NUM_WORKLOADS; w++) {
+    const struct workload* wl = &workloads[w];
+    if (only_workloads) {
+      char list[1024];
+      bool found = false;
+      snprintf(list, sizeof(list), "%s", only_workloads);
+      for (char* s = strtok(list, ","); s; s = strtok(NULL, ",")) {
+        if (strcmp(s, wl->name) == 0) found = true;
+      }
+      if (! found) continue;
+    }
+
+    run_result_t base = measure(self, hpcrun, wl->name, NULL, reps);
+    printf("%s\n {\"workload\":\"%s\",\"config\":null,\"status\":%d,"
+           "\"seconds\":%.4f,\"maxrss_kb\":%ld}",
+           first ? "" : ",", wl->name, base.status, base.seconds, base.maxrss_kb);
+    first = false;
+    fflush(stdout);
+
+    char configs[1024];
+    snprintf(configs, sizeof(configs), "%s", only_configs ? only_configs : wl->configs);
+    char* cfg[MAX_CONFIGS];
+    int ncfg = 0;
+    for (char* s = strtok(configs, ","); s && ncfg < MAX_CONFIGS; s = strtok(NULL, ",")) {
+      cfg[ncfg++] = s;
+    }
+    for (int i = 0; i < ncfg; i++) {
+      run_result_t res = measure(self, hpcrun, wl->name, cfg[i], reps);
+      double slowdown = (res.status == 0 && base.status == 0 && base.seconds > 0)
+        ? res.seconds / base.seconds : 0;
+      printf(",\n {\"workload\":\"%s\",\"config\":\"%s\",\"status\":%d,"
+             "\"seconds\":%.4f,\"slowdown\":%.3f,\"samples\":%ld,"
+             "\"samples_per_second\":%.1f,\"maxrss_kb\":%ld,\"output_bytes\":%lld}",
+             wl->name, cfg[i], res.status, res.seconds, slowdown, res.samples,
+             res.seconds > 0 ? res.samples / res.seconds : 0.0,
+             res.maxrss_kb, res.output_bytes);
+      fflush(stdout);
+    }
+  }
+  printf("\n]}\n");
+  return 0;
+}
+
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s driver [options] | <workload> [-s scale] [-p plugin]\n"
+            "workloads:", argv[0]);
+    for (int i = 0; i < NUM_WORKLOADS; i++) fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+  if (strcmp(argv[1], "driver") == 0) {
+    return driver(argc - 1, argv + 1);
+  }
+
+  const struct workload* wl = find_workload(argv[1]);
+  if (! wl) {
+    fprintf(stderr, "unknown workload %s\n", argv[1]);
+    return 1;
+  }
+  int c;
+  optind = 2;
+  while ((c = getopt(argc, argv, "s:p:")) != -1) {
+    switch (c) {
+    case 's': scale = atoi(optarg); break;
+    case 'p': plugin = optarg; break;
+    default:
+      return 1;
+    }
+  }
+  if (scale < 1) scale = 1;
+
+  double start = now();
+  wl->run();
+  printf("%s: %.3f s (%g)\n", wl->name, now() - start, sink);
+  return 0;
+}
+
+#endif
@@ -100,6 +100,7 @@
 #ifndef _HPCRUN_SAFE_SAMPLING_H_
 #define _HPCRUN_SAFE_SAMPLING_H_
 
+#include <hpcrun/hpcrun_topology.h>
 #include <hpcrun/main.h>
 #include <hpcrun/thread_data.h>
 #include <hpcrun/trampoline/common/trampoline.h>
@@ -157,6 +158,9 @@ hpcrun_safe_enter_async(void *pc)
 #endif
   int prev;
 
+  // one getcpu per signal when there is no rseq
+  hpcrun_topology_forget_cpu();
+
 #if 0
   if (hpcrun_trampoline_interior(pc) || hpcrun_trampoline_at_entry(pc)
       || ! hpcrun_td_avail()) {
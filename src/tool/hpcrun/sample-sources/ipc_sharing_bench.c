@@ -0,0 +1,360 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// cross-process coordination benchmark for the WP_IPC_*_SHARING clients
+//
+// Forks producer and consumer processes that share one MAP_SHARED
+// region.  Every cache line of the region is written by one producer
+// and read by one consumer.  Each process takes a "sample" every few
+// accesses and runs one of two coordination schemes on it:
+//
+//   global: one publication slot for all processes, and a translation
+//           that opens /proc/self/pagemap on every lookup.  A process
+//           that finds a fresh publication of somebody else arms on
+//           that line, whether or not it touches that line itself.
+//   hashed: publication slots keyed by the physical cache line, and a
+//           per-process cache of page frame numbers read with pread
+//           from a pagemap fd kept open.  A process only arms on the
+//           line of its own sample.
+//
+// For each scheme it reports the time spent coordinating per sample,
+// the share of samples that armed a watchpoint and the share of those
+// on a line the arming process accesses (the ones that can trap).
+// Translating needs CAP_SYS_ADMIN; without it every frame reads as 0
+// and the benchmark says so.
+//
+// 'make check' in src/tool/hpcrun builds the benchmark; by hand:
+//   cc -O2 -o ipc_sharing_bench ipc_sharing_bench.c
+// Run:
+//   ./ipc_sharing_bench [-p pairs] [-l lines] [-s samples] [-n slots] [-a age]
+//
+// A publication stays fresh for age (default 2, as in hpcrun) sample
+// intervals of the reader.  On fewer cores than processes the partners
+// rarely run at the same time; a large age stands in for that.
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CACHE_LINE_SZ   64
+#define PAGEMAP_ENTRY   8
+#define PFN_CACHE_SIZE  1024
+#define MAX_PROCS       256
+#define ACCESSES_PER_SAMPLE 1000
+
+enum bench_mode_e { MODE_GLOBAL, MODE_HASHED };
+
+typedef struct bench_slot_s {
+  volatile uint64_t counter;
+  volatile uint64_t time;
+  volatile uint64_t line;   // physical cache line
+  volatile int owner;
+  volatile int index;       // line in the region, for the bookkeeping only
+  char pad[CACHE_LINE_SZ - 3 * sizeof(uint64_t) - 2 * sizeof(int)];
+} bench_slot_t;
+
+typedef struct bench_result_s {
+  uint64_t samples;
+  uint64_t armed;
+  uint64_t useful;
+  uint64_t untranslated;
+  uint64_t ns;
+} bench_result_t;
+
+typedef struct pfn_entry_s {
+  uintptr_t vpage;
+  uint64_t pfn;
+} pfn_entry_t;
+
+static int npairs = 4;
+static int nlines = 4096;
+static int nsamples = 20000;
+static int nslots = 256;
+static int age_factor = 2;
+
+static long page_size;
+static char *region;
+static bench_slot_t *slots;
+static bench_result_t *results;
+
+static int pagemap_fd = -1;
+static pfn_entry_t pfn_cache[PFN_CACHE_SIZE];
+
+
+static inline uint64_t
+rdtsc()
+{
+  uint32_t lo, hi;
+  __asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static uint64_t
+pfn_from_entry(uint64_t entry)
+{
+  if (!(entry & (1ULL << 63))) return 0;
+  return entry & 0x7FFFFFFFFFFFFFULL;
+}
+
+
+// the translation GetPFN did: open, seek and read the pagemap each time
+static uint64_t
+pfn_fopen(uintptr_t va)
+{
+  FILE *f = fopen("/proc/self/pagemap", "rb");
+  if (!f) return 0;
+  uint64_t entry = 0;
+  if (fseek(f, va / page_size * PAGEMAP_ENTRY, SEEK_SET) != 0 ||
+      fread(&entry, sizeof(entry), 1, f) != 1) {
+    entry = 0;
+  }
+  fclose(f);
+  return pfn_from_entry(entry);
+}
+
+
+// the translation WPIPCGetPA does: a direct mapped cache in front of pread
+static uint64_t
+pfn_cached(uintptr_t va)
+{
+  uintptr_t vpage = va & ~(page_size - 1);
+  pfn_entry_t *e = &pfn_cache[(vpage / page_size) & (PFN_CACHE_SIZE - 1)];
+  if (e->vpage != vpage || e->pfn == 0) {
+    uint64_t entry = 0;
+    if (pagemap_fd < 0) pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    if (pread(pagemap_fd, &entry, sizeof(entry), vpage / page_size * PAGEMAP_ENTRY) != sizeof(entry)) {
+      entry = 0;
+    }
+    e->vpage = vpage;
+    e->pfn = pfn_from_entry(entry);
+  }
+  return e->pfn;
+}
+
+
+static bench_slot_t *
+slot_of(enum bench_mode_e mode, uint64_t line)
+{
+  if (mode == MODE_GLOBAL) return &slots[0];
+  uint64_t h = (line / CACHE_LINE_SZ) * 0x9E3779B97F4A7C15ULL;
+  return &slots[(h >> 32) & (nslots - 1)];
+}
+
+
+// line of the region a process touches on its k-th access
+static int
+line_of(int proc, uint64_t k)
+{
+  int pair = proc / 2;
+  int per_pair = nlines / npairs;
+  return pair * per_pair + (int) (k % per_pair);
+}
+
+
+static void
+run_process(enum bench_mode_e mode, int proc)
+{
+  bench_result_t *r = &results[proc];
+  bool producer = (proc & 1) == 0;
+  uint64_t k = (uint64_t) proc * 7919;
+  uint64_t last = rdtsc();
+  uint64_t seed = 88172645463325252ULL + proc;
+  volatile uint64_t sink = 0;
+
+  memset(pfn_cache, 0, sizeof(pfn_cache));
+  pagemap_fd = -1;
+
+  for (int s = 0; s < nsamples; s++) {
+    for (int a = 0; a < ACCESSES_PER_SAMPLE; a++, k++) {
+      volatile uint64_t *p = (volatile uint64_t *) (region + (size_t) line_of(proc, k) * CACHE_LINE_SZ);
+      if (producer) *p = k; else sink += *p;
+    }
+
+    // the sampled access: any line of our pair, as with a sampling period
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    int sampled = line_of(proc, seed);
+    uintptr_t va = (uintptr_t) region + (size_t) sampled * CACHE_LINE_SZ;
+    uint64_t start = now_ns();
+    uint64_t pfn = mode == MODE_GLOBAL ? pfn_fopen(va) : pfn_cached(va);
+    r->samples++;
+    if (pfn == 0) {
+      r->untranslated++;
+    } else {
+      uint64_t line = pfn * page_size + (va & (page_size - 1) & ~(CACHE_LINE_SZ - 1));
+      uint64_t now = rdtsc();
+      uint64_t max_age = age_factor * (now - last);
+      bench_slot_t *slot = slot_of(mode, line);
+      uint64_t counter = slot->counter;
+      bool fresh = slot->owner != proc + 1 && slot->owner != 0 && now - slot->time <= max_age;
+      if (fresh && (counter & 1) == 0 && (mode == MODE_GLOBAL || slot->line == line)) {
+        int armed_index = slot->index;
+        if (slot->counter == counter) {
+          r->armed++;
+          // only a line of our own pair can trap
+          if (armed_index / (nlines / npairs) == proc / 2) r->useful++;
+        }
+      } else if ((counter & 1) == 0 && !fresh &&
+                 __sync_bool_compare_and_swap(&slot->counter, counter, counter + 1)) {
+        slot->time = rdtsc();
+        slot->line = line;
+        slot->owner = proc + 1;
+        slot->index = sampled;
+        __sync_synchronize();
+        slot->counter = counter + 2;
+      }
+    }
+    r->ns += now_ns() - start;
+    last = rdtsc();
+  }
+  (void) sink;
+}
+
+
+static void
+run_mode(enum bench_mode_e mode)
+{
+  int nprocs = 2 * npairs;
+  memset(region, 0, (size_t) nlines * CACHE_LINE_SZ);
+  memset(slots, 0, (size_t) nslots * sizeof(bench_slot_t));
+  memset(results, 0, nprocs * sizeof(bench_result_t));
+
+  for (int p = 0; p < nprocs; p++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      run_process(mode, p);
+      _exit(0);
+    }
+  }
+  for (int p = 0; p < nprocs; p++) wait(NULL);
+
+  bench_result_t total = { 0 };
+  for (int p = 0; p < nprocs; p++) {
+    total.samples += results[p].samples;
+    total.armed += results[p].armed;
+    total.useful += results[p].useful;
+    total.untranslated += results[p].untranslated;
+    total.ns += results[p].ns;
+  }
+  if (total.untranslated == total.samples) {
+    printf("%-7s pagemap gives no frame numbers (needs CAP_SYS_ADMIN)\n",
+           mode == MODE_GLOBAL ? "global" : "hashed");
+    return;
+  }
+  printf("%-7s %10lu samples %8.0f ns/sample  armed %5.1f%%  on own lines %5.1f%%\n",
+         mode == MODE_GLOBAL ? "global" : "hashed",
+         total.samples,
+         (double) total.ns / total.samples,
+         100.0 * total.armed / total.samples,
+         total.armed ? 100.0 * total.useful / total.armed : 0.0);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "p:l:s:n:a:")) != -1) {
+    switch (opt) {
+    case 'p': npairs = atoi(optarg); break;
+    case 'l': nlines = atoi(optarg); break;
+    case 's': nsamples = atoi(optarg); break;
+    case 'n': nslots = atoi(optarg); break;
+    case 'a': age_factor = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-p pairs] [-l lines] [-s samples] [-n slots] [-a age]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (npairs < 1 || 2 * npairs > MAX_PROCS || nlines < npairs || nslots < 1 || (nslots & (nslots - 1))) {
+    fprintf(stderr, "need 1 <= pairs <= %d, lines >= pairs and a power of two of slots\n", MAX_PROCS / 2);
+    return 1;
+  }
+  page_size = sysconf(_SC_PAGESIZE);
+
+  size_t region_sz = (size_t) nlines * CACHE_LINE_SZ;
+  region = mmap(NULL, region_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  slots = mmap(NULL, nslots * sizeof(bench_slot_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  results = mmap(NULL, MAX_PROCS * sizeof(bench_result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED || slots == MAP_FAILED || results == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  printf("%d producer/consumer pairs, %d lines, %d samples per process, %d slots\n",
+         npairs, nlines, nsamples, nslots);
+  run_mode(MODE_GLOBAL);
+  run_mode(MODE_HASHED);
+  return 0;
+}
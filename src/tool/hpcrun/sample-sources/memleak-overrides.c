@@ -463,6 +463,11 @@ memleak_add_leakinfo(const char *name, void *sys_ptr, void *appl_ptr,
         (hpcrun_metricVal_t) {.i=bytes}, 
         0, 1, NULL);
     info_ptr->context = smpl.sample_node;
+    // the block points to its allocation context until it is freed,
+    // so cct pruning must leave the context alone
+    if (smpl.sample_node) {
+      hpcrun_cct_pin(smpl.sample_node);
+    }
     loc_str = loc_name[loc];
   } else {
     info_ptr->context = NULL;
@@ -207,7 +207,7 @@ kernel_block_handler( event_thread_t *current_event, sample_val_t sv,
     } else if (cct_kernel != NULL) {
       // other event than cs occurs (it can be cycles, clocks or others)
 
-      if ((mmap_data->time > 0) && (time_cs_out > 0) && (mmap_data->nr==0)) {
+      if ((mmap_data->time > 0) && (time_cs_out > 0) && (perf_num_kernel_frames(mmap_data)==0)) {
 #if KERNEL_BLOCKING_DEBUG
         unsigned int cpumode = mmap_data->header_misc & PERF_RECORD_MISC_CPUMODE_MASK;
         assert(cpumode == PERF_RECORD_MISC_USER);
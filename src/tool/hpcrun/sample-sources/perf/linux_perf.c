@@ -89,8 +89,10 @@
 #include "sample-sources/sample_source_obj.h"
 #include "sample-sources/common.h"
 #include "sample-sources/watchpoint_support.h"
+#include "sample-sources/watchpoint_adaptive.h"
 
 #include <hpcrun/cct_insert_backtrace.h>
+#include <hpcrun/hpcrun_overhead.h>
 #include <hpcrun/hpcrun_stats.h>
 #include <hpcrun/loadmap.h>
 #include <hpcrun/messages/messages.h>
@@ -209,7 +211,7 @@ static int
 ibs_restart_perf_event(int fd);
 
 static bool 
-perf_thread_init(event_info_t *event, event_thread_t *et);
+perf_thread_init(event_info_t *event, event_thread_t *et, int group_fd);
 
 static void 
 perf_thread_fini(int nevents, event_thread_t *event_thread);
@@ -217,6 +219,9 @@ perf_thread_fini(int nevents, event_thread_t *event_thread);
 static int 
 perf_event_handler( int sig, siginfo_t* siginfo, void* context);
 
+static int 
+handle_perf_event( int sig, siginfo_t* siginfo, void* context);
+
 static int
 sig_event_handler( int sig, siginfo_t* siginfo, void* context);
 //******************************************************************************
@@ -239,6 +244,16 @@ static event_info_t  *event_desc = NULL;
 
 static struct event_threshold_s default_threshold = {DEFAULT_THRESHOLD, FREQUENCY};
 
+// open the events of a thread as one group (HPCRUN_PERF_GROUP), so that
+// they can be disabled and enabled with a single ioctl
+static bool perf_group_enabled = true;
+
+// table to find the event of a file descriptor in the signal handler.
+// file descriptors are shared by all threads, but each thread only
+// writes the entries of its own events.
+#define PERF_FD_TABLE_SIZE 4096
+static event_thread_t *perf_fd_table[PERF_FD_TABLE_SIZE];
+
 
 /******************************************************************************
  * external thread-local variables
@@ -254,44 +269,44 @@ event_thread_t *event_thread_board[HASH_TABLE_SIZE];
 
 /*
  * Enable all the counters
+ * Events in a group are enabled through their leader.
  */ 
 	static void
 perf_start_all(int nevents, event_thread_t *event_thread)
 {
 	int i;
 	for(i=0; i<nevents; i++) {
-		//ioctl(event_thread[i].fd, PERF_EVENT_IOC_ENABLE, 0);
-		if(hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP") && event_thread[i].fd >= 0){
-                        ioctl(event_thread[i].fd, IBS_ENABLE);
-			//ioctl(event_thread[i].fd, IBS_CTL_RELOAD);
-                        //fprintf(stderr, "fd: %d is disabled\n", event_thread[i].fd);
-                }
-                else
-                        ioctl(event_thread[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+		event_thread_t *et = &(event_thread[i]);
+		if(et->kind == EVENT_KIND_IBS_OP && et->fd >= 0) {
+			ioctl(et->fd, IBS_ENABLE);
+		}
+		else if(et->group_fd < 0) {
+			ioctl(et->fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+		else if(et->group_fd == et->fd) {
+			ioctl(et->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
 	}
 }
 
 /*
  * Disable all the counters
+ * Events in a group are disabled through their leader.
  */ 
 	static void
 perf_stop_all(int nevents, event_thread_t *event_thread)
 {
 	int i;
-	char filename[64];
-	//sprintf(filename, "/dev/cpu/%d/ibs/op", TD_GET(core_profile_trace_data.id));
-	//int fd = open(filename, O_RDONLY | O_NONBLOCK);
 	for(i=0; i<nevents; i++) {
-		//fprintf(stderr, "event %d is closed\n", i);
-		//fprintf(stderr, "event %s is to be closed\n", event_thread[i].event->metric_desc->name);
-		if(/*amd_ibs_flag*/hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP") && event_thread[i].fd >= 0){
-			ioctl(event_thread[i].fd, IBS_DISABLE);
-			//fprintf(stderr, "IBS_OP is disabled\n");
-			//fprintf(stderr, "fd: %d is disabled\n", event_thread[i].fd);
+		event_thread_t *et = &(event_thread[i]);
+		if(et->kind == EVENT_KIND_IBS_OP && et->fd >= 0) {
+			ioctl(et->fd, IBS_DISABLE);
+		}
+		else if(et->group_fd < 0) {
+			ioctl(et->fd, PERF_EVENT_IOC_DISABLE, 0);
 		}
-		else {
-			//fprintf(stderr, "event %s has been disabled\n", event_thread[i].event->metric_desc->name);
-			ioctl(event_thread[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+		else if(et->group_fd == et->fd) {
+			ioctl(et->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
 		}
 	}
 }
@@ -306,7 +321,7 @@ ibs_ctl_backup(int nevents, event_thread_t *event_thread)
         for(i=0; i<nevents; i++) {
                 //fprintf(stderr, "event %d is closed\n", i);
                 //fprintf(stderr, "event %s is to be closed\n", event_thread[i].event->metric_desc->name);
-                if(/*amd_ibs_flag*/hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP") && event_thread[i].fd >= 0){
+                if(/*amd_ibs_flag*/event_thread[i].kind == EVENT_KIND_IBS_OP && event_thread[i].fd >= 0){
 			ibs_count = ioctl(event_thread[i].fd, GET_CUR_CNT);
                         //ioctl(event_thread[i].fd, IBS_CTL_BACKUP);
                         //fprintf(stderr, "IBS_OP is disabled\n");
@@ -325,7 +340,7 @@ ibs_ctl_reload(int nevents, event_thread_t *event_thread)
         for(i=0; i<nevents; i++) {
                 //fprintf(stderr, "event %d is closed\n", i);
                 //fprintf(stderr, "event %s is to be closed\n", event_thread[i].event->metric_desc->name);
-                if(/*amd_ibs_flag*/hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP") && event_thread[i].fd >= 0){
+                if(/*amd_ibs_flag*/event_thread[i].kind == EVENT_KIND_IBS_OP && event_thread[i].fd >= 0){
                         //ioctl(event_thread[i].fd, IBS_CTL_RELOAD);
 			//long temp = ioctl(event_thread[i].fd, GET_CUR_CNT);
 			//fprintf(stderr, "value of counter in register before reload: %ld\n", temp);
@@ -452,14 +467,29 @@ void set_global_op_sample_rate(int sample_rate)
 }
 
 
+//----------------------------------------------------------
+// kind of an event, given its name
+//----------------------------------------------------------
+	static perf_event_kind_t
+perf_event_kind(const char *name)
+{
+	if (hpcrun_ev_is(name, "IBS_OP"))
+		return EVENT_KIND_IBS_OP;
+	if (hpcrun_ev_is(name, "AMD_L1_DATA_ACCESS"))
+		return EVENT_KIND_AMD_L1_DATA_ACCESS;
+	if (hpcrun_ev_is(name, "AMD_MICRO_OP_RETIRED"))
+		return EVENT_KIND_AMD_MICRO_OP_RETIRED;
+	return EVENT_KIND_GENERIC;
+}
+
 //----------------------------------------------------------
 // initialize an event
-//  event_num: event number
-//  name: name of event (has to be recognized by perf event)
-//  threshold: sampling threshold 
+//  event: event description
+//  et: event data of this thread
+//  group_fd: fd of the group leader, or -1 to open the event on its own
 //----------------------------------------------------------
 	static bool
-perf_thread_init(event_info_t *event, event_thread_t *et)
+perf_thread_init(event_info_t *event, event_thread_t *et, int group_fd)
 {
 	//fprintf(stderr, "perf_thread_init is called in thread %d for event %s with period %ld\n", TD_GET(core_profile_trace_data.id), event->metric_desc->name, event->metric_desc->period);
 	int my_id = sched_getcpu();
@@ -470,16 +500,29 @@ perf_thread_init(event_info_t *event, event_thread_t *et)
 		my_id = sched_getcpu();
 	}
 
-	if(!hpcrun_ev_is(event->metric_desc->name, "IBS_OP")) {
+	et->event    = event;
+	et->kind     = perf_event_kind(event->metric_desc->name);
+	et->group_fd = -1;
+	et->fd       = -1;
+
+	if(et->kind != EVENT_KIND_IBS_OP) {
 	et->num_overflows = 0;
 	et->prev_num_overflows = 0;
-	et->event = event;
 	// ask sys to "create" the event
 	// it returns -1 if it fails.
 	//fprintf(stderr, "monitoring a sample\n");
 	event->attr.wakeup_events = 1;
 	et->fd = perf_event_open(&event->attr,
-			THREAD_SELF, CPU_ANY, GROUP_FD, PERF_FLAGS);
+			THREAD_SELF, CPU_ANY, group_fd, PERF_FLAGS);
+	if (et->fd < 0 && group_fd >= 0) {
+		// the event cannot join the group (e.g., it is from another PMU,
+		// or the group doesn't fit in the counters): open it on its own
+		TMSG(LINUX_PERF, "event %d cannot join group %d: %s",
+				event->id, group_fd, strerror(errno));
+		group_fd = -1;
+		et->fd = perf_event_open(&event->attr,
+				THREAD_SELF, CPU_ANY, GROUP_FD, PERF_FLAGS);
+	}
 	TMSG(LINUX_PERF, "dbg register event %d, fd: %d, skid: %d, c: %d, t: %d, period: %d, freq: %d",
 			event->id, et->fd, event->attr.precise_ip, event->attr.config,
 			event->attr.type, event->attr.sample_freq, event->attr.freq);
@@ -494,6 +537,10 @@ perf_thread_init(event_info_t *event, event_thread_t *et)
 		return false;
 	}
 
+	et->group_fd = group_fd;
+	if (et->fd < PERF_FD_TABLE_SIZE)
+		perf_fd_table[et->fd] = et;
+
 	// create mmap buffer for this file 
 	et->mmap = set_mmap(et->fd);
 
@@ -507,7 +554,7 @@ perf_thread_init(event_info_t *event, event_thread_t *et)
 
 	// need to set PERF_SIGNAL to this file descriptor
 	// to avoid POLL_HUP in the signal handler
-	if(hpcrun_ev_is(event->metric_desc->name, "AMD_L1_DATA_ACCESS") || hpcrun_ev_is(event->metric_desc->name, "AMD_MICRO_OP_RETIRED"))
+	if(et->kind == EVENT_KIND_AMD_L1_DATA_ACCESS || et->kind == EVENT_KIND_AMD_MICRO_OP_RETIRED)
 		ret = fcntl(et->fd, F_SETSIG, /*PERF_SIGNAL*/SIGNEW);
 	else
 		ret = fcntl(et->fd, F_SETSIG, PERF_SIGNAL);
@@ -531,7 +578,6 @@ perf_thread_init(event_info_t *event, event_thread_t *et)
 	return (ret >= 0);
 	} else {
 		char filename [64];
-		et->event = event;
 		global_buffer = malloc(BUFFER_SIZE_B);
 		//int my_id = sched_getcpu();//TD_GET(core_profile_trace_data.id);
 		sprintf(filename, "/dev/cpu/%d/ibs/op", my_id);
@@ -546,6 +592,8 @@ perf_thread_init(event_info_t *event, event_thread_t *et)
 			//fprintf(stderr, "Could open %s by thread %d\n", filename, TD_GET(core_profile_trace_data.id));
 				amd_ibs_flag = true;
 			}
+			if (et->fd < PERF_FD_TABLE_SIZE)
+				perf_fd_table[et->fd] = et;
 			//fprintf(stderr, "Could open %s by thread %d\n", filename, TD_GET(core_profile_trace_data.id));
                 	ioctl(et->fd, SET_BUFFER_SIZE, BUFFER_SIZE_B);
                 //ioctl(fd[cpu], SET_POLL_SIZE, poll_size / sizeof(ibs_op_t));
@@ -611,7 +659,9 @@ perf_thread_fini(int nevents, event_thread_t *event_thread)
 {
         //fprintf(stderr, "fini\n");
         for(int i=0; i<nevents; i++) {
-		if(!hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP")) {
+		if(event_thread[i].kind != EVENT_KIND_IBS_OP) {
+			if (event_thread[i].fd >= 0 && event_thread[i].fd < PERF_FD_TABLE_SIZE)
+				perf_fd_table[event_thread[i].fd] = NULL;
                 	if (event_thread[i].fd)
                         	close(event_thread[i].fd);
 
@@ -623,12 +673,21 @@ perf_thread_fini(int nevents, event_thread_t *event_thread)
 
 
 // ---------------------------------------------
-// get the index of the file descriptor
+// get the event of the file descriptor
 // ---------------------------------------------
 
 	static event_thread_t*
 get_fd_index(int nevents, int fd, event_thread_t *event_thread)
 {
+	if (fd >= 0 && fd < PERF_FD_TABLE_SIZE) {
+		event_thread_t *et = perf_fd_table[fd];
+		if ((uintptr_t) et >= (uintptr_t) event_thread
+				&& (uintptr_t) et < (uintptr_t) (event_thread + nevents)
+				&& et->fd == fd)
+			return et;
+	}
+	// not in the table: this is not the event of this thread,
+	// or the fd is too large for the table
 	for(int i=0; i<nevents; i++) {
 		if (event_thread[i].fd == fd)
 			return &(event_thread[i]);
@@ -650,11 +709,16 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
 	// sampling taken by perf event kernel
 	// ----------------------------------------------------------------------------
 	bool amd_ibs_event = false;
-	if(hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP") && current->fd >= 0)
+	if(current->kind == EVENT_KIND_IBS_OP && current->fd >= 0)
 			amd_ibs_event = true;
-	uint64_t metric_inc = 1;
+	uint64_t start = rdtsc();
+	double metric_inc = 1;
 	if ((!amd_ibs_event && current->event->attr.freq==1) && mmap_data->period > 0)
 		metric_inc = mmap_data->period;
+	// the adaptive controller may have scaled the period: weigh the sample
+	// by the period it was taken with so the metric stays in command line units
+	else if (!amd_ibs_event && mmap_data->period > 0 && current->event->attr.sample_period > 0)
+		metric_inc = (double) mmap_data->period / current->event->attr.sample_period;
 	//fprintf(stderr, "metric_inc: %ld\n", metric_inc);
 	// ----------------------------------------------------------------------------
 	// record time enabled and time running
@@ -759,6 +823,7 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
 				sv->sample_node,
 				current->event->metric);
 //#endif
+		WPAdaptiveNoteSample(rdtsc() - start);
 	}
 
 	return sv;
@@ -799,6 +864,10 @@ METHOD_FN(init)
 	// checking the option of multiplexing:
 	// the env variable is set by hpcrun or by user (case for static exec)
 
+	// events are grouped unless HPCRUN_PERF_GROUP=0
+	const char *str_group = getenv("HPCRUN_PERF_GROUP");
+	perf_group_enabled = (str_group == NULL || atoi(str_group) != 0);
+
 	self->state = INIT;
 
 	// init events
@@ -860,7 +929,7 @@ METHOD_FN(start)
 	for (int i=0; i<nevents; i++)
 	{
 		int ret;
-		if(hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP") && event_thread[i].fd >= 0){
+		if(event_thread[i].kind == EVENT_KIND_IBS_OP && event_thread[i].fd >= 0){
 			ret = ioctl(event_thread[i].fd, IBS_ENABLE);
 		} else
 			ret = ioctl(event_thread[i].fd, PERF_EVENT_IOC_RESET, 0);
@@ -868,7 +937,7 @@ METHOD_FN(start)
 			TMSG(LINUX_PERF, "error fd %d in IOC_RESET: %s", event_thread[i].fd, strerror(errno));
 		}
 
-		if(hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP"))
+		if(event_thread[i].kind == EVENT_KIND_IBS_OP)
 			ibs_restart_perf_event( event_thread[i].fd );
 		else
 			restart_perf_event( event_thread[i].fd );
@@ -925,8 +994,10 @@ METHOD_FN(stop)
 	TMSG(LINUX_PERF, "%d: stop OK", self->sel_idx);
 
 	for(int i=0; i<nevents; i++) {
-		if(hpcrun_ev_is(event_thread[i].event->metric_desc->name, "IBS_OP")) {
+		if(event_thread[i].kind == EVENT_KIND_IBS_OP) {
 			if (event_thread[i].fd >= 0) {
+				if (event_thread[i].fd < PERF_FD_TABLE_SIZE)
+					perf_fd_table[event_thread[i].fd] = NULL;
                         	close(event_thread[i].fd);
 				free(global_buffer);
 			}
@@ -1259,17 +1330,30 @@ METHOD_FN(gen_event_set, int lush_metrics)
 	td->core_profile_trace_data.perf_event_info = aux_info;
 	td->ss_info[self->sel_idx].ptr = event_thread;
 
+	// scratch memory to read the buffers in the signal handler
+	perf_mmap_thread_init();
+
 
 	// setup all requested events
 	// if an event cannot be initialized, we still keep it in our list
 	//  but there will be no samples
 
+	// the first event that opens becomes the leader of the group of
+	// the thread, the others (if they can) join its group.
+
+	int group_fd = -1;
+
 	for (int i=0; i<nevents; i++)
 	{
 		// initialize this event. If it's valid, we set the metric for the event
-		if (!perf_thread_init( &(event_desc[i]), &(event_thread[i])) ) {
+		if (!perf_thread_init( &(event_desc[i]), &(event_thread[i]), group_fd) ) {
 			TMSG(LINUX_PERF, "FAIL to initialize %s", event_desc[i].metric_desc->name);
 		}
+		if (perf_group_enabled && group_fd < 0 && event_thread[i].fd >= 0
+				&& event_thread[i].kind != EVENT_KIND_IBS_OP) {
+			group_fd = event_thread[i].fd;
+			event_thread[i].group_fd = group_fd;
+		}
 	}
 
 	event_thread_board[TD_GET(core_profile_trace_data.id)] =  event_thread;
@@ -1396,6 +1480,28 @@ void linux_perf_events_resume(){
 	perf_start_all(nevents, event_thread);
 }
 
+// Sets the period of this thread's precise sampling events to scale times
+// the period given on the command line.  Counting events keep theirs since
+// their readers multiply the overflows by it, and the IBS op period is
+// programmed per CPU rather than per thread, so it is left alone too.
+void linux_perf_set_period_scale(uint32_t scale){
+	sample_source_t *self = &obj_name();
+	event_thread_t *event_thread = TD_GET(ss_info)[self->sel_idx].ptr;
+	int nevents = self->evl.nevents;
+
+	for (int i = 0; i < nevents; i++) {
+		event_thread_t *current = &event_thread[i];
+		struct perf_event_attr *attr = &current->event->attr;
+		if (current->fd < 0 || current->kind == EVENT_KIND_IBS_OP ||
+				attr->freq || attr->sample_period == 0 || attr->precise_ip == 0)
+			continue;
+		uint64_t period = attr->sample_period * scale;
+		if (ioctl(current->fd, PERF_EVENT_IOC_PERIOD, &period) < 0)
+			TMSG(LINUX_PERF, "cannot set the period of fd %d to %lu: %s",
+					current->fd, period, strerror(errno));
+	}
+}
+
 
 // OUTPUT: val, it is a uint64_t array and has at least 3 elements.
 // For a counting event, val[0] is the actual value read from counter; val[1] is the time enabling; val[2] is time running
@@ -1604,16 +1710,6 @@ sig_event_handler(int n, siginfo_t *info, void *unused)
 	num_items = tmp / sizeof(ibs_op_t);
 	n_op_samples[my_id] += num_items;
 	n_lost_op_samples[my_id] += ioctl(fd, GET_LOST);
-	char * sample_buffer = malloc (sizeof(ibs_op_t));
-	int offset = 0;
-	for (int i = 0; i < num_items; i++) {
-		//fread((char *)&op, sizeof(op), 1, op_in_fp)
-		memcpy ( sample_buffer, global_buffer + offset, sizeof(ibs_op_t) );
-		offset += i * sizeof(ibs_op_t);
-		ibs_op_t *op_data = (ibs_op_t *) sample_buffer;
-		//fprintf(stderr, " sampling timestamp: %ld, cpu: %d, tid: %d, pid: %d\n", op_data->tsc, op_data->cpu, op_data->tid, op_data->pid);	
-	}
-	free (sample_buffer);
 	// after
 	ioctl(fd, IBS_ENABLE);
     }
@@ -1653,6 +1749,19 @@ perf_event_handler(
 		siginfo_t* siginfo, 
 		void* context
 		)
+{
+	uint64_t ovh_start = hpcrun_overhead_begin();
+	int ret = handle_perf_event(sig, siginfo, context);
+	hpcrun_overhead_end(HPCRUN_OVH_PERF_HANDLER, ovh_start);
+	return ret;
+}
+
+	static int
+handle_perf_event(
+		int sig, 
+		siginfo_t* siginfo, 
+		void* context
+		)
 {
 	// ----------------------------------------------------------------------------
 	// disable all counters
@@ -1706,7 +1815,7 @@ perf_event_handler(
 	if (! hpcrun_safe_enter_async(pc) /*&& !hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP")*/) {
 //#endif
 		hpcrun_stats_num_samples_blocked_async_inc();
-		if(hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP"))
+		if(current->kind == EVENT_KIND_IBS_OP)
 			ibs_restart_perf_event(/*siginfo->si_int*/ siginfo->si_fd);
 		else
 			restart_perf_event(/*siginfo->si_int*/ siginfo->si_fd);
@@ -1719,7 +1828,7 @@ perf_event_handler(
 	if (in_hpctoolkit_ibs[my_id] == 1) {
                 //ibs_ctl_reload(nevents, event_thread);
 
-		if(hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP"))
+		if(current->kind == EVENT_KIND_IBS_OP)
                         ibs_restart_perf_event(fd);
                 else
                         restart_perf_event(fd);
@@ -1734,7 +1843,7 @@ perf_event_handler(
 	// ----------------------------------------------------------------------------
 	// check #1: check if signal generated by kernel for profiling
 	// ----------------------------------------------------------------------------
-	if (siginfo->si_code < 0 && !hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP")) {
+	if (siginfo->si_code < 0 && current->kind != EVENT_KIND_IBS_OP) {
 		TMSG(LINUX_PERF, "signal si_code %d < 0 indicates not from kernel", 
 				siginfo->si_code);
 		//fprintf(stderr, "quit 1\n");
@@ -1782,92 +1891,60 @@ perf_event_handler(
 	// metrics. Perhaps we should throw away?
 	// ----------------------------------------------------------------------------
 
-	int tmp = 0;
-	bool amd_ibs_event = false;
-	if(hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP") && current->fd >= 0)
-	{
-		amd_ibs_event = true;
-		tmp = read(fd, global_buffer, BUFFER_SIZE_B);
-	}
-
 	// Increment the number of overflows for the current event
 	current->num_overflows++;
+
 	// ----------------------------------------------------------------------------
-	// parse the buffer until it finishes reading all buffers
+	// parse all the pending records of the buffer in one pass
 	// ----------------------------------------------------------------------------
-//#if 0
-	int more_data = 0;
-	char * sample_buffer;
-	if(amd_ibs_event)
+	if(current->kind == EVENT_KIND_IBS_OP && current->fd >= 0)
 	{
-       		more_data = tmp / sizeof(ibs_op_t);
-		sample_buffer = malloc (sizeof(ibs_op_t));
-		//fprintf(stderr, "%d samples are detected in a counter overflow\n", more_data);
-	} 
-
-	int offset = 0;
-	//fprintf(stderr, "event with name %s is about to be read\n", current->event->metric_desc->name);
-	int i = 0;
-//#if 0
-	do {
-		perf_mmap_data_t mmap_data;
-		memset(&mmap_data, 0, sizeof(perf_mmap_data_t));
-
-		 sample_val_t sv;
-		 memset(&sv, 0, sizeof(sample_val_t));
-		// reading info from mmapped buffer
-		if(amd_ibs_event)
-		{
-			memcpy ( sample_buffer, global_buffer + offset, sizeof(ibs_op_t) );
-			i++;
-                	offset = i * sizeof(ibs_op_t);
-                	ibs_op_t *op_data = (ibs_op_t *) sample_buffer;
-			original_sample_count++;
-			//fprintf(stderr, "more_data: %d\n", more_data);
-			read_ibs_buffer(current, &mmap_data, op_data);
-
-			//if (hpcrun_safe_enter_async(mmap_data.ip) /*&& !hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP")*/) {	
-			//fprintf(stderr, "before record_sample\n");
-        		record_sample(current, &mmap_data, context, &sv);
-			//}
-
-			//if(!op_data->kern_mode)
-			//fprintf(stderr, "event with name %s is handled here\n", current->event->metric_desc->name);
-			//record_sample(current, &mmap_data, context, &sv);		
-			more_data--;
-		} else
-		{
-			more_data = read_perf_buffer(current, &mmap_data);
+		// the IBS driver copies the ops into global_buffer:
+		// read them in place
+		int tmp = read(fd, global_buffer, BUFFER_SIZE_B);
+		int num_ops = (tmp > 0) ? tmp / sizeof(ibs_op_t) : 0;
+		ibs_op_t *ops = (ibs_op_t *) global_buffer;
 
-			//fprintf(stderr, "event with name %s is handled there\n", current->event->metric_desc->name);
-                	if (mmap_data.header_type == PERF_RECORD_SAMPLE && !hpcrun_ev_is(current->event->metric_desc->name, "AMD_L1_DATA_ACCESS") && !hpcrun_ev_is(current->event->metric_desc->name, "AMD_MICRO_OP_RETIRED"))
-                        	record_sample(current, &mmap_data, context, &sv);
+		for (int i = 0; i < num_ops; i++) {
+			perf_mmap_data_t mmap_data;
+			memset(&mmap_data, 0, sizeof(perf_mmap_data_t));
 
-			kernel_block_handler(current, sv, &mmap_data);
+			sample_val_t sv;
+			memset(&sv, 0, sizeof(sample_val_t));
+
+			original_sample_count++;
+			read_ibs_buffer(current, &mmap_data, &ops[i]);
+			record_sample(current, &mmap_data, context, &sv);
 		}
-		//fprintf(stderr, "event with name %s has been read\n", current->event->metric_desc->name);
-		TMSG(LINUX_PERF, "record buffer: sid: %d, ip: %p, addr: %p, id: %d", mmap_data.sample_id, mmap_data.ip, mmap_data.addr, mmap_data.id);
+	} else
+	{
+		perf_ring_pass_t pass;
+		pe_header_t *record;
 
-#if 0
-		sample_val_t sv;
-		memset(&sv, 0, sizeof(sample_val_t));
+		perf_ring_begin(&pass, current->mmap, perf_mmap_data_size());
 
-		if (mmap_data.header_type == PERF_RECORD_SAMPLE)
-			record_sample(current, &mmap_data, context, &sv);
+		while ((record = perf_ring_next(&pass)) != NULL) {
+			perf_mmap_data_t mmap_data;
+			memset(&mmap_data, 0, sizeof(perf_mmap_data_t));
 
-		kernel_block_handler(current, sv, &mmap_data);
-#endif
+			sample_val_t sv;
+			memset(&sv, 0, sizeof(sample_val_t));
+
+			parse_perf_record(current, record, &mmap_data);
+
+			if (mmap_data.header_type == PERF_RECORD_SAMPLE && current->kind != EVENT_KIND_AMD_L1_DATA_ACCESS && current->kind != EVENT_KIND_AMD_MICRO_OP_RETIRED)
+				record_sample(current, &mmap_data, context, &sv);
+
+			kernel_block_handler(current, sv, &mmap_data);
+
+			TMSG(LINUX_PERF, "record buffer: sid: %d, ip: %p, addr: %p, id: %d", mmap_data.sample_id, mmap_data.ip, mmap_data.addr, mmap_data.id);
+		}
+		perf_ring_end(&pass);
+	}
 
-	} while (more_data > 0);
-//#endif
-	if(amd_ibs_event)
-        {
-                free(sample_buffer);
-        }
-//#endif
 	hpcrun_safe_exit();
 
-	if(hpcrun_ev_is(current->event->metric_desc->name, "IBS_OP"))
+	if(current->kind == EVENT_KIND_IBS_OP)
 		ibs_restart_perf_event(fd);
 	else
 		restart_perf_event(fd);
@@ -69,6 +69,16 @@
 //  4  Detect automatically to have the most precise possible (default)
 #define HPCRUN_OPTION_PRECISE_IP "HPCRUN_PRECISE_IP"
 
+// -----------------------------------------------------
+// user call chain option
+// -----------------------------------------------------
+
+// If set to a non-zero value, ask the kernel to record the user-mode
+// call chain (frame pointer walk) with each sample and use it instead
+// of unwinding in the signal handler. Samples whose chain does not
+// reach main or a thread's start routine are still unwound.
+#define HPCRUN_OPTION_PERF_CALLCHAIN "HPCRUN_PERF_CALLCHAIN"
+
 // default option for precise_ip: autodetect skid
 #define PERF_EVENT_AUTODETECT_SKID    4
 
@@ -112,6 +122,22 @@ static uint16_t perf_kernel_lm_id;
 // implementation
 //******************************************************************************
 
+//----------------------------------------------------------
+// number of entries of the call chain that belong to the kernel.
+// the kernel frames come first, up to the user context marker
+// if user call chains are recorded as well.
+//----------------------------------------------------------
+int
+perf_num_kernel_frames(perf_mmap_data_t *data)
+{
+  int nr_kernel = 0;
+  while (nr_kernel < data->nr && data->ips[nr_kernel] != PERF_CONTEXT_USER) {
+    nr_kernel++;
+  }
+  return nr_kernel;
+}
+
+
 //----------------------------------------------------------
 // extend a user-mode callchain with kernel frames (if any)
 //----------------------------------------------------------
@@ -127,9 +153,13 @@ perf_add_kernel_callchain(
   }
   perf_mmap_data_t *data = (perf_mmap_data_t*) data_aux;
   if (data->nr > 0) {
+    int nr_kernel = perf_num_kernel_frames(data);
+
     // add kernel IPs to the call chain top down, which is the 
     // reverse of the order in which they appear in ips
-    for (int i = data->nr - 1; i >= 0; i--) {
+    for (int i = nr_kernel - 1; i >= 0; i--) {
+      // skip context markers (PERF_CONTEXT_KERNEL)
+      if (data->ips[i] >= PERF_CONTEXT_MAX) continue;
 
       uint16_t lm_id = perf_kernel_lm_id;
       ip_normalized_t npc = { .lm_id = lm_id, .lm_ip = data->ips[i] };
@@ -142,6 +172,46 @@ perf_add_kernel_callchain(
 }
 
 
+//----------------------------------------------------------
+// build the user-mode backtrace from the call chain recorded
+// by the kernel. returns false if the sample has no user chain
+// or the chain does not reach a fence; the caller unwinds then.
+//----------------------------------------------------------
+static bool
+perf_user_callchain(
+  backtrace_info_t *bt, void *data_aux
+)
+{
+  perf_mmap_data_t *data = (perf_mmap_data_t*) data_aux;
+  if (data->nr == 0 || data->ips == NULL) {
+    return false;
+  }
+
+  // user frames follow the user context marker. a sample taken in
+  // user mode has no kernel part, and the chain may start with the
+  // marker or directly with the user ip.
+  u64 first = 0;
+  while (first < data->nr && data->ips[first] != PERF_CONTEXT_USER) {
+    first++;
+  }
+  if (first == data->nr) {
+    first = (data->ips[0] < PERF_CONTEXT_MAX) ? 0 : data->nr;
+  } else {
+    first++;
+  }
+
+  u64 last = first;
+  while (last < data->nr && data->ips[last] < PERF_CONTEXT_MAX) {
+    last++;
+  }
+  if (last == first) {
+    return false;
+  }
+
+  return hpcrun_generate_backtrace_from_ips(bt, data->ips + first, last - first);
+}
+
+
 /*
  * get int long value of variable environment.
  * If the variable is not set, return the default value 
@@ -289,6 +359,26 @@ is_perf_ksym_available()
 }
 
 
+//----------------------------------------------------------
+// Interface to see if user call chains are requested.
+// the value is cached, and the call chain provider is
+// registered the first time it is enabled.
+//----------------------------------------------------------
+static bool
+is_perf_user_callchain_enabled()
+{
+  static int user_callchain = -1;
+
+  if (user_callchain < 0) {
+    user_callchain = (getEnvLong(HPCRUN_OPTION_PERF_CALLCHAIN, 0) != 0);
+    if (user_callchain) {
+      hpcrun_user_callpath_register(perf_user_callchain);
+    }
+  }
+  return (user_callchain == 1);
+}
+
+
 /*************************************************************
  * Interface API
  **************************************************************/ 
@@ -345,6 +435,13 @@ perf_attr_init(
     attr->exclude_hv      = 0;
     attr->exclude_idle    = 0;
   }
+  if (is_perf_user_callchain_enabled()) {
+    /* the kernel walks the user frame pointers at sample time */
+    attr->sample_type             |= PERF_SAMPLE_CALLCHAIN;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
+    attr->exclude_callchain_user   = INCLUDE_CALLCHAIN;
+#endif
+  }
   attr->precise_ip    = get_precise_ip(attr);   /* the precision is either detected automatically
                                               as precise as possible or  on the user's variable.  */
   return true;
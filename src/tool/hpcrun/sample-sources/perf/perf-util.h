@@ -40,6 +40,7 @@
 
 #include <sys/syscall.h> 
 
+#include <stdint.h>
 #include <unistd.h>
 #include <linux/types.h>
 #include <linux/perf_event.h>
@@ -73,11 +74,6 @@ typedef __u32 u32;
 typedef __u64 u64;
 #endif
 
-// the number of maximum frames (call chains) 
-// For kernel only call chain, I think 32 is a good number.
-// If we include user call chains, it should be bigger than that.
-#define MAX_CALLCHAIN_FRAMES 32
-
 // data from perf's mmap. See perf_event_open man page
 typedef struct perf_mmap_data_s {
   struct perf_event_header header;
@@ -102,7 +98,7 @@ typedef struct perf_mmap_data_s {
   int mem_access_sample;
   int valid_mem_access_sample;
   u64    nr;         /* if PERF_SAMPLE_CALLCHAIN */
-  u64    ips[MAX_CALLCHAIN_FRAMES];       /* if PERF_SAMPLE_CALLCHAIN */
+  const uint64_t *ips; /* if PERF_SAMPLE_CALLCHAIN, points into the record */
   u32    size;       /* if PERF_SAMPLE_RAW */
   char   *data;      /* if PERF_SAMPLE_RAW */
   /* if PERF_SAMPLE_BRANCH_STACK */
@@ -154,6 +150,19 @@ typedef struct event_info_s {
 typedef struct perf_event_mmap_page pe_mmap_t;
 
 
+// --------------------------------------------------------------
+// kinds of events that need a special treatment in the sample handler.
+// the kind is resolved once per thread when the event is created, so
+// that the handler doesn't need to compare the event names.
+// --------------------------------------------------------------
+typedef enum perf_event_kind_e {
+  EVENT_KIND_GENERIC = 0,
+  EVENT_KIND_IBS_OP,               // AMD IBS op, read from the IBS driver
+  EVENT_KIND_AMD_L1_DATA_ACCESS,
+  EVENT_KIND_AMD_MICRO_OP_RETIRED
+} perf_event_kind_t;
+
+
 // --------------------------------------------------------------
 // data perf event per thread per event
 // this data is designed to be used within a thread
@@ -163,6 +172,8 @@ typedef struct event_thread_s {
   pe_mmap_t    *mmap;  // mmap buffer
   int          fd;     // file descriptor of the event
   event_info_t *event; // pointer to main event description
+  perf_event_kind_t kind; // kind of the event
+  int          group_fd;  // fd of the group leader, -1 if not in a group
   uint64_t num_overflows; // record how many times this event has overflowed
   uint64_t prev_num_overflows;
 } event_thread_t;
@@ -186,7 +197,11 @@ perf_attr_init(
   u64  sampletype
 );
 
+int
+perf_num_kernel_frames(perf_mmap_data_t *data);
+
 extern void linux_perf_events_pause();
 extern void linux_perf_events_resume();
+extern void linux_perf_set_period_scale(uint32_t scale);
 
 #endif
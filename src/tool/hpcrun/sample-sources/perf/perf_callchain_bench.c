@@ -0,0 +1,376 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+//
+// user call chain benchmark for the linux_perf sample handler
+//
+// Compares two ways of getting the user call path of a sample taken
+// with a software event (cpu-clock), so it runs on machines without
+// hardware counters:
+//
+//   unwind:    the sample records only the ip; the handler unwinds
+//              the interrupted context itself (glibc backtrace(), a
+//              DWARF unwinder, stands in for the hpcrun unwinder).
+//   callchain: the sample records the user call chain
+//              (PERF_SAMPLE_CALLCHAIN, exclude_callchain_kernel); the
+//              kernel walks the frame pointers and the handler only
+//              reads the frames out of the ring buffer.
+//
+// The workload is a compute loop at the bottom of a recursion of a
+// given depth. Each variant reports the number of samples, the time
+// spent in the handler per sample, the average number of frames, the
+// fraction of samples whose path reaches below the recursion (i.e. a
+// complete path; a broken frame pointer chain stops short) and the
+// slowdown of the loop compared to a run without events. The kernel
+// walk happens at overflow time and is not part of the handler time,
+// so the slowdown is the number to compare.
+//
+// 'make check' in src/tool/hpcrun builds the benchmark; by hand (the
+// frame pointers are required for the kernel walk):
+//   cc -O2 -fno-omit-frame-pointer -o perf_callchain_bench perf_callchain_bench.c
+// Run:
+//   ./perf_callchain_bench [-d depth] [-p period-ns] [-t seconds]
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#define BENCH_SIGNAL    (SIGRTMIN+4)
+#define BUFFER_PAGES    8          // data pages of the ring buffer
+#define MAX_FRAMES      256
+#define RECORD_MAX      (sizeof(uint64_t) * (MAX_FRAMES + 8))
+
+enum bench_mode_e { MODE_NONE, MODE_UNWIND, MODE_CALLCHAIN };
+
+static enum bench_mode_e mode;
+static int    fd = -1;
+static void  *buffer;
+static size_t pgsz;
+static int    depth;
+
+static volatile uint64_t num_samples;
+static volatile uint64_t handler_ns;
+static volatile uint64_t num_frames;
+static volatile uint64_t num_complete;
+
+static char record_copy[RECORD_MAX];
+
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// number of user frames of a call chain, without context markers
+static int
+user_frames(const uint64_t *ips, uint64_t nr)
+{
+  int n = 0;
+  for (uint64_t i = 0; i < nr; i++) {
+    if (ips[i] < PERF_CONTEXT_MAX) n++;
+  }
+  return n;
+}
+
+
+// consume the records in the ring buffer; returns the frames of the
+// last sample (callchain mode) or 0
+static int
+read_records()
+{
+  struct perf_event_mmap_page *hdr = buffer;
+  char *data = (char *) buffer + pgsz;
+  size_t size = BUFFER_PAGES * pgsz;
+
+  uint64_t head = __atomic_load_n(&hdr->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = hdr->data_tail;
+  int frames = 0;
+
+  while (tail < head) {
+    struct perf_event_header *rec =
+      (struct perf_event_header *) (data + (tail % size));
+    size_t off = tail % size;
+
+    // a record that wraps around is copied out, as in perf_mmap.c
+    if (off + rec->size > size) {
+      if (rec->size > RECORD_MAX) { tail += rec->size; continue; }
+      size_t right = size - off;
+      memcpy(record_copy, data + off, right);
+      memcpy(record_copy + right, data, rec->size - right);
+      rec = (struct perf_event_header *) record_copy;
+    }
+
+    if (rec->type == PERF_RECORD_SAMPLE && mode == MODE_CALLCHAIN) {
+      const uint64_t *body = (const uint64_t *) (rec + 1);
+      // body[0] is the ip, then nr and the frames
+      uint64_t nr = body[1];
+      frames = user_frames(body + 2, nr);
+    }
+    tail += rec->size;
+  }
+  __atomic_store_n(&hdr->data_tail, tail, __ATOMIC_RELEASE);
+  return frames;
+}
+
+
+static void
+handler(int sig, siginfo_t *info, void *context)
+{
+  uint64_t start = now_ns();
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+  int frames = read_records();
+  if (mode == MODE_UNWIND) {
+    void *ips[MAX_FRAMES];
+    frames = backtrace(ips, MAX_FRAMES);
+    // the unwind starts in the handler: drop its frame and the
+    // signal trampoline so that both modes count the same frames
+    frames = (frames > 2) ? frames - 2 : 0;
+  }
+
+  num_samples++;
+  num_frames += frames;
+  if (frames > depth) num_complete++;
+
+  ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+
+  handler_ns += now_ns() - start;
+}
+
+
+static int
+open_event(long period)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = PERF_TYPE_SOFTWARE;
+  attr.config         = PERF_COUNT_SW_CPU_CLOCK;
+  attr.sample_period  = period;
+  attr.sample_type    = PERF_SAMPLE_IP;
+  attr.disabled       = 1;
+  attr.wakeup_events  = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  if (mode == MODE_CALLCHAIN) {
+    attr.sample_type   |= PERF_SAMPLE_CALLCHAIN;
+    attr.exclude_callchain_kernel = 1;
+  }
+
+  fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0) return -1;
+
+  buffer = mmap(NULL, (BUFFER_PAGES + 1) * pgsz, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  struct f_owner_ex owner;
+  owner.type = F_OWNER_TID;
+  owner.pid  = syscall(SYS_gettid);
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_ASYNC);
+  fcntl(fd, F_SETSIG, BENCH_SIGNAL);
+  fcntl(fd, F_SETOWN_EX, &owner);
+
+  return fd;
+}
+
+
+static void
+close_event()
+{
+  munmap(buffer, (BUFFER_PAGES + 1) * pgsz);
+  close(fd);
+  fd = -1;
+}
+
+
+// the workload: a compute loop under 'level' frames. returns the
+// number of loop iterations done in 'seconds'
+static uint64_t __attribute__((noinline))
+workload(int level, double seconds)
+{
+  if (level > 0) {
+    uint64_t iters = workload(level - 1, seconds);
+    // keep the call from being turned into a jump
+    __asm__ volatile("" ::: "memory");
+    return iters;
+  }
+
+  uint64_t iters = 0;
+  volatile double x = 1.0;
+  uint64_t end = now_ns() + (uint64_t) (seconds * 1e9);
+  do {
+    for (int i = 0; i < 1000; i++) {
+      x = x * 1.0000001 + 0.0000001;
+    }
+    iters++;
+  } while (now_ns() < end);
+  return iters;
+}
+
+
+static uint64_t
+run(enum bench_mode_e m, long period, double seconds)
+{
+  mode         = m;
+  num_samples  = 0;
+  handler_ns   = 0;
+  num_frames   = 0;
+  num_complete = 0;
+
+  if (mode != MODE_NONE) {
+    if (open_event(period) < 0) {
+      fprintf(stderr, "perf_event_open failed: %s\n", strerror(errno));
+      exit(1);
+    }
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+  }
+
+  uint64_t iters = workload(depth, seconds);
+
+  if (mode != MODE_NONE) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    close_event();
+  }
+  return iters;
+}
+
+
+static void
+report(const char *name, uint64_t iters, uint64_t base, double seconds)
+{
+  double slowdown = (iters > 0) ? ((double) base / iters - 1.0) * 100.0 : 0.0;
+  uint64_t n = num_samples;
+  printf("%-10s %10lu %12.0f %12.0f %10.1f %9.1f%% %10.2f%%\n", name,
+         (unsigned long) n, n / seconds,
+         n ? (double) handler_ns / n : 0.0,
+         n ? (double) num_frames / n : 0.0,
+         n ? 100.0 * num_complete / n : 0.0,
+         slowdown);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  long   period  = 100000;   // ns
+  double seconds = 2.0;
+  int    opt;
+
+  depth = 32;
+  while ((opt = getopt(argc, argv, "d:p:t:")) != -1) {
+    switch (opt) {
+    case 'd': depth   = atoi(optarg); break;
+    case 'p': period  = atol(optarg); break;
+    case 't': seconds = atof(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-d depth] [-p period-ns] [-t seconds]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (depth < 0 || depth > MAX_FRAMES - 16 || period <= 0 || seconds <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  pgsz = sysconf(_SC_PAGESIZE);
+
+  // the first backtrace() loads the unwinder; keep it out of the handler
+  void *warmup[4];
+  backtrace(warmup, 4);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = handler;
+  sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(BENCH_SIGNAL, &sa, NULL);
+
+  printf("cpu-clock, period %ld ns, recursion depth %d, %.1f s per run\n",
+         period, depth, seconds);
+  printf("%-10s %10s %12s %12s %10s %10s %11s\n", "mode", "samples",
+         "samples/s", "ns/sample", "frames", "complete", "slowdown");
+
+  uint64_t base = run(MODE_NONE, period, seconds);
+
+  uint64_t iters = run(MODE_UNWIND, period, seconds);
+  report("unwind", iters, base, seconds);
+
+  iters = run(MODE_CALLCHAIN, period, seconds);
+  report("callchain", iters, base, seconds);
+
+  return 0;
+}
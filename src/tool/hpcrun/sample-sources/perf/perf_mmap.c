@@ -68,6 +68,7 @@
  *****************************************************************************/
 
 #include <hpcrun/messages/messages.h>
+#include <hpcrun/memory/hpcrun-malloc.h>
 
 /******************************************************************************
  * local include
@@ -88,15 +89,8 @@
 #define PERF_MMAP_SIZE(pagesz)    ((pagesz) * (PERF_DATA_PAGES + 1))
 #define PERF_TAIL_MASK(pagesz)    (((pagesz) * PERF_DATA_PAGES) - 1)
 
-
-
-/******************************************************************************
- * forward declarations
- *****************************************************************************/
-
-static void
-skip_perf_data(pe_mmap_t *current_perf_mmap, size_t sz) 
-__attribute__ ((unused));
+// the size of a record is stored in 16 bits
+#define PERF_RECORD_MAX_SIZE      (1 << 16)
 
 
 
@@ -107,23 +101,15 @@ __attribute__ ((unused));
 static int pagesize      = 0;
 static size_t tail_mask  = 0;
 
+// per-thread copy of a record that wraps around the end of a ring buffer.
+// allocated by perf_mmap_thread_init, out of the signal handler.
+static __thread char *record_scratch = NULL;
+
 
 /******************************************************************************
  * local methods
  *****************************************************************************/
 
-/*
- * Not the data we need? Skip the data.
- */
-/*static void skip_perf_data(pe_mmap_t *hdr, size_t sz)
-{
-  if ((hdr->data_tail + sz) > hdr->data_head)
-    sz = hdr->data_head - hdr->data_tail;
-
-  hdr->data_tail += sz;
-} */
-
-
 static u64
 perf_mmap_read_head(pe_mmap_t *hdr)
 {
@@ -132,103 +118,53 @@ perf_mmap_read_head(pe_mmap_t *hdr)
 	return head;
 }
 
-/***
- * number of reminder data in the buffer
- */
-static int
-num_of_more_perf_data(pe_mmap_t *hdr)
-{
-  u64 head = perf_mmap_read_head(hdr);
-  return (head - hdr->data_tail);
-}
-
-/***
- * return true if we have more data to read
- */
-static int
-has_more_perf_data(pe_mmap_t *hdr)
-{
-  return (num_of_more_perf_data(hdr) > 0);
-}
-
-
-
 
 //----------------------------------------------------------
-// read from perf_events mmap'ed buffer
+// cursor over the body of a record.
+// the body is contiguous (in the ring or in the scratch copy),
+// so fields are read in place. reads beyond the end of the
+// record fail and leave the destination untouched.
 //----------------------------------------------------------
 
-static int
-perf_read(
-  pe_mmap_t *current_perf_mmap,
-  void *buf,
-  size_t bytes_wanted
-)
-{
-  if (current_perf_mmap == NULL)
-    return -1;
-
-  // front of the circular data buffer
-  char *data = BUFFER_FRONT(current_perf_mmap);
-
-  // compute bytes available in the circular buffer
-  u64 data_head = perf_mmap_read_head(current_perf_mmap);
-
-  size_t bytes_available = data_head - current_perf_mmap->data_tail;
-
-  if (bytes_wanted > bytes_available) return -1;
-
-  // compute offset of tail in the circular buffer
-  unsigned long tail = BUFFER_OFFSET(current_perf_mmap->data_tail);
-
-  long bytes_at_right = BUFFER_SIZE - tail;
+typedef struct record_cursor_s {
+  const char *pos;
+  const char *end;
+} record_cursor_t;
 
-  // bytes to copy to the right of tail
-  size_t right = bytes_at_right < bytes_wanted ? bytes_at_right : bytes_wanted;
 
-  // copy bytes from tail position
-  memcpy(buf, data + tail, right);
-
-  // if necessary, wrap and continue copy from left edge of buffer
-  if (bytes_wanted > right) {
-    size_t left = bytes_wanted - right;
-    memcpy(buf + right, data, left);
+static inline const void *
+cursor_take(record_cursor_t *cursor, size_t bytes)
+{
+  if (cursor->pos + bytes > cursor->end) {
+    cursor->pos = cursor->end;
+    return NULL;
   }
-
-  // update tail after consuming bytes_wanted
-  current_perf_mmap->data_tail += bytes_wanted;
-
-  return 0;
+  const void *p = cursor->pos;
+  cursor->pos += bytes;
+  return p;
 }
 
 
-static inline int
-perf_read_header(
-  pe_mmap_t *current_perf_mmap,
-  pe_header_t *hdr
-)
+static inline void
+cursor_u64(record_cursor_t *cursor, u64 *val)
 {
-  return perf_read(current_perf_mmap, hdr, sizeof(pe_header_t));
+  const void *p = cursor_take(cursor, sizeof(u64));
+  if (p) memcpy(val, p, sizeof(u64));
 }
 
 
-static inline int
-perf_read_u32(
-  pe_mmap_t *current_perf_mmap,
-  u32 *val
-)
+static inline void
+cursor_u32(record_cursor_t *cursor, u32 *val)
 {
-  return perf_read(current_perf_mmap, val, sizeof(u32));
+  const void *p = cursor_take(cursor, sizeof(u32));
+  if (p) memcpy(val, p, sizeof(u32));
 }
 
 
-static inline int
-perf_read_u64(
-  pe_mmap_t *current_perf_mmap,
-  u64 *val
-)
+static inline void
+cursor_skip_u64(record_cursor_t *cursor, u64 count)
 {
-  return perf_read(current_perf_mmap, val, sizeof(u64));
+  cursor_take(cursor, count * sizeof(u64));
 }
 
 
@@ -236,217 +172,200 @@ perf_read_u64(
 // special mmap buffer reading for PERF_SAMPLE_READ
 //----------------------------------------------------------
 static void
-handle_struct_read_format( pe_mmap_t *perf_mmap, int read_format)
+handle_struct_read_format(record_cursor_t *cursor, int read_format)
 {
-  u64 value, id, nr, time_enabled, time_running;
+  u64 nr = 1;
+  u64 per_value = (read_format & PERF_FORMAT_ID) ? 2 : 1;
 
   if (read_format & PERF_FORMAT_GROUP) {
-    perf_read_u64(perf_mmap, &nr);
+    cursor_u64(cursor, &nr);
   } else {
-    perf_read_u64(perf_mmap, &value);
+    // value, then its id
+    cursor_skip_u64(cursor, 1);
+    per_value--;
   }
 
   if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) {
-    perf_read_u64(perf_mmap, &time_enabled);
+    cursor_skip_u64(cursor, 1);
   }
   if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) {
-    perf_read_u64(perf_mmap, &time_running);
-  }
-
-  if (read_format & PERF_FORMAT_GROUP) {
-    for(int i=0;i<nr;i++) {
-      perf_read_u64(perf_mmap, &value);
-
-      if (read_format & PERF_FORMAT_ID) {
-        perf_read_u64(perf_mmap, &id);
-      }
-    }
-  }
-  else {
-    if (read_format & PERF_FORMAT_ID) {
-      perf_read_u64(perf_mmap, &id);
-    }
+    cursor_skip_u64(cursor, 1);
   }
+  cursor_skip_u64(cursor, nr * per_value);
 }
 
 
-
 //----------------------------------------------------------
 // processing of kernel callchains
 //----------------------------------------------------------
 
 static int
-perf_sample_callchain(pe_mmap_t *current_perf_mmap, perf_mmap_data_t* mmap_data)
+perf_sample_callchain(record_cursor_t *cursor, perf_mmap_data_t* mmap_data)
 {
   mmap_data->nr = 0;     // initialze the number of records to be 0
+  mmap_data->ips = NULL;
   u64 num_records = 0;
 
   // determine how many frames in the call chain
-  if (perf_read_u64( current_perf_mmap, &num_records) == 0) {
-    if (num_records > 0) {
-
-      // warning: if the number of frames is bigger than the storage (MAX_CALLCHAIN_FRAMES)
-      // we have to truncate them. This is not a good practice, but so far it's the only
-      // simplest solution I can come up.
-      mmap_data->nr = (num_records < MAX_CALLCHAIN_FRAMES ? num_records : MAX_CALLCHAIN_FRAMES);
-
-      // read the IPs for the frames
-      if (perf_read( current_perf_mmap, mmap_data->ips, num_records * sizeof(u64)) != 0) {
-        // the data seems invalid
-        mmap_data->nr = 0;
-        TMSG(LINUX_PERF, "unable to read all %d frames", mmap_data->nr);
-      }
-    }
-  } else {
-    TMSG(LINUX_PERF, "unable to read the number of frames" );
+  cursor_u64(cursor, &num_records);
+
+  const void *ips = cursor_take(cursor, num_records * sizeof(u64));
+  if (ips == NULL) {
+    // the data seems invalid
+    TMSG(LINUX_PERF, "unable to read all %d frames", num_records);
+    return 0;
   }
+
+  // like the registers and the user stack, the frames stay in the
+  // record; a user call chain is much longer than a kernel one and
+  // copying it out would cost as much as the unwind it replaces.
+  mmap_data->nr  = num_records;
+  mmap_data->ips = (const uint64_t *) ips;
+
   return mmap_data->nr;
 }
 
 
 //----------------------------------------------------------
-// part of the buffer to be skipped
+// registers of PERF_SAMPLE_REGS_USER and PERF_SAMPLE_REGS_INTR
+// returns the registers (in place), or NULL if none
 //----------------------------------------------------------
-static void
-skip_perf_data(pe_mmap_t *current_perf_mmap, size_t sz)
+static u64 *
+perf_sample_regs(record_cursor_t *cursor, u64 mask, u64 *abi)
 {
-  struct perf_event_mmap_page *hdr = current_perf_mmap;
-  u64 data_head = perf_mmap_read_head(current_perf_mmap);
-  rmb();
-
-  if ((hdr->data_tail + sz) > data_head)
-     sz = data_head - hdr->data_tail;
-
-  hdr->data_tail += sz;
+  *abi = 0;
+  cursor_u64(cursor, abi);
+  if (*abi == 0)
+    return NULL;
+  return (u64 *) cursor_take(cursor, __builtin_popcountll(mask) * sizeof(u64));
 }
 
-// read the counter value of the event
-// val is an array of uint64_t, at least has a length of 3
-int perf_read_event_counter(event_thread_t *current, uint64_t *val){
-
-  pe_mmap_t *current_perf_mmap = current->mmap;
-  //rdpmc(current_perf_mmap, val); //something wrong when using rdpmc
-
-  if (current->fd < 0){
-    EMSG("Error: unable to open the event %d file descriptor", current->event->id);
-    fprintf("Error: unable to open the event %d file descriptor", current->event->id);
-    return -1;
-  }
-  //fprintf(stderr, "val[0] 1: %ld\n", val[0]);
-  //fprintf(stderr, "val[1] 1: %ld\n", val[1]);
-  //fprintf(stderr, "val[2] 1: %ld\n", val[2]);
-  int ret = read(current->fd, val, sizeof(uint64_t) * 3 );
-  //fprintf(stderr, "val[0] 2: %ld\n", val[0]);
-  //fprintf(stderr, "val[1] 2: %ld\n", val[1]);
-  //fprintf(stderr, "val[2] 2: %ld\n", val[2]);
-  //fprintf(stderr, "ret: %d\n", ret);
-  if (/*ret < sizeof(uint64_t)*3*/ret < sizeof(uint64_t)) {
-    EMSG("Error: unable to read event %d", current->event->id);
-    fprintf(stderr, "Error: unable to read event %d", current->event->id);
-    return -1;
-  }
-  return 0;
-}
 
 /**
- * parse mmapped buffer and copy the values into perf_mmap_data_t mmap_info.
+ * parse the body of a sample record and copy the values into
+ * perf_mmap_data_t mmap_info. call chain, raw data, registers and user
+ * stack point into the record, so they are only valid during the pass.
  * we assume mmap_info is already initialized.
  * returns the number of read event attributes
  */
 static int
-parse_buffer(int sample_type, event_thread_t *current, perf_mmap_data_t *mmap_info )
+parse_buffer(record_cursor_t *cursor, event_thread_t *current, perf_mmap_data_t *mmap_info )
 {
-	pe_mmap_t *current_perf_mmap = current->mmap;
+	struct perf_event_attr *attr = &(current->event->attr);
+	u64 sample_type = attr->sample_type;
 
 	int data_read = 0;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
 	if (sample_type & PERF_SAMPLE_IDENTIFIER) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->sample_id);
+	  cursor_u64(cursor, &mmap_info->sample_id);
 	  data_read++;
 	}
 #endif
 	if (sample_type & PERF_SAMPLE_IP) {
 	  // to be used by datacentric event
-	  perf_read_u64(current_perf_mmap, &mmap_info->ip);
+	  cursor_u64(cursor, &mmap_info->ip);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TID) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->pid);
-	  perf_read_u32(current_perf_mmap, &mmap_info->tid);
+	  cursor_u32(cursor, &mmap_info->pid);
+	  cursor_u32(cursor, &mmap_info->tid);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TIME) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->time);
+	  cursor_u64(cursor, &mmap_info->time);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ADDR) {
 	  // to be used by datacentric event
-	  perf_read_u64(current_perf_mmap, &mmap_info->addr);
+	  cursor_u64(cursor, &mmap_info->addr);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ID) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->id);
+	  cursor_u64(cursor, &mmap_info->id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STREAM_ID) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->stream_id);
+	  cursor_u64(cursor, &mmap_info->stream_id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CPU) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->cpu);
-	  perf_read_u32(current_perf_mmap, &mmap_info->res);
+	  cursor_u32(cursor, &mmap_info->cpu);
+	  cursor_u32(cursor, &mmap_info->res);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_PERIOD) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->period);
+	  cursor_u64(cursor, &mmap_info->period);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_READ) {
 	  // to be used by datacentric event
-	  handle_struct_read_format(current_perf_mmap,
-	      current->event->attr.read_format);
+	  handle_struct_read_format(cursor, attr->read_format);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
 	  // add call chain from the kernel
-	  perf_sample_callchain(current_perf_mmap, mmap_info);
+	  perf_sample_callchain(cursor, mmap_info);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_RAW) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->size);
-	  mmap_info->data = alloca( sizeof(char) * mmap_info->size );
-	  perf_read( current_perf_mmap, mmap_info->data, mmap_info->size) ;
+	  cursor_u32(cursor, &mmap_info->size);
+	  mmap_info->data = (char *) cursor_take(cursor, mmap_info->size);
+	  // the raw data is padded to align the record to 64 bits
+	  cursor_take(cursor, (8 - ((mmap_info->size + sizeof(u32)) & 7)) & 7);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_BRANCH_STACK) {
+	  u64 bnr = 0;
+	  cursor_u64(cursor, &bnr);
+#ifdef PERF_SAMPLE_BRANCH_HW_INDEX
+	  if (attr->branch_sample_type & PERF_SAMPLE_BRANCH_HW_INDEX) {
+	    cursor_skip_u64(cursor, 1);
+	  }
+#endif
+	  cursor_take(cursor, bnr * sizeof(struct perf_branch_entry));
 	  data_read++;
 	}
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
 	if (sample_type & PERF_SAMPLE_REGS_USER) {
+	  mmap_info->regs = perf_sample_regs(cursor, attr->sample_regs_user, &mmap_info->abi);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STACK_USER) {
+	  cursor_u64(cursor, &mmap_info->stack_size);
+	  mmap_info->stack_data = (char *) cursor_take(cursor, mmap_info->stack_size);
+	  if (mmap_info->stack_size > 0) {
+	    cursor_u64(cursor, &mmap_info->stack_dyn_size);
+	  }
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
 	if (sample_type & PERF_SAMPLE_WEIGHT) {
+	  cursor_u64(cursor, &mmap_info->weight);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_DATA_SRC) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->data_src);
+	  cursor_u64(cursor, &mmap_info->data_src);
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
-	// only available since kernel 3.19
 	if (sample_type & PERF_SAMPLE_TRANSACTION) {
+	  cursor_u64(cursor, &mmap_info->transaction);
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0)
 	// only available since kernel 3.19
 	if (sample_type & PERF_SAMPLE_REGS_INTR) {
+	  mmap_info->intr_regs = perf_sample_regs(cursor, attr->sample_regs_intr,
+	      &mmap_info->intr_abi);
+	  data_read++;
+	}
+#endif
+#ifdef PERF_SAMPLE_PHYS_ADDR
+	if (sample_type & PERF_SAMPLE_PHYS_ADDR) {
+	  cursor_u64(cursor, &mmap_info->phy_addr);
 	  data_read++;
 	}
 #endif
@@ -457,76 +376,185 @@ parse_buffer(int sample_type, event_thread_t *current, perf_mmap_data_t *mmap_in
 // Public Interfaces
 //----------------------------------------------------------------------
 
+// read the counter value of the event
+// val is an array of uint64_t, at least has a length of 3
+int perf_read_event_counter(event_thread_t *current, uint64_t *val){
+
+  pe_mmap_t *current_perf_mmap = current->mmap;
+  //rdpmc(current_perf_mmap, val); //something wrong when using rdpmc
+
+  if (current->fd < 0){
+    EMSG("Error: unable to open the event %d file descriptor", current->event->id);
+    return -1;
+  }
+  //fprintf(stderr, "val[0] 1: %ld\n", val[0]);
+  //fprintf(stderr, "val[1] 1: %ld\n", val[1]);
+  //fprintf(stderr, "val[2] 1: %ld\n", val[2]);
+  int ret = read(current->fd, val, sizeof(uint64_t) * 3 );
+  //fprintf(stderr, "val[0] 2: %ld\n", val[0]);
+  //fprintf(stderr, "val[1] 2: %ld\n", val[1]);
+  //fprintf(stderr, "val[2] 2: %ld\n", val[2]);
+  //fprintf(stderr, "ret: %d\n", ret);
+  if (/*ret < sizeof(uint64_t)*3*/ret < sizeof(uint64_t)) {
+    EMSG("Error: unable to read event %d", current->event->id);
+    fprintf(stderr, "Error: unable to read event %d", current->event->id);
+    return -1;
+  }
+  return 0;
+}
+
 
 //----------------------------------------------------------
-// reading mmap buffer from the kernel
-// in/out: mmapped data of type perf_mmap_data_t.
-// return true if there are more data to be read,
-//        false otherwise
+// start a pass over the records of a ring buffer.
+// data_size is the size of the data area (a power of 2).
 //----------------------------------------------------------
-int
-read_perf_buffer(event_thread_t *current, perf_mmap_data_t *mmap_info)
+void
+perf_ring_begin(perf_ring_pass_t *pass, pe_mmap_t *mmap, size_t data_size)
 {
-  pe_header_t hdr;
-  pe_mmap_t *current_perf_mmap = current->mmap;
+  if (pagesize == 0) {
+    perf_mmap_init();
+  }
+  pass->mmap      = mmap;
+  pass->data_mask = data_size - 1;
 
-  int read_successfully = perf_read_header(current_perf_mmap, &hdr);
-  if (read_successfully != 0) {
-    return 0;
+  if (mmap == NULL) {
+    pass->data = NULL;
+    pass->head = pass->pos = 0;
+    return;
   }
+  pass->data = (char *) mmap + pagesize;
+  pass->pos  = mmap->data_tail;
+  pass->head = perf_mmap_read_head(mmap);
+}
 
-  mmap_info->header_type = hdr.type;
-  mmap_info->header_misc = hdr.misc;
 
-  if (hdr.type == PERF_RECORD_SAMPLE) {
-      if (hdr.size <= 0) {
-        return 0;
-      }
-      int sample_type = current->event->attr.sample_type;
-      parse_buffer(sample_type, current, mmap_info);
+//----------------------------------------------------------
+// next record of the pass, or NULL if there is no more record.
+// the record is read in place, unless it wraps around the end of
+// the buffer, in which case it is copied into the scratch memory
+// of the thread. the record is valid until the next call.
+//----------------------------------------------------------
+pe_header_t *
+perf_ring_next(perf_ring_pass_t *pass)
+{
+  size_t data_size = pass->data_mask + 1;
+
+  while (pass->head - pass->pos >= sizeof(pe_header_t)) {
+    size_t offset = pass->pos & pass->data_mask;
+
+    // the kernel aligns records to 64 bits, so a header never wraps
+    pe_header_t *record = (pe_header_t *) (pass->data + offset);
+
+    if (record->size < sizeof(pe_header_t) ||
+        record->size > pass->head - pass->pos) {
+      // corrupted or incomplete: drop the rest of the buffer
+      TMSG(LINUX_PERF, "invalid record size %d, skip %d bytes",
+           record->size, pass->head - pass->pos);
+      break;
+    }
+    pass->pos += record->size;
+
+    if (offset + record->size <= data_size)
+      return record;
+
+    // the record wraps around: put it back together
+    if (record_scratch == NULL) {
+      TMSG(LINUX_PERF, "no scratch memory, skip record of %d bytes", record->size);
+      continue;
+    }
+    size_t right = data_size - offset;
+    memcpy(record_scratch, record, right);
+    memcpy(record_scratch + right, pass->data, record->size - right);
+
+    return (pe_header_t *) record_scratch;
+  }
+  pass->pos = pass->head;
+  return NULL;
+}
+
+
+//----------------------------------------------------------
+// drop the records that haven't been read in this pass
+//----------------------------------------------------------
+void
+perf_ring_skip_all(perf_ring_pass_t *pass)
+{
+  pass->pos = pass->head;
+}
+
+
+//----------------------------------------------------------
+// end of the pass: give the consumed space back to the kernel
+//----------------------------------------------------------
+void
+perf_ring_end(perf_ring_pass_t *pass)
+{
+  if (pass->mmap == NULL)
+    return;
+
+  // make sure the records are read before the kernel can overwrite them
+  __sync_synchronize();
+  pass->mmap->data_tail = pass->pos;
+}
+
+
+//----------------------------------------------------------
+// parse a record of a linux_perf event.
+// in/out: mmapped data of type perf_mmap_data_t.
+//----------------------------------------------------------
+void
+parse_perf_record(event_thread_t *current, pe_header_t *record,
+                  perf_mmap_data_t *mmap_info)
+{
+  record_cursor_t cursor = { (const char *) (record + 1),
+                             (const char *) record + record->size };
+
+  mmap_info->header_type = record->type;
+  mmap_info->header_misc = record->misc;
+
+  if (record->type == PERF_RECORD_SAMPLE) {
+      parse_buffer(&cursor, current, mmap_info);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
-  } else if (hdr.type == PERF_RECORD_SWITCH) {
+  } else if (record->type == PERF_RECORD_SWITCH) {
       // only available since kernel 4.3
+      // the record has no body, only the sample_id fields
 
-      u64 type;
-      struct { uint32_t pid, tid; } pid;
-      struct { uint32_t cpu, reserved; } cpu;
-
-      type = current->event->attr.sample_type;
+      u64 type = current->event->attr.sample_type;
 
       if (type & PERF_SAMPLE_TID) {
-        perf_read( current_perf_mmap, &pid, sizeof(pid)) ;
+        cursor_u32(&cursor, &mmap_info->pid);
+        cursor_u32(&cursor, &mmap_info->tid);
       }
-
       if (type & PERF_SAMPLE_TIME) {
-        perf_read_u64( current_perf_mmap, &(mmap_info->context_switch_time) ) ;
+        cursor_u64(&cursor, &(mmap_info->context_switch_time));
+      }
+      if (type & PERF_SAMPLE_ID) {
+        cursor_u64(&cursor, &mmap_info->id);
+      }
+      if (type & PERF_SAMPLE_STREAM_ID) {
+        cursor_u64(&cursor, &mmap_info->stream_id);
       }
       if (type & PERF_SAMPLE_CPU) {
-        perf_read( current_perf_mmap, &cpu, sizeof(cpu) ) ;
+        cursor_u32(&cursor, &mmap_info->cpu);
+        cursor_u32(&cursor, &mmap_info->res);
       }
-#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
-  } else if (hdr.type == PERF_RECORD_LOST_SAMPLES) {
-     u64 lost_samples;
-     perf_read_u64(current_perf_mmap, &lost_samples);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
+  } else if (record->type == PERF_RECORD_LOST_SAMPLES) {
+     u64 lost_samples = 0;
+     cursor_u64(&cursor, &lost_samples);
      TMSG(LINUX_PERF, "[%d] lost samples %d",
     		 current->fd, lost_samples);
-     skip_perf_data(current_perf_mmap, hdr.size-sizeof(lost_samples))
 #endif
 
   } else {
       // not a PERF_RECORD_SAMPLE nor PERF_RECORD_SWITCH
       // skip it
-      if (hdr.size <= 0) {
-        return 0;
-      }
-      //skip_perf_data(current_perf_mmap, hdr.size);
       TMSG(LINUX_PERF, "[%d] skip header %d  %d : %d bytes",
     		  current->fd,
-    		  hdr.type, hdr.misc, hdr.size);
+    		  record->type, record->misc, record->size);
   }
-
-  return (has_more_perf_data(current_perf_mmap));
 }
 
 //----------------------------------------------------------
@@ -567,6 +595,15 @@ perf_unmmap(pe_mmap_t *mmap)
   munmap(mmap, PERF_MMAP_SIZE(pagesize));
 }
 
+/***
+ * size of the data area of the buffers allocated by set_mmap
+ */
+size_t
+perf_mmap_data_size()
+{
+  return tail_mask + 1;
+}
+
 /**
  * initialize perf_mmap.
  * caller needs to call this in the beginning before calling any API.
@@ -578,3 +615,16 @@ perf_mmap_init()
   tail_mask = PERF_TAIL_MASK(pagesize);
 }
 
+/**
+ * allocate the scratch memory of the calling thread.
+ * needs to be called by each thread before reading buffers,
+ * outside of the signal handler.
+ */
+void
+perf_mmap_thread_init()
+{
+  if (record_scratch == NULL) {
+    record_scratch = hpcrun_malloc(PERF_RECORD_MAX_SIZE);
+  }
+}
+
@@ -58,31 +58,42 @@
 #include "perf-util.h"
 
 
-/******************************************************************************
- *  constants
- *****************************************************************************/
-
-#define BUFFER_FRONT(current_perf_mmap)              ((char *) current_perf_mmap + pagesize)
-#define BUFFER_SIZE               (tail_mask + 1)
-#define BUFFER_OFFSET(tail)       ((tail) & tail_mask)
-
 /******************************************************************************
  *  types
  *****************************************************************************/
 
 typedef struct perf_event_header pe_header_t;
 
+// a pass over the pending records of a ring buffer.
+// records are read in place, and the tail of the buffer is
+// updated once, at the end of the pass.
+typedef struct perf_ring_pass_s {
+  pe_mmap_t *mmap;
+  char      *data;       // front of the data area
+  u64        data_mask;  // size of the data area - 1
+  u64        head;       // head of the buffer when the pass started
+  u64        pos;        // position of the next record
+} perf_ring_pass_t;
+
 
 /******************************************************************************
  *  interfaces
  *****************************************************************************/
 
 void perf_mmap_init();
+void perf_mmap_thread_init();
 
 pe_mmap_t* set_mmap(int perf_fd);
 void perf_unmmap(pe_mmap_t *mmap);
+size_t perf_mmap_data_size();
+
+void perf_ring_begin(perf_ring_pass_t *pass, pe_mmap_t *mmap, size_t data_size);
+pe_header_t *perf_ring_next(perf_ring_pass_t *pass);
+void perf_ring_skip_all(perf_ring_pass_t *pass);
+void perf_ring_end(perf_ring_pass_t *pass);
 
-int read_perf_buffer(event_thread_t *current, perf_mmap_data_t *mmap_info);
+void parse_perf_record(event_thread_t *current, pe_header_t *record,
+                       perf_mmap_data_t *mmap_info);
 int perf_read_event_counter(event_thread_t *current, uint64_t *val);
 
 #endif
@@ -0,0 +1,388 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// sampling overhead benchmark for the linux_perf sample handler
+//
+// Measures the cost of the control path of the linux_perf sample handler
+// (disabling and enabling the events, finding the event that overflowed
+// and its kind) with software events (cpu-clock, task-clock), so it runs
+// on machines without hardware counters.  Two variants are compared:
+//
+//   separate: events opened on their own, one ioctl per event to disable
+//             and enable them, event lookup by a linear search on the fd
+//             and event kind by comparing the event name.
+//   group:    events opened in one group, one PERF_IOC_FLAG_GROUP ioctl
+//             on the leader to disable and enable them, event lookup by
+//             an fd table and a precomputed event kind.
+//
+// Each variant runs a compute loop for a fixed time and reports the
+// number of samples, the time spent in the handler per sample and the
+// slowdown of the loop compared to a run without events.
+//
+// 'make check' in src/tool/hpcrun builds the benchmark; by hand:
+//   cc -O2 -o perf_overhead_bench perf_overhead_bench.c
+// Run:
+//   ./perf_overhead_bench [-e nevents] [-p period-ns] [-t seconds]
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#define BENCH_SIGNAL    (SIGRTMIN+4)
+#define MAX_EVENTS      16
+#define FD_TABLE_SIZE   4096
+
+enum bench_mode_e { MODE_NONE, MODE_SEPARATE, MODE_GROUP };
+
+enum bench_kind_e { KIND_GENERIC, KIND_IBS_OP, KIND_AMD_L1_DATA_ACCESS };
+
+typedef struct bench_event_s {
+  int fd;
+  int group_fd;
+  enum bench_kind_e kind;
+  const char *name;
+} bench_event_t;
+
+static bench_event_t events[MAX_EVENTS];
+static bench_event_t *fd_table[FD_TABLE_SIZE];
+static int  nevents;
+static enum bench_mode_e mode;
+
+static volatile uint64_t num_samples;
+static volatile uint64_t handler_ns;
+static volatile uint64_t num_ioctls;
+
+static const char *event_names[] = { "CPU-CLOCK", "TASK-CLOCK" };
+
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int
+bench_ioctl(int fd, unsigned long request, unsigned long arg)
+{
+  num_ioctls++;
+  return ioctl(fd, request, arg);
+}
+
+
+// same comparison as hpcrun_ev_is
+static bool
+ev_is(const char *candidate, const char *event_name)
+{
+  return candidate && (strcmp(event_name, candidate) == 0);
+}
+
+
+static void
+stop_all()
+{
+  for (int i = 0; i < nevents; i++) {
+    bench_event_t *ev = &events[i];
+    if (mode == MODE_SEPARATE) {
+      if (ev_is(ev->name, "IBS_OP")) continue;
+      bench_ioctl(ev->fd, PERF_EVENT_IOC_DISABLE, 0);
+    } else if (ev->group_fd == ev->fd) {
+      bench_ioctl(ev->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+}
+
+
+static void
+start_all()
+{
+  for (int i = 0; i < nevents; i++) {
+    bench_event_t *ev = &events[i];
+    if (mode == MODE_SEPARATE) {
+      if (ev_is(ev->name, "IBS_OP")) continue;
+      bench_ioctl(ev->fd, PERF_EVENT_IOC_ENABLE, 0);
+    } else if (ev->group_fd == ev->fd) {
+      bench_ioctl(ev->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+}
+
+
+static bench_event_t *
+find_event(int fd)
+{
+  if (mode == MODE_GROUP && fd >= 0 && fd < FD_TABLE_SIZE && fd_table[fd]) {
+    return fd_table[fd];
+  }
+  for (int i = 0; i < nevents; i++) {
+    if (events[i].fd == fd) return &events[i];
+  }
+  return NULL;
+}
+
+
+static void
+restart_event(int fd)
+{
+  bench_ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  bench_ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+}
+
+
+static void
+handler(int sig, siginfo_t *info, void *context)
+{
+  uint64_t start = now_ns();
+
+  stop_all();
+
+  bench_event_t *ev = find_event(info->si_fd);
+  if (ev) {
+    bool special;
+    if (mode == MODE_SEPARATE) {
+      special = ev_is(ev->name, "IBS_OP")
+        || ev_is(ev->name, "AMD_L1_DATA_ACCESS");
+    } else {
+      special = (ev->kind != KIND_GENERIC);
+    }
+    if (!special) num_samples++;
+    restart_event(ev->fd);
+  }
+
+  start_all();
+
+  handler_ns += now_ns() - start;
+}
+
+
+static int
+open_event(int i, long period, int group_fd)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = PERF_TYPE_SOFTWARE;
+  attr.config         = (i % 2 == 0) ? PERF_COUNT_SW_CPU_CLOCK
+                                     : PERF_COUNT_SW_TASK_CLOCK;
+  attr.sample_period  = period;
+  attr.sample_type    = PERF_SAMPLE_IP;
+  attr.disabled       = 1;
+  attr.wakeup_events  = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+  if (fd < 0) return -1;
+
+  struct f_owner_ex owner;
+  owner.type = F_OWNER_TID;
+  owner.pid  = syscall(SYS_gettid);
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_ASYNC);
+  fcntl(fd, F_SETSIG, BENCH_SIGNAL);
+  fcntl(fd, F_SETOWN_EX, &owner);
+
+  return fd;
+}
+
+
+static int
+open_events(long period)
+{
+  int leader = -1;
+  memset(fd_table, 0, sizeof(fd_table));
+  for (int i = 0; i < nevents; i++) {
+    bench_event_t *ev = &events[i];
+    ev->name     = event_names[i % 2];
+    ev->kind     = KIND_GENERIC;
+    ev->group_fd = -1;
+    ev->fd       = open_event(i, period, (mode == MODE_GROUP) ? leader : -1);
+    if (ev->fd < 0) {
+      fprintf(stderr, "perf_event_open failed: %s\n", strerror(errno));
+      return -1;
+    }
+    if (mode == MODE_GROUP) {
+      if (leader < 0) leader = ev->fd;
+      ev->group_fd = leader;
+    }
+    if (ev->fd < FD_TABLE_SIZE) fd_table[ev->fd] = ev;
+  }
+  return 0;
+}
+
+
+static void
+close_events()
+{
+  for (int i = nevents - 1; i >= 0; i--) {
+    close(events[i].fd);
+  }
+}
+
+
+// the workload: returns the number of loop iterations done in 'seconds'
+static uint64_t
+workload(double seconds)
+{
+  uint64_t iters = 0;
+  volatile double x = 1.0;
+  uint64_t end = now_ns() + (uint64_t) (seconds * 1e9);
+  do {
+    for (int i = 0; i < 1000; i++) {
+      x = x * 1.0000001 + 0.0000001;
+    }
+    iters++;
+  } while (now_ns() < end);
+  return iters;
+}
+
+
+static uint64_t
+run(enum bench_mode_e m, long period, double seconds)
+{
+  mode        = m;
+  num_samples = 0;
+  handler_ns  = 0;
+  num_ioctls  = 0;
+
+  if (mode != MODE_NONE) {
+    if (open_events(period) < 0) exit(1);
+    for (int i = 0; i < nevents; i++) {
+      restart_event(events[i].fd);
+    }
+    start_all();
+    num_ioctls = 0;
+  }
+
+  uint64_t iters = workload(seconds);
+
+  if (mode != MODE_NONE) {
+    stop_all();
+    close_events();
+  }
+  return iters;
+}
+
+
+static void
+report(const char *name, uint64_t iters, uint64_t base, double seconds)
+{
+  double slowdown = (iters > 0) ? ((double) base / iters - 1.0) * 100.0 : 0.0;
+  uint64_t n = num_samples;
+  printf("%-10s %10lu %12.0f %12.0f %12.1f %10.2f%%\n", name,
+         (unsigned long) n, n / seconds,
+         n ? (double) handler_ns / n : 0.0,
+         n ? (double) num_ioctls / n : 0.0,
+         slowdown);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  long   period  = 100000;   // ns
+  double seconds = 2.0;
+  int    opt;
+
+  nevents = 4;
+  while ((opt = getopt(argc, argv, "e:p:t:")) != -1) {
+    switch (opt) {
+    case 'e': nevents = atoi(optarg); break;
+    case 'p': period  = atol(optarg); break;
+    case 't': seconds = atof(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-e nevents] [-p period-ns] [-t seconds]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (nevents < 1 || nevents > MAX_EVENTS || period <= 0 || seconds <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = handler;
+  sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(BENCH_SIGNAL, &sa, NULL);
+
+  printf("%d software events, period %ld ns, %.1f s per run\n",
+         nevents, period, seconds);
+  printf("%-10s %10s %12s %12s %12s %11s\n", "mode", "samples",
+         "samples/s", "ns/sample", "ioctl/sample", "slowdown");
+
+  uint64_t base = run(MODE_NONE, period, seconds);
+
+  uint64_t iters = run(MODE_SEPARATE, period, seconds);
+  report("separate", iters, base, seconds);
+
+  iters = run(MODE_GROUP, period, seconds);
+  report("group", iters, base, seconds);
+
+  return 0;
+}
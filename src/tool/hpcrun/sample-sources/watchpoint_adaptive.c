@@ -0,0 +1,188 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Adaptive sampling period and watchpoint count, see watchpoint_adaptive.h.
+//
+
+#include <stdlib.h>
+
+#include <messages/messages.h>
+
+#include "watchpoint_support.h"
+#include "watchpoint_counters.h"
+#include "watchpoint_adaptive.h"
+#include "perf/perf-util.h"
+
+// hysteresis around the target so the controller does not oscillate
+#define OVER_TARGET_FACTOR  1.25
+#define UNDER_TARGET_FACTOR 0.5
+
+#define DEFAULT_PERIOD_SCALE_MAX 64
+
+extern __thread int wait_threshold;
+extern __thread uint64_t sample_count;
+
+typedef struct WPAdaptiveState {
+  uint64_t windowStart;   // rdtsc() at the start of the window
+  uint64_t sampleCycles;  // cycles in the sample handler this window
+  uint64_t trapCycles;    // cycles in the trap handler this window
+  uint32_t samples;
+  uint32_t periodScale;   // period multiplier in effect, a power of two
+  int activeWP;           // watchpoints armed per sample
+  int maxWP;
+} WPAdaptiveState_t;
+
+double wpAdaptiveTarget = 0;
+
+static bool adaptSlots = false;
+static uint32_t maxPeriodScale = DEFAULT_PERIOD_SCALE_MAX;
+static int periodUpCtr = -1, periodDownCtr = -1, slotsUpCtr = -1, slotsDownCtr = -1;
+
+static __thread WPAdaptiveState_t adaptive = {.periodScale = 1};
+
+static inline void CounterInc(int id) {
+  if (id >= 0)
+    WPCounterInc(id);
+}
+
+void WPAdaptiveProcessInit(bool slots) {
+  char *target = getenv("HPCRUN_WP_OVERHEAD_TARGET");
+  if (target == NULL || *target == '\0')
+    return;
+  double percent = strtod(target, NULL);
+  if (percent <= 0 || percent >= 100) {
+    EMSG("WATCHPOINT: ignoring HPCRUN_WP_OVERHEAD_TARGET=%s, expected a percentage", target);
+    return;
+  }
+  wpAdaptiveTarget = percent / 100;
+  adaptSlots = slots;
+
+  char *scaleMax = getenv("HPCRUN_WP_PERIOD_SCALE_MAX");
+  if (scaleMax && strtoul(scaleMax, NULL, 10) > 0)
+    maxPeriodScale = strtoul(scaleMax, NULL, 10);
+
+  periodUpCtr = WPCounterRegister("adaptivePeriodUp");
+  periodDownCtr = WPCounterRegister("adaptivePeriodDown");
+  slotsUpCtr = WPCounterRegister("adaptiveSlotsUp");
+  slotsDownCtr = WPCounterRegister("adaptiveSlotsDown");
+}
+
+void WPAdaptiveThreadInit(int maxWP) {
+  adaptive.windowStart = rdtsc();
+  adaptive.sampleCycles = 0;
+  adaptive.trapCycles = 0;
+  adaptive.samples = 0;
+  adaptive.periodScale = 1;
+  adaptive.activeWP = maxWP;
+  adaptive.maxWP = maxWP;
+}
+
+int WPAdaptiveActiveWP(void) {
+  // threads that never went through WPAdaptiveThreadInit use every slot
+  return adaptive.activeWP ? adaptive.activeWP : wpConfig.maxWP;
+}
+
+static void SetPeriodScale(WPAdaptiveState_t *st, uint32_t scale) {
+  TMSG(WATCHPOINT, "adaptive: period scale %u -> %u", st->periodScale, scale);
+  CounterInc(scale > st->periodScale ? periodUpCtr : periodDownCtr);
+  st->periodScale = scale;
+  linux_perf_set_period_scale(scale);
+}
+
+static void SetActiveWP(WPAdaptiveState_t *st, int n) {
+  TMSG(WATCHPOINT, "adaptive: watchpoints per sample %d -> %d", st->activeWP, n);
+  CounterInc(n > st->activeWP ? slotsUpCtr : slotsDownCtr);
+  st->activeWP = n;
+  WatchpointThreadSetActiveSlots(n);
+}
+
+// One control step at the end of a window.  Traps cost more than
+// samples but only watchpoints drive them, so when they dominate drop a
+// watchpoint first; otherwise sample less often.  Going back, restore
+// the period before the watchpoints.
+static void Step(WPAdaptiveState_t *st) {
+  uint64_t now = rdtsc();
+  uint64_t elapsed = now - st->windowStart;
+  double overhead = elapsed ? (double) (st->sampleCycles + st->trapCycles) / elapsed : 0;
+  uint32_t scale = st->periodScale;
+  int activeWP = st->activeWP;
+
+  if (overhead > wpAdaptiveTarget * OVER_TARGET_FACTOR) {
+    if (adaptSlots && st->activeWP > 1 && st->trapCycles > st->sampleCycles)
+      SetActiveWP(st, st->activeWP - 1);
+    else if (st->periodScale < maxPeriodScale)
+      SetPeriodScale(st, st->periodScale * 2);
+  } else if (overhead < wpAdaptiveTarget * UNDER_TARGET_FACTOR) {
+    if (st->periodScale > 1)
+      SetPeriodScale(st, st->periodScale / 2);
+    else if (adaptSlots && st->activeWP < st->maxWP)
+      SetActiveWP(st, st->activeWP + 1);
+  }
+
+  // let the clients that wait after a change (WAIT_THRESHOLD) settle
+  if (scale != st->periodScale || activeWP != st->activeWP)
+    wait_threshold = sample_count + CHANGE_THRESHOLD;
+
+  st->windowStart = now;
+  st->sampleCycles = 0;
+  st->trapCycles = 0;
+  st->samples = 0;
+}
+
+void WPAdaptiveNoteSample(uint64_t cycles) {
+  if (!WPAdaptiveEnabled())
+    return;
+  adaptive.sampleCycles += cycles;
+  if (++adaptive.samples >= CHANGE_THRESHOLD)
+    Step(&adaptive);
+}
+
+void WPAdaptiveNoteTrap(uint64_t cycles) {
+  if (!WPAdaptiveEnabled())
+    return;
+  adaptive.trapCycles += cycles;
+}
@@ -0,0 +1,93 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Adaptive sampling period and watchpoint count.
+//
+// With HPCRUN_WP_OVERHEAD_TARGET=<percent> each thread measures the
+// cycles it spends in the sample and trap handlers over windows of
+// CHANGE_THRESHOLD samples and steers that share of its run time toward
+// the target.  Above the target it first gives up a watchpoint per
+// sample when the traps dominate, otherwise doubles the period of its
+// precise sampling events (up to HPCRUN_WP_PERIOD_SCALE_MAX times the
+// command line period); well below the target it undoes those steps.
+//
+// Volumes stay unbiased: every sample is weighted by the period it was
+// taken with, and SampleData_t records that period and the number of
+// watchpoints armed for it so the trap callbacks scale by the values in
+// effect at arming time.
+//
+
+
+#ifndef __WATCHPOINT_ADAPTIVE_H__
+#define __WATCHPOINT_ADAPTIVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern double wpAdaptiveTarget; // fraction of run time, 0 if disabled
+
+static inline bool WPAdaptiveEnabled(void) {
+  return wpAdaptiveTarget > 0;
+}
+
+// adaptSlots: whether the controller may change the number of watchpoints
+// per sample; clients that manage the slots themselves pass false.
+extern void WPAdaptiveProcessInit(bool adaptSlots);
+extern void WPAdaptiveThreadInit(int maxWP);
+
+// watchpoints to arm per sample on this thread
+extern int WPAdaptiveActiveWP(void);
+
+// Account the cycles of one sample or trap handler.  Every
+// CHANGE_THRESHOLD samples this runs one step of the controller, which
+// may retarget this thread's events and watchpoints; call it from the
+// owning thread only.
+extern void WPAdaptiveNoteSample(uint64_t cycles);
+extern void WPAdaptiveNoteTrap(uint64_t cycles);
+
+#endif
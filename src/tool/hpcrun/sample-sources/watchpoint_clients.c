@@ -90,6 +90,8 @@
 #include <hpcrun/threadmgr.h>
 #include <hpcrun/files.h>
 #include <hpcrun/env.h>
+#include <hpcrun/cct/cct_topk.h>
+#include <hpcrun/cct/cct_prune.h>
 
 #include <sample-sources/blame-shift/blame-shift.h>
 #include <utilities/tokenize.h>
@@ -128,9 +130,15 @@
 #include <sys/types.h>
 #include <sys/syscall.h>
 
+#include <hpcrun/hpcrun_topology.h>
 #include <hpcrun/unwind/x86-family/x86-move.h>
 #include <utilities/arch/context-pc.h>
 #include "watchpoint_support.h"
+#include "watchpoint_policy.h"
+#include "watchpoint_counters.h"
+#include "watchpoint_adaptive.h"
+#include "watchpoint_ipc.h"
+#include "watchpoint_decode_cache.h"
 #include <unwind/x86-family/x86-misc.h>
 #include "perf/perf-util.h"
 #include <hpcrun/handling_sample.h>
@@ -152,6 +160,20 @@
 #endif
 
 #define WAIT_THRESHOLD 10
+
+// Period the sample was taken with; the adaptive controller may have scaled
+// it away from the configured metric period.
+static inline uint64_t SamplePeriod(perf_mmap_data_t *mmap_data, int sampledMetricId) {
+  return mmap_data->period ? mmap_data->period : hpcrun_id2metric(sampledMetricId)->period;
+}
+
+// Weight of one communication trap, using the period and watchpoint count
+// in effect when the trapping sample was armed.
+static inline double CommTrapIncrement(SampleData_t *sd, long defaultPeriod) {
+  int numWP = sd->numWatchpoints ? sd->numWatchpoints : wpConfig.maxWP;
+  uint64_t period = sd->samplingPeriod ? sd->samplingPeriod : defaultPeriod;
+  return (double) CACHE_LINE_SZ/MAX_WP_LENGTH / numWP * period;
+}
 extern bool amd_ibs_flag;
 int used_wp_count = 0;
 int max_used_wp_count = 0;
@@ -171,8 +193,8 @@ MonitoredNodeStruct_t MonitoredNode;
 
 //int wp_user_list[MAX_WP_SLOTS];
 #define SAMPLES_POST_FULL_RESET_VAL (1)
-extern int globalWPIsUsers[MAX_WP_SLOTS];
-extern int L3GlobalWPIsUsers[MAX_WP_SLOTS];
+extern int globalWPIsUsers[MAX_ANY_WP_SLOTS];
+extern int L3GlobalWPIsUsers[MAX_ANY_WP_SLOTS];
 
 int red_metric_id = -1;
 int redApprox_metric_id = -1;
@@ -232,7 +254,7 @@ __thread int mem_access_sample = 0;
 __thread int valid_mem_access_sample = 0;
 //uint64_t global_store_count = 0;
 uint64_t sample_count_counter = 0;
-extern uint64_t numWatchpointArmingAttempt[MAX_WP_SLOTS];
+extern uint64_t numWatchpointArmingAttempt[MAX_ANY_WP_SLOTS];
 
 #ifdef REUSE_HISTO
 bool reuse_output_trace = false;
@@ -306,13 +328,6 @@ void SetupWatermarkMetric(int metricId){
 static dso_info_t * hpcrunLM;
 static dso_info_t * libmonitorLM;
 
-typedef struct WPStats{
-  long numImpreciseSamples __attribute__((aligned(CACHE_LINE_SZ)));
-  long numWatchpointsSet;
-  char dummy[CACHE_LINE_SZ];
-}WPStats_t;
-
-__thread WPStats_t wpStats;
 __thread uint64_t prev_event_count = 0;
 uint64_t periodic_l2_load_miss_count = 0;
 uint64_t next_periodic_l2_load_miss_count = 0;
@@ -379,41 +394,12 @@ __thread uint64_t prev_timestamp = 0;
 __thread int64_t lastTime = 0;
 __thread int64_t storeLastTime = 0;
 __thread int64_t storeOlderTime = 0;
-__thread uint64_t writtenBytes = 0;
-__thread uint64_t loadedBytes = 0;
-__thread uint64_t usedBytes = 0;
-__thread uint64_t deadBytes = 0;
-__thread uint64_t oldBytes = 0;
-__thread uint64_t oldAppxBytes = 0;
-__thread uint64_t newBytes = 0;
-__thread uint64_t accessedIns = 0;
-__thread uint64_t falseWWIns = 0;
-__thread uint64_t falseWRIns = 0;
-__thread uint64_t falseRWIns = 0;
-__thread uint64_t trueWWIns = 0;
-__thread uint64_t trueWRIns = 0;
-__thread uint64_t trueRWIns = 0;
-__thread uint64_t reuse = 0;
-__thread uint64_t reuseTemporal = 0;
-__thread uint64_t reuseSpatial = 0;
-__thread uint64_t mtReuse = 0;
-__thread uint64_t mtReuseTemporal = 0;
-__thread uint64_t mtReuseSpatial = 0;
 
 // ComDetective stats begin
-__thread uint64_t fs_num = 0;
-__thread uint64_t inter_core_fs_num = 0;
-__thread uint64_t ts_num = 0;
-__thread uint64_t inter_core_ts_num = 0;
-__thread uint64_t as_num = 0;
-__thread uint64_t inter_core_as_num = 0;
-__thread uint64_t line_transfer_num = 0;
 __thread uint64_t sample_count = 0;
 __thread uint64_t valid_sample_count = 1;
 __thread uint64_t valid_sample_count1 = 0;
 __thread uint64_t valid_sample_count2 = 0;
-__thread uint64_t trap_count = 0;
-__thread uint64_t wp_arming_count = 0;
 // ComDetective stats end
 
 // Some stats
@@ -483,6 +469,63 @@ int hashCode(void * key) {
   return (uint64_t) key % 54121 % HASHTABLESIZE;
 }
 
+// Contexts this thread published on the bulletin boards or in
+// gSharedData.  Each holds a pin, taken before the context becomes
+// visible, that is dropped once the entry is gone: its slot was
+// overwritten or it expired.  A reader pins the context right after it
+// copied the entry (see SetWatchPointSample), so an entry found gone
+// by one sweep is unpinned only by the next one, a sample later.
+#define WP_PUBLISHED_MAX 64
+
+typedef struct WPPublished {
+  cct_node_t * node;
+  cct_node_t * const volatile * slotNode;
+  const volatile uint64_t * slotTime;
+  uint64_t time;
+  uint64_t lifetime; // UINT64_MAX: until overwritten
+  bool gone;
+} WPPublished_t;
+
+static __thread WPPublished_t wpPublished[WP_PUBLISHED_MAX];
+static __thread int wpNumPublished = 0;
+
+static void WPPublishedSweep(uint64_t now) {
+  int n = 0;
+  for (int i = 0; i < wpNumPublished; i++) {
+    WPPublished_t *p = &wpPublished[i];
+    if (p->gone) {
+      hpcrun_cct_unpin(p->node);
+      continue;
+    }
+    p->gone = (*p->slotNode != p->node) || (*p->slotTime != p->time)
+      || (now > p->time && now - p->time > p->lifetime);
+    wpPublished[n++] = *p;
+  }
+  wpNumPublished = n;
+}
+
+// Pins node, which is about to be stored with the given time in the
+// entry whose node and time fields are slotNode and slotTime.
+static void WPPublish(cct_node_t * node, cct_node_t * const volatile * slotNode,
+    const volatile uint64_t * slotTime, uint64_t time, uint64_t lifetime) {
+  if (node == NULL)
+    return;
+  WPPublishedSweep(rdtsc());
+  if (wpNumPublished == WP_PUBLISHED_MAX) {
+    // all still visible: the oldest keeps its pin for good
+    memmove(&wpPublished[0], &wpPublished[1], sizeof(WPPublished_t) * (WP_PUBLISHED_MAX - 1));
+    wpNumPublished--;
+  }
+  hpcrun_cct_pin(node);
+  WPPublished_t *p = &wpPublished[wpNumPublished++];
+  p->node = node;
+  p->slotNode = slotNode;
+  p->slotTime = slotTime;
+  p->time = time;
+  p->lifetime = lifetime;
+  p->gone = false;
+}
+
 #ifdef MULTITHREAD_REUSE_HISTO
 
 ReuseBBEntry_t getEntryFromReuseBulletinBoard(void * cacheLineBaseAddress, int * item_not_found) {
@@ -502,6 +545,8 @@ void reuseHashInsert(ReuseBBEntry_t item) {
   {
     uint64_t theCounter = reuseBulletinBoard.counter;
     if(__sync_bool_compare_and_swap(&reuseBulletinBoard.counter, theCounter, theCounter+1)){
+      WPPublish(item.node, &reuseBulletinBoard.hashTable[hashIndex].node,
+          &reuseBulletinBoard.hashTable[hashIndex].time, item.time, UINT64_MAX);
       reuseBulletinBoard.hashTable[hashIndex] = item;
       __sync_synchronize();
       reuseBulletinBoard.counter++;
@@ -946,9 +991,9 @@ METHOD_FN(thread_init)
 METHOD_FN(thread_init_action)
 {
   TMSG(WATCHPOINT, "register thread");
-  wpStats.numImpreciseSamples = 0;
-  wpStats.numWatchpointsSet = 0;
+  WPCounterThreadInit();
   WatchpointThreadInit(theWPConfig->wpCallback);
+  WPAdaptiveThreadInit(wpConfig.maxWP);
   TMSG(WATCHPOINT, "register thread ok");
 
 }
@@ -972,50 +1017,52 @@ METHOD_FN(start)
 static void ClientTermination(){
   // Cleanup the watchpoint data
   //fprintf(stderr, "ClientTermination is executed here\n");
-  hpcrun_stats_num_samples_imprecise_inc(wpStats.numImpreciseSamples);
-  hpcrun_stats_num_watchpoints_set_inc(wpStats.numWatchpointsSet);
+  hpcrun_stats_num_samples_imprecise_inc(WPCounterThreadValue(WP_CTR_IMPRECISE_SAMPLES));
+  hpcrun_stats_num_watchpoints_set_inc(WPCounterThreadValue(WP_CTR_WATCHPOINTS_SET));
   WatchpointThreadTerminate();
+  hpcrun_stats_watchpoint_arm_latency_inc(WPCounterThreadValue(WP_CTR_ARMS), WPCounterThreadValue(WP_CTR_ARM_CYCLES));
+  hpcrun_stats_watchpoint_disarm_latency_inc(WPCounterThreadValue(WP_CTR_DISARMS), WPCounterThreadValue(WP_CTR_DISARM_CYCLES));
   //fprintf(stderr, "after WatchpointThreadTerminate\n");
   switch (theWPConfig->id) {
     case WP_DEADSPY:
-      hpcrun_stats_num_writtenBytes_inc(writtenBytes);
-      hpcrun_stats_num_usedBytes_inc(usedBytes);
-      hpcrun_stats_num_deadBytes_inc(deadBytes);
+      hpcrun_stats_num_writtenBytes_inc(WPCounterThreadValue(WP_CTR_WRITTEN_BYTES));
+      hpcrun_stats_num_usedBytes_inc(WPCounterThreadValue(WP_CTR_USED_BYTES));
+      hpcrun_stats_num_deadBytes_inc(WPCounterThreadValue(WP_CTR_DEAD_BYTES));
       break;
     case WP_REDSPY:
-      hpcrun_stats_num_writtenBytes_inc(writtenBytes);
-      hpcrun_stats_num_newBytes_inc(newBytes);
-      hpcrun_stats_num_oldBytes_inc(oldBytes);
-      hpcrun_stats_num_oldAppxBytes_inc(oldAppxBytes);
+      hpcrun_stats_num_writtenBytes_inc(WPCounterThreadValue(WP_CTR_WRITTEN_BYTES));
+      hpcrun_stats_num_newBytes_inc(WPCounterThreadValue(WP_CTR_NEW_BYTES));
+      hpcrun_stats_num_oldBytes_inc(WPCounterThreadValue(WP_CTR_OLD_BYTES));
+      hpcrun_stats_num_oldAppxBytes_inc(WPCounterThreadValue(WP_CTR_OLD_APPX_BYTES));
       break;
     case WP_LOADSPY:
-      hpcrun_stats_num_loadedBytes_inc(loadedBytes);
-      hpcrun_stats_num_newBytes_inc(newBytes);
-      hpcrun_stats_num_oldBytes_inc(oldBytes);
-      hpcrun_stats_num_oldAppxBytes_inc(oldAppxBytes);
+      hpcrun_stats_num_loadedBytes_inc(WPCounterThreadValue(WP_CTR_LOADED_BYTES));
+      hpcrun_stats_num_newBytes_inc(WPCounterThreadValue(WP_CTR_NEW_BYTES));
+      hpcrun_stats_num_oldBytes_inc(WPCounterThreadValue(WP_CTR_OLD_BYTES));
+      hpcrun_stats_num_oldAppxBytes_inc(WPCounterThreadValue(WP_CTR_OLD_APPX_BYTES));
       break;
     case WP_TEMPORAL_REUSE:
-      hpcrun_stats_num_accessedIns_inc(accessedIns);
-      hpcrun_stats_num_reuse_inc(reuse);
+      hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+      hpcrun_stats_num_reuse_inc(WPCounterThreadValue(WP_CTR_REUSE));
       break;
     case WP_SPATIAL_REUSE:
-      hpcrun_stats_num_accessedIns_inc(accessedIns);
-      hpcrun_stats_num_reuse_inc(reuse);
+      hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+      hpcrun_stats_num_reuse_inc(WPCounterThreadValue(WP_CTR_REUSE));
       break;
     case WP_FALSE_SHARING:
     case WP_IPC_FALSE_SHARING:
-      hpcrun_stats_num_accessedIns_inc(accessedIns);
-      hpcrun_stats_num_falseWWIns_inc(falseWWIns);
-      hpcrun_stats_num_falseRWIns_inc(falseRWIns);
-      hpcrun_stats_num_falseWRIns_inc(falseWRIns);
+      hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+      hpcrun_stats_num_falseWWIns_inc(WPCounterThreadValue(WP_CTR_FALSE_WW_INS));
+      hpcrun_stats_num_falseRWIns_inc(WPCounterThreadValue(WP_CTR_FALSE_RW_INS));
+      hpcrun_stats_num_falseWRIns_inc(WPCounterThreadValue(WP_CTR_FALSE_WR_INS));
       //fprintf(stderr, "sample_count: %ld\n", sample_count);
       break;
     case WP_TRUE_SHARING:
     case WP_IPC_TRUE_SHARING:
-      hpcrun_stats_num_accessedIns_inc(accessedIns);
-      hpcrun_stats_num_trueWWIns_inc(trueWWIns);
-      hpcrun_stats_num_trueRWIns_inc(trueRWIns);
-      hpcrun_stats_num_trueWRIns_inc(trueWRIns);
+      hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+      hpcrun_stats_num_trueWWIns_inc(WPCounterThreadValue(WP_CTR_TRUE_WW_INS));
+      hpcrun_stats_num_trueRWIns_inc(WPCounterThreadValue(WP_CTR_TRUE_RW_INS));
+      hpcrun_stats_num_trueWRIns_inc(WPCounterThreadValue(WP_CTR_TRUE_WR_INS));
       break;
     case WP_REUSE:
       {
@@ -1043,9 +1090,9 @@ static void ClientTermination(){
         //close the trace output
         CloseWitchTraceOutput();
 #endif
-        hpcrun_stats_num_accessedIns_inc(accessedIns);
-        hpcrun_stats_num_reuseTemporal_inc(reuseTemporal);
-        hpcrun_stats_num_reuseSpatial_inc(reuseSpatial);
+        hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+        hpcrun_stats_num_reuseTemporal_inc(WPCounterThreadValue(WP_CTR_REUSE_TEMPORAL));
+        hpcrun_stats_num_reuseSpatial_inc(WPCounterThreadValue(WP_CTR_REUSE_SPATIAL));
       }   break;
     case WP_AMD_REUSE:
     case WP_AMD_REUSETRACKER:
@@ -1092,21 +1139,21 @@ uint64_t val[3];
 	fprintf(stderr, "mem_access_sample: %ld\n", mem_access_sample);
 	fprintf(stderr, "valid_mem_access_sample: %ld\n", valid_mem_access_sample);
 #endif
-        hpcrun_stats_num_accessedIns_inc(accessedIns);
-        hpcrun_stats_num_reuseTemporal_inc(mtReuseTemporal);
-        hpcrun_stats_num_reuseSpatial_inc(mtReuseSpatial);
+        hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+        hpcrun_stats_num_reuseTemporal_inc(WPCounterThreadValue(WP_CTR_MT_REUSE_TEMPORAL));
+        hpcrun_stats_num_reuseSpatial_inc(WPCounterThreadValue(WP_CTR_MT_REUSE_SPATIAL));
       }   break;
     case WP_AMD_COMM:
     case WP_ALL_SHARING:
     case WP_COMDETECTIVE:
     case WP_IPC_ALL_SHARING:
-      hpcrun_stats_num_accessedIns_inc(accessedIns);
-      hpcrun_stats_num_falseWWIns_inc(falseWWIns);
-      hpcrun_stats_num_falseRWIns_inc(falseRWIns);
-      hpcrun_stats_num_falseWRIns_inc(falseWRIns);
-      hpcrun_stats_num_trueWWIns_inc(trueWWIns);
-      hpcrun_stats_num_trueRWIns_inc(trueRWIns);
-      hpcrun_stats_num_trueWRIns_inc(trueWRIns);
+      hpcrun_stats_num_accessedIns_inc(WPCounterThreadValue(WP_CTR_ACCESSED_INS));
+      hpcrun_stats_num_falseWWIns_inc(WPCounterThreadValue(WP_CTR_FALSE_WW_INS));
+      hpcrun_stats_num_falseRWIns_inc(WPCounterThreadValue(WP_CTR_FALSE_RW_INS));
+      hpcrun_stats_num_falseWRIns_inc(WPCounterThreadValue(WP_CTR_FALSE_WR_INS));
+      hpcrun_stats_num_trueWWIns_inc(WPCounterThreadValue(WP_CTR_TRUE_WW_INS));
+      hpcrun_stats_num_trueRWIns_inc(WPCounterThreadValue(WP_CTR_TRUE_RW_INS));
+      hpcrun_stats_num_trueWRIns_inc(WPCounterThreadValue(WP_CTR_TRUE_WR_INS));
 #if 0
       fprintf(stderr, "original_sample_count: %ld\n", original_sample_count);
       fprintf(stderr, "valid_sample_count: %ld\n", valid_sample_count);
@@ -1126,141 +1173,43 @@ uint64_t val[3];
 METHOD_FN(thread_fini_action)
 {
   TMSG(WATCHPOINT, "unregister thread");
+  WPCounterThreadFini();
 }
 
 #define N 100000
-cct_node_t *topNNode[N]={NULL};
-
-  static void
-TopN(cct_node_t* node, cct_op_arg_t arg, size_t level)
-{
-  int i, t;
-  uint64_t min;
-  int metricID = (int)arg;
-  if (node) {
-    metric_set_t *set = hpcrun_get_metric_set(node);
-    if (!set) return;
-    hpcrun_metricVal_t *loc = hpcrun_metric_set_loc(set, metricID);
-    if (!loc) return;
-
-    uint64_t val = loc->i;
-    if (val == 0) return;
-
-    for (i=0; i<N; i++) {
-      if (!topNNode[i]) {
-        topNNode[i] = node;
-        break;
-      }
-    }
-    // if no empty slot
-    if (i == N) {
-      min = ULLONG_MAX;
-      for (i=0; i<N; i++) {
-        metric_set_t *seti = hpcrun_get_metric_set(topNNode[i]);
-        hpcrun_metricVal_t *loci = hpcrun_metric_set_loc(seti, metricID);
-        if (loci->i < min) {
-          t = i;
-          min = loci->i;
-        }
-      }
-      if (val > min) topNNode[t] = node;
-    }
-  }
-}
 
   static void
 PrintTopN(int metricID)
 {
   FILE *fd;
   char default_path[PATH_MAX];
+  char log_path[PATH_MAX];
   thread_data_t *td = hpcrun_get_thread_data();
   cct_node_t *root = td->core_profile_trace_data.epoch->csdata.tree_root;
   //TODO: partial? cct_node_t *partial = td->core_profile_trace_data.epoch->csdata.partial_unw_root;
 
-  // trave root first and then partial second
-  hpcrun_cct_walk_node_1st(root, TopN, (void *) metricID);
-
-  int i, j;
-  for (i=0; i<N; i++) {
-    cct_node_t *node1 = topNNode[i];
-    if (!node1) goto end;
-    metric_set_t *set1 = hpcrun_get_metric_set(node1);
-    hpcrun_metricVal_t *loc1 = hpcrun_metric_set_loc(set1, metricID);
-    uint64_t val1 = loc1->i;
-    for (j = i+1; j<N; j++) {
-      cct_node_t *node2 = topNNode[j];
-      if (!node2) break;
-      metric_set_t *set2 = hpcrun_get_metric_set(node2);
-      hpcrun_metricVal_t *loc2 = hpcrun_metric_set_loc(set2, metricID);
-      uint64_t val2 = loc2->i;
-
-      if (val2 > val1) {
-        cct_node_t *tmp = topNNode[i];
-        topNNode[i] = topNNode[j];
-        topNNode[j] = tmp;
-        val1 = val2;
-      }
-    }
-  }
-end:
-  ;
+  cct_topk_t topN;
+  hpcrun_cct_topk_init(&topN, metricID, N);
+  topN.normalizer = WPCounterThreadValue(WP_CTR_DEAD_BYTES);
+  hpcrun_cct_topk_collect(root, &topN, 1);
+  hpcrun_cct_topk_sort(&topN);
+
   char *path = getenv(HPCRUN_OUT_PATH);
   if (path == NULL || strlen(path) == 0) {
     sprintf(default_path, "./hpctoolkit-%s-measurements", hpcrun_files_executable_name());
     path = default_path;
   }
-  sprintf(path, "%s/%s", path, "topN.log");
-
-  fd = fopen(path, "a+");
+  snprintf(log_path, sizeof(log_path), "%s/%s", path, "topN.log");
 
-  int libmonitorId, libhpcrunId;
-  // print loadmodule info first
-  fprintf (fd, "<LOADMODULES>\n");
-  hpcrun_loadmap_t *current_loadmap = td->core_profile_trace_data.epoch->loadmap;
-  for (load_module_t* lm_src = current_loadmap->lm_end;
-      (lm_src); lm_src = lm_src->prev)
-  {
-    if (strstr(lm_src->name, "libmonitor")) libmonitorId = lm_src->id;
-    if (strstr(lm_src->name, "libhpcrun")) libhpcrunId = lm_src->id;
-    fprintf(fd, "%d:%p:%s\n", lm_src->id, (void*) lm_src->dso_info->start_to_ref_dist, lm_src->name);
-  }
-  fprintf (fd, "</LOADMODULES>\n");
-  fprintf (fd, "<TOPN>\n");
-  // sort the top N from high to low
-  for (i=0; i<N; i++) {
-    cct_node_t *node = topNNode[i];
-    if (!node) break;
-    metric_set_t *set = hpcrun_get_metric_set(node);
-    hpcrun_metricVal_t *loc = hpcrun_metric_set_loc(set, metricID);
-    uint64_t val = loc->i;
-    fprintf(fd, "%lu:%lf:", val, (double)val/deadBytes);
-    //FIXME: +1 not needed
-    fprintf(fd, "%d-%p", hpcrun_cct_addr(node)->ip_norm.lm_id, (void*) (hpcrun_cct_addr(node)->ip_norm.lm_ip+1));
-    node = hpcrun_cct_parent(node);
-    bool lastWasSeparator=false;
-    while (node) {
-      if (hpcrun_cct_addr(node)->ip_norm.lm_id == 0){
-        break;
-      }
-      if (hpcrun_cct_addr(node)->ip_norm.lm_id !=  libmonitorId && hpcrun_cct_addr(node)->ip_norm.lm_id != libhpcrunId) {
-        // if last node was a separator, +1 here
-        if( lastWasSeparator ) {
-          //FIXME: +1 not needed
-          fprintf(fd, ",%d-%p", hpcrun_cct_addr(node)->ip_norm.lm_id, (void*)(hpcrun_cct_addr(node)->ip_norm.lm_ip+1));
-          lastWasSeparator = false;
-        } else
-          fprintf(fd, ",%d-%p", hpcrun_cct_addr(node)->ip_norm.lm_id, (void*) hpcrun_cct_addr(node)->ip_norm.lm_ip);
-      }
-      else if (hpcrun_cct_addr(node)->ip_norm.lm_id == libhpcrunId) {
-        fprintf(fd, ",SEP");
-        lastWasSeparator = true;
-      } else ;
-      node = hpcrun_cct_parent(node);
-    }
-    fprintf(fd, "\n");
+  fd = fopen(log_path, "a+");
+  if (!fd) {
+    EMSG("could not open %s", log_path);
+    hpcrun_cct_topk_fini(&topN);
+    return;
   }
-  fprintf (fd, "</TOPN>\n");
+  hpcrun_cct_topk_fprint(fd, td->core_profile_trace_data.epoch->loadmap, &topN, 1);
   fclose (fd);
+  hpcrun_cct_topk_fini(&topN);
 }
 
   static void
@@ -1294,6 +1243,8 @@ METHOD_FN(shutdown)
   TMSG(WATCHPOINT, "shutdown");
 
   METHOD_CALL(self, stop); // make sure stop has been called
+  WPPolicyPrintSummary();
+  WPCounterWriteJSON("final");
   self->state = UNINIT;
 }
 
@@ -1337,12 +1288,56 @@ int context_sample_count[256][13][3];
 int context_watermark_sample_count[256][13][3];
 int l2_count = 0;
 int l3_count = 0;
+static bool locality_from_env = false;
+
+// weighted ReuseTracker reuses by how far the reusing cpu is from the
+// sampling one
+static int reuse_level_counter[HPCRUN_TOPO_NUM_LEVELS];
+static const char *reuse_level_counter_names[HPCRUN_TOPO_NUM_LEVELS] = {
+  "reuseSameL2", "reuseSameL3", "reuseSameNUMA", "reuseSameSocket",
+  "reuseCrossSocket", "reuseUnknownTopology"
+};
+
+// L2 and L3 domain of a cpu; the HPCRUN_THREAD_LOCALITY_MAPPING string
+// overrides the topology read from sysfs
+static inline int CpuL3(int cpu) {
+  if (locality_from_env)
+    return (cpu >= 0 && cpu < HASH_TABLE_SIZE) ? thread_to_l3_mapping[cpu] : 0;
+  return hpcrun_topology_of(cpu)->l3;
+}
+
+static inline int CpuL2(int cpu) {
+  if (locality_from_env)
+    return (cpu >= 0 && cpu < HASH_TABLE_SIZE) ? thread_to_l2_mapping[cpu] : 0;
+  return hpcrun_topology_of(cpu)->l2;
+}
+
+static inline void ReuseTopologyAdd(WatchPointInfo_t *wpi, uint64_t inc) {
+  if (inc == 0)
+    return;
+  hpcrun_topo_level_t level = hpcrun_topology_level(wpi->sample.first_accessing_core_id,
+                                                    hpcrun_topology_current_cpu());
+  if (reuse_level_counter[level] >= 0)
+    WPCounterAdd(reuse_level_counter[level], inc);
+}
 
 int reading_locality_vector()
 {
   int sum = 0;
 
+  for (int i = 0; i < HPCRUN_TOPO_NUM_LEVELS; i++)
+    reuse_level_counter[i] = WPCounterRegister(reuse_level_counter_names[i]);
+
   char *string = getenv("HPCRUN_THREAD_LOCALITY_MAPPING");
+  if (string == NULL) {
+    l3_count = hpcrun_topology_num_domains(HPCRUN_TOPO_SAME_L3);
+    l2_count = hpcrun_topology_num_domains(HPCRUN_TOPO_SAME_L2);
+    if (l3_count < 1) l3_count = 1;
+    if (l2_count < 1) l2_count = 1;
+    AMSG("locality from topology: %d L3 domains, %d L2 domains", l3_count, l2_count);
+    return 0;
+  }
+  locality_from_env = true;
 
   int l3_size = 1;
   int l2_size = 1;
@@ -1411,6 +1406,19 @@ int reading_locality_vector()
   return 0;
 }
 
+// cct nodes that outlive a sample: the watchpoints' sample contexts
+// and the monitored context. contexts published on the bulletin
+// boards and in gSharedData are pinned while they are published
+// instead (see WPPublish): other threads arm watchpoints with them, so
+// a mark at prune time would come too late.
+static void
+WPProtectCCTNodes(void)
+{
+  WPPublishedSweep(rdtsc());
+  WatchpointProtectCCTNodes();
+  hpcrun_cct_prune_protect(monitored_node);
+}
+
   static void
 METHOD_FN(process_event_list, int lush_metrics)
 {
@@ -1433,8 +1441,8 @@ METHOD_FN(process_event_list, int lush_metrics)
     }
   }
 
-  wpStats.numImpreciseSamples = 0;
-  wpStats.numWatchpointsSet = 0;
+  WPCounterProcessInit();
+  WPCounterThreadInit();
   //fprintf(stderr, "before WatchpointThreadInit\n");
   //WatchpointThreadInit(theWPConfig->wpCallback);
   //fprintf(stderr, "after WatchpointThreadInit\n");
@@ -1443,6 +1451,11 @@ METHOD_FN(process_event_list, int lush_metrics)
   }
   event_id = theWPConfig->id;
   WatchpointThreadInit(theWPConfig->wpCallback);
+  // only the communication clients arm WPAdaptiveActiveWP() watchpoints per sample
+  WPAdaptiveProcessInit(theWPConfig->id == WP_COMDETECTIVE || theWPConfig->id == WP_AMD_COMM);
+  WPDecodeCacheProcessInit();
+  WPAdaptiveThreadInit(wpConfig.maxWP);
+  hpcrun_cct_prune_register_protect(WPProtectCCTNodes);
 
   PopulateBlackListAddresses();
 
@@ -2182,10 +2195,10 @@ static WPTriggerActionType DeadStoreWPCallback(WatchPointInfo_t *wpi, int startO
   // if the access is a LOAD/LOAD_AND_STORE we are done! not a dead write :)
   if(wt->accessType == LOAD || wt->accessType == LOAD_AND_STORE) {
     // update the measured (i.e. not dead)
-    usedBytes += inc;
+    WPCounterAdd(WP_CTR_USED_BYTES, inc);
     UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_USED][joinNodeIdx] /* joinNode*/, measured_metric_id /* checkedMetric */, inc);
   } else {
-    deadBytes += inc;
+    WPCounterAdd(WP_CTR_DEAD_BYTES, inc);
     UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_KILLED][joinNodeIdx] /* joinNode*/, dead_metric_id /* checkedMetric */, inc);
   }
   return ALREADY_DISABLED;
@@ -2305,14 +2318,14 @@ static WPTriggerActionType RedStoreWPCallback(WatchPointInfo_t *wpi, int startOf
       // This is an approximation of what might have happened.
       // If I observe that 4 bytes are redundant out of 128 accessed bytes, I amplify it to 128 bytes.
       uint64_t inc = numDiffSamples * wpi->sample.accessLength;
-      oldAppxBytes += inc;
+      WPCounterAdd(WP_CTR_OLD_APPX_BYTES, inc);
       UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_KILLED][joinNodeIdx] /* joinNode*/, redApprox_metric_id /* checkedMetric */, inc);
     } else {
       // Now increment metric by numDiffSamples * wpi->sample.accessLength
       // This is an approximation of what might have happened.
       // If I observe that 4 bytes are NOT redundant out of 128 accessed bytes, I amplify it to 128 bytes.
       uint64_t inc = numDiffSamples * wpi->sample.accessLength;
-      newBytes += inc;
+      WPCounterAdd(WP_CTR_NEW_BYTES, inc);
       UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_NEW_VAL][joinNodeIdx] /* joinNode*/, measured_metric_id /* checkedMetric */, inc);
     }
   }else /* non float */{
@@ -2336,14 +2349,14 @@ TreatLikeInteger:
       // This is an approximation of what might have happened.
       // If I observe that 4 bytes are redundant out of 128 accessed bytes, I amplify it to 128 bytes.
       uint64_t inc = numDiffSamples * wpi->sample.accessLength;
-      oldBytes += inc;
+      WPCounterAdd(WP_CTR_OLD_BYTES, inc);
       UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_KILLED][joinNodeIdx] /* joinNode*/, red_metric_id /* checkedMetric */, inc);
     } else {
       // Now increment metric: if the entire overlap is redundant, amplify to numDiffSamples * wpi->sample.accessLength
       // This is an approximation of what might have happened.
       // If I observe that 4 bytes are NOT redundant out of 128 accessed bytes, I amplify it to 128 bytes.
       uint64_t inc = numDiffSamples * wpi->sample.accessLength;
-      newBytes += inc;
+      WPCounterAdd(WP_CTR_NEW_BYTES, inc);
       UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/,  joinNodes[E_NEW_VAL][joinNodeIdx] /* joinNode*/, measured_metric_id /* checkedMetric */, inc);
     }
   }
@@ -2362,7 +2375,7 @@ static WPTriggerActionType TemporalReuseWPCallback(WatchPointInfo_t *wpi, int st
 
   // Now increment temporal_metric_id by numDiffSamples * overlapBytes
   uint64_t inc = numDiffSamples;
-  reuse += inc;
+  WPCounterAdd(WP_CTR_REUSE, inc);
   //fprintf(stderr, "in TemporalReuseWPCallback, reuse distance: %ld\n", inc);
   UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_TEPORALLY_REUSED][joinNodeIdx] /* joinNode*/, temporal_metric_id /* checkedMetric */, inc);
   return ALREADY_DISABLED;
@@ -2379,7 +2392,7 @@ static WPTriggerActionType SpatialReuseWPCallback(WatchPointInfo_t *wpi, int sta
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
   // Now increment dead_metric_id by numDiffSamples * overlapBytes
   uint64_t inc = numDiffSamples;
-  reuse += inc;
+  WPCounterAdd(WP_CTR_REUSE, inc);
 
   UpdateConcatenatedPathPair(wt->ctxt, wpi->sample.node /* oldNode*/, joinNodes[E_SPATIALLY_REUSED][joinNodeIdx] /* joinNode*/, spatial_metric_id /* checkedMetric */, inc);
   return ALREADY_DISABLED;
@@ -2405,16 +2418,16 @@ static WPTriggerActionType FalseSharingWPCallback(WatchPointInfo_t *wpi, int sta
 
   //fprintf(stderr, "wt->va: %lx, wt->accessType: %d\n", wt->va, wt->accessType);
   if(wt->accessType == LOAD){
-    falseWRIns ++;
+    WPCounterInc(WP_CTR_FALSE_WR_INS);
     metricId = false_wr_metric_id;
     joinNode = joinNodes[E_FALSE_WR_SHARE][joinNodeIdx];
   } else {
     if(wpi->sample.accessType == LOAD) {
-      falseRWIns ++;
+      WPCounterInc(WP_CTR_FALSE_RW_INS);
       metricId = false_rw_metric_id;
       joinNode = joinNodes[E_FALSE_RW_SHARE][joinNodeIdx];
     } else{
-      falseWWIns ++;
+      WPCounterInc(WP_CTR_FALSE_WW_INS);
       metricId =  false_ww_metric_id;
       joinNode = joinNodes[E_FALSE_WW_SHARE][joinNodeIdx];
     }
@@ -2514,7 +2527,7 @@ static WPTriggerActionType ReuseWPCallback(WatchPointInfo_t *wpi, int startOffse
   //fprintf(stderr, "reuse distance: %ld\n", (val[0][0] + val[1][0]));
   cct_metric_data_increment(reuse_memory_distance_count_metric_id, reusePairNode, (cct_metric_data_t){.i = 1});
 
-  reuseTemporal += inc;
+  WPCounterAdd(WP_CTR_REUSE_TEMPORAL, inc);
   if (wpi->sample.reuseType == REUSE_TEMPORAL){
     cct_metric_data_increment(temporal_reuse_metric_id, reusePairNode, (cct_metric_data_t){.i = inc});
     //fprintf(stderr, "reuse distance temporal: %ld\n", inc);
@@ -2555,7 +2568,7 @@ static inline void GetAllFalseSharingLocations(size_t va, int accessLen, size_t
 
 static WPTriggerActionType ReuseTrackerWPCallback(WatchPointInfo_t *wpi, int startOffset, int safeAccessLen, WatchPointTrigger_t * wt){
   //fprintf(stderr, "in ReuseTrackerWPCallback\n");
-  trap_count++;
+  WPCounterInc(WP_CTR_CLIENT_TRAPS);
   int reuse_type = REUSE_NONE;
   bool l3_inc_attribute = false;
   bool time_distance_attribute = false;
@@ -2686,9 +2699,9 @@ static WPTriggerActionType ReuseTrackerWPCallback(WatchPointInfo_t *wpi, int sta
 
     if(profiling_mode == L3 || profiling_mode == MIXED) {
       int affinity_l3 = 0;
-      int my_core = sched_getcpu();
+      int my_core = hpcrun_topology_current_cpu();
       if(l3_count > 1)
-        affinity_l3 = thread_to_l3_mapping[my_core];
+        affinity_l3 = CpuL3(my_core);
       bool post_rd_flag = false;
       bool handle_trap = false;
       uint64_t theCounter = globalReuseWPs.table[wt->location].counter;
@@ -2737,7 +2750,7 @@ static WPTriggerActionType ReuseTrackerWPCallback(WatchPointInfo_t *wpi, int sta
         // before
         int cur_global_thread_count = global_thread_count;
         for(int i = 0; i < cur_global_thread_count; i++) {
-          if((mapping_size == 0) || (l3_count == 1) || (thread_to_l3_mapping[mapping_vector[i % mapping_size]] == affinity_l3)) {
+          if((mapping_size == 0) || (l3_count == 1) || (CpuL3(mapping_vector[i % mapping_size]) == affinity_l3)) {
             for (int j=0; j < MIN(2, reuse_distance_num_events); j++){
               uint64_t val1[3];
               linux_perf_read_event_counter_shared( reuse_distance_events[j], val1, i/*locality_vector[affinity_l3][i+1]*/);
@@ -2867,7 +2880,8 @@ static WPTriggerActionType ReuseTrackerWPCallback(WatchPointInfo_t *wpi, int sta
     }
   }
 
-  reuseTemporal += attributed_inc;
+  WPCounterAdd(WP_CTR_REUSE_TEMPORAL, attributed_inc);
+  ReuseTopologyAdd(wpi, l3_inc_attribute ? l3_attributed_inc : attributed_inc);
   if (reuse_type == REUSE_TEMPORAL){
     cct_metric_data_increment(temporal_reuse_metric_id, reusePairNode, (cct_metric_data_t){.i = attributed_inc});
     //fprintf(stderr, "reuse distance temporal: %ld\n", inc);
@@ -2982,7 +2996,7 @@ static WPTriggerActionType AMDReuseWPCallback(WatchPointInfo_t *wpi, int startOf
   //fprintf(stderr, "reuse distance: %ld\n", (val[0][0] + val[1][0]));
   cct_metric_data_increment(reuse_memory_distance_count_metric_id, reusePairNode, (cct_metric_data_t){.i = 1});
 
-  reuseTemporal += inc;
+  WPCounterAdd(WP_CTR_REUSE_TEMPORAL, inc);
   if (wpi->sample.reuseType == REUSE_TEMPORAL){
     cct_metric_data_increment(temporal_reuse_metric_id, reusePairNode, (cct_metric_data_t){.i = inc});
     //fprintf(stderr, "reuse distance temporal: %ld\n", inc);
@@ -3000,7 +3014,7 @@ static WPTriggerActionType AMDReuseWPCallback(WatchPointInfo_t *wpi, int startOf
 //#if 0
 static WPTriggerActionType AMDReuseTrackerWPCallback(WatchPointInfo_t *wpi, int startOffset, int safeAccessLen, WatchPointTrigger_t * wt){
 	//fprintf(stderr, "trap in AMDReuseWPCallback happens\n");
-	trap_count++;
+	WPCounterInc(WP_CTR_CLIENT_TRAPS);
 #if 0  // jqswang:TODO, how to handle it?
   if(!wt->pc) {
     // if the ip is 0, let's drop the WP
@@ -3140,9 +3154,9 @@ static WPTriggerActionType AMDReuseTrackerWPCallback(WatchPointInfo_t *wpi, int
 
     if(profiling_mode == L3 || profiling_mode == MIXED) {
       int affinity_l3 = 0;
-      int my_core = sched_getcpu();
+      int my_core = hpcrun_topology_current_cpu();
       if(l3_count > 1)
-        affinity_l3 = thread_to_l3_mapping[my_core];
+        affinity_l3 = CpuL3(my_core);
       bool post_rd_flag = false;
       bool handle_trap = false;
       uint64_t theCounter = globalReuseWPs.table[wt->location].counter;
@@ -3192,7 +3206,7 @@ static WPTriggerActionType AMDReuseTrackerWPCallback(WatchPointInfo_t *wpi, int
         // before
         int cur_global_thread_count = global_thread_count;
         for(int i = 0; i < cur_global_thread_count; i++) {
-          if((mapping_size == 0) || (l3_count == 1) || (thread_to_l3_mapping[mapping_vector[i % mapping_size]] == affinity_l3)) {
+          if((mapping_size == 0) || (l3_count == 1) || (CpuL3(mapping_vector[i % mapping_size]) == affinity_l3)) {
             //for (int j=0; j < MIN(2, reuse_distance_num_events); j++){
               uint64_t val1[3];
               linux_perf_read_event_counter_shared( amd_reuse_distance_event, val1, i/*locality_vector[affinity_l3][i+1]*/);
@@ -3322,7 +3336,8 @@ static WPTriggerActionType AMDReuseTrackerWPCallback(WatchPointInfo_t *wpi, int
     }
   }
 
-  reuseTemporal += attributed_inc;
+  WPCounterAdd(WP_CTR_REUSE_TEMPORAL, attributed_inc);
+  ReuseTopologyAdd(wpi, l3_inc_attribute ? l3_attributed_inc : attributed_inc);
   if (reuse_type == REUSE_TEMPORAL){
     cct_metric_data_increment(temporal_reuse_metric_id, reusePairNode, (cct_metric_data_t){.i = attributed_inc});
     //fprintf(stderr, "reuse distance temporal: %ld\n", inc);
@@ -3353,7 +3368,7 @@ static WPTriggerActionType AMDCommWPCallback(WatchPointInfo_t *wpi, int startOff
   const void* joinNode;
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
 
-  number_of_traps++;
+  WPCounterInc(WP_CTR_CLIENT_TRAPS);
   int max_thread_num = wpi->sample.first_accessing_tid;
   if(max_thread_num < TD_GET(core_profile_trace_data.id))
   {
@@ -3370,9 +3385,9 @@ static WPTriggerActionType AMDCommWPCallback(WatchPointInfo_t *wpi, int startOff
   int64_t trapTime = rdtsc();
   int max_core_num = wpi->sample.first_accessing_core_id;
 
-  if(max_core_num < sched_getcpu()) // sched_getcpu() finds the cpu on which the thread is running
+  if(max_core_num < hpcrun_topology_current_cpu()) // the cpu on which the thread is running
   {   
-    max_core_num = sched_getcpu(); 
+    max_core_num = hpcrun_topology_current_cpu(); 
   }
   if(fs_core_matrix_size < max_core_num)
   {
@@ -3387,7 +3402,7 @@ static WPTriggerActionType AMDCommWPCallback(WatchPointInfo_t *wpi, int startOff
   int index2 = TD_GET(core_profile_trace_data.id); 
 
   int core_id1 = wpi->sample.first_accessing_core_id;  
-  int core_id2 = sched_getcpu();  
+  int core_id2 = hpcrun_topology_current_cpu();  
   int flag = 0;
   // if ts2 > tprev then
 //#if 0
@@ -3395,23 +3410,23 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
     if(wt->accessType == LOAD && wpi->sample.samplerAccessType == LOAD){
       if(wpi->sample.sampleType == ALL_LOAD) {
         flag = 1;
-        number_of_caught_read_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_TRAPS);
       }
     } else if ((wt->accessType == STORE || wt->accessType == LOAD_AND_STORE) && wpi->sample.samplerAccessType == STORE) {
       if(wpi->sample.sampleType == ALL_STORE) {
         flag = 2;
-        number_of_caught_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_WRITE_TRAPS);
       }
     }
  #if 0 
     else if (wt->accessType == LOAD_AND_STORE && wpi->sample.samplerAccessType == LOAD_AND_STORE){
       if(wpi->sample.sampleType == ALL_LOAD) {
         flag = 1;
-        number_of_caught_read_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_WRITE_TRAPS);
       }
       if(wpi->sample.sampleType == ALL_STORE) {
         flag = 2;
-        number_of_caught_read_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_WRITE_TRAPS);
       }
     }
 #endif
@@ -3430,7 +3445,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
 
   if (flag == 1) { // Load trap (WAR)
     void * cacheLineBaseAddress = (void *) ALIGN_TO_CACHE_LINE((size_t)wt->va);    
-    double increment = (double) /*valid_sample_count1 / valid_sample_count **/ /*thread_coefficient(as_matrix_size) **/ CACHE_LINE_SZ/MAX_WP_LENGTH / wpConfig.maxWP * global_sampling_period; 
+    double increment = CommTrapIncrement(&wpi->sample, global_sampling_period);
 #if 0    
     if(global_thread_count > 2)
     	valid_sample_count = 0;
@@ -3439,7 +3454,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
     if(GET_OVERLAP_BYTES(wpi->sample.target_va, wpi->sample.accessLength, wt->va, wt->accessLength) > 0) {
       int id = -1;
       // Record true sharing
-      trueWRIns ++;
+      WPCounterInc(WP_CTR_TRUE_WR_INS);
       metricId =  true_wr_metric_id;
       joinNode = joinNodes[E_TRUE_WR_SHARE][joinNodeIdx];
       ts_matrix[index1][index2] = ts_matrix[index1][index2] + increment;
@@ -3453,7 +3468,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
     } else {
       int id = -1;
       // Record false sharing
-      falseWRIns ++;
+      WPCounterInc(WP_CTR_FALSE_WR_INS);
       metricId =  false_wr_metric_id;
       joinNode = joinNodes[E_FALSE_WR_SHARE][joinNodeIdx];
       fs_matrix[index1][index2] = fs_matrix[index1][index2] + increment;
@@ -3475,7 +3490,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
   }
   else if (flag == 2) { // Store trap (WAW)
     void * cacheLineBaseAddress = (void *) ALIGN_TO_CACHE_LINE((size_t)wt->va);    
-    double increment = (double) /*valid_sample_count1 / valid_sample_count **/ /*thread_coefficient(as_matrix_size) **/ CACHE_LINE_SZ/MAX_WP_LENGTH / wpConfig.maxWP * global_sampling_period; 
+    double increment = CommTrapIncrement(&wpi->sample, global_sampling_period);
 #if 0
     if(global_thread_count > 2)
     	valid_sample_count = 0;
@@ -3484,7 +3499,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
     if(GET_OVERLAP_BYTES(wpi->sample.target_va, wpi->sample.accessLength, wt->va, wt->accessLength) > 0) {
       int id = -1;
       // Record true sharing
-      trueWWIns ++;
+      WPCounterInc(WP_CTR_TRUE_WW_INS);
       metricId =  true_ww_metric_id;
       joinNode = joinNodes[E_TRUE_WW_SHARE][joinNodeIdx];
       ts_matrix[index1][index2] = ts_matrix[index1][index2] + increment;
@@ -3498,7 +3513,7 @@ if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sa
     } else {
       int id = -1;
       // Record false sharing
-      falseWWIns ++;
+      WPCounterInc(WP_CTR_FALSE_WW_INS);
       metricId =  false_ww_metric_id;
       joinNode = joinNodes[E_FALSE_WW_SHARE][joinNodeIdx];
       fs_matrix[index1][index2] = fs_matrix[index1][index2] + increment;
@@ -3534,7 +3549,7 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
   const void* joinNode;
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
 
-  number_of_traps++;
+  WPCounterInc(WP_CTR_CLIENT_TRAPS);
   int max_thread_num = wpi->sample.first_accessing_tid;
   if(max_thread_num < TD_GET(core_profile_trace_data.id))
   {
@@ -3554,9 +3569,9 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
   int64_t trapTime = rdtsc();
   int max_core_num = wpi->sample.first_accessing_core_id;
 
-  if(max_core_num < sched_getcpu()) // sched_getcpu() finds the cpu on which the thread is running
+  if(max_core_num < hpcrun_topology_current_cpu()) // the cpu on which the thread is running
   {   
-    max_core_num = sched_getcpu(); 
+    max_core_num = hpcrun_topology_current_cpu(); 
   }
   if(fs_core_matrix_size < max_core_num)
   {
@@ -3574,7 +3589,7 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
   int index2 = TD_GET(core_profile_trace_data.id); 
 
   int core_id1 = wpi->sample.first_accessing_core_id;  
-  int core_id2 = sched_getcpu();  
+  int core_id2 = hpcrun_topology_current_cpu();  
   int flag = 0;
   // if ts2 > tprev then
   if((prev_timestamp < wpi->sample.bulletinBoardTimestamp) && ((trapTime - wpi->sample.bulletinBoardTimestamp)  <  wpi->sample.expirationPeriod)) { 
@@ -3582,24 +3597,24 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
       if(wpi->sample.sampleType == ALL_LOAD) {
         global_sampling_period = global_load_sampling_period;
         flag = 1;
-        number_of_caught_read_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_TRAPS);
       }
     } else if (wt->accessType == STORE && wpi->sample.samplerAccessType == STORE) {
       if(wpi->sample.sampleType == ALL_STORE) {
         global_sampling_period = global_store_sampling_period;
         flag = 2;
-        number_of_caught_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_WRITE_TRAPS);
       }
     } else if (wt->accessType == LOAD_AND_STORE && wpi->sample.samplerAccessType == LOAD_AND_STORE){
       if(wpi->sample.sampleType == ALL_LOAD) {
         global_sampling_period = global_load_sampling_period;
         flag = 1;
-        number_of_caught_read_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_WRITE_TRAPS);
       }
       if(wpi->sample.sampleType == ALL_STORE) {
         global_sampling_period = global_store_sampling_period;
         flag = 2;
-        number_of_caught_read_write_traps++;
+        WPCounterInc(WP_CTR_CAUGHT_READ_WRITE_TRAPS);
       }
     }
   }
@@ -3607,13 +3622,13 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
 
   if (flag == 1) { // Load trap (WAR)
     void * cacheLineBaseAddress = (void *) ALIGN_TO_CACHE_LINE((size_t)wt->va);    
-    double increment = (double) CACHE_LINE_SZ/MAX_WP_LENGTH / wpConfig.maxWP * global_sampling_period; 
+    double increment = CommTrapIncrement(&wpi->sample, global_sampling_period);
 
     // if [M1 , M1 + δ1 ) overlaps with [M2 , M2 + δ2 ) then
     if(GET_OVERLAP_BYTES(wpi->sample.target_va, wpi->sample.accessLength, wt->va, wt->accessLength) > 0) {
       int id = -1;
       // Record true sharing
-      trueWRIns ++;
+      WPCounterInc(WP_CTR_TRUE_WR_INS);
       metricId =  true_wr_metric_id;
       joinNode = joinNodes[E_TRUE_WR_SHARE][joinNodeIdx];
 #if ADAMANT_USED
@@ -3669,7 +3684,7 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
     } else {
       int id = -1;
       // Record false sharing
-      falseWRIns ++;
+      WPCounterInc(WP_CTR_FALSE_WR_INS);
       metricId =  false_wr_metric_id;
       joinNode = joinNodes[E_FALSE_WR_SHARE][joinNodeIdx];
 #if ADAMANT_USED
@@ -3739,13 +3754,13 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
   }
   else if (flag == 2) { // Store trap (WAW)
     void * cacheLineBaseAddress = (void *) ALIGN_TO_CACHE_LINE((size_t)wt->va);    
-    double increment = (double) CACHE_LINE_SZ/MAX_WP_LENGTH / wpConfig.maxWP * global_sampling_period; 
+    double increment = CommTrapIncrement(&wpi->sample, global_sampling_period);
 
     // if [M1 , M1 + δ1 ) overlaps with [M2 , M2 + δ2 ) then
     if(GET_OVERLAP_BYTES(wpi->sample.target_va, wpi->sample.accessLength, wt->va, wt->accessLength) > 0) {
       int id = -1;
       // Record true sharing
-      trueWWIns ++;
+      WPCounterInc(WP_CTR_TRUE_WW_INS);
       metricId =  true_ww_metric_id;
       joinNode = joinNodes[E_TRUE_WW_SHARE][joinNodeIdx];
 #if ADAMANT_USED
@@ -3801,7 +3816,7 @@ static WPTriggerActionType ComDetectiveWPCallback(WatchPointInfo_t *wpi, int sta
     } else {
       int id = -1;
       // Record false sharing
-      falseWWIns ++;
+      WPCounterInc(WP_CTR_FALSE_WW_INS);
       metricId =  false_ww_metric_id;
       joinNode = joinNodes[E_FALSE_WW_SHARE][joinNodeIdx];
 #if ADAMANT_USED
@@ -3887,16 +3902,16 @@ static WPTriggerActionType TrueSharingWPCallback(WatchPointInfo_t *wpi, int star
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
 
   if(wt->accessType == LOAD){
-    trueWRIns ++;
+    WPCounterInc(WP_CTR_TRUE_WR_INS);
     metricId = true_wr_metric_id;
     joinNode = joinNodes[E_TRUE_WR_SHARE][joinNodeIdx];
   } else {
     if(wpi->sample.accessType == LOAD) {
-      trueRWIns ++;
+      WPCounterInc(WP_CTR_TRUE_RW_INS);
       metricId = true_rw_metric_id;
       joinNode = joinNodes[E_TRUE_RW_SHARE][joinNodeIdx];
     } else{
-      trueWWIns ++;
+      WPCounterInc(WP_CTR_TRUE_WW_INS);
       metricId =  true_ww_metric_id;
       joinNode = joinNodes[E_TRUE_WW_SHARE][joinNodeIdx];
     }
@@ -3918,16 +3933,16 @@ static WPTriggerActionType IPCFalseSharingWPCallback(WatchPointInfo_t *wpi, int
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
 
   if(wt->accessType == LOAD){
-    falseWRIns ++;
+    WPCounterInc(WP_CTR_FALSE_WR_INS);
     metricId = false_wr_metric_id;
     joinNode = joinNodes[E_IPC_FALSE_WR_SHARE][joinNodeIdx];
   } else {
     if(wpi->sample.accessType == LOAD) {
-      falseRWIns ++;
+      WPCounterInc(WP_CTR_FALSE_RW_INS);
       metricId = false_rw_metric_id;
       joinNode = joinNodes[E_IPC_FALSE_RW_SHARE][joinNodeIdx];
     } else{
-      falseWWIns ++;
+      WPCounterInc(WP_CTR_FALSE_WW_INS);
       metricId =  false_ww_metric_id;
       joinNode = joinNodes[E_IPC_FALSE_WW_SHARE][joinNodeIdx];
     }
@@ -3947,16 +3962,16 @@ static WPTriggerActionType IPCTrueSharingWPCallback(WatchPointInfo_t *wpi, int s
   int joinNodeIdx = wpi->sample.isSamplePointAccurate? E_ACCURATE_JOIN_NODE_IDX : E_INACCURATE_JOIN_NODE_IDX;
   int i = 1;
   if(wt->accessType == LOAD){
-    trueWRIns ++;
+    WPCounterInc(WP_CTR_TRUE_WR_INS);
     metricId = true_wr_metric_id;
     joinNode = joinNodes[E_IPC_TRUE_WR_SHARE][joinNodeIdx];
   } else {
     if(wpi->sample.accessType == LOAD) {
-      trueRWIns ++;
+      WPCounterInc(WP_CTR_TRUE_RW_INS);
       metricId = true_rw_metric_id;
       joinNode = joinNodes[E_IPC_TRUE_RW_SHARE][joinNodeIdx];
     } else{
-      trueWWIns ++;
+      WPCounterInc(WP_CTR_TRUE_WW_INS);
       metricId =  true_ww_metric_id;
       joinNode = joinNodes[E_IPC_TRUE_WW_SHARE][joinNodeIdx];
     }
@@ -4131,412 +4146,99 @@ GetAllFalseSharingLocations(va, accessLen, curAddr, curWPSize, wpSizes, curWPSiz
 }
 }*/
 
-#define PAGEMAP_ENTRY 8
-#define GET_BIT(X,Y) (X & ((uint64_t)1<<Y)) >> Y
-#define GET_PFN(X) X & 0x7FFFFFFFFFFFFF
-const int __endian_bit = 1;
-#define is_bigendian() ( (*(char*)&__endian_bit) == 0 )
-#define MAX_BACKTRACE_LEN (1024)
-#define MAX_IPC_PROCS (1024)
-#define MAX_LOAD_MODULES (1024)
-#define MAX_LM_PATH_LEN (1024)
-#define INVALID_PHYSICAL_ADDRESS (0L)
-#define INVALID_VIRUAL_ADDRESS ((void*) 0)
-#define PAGE_SZ (4096)
-#define PAGE_OFFSET(a) ((size_t)(a) & (PAGE_SZ-1))
-#define GET_VA_PAGE(p) (void*)((size_t)(p) & ~(PAGE_SZ-1))
-#define GET_PA_PAGE(p) (unsigned long)((p) & ~(PAGE_SZ-1))
-#define PA_PATH "/proc/self/pagemap"
-#define VA_PATH "/proc/self/maps"
-#define VM_MAP_CHECK_FREQUENCY (128)
-
-
-typedef enum LM_ENTRY_STATUS {UNUSED=0, TRANSIENT=1, STABLE=2} LM_ENTRY_STATUS_t;
-
-typedef struct LM_ID_PATH{
-  volatile LM_ENTRY_STATUS_t status;
-  //    uint16_t lmId;
-  char realPath[MAX_LM_PATH_LEN];
-}LM_ID_PATH;
-
-
-typedef struct IPC_FSInfo{
-  char dummy2[CACHE_LINE_SZ];
-  uint64_t time;
-  pid_t tid;
-  WatchPointType wpType;
-  AccessType accessType;
-  unsigned long address;
-  unsigned long offset;
-  int accessLen;
-  uint16_t btLength;
-  struct cct_addr_t backtrace[MAX_BACKTRACE_LEN];
-  char dummy4[CACHE_LINE_SZ];
-}IPC_FSInfo;
-
-typedef struct IPC_SharedData{
-  char dummy1[CACHE_LINE_SZ];
-  volatile uint32_t curThreadsSubsribed;
-  char dummy2[CACHE_LINE_SZ];
-  volatile uint32_t numLMIds;
-  char dummy3[CACHE_LINE_SZ];
-  LM_ID_PATH sharedLMInfo[MAX_LOAD_MODULES];
-  char dummy4[CACHE_LINE_SZ];
-  volatile uint64_t counter;
-  char dummy5[CACHE_LINE_SZ];
-  IPC_FSInfo fsInfo;
-  char dummy6[CACHE_LINE_SZ];
-}IPC_SharedData;
-
-typedef struct VAPAMap {
-  // Id given by us
-  void * virtualAddress;
-  unsigned long physicalAddress;
-  struct VAPAMap *left;
-  struct VAPAMap *right;
-} VAPAMap_t;
-
-__thread VAPAMap_t * vaToPAMap = NULL;
-__thread VAPAMap_t * paToVAMap = NULL;
 __thread pid_t myTid = -1;
 __thread bool ipcDataInited = false;
 __thread IPC_FSInfo localIPCInfo;
-__thread time_t lastMapChangeTime;
-__thread struct stat mapsStat;
-__thread uint64_t lastVMMAPCheck = 0;
-
-
-IPC_SharedData * ipcSharedData;
-
-static const char * shared_key = "/FALSE_SHARING_KEY";
-
-
-
-
-
-void ReadIPCSharedDataTransactionally(IPC_FSInfo *ipcFSInfo){
-  // Laport's STM
-  do{
-    int64_t startCounter = ipcSharedData->counter;
-    if(startCounter & 1)
-      continue; // Some writer is updating
-
-    __sync_synchronize();
-    *ipcFSInfo = ipcSharedData->fsInfo;
-    __sync_synchronize();
-    int64_t endCounter = ipcSharedData->counter;
-    if(startCounter == endCounter)
-      break;
-  }while(1);
-}
-
-static void destroy_shared_memory(void * p) {
-  // we should munmap, but I will not do since we dont do it in so many other places in hpcrun
-  // munmap(ipc_data);
-  shm_unlink((char *)shared_key);
-}
-
-static inline void create_shared_memory() {
-  int fd ;
-  if ( (fd = shm_open(shared_key, O_RDWR | O_CREAT, 0666)) < 0 ) {
-    EEMSG("Failed to shm_open (%s), retval = %d", shared_key, fd);
-    monitor_real_abort();
-  }
-  if ( ftruncate(fd, sizeof(IPC_SharedData)) < 0 ) {
-    EEMSG("Failed to ftruncate()");
-    monitor_real_abort();
-  }
-  void * ptr = mmap(NULL, sizeof(IPC_SharedData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
-  if(ptr == MAP_FAILED ) {
-    EEMSG("Failed to mmap() IPC_SharedData");
-    monitor_real_abort();
-  }
-  if(__sync_bool_compare_and_swap(&ipcSharedData, 0, ptr)){
-    hpcrun_process_aux_cleanup_add(destroy_shared_memory, NULL);
-  }
-
-}
-
-uint16_t GetOrCreateIPCSharedLMEntry(const char * realPath){
-
-  if(ipcSharedData == NULL)
-    create_shared_memory();
-  // start from 1; leave 0 out;
-  for(uint16_t i = 1 ; i < MAX_LOAD_MODULES; i++){
-    switch (ipcSharedData->sharedLMInfo[i].status) {
-      case STABLE:
-        if(0==strncmp(realPath, ipcSharedData->sharedLMInfo[i].realPath, MAX_LM_PATH_LEN))
-          return i;
-        break;
-      case TRANSIENT:
-TRANSIENT_CASE:
-        while(ipcSharedData->sharedLMInfo[i].status != STABLE) ; // spin
-        if(0==strncmp(realPath, ipcSharedData->sharedLMInfo[i].realPath, MAX_LM_PATH_LEN))
-          return i;
-        break;
-      case UNUSED:
-        // Attempt to install
-        if(__sync_bool_compare_and_swap(&(ipcSharedData->sharedLMInfo[i].status), UNUSED, TRANSIENT))  {
-          strncpy(ipcSharedData->sharedLMInfo[i].realPath, realPath, MAX_LM_PATH_LEN);
-          // need a fence on weak memory here.
-          ipcSharedData->sharedLMInfo[i].status = STABLE;
-          return i;
-        } else {
-          goto TRANSIENT_CASE;
-        }
-      default:
-        assert(0 && "SHOULD NEVER REACH HERE");
-        monitor_real_abort();
-    }
-  }
-  assert(0 && "Should never reach here");
-  monitor_real_abort();
-  return 0;
-}
-
-unsigned long GetPFN(unsigned long virt_addr){
-  FILE * f = fopen(PA_PATH, "rb");
-  if(!f){
-    printf("Error! Cannot open %s\n", PA_PATH);
-    goto ErrExit;
-  }
-
-  //Shifting by virt-addr-offset number of bytes
-  //and multiplying by the size of an address (the size of an entry in pagemap file)
-  uint64_t file_offset = virt_addr / getpagesize() * PAGEMAP_ENTRY;
-  int status = fseek(f, file_offset, SEEK_SET);
-  if(status){
-    perror("Failed to do fseek!");
-    goto ErrExit;
-  }
-  errno = 0;
-  uint64_t read_val = 0;
-  unsigned char c_buf[PAGEMAP_ENTRY];
-  for(int i=0; i < PAGEMAP_ENTRY; i++){
-    unsigned char c = getc(f);
-    if(c==EOF){
-      //printf("\nReached end of the file\n");
-      goto ErrExit;
-    }
-    if(is_bigendian())
-      c_buf[i] = c;
-    else
-      c_buf[PAGEMAP_ENTRY - i - 1] = c;
-  }
-
-  fclose(f);
-
-  for(int i=0; i < PAGEMAP_ENTRY; i++){
-    //printf("%d ",c_buf[i]);
-    read_val = (read_val << 8) + c_buf[i];
-  }
-  //
-  if(GET_BIT(read_val, 63)) {
-    return (unsigned long long) GET_PFN(read_val);
-  }
-  //    else
-  //        printf("Page not present\n");
-  //    if(GET_BIT(read_val, 62))
-  //        printf("Page swapped\n");
-
-  return INVALID_PHYSICAL_ADDRESS;
-ErrExit:
-  if(f){
-    fclose(f);
-  }
-  return INVALID_PHYSICAL_ADDRESS;
-
-}
-
-
-
-static inline struct VAPAMap* splayVAtoPAMap(struct VAPAMap* root, void* vPage) {
-  REGULAR_SPLAY_TREE(VAPAMap, root, vPage, virtualAddress, left, right);
-  return root;
-}
-
-static inline struct VAPAMap* splayPAtoVAMap(struct VAPAMap* root, unsigned long pPage) {
-  REGULAR_SPLAY_TREE(VAPAMap, root, pPage, physicalAddress, left, right);
-  return root;
-}
-
-
-static void InsertVAtoPAMap(void * va, unsigned long pa){
-  VAPAMap_t * found    = splayVAtoPAMap(vaToPAMap, va);
-
-  // Check if a trace node with traceKey already exists under this context node
-  if(found && (va == found->virtualAddress)) {
-    vaToPAMap = found;
-    if(found->physicalAddress != pa)
-      found->physicalAddress = pa;
-  } else {
-    VAPAMap_t* newNode = hpcrun_malloc(sizeof(VAPAMap_t));
-    newNode->virtualAddress = va;
-    newNode->physicalAddress = pa;
-    if(!found) {
-      newNode->left = NULL;
-      newNode->right = NULL;
-    } else if(va < found->virtualAddress) {
-      newNode->left = found->left;
-      newNode->right = found;
-      found->left = NULL;
-    } else { // addr > addr of found
-      newNode->left = found;
-      newNode->right = found->right;
-      found->right = NULL;
-    }
-    vaToPAMap = newNode;
-  }
-}
-
-
-static void InsertPAtoVAMap(unsigned long pa, void * va){
-  VAPAMap_t * found    = splayPAtoVAMap(paToVAMap, pa);
-
-  // Check if a trace node with traceKey already exists under this context node
-  if(found && (pa == found->physicalAddress)) {
-    paToVAMap = found;
-    if(found->virtualAddress != va)
-      found->virtualAddress = va;
-  } else {
-    VAPAMap_t * newNode = hpcrun_malloc(sizeof(VAPAMap_t));
-    newNode->virtualAddress = va;
-    newNode->physicalAddress = pa;
-    if(!found) {
-      newNode->left = NULL;
-      newNode->right = NULL;
-    } else if(pa < found->physicalAddress) {
-      newNode->left = found->left;
-      newNode->right = found;
-      found->left = NULL;
-    } else { // addr > addr of found
-      newNode->left = found;
-      newNode->right = found->right;
-      found->right = NULL;
-    }
-    paToVAMap = newNode;
-  }
-}
-
-
-
-unsigned long GetPAfromVA(void * va){
-  void * pageBaseAddr = GET_VA_PAGE(va);
-  REGULAR_SPLAY_TREE(VAPAMap, vaToPAMap, pageBaseAddr, virtualAddress, left, right);
-  if(vaToPAMap && (pageBaseAddr == vaToPAMap->virtualAddress)) {
-    return vaToPAMap->physicalAddress;
-  }
-  return INVALID_PHYSICAL_ADDRESS;
-}
-
-void * GetVAfromPA(unsigned long pa){
-  unsigned long  pageBaseAddr = pa;
-  REGULAR_SPLAY_TREE(VAPAMap, paToVAMap, pageBaseAddr, physicalAddress, left, right);
-  if(paToVAMap && (pageBaseAddr == paToVAMap->physicalAddress)) {
-    return paToVAMap->virtualAddress;
-  }
-  return INVALID_VIRUAL_ADDRESS;
-}
-
 
-
-static void GetAllSharedPages() {
-  FILE* loadmap = fopen(VA_PATH, "r");
-  if (! loadmap) {
-    EMSG("Could not open /proc/self/maps");
-    return;
-  }
-  char linebuf[1024 + 1];
-  char* addr = NULL;
-  for(;;) {
-    char* l = fgets(linebuf, sizeof(linebuf), loadmap);
-    if (feof(loadmap)) break;
-    char* save = NULL;
-    const char delim[] = " \n";
-    addr = strtok_r(l, delim, &save);
-    char* perms = strtok_r(NULL, delim, &save);
-    // if write is not allowed skip
-    if (perms[1] == '-') {
-      continue;
-    }
-    if (perms[3] == 's') {
-      const char dash[] = "-";
-      char* start_str = strtok_r(addr, dash, &save);
-      char* end_str   = strtok_r(NULL, dash, &save);
-      void *start = (void*) (uintptr_t) strtol(start_str, NULL, 16);
-      void *end   = (void*) (uintptr_t) strtol(end_str, NULL, 16);
-      const long pgSz = sysconf(_SC_PAGESIZE);
-      for(void *va = start; va < end; va += pgSz) {
-        // Get PA for each VA page
-        unsigned long pa =  (unsigned long) GetPFN((unsigned long)va);
-        if(pa != INVALID_PHYSICAL_ADDRESS) {
-          //                    printf("\n VA:%xl = %xl", va, pa);
-          InsertVAtoPAMap(va, pa);
-          InsertPAtoVAMap(pa, va);
-        }
-      }
-    }
-  }
-  fclose(loadmap);
-}
-
-static void UpdateVMMap(){
-  int s = stat(VA_PATH, &mapsStat);
-  if(s != 0){
-    fprintf(stderr, "\n Failed to STAT %s", VA_PATH);
-  }
-
-  if( ((lastVMMAPCheck % VM_MAP_CHECK_FREQUENCY) == 0)
-      && (lastMapChangeTime != mapsStat.st_mtime)) {
-    // New mapping
-    GetAllSharedPages();
-  }
-  lastMapChangeTime = mapsStat.st_mtime;
-  lastVMMAPCheck++;
-}
-
-static void HandleIPCFalseSharing(void * data_addr, void * pc, cct_node_t *node, int accessLen, AccessType accessType, int sampledMetricId, bool isSamplePointAccurate){
-  if(ipcSharedData == NULL){
-    create_shared_memory();
-  }
+static void HandleIPCFalseSharing(perf_mmap_data_t *mmap_data, void * data_addr, void * pc, cct_node_t *node, int accessLen, AccessType accessType, int sampledMetricId, bool isSamplePointAccurate){
   if (ipcDataInited == false) {
     myTid = syscall(SYS_gettid);
-    lastVMMAPCheck = 0;
     ipcDataInited = true;
   }
   // is address on shared page?
-  unsigned long pa = GetPAfromVA(data_addr);
+  unsigned long pa = WPIPCGetPA(data_addr);
+  if(pa == INVALID_PHYSICAL_ADDRESS) {
+    goto ErrExit;
+  }
   // Ok, on a shared page!
-  // Ok to publish new data?
+  unsigned long paLine = ALIGN_TO_CACHE_LINE(pa);
 
-  // Is the published address old enough (stayed for > 1 sample time span)
+  // A publication on this line is taken while it is younger than two sample time spans
   int64_t curTime = rdtsc();
-  volatile IPC_FSInfo * globalIPCInfo = &(ipcSharedData->fsInfo);
-
+  uint64_t maxAge = 2 * (curTime - lastTime);
   pid_t me = myTid;
-  // Get the time, tid, and counter
-  // This is definately racy but benign.
-  uint64_t theCounter = ipcSharedData->counter;
-  if( ((curTime-globalIPCInfo->time) > 2 * (curTime-lastTime)) // Sufficient time passed since the last time somebody published
-      &&
-      ( (theCounter & 1) == 0) // Nobody is in the process of publishing
-      && (pa != INVALID_PHYSICAL_ADDRESS) // my PA is a valid address
-    ) {
-    // Attempt to lockout
-
-    if(__sync_bool_compare_and_swap(&(ipcSharedData->counter), theCounter, theCounter+1)){
-    } else {
-      // Failed to update ==> someone else succeeded ==> Fetch that address and set a WP for that
-      goto SET_FS_WP;
+  IPC_Slot * slot;
+  IPC_FSInfo * globalIPCInfo;
+
+  if(WPIPCReadFresh(paLine, me, curTime, maxAge, &localIPCInfo)){
+    // Somebody else touched this line: set the WP on our own mapping of it
+    void * va = (void *) ((uintptr_t) data_addr & ~(wpConfig.pgsz - 1)) + localIPCInfo.offset;
+
+    long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+    WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
+
+    switch (theWPConfig->id) {
+      case WP_IPC_TRUE_SHARING:{
+                                 // Set WP at the same address
+                                 SampleData_t sd= {
+                                   .va = va,
+                                   .node = localIPCInfo.backtrace,
+                                   .accessType=localIPCInfo.accessType,
+                                   .type=localIPCInfo.wpType,
+                                   .wpLength = GetFloorWPLengthAtAddress(va, accessLen),
+                                   .accessLength= accessLen,
+                                   .sampledMetricId=sampledMetricId,
+                                   .isSamplePointAccurate = isSamplePointAccurate,
+                                   .preWPAction=theWPConfig->preWPAction,
+                                   .isBackTrace = true
+                                 };
+                                 SubscribeWatchpoint(&sd, OVERWRITE, false /* capture value */);
+                               }
+                               break;
+      case WP_IPC_FALSE_SHARING: {
+                                   int wpSizes[] = {8, 4, 2, 1};
+                                   FalseSharingLocs falseSharingLocs[CACHE_LINE_SZ];
+                                   int numFSLocs = 0;
+                                   GetAllFalseSharingLocations((size_t) va, accessLen, ALIGN_TO_CACHE_LINE((size_t)va), CACHE_LINE_SZ, wpSizes, 0 /*curWPSizeIdx*/ , 4 /*totalWPSizes*/, falseSharingLocs, &numFSLocs);
+                                   // Find 4 slots in the cacheline
+                                   for(int i = 0; i < numFSLocs/2; i ++) {
+                                     int idx = rdtsc() % numFSLocs;
+                                     FalseSharingLocs tmpVal = falseSharingLocs[idx];
+                                     falseSharingLocs[idx] = falseSharingLocs[i];
+                                     falseSharingLocs[i] = tmpVal;
+                                   }
+                                   for(int i = 0; i < MIN(numFSLocs, wpConfig.maxWP); i ++) {
+                                     SampleData_t sd= {
+                                       .va = (void *) falseSharingLocs[i].va,
+                                       .node = localIPCInfo.backtrace,
+                                       .accessType=localIPCInfo.accessType,
+                                       .type=localIPCInfo.wpType,
+                                       .wpLength = falseSharingLocs[i].wpLen,
+                                       .accessLength= accessLen,
+                                       .sampledMetricId=sampledMetricId,
+                                       .isSamplePointAccurate = isSamplePointAccurate,
+                                       .preWPAction=theWPConfig->preWPAction,
+                                       .isBackTrace = true
+                                     };
+                                     SubscribeWatchpoint(&sd, OVERWRITE, false /* capture value */);
+                                   }
+                                 }
+                                 break;
+      case WP_IPC_ALL_SHARING: {
+                                 assert(0);
+                               }
+                               break;
+      default:
+                               break;
     }
-
-
+  } else if((globalIPCInfo = WPIPCBeginPublish(paLine, me, curTime, maxAge, &slot)) != NULL) {
+    // Nobody else touched this line lately: publish my access
     globalIPCInfo->time = rdtsc();
     globalIPCInfo->tid = myTid;
     globalIPCInfo->wpType = accessType == LOAD ? WP_WRITE : WP_RW;
     globalIPCInfo->accessType = accessType;
-    globalIPCInfo->address = pa;
-    globalIPCInfo->offset = PAGE_OFFSET(data_addr);
+    globalIPCInfo->address = paLine;
+    globalIPCInfo->offset = (uintptr_t) data_addr & (wpConfig.pgsz - 1);
     globalIPCInfo->accessLen = accessLen;
 
     int btLen = 0;
@@ -4556,78 +4258,7 @@ static void HandleIPCFalseSharing(void * data_addr, void * pc, cct_node_t *node,
       globalIPCInfo->backtrace[btLen].ip_norm.lm_id = 0;
       globalIPCInfo->backtrace[btLen].ip_norm.lm_ip = 0;
     }
-    __sync_synchronize();
-    ipcSharedData->counter = theCounter + 2; // makes the counter even
-  } else if ((globalIPCInfo->tid != me)  && (globalIPCInfo->tid != -1)/* dont set WP for my own accessed locations */){
-    // If the data is "new" set the WP
-SET_FS_WP: ReadIPCSharedDataTransactionally(&localIPCInfo);
-           // Get the VA from PA
-           void * va = GetVAfromPA (localIPCInfo.address);
-           if(va == INVALID_VIRUAL_ADDRESS) {
-             goto ErrExit;
-           }
-
-           va = va + localIPCInfo.offset;
-
-           long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-           accessedIns += metricThreshold;
-
-           switch (theWPConfig->id) {
-             case WP_IPC_TRUE_SHARING:{
-                                        // Set WP at the same address
-                                        SampleData_t sd= {
-                                          .va = va,
-                                          .node = localIPCInfo.backtrace,
-                                          .accessType=localIPCInfo.accessType,
-                                          .type=localIPCInfo.wpType,
-                                          .wpLength = GetFloorWPLengthAtAddress(va, accessLen),
-                                          .accessLength= accessLen,
-                                          .sampledMetricId=sampledMetricId,
-                                          .isSamplePointAccurate = isSamplePointAccurate,
-                                          .preWPAction=theWPConfig->preWPAction,
-                                          .isBackTrace = true
-                                        };
-                                        SubscribeWatchpoint(&sd, OVERWRITE, false /* capture value */);
-                                      }
-                                      break;
-             case WP_IPC_FALSE_SHARING: {
-                                          int wpSizes[] = {8, 4, 2, 1};
-                                          FalseSharingLocs falseSharingLocs[CACHE_LINE_SZ];
-                                          int numFSLocs = 0;
-                                          GetAllFalseSharingLocations((size_t) va, accessLen, ALIGN_TO_CACHE_LINE((size_t)va), CACHE_LINE_SZ, wpSizes, 0 /*curWPSizeIdx*/ , 4 /*totalWPSizes*/, falseSharingLocs, &numFSLocs);
-                                          // Find 4 slots in the cacheline
-                                          for(int i = 0; i < numFSLocs/2; i ++) {
-                                            int idx = rdtsc() % numFSLocs;
-                                            FalseSharingLocs tmpVal = falseSharingLocs[idx];
-                                            falseSharingLocs[idx] = falseSharingLocs[i];
-                                            falseSharingLocs[i] = tmpVal;
-                                          }
-                                          for(int i = 0; i < MIN(numFSLocs, wpConfig.maxWP); i ++) {
-                                            SampleData_t sd= {
-                                              .va = (void *) falseSharingLocs[i].va,
-                                              .node = localIPCInfo.backtrace,
-                                              .accessType=localIPCInfo.accessType,
-                                              .type=localIPCInfo.wpType,
-                                              .wpLength = falseSharingLocs[i].wpLen,
-                                              .accessLength= accessLen,
-                                              .sampledMetricId=sampledMetricId,
-                                              .isSamplePointAccurate = isSamplePointAccurate,
-                                              .preWPAction=theWPConfig->preWPAction,
-                                              .isBackTrace = true
-                                            };
-                                            SubscribeWatchpoint(&sd, OVERWRITE, false /* capture value */);
-                                          }
-                                        }
-                                        break;
-             case WP_IPC_ALL_SHARING: {
-                                        assert(0);
-                                      }
-                                      break;
-             default:
-                                      break;
-           }
-  }else{
-    /* dont set WP for my own accessed locations */
+    WPIPCEndPublish(slot);
   }
 ErrExit:
   lastTime = rdtsc();
@@ -4714,6 +4345,12 @@ void hashInsertwithTime(struct SharedEntry item, uint64_t cur_time, uint64_t pre
   int hashIndex = hashCode(cacheLineBaseAddress);
 
   if ((bulletinBoard.hashTable[hashIndex].cacheLineBaseAddress == -1) || (item.tid != bulletinBoard.hashTable[hashIndex].tid) || ((item.time - bulletinBoard.hashTable[hashIndex].time) > (cur_time - prev_time))) {
+    // other threads copy the node into their watchpoints, where we
+    // cannot protect it: pin it before it becomes visible. readers take
+    // entries up to twice their expiration period old.
+    WPPublish(item.node, &bulletinBoard.hashTable[hashIndex].node,
+        &bulletinBoard.hashTable[hashIndex].time, item.time,
+        2 * (uint64_t) item.expiration_period);
     bulletinBoard.hashTable[hashIndex] = item;
   }
 }
@@ -4744,6 +4381,7 @@ int ibs_get_mem_width(int mem_width) {
 }
 
 bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context, cct_node_t *node, int sampledMetricId) {
+  WPCounterPoll();
   if (strncmp (hpcrun_id2metric(sampledMetricId)->name,"L2_RQSTS.MISS", 13) == 0)
     fprintf(stderr, "there is an L2_RQSTS.MISS 1\n"); 
   //fprintf(stderr, "in OnSample\n");
@@ -4794,10 +4432,16 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 	accessLen = ibs_get_mem_width(mmap_data->mem_width);
 	//fprintf(stderr, "mem_width: %d, accessLen: %d\n", mmap_data->mem_width, accessLen); 		
   }
+  else if(getEntryFromAccessTypeLengthCache(precisePC, (uint32_t*)(&accessLen), &accessType, NULL)) {
+    // decoded before, by a sample or a trap
+  }
   else if(false == get_mem_access_length_and_type(precisePC, (uint32_t*)(&accessLen), &accessType)){
     //EMSG("Sampled a non load store at = %p\n", precisePC);
     goto ErrExit; // incorrect access type
   }
+  else if(accessType != UNKNOWN && accessLen != 0) {
+    insertEntryToAccessTypeLengthCache(precisePC, accessLen, accessType, NULL);
+  }
   //fprintf(stderr, "in OnSample, sampled address: %lx, disassembled address: %lx, mmap_data->addr_valid: %d\n", data_addr, addr1, mmap_data->addr_valid);
   if(!amd_ibs_flag && (accessType == UNKNOWN || accessLen == 0)){
     //EMSG("Sampled sd.accessType = %d, accessLen=%d at precisePC = %p\n", accessType, accessLen, precisePC);
@@ -4823,8 +4467,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                         goto ErrExit; // incorrect access type
                       }
 
-                      long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                      writtenBytes += accessLen * metricThreshold;
+                      long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                      WPCounterAdd(WP_CTR_WRITTEN_BYTES, accessLen * metricThreshold);
                       SampleData_t sd= {
                         .va = data_addr,
                         .node = node,
@@ -4848,8 +4492,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                        goto ErrExit;
                      }
 
-                     long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                     writtenBytes += accessLen * metricThreshold;
+                     long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                     WPCounterAdd(WP_CTR_WRITTEN_BYTES, accessLen * metricThreshold);
                      SampleData_t sd= {
                        .va = data_addr,
                        .node = node,
@@ -4878,8 +4522,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                         goto ErrExit;
                       }
 
-                      long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                      loadedBytes += accessLen * metricThreshold;
+                      long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                      WPCounterAdd(WP_CTR_LOADED_BYTES, accessLen * metricThreshold);
                       // we use WP_RW because we cannot set WP_READ alone
                       SampleData_t sd= {
                         .va = data_addr,
@@ -4909,8 +4553,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 #else
                      if ( accessType != reuse_monitor_type && reuse_monitor_type != LOAD_AND_STORE) break;
 #endif
-                     long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                     accessedIns += metricThreshold;
+                     long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                     WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                      SampleData_t sd= {
                        .node = node,
                        .type=WP_RW,  //jqswang: Setting it to WP_READ causes segment fault
@@ -4997,10 +4641,10 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                             sample_count++;
                             int me = TD_GET(core_profile_trace_data.id);
 
-                            int my_core = sched_getcpu();
+                            int my_core = hpcrun_topology_current_cpu();
                             /*if((strncmp (hpcrun_id2metric(sampledMetricId)->name,"MEM_LOAD_RETIRED.L2_MISS",24) == 0))
                               fprintf(stderr, "l2 miss sample happens1\n");*/	
-                            //fprintf(stderr, "thread %d is sampled in core %d\n", me, sched_getcpu());
+                            //fprintf(stderr, "thread %d is sampled in core %d\n", me, hpcrun_topology_current_cpu());
                             //fprintf(stderr, "sample type: %s in thread %d, sample_count: %d\n", hpcrun_id2metric(sampledMetricId)->name, TD_GET(core_profile_trace_data.id), sample_count);	
                             int64_t storeCurTime = 0;
                             if(accessType == STORE || accessType == LOAD_AND_STORE) {
@@ -5013,8 +4657,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 #else
                             if ( accessType != reuse_monitor_type && reuse_monitor_type != LOAD_AND_STORE) break;
 #endif
-                            long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                            accessedIns += metricThreshold;
+                            long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                            WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                             SampleData_t sd= {
                               .node = node,
                               //.type=WP_RW,  //jqswang: Setting it to WP_READ causes segment fault
@@ -5227,10 +4871,11 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                               // before
                               int affinity_l3;
                               int affinity_l2;
+                              sd.first_accessing_core_id = my_core;
                               if(l2_count > 1) {
-                                affinity_l3 = thread_to_l3_mapping[my_core]; 
+                                affinity_l3 = CpuL3(my_core); 
                                 sd.L3Id = affinity_l3;
-                                affinity_l2 = thread_to_l2_mapping[my_core];
+                                affinity_l2 = CpuL2(my_core);
                                 sd.L2Id = affinity_l2;
                               }
 
@@ -5243,7 +4888,7 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                               int cur_global_thread_count = global_thread_count;
                               if(profiling_mode == L3 || profiling_mode == MIXED) {
                                 for(int i = 0; i < cur_global_thread_count; i++) {
-                                  if((mapping_size == 0) || (l3_count == 1) || (thread_to_l3_mapping[mapping_vector[i % mapping_size]] == affinity_l3)) {
+                                  if((mapping_size == 0) || (l3_count == 1) || (CpuL3(mapping_vector[i % mapping_size]) == affinity_l3)) {
                                     for (int j=0; j < MIN(2, reuse_distance_num_events); j++){
                                       uint64_t val[3];  
                                       linux_perf_read_event_counter_shared( reuse_distance_events[j], val, i/*locality_vector[affinity_l3][i+1]*/);
@@ -5300,7 +4945,7 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                                 if(mapping_size > 0) {
                                   core_id = mapping_vector[indices[i] % mapping_size];	
                                 }
-                                if((mapping_size == 0) || (thread_to_l3_mapping[core_id] == affinity_l3)) {
+                                if((mapping_size == 0) || (CpuL3(core_id) == affinity_l3)) {
                                   //fprintf(stderr, "a wp in thread %d is armed by thread %d to detect reuse\n", indices[i], me);
                                   if(indices[i] == me || profiling_mode == L3 || profiling_mode == MIXED) { 
                                     if (reuse_profile_type == REUSE_SPATIAL){ 
@@ -5382,8 +5027,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 		     mem_access_sample = mmap_data->mem_access_sample;
 		     valid_mem_access_sample = mmap_data->valid_mem_access_sample;
 		     sample_count++;
-                     long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                     accessedIns += metricThreshold;
+                     long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                     WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                      SampleData_t sd= {
                        .node = node,
                        .type=WP_RW,  //jqswang: Setting it to WP_READ causes segment fault
@@ -5466,7 +5111,7 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 			    sample_count++;
                             int me = TD_GET(core_profile_trace_data.id);
 
-                            int my_core = sched_getcpu();
+                            int my_core = hpcrun_topology_current_cpu();
                             int64_t storeCurTime = 0;
                             if(accessType == STORE || accessType == LOAD_AND_STORE) {
                               storeCurTime = curTime;
@@ -5478,8 +5123,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 #else
                             if ( accessType != reuse_monitor_type && reuse_monitor_type != LOAD_AND_STORE) break;
 #endif
-                            long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                            accessedIns += metricThreshold;
+                            long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                            WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                             SampleData_t sd= {
                               .node = node,
                               //.type=WP_RW,  //jqswang: Setting it to WP_READ causes segment fault
@@ -5702,10 +5347,11 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                               // before
                               int affinity_l3;
                               int affinity_l2;
+                              sd.first_accessing_core_id = my_core;
                               if(l2_count > 1) {
-                                affinity_l3 = thread_to_l3_mapping[my_core]; 
+                                affinity_l3 = CpuL3(my_core); 
                                 sd.L3Id = affinity_l3;
-                                affinity_l2 = thread_to_l2_mapping[my_core];
+                                affinity_l2 = CpuL2(my_core);
                                 sd.L2Id = affinity_l2;
                               }
 
@@ -5718,7 +5364,7 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                               int cur_global_thread_count = global_thread_count;
                               if(profiling_mode == L3 || profiling_mode == MIXED) {
                                 for(int i = 0; i < cur_global_thread_count; i++) {
-                                  if((mapping_size == 0) || (l3_count == 1) || (thread_to_l3_mapping[mapping_vector[i % mapping_size]] == affinity_l3)) {
+                                  if((mapping_size == 0) || (l3_count == 1) || (CpuL3(mapping_vector[i % mapping_size]) == affinity_l3)) {
 				    uint64_t val[3];  
                                     linux_perf_read_event_counter_shared( amd_reuse_distance_event, val, i/*locality_vector[affinity_l3][i+1]*/);
                                     for(int k=0; k < 3; k++) {
@@ -5777,7 +5423,7 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                                 if(mapping_size > 0) {
                                   core_id = mapping_vector[indices[i] % mapping_size];	
                                 }
-                                if((mapping_size == 0) || (thread_to_l3_mapping[core_id] == affinity_l3)) {
+                                if((mapping_size == 0) || (CpuL3(core_id) == affinity_l3)) {
                                   //fprintf(stderr, "a wp in thread %d is armed by thread %d to detect reuse\n", indices[i], me);
                                   if(indices[i] == me || profiling_mode == L3 || profiling_mode == MIXED) { 
                                     if (reuse_profile_type == REUSE_SPATIAL){ 
@@ -5855,8 +5501,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
 			  }
 			  break;
     case WP_SPATIAL_REUSE:{
-                            long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                            accessedIns += metricThreshold;
+                            long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                            WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
 
                             SampleData_t sd= {
                               .node = node,
@@ -5890,8 +5536,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                           }
                           break;
     case WP_TEMPORAL_REUSE:{
-                             long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                             accessedIns += metricThreshold;
+                             long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                             WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
 
                              SampleData_t sd= {
                                .va = data_addr,
@@ -5941,6 +5587,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                             localSharedData.node = node;
 
                             if(__sync_bool_compare_and_swap(&gSharedData.counter, theCounter, theCounter+1)){
+                              WPPublish(node, &gSharedData.node, &gSharedData.time,
+                                  localSharedData.time, UINT64_MAX); // see hashInsertwithTime
                               gSharedData = localSharedData;
                               __sync_synchronize();
                               gSharedData.counter++; // makes the counter even
@@ -5951,8 +5599,8 @@ bool OnSample(perf_mmap_data_t * mmap_data, /*void * contextPC*/void * context,
                           } else if ((localSharedData.tid != me)  && (localSharedData.tid != -1)/* dont set WP for my own accessed locations */){
                             // If the data is "new" set the WP
 SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
-           long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-           accessedIns += metricThreshold;
+           long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+           WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
 
            switch (theWPConfig->id) {
              case WP_TRUE_SHARING:{
@@ -6043,8 +5691,8 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
 
     case WP_IPC_FALSE_SHARING:
     case WP_IPC_TRUE_SHARING: {
-                                UpdateVMMap();
-                                HandleIPCFalseSharing(data_addr, precisePC, node, accessLen, accessType, sampledMetricId, isSamplePointAccurate);
+                                WPIPCCheckMaps();
+                                HandleIPCFalseSharing(mmap_data, data_addr, precisePC, node, accessLen, accessType, sampledMetricId, isSamplePointAccurate);
                               }
                               break;
 
@@ -6090,7 +5738,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
 
 
                             	int me = TD_GET(core_profile_trace_data.id);
-                            	int current_core = sched_getcpu();
+                            	int current_core = hpcrun_topology_current_cpu();
                             // L1 = getCacheline ( M1 )
                             	void * cacheLineBaseAddressVar = (void *) ALIGN_TO_CACHE_LINE((size_t)data_addr);
                             	int item_not_found = 0;
@@ -6129,11 +5777,11 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                 int flag = 0;
                                 double global_sampling_period = 0;
                                 if(sType == ALL_LOAD /*accessType == LOAD*/) { // means that the sample is (read) (WAR)
-                                  global_sampling_period = (double) hpcrun_id2metric(sampledMetricId)->period;
+                                  global_sampling_period = (double) SamplePeriod(mmap_data, sampledMetricId);
                                   flag = 1;
                                 }
                                 if(sType == ALL_STORE) { // means that the sample is a store type (write) (WAW)
-                                  global_sampling_period = (double) hpcrun_id2metric(sampledMetricId)->period;
+                                  global_sampling_period = (double) SamplePeriod(mmap_data, sampledMetricId);
                                   flag = 2;
                                 }
 			       //fprintf(stderr, "IBS_OP sample period in OnSample: %0.2lf\n", (double) global_sampling_period);	
@@ -6180,7 +5828,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                   if(GET_OVERLAP_BYTES(item.address, item.accessLen, data_addr, accessLen) > 0) { //then ts
 
                                     // ends
-                                    trueWRIns ++;
+                                    WPCounterInc(WP_CTR_TRUE_WR_INS);
                                     metricId = true_wr_metric_id;
                                     joinNode = joinNodes[E_TRUE_WR_SHARE][joinNodeIdx];
 
@@ -6194,7 +5842,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                   } else { 
                                 
 
-                                    falseWRIns ++;
+                                    WPCounterInc(WP_CTR_FALSE_WR_INS);
                                     metricId = false_wr_metric_id;
                                     joinNode = joinNodes[E_FALSE_WR_SHARE][joinNodeIdx];
 
@@ -6235,7 +5883,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                   if(GET_OVERLAP_BYTES(item.address, item.accessLen, data_addr, accessLen) > 0) { //then ts
                                     // ends
 
-                                    trueWWIns ++;
+                                    WPCounterInc(WP_CTR_TRUE_WW_INS);
                                     metricId = true_ww_metric_id;
                                     joinNode = joinNodes[E_TRUE_WW_SHARE][joinNodeIdx];
 
@@ -6245,13 +5893,13 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                       ts_core_matrix[item.core_id][current_core] = ts_core_matrix[item.core_id][current_core] + increment;
                                       waw_ts_core_matrix[item.core_id][current_core] = waw_ts_core_matrix[item.core_id][current_core] + increment;			    }
                                   } else {
-                                    /*falseWWIns ++;
+                                    /*WPCounterInc(WP_CTR_FALSE_WW_INS);
                                       metricId =  false_ww_metric_id;
                                       cct_metric_data_increment(metricId, node, (cct_metric_data_t){.i = 1});*/
                                     // Record false sharing
 #if ADAMANT_USED
                                    #endif
-                                    falseWWIns ++;
+                                    WPCounterInc(WP_CTR_FALSE_WW_INS);
                                     metricId = false_ww_metric_id;
                                     joinNode = joinNodes[E_FALSE_WW_SHARE][joinNodeIdx];
 
@@ -6314,19 +5962,20 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                               }while(1);
 
                               if((localSharedData.cacheLineBaseAddress != -1) && !do_not_arm_watchpoint) {
-                                long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                                accessedIns += metricThreshold;
+                                long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                                WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                                 void * cacheLineBaseAddress = localSharedData.cacheLineBaseAddress;
+                                int numWP = WPAdaptiveActiveWP();
                                 int shuffleNums[CACHE_LINE_SZ/MAX_WP_LENGTH] = {0, 1, 2, 3, 4, 5, 6, 7}; // hard coded
-                                for(int i = 0; i < wpConfig.maxWP; i ++) {
+                                for(int i = 0; i < numWP; i ++) {
                                   int idx = rdtsc() & (CACHE_LINE_SZ/MAX_WP_LENGTH -1);
                                   int tmpVal = shuffleNums[idx];
                                   shuffleNums[idx] = shuffleNums[i];
                                   shuffleNums[i] = tmpVal;
                                 }
-                                number_of_arming++;
+                                WPCounterInc(WP_CTR_COMM_ARMS);
 
-                                for(int i = 0; i < wpConfig.maxWP; i ++) {
+                                for(int i = 0; i < numWP; i ++) {
                                   SampleData_t sd= {
                                     .va = cacheLineBaseAddress + (shuffleNums[i] << 3),
                                     .target_va = localSharedData.address,
@@ -6345,7 +5994,9 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                     .first_accessing_core_id = localSharedData.core_id,
                                     .bulletinBoardTimestamp = localSharedData.time,
                                     .expirationPeriod = localSharedData.expiration_period,
-				    .valid_sample_count = localSharedData.valid_sample_count
+				    .valid_sample_count = localSharedData.valid_sample_count,
+                                    .samplingPeriod = metricThreshold,
+                                    .numWatchpoints = numWP
                                   };
                                   // if current WPs in T are old then
                                   // Disarm any previously armed WPs
@@ -6370,7 +6021,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                   struct SharedEntry inserted_item;
                                   inserted_item.time = curtime;
                                   inserted_item.tid = me;
-                                  inserted_item.core_id = sched_getcpu();
+                                  inserted_item.core_id = hpcrun_topology_current_cpu();
                                   inserted_item.wpType = WP_RW;
                                   inserted_item.accessType = accessType;
                                   inserted_item.sampleType = sType;
@@ -6433,7 +6084,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
 
 
                             int me = TD_GET(core_profile_trace_data.id); 
-                            int current_core = sched_getcpu(); 
+                            int current_core = hpcrun_topology_current_cpu(); 
                             // L1 = getCacheline ( M1 )
                             void * cacheLineBaseAddressVar = (void *) ALIGN_TO_CACHE_LINE((size_t)data_addr);
                             int item_not_found = 0;
@@ -6469,11 +6120,11 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                 int flag = 0;
                                 double global_sampling_period = 0;
                                 if(sType == ALL_LOAD /*accessType == LOAD*/) { // means that the sample is (read) (WAR)
-                                  global_sampling_period = (double) global_load_sampling_period;
+                                  global_sampling_period = (double) SamplePeriod(mmap_data, sampledMetricId);
                                   flag = 1;
                                 }
                                 if(sType == ALL_STORE) { // means that the sample is a store type (write) (WAW)
-                                  global_sampling_period = (double) global_store_sampling_period;
+                                  global_sampling_period = (double) SamplePeriod(mmap_data, sampledMetricId);
                                   flag = 2;
                                 } 
                                 int max_thread_num = item.tid; 
@@ -6535,7 +6186,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                     }
 #endif
                                     // ends
-                                    trueWRIns ++;
+                                    WPCounterInc(WP_CTR_TRUE_WR_INS);
                                     metricId = true_wr_metric_id;
                                     joinNode = joinNodes[E_TRUE_WR_SHARE][joinNodeIdx];
 
@@ -6568,7 +6219,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                       ts_core_matrix[item.core_id][current_core] = ts_core_matrix[item.core_id][current_core] + increment;
                                       war_ts_core_matrix[item.core_id][current_core] = war_ts_core_matrix[item.core_id][current_core] + increment;        			    }
                                   } else {
-                                    /*falseWWIns ++;
+                                    /*WPCounterInc(WP_CTR_FALSE_WW_INS);
                                       metricId =  false_ww_metric_id;
                                       cct_metric_data_increment(metricId, node, (cct_metric_data_t){.i = 1});*/
                                     // Record false sharing
@@ -6600,7 +6251,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                     }
 #endif
 
-                                    falseWRIns ++;
+                                    WPCounterInc(WP_CTR_FALSE_WR_INS);
                                     metricId = false_wr_metric_id;
                                     joinNode = joinNodes[E_FALSE_WR_SHARE][joinNodeIdx];
 
@@ -6681,7 +6332,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
 #endif
                                     // ends
 
-                                    trueWWIns ++;
+                                    WPCounterInc(WP_CTR_TRUE_WW_INS);
                                     metricId = true_ww_metric_id;
                                     joinNode = joinNodes[E_TRUE_WW_SHARE][joinNodeIdx];
 
@@ -6713,7 +6364,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                       ts_core_matrix[item.core_id][current_core] = ts_core_matrix[item.core_id][current_core] + increment;
                                       waw_ts_core_matrix[item.core_id][current_core] = waw_ts_core_matrix[item.core_id][current_core] + increment;			    }
                                   } else {
-                                    /*falseWWIns ++;
+                                    /*WPCounterInc(WP_CTR_FALSE_WW_INS);
                                       metricId =  false_ww_metric_id;
                                       cct_metric_data_increment(metricId, node, (cct_metric_data_t){.i = 1});*/
                                     // Record false sharing
@@ -6745,7 +6396,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                     }
 #endif
 
-                                    falseWWIns ++;
+                                    WPCounterInc(WP_CTR_FALSE_WW_INS);
                                     metricId = false_ww_metric_id;
                                     joinNode = joinNodes[E_FALSE_WW_SHARE][joinNodeIdx];
 
@@ -6835,19 +6486,20 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                               }while(1);
 
                               if((localSharedData.cacheLineBaseAddress != -1) && !do_not_arm_watchpoint) {
-                                long  metricThreshold = hpcrun_id2metric(sampledMetricId)->period;
-                                accessedIns += metricThreshold;
+                                long  metricThreshold = SamplePeriod(mmap_data, sampledMetricId);
+                                WPCounterAdd(WP_CTR_ACCESSED_INS, metricThreshold);
                                 void * cacheLineBaseAddress = localSharedData.cacheLineBaseAddress;
+                                int numWP = WPAdaptiveActiveWP();
                                 int shuffleNums[CACHE_LINE_SZ/MAX_WP_LENGTH] = {0, 1, 2, 3, 4, 5, 6, 7}; // hard coded
-                                for(int i = 0; i < wpConfig.maxWP; i ++) {
+                                for(int i = 0; i < numWP; i ++) {
                                   int idx = rdtsc() & (CACHE_LINE_SZ/MAX_WP_LENGTH -1);
                                   int tmpVal = shuffleNums[idx];
                                   shuffleNums[idx] = shuffleNums[i];
                                   shuffleNums[i] = tmpVal;
                                 }
-                                number_of_arming++;
+                                WPCounterInc(WP_CTR_COMM_ARMS);
 
-                                for(int i = 0; i < wpConfig.maxWP; i ++) {
+                                for(int i = 0; i < numWP; i ++) {
                                   SampleData_t sd= {
                                     .va = cacheLineBaseAddress + (shuffleNums[i] << 3),
                                     .target_va = localSharedData.address,
@@ -6865,7 +6517,9 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                     .first_accessing_tid = localSharedData.tid,
                                     .first_accessing_core_id = localSharedData.core_id,
                                     .bulletinBoardTimestamp = localSharedData.time,
-                                    .expirationPeriod = localSharedData.expiration_period
+                                    .expirationPeriod = localSharedData.expiration_period,
+                                    .samplingPeriod = metricThreshold,
+                                    .numWatchpoints = numWP
                                   };
                                   // if current WPs in T are old then
                                   // Disarm any previously armed WPs
@@ -6893,7 +6547,7 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                                   struct SharedEntry inserted_item;
                                   inserted_item.time = curtime;
                                   inserted_item.tid = me;
-                                  inserted_item.core_id = sched_getcpu();
+                                  inserted_item.core_id = hpcrun_topology_current_cpu();
                                   inserted_item.wpType = WP_RW;
                                   inserted_item.accessType = accessType;
                                   inserted_item.sampleType = sType;
@@ -6921,11 +6575,11 @@ SET_FS_WP: ReadSharedDataTransactionally(&localSharedData);
                           break;
   }
   //fprintf(stderr, "here7!\n");
-  wpStats.numWatchpointsSet ++;
+  WPCounterInc(WP_CTR_WATCHPOINTS_SET);
   return true;
 
 ErrExit:
-  wpStats.numImpreciseSamples ++;
+  WPCounterInc(WP_CTR_IMPRECISE_SAMPLES);
   return false;
 
 }
@@ -6947,24 +6601,7 @@ void dump_profiling_metrics() {
   }
 //#endif
   if(theWPConfig->id == WP_COMDETECTIVE || theWPConfig->id == WP_AMD_COMM) {
-    dump_fs_matrix();
-    dump_fs_core_matrix();
-    dump_ts_matrix();
-    dump_ts_core_matrix();
-    dump_as_matrix();
-    dump_as_core_matrix();
-    dump_war_fs_matrix();
-    dump_war_fs_core_matrix();
-    dump_war_ts_matrix();
-    dump_war_ts_core_matrix();
-    dump_war_as_matrix();
-    dump_war_as_core_matrix();
-    dump_waw_fs_matrix();
-    dump_waw_fs_core_matrix();
-    dump_waw_ts_matrix();
-    dump_waw_ts_core_matrix();
-    dump_waw_as_matrix();
-    dump_waw_as_core_matrix();
+    dump_comm_matrices();
   } 
   if(theWPConfig->id == WP_REUSETRACKER) {
 #ifdef REUSE_HISTO
@@ -0,0 +1,309 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Sharded registry of the watchpoint counters, see watchpoint_counters.h.
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
+#include <messages/fmt.h>
+#include <messages/messages.h>
+#include <hpcrun/files.h>
+
+#include "watchpoint_counters.h"
+
+#define JSON_LINE_MAX 8192
+
+static WPCounterShard_t counterShards[WP_COUNTER_MAX_SHARDS];
+static WPCounterShard_t overflowShard = {.shared = true};
+static atomic_int nextShard = ATOMIC_VAR_INIT(0);
+
+// shards of exited threads, and a sequence count that is odd while a
+// shard's values move to the overflow shard
+static WPCounterShard_t *freeShards = NULL;
+static spinlock_t freeLock = SPINLOCK_UNLOCKED;
+static atomic_uint_least64_t retireSeq = ATOMIC_VAR_INIT(0);
+
+__thread WPCounterShard_t *wpCounterShard = &overflowShard;
+
+static const char *counterNames[WP_COUNTER_MAX] = {
+  [WP_CTR_IMPRECISE_SAMPLES]       = "impreciseSamples",
+  [WP_CTR_WATCHPOINTS_SET]         = "watchpointsSet",
+  [WP_CTR_ARMS]                    = "arms",
+  [WP_CTR_DISARMS]                 = "disarms",
+  [WP_CTR_ARM_CYCLES]              = "armCycles",
+  [WP_CTR_DISARM_CYCLES]           = "disarmCycles",
+  [WP_CTR_CLIENT_TRAPS]            = "clientTraps",
+  [WP_CTR_CAUGHT_READ_TRAPS]       = "caughtReadTraps",
+  [WP_CTR_CAUGHT_WRITE_TRAPS]      = "caughtWriteTraps",
+  [WP_CTR_CAUGHT_READ_WRITE_TRAPS] = "caughtReadWriteTraps",
+  [WP_CTR_COMM_ARMS]               = "commArms",
+  [WP_CTR_WRITTEN_BYTES]           = "writtenBytes",
+  [WP_CTR_LOADED_BYTES]            = "loadedBytes",
+  [WP_CTR_USED_BYTES]              = "usedBytes",
+  [WP_CTR_DEAD_BYTES]              = "deadBytes",
+  [WP_CTR_OLD_BYTES]               = "oldBytes",
+  [WP_CTR_OLD_APPX_BYTES]          = "oldAppxBytes",
+  [WP_CTR_NEW_BYTES]               = "newBytes",
+  [WP_CTR_ACCESSED_INS]            = "accessedIns",
+  [WP_CTR_FALSE_WW_INS]            = "falseWWIns",
+  [WP_CTR_FALSE_WR_INS]            = "falseWRIns",
+  [WP_CTR_FALSE_RW_INS]            = "falseRWIns",
+  [WP_CTR_TRUE_WW_INS]             = "trueWWIns",
+  [WP_CTR_TRUE_WR_INS]             = "trueWRIns",
+  [WP_CTR_TRUE_RW_INS]             = "trueRWIns",
+  [WP_CTR_REUSE]                   = "reuse",
+  [WP_CTR_REUSE_TEMPORAL]          = "reuseTemporal",
+  [WP_CTR_REUSE_SPATIAL]           = "reuseSpatial",
+  [WP_CTR_MT_REUSE_TEMPORAL]       = "mtReuseTemporal",
+  [WP_CTR_MT_REUSE_SPATIAL]        = "mtReuseSpatial",
+};
+static atomic_int numCounters = ATOMIC_VAR_INIT(WP_CTR_NUM_BUILTIN);
+static spinlock_t registerLock = SPINLOCK_UNLOCKED;
+
+// JSON output; disabled unless HPCRUN_WP_COUNTERS_INTERVAL is set
+static bool jsonEnabled = false;
+static uint64_t intervalNs = 0;
+static atomic_uint_least64_t nextSnapshotNs = ATOMIC_VAR_INIT(0);
+static atomic_int jsonFd = ATOMIC_VAR_INIT(-1);
+
+int WPCounterRegister(const char *name) {
+  int id = -1;
+  spinlock_lock(&registerLock);
+  int n = atomic_load_explicit(&numCounters, memory_order_relaxed);
+  for (int i = 0; i < n; i++) {
+    if (strcmp(counterNames[i], name) == 0) {
+      id = i;
+      break;
+    }
+  }
+  if (id < 0 && n < WP_COUNTER_MAX) {
+    counterNames[n] = name;
+    id = n;
+    // publish the name before the count that makes it visible
+    atomic_store_explicit(&numCounters, n + 1, memory_order_release);
+  }
+  spinlock_unlock(&registerLock);
+  if (id < 0)
+    EMSG("WATCHPOINT: counter registry full, dropping counter %s", name);
+  return id;
+}
+
+const char *WPCounterName(int id) {
+  return (id >= 0 && id < WPCounterCount()) ? counterNames[id] : NULL;
+}
+
+int WPCounterCount(void) {
+  return atomic_load_explicit(&numCounters, memory_order_acquire);
+}
+
+void WPCounterThreadInit(void) {
+  if (!wpCounterShard->shared)
+    return;
+
+  spinlock_lock(&freeLock);
+  WPCounterShard_t *s = freeShards;
+  if (s)
+    freeShards = s->nextFree;
+  spinlock_unlock(&freeLock);
+
+  if (!s) {
+    int i = atomic_fetch_add_explicit(&nextShard, 1, memory_order_relaxed);
+    if (i < WP_COUNTER_MAX_SHARDS)
+      s = &counterShards[i];
+  }
+  if (s)
+    wpCounterShard = s;
+}
+
+void WPCounterThreadFini(void) {
+  WPCounterShard_t *s = wpCounterShard;
+  if (s->shared)
+    return;
+  wpCounterShard = &overflowShard;
+
+  spinlock_lock(&freeLock);
+  atomic_fetch_add_explicit(&retireSeq, 1, memory_order_acq_rel);
+  for (int i = 0; i < WP_COUNTER_MAX; i++) {
+    uint64_t v = atomic_load_explicit(&s->val[i], memory_order_relaxed);
+    if (v) {
+      atomic_fetch_add_explicit(&overflowShard.val[i], v, memory_order_relaxed);
+      atomic_store_explicit(&s->val[i], 0, memory_order_relaxed);
+    }
+  }
+  atomic_fetch_add_explicit(&retireSeq, 1, memory_order_acq_rel);
+  s->nextFree = freeShards;
+  freeShards = s;
+  spinlock_unlock(&freeLock);
+}
+
+static int ShardsInUse(void) {
+  int n = atomic_load_explicit(&nextShard, memory_order_relaxed);
+  return n < WP_COUNTER_MAX_SHARDS ? n : WP_COUNTER_MAX_SHARDS;
+}
+
+// a sum that overlaps a retiring shard may count its values twice or
+// not at all, so it is retried. the retries are bounded: the snapshot
+// may run in a signal handler that interrupted the retiring thread.
+#define SNAPSHOT_TRIES 4
+
+int WPCounterSnapshot(uint64_t *out) {
+  int n = WPCounterCount();
+  int shards = ShardsInUse();
+  for (int t = 0; t < SNAPSHOT_TRIES; t++) {
+    uint64_t seq = atomic_load_explicit(&retireSeq, memory_order_acquire);
+    for (int i = 0; i < n; i++)
+      out[i] = atomic_load_explicit(&overflowShard.val[i], memory_order_relaxed);
+    for (int s = 0; s < shards; s++) {
+      for (int i = 0; i < n; i++)
+        out[i] += atomic_load_explicit(&counterShards[s].val[i], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if ((seq & 1) == 0 && seq == atomic_load_explicit(&retireSeq, memory_order_relaxed))
+      break;
+  }
+  return n;
+}
+
+static uint64_t NowNs(clockid_t clk) {
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int JSONFd(void) {
+  int fd = atomic_load_explicit(&jsonFd, memory_order_acquire);
+  if (fd >= 0)
+    return fd;
+
+  char path[PATH_MAX];
+  hpcrun_msg_ns(path, sizeof(path), "%s/%s-%d.wpcounters.json",
+                hpcrun_files_output_directory(), hpcrun_files_executable_name(), (int) getpid());
+  fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    return -1;
+  int expected = -1;
+  if (!atomic_compare_exchange_strong(&jsonFd, &expected, fd)) {
+    // another thread got there first
+    close(fd);
+    fd = expected;
+  }
+  return fd;
+}
+
+// One line per snapshot, e.g.
+// {"pid":42,"time_ns":...,"reason":"periodic","threads":8,"counters":{"arms":..,...}}
+// written with a single O_APPEND write so concurrent snapshots never interleave.
+void WPCounterWriteJSON(const char *reason) {
+  if (!jsonEnabled)
+    return;
+  int fd = JSONFd();
+  if (fd < 0)
+    return;
+
+  uint64_t val[WP_COUNTER_MAX];
+  int n = WPCounterSnapshot(val);
+
+  char buf[JSON_LINE_MAX];
+  size_t len = hpcrun_msg_ns(buf, sizeof(buf),
+                             "{\"pid\":%d,\"time_ns\":%lu,\"reason\":\"%s\",\"threads\":%d,\"counters\":{",
+                             (int) getpid(), NowNs(CLOCK_REALTIME), reason, ShardsInUse());
+  for (int i = 0; i < n && len < sizeof(buf); i++) {
+    len += hpcrun_msg_ns(buf + len, sizeof(buf) - len, "%s\"%s\":%lu",
+                         i ? "," : "", counterNames[i], val[i]);
+  }
+  if (len + 3 >= sizeof(buf)) {
+    EMSG("WATCHPOINT: counter snapshot truncated");
+    return;
+  }
+  buf[len++] = '}';
+  buf[len++] = '}';
+  buf[len++] = '\n';
+  if (write(fd, buf, len) != (ssize_t) len)
+    EMSG("WATCHPOINT: short write of the counter snapshot");
+}
+
+void WPCounterPoll(void) {
+  if (intervalNs == 0)
+    return;
+  uint64_t now = NowNs(CLOCK_MONOTONIC);
+  uint64_t next = atomic_load_explicit(&nextSnapshotNs, memory_order_relaxed);
+  if (now < next)
+    return;
+  // only the thread that moves the deadline writes the snapshot
+  if (!atomic_compare_exchange_strong(&nextSnapshotNs, &next, now + intervalNs))
+    return;
+  WPCounterWriteJSON("periodic");
+}
+
+// HPCRUN_WP_COUNTERS_INTERVAL: seconds between snapshots, 0 for only
+// the final snapshot at shutdown; unset disables the JSON output.
+void WPCounterProcessInit(void) {
+  const char *s = getenv("HPCRUN_WP_COUNTERS_INTERVAL");
+  if (s == NULL || *s == '\0')
+    return;
+  char *end;
+  double secs = strtod(s, &end);
+  if (*end != '\0' || secs < 0) {
+    EMSG("WATCHPOINT: ignoring bad HPCRUN_WP_COUNTERS_INTERVAL=%s", s);
+    return;
+  }
+  jsonEnabled = true;
+  intervalNs = (uint64_t) (secs * 1e9);
+  atomic_store_explicit(&nextSnapshotNs, NowNs(CLOCK_MONOTONIC) + intervalNs, memory_order_relaxed);
+}
@@ -0,0 +1,173 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Registry of the watchpoint statistics counters.
+//
+// Every thread owns a cache-line aligned shard holding one slot per
+// counter; only the owner writes it, so an update is a plain relaxed
+// load and store with no lock prefix and no false sharing.  Readers
+// sum the shards at any time without stopping the writers, which is
+// what the periodic JSON snapshots (HPCRUN_WP_COUNTERS_INTERVAL) and
+// the final one at shutdown do.
+//
+// Threads beyond WP_COUNTER_MAX_SHARDS fall back to one shared shard
+// updated with fetch-and-add; they show up in the snapshots but not in
+// the per-thread values handed to hpcrun_stats.
+//
+// A thread that exits adds its values to the shared shard and puts its
+// own shard on a free list for the next thread, so programs that keep
+// creating short-lived threads do not run out of shards.
+//
+
+
+#ifndef __WATCHPOINT_COUNTERS_H__
+#define __WATCHPOINT_COUNTERS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <lib/prof-lean/stdatomic.h>
+
+#include "watchpoint_support.h"
+
+#define WP_COUNTER_MAX        64
+#define WP_COUNTER_MAX_SHARDS 1024
+
+// builtin counters; more can be added with WPCounterRegister
+typedef enum WPCounterId {
+  WP_CTR_IMPRECISE_SAMPLES,
+  WP_CTR_WATCHPOINTS_SET,
+  WP_CTR_ARMS,              // arms, including retargeting a live slot
+  WP_CTR_DISARMS,
+  WP_CTR_ARM_CYCLES,        // rdtsc cycles spent in the arms
+  WP_CTR_DISARM_CYCLES,
+  WP_CTR_CLIENT_TRAPS,      // traps handled by the client callbacks
+  WP_CTR_CAUGHT_READ_TRAPS,
+  WP_CTR_CAUGHT_WRITE_TRAPS,
+  WP_CTR_CAUGHT_READ_WRITE_TRAPS,
+  WP_CTR_COMM_ARMS,         // ComDetective arms on behalf of other threads
+  WP_CTR_WRITTEN_BYTES,
+  WP_CTR_LOADED_BYTES,
+  WP_CTR_USED_BYTES,
+  WP_CTR_DEAD_BYTES,
+  WP_CTR_OLD_BYTES,
+  WP_CTR_OLD_APPX_BYTES,
+  WP_CTR_NEW_BYTES,
+  WP_CTR_ACCESSED_INS,
+  WP_CTR_FALSE_WW_INS,
+  WP_CTR_FALSE_WR_INS,
+  WP_CTR_FALSE_RW_INS,
+  WP_CTR_TRUE_WW_INS,
+  WP_CTR_TRUE_WR_INS,
+  WP_CTR_TRUE_RW_INS,
+  WP_CTR_REUSE,
+  WP_CTR_REUSE_TEMPORAL,
+  WP_CTR_REUSE_SPATIAL,
+  WP_CTR_MT_REUSE_TEMPORAL,
+  WP_CTR_MT_REUSE_SPATIAL,
+  WP_CTR_NUM_BUILTIN
+} WPCounterId;
+
+typedef struct WPCounterShard {
+  atomic_uint_least64_t val[WP_COUNTER_MAX];
+  bool shared;
+  struct WPCounterShard *nextFree;
+} __attribute__((aligned(CACHE_LINE_SZ))) WPCounterShard_t;
+
+extern __thread WPCounterShard_t *wpCounterShard;
+
+static inline void WPCounterAdd(int id, uint64_t v) {
+  WPCounterShard_t *s = wpCounterShard;
+  if (s->shared) {
+    atomic_fetch_add_explicit(&s->val[id], v, memory_order_relaxed);
+  } else {
+    uint64_t old = atomic_load_explicit(&s->val[id], memory_order_relaxed);
+    atomic_store_explicit(&s->val[id], old + v, memory_order_relaxed);
+  }
+}
+
+static inline void WPCounterInc(int id) {
+  WPCounterAdd(id, 1);
+}
+
+// value accumulated by the calling thread, 0 on the shared shard
+static inline uint64_t WPCounterThreadValue(int id) {
+  WPCounterShard_t *s = wpCounterShard;
+  return s->shared ? 0 : atomic_load_explicit(&s->val[id], memory_order_relaxed);
+}
+
+// Register an extra counter; returns its id, the id of an existing
+// counter with the same name, or -1 when the registry is full.
+// The name must stay valid for the life of the process.
+extern int WPCounterRegister(const char *name);
+
+extern const char *WPCounterName(int id);
+extern int WPCounterCount(void);
+
+// Give the calling thread its own shard; safe to call more than once.
+extern void WPCounterThreadInit(void);
+
+// Retire the calling thread's shard at thread exit: its values move to
+// the shared shard and the shard goes back on the free list.
+extern void WPCounterThreadFini(void);
+
+// Sum every shard into out[0..WP_COUNTER_MAX); returns the number of
+// registered counters.  Async-signal safe.
+extern int WPCounterSnapshot(uint64_t *out);
+
+// Append one JSON object per call to <outdir>/<exe>-<pid>.wpcounters.json.
+// Async-signal safe.
+extern void WPCounterWriteJSON(const char *reason);
+
+// Write a periodic snapshot if HPCRUN_WP_COUNTERS_INTERVAL has elapsed;
+// cheap enough for the sample path.
+extern void WPCounterPoll(void);
+
+extern void WPCounterProcessInit(void);
+
+#endif
@@ -0,0 +1,247 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Two level decode cache for memory instructions, see
+// watchpoint_decode_cache.h.
+//
+
+#include <string.h>
+
+#include <hpcrun/loadmap.h>
+#include <lib/prof-lean/stdatomic.h>
+
+#include "watchpoint_counters.h"
+#include "watchpoint_decode_cache.h"
+
+// An entry packs the pc (user space addresses fit in 48 bits), the
+// access length, the access type and the float type; 0 is an empty
+// way.  ENTRY_FLOAT_NONE marks an entry whose float type was not
+// decoded.
+#define ENTRY_PC_BITS 48
+#define ENTRY_PC_MASK ((1ULL << ENTRY_PC_BITS) - 1)
+#define ENTRY_LEN_SHIFT ENTRY_PC_BITS
+#define ENTRY_TYPE_SHIFT (ENTRY_PC_BITS + 8)
+#define ENTRY_FLOAT_SHIFT (ENTRY_PC_BITS + 12)
+#define ENTRY_FLOAT_NONE 0xf
+
+typedef struct DecodeL1Set{
+  uint64_t way[DECODE_L1_WAYS];  // most recently used first
+} DecodeL1Set_t;
+
+typedef struct DecodeL2Set{
+  atomic_uint_least64_t way[DECODE_L2_WAYS];
+} __attribute__((aligned(CACHE_LINE_SZ))) DecodeL2Set_t;
+
+static DecodeL2Set_t decodeL2[DECODE_L2_SETS];
+static __thread DecodeL1Set_t decodeL1[DECODE_L1_SETS];
+
+// Entries are keyed by pc alone, so code mapped or unmapped by dlopen
+// and dlclose drops the entries in its range. The shared cache is
+// cleaned by the thread that changes the loadmap; every other thread
+// empties its own cache when it sees the loadmap generation move.
+static atomic_uint loadmapGen = ATOMIC_VAR_INIT(0);
+static __thread unsigned int decodeL1Gen = 0;
+
+static int l1HitCtr = -1, l2HitCtr = -1, missCtr = -1;
+
+static inline void CounterInc(int id) {
+  if (id >= 0)
+    WPCounterInc(id);
+}
+
+static void DecodeCacheInvalidate(void * start, void * end) {
+  uint64_t lo = (uint64_t) start & ENTRY_PC_MASK;
+  uint64_t hi = (uint64_t) end & ENTRY_PC_MASK;
+  for (int s = 0; s < DECODE_L2_SETS; s++) {
+    for (int i = 0; i < DECODE_L2_WAYS; i++) {
+      uint64_t e = atomic_load_explicit(&decodeL2[s].way[i], memory_order_relaxed);
+      uint64_t pc = e & ENTRY_PC_MASK;
+      // an entry replaced meanwhile is left alone
+      if (e != 0 && lo <= pc && pc < hi)
+        atomic_compare_exchange_strong_explicit(&decodeL2[s].way[i], &e, 0,
+                                                memory_order_relaxed, memory_order_relaxed);
+    }
+  }
+  atomic_fetch_add_explicit(&loadmapGen, 1, memory_order_release);
+}
+
+// empty the calling thread's cache if the loadmap changed since
+static inline void L1Validate(void) {
+  unsigned int gen = atomic_load_explicit(&loadmapGen, memory_order_acquire);
+  if (gen != decodeL1Gen) {
+    memset(decodeL1, 0, sizeof(decodeL1));
+    decodeL1Gen = gen;
+  }
+}
+
+void WPDecodeCacheProcessInit(void) {
+  static loadmap_notify_t notifier = {
+    .map = DecodeCacheInvalidate,
+    .unmap = DecodeCacheInvalidate,
+  };
+  static bool registered = false;
+
+  l1HitCtr = WPCounterRegister("decodeCacheL1Hits");
+  l2HitCtr = WPCounterRegister("decodeCacheL2Hits");
+  missCtr = WPCounterRegister("decodeCacheMisses");
+  if (!registered) {
+    hpcrun_loadmap_notify_register(&notifier);
+    registered = true;
+  }
+}
+
+static inline uint64_t SetHash(void * pc) {
+  // instructions are byte aligned; mix the low bits into the index
+  uint64_t h = (uint64_t) pc * 0x9E3779B97F4A7C15ULL;
+  return h >> 32;
+}
+
+static inline uint64_t MakeEntry(void * pc, uint32_t accessLen, AccessType accessType, const FloatType *floatType) {
+  uint64_t f = floatType ? (*floatType & 0xf) : ENTRY_FLOAT_NONE;
+  return ((uint64_t) pc & ENTRY_PC_MASK)
+    | ((uint64_t) (accessLen & 0xff) << ENTRY_LEN_SHIFT)
+    | ((uint64_t) (accessType & 0xf) << ENTRY_TYPE_SHIFT)
+    | (f << ENTRY_FLOAT_SHIFT);
+}
+
+static inline bool EntryMatches(uint64_t e, void * pc) {
+  return e != 0 && (e & ENTRY_PC_MASK) == ((uint64_t) pc & ENTRY_PC_MASK);
+}
+
+static inline bool EntryHasFloatType(uint64_t e) {
+  return ((e >> ENTRY_FLOAT_SHIFT) & 0xf) != ENTRY_FLOAT_NONE;
+}
+
+// an entry satisfies a lookup that wants the float type only if it
+// carries one
+static inline bool EntryHit(uint64_t e, void * pc, const FloatType *floatType) {
+  return EntryMatches(e, pc) && (floatType == NULL || EntryHasFloatType(e));
+}
+
+static inline void EntryDecode(uint64_t e, uint32_t *accessLen, AccessType *accessType, FloatType *floatType) {
+  *accessLen = (e >> ENTRY_LEN_SHIFT) & 0xff;
+  *accessType = (AccessType) ((e >> ENTRY_TYPE_SHIFT) & 0xf);
+  if (floatType)
+    *floatType = (FloatType) ((e >> ENTRY_FLOAT_SHIFT) & 0xf);
+}
+
+// move way i of the set to the front
+static inline void L1Promote(DecodeL1Set_t *set, int i, uint64_t e) {
+  for (; i > 0; i--)
+    set->way[i] = set->way[i - 1];
+  set->way[0] = e;
+}
+
+static inline void L1Insert(void * pc, uint64_t e) {
+  DecodeL1Set_t *set = &decodeL1[SetHash(pc) & (DECODE_L1_SETS - 1)];
+  // evicts the least recently used way
+  L1Promote(set, DECODE_L1_WAYS - 1, e);
+}
+
+bool getEntryFromAccessTypeLengthCache(void * pc, uint32_t *accessLen, AccessType *accessType, FloatType *floatType) {
+  L1Validate();
+  uint64_t h = SetHash(pc);
+  DecodeL1Set_t *l1 = &decodeL1[h & (DECODE_L1_SETS - 1)];
+  for (int i = 0; i < DECODE_L1_WAYS; i++) {
+    uint64_t e = l1->way[i];
+    if (EntryHit(e, pc, floatType)) {
+      if (i > 0)
+        L1Promote(l1, i, e);
+      EntryDecode(e, accessLen, accessType, floatType);
+      CounterInc(l1HitCtr);
+      return true;
+    }
+  }
+
+  DecodeL2Set_t *l2 = &decodeL2[(h >> 8) & (DECODE_L2_SETS - 1)];
+  for (int i = 0; i < DECODE_L2_WAYS; i++) {
+    uint64_t e = atomic_load_explicit(&l2->way[i], memory_order_relaxed);
+    if (EntryHit(e, pc, floatType)) {
+      L1Insert(pc, e);
+      EntryDecode(e, accessLen, accessType, floatType);
+      CounterInc(l2HitCtr);
+      return true;
+    }
+  }
+  CounterInc(missCtr);
+  return false;
+}
+
+void insertEntryToAccessTypeLengthCache(void * pc, uint32_t accessLen, AccessType accessType, const FloatType *floatType) {
+  L1Validate();
+  uint64_t e = MakeEntry(pc, accessLen, accessType, floatType);
+  uint64_t h = SetHash(pc);
+  DecodeL1Set_t *l1 = &decodeL1[h & (DECODE_L1_SETS - 1)];
+  int i;
+
+  // replace a stale copy of pc rather than shadowing it
+  for (i = 0; i < DECODE_L1_WAYS - 1; i++) {
+    if (EntryMatches(l1->way[i], pc))
+      break;
+  }
+  L1Promote(l1, i, e);
+
+  // Take the way already holding pc (upgrading it if the new entry
+  // carries the float type), else an empty way; otherwise evict a
+  // pseudo random way.  Racing inserts of the same pc at worst leave it
+  // in two ways of the set.
+  DecodeL2Set_t *l2 = &decodeL2[(h >> 8) & (DECODE_L2_SETS - 1)];
+  int victim = -1;
+  for (i = 0; i < DECODE_L2_WAYS; i++) {
+    uint64_t cur = atomic_load_explicit(&l2->way[i], memory_order_relaxed);
+    if (EntryMatches(cur, pc)) {
+      if (floatType && !EntryHasFloatType(cur))
+        atomic_store_explicit(&l2->way[i], e, memory_order_relaxed);
+      return;
+    }
+    if (cur == 0 && victim < 0)
+      victim = i;
+  }
+  if (victim < 0)
+    victim = rdtsc() & (DECODE_L2_WAYS - 1);
+  atomic_store_explicit(&l2->way[victim], e, memory_order_relaxed);
+}
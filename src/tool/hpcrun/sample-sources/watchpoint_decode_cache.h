@@ -0,0 +1,94 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+
+//
+// Cache of the decoded access type and length of memory instructions.
+//
+// The trap handler needs the access type and length of the instruction
+// that hit a watchpoint; disassembling it is the most expensive part of
+// handling a trap.  Lookups go to a small set-associative cache private
+// to the thread first and to a larger one shared by all threads second,
+// and only a miss in both disassembles.  Every way of the shared cache
+// is a single 64-bit word holding the pc, length, access type and float
+// type, so it is read and written without locks; one set fills one
+// cache line.  The accessed address depends on the registers at the
+// trap and is never cached.
+//
+// The sample handler inserts the instructions it decodes as well, so a
+// watchpoint trapping at a pc that was sampled before is a hit.
+//
+// A range of code mapped or unmapped in the loadmap (dlopen, dlclose)
+// drops its entries from both levels, so a library loaded where another
+// one was never hits the old one's decodes.
+//
+
+#ifndef __WATCHPOINT_DECODE_CACHE_H__
+#define __WATCHPOINT_DECODE_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "watchpoint_support.h"
+
+// per thread: 64 sets of 4 ways
+#define DECODE_L1_SETS 64
+#define DECODE_L1_WAYS 4
+// shared: 4096 sets of 8 ways
+#define DECODE_L2_SETS 4096
+#define DECODE_L2_WAYS 8
+
+// registers the loadmap notifier that keeps the cache in step with
+// dlopen and dlclose
+extern void WPDecodeCacheProcessInit(void);
+
+// With a non-NULL floatType a lookup only hits entries inserted with a
+// float type, and an insert with one upgrades an entry without.
+extern bool getEntryFromAccessTypeLengthCache(void * pc, uint32_t *accessLen, AccessType *accessType, FloatType *floatType);
+extern void insertEntryToAccessTypeLengthCache(void * pc, uint32_t accessLen, AccessType accessType, const FloatType *floatType);
+
+#endif
@@ -0,0 +1,504 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Shared memory coordination for the IPC sharing clients, see
+// watchpoint_ipc.h.
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <hpcrun/main.h>
+#include <hpcrun/memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+#include <monitor.h>
+
+#include "watchpoint_ipc.h"
+
+#define IPC_SHARED_MAGIC (0x48504349504331ULL) // "HPCIPC1"
+#define DEFAULT_IPC_SLOTS (256)
+#define DEFAULT_IPC_LMS (1024)
+#define MAX_IPC_LMS (UINT16_MAX)
+#define MAX_LM_PATH_LEN (1024)
+#define ATTACH_SPINS (1 << 20)
+
+#define PAGEMAP_ENTRY 8
+#define PAGEMAP_PRESENT(X) ((X) & ((uint64_t)1 << 63))
+#define PAGEMAP_PFN(X) ((X) & 0x7FFFFFFFFFFFFFULL)
+#define PA_PATH "/proc/self/pagemap"
+#define VA_PATH "/proc/self/maps"
+#define VM_MAP_CHECK_FREQUENCY (128)
+
+// direct mapped, per thread
+#define PFN_CACHE_SIZE (1024)
+
+typedef enum LM_ENTRY_STATUS {UNUSED=0, TRANSIENT=1, STABLE=2} LM_ENTRY_STATUS_t;
+
+typedef struct LM_ID_PATH{
+  volatile LM_ENTRY_STATUS_t status;
+  char realPath[MAX_LM_PATH_LEN];
+}LM_ID_PATH;
+
+struct IPC_Slot{
+  volatile uint64_t counter;  // odd while a writer fills in fsInfo
+  IPC_FSInfo fsInfo;
+} __attribute__((aligned(CACHE_LINE_SZ)));
+
+typedef struct IPC_SharedHeader{
+  volatile uint64_t magic;    // set once the creator has sized the segment
+  uint64_t size;
+  uint32_t numSlots;
+  uint32_t numLMIds;
+} __attribute__((aligned(CACHE_LINE_SZ))) IPC_SharedHeader;
+
+// header, numLMIds load module entries, numSlots slots
+typedef struct IPC_Shared{
+  IPC_SharedHeader *header;
+  LM_ID_PATH *lmInfo;
+  IPC_Slot *slots;
+  uint32_t slotMask;
+}IPC_Shared;
+
+typedef struct PFNCacheEntry{
+  uintptr_t vPage;
+  unsigned long pfn;
+  uint32_t generation;
+}PFNCacheEntry_t;
+
+typedef struct SharedRange{
+  uintptr_t start;
+  uintptr_t end;
+}SharedRange_t;
+
+static const char * shared_key = "/FALSE_SHARING_KEY";
+static IPC_Shared * ipcShared;
+static int pagemapFd = -1;
+
+static __thread PFNCacheEntry_t * pfnCache;
+static __thread uint32_t pfnGeneration = 1;
+static __thread SharedRange_t * sharedRanges;
+static __thread int numSharedRanges;
+static __thread int sharedRangesCapacity;
+static __thread uint64_t mapsHash;
+static __thread uint64_t mapsChecks;
+
+
+static inline uint64_t HashBytes(uint64_t h, const char * p, size_t n){
+  // FNV-1a
+  for(size_t i = 0; i < n; i++){
+    h ^= (unsigned char) p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static inline uint32_t RoundUpPow2(uint32_t v){
+  uint32_t p = 1;
+  while(p < v)
+    p <<= 1;
+  return p;
+}
+
+static inline size_t SegmentSize(uint32_t numLMIds, uint32_t numSlots){
+  return sizeof(IPC_SharedHeader) + ALIGN_TO_CACHE_LINE(sizeof(LM_ID_PATH) * numLMIds + CACHE_LINE_SZ - 1)
+    + sizeof(IPC_Slot) * numSlots;
+}
+
+static uint32_t EnvSize(const char * name, uint32_t dflt, uint32_t max){
+  char * s = getenv(name);
+  if(s == NULL || *s == '\0')
+    return dflt;
+  unsigned long v = strtoul(s, NULL, 10);
+  if(v == 0 || v > max){
+    EMSG("WATCHPOINT: ignoring %s=%s", name, s);
+    return dflt;
+  }
+  return v;
+}
+
+static void destroy_shared_memory(void * p) {
+  // we should munmap, but I will not do since we dont do it in so many other places in hpcrun
+  shm_unlink((char *)shared_key);
+}
+
+static void * MapSegment(int fd, size_t size){
+  void * ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(ptr == MAP_FAILED){
+    EEMSG("Failed to mmap() the IPC shared segment (%lu bytes)", size);
+    monitor_real_abort();
+  }
+  return ptr;
+}
+
+// Wait for the creator to size and initialize the segment, then map all of it.
+static IPC_SharedHeader * AttachSegment(int fd){
+  struct stat st;
+  for(int spin = 0; ; spin++){
+    if(spin == ATTACH_SPINS){
+      EEMSG("The IPC shared segment %s was never initialized; remove it (shm_cleaner) and rerun", shared_key);
+      monitor_real_abort();
+    }
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(IPC_SharedHeader))
+      break;
+    sched_yield();
+  }
+  IPC_SharedHeader * header = MapSegment(fd, sizeof(IPC_SharedHeader));
+  for(int spin = 0; header->magic != IPC_SHARED_MAGIC; spin++){
+    if(spin == ATTACH_SPINS){
+      EEMSG("The IPC shared segment %s was never initialized; remove it (shm_cleaner) and rerun", shared_key);
+      monitor_real_abort();
+    }
+    sched_yield();
+  }
+  __sync_synchronize();
+  size_t size = header->size;
+  munmap(header, sizeof(IPC_SharedHeader));
+  return MapSegment(fd, size);
+}
+
+static void create_shared_memory() {
+  bool creator = true;
+  int fd = shm_open(shared_key, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if(fd < 0 && errno == EEXIST){
+    creator = false;
+    fd = shm_open(shared_key, O_RDWR, 0666);
+  }
+  if(fd < 0){
+    EEMSG("Failed to shm_open (%s), retval = %d", shared_key, fd);
+    monitor_real_abort();
+  }
+
+  IPC_SharedHeader * header;
+  if(creator){
+    uint32_t numSlots = RoundUpPow2(EnvSize("HPCRUN_WP_IPC_SLOTS", DEFAULT_IPC_SLOTS, 1U << 20));
+    uint32_t numLMIds = EnvSize("HPCRUN_WP_IPC_LMS", DEFAULT_IPC_LMS, MAX_IPC_LMS);
+    size_t size = SegmentSize(numLMIds, numSlots);
+    if(ftruncate(fd, size) < 0){
+      EEMSG("Failed to ftruncate()");
+      monitor_real_abort();
+    }
+    // fresh pages are zero: every entry UNUSED, every slot counter even
+    header = MapSegment(fd, size);
+    header->size = size;
+    header->numSlots = numSlots;
+    header->numLMIds = numLMIds;
+    __sync_synchronize();
+    header->magic = IPC_SHARED_MAGIC;
+  } else {
+    header = AttachSegment(fd);
+  }
+  close(fd);
+
+  IPC_Shared * shared = hpcrun_malloc(sizeof(IPC_Shared));
+  shared->header = header;
+  shared->lmInfo = (LM_ID_PATH *) (header + 1);
+  shared->slots = (IPC_Slot *) ((char *) header + header->size - sizeof(IPC_Slot) * header->numSlots);
+  shared->slotMask = header->numSlots - 1;
+  if(__sync_bool_compare_and_swap(&ipcShared, NULL, shared)){
+    if(creator)
+      hpcrun_process_aux_cleanup_add(destroy_shared_memory, NULL);
+  } else {
+    munmap(header, header->size);
+  }
+}
+
+static inline IPC_Shared * GetShared(){
+  if(ipcShared == NULL)
+    create_shared_memory();
+  return ipcShared;
+}
+
+uint16_t GetOrCreateIPCSharedLMEntry(const char * realPath){
+  IPC_Shared * shared = GetShared();
+  uint32_t numLMIds = shared->header->numLMIds;
+  // id 0 is never handed out
+  uint32_t start = HashBytes(0xcbf29ce484222325ULL, realPath, strnlen(realPath, MAX_LM_PATH_LEN)) % numLMIds;
+  for(uint32_t n = 0; n < numLMIds; n++){
+    uint16_t i = (start + n) % numLMIds;
+    if(i == 0)
+      continue;
+    LM_ID_PATH * entry = &shared->lmInfo[i];
+    switch (entry->status) {
+      case STABLE:
+        if(0==strncmp(realPath, entry->realPath, MAX_LM_PATH_LEN))
+          return i;
+        break;
+      case TRANSIENT:
+TRANSIENT_CASE:
+        while(entry->status != STABLE) ; // spin
+        if(0==strncmp(realPath, entry->realPath, MAX_LM_PATH_LEN))
+          return i;
+        break;
+      case UNUSED:
+        // Attempt to install
+        if(__sync_bool_compare_and_swap(&(entry->status), UNUSED, TRANSIENT))  {
+          strncpy(entry->realPath, realPath, MAX_LM_PATH_LEN);
+          __sync_synchronize();
+          entry->status = STABLE;
+          return i;
+        } else {
+          goto TRANSIENT_CASE;
+        }
+      default:
+        assert(0 && "SHOULD NEVER REACH HERE");
+        monitor_real_abort();
+    }
+  }
+  EEMSG("All %u IPC load module ids are in use, raise HPCRUN_WP_IPC_LMS", numLMIds);
+  monitor_real_abort();
+  return 0;
+}
+
+//
+// virtual to physical translation
+//
+
+static void AddSharedRange(uintptr_t start, uintptr_t end){
+  if(numSharedRanges == sharedRangesCapacity){
+    int capacity = sharedRangesCapacity ? 2 * sharedRangesCapacity : 64;
+    SharedRange_t * ranges = mmap(NULL, capacity * sizeof(SharedRange_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ranges == MAP_FAILED)
+      return;
+    if(sharedRanges){
+      memcpy(ranges, sharedRanges, numSharedRanges * sizeof(SharedRange_t));
+      munmap(sharedRanges, sharedRangesCapacity * sizeof(SharedRange_t));
+    }
+    sharedRanges = ranges;
+    sharedRangesCapacity = capacity;
+  }
+  sharedRanges[numSharedRanges].start = start;
+  sharedRanges[numSharedRanges].end = end;
+  numSharedRanges++;
+}
+
+// one line of /proc/self/maps: "start-end perms offset dev inode path"
+static uint64_t ScanMapsLine(uint64_t h, char * line, size_t len){
+  char * perms = memchr(line, ' ', len);
+  if(perms == NULL || (line + len) - perms < 5)
+    return h;
+  perms++;
+  // only writable shared mappings can be written by another process
+  if(perms[1] != 'w' || perms[3] != 's')
+    return h;
+  AddSharedRange(strtoul(line, NULL, 16), strtoul(memchr(line, '-', len) + 1, NULL, 16));
+  return HashBytes(h, line, len);
+}
+
+// Collect this thread's view of the writable shared mappings.  The
+// maps file is read with plain read(2) since this runs in the sample
+// handler.
+static uint64_t ScanSharedMappings(){
+  int fd = open(VA_PATH, O_RDONLY);
+  if(fd < 0){
+    EMSG("Could not open %s", VA_PATH);
+    return mapsHash;
+  }
+  numSharedRanges = 0;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  char buf[4096];
+  size_t have = 0;
+  bool skip = false;
+  for(;;){
+    ssize_t n = read(fd, buf + have, sizeof(buf) - have);
+    if(n <= 0)
+      break;
+    have += n;
+    char * line = buf;
+    char * nl;
+    while((nl = memchr(line, '\n', buf + have - line)) != NULL){
+      if(!skip)
+        h = ScanMapsLine(h, line, nl - line);
+      skip = false;
+      line = nl + 1;
+    }
+    have = buf + have - line;
+    if(have == sizeof(buf)){
+      // a path longer than the buffer: the fields we look at come
+      // first, drop the rest of the line
+      if(!skip)
+        h = ScanMapsLine(h, buf, have);
+      skip = true;
+      have = 0;
+    } else {
+      memmove(buf, line, have);
+    }
+  }
+  close(fd);
+  return h;
+}
+
+void WPIPCCheckMaps(){
+  if((mapsChecks++ % VM_MAP_CHECK_FREQUENCY) != 0)
+    return;
+  uint64_t h = ScanSharedMappings();
+  if(h != mapsHash){
+    // some shared mapping came, went or moved: drop every cached frame
+    mapsHash = h;
+    pfnGeneration++;
+  }
+}
+
+static inline bool IsOnSharedMapping(uintptr_t va){
+  for(int i = 0; i < numSharedRanges; i++)
+    if(va >= sharedRanges[i].start && va < sharedRanges[i].end)
+      return true;
+  return false;
+}
+
+static unsigned long ReadPFN(uintptr_t vPage){
+  if(pagemapFd < 0){
+    int fd = open(PA_PATH, O_RDONLY);
+    if(fd < 0){
+      EMSG("Cannot open %s", PA_PATH);
+      return INVALID_PHYSICAL_ADDRESS;
+    }
+    if(!__sync_bool_compare_and_swap(&pagemapFd, -1, fd))
+      close(fd);
+  }
+  uint64_t entry;
+  off_t offset = vPage / wpConfig.pgsz * PAGEMAP_ENTRY;
+  if(pread(pagemapFd, &entry, sizeof(entry), offset) != sizeof(entry))
+    return INVALID_PHYSICAL_ADDRESS;
+  // without CAP_SYS_ADMIN the kernel reports frame 0 for every page
+  if(!PAGEMAP_PRESENT(entry))
+    return INVALID_PHYSICAL_ADDRESS;
+  return PAGEMAP_PFN(entry);
+}
+
+unsigned long WPIPCGetPA(void * va){
+  uintptr_t vPage = (uintptr_t) va & ~(wpConfig.pgsz - 1);
+  if(!IsOnSharedMapping(vPage))
+    return INVALID_PHYSICAL_ADDRESS;
+
+  if(pfnCache == NULL){
+    pfnCache = hpcrun_malloc(sizeof(PFNCacheEntry_t) * PFN_CACHE_SIZE);
+    memset(pfnCache, 0, sizeof(PFNCacheEntry_t) * PFN_CACHE_SIZE);
+  }
+  PFNCacheEntry_t * e = &pfnCache[(vPage / wpConfig.pgsz) & (PFN_CACHE_SIZE - 1)];
+  if(e->generation != pfnGeneration || e->vPage != vPage){
+    e->vPage = vPage;
+    e->pfn = ReadPFN(vPage);
+    // a page not yet faulted in is looked up again next time
+    e->generation = e->pfn == INVALID_PHYSICAL_ADDRESS ? 0 : pfnGeneration;
+  }
+  if(e->pfn == INVALID_PHYSICAL_ADDRESS)
+    return INVALID_PHYSICAL_ADDRESS;
+  return e->pfn * wpConfig.pgsz + ((uintptr_t) va & (wpConfig.pgsz - 1));
+}
+
+//
+// publication slots
+//
+
+static inline IPC_Slot * GetSlot(unsigned long paLine){
+  IPC_Shared * shared = GetShared();
+  uint64_t h = (paLine / CACHE_LINE_SZ) * 0x9E3779B97F4A7C15ULL;
+  return &shared->slots[(h >> 32) & shared->slotMask];
+}
+
+bool WPIPCReadFresh(unsigned long paLine, pid_t me, uint64_t now, uint64_t maxAge, IPC_FSInfo * info){
+  IPC_Slot * slot = GetSlot(paLine);
+  // Lamport's seqlock: retry while a writer is active or got in between
+  do{
+    uint64_t startCounter = slot->counter;
+    if(startCounter & 1)
+      continue; // Some writer is updating
+
+    __sync_synchronize();
+    volatile IPC_FSInfo * pub = &slot->fsInfo;
+    if(pub->address != paLine || pub->tid == me || pub->tid == -1 || (now - pub->time) > maxAge){
+      __sync_synchronize();
+      if(slot->counter == startCounter)
+        return false;
+      continue;
+    }
+    info->time = pub->time;
+    info->tid = pub->tid;
+    info->wpType = pub->wpType;
+    info->accessType = pub->accessType;
+    info->address = pub->address;
+    info->offset = pub->offset;
+    info->accessLen = pub->accessLen;
+    info->btLength = pub->btLength < MAX_BACKTRACE_LEN ? pub->btLength : MAX_BACKTRACE_LEN - 1;
+    // only the frames in use, including the terminating one
+    memcpy(info->backtrace, (const void *) pub->backtrace, (info->btLength + 1) * sizeof(struct cct_addr_t));
+    __sync_synchronize();
+    if(slot->counter == startCounter)
+      return true;
+  }while(1);
+}
+
+IPC_FSInfo * WPIPCBeginPublish(unsigned long paLine, pid_t me, uint64_t now, uint64_t minAge, IPC_Slot ** slotp){
+  IPC_Slot * slot = GetSlot(paLine);
+  uint64_t theCounter = slot->counter;
+  if(theCounter & 1)
+    return NULL; // Somebody is in the process of publishing
+  // This is racy but benign: the CAS below fails if the slot changed.
+  volatile IPC_FSInfo * pub = &slot->fsInfo;
+  if(pub->tid != me && pub->tid != -1 && pub->time != 0 && (now - pub->time) <= minAge)
+    return NULL; // keep a young publication of somebody else
+  if(!__sync_bool_compare_and_swap(&(slot->counter), theCounter, theCounter + 1))
+    return NULL;
+  *slotp = slot;
+  return &slot->fsInfo;
+}
+
+void WPIPCEndPublish(IPC_Slot * slot){
+  __sync_synchronize();
+  slot->counter = slot->counter + 1; // makes the counter even
+}
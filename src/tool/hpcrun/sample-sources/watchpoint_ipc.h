@@ -0,0 +1,120 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+
+//
+// Cross-process coordination for the WP_IPC_*_SHARING clients.
+//
+// Processes meet in one POSIX shared memory segment holding the table of
+// shared load module ids and a table of publication slots.  A slot is
+// picked by hashing the physical cache line a sample touched, so
+// samples on different lines do not contend and a process only arms
+// watchpoints on the lines it touches itself.  Every slot is guarded by
+// its own sequence counter: odd while a writer fills it in.
+//
+// The first process to create the segment sizes it:
+//   HPCRUN_WP_IPC_SLOTS  publication slots, rounded up to a power of two
+//                        (default 256)
+//   HPCRUN_WP_IPC_LMS    load module ids (default 1024, at most 65535)
+// later processes adopt the sizes recorded in the segment.
+//
+// Physical addresses come from /proc/self/pagemap through a per-thread
+// cache of page frame numbers.  Only writable shared mappings are
+// translated; the cache is dropped whenever the set of those mappings
+// in /proc/self/maps changes, which WPIPCCheckMaps() polls for.
+//
+
+
+#ifndef __WATCHPOINT_IPC_H__
+#define __WATCHPOINT_IPC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <hpcrun/cct/cct_addr.h>
+
+#include "watchpoint_support.h"
+
+#define MAX_BACKTRACE_LEN (1024)
+#define INVALID_PHYSICAL_ADDRESS (0L)
+
+typedef struct IPC_FSInfo{
+  uint64_t time;
+  pid_t tid;
+  WatchPointType wpType;
+  AccessType accessType;
+  unsigned long address;  // physical cache line
+  unsigned long offset;   // offset of the access in its page
+  int accessLen;
+  uint16_t btLength;
+  struct cct_addr_t backtrace[MAX_BACKTRACE_LEN];
+}IPC_FSInfo;
+
+typedef struct IPC_Slot IPC_Slot;
+
+// shared load module id for realPath, allocating one on first use
+extern uint16_t GetOrCreateIPCSharedLMEntry(const char * realPath);
+
+// physical address of va if it is on a writable shared mapping,
+// INVALID_PHYSICAL_ADDRESS otherwise
+extern unsigned long WPIPCGetPA(void * va);
+
+// Re-read the shared mappings every few calls; call once per sample.
+extern void WPIPCCheckMaps(void);
+
+// Copy out the publication for paLine if another thread published it
+// less than maxAge cycles before now.
+extern bool WPIPCReadFresh(unsigned long paLine, pid_t me, uint64_t now, uint64_t maxAge, IPC_FSInfo * info);
+
+// Claim the slot of paLine for publishing unless it holds a publication
+// of another thread younger than minAge cycles or is being written.  On
+// success fill in the returned info, then call WPIPCEndPublish().
+extern IPC_FSInfo * WPIPCBeginPublish(unsigned long paLine, pid_t me, uint64_t now, uint64_t minAge, IPC_Slot ** slot);
+extern void WPIPCEndPublish(IPC_Slot * slot);
+
+#endif
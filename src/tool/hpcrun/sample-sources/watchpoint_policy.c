@@ -0,0 +1,379 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Replacement policies for the hardware watchpoint slots, see
+// watchpoint_policy.h.
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <lib/prof-lean/stdatomic.h>
+#include <messages/messages.h>
+
+#include "watchpoint_policy.h"
+
+#define SAMPLES_POST_FULL_RESET_VAL (1)
+#define DEFAULT_DECAY_HALF_LIFE (100000000UL)  // cycles
+#define SLOT_IS_ACTIVE(st, i) ((st)->activeMask & (1u << (i)))
+
+typedef struct WPPolicyTotals {
+  atomic_ulong offered;
+  atomic_ulong armed;
+  atomic_ulong replaced;
+  atomic_ulong wasted;
+  atomic_ulong traps;
+  atomic_ulong overheadCycles;
+} WPPolicyTotals_t;
+
+static WPPolicyTotals_t policyTotals[NUM_REPLACEMENT_POLICIES];
+
+
+//***************************************************************************
+// helpers
+//***************************************************************************
+
+static inline double SampleWeight(const SampleData_t *sample) {
+  return sample->weight > 0 ? sample->weight : 1.0;
+}
+
+// reservoir key of Efraimidis and Spirakis, u^(1/w), kept as a log;
+// u is drawn from (0,1] so the key stays finite
+static inline double ReservoirKey(WPPolicyState_t *st, double weight) {
+  double u;
+  drand48_r(st->randBuffer, &u);
+  return log(1.0 - u) / weight;
+}
+
+static int OldestSlot(WPPolicyState_t *st) {
+  int location = 0;
+  for (int i = 1; i < st->maxWP; i++) {
+    if (st->slot[i].armTime < st->slot[location].armTime)
+      location = i;
+  }
+  return location;
+}
+
+
+//***************************************************************************
+// policies
+//***************************************************************************
+
+// Equal probability for any data access: the n-th sample after the
+// slots filled up replaces a random slot with probability maxWP/(maxWP+n).
+static VictimType AutoSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  long int tmpVal;
+  lrand48_r(st->randBuffer, &tmpVal);
+  *location = tmpVal % st->maxWP;
+
+  bool replace = WPReservoirAccept(st->randBuffer, st->maxWP, st->maxWP + st->samplePostFull);
+  st->samplePostFull++;
+  // this is an indication not to replace, but if the client chooses to force, they can
+  return replace ? NON_EMPTY_SLOT : NONE_AVAILABLE;
+}
+
+static VictimType EmptySlotOnlySelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  return NONE_AVAILABLE;
+}
+
+static VictimType OldestSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  *location = OldestSlot(st);
+  return NON_EMPTY_SLOT;
+}
+
+static VictimType NewestSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  *location = 0;
+  for (int i = 1; i < st->maxWP; i++) {
+    if (st->slot[i].armTime > st->slot[*location].armTime)
+      *location = i;
+  }
+  return NON_EMPTY_SLOT;
+}
+
+// Visit the slots in random order; a slot that has seen n arming
+// attempts since it was armed is replaced with probability 1/n.
+static VictimType RdxSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  int indices[MAX_ANY_WP_SLOTS];
+  for (int i = 0; i < st->maxWP; i++) {
+    indices[i] = i;
+  }
+  for (int n = st->maxWP; n > 1; n--) {
+    long int tmpVal;
+    lrand48_r(st->randBuffer, &tmpVal);
+    int index = tmpVal % n;
+    int swap = indices[index];
+    indices[index] = indices[n - 1];
+    indices[n - 1] = swap;
+  }
+  for (int i = 0; i < st->maxWP; i++) {
+    int idx = indices[i];
+    if (WPReservoirAccept(st->randBuffer, 1.0, st->slot[idx].attempts)) {
+      *location = idx;
+      return NON_EMPTY_SLOT;
+    }
+  }
+  return NONE_AVAILABLE;
+}
+
+static void RdxOnOffer(WPPolicyState_t *st, VictimType r, int location) {
+  for (int j = 0; j < st->maxWP; j++) {
+    if (r != EMPTY_SLOT || SLOT_IS_ACTIVE(st, j) || j == location)
+      st->slot[j].attempts++;
+  }
+}
+
+// Weighted reservoir over the stream of samples: the slots hold the
+// maxWP samples with the largest keys u^(1/w).
+static VictimType WeightedSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  int victim = 0;
+  for (int i = 1; i < st->maxWP; i++) {
+    if (st->slot[i].key < st->slot[victim].key)
+      victim = i;
+  }
+  double key = ReservoirKey(st, SampleWeight(sample));
+  if (key <= st->slot[victim].key)
+    return NONE_AVAILABLE;
+  // the slot takes the key only once the arm succeeds
+  st->pendingKey = key;
+  *location = victim;
+  return NON_EMPTY_SLOT;
+}
+
+static void WeightedOnArm(WPPolicyState_t *st, int location, const SampleData_t *sample, VictimType r) {
+  st->slot[location].key = (r == NON_EMPTY_SLOT) ? st->pendingKey
+                                                 : ReservoirKey(st, SampleWeight(sample));
+}
+
+// A slot's weight halves every halfLife cycles; the weakest slot is
+// replaced with probability w/(w + its decayed weight).
+static VictimType AgeDecaySelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  uint64_t now = rdtsc();
+  int victim = 0;
+  double victimScore = INFINITY;
+  for (int i = 0; i < st->maxWP; i++) {
+    double age = (double)(now - st->slot[i].armTime);
+    double score = st->slot[i].weight * exp2(-age / st->halfLife);
+    if (score < victimScore) {
+      victim = i;
+      victimScore = score;
+    }
+  }
+  double weight = SampleWeight(sample);
+  if (!WPReservoirAccept(st->randBuffer, weight, weight + victimScore))
+    return NONE_AVAILABLE;
+  *location = victim;
+  return NON_EMPTY_SLOT;
+}
+
+// Keep one calling context from holding all the slots: a sample evicts
+// the oldest slot of the most represented context outright if that
+// context holds at least two slots more than the sample's own; otherwise
+// it goes through the AUTO reservoir step.
+static VictimType ContextFairSelectVictim(WPPolicyState_t *st, const SampleData_t *sample, int *location) {
+  int count[MAX_ANY_WP_SLOTS];
+  int own = 0;
+  for (int i = 0; i < st->maxWP; i++) {
+    count[i] = 0;
+    for (int j = 0; j < st->maxWP; j++) {
+      if (st->slot[j].ctxt == st->slot[i].ctxt)
+        count[i]++;
+    }
+    if (st->slot[i].ctxt == sample->node)
+      own++;
+  }
+  int victim = 0;
+  for (int i = 1; i < st->maxWP; i++) {
+    if (count[i] > count[victim] ||
+        (count[i] == count[victim] && st->slot[i].armTime < st->slot[victim].armTime))
+      victim = i;
+  }
+  *location = victim;
+  if (count[victim] > own + 1)
+    return NON_EMPTY_SLOT;
+
+  bool replace = WPReservoirAccept(st->randBuffer, st->maxWP, st->maxWP + st->samplePostFull);
+  st->samplePostFull++;
+  return replace ? NON_EMPTY_SLOT : NONE_AVAILABLE;
+}
+
+static const WPReplacementPolicyOps_t policyOps[NUM_REPLACEMENT_POLICIES] = {
+  [AUTO]               = {"AUTO", AutoSelectVictim, NULL, NULL},
+  [EMPTY_SLOT_ONLY]    = {"EMPTY_SLOT_ONLY", EmptySlotOnlySelectVictim, NULL, NULL},
+  [OLDEST]             = {"OLDEST", OldestSelectVictim, NULL, NULL},
+  [NEWEST]             = {"NEWEST", NewestSelectVictim, NULL, NULL},
+  [RDX]                = {"RDX", RdxSelectVictim, RdxOnOffer, NULL},
+  [WEIGHTED_RESERVOIR] = {"WEIGHTED_RESERVOIR", WeightedSelectVictim, NULL, WeightedOnArm},
+  [AGE_DECAY]          = {"AGE_DECAY", AgeDecaySelectVictim, NULL, NULL},
+  [CONTEXT_FAIR]       = {"CONTEXT_FAIR", ContextFairSelectVictim, NULL, NULL},
+};
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+const WPReplacementPolicyOps_t *WPPolicyOps(ReplacementPolicy policy) {
+  if (policy < 0 || policy >= NUM_REPLACEMENT_POLICIES)
+    policy = AUTO;
+  return &policyOps[policy];
+}
+
+bool WPPolicyParse(const char *name, ReplacementPolicy *policy) {
+  for (int i = 0; i < NUM_REPLACEMENT_POLICIES; i++) {
+    if (0 == strcasecmp(name, policyOps[i].name)) {
+      *policy = (ReplacementPolicy) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WPPolicyStateInit(WPPolicyState_t *st, int maxWP, struct drand48_data *randBuffer) {
+  memset(st, 0, sizeof(*st));
+  st->maxWP = maxWP;
+  st->randBuffer = randBuffer;
+  st->samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
+  for (int i = 0; i < MAX_ANY_WP_SLOTS; i++) {
+    st->slot[i].attempts = SAMPLES_POST_FULL_RESET_VAL;
+    st->slot[i].key = -INFINITY;
+  }
+
+  st->halfLife = DEFAULT_DECAY_HALF_LIFE;
+  char *halfLife = getenv("HPCRUN_WP_DECAY_HALFLIFE");
+  if (halfLife && strtoull(halfLife, NULL, 10) > 0)
+    st->halfLife = strtoull(halfLife, NULL, 10);
+}
+
+// Finds a victim slot to set a new WP; st->activeMask must be current.
+VictimType WPPolicySelectVictim(WPPolicyState_t *st, ReplacementPolicy policy, const SampleData_t *sample, int *location) {
+  const WPReplacementPolicyOps_t *ops = WPPolicyOps(policy);
+  VictimType r = NONE_AVAILABLE;
+
+  st->stats.offered++;
+  // If any WP slot is inactive, return it
+  for (int i = 0; i < st->maxWP; i++) {
+    if (!SLOT_IS_ACTIVE(st, i)) {
+      *location = i;
+      r = EMPTY_SLOT;
+      break;
+    }
+  }
+  if (r != EMPTY_SLOT)
+    r = ops->selectVictim(st, sample, location);
+
+  if (ops->onOffer)
+    ops->onOffer(st, r, *location);
+  return r;
+}
+
+void WPPolicyNoteArm(WPPolicyState_t *st, ReplacementPolicy policy, int location, const SampleData_t *sample, VictimType r) {
+  const WPReplacementPolicyOps_t *ops = WPPolicyOps(policy);
+  WPSlotMeta_t *m = &st->slot[location];
+  if (m->armed && m->hits == 0)
+    st->stats.wasted++;
+  if (r == NON_EMPTY_SLOT)
+    st->stats.replaced++;
+  st->stats.armed++;
+
+  m->armTime = rdtsc();
+  m->weight = SampleWeight(sample);
+  m->hits = 0;
+  m->ctxt = sample->node;
+  m->armed = true;
+  if (ops->onArm)
+    ops->onArm(st, location, sample, r);
+}
+
+void WPPolicyNoteTrap(WPPolicyState_t *st, int location) {
+  st->slot[location].hits++;
+  st->stats.traps++;
+}
+
+void WPPolicyThreadFini(WPPolicyState_t *st, ReplacementPolicy policy) {
+  for (int i = 0; i < st->maxWP; i++) {
+    if (st->slot[i].armed && st->slot[i].hits == 0)
+      st->stats.wasted++;
+    st->slot[i].armed = false;
+  }
+
+  WPPolicyTotals_t *t = &policyTotals[WPPolicyOps(policy) - policyOps];
+  atomic_fetch_add_explicit(&t->offered, st->stats.offered, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->armed, st->stats.armed, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->replaced, st->stats.replaced, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->wasted, st->stats.wasted, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->traps, st->stats.traps, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->overheadCycles, st->stats.overheadCycles, memory_order_relaxed);
+  memset(&st->stats, 0, sizeof(st->stats));
+}
+
+// coverage: fraction of the offered samples that got a slot
+// wasted: arms that were evicted or still pending at exit without a trap
+// traps/Mcycle: traps delivered per million cycles spent choosing and arming
+void WPPolicyPrintSummary(void) {
+  for (int i = 0; i < NUM_REPLACEMENT_POLICIES; i++) {
+    WPPolicyTotals_t *t = &policyTotals[i];
+    double offered = atomic_load_explicit(&t->offered, memory_order_relaxed);
+    if (offered == 0)
+      continue;
+    double armed = atomic_load_explicit(&t->armed, memory_order_relaxed);
+    double traps = atomic_load_explicit(&t->traps, memory_order_relaxed);
+    double cycles = atomic_load_explicit(&t->overheadCycles, memory_order_relaxed);
+    AMSG("WATCHPOINT POLICY %s: offered:%.2e, armed:%.2e, replaced:%.2e, wasted:%.2e, traps:%.2e, "
+         "coverage:%.3f, traps/arm:%.3f, traps/Mcycle:%.2f",
+         policyOps[i].name, offered, armed,
+         (double) atomic_load_explicit(&t->replaced, memory_order_relaxed),
+         (double) atomic_load_explicit(&t->wasted, memory_order_relaxed),
+         traps, armed / offered, armed ? traps / armed : 0.0,
+         cycles ? traps * 1e6 / cycles : 0.0);
+  }
+}
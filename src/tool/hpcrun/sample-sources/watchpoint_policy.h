@@ -0,0 +1,131 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Replacement policies for the hardware watchpoint slots.
+//
+// When every debug register of a thread is armed, a policy decides
+// whether a new sample evicts one of them and which one.  Each policy
+// sees the same per-slot metadata (arm time, sample weight, hit count,
+// calling context) kept by the engine in WPPolicyState_t; the engine
+// itself handles the common empty-slot case and the statistics.
+//
+// The policy is picked with HPCRUN_WP_REPLACEMENT_SCHEME; clients may
+// still force one in their WPConfigOverride.
+//
+
+
+#ifndef __WATCHPOINT_POLICY_H__
+#define __WATCHPOINT_POLICY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "watchpoint_support.h"
+
+// state of one slot as seen by the policies
+typedef struct WPSlotMeta {
+  uint64_t armTime;   // rdtsc() when the slot was last armed
+  double   weight;    // weight of the sample that armed it
+  double   key;       // reservoir key (WEIGHTED_RESERVOIR)
+  uint64_t hits;      // traps since the slot was last armed
+  uint64_t attempts;  // arming attempts seen by the slot (RDX)
+  void *   ctxt;      // calling context of the sample that armed it
+  bool     armed;     // armed since the last time it was accounted
+} WPSlotMeta_t;
+
+// per-thread statistics of the policy in use
+typedef struct WPPolicyStats {
+  uint64_t offered;       // samples offered for a watchpoint
+  uint64_t armed;         // samples that got a slot
+  uint64_t replaced;      // armed slots evicted by a newer sample
+  uint64_t wasted;        // arms that ended without a single trap
+  uint64_t traps;         // traps delivered to the client
+  uint64_t overheadCycles; // cycles spent choosing victims and arming
+} WPPolicyStats_t;
+
+typedef struct WPPolicyState {
+  WPSlotMeta_t slot[MAX_ANY_WP_SLOTS];
+  int maxWP;
+  uint32_t activeMask;     // bit i set if slot i is armed
+  uint64_t samplePostFull; // samples seen since the slots last had room
+  uint64_t halfLife;       // AGE_DECAY: cycles for a slot to lose half its weight
+  double pendingKey;       // WEIGHTED_RESERVOIR: key of the sample being offered
+  struct drand48_data *randBuffer;
+  WPPolicyStats_t stats;
+} WPPolicyState_t;
+
+typedef struct WPReplacementPolicyOps {
+  const char *name;
+  // Called only when every slot is armed.  Either sets *location and
+  // returns NON_EMPTY_SLOT, or returns NONE_AVAILABLE.
+  VictimType (*selectVictim)(WPPolicyState_t *st, const SampleData_t *sample, int *location);
+  // Optional; called once per offered sample after the decision.
+  void (*onOffer)(WPPolicyState_t *st, VictimType r, int location);
+  // Optional; called once the sample is armed in the slot.
+  void (*onArm)(WPPolicyState_t *st, int location, const SampleData_t *sample, VictimType r);
+} WPReplacementPolicyOps_t;
+
+extern const WPReplacementPolicyOps_t *WPPolicyOps(ReplacementPolicy policy);
+extern bool WPPolicyParse(const char *name, ReplacementPolicy *policy);
+
+extern void WPPolicyStateInit(WPPolicyState_t *st, int maxWP, struct drand48_data *randBuffer);
+extern VictimType WPPolicySelectVictim(WPPolicyState_t *st, ReplacementPolicy policy, const SampleData_t *sample, int *location);
+extern void WPPolicyNoteArm(WPPolicyState_t *st, ReplacementPolicy policy, int location, const SampleData_t *sample, VictimType r);
+extern void WPPolicyNoteTrap(WPPolicyState_t *st, int location);
+extern void WPPolicyThreadFini(WPPolicyState_t *st, ReplacementPolicy policy);
+extern void WPPolicyPrintSummary(void);
+
+// Reservoir step shared by the policies and the shared-slot clients:
+// keep the new item with probability k/n.
+static inline bool WPReservoirAccept(struct drand48_data *randBuffer, double k, double n) {
+  double randValue;
+  drand48_r(randBuffer, &randValue);
+  return randValue <= k / n;
+}
+
+#endif // __WATCHPOINT_POLICY_H__
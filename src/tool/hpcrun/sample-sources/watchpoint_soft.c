@@ -0,0 +1,622 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Page-protection watchpoint backend, see watchpoint_soft.h.
+//
+// Nothing here takes a lock: watchpoints are armed and released from
+// sample handlers, and the SIGSEGV filter and the SIGTRAP handler can
+// interrupt any of them on the same thread.
+//
+// Each thread has a fixed set of watchpoint slots, found without a
+// lookup by the faulting thread, since only its own watchpoints can
+// trigger on it. Another thread may arm or release one of them
+// meanwhile; a sequence count on the slot lets the fault skip a slot
+// that changed under it.
+//
+// The protection of a page comes from per-page records in an open
+// addressed table, counting the active watchpoints on the page by type
+// and the threads stepping over an access to it. A record is
+// referenced by the watchpoints on its page and by the steps held over
+// it, and is freed with the last reference. Two threads creating a
+// record for the same page at once may both succeed, so the counts of
+// a page are summed over all its records.
+//
+// The protection of a page is always recomputed from its counts, and
+// recomputed again when a change to a page of the same probe window
+// raced with the mprotect, so arms, disarms and the re-protection after
+// a single step can race without leaving a page unprotected or
+// protected for nothing. A page stays read/write while any thread is
+// in the middle of a step over it; re-protecting it under another
+// thread would fault that thread again on the same instruction.
+//
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <monitor.h>
+
+#include <hpcrun/segv_handler.h>
+#include <hpcrun/thread_data.h>
+#include <lib/prof-lean/stdatomic.h>
+#include <messages/messages.h>
+
+#include "watchpoint_counters.h"
+#include "watchpoint_decode_cache.h"
+#include "watchpoint_soft.h"
+
+#include <unwind/x86-family/x86-misc.h>
+
+#define WP_SOFT_PAGES    8192   // page records, a power of 2
+#define WP_SOFT_PROBE    16     // records probed for a page
+#define WP_SOFT_RELEASED 64     // recently unwatched pages
+#define WP_SOFT_MAX_STEP 4      // pages unprotected for one instruction
+#define EFLAGS_TF        0x100
+#define PF_WRITE         0x2    // page fault error code: write access
+#define MAX_ACCESS_LEN   64
+
+// a page with watchpoints or steps on it
+typedef struct WPSoftPage {
+  atomic_uintptr_t key;         // page | references, 0 when free
+  atomic_int numWrite;          // active write watchpoints
+  atomic_int numRW;             // active read/write watchpoints
+  atomic_int numStepping;       // steps in flight over it
+} WPSoftPage_t;
+
+typedef struct WPSoftWatch {
+  atomic_uint seq;              // odd while the fields below change
+  uintptr_t va;
+  int len;
+  WatchPointType type;
+  WPSoftPage_t *page;
+  atomic_int inUse;
+  atomic_int active;
+} WPSoftWatch_t;
+
+typedef struct WPSoftThread {
+  atomic_int os_tid;            // 0 when free
+  WPSoftWatch_t watches[MAX_SOFT_WP_SLOTS];
+} WPSoftThread_t;
+
+// a single step in progress on this thread
+typedef struct WPSoftStep {
+  bool stepping;
+  int numPages;                 // pages held for the step
+  uintptr_t pages[WP_SOFT_MAX_STEP];
+  WPSoftPage_t *records[WP_SOFT_MAX_STEP];
+  bool hadTF;
+  bool triggered;
+  WPSoftTrigger_t trigger;
+} WPSoftStep_t;
+
+static WPSoftThread_t threads[WP_SOFT_MAX_THREADS];
+static WPSoftPage_t pages[WP_SOFT_PAGES];
+// bumped after each change to the counts of a page, by probe window
+static atomic_uint versions[WP_SOFT_PAGES];
+static atomic_uintptr_t released[WP_SOFT_RELEASED];
+static atomic_uint releasedNext = ATOMIC_VAR_INIT(0);
+static uintptr_t pageMask;
+static WPSoftTrapCall_t trapCall;
+
+static int ctrFaults = -1;
+static int ctrFalseFaults = -1;
+static int ctrTraps = -1;
+static int ctrStepOverflows = -1;
+
+static __thread WPSoftThread_t *self;
+static __thread WPSoftStep_t step;
+static __thread WPSoftTrigger_t currentTrigger;
+static __thread uintptr_t stackLo, stackHi;
+
+
+//***************************************************************************
+// page records
+//***************************************************************************
+
+static inline int
+Home(uintptr_t page)
+{
+  return (page / (pageMask + 1)) & (WP_SOFT_PAGES - 1);
+}
+
+
+static inline WPSoftPage_t *
+Probe(uintptr_t page, int i)
+{
+  return &pages[(Home(page) + i) & (WP_SOFT_PAGES - 1)];
+}
+
+
+static inline bool
+IsRecordOf(uintptr_t key, uintptr_t page)
+{
+  return (key & ~pageMask) == page && (key & pageMask) != 0;
+}
+
+
+// a record of page with a reference taken, or NULL when the probe
+// window of page is full
+static WPSoftPage_t *
+PageRef(uintptr_t page)
+{
+  // join a live record first, so that threads share one where they can
+  for (int i = 0; i < WP_SOFT_PROBE; i++) {
+    WPSoftPage_t *r = Probe(page, i);
+    uintptr_t k = atomic_load_explicit(&r->key, memory_order_acquire);
+    while (IsRecordOf(k, page) && (k & pageMask) != pageMask) {
+      if (atomic_compare_exchange_weak_explicit(&r->key, &k, k + 1,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire)) {
+        return r;
+      }
+    }
+  }
+  for (int i = 0; i < WP_SOFT_PROBE; i++) {
+    WPSoftPage_t *r = Probe(page, i);
+    uintptr_t k = 0;
+    if (atomic_compare_exchange_strong_explicit(&r->key, &k, page | 1,
+                                                memory_order_acq_rel,
+                                                memory_order_relaxed)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+
+// drop a reference; the counts of r are back to 0 when it is the last
+static void
+PageUnref(WPSoftPage_t *r)
+{
+  uintptr_t k = atomic_load_explicit(&r->key, memory_order_relaxed);
+  uintptr_t next;
+  do {
+    next = ((k & pageMask) == 1) ? 0 : k - 1;
+  } while (!atomic_compare_exchange_weak_explicit(&r->key, &k, next,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed));
+}
+
+
+static int
+PageProt(uintptr_t page)
+{
+  int numWrite = 0, numRW = 0, numStepping = 0;
+  for (int i = 0; i < WP_SOFT_PROBE; i++) {
+    WPSoftPage_t *r = Probe(page, i);
+    if (!IsRecordOf(atomic_load_explicit(&r->key, memory_order_acquire), page)) continue;
+    int w = atomic_load_explicit(&r->numWrite, memory_order_acquire);
+    int rw = atomic_load_explicit(&r->numRW, memory_order_acquire);
+    int s = atomic_load_explicit(&r->numStepping, memory_order_acquire);
+    // freed and taken for another page in between: its counts for
+    // this page were 0
+    if (!IsRecordOf(atomic_load_explicit(&r->key, memory_order_acquire), page)) continue;
+    numWrite += w;
+    numRW += rw;
+    numStepping += s;
+  }
+  if (numStepping > 0) return PROT_READ | PROT_WRITE;
+  if (numRW > 0) return PROT_NONE;
+  if (numWrite > 0) return PROT_READ;
+  return PROT_READ | PROT_WRITE;
+}
+
+
+static bool
+PageWatched(uintptr_t page)
+{
+  for (int i = 0; i < WP_SOFT_PROBE; i++) {
+    if (IsRecordOf(atomic_load_explicit(&Probe(page, i)->key, memory_order_acquire), page)) {
+      return true;
+    }
+  }
+  for (int i = 0; i < WP_SOFT_RELEASED; i++) {
+    if (atomic_load_explicit(&released[i], memory_order_acquire) == page) return true;
+  }
+  return false;
+}
+
+
+// Protect page by its counts, after a change to them. Whoever changes
+// the counts of a page later also protects it later, so the last
+// mprotect of a page is computed from its last counts.
+static void
+Reprotect(uintptr_t page)
+{
+  atomic_uint *version = &versions[Home(page)];
+  atomic_fetch_add_explicit(version, 1, memory_order_acq_rel);
+  unsigned int v;
+  do {
+    v = atomic_load_explicit(version, memory_order_acquire);
+    if (mprotect((void *) page, pageMask + 1, PageProt(page)) != 0) {
+      EMSG("WATCHPOINT: mprotect of page %p failed", (void *) page);
+      return;
+    }
+  } while (atomic_load_explicit(version, memory_order_acquire) != v);
+}
+
+
+static inline void
+CountWatch(WPSoftWatch_t *w, int delta)
+{
+  atomic_fetch_add_explicit(w->type == WP_WRITE ? &w->page->numWrite : &w->page->numRW,
+                            delta, memory_order_acq_rel);
+}
+
+
+static inline WPSoftWatch_t *
+Watch(int id)
+{
+  int i = id - WP_SOFT_ID_BASE;
+  if (i < 0 || i >= WP_SOFT_MAX_WATCHES) return NULL;
+  WPSoftWatch_t *w = &threads[i / MAX_SOFT_WP_SLOTS].watches[i % MAX_SOFT_WP_SLOTS];
+  return atomic_load_explicit(&w->inUse, memory_order_acquire) ? w : NULL;
+}
+
+
+//***************************************************************************
+// signal handlers
+//***************************************************************************
+
+#if defined(__x86_64__)
+
+// the first active watchpoint of this thread that the access at pc to
+// addr can touch, copied into cand
+static WPSoftWatch_t *
+FindCandidate(uintptr_t page, uintptr_t addr, bool isWrite, WPSoftWatch_t *cand)
+{
+  if (!self) return NULL;
+  for (int i = 0; i < MAX_SOFT_WP_SLOTS; i++) {
+    WPSoftWatch_t *w = &self->watches[i];
+    unsigned int seq = atomic_load_explicit(&w->seq, memory_order_acquire);
+    if ((seq & 1) != 0 || !atomic_load_explicit(&w->active, memory_order_acquire)) continue;
+    cand->va = w->va;
+    cand->len = w->len;
+    cand->type = w->type;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&w->seq, memory_order_relaxed) != seq) continue;
+    if ((cand->va & ~pageMask) != page) continue;
+    if (cand->type == WP_WRITE && !isWrite) continue;
+    if (addr < cand->va + cand->len && cand->va < addr + MAX_ACCESS_LEN) return w;
+  }
+  return NULL;
+}
+
+
+static bool
+OnSoftFault(siginfo_t *info, void *context)
+{
+  if (info->si_code != SEGV_ACCERR) return false;
+
+  ucontext_t *uc = context;
+  uintptr_t addr = (uintptr_t) info->si_addr;
+  uintptr_t page = addr & ~pageMask;
+  bool isWrite = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+  void *pc = (void *) uc->uc_mcontext.gregs[REG_RIP];
+
+  if (!PageWatched(page)) return false;
+  if (PageProt(page) == (PROT_READ | PROT_WRITE)) {
+    // unwatched or stepped over by another thread since the fault; the
+    // access just needs a retry
+    return true;
+  }
+  // accesses from hpcrun itself are stepped over, never reported
+  WPSoftWatch_t cand;
+  WPSoftWatch_t *w = inside_hpcrun ? NULL : FindCandidate(page, addr, isWrite, &cand);
+
+  // An instruction touches a page at most once per step, but a page
+  // already held needs no second hold.
+  bool held = false;
+  for (int i = 0; i < step.numPages; i++) {
+    if (step.pages[i] == page) held = true;
+  }
+  if (!held && step.numPages < WP_SOFT_MAX_STEP) {
+    WPSoftPage_t *r = PageRef(page);
+    if (r) {
+      atomic_fetch_add_explicit(&r->numStepping, 1, memory_order_acq_rel);
+      step.pages[step.numPages] = page;
+      step.records[step.numPages] = r;
+      step.numPages++;
+      held = true;
+      Reprotect(page);
+    }
+  }
+  if (!held) {
+    // Unheld, the page is re-protected by the next change to a
+    // watchpoint on it or step over it; its watchpoints may miss traps
+    // until then.
+    mprotect((void *) page, pageMask + 1, PROT_READ | PROT_WRITE);
+    WPCounterInc(ctrStepOverflows);
+  }
+  WPCounterInc(ctrFaults);
+
+  if (w && !step.triggered) {
+    WPSoftTrigger_t *t = &step.trigger;
+    void *decodedVa = NULL;
+    FloatType *floatType = wpConfig.getFloatType ? &t->floatType : NULL;
+    t->floatType = ELEM_TYPE_UNKNOWN;
+    // the fault address stands in for the decoded one, so a hit is exact
+    if (!getEntryFromAccessTypeLengthCache(pc, &t->accessLength, &t->accessType, floatType)) {
+      if (get_mem_access_length_and_type_address(pc, &t->accessLength, &t->accessType,
+                                                 floatType, context, &decodedVa)) {
+        insertEntryToAccessTypeLengthCache(pc, t->accessLength, t->accessType, floatType);
+      } else {
+        t->accessLength = 0;
+      }
+    }
+    if (t->accessLength == 0) t->accessLength = 1;
+    // the fault address is exact, but only the first byte in the page
+    if (addr < cand.va + cand.len && cand.va < addr + t->accessLength) {
+      t->id = WP_SOFT_ID_BASE + (int) (self - threads) * MAX_SOFT_WP_SLOTS
+        + (int) (w - self->watches);
+      t->pc = pc;
+      t->va = (void *) addr;
+      step.triggered = true;
+    }
+  }
+  if (!step.triggered) WPCounterInc(ctrFalseFaults);
+
+  if (!step.stepping) {
+    step.hadTF = (uc->uc_mcontext.gregs[REG_EFL] & EFLAGS_TF) != 0;
+    step.stepping = true;
+  }
+  uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+  // a blocked SIGTRAP would kill the process
+  sigdelset(&uc->uc_sigmask, SIGTRAP);
+  return true;
+}
+
+
+static int
+OnSoftTrap(int sig, siginfo_t *info, void *context)
+{
+  if (!step.stepping) {
+    return 1;  // not ours
+  }
+  ucontext_t *uc = context;
+  if (!step.hadTF) {
+    uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+  }
+
+  for (int i = 0; i < step.numPages; i++) {
+    atomic_fetch_sub_explicit(&step.records[i]->numStepping, 1, memory_order_acq_rel);
+    Reprotect(step.pages[i]);
+    PageUnref(step.records[i]);
+  }
+  step.numPages = 0;
+  step.stepping = false;
+
+  if (step.triggered) {
+    // a trap of the delivery itself may start a new step
+    step.triggered = false;
+    currentTrigger = step.trigger;
+    WPCounterInc(ctrTraps);
+    trapCall(currentTrigger.id, context);
+  }
+  return 0;
+}
+
+#endif
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+bool
+WPSoftInit(WPSoftTrapCall_t call)
+{
+#if defined(__x86_64__)
+  pageMask = sysconf(_SC_PAGESIZE) - 1;
+  trapCall = call;
+
+  if (monitor_sigaction(SIGTRAP, &OnSoftTrap, 0, NULL) != 0) {
+    EMSG("WATCHPOINT: unable to install the SIGTRAP handler");
+    return false;
+  }
+  hpcrun_segv_set_filter(&OnSoftFault);
+
+  ctrFaults = WPCounterRegister("softFaults");
+  ctrFalseFaults = WPCounterRegister("softFalseFaults");
+  ctrTraps = WPCounterRegister("softTraps");
+  ctrStepOverflows = WPCounterRegister("softStepOverflows");
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void
+WPSoftThreadInit(void)
+{
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+      stackLo = (uintptr_t) addr;
+      stackHi = (uintptr_t) addr + size;
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  int tid = syscall(__NR_gettid);
+  for (int i = 0; i < WP_SOFT_MAX_THREADS; i++) {
+    int unused = 0;
+    if (atomic_compare_exchange_strong_explicit(&threads[i].os_tid, &unused, tid,
+                                                memory_order_acq_rel,
+                                                memory_order_relaxed)) {
+      self = &threads[i];
+      return;
+    }
+  }
+  EMSG("WATCHPOINT: more than %d threads, thread %d has no software watchpoints",
+       WP_SOFT_MAX_THREADS, tid);
+}
+
+
+void
+WPSoftThreadFini(void)
+{
+  if (!self) return;
+  // Another thread may have armed one here after this thread let go of
+  // its watchpoints.
+  for (int i = 0; i < MAX_SOFT_WP_SLOTS; i++) {
+    WPSoftRelease(WP_SOFT_ID_BASE + (int) (self - threads) * MAX_SOFT_WP_SLOTS + i);
+  }
+  atomic_store_explicit(&self->os_tid, 0, memory_order_release);
+  self = NULL;
+}
+
+
+int
+WPSoftArm(void *va, int len, WatchPointType type, pid_t os_tid)
+{
+  uintptr_t a = (uintptr_t) va;
+  uintptr_t page = a & ~pageMask;
+  // the signal frames go on the stack, it must stay accessible
+  if (a >= stackLo && a < stackHi) return -1;
+  if (IsAltStackAddress(va)) return -1;
+
+  WPSoftThread_t *t = NULL;
+  for (int i = 0; i < WP_SOFT_MAX_THREADS && !t; i++) {
+    if (atomic_load_explicit(&threads[i].os_tid, memory_order_acquire) == os_tid) {
+      t = &threads[i];
+    }
+  }
+  if (!t) return -1;
+
+  WPSoftWatch_t *w = NULL;
+  for (int i = 0; i < MAX_SOFT_WP_SLOTS && !w; i++) {
+    int unused = 0;
+    if (atomic_compare_exchange_strong_explicit(&t->watches[i].inUse, &unused, 1,
+                                                memory_order_acq_rel,
+                                                memory_order_relaxed)) {
+      w = &t->watches[i];
+    }
+  }
+  WPSoftPage_t *r = w ? PageRef(page) : NULL;
+  if (!r) {
+    if (w) atomic_store_explicit(&w->inUse, 0, memory_order_release);
+    EMSG("WATCHPOINT: software watchpoint table full");
+    return -1;
+  }
+
+  unsigned int seq = atomic_load_explicit(&w->seq, memory_order_relaxed);
+  atomic_store_explicit(&w->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  w->va = a;
+  w->len = len;
+  w->type = type;
+  w->page = r;
+  atomic_store_explicit(&w->seq, seq + 2, memory_order_release);
+
+  atomic_store_explicit(&w->active, 1, memory_order_release);
+  CountWatch(w, 1);
+  Reprotect(page);
+  return WP_SOFT_ID_BASE + (int) (t - threads) * MAX_SOFT_WP_SLOTS + (int) (w - t->watches);
+}
+
+
+static void
+SetActive(int id, bool active)
+{
+  WPSoftWatch_t *w = Watch(id);
+  if (w && atomic_exchange_explicit(&w->active, active, memory_order_acq_rel) != (int) active) {
+    CountWatch(w, active ? 1 : -1);
+    Reprotect(w->va & ~pageMask);
+  }
+}
+
+
+void
+WPSoftEnable(int id)
+{
+  SetActive(id, true);
+}
+
+
+void
+WPSoftDisable(int id)
+{
+  SetActive(id, false);
+}
+
+
+void
+WPSoftRelease(int id)
+{
+  WPSoftWatch_t *w = Watch(id);
+  if (!w) return;
+  uintptr_t page = w->va & ~pageMask;
+  if (atomic_exchange_explicit(&w->active, 0, memory_order_acq_rel)) {
+    CountWatch(w, -1);
+  }
+  // a thread may be faulting on the page right now
+  unsigned int i = atomic_fetch_add_explicit(&releasedNext, 1, memory_order_relaxed);
+  atomic_store_explicit(&released[i % WP_SOFT_RELEASED], page, memory_order_release);
+  Reprotect(page);
+  PageUnref(w->page);
+  atomic_store_explicit(&w->inUse, 0, memory_order_release);
+}
+
+
+const WPSoftTrigger_t *
+WPSoftCurrentTrigger(void)
+{
+  return &currentTrigger;
+}
@@ -0,0 +1,127 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Software watchpoints from page protection, for machines whose debug
+// registers are hidden (VMs, containers) or too few.
+//
+// Arming a watchpoint protects its page: PROT_READ for a write
+// watchpoint, PROT_NONE for a read/write one. An access to the page
+// raises SIGSEGV before the instruction runs; the handler unprotects
+// the page and sets the trap flag, the instruction completes, and the
+// single-step SIGTRAP protects the page again. When the access
+// overlaps an active watchpoint of the faulting thread, the SIGTRAP
+// handler then delivers it like a hardware trap, after the access as
+// on hardware, with the precise pc and address taken at the fault.
+//
+// Watchpoints are identified by ids that stand in for the perf event
+// fds of hardware watchpoints. Any access to a watched page faults, so
+// the cost grows with the traffic on the page, not on the watched
+// bytes. While one thread steps over an access, other threads can
+// reach the page without faulting and may miss a trap.
+//
+// The kernel does not fault on user memory it cannot access: a system
+// call that reads or writes a watched page, read(2) into a watched
+// buffer for instance, fails with EFAULT in the application. This
+// changes what the application sees, so the backend is used only when
+// asked for with HPCRUN_WP_BACKEND=mprotect, never as a fallback.
+//
+// The overhead and accuracy of this backend against the debug
+// registers have not been measured. 'overhead_bench driver -w reuse'
+// runs WP_REUSETRACKER under HPCRUN_WP_BACKEND=hw and =mprotect for
+// that; the softFaults and softFalseFaults counters of a run give the
+// faults taken per trap.
+//
+
+#ifndef __WATCHPOINT_SOFT_H__
+#define __WATCHPOINT_SOFT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "watchpoint_support.h"
+
+#define WP_SOFT_MAX_THREADS 256
+#define WP_SOFT_MAX_WATCHES (WP_SOFT_MAX_THREADS * MAX_SOFT_WP_SLOTS)
+#define WP_SOFT_ID_BASE     (1 << 20)
+
+// what the fault saw of the access that triggered a watchpoint
+typedef struct WPSoftTrigger {
+  int id;
+  void *pc;
+  void *va;
+  uint32_t accessLength;
+  AccessType accessType;
+  FloatType floatType;
+} WPSoftTrigger_t;
+
+// called in the SIGTRAP handler with the id of the triggered watchpoint
+typedef void (*WPSoftTrapCall_t)(int id, void *context);
+
+// Install the SIGTRAP handler and the SIGSEGV filter; false where the
+// backend is not supported (not x86).
+extern bool WPSoftInit(WPSoftTrapCall_t trapCall);
+
+// Record the stack of the calling thread, which is never watched, and
+// give it MAX_SOFT_WP_SLOTS watchpoints; at most WP_SOFT_MAX_THREADS
+// threads have them at once.
+extern void WPSoftThreadInit(void);
+
+// release the watchpoints of the calling thread and its slots
+extern void WPSoftThreadFini(void);
+
+// Watch [va, va + len) for accesses by thread os_tid; returns the id,
+// or -1 when va is on a stack or os_tid has no free slot.
+extern int WPSoftArm(void *va, int len, WatchPointType type, pid_t os_tid);
+extern void WPSoftEnable(int id);
+extern void WPSoftDisable(int id);
+extern void WPSoftRelease(int id);
+
+// the trigger being delivered on the calling thread
+extern const WPSoftTrigger_t *WPSoftCurrentTrigger(void);
+
+#endif
@@ -39,10 +39,13 @@
 #include <hpcrun/hpcrun_options.h>
 #include <hpcrun/write_data.h>
 #include <hpcrun/safe-sampling.h>
+#include <hpcrun/hpcrun_overhead.h>
 #include <hpcrun/hpcrun_stats.h>
 #include <hpcrun/memory/mmap.h>
+#include <hpcrun/memory/hpcrun-malloc.h>
 
 #include <hpcrun/cct/cct.h>
+#include <hpcrun/cct/cct_prune.h>
 #include <hpcrun/metrics.h>
 #include <hpcrun/sample_event.h>
 #include <hpcrun/sample_sources_registered.h>
@@ -64,6 +67,12 @@
 #include <adm_init_fini.h>
 #endif
 #include "matrix.h"
+#include "perf/perf_mmap.h"
+#include "watchpoint_policy.h"
+#include "watchpoint_counters.h"
+#include "watchpoint_adaptive.h"
+#include "watchpoint_decode_cache.h"
+#include "watchpoint_soft.h"
 //#include "amd_support.h"
 
 //extern int init_adamant;
@@ -137,8 +146,7 @@ typedef struct ThreadData{
   stack_t ss;
   void * fs_reg_val;
   void * gs_reg_val;
-  uint64_t samplePostFull;
-  uint64_t numWatchpointArmingAttempt[MAX_WP_SLOTS];
+  WPPolicyState_t policy;
   pid_t os_tid;
   long numWatchpointTriggers;
   long numActiveWatchpointTriggers;
@@ -149,9 +157,10 @@ typedef struct ThreadData{
   long numWatchpointDropped;
   long numInsaneIP;
   struct drand48_data randBuffer;
-  WatchPointInfo_t watchPointArray[MAX_WP_SLOTS];
+  WatchPointInfo_t * watchPointArray; // hwWatchPointArray, or the software slots
+  WatchPointInfo_t hwWatchPointArray[MAX_WP_SLOTS];
   WatchPointUpCall_t fptr;
-  volatile uint64_t counter[MAX_WP_SLOTS];
+  volatile uint64_t counter[MAX_ANY_WP_SLOTS];
   char dummy[CACHE_LINE_SZ];
 } ThreadData_t;
 
@@ -162,66 +171,14 @@ typedef struct threadDataTableStruct{
 
 ThreadDataTable_t threadDataTable;
 
-int globalWPIsUsers[MAX_WP_SLOTS];
-int L3GlobalWPIsUsers[4][MAX_WP_SLOTS];
+int globalWPIsUsers[MAX_ANY_WP_SLOTS];
+int L3GlobalWPIsUsers[4][MAX_ANY_WP_SLOTS];
 
-uint64_t numWatchpointArmingAttempt[MAX_WP_SLOTS];
+uint64_t numWatchpointArmingAttempt[MAX_ANY_WP_SLOTS];
 
 globalReuseTable_t globalReuseWPs;
 globalReuseTable_t globalStoreReuseWPs;
 
-accessTypeLengthTable_t accessTypeLengthCache;
-
-int getIndex(void * key) {
-	  return (uint64_t) key % 54121 % HASH_TABLE_SIZE;
-}
-
-bool getEntryFromAccessTypeLengthCache(void * pc, uint32_t *accessLen, AccessType *accessType) {
-  int idx = getIndex(pc);
-  void * entry_pc = NULL;
-  do{
-    int64_t startCounter = accessTypeLengthCache.table[idx].counter;
-    if(startCounter & 1)
-      continue; // Some writer is updating
-
-    __sync_synchronize();
-    *accessLen = accessTypeLengthCache.table[idx].accessLength;
-    *accessType = accessTypeLengthCache.table[idx].accessType;
-    entry_pc = accessTypeLengthCache.table[idx].pc;
-    __sync_synchronize();
-    int64_t endCounter = accessTypeLengthCache.table[idx].counter;
-    if(startCounter == endCounter)
-      break;
-  }while(1);
-  if(pc == entry_pc) {
-	  //fprintf(stderr, "getEntryFromAccessTypeLengthCache returns true\n");
-	  return true;
-  }
-  //fprintf(stderr, "getEntryFromAccessTypeLengthCache returns false\n");
-  return false;
-  //if(cacheLineBaseAddress != reuseBulletinBoard.hashTable[hashIndex].cacheLineBaseAddress)
-    //*item_not_found = 1;
-  //return reuseBulletinBoard.hashTable[hashIndex];
-}
-
-void insertEntryToAccessTypeLengthCache(void * pc, uint32_t accessLen, AccessType accessType) {
-    int idx = getIndex(pc);
-    int64_t counter = accessTypeLengthCache.table[idx].counter;
-    if((counter & 1) == 0) {
-
-    	if(__sync_bool_compare_and_swap(&accessTypeLengthCache.table[idx].counter, counter, counter+1)) {
-		accessTypeLengthCache.table[idx].pc = pc;
-    		accessTypeLengthCache.table[idx].accessLength = accessLen;
-    		accessTypeLengthCache.table[idx].accessType = accessType;
-		//fprintf(stderr, "insertion: idx: %d, pc: %lx, accessLen: %d, accessType: %d\n", idx, pc, accessLen, accessType);
-		accessTypeLengthCache.table[idx].counter++;
-	}
-    }
-    
-  //if(cacheLineBaseAddress != reuseBulletinBoard.hashTable[hashIndex].cacheLineBaseAddress)
-    //*item_not_found = 1;
-}
-
 globalReuseTable_t globalL3ReuseWPs[4];
 
 typedef struct FdData {
@@ -297,6 +254,10 @@ bool IsFSorGS(void * addr) {
 
 
 static inline void EnableWatchpoint(int fd) {
+  if (wpConfig.softWP) {
+    WPSoftEnable(fd);
+    return;
+  }
   // Start the event
   CHECK(ioctl(fd, PERF_EVENT_IOC_ENABLE, 0));
 }
@@ -305,7 +266,11 @@ static inline void DisableWatchpoint(WatchPointInfo_t *wpi) {
   // Stop the event
   //fprintf(stderr, "watchpoint is disabled\n");
   assert(wpi->fileHandle != -1);
-  CHECK(ioctl(wpi->fileHandle, PERF_EVENT_IOC_DISABLE, 0));
+  if (wpConfig.softWP) {
+    WPSoftDisable(wpi->fileHandle);
+  } else {
+    CHECK(ioctl(wpi->fileHandle, PERF_EVENT_IOC_DISABLE, 0));
+  }
   wpi->isActive = false;
 }
 
@@ -325,6 +290,8 @@ static void UNMAPWPMBuffer(void * buf){
 }
 
 static int OnWatchPoint(int signum, siginfo_t *info, void *context);
+static int HandleWatchPoint(int signum, siginfo_t *info, void *context);
+static void OnSoftWatchPoint(int id, void *context);
 
 __attribute__((constructor))
   static void InitConfig(){
@@ -355,17 +322,12 @@ __attribute__((constructor))
     int fd =  perf_event_open(&peLBR, 0, -1, -1 /*group*/, 0);
     if (fd != -1) {
       wpConfig.isLBREnabled = true;
+      CHECK(close(fd));
     } else {
       wpConfig.isLBREnabled = false;
     }
-    CHECK(close(fd));
 
 
-#if defined(FAST_BP_IOC_FLAG)
-    wpConfig.isWPModifyEnabled = true;
-#else
-    wpConfig.isWPModifyEnabled = false;
-#endif
     //wpConfig.signalDelivered = SIGTRAP;
     //wpConfig.signalDelivered = SIGIO;
     //wpConfig.signalDelivered = SIGUSR1;
@@ -417,13 +379,56 @@ __attribute__((constructor))
       }
     }
 
-    if(i == 0) {
-      fprintf(stderr, "Cannot create a single watch point\n");
+    // HPCRUN_WP_BACKEND: hw (debug registers), the default, or
+    // mprotect (page protection, see watchpoint_soft.h). Page
+    // protection makes system calls on watched pages fail, so it is
+    // never picked unless asked for.
+    char * backend = getenv("HPCRUN_WP_BACKEND");
+    wpConfig.softWP = false;
+    if (backend && 0 == strcasecmp(backend, "mprotect")) {
+      wpConfig.softWP = true;
+    } else if (backend && 0 != strcasecmp(backend, "hw")) {
+      EMSG("Unknown HPCRUN_WP_BACKEND %s, using hw", backend);
+    }
+
+    if(i == 0 && !wpConfig.softWP) {
+      fprintf(stderr, "Cannot create a single watch point; HPCRUN_WP_BACKEND=mprotect watches without debug registers\n");
       monitor_real_abort();
     }
+#if defined(FAST_BP_IOC_FLAG)
+    // The kernel may know the ioctl but not support it for breakpoints;
+    // find out once here rather than at the first arm.
+    struct perf_event_attr peModify = {
+      .type                   = PERF_TYPE_BREAKPOINT,
+      .size                   = sizeof(struct perf_event_attr),
+      .bp_type                = HW_BREAKPOINT_W,
+      .bp_len                 = HW_BREAKPOINT_LEN_1,
+      .bp_addr                = (uintptr_t)&dummyWP[MAX_WP_SLOTS - 1],
+      .sample_period          = 1,
+      .precise_ip             = 0 /* arbitraty skid */,
+      .sample_type            = 0,
+      .exclude_user           = 0,
+      .exclude_kernel         = 1,
+      .exclude_hv             = 1,
+      .disabled               = 0, /* enabled */
+    };
+    wpConfig.isWPModifyEnabled = i > 0 && (ioctl(wpHandles[0], FAST_BP_IOC_FLAG, (unsigned long) (&peModify)) == 0);
+#else
+    wpConfig.isWPModifyEnabled = false;
+#endif
     for (int j = 0 ; j < i; j ++) {
       CHECK(close(wpHandles[j]));
     }
+
+    if (wpConfig.softWP) {
+      if (!WPSoftInit(OnSoftWatchPoint)) {
+        fprintf(stderr, "Cannot create a single watch point\n");
+        monitor_real_abort();
+      }
+      wpConfig.isLBREnabled = false;
+      wpConfig.isWPModifyEnabled = false;
+      i = MAX_SOFT_WP_SLOTS;
+    }
     int custom_wp_size = atoi(getenv(WATCHPOINT_SIZE));
     if(custom_wp_size < i)
       wpConfig.maxWP = custom_wp_size;
@@ -437,20 +442,10 @@ __attribute__((constructor))
 
     // Get the replacement scheme
     char * replacementScheme = getenv("HPCRUN_WP_REPLACEMENT_SCHEME");
-    if(replacementScheme){
-      if(0 == strcasecmp(replacementScheme, "AUTO")) {
-        wpConfig.replacementPolicy = AUTO;
-      } if (0 == strcasecmp(replacementScheme, "OLDEST")) {
-        wpConfig.replacementPolicy = OLDEST;
-      } if (0 == strcasecmp(replacementScheme, "NEWEST")) {
-        wpConfig.replacementPolicy = NEWEST;
-      } else {
-        // default;
-        wpConfig.replacementPolicy = AUTO;
-      }
-    } else {
-      // default;
-      wpConfig.replacementPolicy = AUTO;
+    // default;
+    wpConfig.replacementPolicy = AUTO;
+    if(replacementScheme && !WPPolicyParse(replacementScheme, &wpConfig.replacementPolicy)){
+      EMSG("Unknown HPCRUN_WP_REPLACEMENT_SCHEME %s, using AUTO", replacementScheme);
     }
     //fprintf(stderr, "InitConfig is called\n"); 
     // Should we fix IP off by one?
@@ -501,14 +496,12 @@ __attribute__((constructor))
     }
 
     for(int i = 0; i < HASH_TABLE_SIZE; i++) {
-      for(int j = 0; j < MAX_WP_SLOTS; j++) {
+      for(int j = 0; j < MAX_ANY_WP_SLOTS; j++) {
         threadDataTable.hashTable[i].counter[j] = 0;	
       }
       threadDataTable.hashTable[i].os_tid = -1;
-      accessTypeLengthCache.table[i].counter = 0;
-      //fprintf(stderr, "accessTypeLengthCache.table[%d].pc: %lx\n", i, accessTypeLengthCache.table[i].pc);
     }
-    for(int i = 0; i < MAX_WP_SLOTS; i++) {
+    for(int i = 0; i < MAX_ANY_WP_SLOTS; i++) {
       globalWPIsUsers[i] = -1;
       numWatchpointArmingAttempt[i] = SAMPLES_POST_FULL_RESET_VAL;
       globalReuseWPs.table[i].tid = -1;
@@ -626,15 +619,11 @@ void SpatialReuseWPConfigOverride(void *v){
   wpConfig.dontDisassembleWPAddress = true;
 }
 
-static void CreateWatchPoint(WatchPointInfo_t * wpi, SampleData_t * sampleData, bool modify) {
-  // Perf event settings
-  create_wp_count++;
-  //fprintf(stderr, "WP is armed on address: %lx\n", sampleData->va);
-  struct perf_event_attr pe = {
+// Fill the breakpoint attributes shared by every watchpoint event.
+static void FillWatchPointAttr(struct perf_event_attr *pe, void *va, int wpLength, WatchPointType type) {
+  *pe = (struct perf_event_attr) {
     .type                   = PERF_TYPE_BREAKPOINT,
     .size                   = sizeof(struct perf_event_attr),
-    //        .bp_type                = HW_BREAKPOINT_W,
-    //        .bp_len                 = HW_BREAKPOINT_LEN_4,
     .sample_period          = 1,
     .precise_ip             = wpConfig.isLBREnabled? 2 /*precise_ip 0 skid*/ : 0 /* arbitraty skid */,
     .sample_type            = (PERF_SAMPLE_IP),
@@ -644,173 +633,136 @@ static void CreateWatchPoint(WatchPointInfo_t * wpi, SampleData_t * sampleData,
     .disabled               = 0, /* enabled */
   };
 
-  switch (sampleData->wpLength) {
-    case 1: pe.bp_len = HW_BREAKPOINT_LEN_1; break;
-    case 2: pe.bp_len = HW_BREAKPOINT_LEN_2; break;
-    case 4: pe.bp_len = HW_BREAKPOINT_LEN_4; break;
-    case 8: pe.bp_len = HW_BREAKPOINT_LEN_8; break;
+  switch (wpLength) {
+    case 1: pe->bp_len = HW_BREAKPOINT_LEN_1; break;
+    case 2: pe->bp_len = HW_BREAKPOINT_LEN_2; break;
+    case 4: pe->bp_len = HW_BREAKPOINT_LEN_4; break;
+    case 8: pe->bp_len = HW_BREAKPOINT_LEN_8; break;
     default:
-            EMSG("Unsupported .bp_len %d: %s\n", wpi->sample.wpLength,strerror(errno));
+            EMSG("Unsupported .bp_len %d: %s\n", wpLength, strerror(errno));
             monitor_real_abort();
   }
-  pe.bp_addr = (uintptr_t)sampleData->va;
+  pe->bp_addr = (uintptr_t)va;
 
-  switch (sampleData->type) {
-    case WP_READ: pe.bp_type = HW_BREAKPOINT_R; break;
-    case WP_WRITE: pe.bp_type = HW_BREAKPOINT_W; break;
-    default: pe.bp_type = HW_BREAKPOINT_W | HW_BREAKPOINT_R; 
+  switch (type) {
+    case WP_READ: pe->bp_type = HW_BREAKPOINT_R; break;
+    case WP_WRITE: pe->bp_type = HW_BREAKPOINT_W; break;
+    default: pe->bp_type = HW_BREAKPOINT_W | HW_BREAKPOINT_R;
   }
-  //fprintf(stderr, "pe.bp_len: %d, pe.bp_addr: %lx\n", pe.bp_len, pe.bp_addr);
+}
+
+// Open the breakpoint event pe on thread os_tid, deliver its signal to
+// that thread and map its buffer if LBR is enabled.
+static bool OpenWatchPointFD(WatchPointInfo_t * wpi, struct perf_event_attr *pe, pid_t os_tid) {
+  if (wpConfig.softWP) {
+    int id = WPSoftArm((void *) pe->bp_addr, pe->bp_len,
+                       (pe->bp_type & HW_BREAKPOINT_R) ? WP_RW : WP_WRITE, os_tid);
+    if (id == -1)
+      return false;
+    wpi->fileHandle = id;
+    return true;
+  }
+  int perf_fd = perf_event_open(pe, os_tid, -1, -1 /*group*/, 0);
+  if (perf_fd == -1) {
+    EMSG("Failed to open perf event file: %s\n",strerror(errno));
+    return false;
+  }
+  // Set the perf_event file to async mode
+  CHECK(fcntl(perf_fd, F_SETFL, fcntl(perf_fd, F_GETFL, 0) | O_ASYNC));
+
+  // Tell the file to send a signal when an event occurs
+  CHECK(fcntl(perf_fd, F_SETSIG, wpConfig.signalDelivered));
+
+  // Deliver the signal to the monitored thread
+  struct f_owner_ex fown_ex;
+  fown_ex.type = F_OWNER_TID;
+  fown_ex.pid  = os_tid;
+  if (fcntl(perf_fd, F_SETOWN_EX, &fown_ex) == -1){
+    EMSG("Failed to set the owner of the perf event file: %s\n", strerror(errno));
+    CHECK(close(perf_fd));
+    return false;
+  }
+
+  wpi->fileHandle = perf_fd;
+  // mmap the file if lbr is enabled
+  if(wpConfig.isLBREnabled) {
+    wpi->mmapBuffer = MAPWPMBuffer(perf_fd);
+  }
+  return true;
+}
+
+static void ReleaseWatchPointSample(WatchPointInfo_t * wpi) {
+  if (!wpi->sample.isBackTrace)
+    hpcrun_cct_unpin(wpi->sample.node);
+  wpi->sample.node = NULL;
+}
+
+// A watchpoint keeps the context of its sample until the slot is
+// armed again, and the context may be another thread's (taken from a
+// bulletin board, where its owner holds a pin): hold a pin of our own
+// on it for as long.
+static void SetWatchPointSample(WatchPointInfo_t * wpi, SampleData_t * sampleData) {
+  if (!sampleData->isBackTrace)
+    hpcrun_cct_pin(sampleData->node);
+  ReleaseWatchPointSample(wpi);
+  wpi->sample = *sampleData;
+}
+
+static bool CreateWatchPoint(WatchPointInfo_t * wpi, SampleData_t * sampleData, bool modify) {
+  // Perf event settings
+  create_wp_count++;
+  struct perf_event_attr pe;
+  FillWatchPointAttr(&pe, sampleData->va, sampleData->wpLength, sampleData->type);
+
 #if defined(FAST_BP_IOC_FLAG)
   if(modify) {
-    // modification
-    //fprintf(stderr, "watchpoint is created with FAST_BP_IOC_FLAG before fileHandle assert\n");
+    // retarget the event; it is (re)enabled since pe.disabled is 0
     assert(wpi->fileHandle != -1);
-    assert(wpi->mmapBuffer != 0 || amd_ibs_flag);
-    //DisableWatchpoint(wpi);
-    //fprintf(stderr, "watchpoint is created with FAST_BP_IOC_FLAG\n");
-    //create_wp_count++;
+    assert(wpi->mmapBuffer != 0 || !wpConfig.isLBREnabled || amd_ibs_flag);
     CHECK(ioctl(wpi->fileHandle, FAST_BP_IOC_FLAG, (unsigned long) (&pe)));
-    //if(wpi->isActive == false) {
-    //EnableWatchpoint(wpi->fileHandle);
-    //}
   } else
 #endif
   {
-
-    //create_wp_count++;
     // fresh creation
-    // Create the perf_event for this thread on all CPUs with no event group
-    //fprintf(stderr, "watchpoint is created with perf_event_open\n");
-
-    int perf_fd = perf_event_open(&pe, 0, -1, -1 /*group*/, 0);
-    if (perf_fd == -1) {
-      EMSG("Failed to open perf event file: %s\n",strerror(errno));
-      fprintf(stderr, "failed at perf_event_open\n");
-      monitor_real_abort();
-    }
-    // Set the perf_event file to async mode
-    CHECK(fcntl(perf_fd, F_SETFL, fcntl(perf_fd, F_GETFL, 0) | O_ASYNC));
-
-    // Tell the file to send a signal when an event occurs
-    CHECK(fcntl(perf_fd, F_SETSIG, wpConfig.signalDelivered));
-
-    // Deliver the signal to this thread
-    struct f_owner_ex fown_ex;
-    fown_ex.type = F_OWNER_TID;
-    fown_ex.pid  = syscall(__NR_gettid);//gettid();
-    int ret = fcntl(perf_fd, F_SETOWN_EX, &fown_ex);
-    if (ret == -1){
-      fprintf(stderr, "failed at F_SETOWN_EX\n");
-      EMSG("Failed to set the owner of the perf event file: %s\n", strerror(errno));
-      return;
-    }
-
-
-    //       CHECK(fcntl(perf_fd, F_SETOWN, gettid()));
-
-    wpi->fileHandle = perf_fd;
-    // mmap the file if lbr is enabled
-    if(wpConfig.isLBREnabled) {
-      //fprintf(stderr, "failed at mmapBuffer\n");
-      wpi->mmapBuffer = MAPWPMBuffer(perf_fd);
+    if(!OpenWatchPointFD(wpi, &pe, syscall(__NR_gettid))) {
+      return false;
     }
   }
 
   wp_active++;
   wpi->isActive = true;
   wpi->va = (void *) pe.bp_addr;
-  wpi->sample = *sampleData;
+  SetWatchPointSample(wpi, sampleData);
   wpi->startTime = rdtsc();
   wpi->bulletinBoardTimestamp = sampleData->bulletinBoardTimestamp;
-//  fprintf(stderr, "CreateWatchPoint is done\n");
+  return true;
 }
 
-static void CreateWatchPointShared(WatchPointInfo_t * wpi, SampleData_t * sampleData, int tid, bool modify) {
+static bool CreateWatchPointShared(WatchPointInfo_t * wpi, SampleData_t * sampleData, int tid, bool modify) {
   // Perf event settings
   create_wp_count++;
-  struct perf_event_attr pe = {
-    .type                   = PERF_TYPE_BREAKPOINT,
-    .size                   = sizeof(struct perf_event_attr),
-    //        .bp_type                = HW_BREAKPOINT_W,
-    //        .bp_len                 = HW_BREAKPOINT_LEN_4,
-    .sample_period          = 1,
-    .precise_ip             = wpConfig.isLBREnabled? 2 /*precise_ip 0 skid*/ : 0 /* arbitraty skid */,
-    .sample_type            = (PERF_SAMPLE_IP),
-    .exclude_user           = 0,
-    .exclude_kernel         = 1,
-    .exclude_hv             = 1,
-    .disabled               = 0, /* enabled */
-  };
-
-  switch (sampleData->wpLength) {
-    case 1: pe.bp_len = HW_BREAKPOINT_LEN_1; break;
-    case 2: pe.bp_len = HW_BREAKPOINT_LEN_2; break;
-    case 4: pe.bp_len = HW_BREAKPOINT_LEN_4; break;
-    case 8: pe.bp_len = HW_BREAKPOINT_LEN_8; break;
-    default:
-            EMSG("Unsupported .bp_len %d: %s\n", wpi->sample.wpLength,strerror(errno));
-            fprintf(stderr, "error: Unsupported .bp_len %d: %s\n", wpi->sample.wpLength,strerror(errno));
-            monitor_real_abort();
-  }
-  pe.bp_addr = (uintptr_t)sampleData->va;
-
-  switch (sampleData->type) {
-    case WP_READ: pe.bp_type = HW_BREAKPOINT_R; break;
-    case WP_WRITE: pe.bp_type = HW_BREAKPOINT_W; break;
-    default: pe.bp_type = HW_BREAKPOINT_W | HW_BREAKPOINT_R;
-  }
+  struct perf_event_attr pe;
+  FillWatchPointAttr(&pe, sampleData->va, sampleData->wpLength, sampleData->type);
 
 #if defined(FAST_BP_IOC_FLAG)
   if(modify) {
     assert(wpi->fileHandle != -1);
-    //assert(wpi->mmapBuffer != 0);
-    //fprintf(stderr, "this region is reached\n");
     CHECK(ioctl(wpi->fileHandle, FAST_BP_IOC_FLAG, (unsigned long) (&pe)));
-  } else 
+  } else
 #endif
-    if (threadDataTable.hashTable[tid].os_tid != -1) { 
-      int perf_fd = perf_event_open(&pe, threadDataTable.hashTable[tid].os_tid, -1, -1, 0);
-      if (perf_fd == -1) {
-        EMSG("Failed to open perf event file: %s\n",strerror(errno));
-        return;
-      }
-
-      // Set the perf_event file to async mode
-      CHECK(fcntl(perf_fd, F_SETFL, fcntl(perf_fd, F_GETFL, 0) | O_ASYNC));
-
-      // Tell the file to send a signal when an event occurs
-      CHECK(fcntl(perf_fd, F_SETSIG, wpConfig.signalDelivered));
-
-      // Deliver the signal to this thread
-      struct f_owner_ex fown_ex;
-      fown_ex.type = F_OWNER_TID;
-      fown_ex.pid  = threadDataTable.hashTable[tid].os_tid; //gettid();
-      int ret = fcntl(perf_fd, F_SETOWN_EX, &fown_ex);
-      if (ret == -1){
-        EMSG("Failed to set the owner of the perf event file: %s\n", strerror(errno));
-        return;
+    if (threadDataTable.hashTable[tid].os_tid != -1) {
+      if(!OpenWatchPointFD(wpi, &pe, threadDataTable.hashTable[tid].os_tid)) {
+        return false;
       }
-
-
-      //       CHECK(fcntl(perf_fd, F_SETOWN, gettid()));
-
-      wpi->fileHandle = perf_fd;
       // insert to perf_fd - tid table here
-      // mmap the file if lbr is enabled
-      if(wpConfig.isLBREnabled) {
-        //fprintf(stderr, "mmapBuffer is initialized\n");
-        wpi->mmapBuffer = MAPWPMBuffer(perf_fd);
-      }
-
-      //fprintf(stderr, "perf_event_open has been used successfully\n");
-      int idx = fdDataInsert(perf_fd, threadDataTable.hashTable[tid].os_tid, tid);
+      fdDataInsert(wpi->fileHandle, threadDataTable.hashTable[tid].os_tid, tid);
     }
   wp_active++;
   wpi->isActive = true;
   wpi->va = (void *) pe.bp_addr;
-  wpi->sample = *sampleData;
+  SetWatchPointSample(wpi, sampleData);
   wpi->startTime = rdtsc();
+  return true;
 }
 
 /* create a dummy PERF_TYPE_HARDWARE event that will never fire */
@@ -850,6 +802,13 @@ static void DisArm(WatchPointInfo_t * wpi){
   //assert(wpi->isActive);
   assert(wpi->fileHandle != -1);
 
+  if (wpConfig.softWP) {
+    WPSoftRelease(wpi->fileHandle);
+    wpi->fileHandle = -1;
+    wpi->isActive = false;
+    return;
+  }
+
   if(wpi->mmapBuffer)
     UNMAPWPMBuffer(wpi->mmapBuffer);
   wpi->mmapBuffer = 0;
@@ -860,46 +819,80 @@ static void DisArm(WatchPointInfo_t * wpi){
 }
 
 static bool ArmWatchPoint(WatchPointInfo_t * wpi, SampleData_t * sampleData) {
-  // if WP modification is suppoted use it
-  //void * cacheLineBaseAddress = (void *) ((uint64_t)((size_t)sampleData->va) & (~(64-1)));
+  uint64_t start = rdtsc();
+  bool armed;
   arm_wp_count++;
-  if(wpConfig.isWPModifyEnabled){
-    // Does not matter whether it was active or not.
-    // If it was not active, enable it.
-    if(wpi->fileHandle != -1) {
-      CreateWatchPoint(wpi, sampleData, true);
-      return true;
+  // if WP modification is suppoted, retarget the slot's pooled event.
+  // Does not matter whether it was active or not; if it was not active, enable it.
+  if(wpConfig.isWPModifyEnabled && wpi->fileHandle != -1){
+    armed = CreateWatchPoint(wpi, sampleData, true);
+  } else {
+    // disable the old WP if active
+    if(wpi->isActive) {
+      DisArm(wpi);
     }
+    armed = CreateWatchPoint(wpi, sampleData, false);
   }
-  // disable the old WP if active
-  if(wpi->isActive) {
-    DisArm(wpi);
+  WPCounterInc(WP_CTR_ARMS);
+  WPCounterAdd(WP_CTR_ARM_CYCLES, rdtsc() - start);
+  if (hpcrun_overhead_enabled) {
+    hpcrun_overhead_end(HPCRUN_OVH_WP_ARM, start);
   }
-  CreateWatchPoint(wpi, sampleData, false);
-  return true;
+  return armed;
 }
 
 
 static bool ArmWatchPointShared(WatchPointInfo_t * wpi, SampleData_t * sampleData, int tid) {
+  uint64_t start = rdtsc();
+  bool armed;
   arm_wp_count++;
-  if(wpConfig.isWPModifyEnabled){
-    // Does not matter whether it was active or not.
-    // If it was not active, enable it.
-    if((wpi->fileHandle != -1) && (sampleData->first_accessing_tid == wpi->sample.first_accessing_tid)) {
-      //fprintf(stderr, "CreateWatchPointShared is entered with modify by thread %d in thread %d\n", TD_GET(core_profile_trace_data.id), tid);
-      CreateWatchPointShared(wpi, sampleData, tid, true);
-      return true;
+  // the pooled events of a slot always monitor thread tid, whoever arms them
+  if(wpConfig.isWPModifyEnabled && wpi->fileHandle != -1){
+    armed = CreateWatchPointShared(wpi, sampleData, tid, true);
+  } else {
+    if(wpi->fileHandle != -1) {
+      DisArm(wpi);
+    }
+    armed = CreateWatchPointShared(wpi, sampleData, tid, false);
+  }
+  WPCounterInc(WP_CTR_ARMS);
+  WPCounterAdd(WP_CTR_ARM_CYCLES, rdtsc() - start);
+  if (hpcrun_overhead_enabled) {
+    hpcrun_overhead_end(HPCRUN_OVH_WP_ARM, start);
+  }
+  return armed;
+}
+
+// Open one disabled breakpoint per slot for the calling thread so that
+// arming a slot later is a single FAST_BP_IOC_FLAG ioctl.
+static void OpenWatchPointPool(int me) {
+  pid_t os_tid = syscall(__NR_gettid);
+  for (int i = 0; i < wpConfig.maxWP; i++) {
+    WatchPointInfo_t *wpi = &tData.watchPointArray[i];
+    struct perf_event_attr pe;
+    FillWatchPointAttr(&pe, wpi, 1, WP_WRITE);
+    pe.disabled = 1;
+    if(!OpenWatchPointFD(wpi, &pe, os_tid)) {
+      // this slot falls back to opening its event at arm time
+      continue;
     }
+    fdDataInsert(wpi->fileHandle, os_tid, me);
   }
+}
 
-  if(wpi->fileHandle != -1) {
-    DisArm(wpi);
+// The software backend has more slots than the debug registers; its
+// per-thread watchpoints are allocated only when it is in use, so the
+// hardware backend keeps MAX_WP_SLOTS inline.
+static WatchPointInfo_t * AllocSoftSlots(void) {
+  WatchPointInfo_t * slots = hpcrun_malloc_freeable(sizeof(WatchPointInfo_t) * MAX_SOFT_WP_SLOTS);
+  if (slots == NULL) {
+    EMSG("Failed to allocate the software watchpoint slots");
+    monitor_real_abort();
   }
-  //fprintf(stderr, "CreateWatchPointShared is entered without modify\n");
-  //fprintf(stderr, "CreateWatchPointShared is entered with modify by thread %d in thread %d without modify\n", TD_GET(core_profile_trace_data.id), tid);
-  CreateWatchPointShared(wpi, sampleData, tid, false);
-  return true;
+  memset(slots, 0, sizeof(WatchPointInfo_t) * MAX_SOFT_WP_SLOTS);
+  return slots;
 }
+
 // Per thread initialization
 
 void WatchpointThreadInit(WatchPointUpCall_t func){
@@ -916,13 +909,15 @@ void WatchpointThreadInit(WatchPointUpCall_t func){
     EMSG("Failed sigaltstack");
     monitor_real_abort();
   }
+  if (wpConfig.softWP)
+    WPSoftThreadInit();
 
   tData.lbrDummyFD = -1;
   tData.fptr = func;
   tData.fs_reg_val = (void*)-1;
   tData.gs_reg_val = (void*)-1;
   srand48_r(time(NULL), &tData.randBuffer);
-  tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
+  WPPolicyStateInit(&tData.policy, wpConfig.maxWP, &tData.randBuffer);
   tData.numWatchpointTriggers = 0;
   tData.numWatchpointImpreciseIP = 0;
   tData.numWatchpointImpreciseAddressArbitraryLength = 0;
@@ -931,12 +926,17 @@ void WatchpointThreadInit(WatchPointUpCall_t func){
   tData.numSampleTriggeringWatchpoints = 0;
   tData.numInsaneIP = 0;
 
+  // scratch memory to read the watchpoint buffers in the signal handler
+  perf_mmap_thread_init();
 
+  tData.watchPointArray = wpConfig.softWP ? AllocSoftSlots() : tData.hwWatchPointArray;
   for (int i=0; i<wpConfig.maxWP; i++) {
     tData.watchPointArray[i].isActive = false;
     tData.watchPointArray[i].fileHandle = -1;
     tData.watchPointArray[i].startTime = 0;
-    tData.numWatchpointArmingAttempt[i] = SAMPLES_POST_FULL_RESET_VAL;
+  }
+  if(wpConfig.isWPModifyEnabled) {
+    OpenWatchPointPool(TD_GET(core_profile_trace_data.id));
   }
 
   //if LBR is supported create a dummy PERF_TYPE_HARDWARE for Linux workaround
@@ -949,11 +949,21 @@ void WatchpointThreadInit(WatchPointUpCall_t func){
   int me = TD_GET(core_profile_trace_data.id);
   tData.os_tid = syscall(__NR_gettid); //gettid();
 
-  for(int i = 0; i < MAX_WP_SLOTS; i++)
+  for(int i = 0; i < MAX_ANY_WP_SLOTS; i++)
     tData.counter[i] = 0;
 
   //if((event_type == WP_REUSE_MT) || (event_type == WP_MT_REUSE))
+  // the table entry keeps its own copy of the slots; software slots of
+  // an entry stay allocated for the next thread that gets its index
+  WatchPointInfo_t * tableSlots = threadDataTable.hashTable[me].watchPointArray;
   threadDataTable.hashTable[me] = tData;
+  if (!wpConfig.softWP) {
+    tableSlots = threadDataTable.hashTable[me].hwWatchPointArray;
+  } else if (tableSlots == NULL) {
+    tableSlots = AllocSoftSlots();
+  }
+  memcpy(tableSlots, tData.watchPointArray, sizeof(WatchPointInfo_t) * wpConfig.maxWP);
+  threadDataTable.hashTable[me].watchPointArray = tableSlots;
 #endif
 }
 
@@ -1006,6 +1016,7 @@ void WatchpointThreadTerminate(){
       if(threadDataTable.hashTable[me].watchPointArray[i].fileHandle != -1) {
         DisArm(&threadDataTable.hashTable[me].watchPointArray[i]);
       }	
+      ReleaseWatchPointSample(&threadDataTable.hashTable[me].watchPointArray[i]);
     }
 
     if(threadData.lbrDummyFD != -1) {
@@ -1020,6 +1031,7 @@ void WatchpointThreadTerminate(){
       if(tData.watchPointArray[i].fileHandle != -1) {
         DisArm(&tData.watchPointArray[i]);
       }
+      ReleaseWatchPointSample(&tData.watchPointArray[i]);
     }
 
     if(tData.lbrDummyFD != -1) {
@@ -1031,7 +1043,14 @@ void WatchpointThreadTerminate(){
   }
   //fprintf(stderr, "tData.numWatchpointTriggers: %ld\n", tData.numWatchpointTriggers); 
   //fprintf(stderr, "tData.numActiveWatchpointTriggers: %ld\n", tData.numActiveWatchpointTriggers);
+  if (wpConfig.softWP)
+    WPSoftThreadFini();
+  if (tData.watchPointArray != tData.hwWatchPointArray) {
+    hpcrun_free(tData.watchPointArray);
+    tData.watchPointArray = tData.hwWatchPointArray;
+  }
   hpcrun_stats_num_watchpoints_triggered_inc(tData.numWatchpointTriggers);
+  WPPolicyThreadFini(&tData.policy, wpConfig.replacementPolicy);
   hpcrun_stats_num_watchpoints_imprecise_inc(tData.numWatchpointImpreciseIP);
   hpcrun_stats_num_watchpoints_imprecise_address_inc(tData.numWatchpointImpreciseAddressArbitraryLength);
   hpcrun_stats_num_watchpoints_imprecise_address_8_byte_inc(tData.numWatchpointImpreciseAddress8ByteLength);
@@ -1052,14 +1071,10 @@ void WatchpointThreadTerminate(){
 }
 
 bool ArmWatchPointProb(int * location, uint64_t sampleTime, int me) {
-  double probabilityToReplace =  1.0/((double)numWatchpointArmingAttempt[*location]);
-  double randValue;
-  drand48_r(&tData.randBuffer, &randValue);
-  if((randValue <= probabilityToReplace) /*|| (profiling_mode == L3 && probabilityToReplace <= 0.001)*/) { 
+  if(WPReservoirAccept(&tData.randBuffer, 1.0, numWatchpointArmingAttempt[*location])) {
     /*if(profiling_mode == L3 && probabilityToReplace <= 0.001)
 	    fprintf(stderr, "reset that is special to L3 profiling");*/
     numWatchpointArmingAttempt[*location]++;
-    //fprintf(stderr, "watchpoint is armed randValue: %0.2lf and probabilityToReplace: %0.2lf, denominator: %d, location: %d, arming thread: %d\n", randValue, probabilityToReplace, numWatchpointArmingAttempt[*location]-1, *location, TD_GET(core_profile_trace_data.id));
     globalReuseWPs.table[*location].active = true;
     globalReuseWPs.table[*location].sharedActive = true;
     //globalReuseWPs.table[*location].first_coherence_miss = true;
@@ -1071,9 +1086,7 @@ bool ArmWatchPointProb(int * location, uint64_t sampleTime, int me) {
     globalReuseWPs.table[*location].rd = 0;
     return true;
   } else {
-	  //fprintf(stderr, "thread %d fails to arm location %d while a wp armed by %d is still monitored, randValue: %0.2lf, probabilityToReplace:%0.2lf\n", me, *location, globalReuseWPs.table[*location].monitored_tid, randValue, probabilityToReplace);
   }
-  //fprintf(stderr, "watchpoint is not armed randValue: %0.2lf and probabilityToReplace: %0.2lf, denominator: %d, location: %d, arming thread: %d\n", randValue, probabilityToReplace, numWatchpointArmingAttempt[*location], *location, TD_GET(core_profile_trace_data.id));
  
   /*if(globalReuseWPs.table[*location].monitored_tid != globalReuseWPs.table[*location].tid)
   	fprintf(stderr, "owner tid is different from monitored tid and watchpoint arming is not allowed\n");*/
@@ -1083,255 +1096,56 @@ bool ArmWatchPointProb(int * location, uint64_t sampleTime, int me) {
 }
 
 // Finds a victim slot to set a new WP
-static VictimType GetVictim(int * location, ReplacementPolicy policy){
-  // If any WP slot is inactive, return it;
+static VictimType GetVictim(int * location, ReplacementPolicy policy, SampleData_t * sampleData){
+  uint64_t start = rdtsc();
+  tData.policy.activeMask = 0;
   for(int i = 0; i < wpConfig.maxWP; i++){
-    if(!tData.watchPointArray[i].isActive) {
-      *location = i;
-      //fprintf(stderr, "empty slot found in watchpoint %d by thread %d, tData.numWatchpointArmingAttempt[0]: %ld, tData.numWatchpointArmingAttempt[1]: %ld, tData.numWatchpointArmingAttempt[2]: %ld, tData.numWatchpointArmingAttempt[3]: %ld, tData.watchPointArray[0].isActive: %d, tData.watchPointArray[1].isActive: %d, tData.watchPointArray[2].isActive: %d, tData.watchPointArray[3].isActive: %d\n", i, TD_GET(core_profile_trace_data.id), tData.numWatchpointArmingAttempt[0], tData.numWatchpointArmingAttempt[1], tData.numWatchpointArmingAttempt[2], tData.numWatchpointArmingAttempt[3], tData.watchPointArray[0].isActive, tData.watchPointArray[1].isActive, tData.watchPointArray[2].isActive, tData.watchPointArray[3].isActive);
-      if(policy == RDX) {
-        for(int j = 0; j < wpConfig.maxWP; j++){
-          if(tData.watchPointArray[j].isActive || (i == j)){
-            tData.numWatchpointArmingAttempt[j]++;
-          }
-        }
-      }
-      //fprintf(stderr, "after empty slot found in watchpoint %d by thread %d, tData.numWatchpointArmingAttempt[0]: %ld, tData.numWatchpointArmingAttempt[1]: %ld, tData.numWatchpointArmingAttempt[2]: %ld, tData.numWatchpointArmingAttempt[3]: %ld, tData.watchPointArray[0].isActive: %d, tData.watchPointArray[1].isActive: %d, tData.watchPointArray[2].isActive: %d, tData.watchPointArray[3].isActive: %d\n", i, TD_GET(core_profile_trace_data.id), tData.numWatchpointArmingAttempt[0], tData.numWatchpointArmingAttempt[1], tData.numWatchpointArmingAttempt[2], tData.numWatchpointArmingAttempt[3], tData.watchPointArray[0].isActive, tData.watchPointArray[1].isActive, tData.watchPointArray[2].isActive, tData.watchPointArray[3].isActive);
-      //fprintf(stderr, "empty slot is found\n");
-      return EMPTY_SLOT;
-    }
+    if(tData.watchPointArray[i].isActive)
+      tData.policy.activeMask |= 1u << i;
   }
-  switch (policy) {
-    case AUTO:{
-                //fprintf(stderr, "replacement policy is AUTO\n");
-                // Equal probability for any data access
-
-
-                // Randomly pick a slot to victimize.
-                long int tmpVal;
-                lrand48_r(&tData.randBuffer, &tmpVal);
-                int rSlot = tmpVal % wpConfig.maxWP;
-                *location = rSlot;
-
-                // if it is the first sample after full, use wpConfig.maxWP/(wpConfig.maxWP+1) probability to replace.
-                // if it is the second sample after full, use wpConfig.maxWP/(wpConfig.maxWP+2) probability to replace.
-                // if it is the third sample after full, use wpConfig.maxWP/(wpConfig.maxWP+3) probability replace.
-
-                double probabilityToReplace =  wpConfig.maxWP/((double)wpConfig.maxWP+tData.samplePostFull);
-                double randValue;
-                drand48_r(&tData.randBuffer, &randValue);
-
-                // update tData.samplePostFull
-                //fprintf(stderr, "thread id: %d, tData.samplePostFull: %ld\n", TD_GET(core_profile_trace_data.id), tData.samplePostFull);
-                tData.samplePostFull++;
-                //fprintf(stderr, "thread id: %d, tData.samplePostFull: %ld\n", TD_GET(core_profile_trace_data.id), tData.samplePostFull);
-                //fprintf(stderr, "probabilityToReplace: %0.2lf\n", probabilityToReplace); 
-                if(randValue <= probabilityToReplace) {
-                  return NON_EMPTY_SLOT;
-                }
-                // this is an indication not to replace, but if the client chooses to force, they can
-                return NONE_AVAILABLE;
-              }
-              break;
-
-    case NEWEST:{
-                  // Always replace the newest
-                  //fprintf(stderr, "replacement policy is NEWEST\n");
-                  int64_t newestTime = 0;
-                  for(int i = 0; i < wpConfig.maxWP; i++){
-                    if(newestTime < tData.watchPointArray[i].startTime) {
-                      *location = i;
-                      newestTime = tData.watchPointArray[i].startTime;
-                    }
-                  }
-                  return NON_EMPTY_SLOT;
-                }
-                break;
-
-    case OLDEST:{
-                  // Always replace the oldest
-                  //fprintf(stderr, "replacement policy is OLDEST\n");
-                  int64_t oldestTime = INT64_MAX;
-                  for(int i = 0; i < wpConfig.maxWP; i++){
-                    if(oldestTime > tData.watchPointArray[i].startTime) {
-                      *location = i;
-                      oldestTime = tData.watchPointArray[i].startTime;
-                    }
-                  }
-                  return NON_EMPTY_SLOT;
-                }
-                break;
-
-    case EMPTY_SLOT_ONLY:{
-                           return NONE_AVAILABLE;
-                         }
-                         break;
-    case RDX:{
-               // make a random sequence of watchpoints to visit 
-               // before
-               int indices[wpConfig.maxWP];
-               for (int i = 0; i < wpConfig.maxWP; i++) {
-                 indices[i] = i;
-               }
-               //fprintf(stderr, "in thread %d, before indices[0]: %d, indices[1]: %d, indices[2]: %d, indices[3]: %d\n", TD_GET(core_profile_trace_data.id), indices[0], indices[1], indices[2], indices[3]);
-               int wp_index = wpConfig.maxWP;
-               while (wp_index) {
-                 long int tmpVal;
-                 lrand48_r(&tData.randBuffer, &tmpVal);
-                 int index = tmpVal % wp_index;
-                 wp_index--;
-                 int swap = indices[index];
-                 indices[index] = indices[wp_index];
-                 indices[wp_index] = swap;
-               }
-               //fprintf(stderr, "in thread %d, after indices[0]: %d, indices[1]: %d, indices[2]: %d, indices[3]: %d\n", TD_GET(core_profile_trace_data.id), indices[0], indices[1], indices[2], indices[3]);
-               // after
-               // visit each watchpoint according to the sequence
-               for(int i = 0; i < wpConfig.maxWP; i++) {
-                 int idx = indices[i];
-                 double probabilityToReplace =  1.0/((double)tData.numWatchpointArmingAttempt[idx]);
-                 double randValue;
-                 drand48_r(&tData.randBuffer, &randValue);
-                 //fprintf(stderr, "i: %d, idx: %d, denominator: %ld, probability: %0.4lf\n", i, idx, tData.numWatchpointArmingAttempt[idx], probabilityToReplace);
-                 if(randValue <= probabilityToReplace /* 1 */) {
-                   *location = idx;
-                   //fprintf(stderr, "arming watchpoint at i: %d and probability: %0.4lf\n", i, probabilityToReplace);
-                   for(int j = 0; j < wpConfig.maxWP; j++){
-                     tData.numWatchpointArmingAttempt[j]++;
-                   }
-                   return NON_EMPTY_SLOT;
-                 }
-               }
-               for(int i = 0; i < wpConfig.maxWP; i++) {
-                 tData.numWatchpointArmingAttempt[i]++;
-               }
-
-               return NONE_AVAILABLE;
-             }
-             break;
-    default:
-             return NONE_AVAILABLE;
-  }
-  // No unarmed WP slot found.
-}
-
-static inline void
-rmb(void) {
-  asm volatile("lfence":::"memory");
-}
-
-static void ConsumeAllRingBufferData(void  *mbuf) {
-  struct perf_event_mmap_page *hdr = (struct perf_event_mmap_page *)mbuf;
-  unsigned long tail;
-  size_t avail_sz;
-  size_t pgmsk = wpConfig.pgsz - 1;
-  /*
-   * data points to beginning of buffer payload
-   */
-  void * data = ((void *)hdr) + wpConfig.pgsz;
-
-  /*
-   * position of tail within the buffer payload
-   */
-  tail = hdr->data_tail & pgmsk;
-
-  /*
-   * size of what is available
-   *
-   * data_head, data_tail never wrap around
-   */
-  avail_sz = hdr->data_head - hdr->data_tail;
-  rmb();
-#if 0
-  if(avail_sz == 0 )
-    EMSG("\n avail_sz = %d\n", avail_sz);
-  else
-    EMSG("\n EEavail_sz = %d\n", avail_sz);
-#endif
-  // reset tail to head
-  hdr->data_tail = hdr->data_head;
-}
-
-
-
-static int ReadMampBuffer(void  *mbuf, void *buf, size_t sz) {
-  //fprintf(stderr, "in ReadMampBuffer\n");
-  struct perf_event_mmap_page *hdr = (struct perf_event_mmap_page *)mbuf;
-  //fprintf(stderr, "in ReadMampBuffer 6\n");
-  void *data;
-  unsigned long tail;
-  size_t avail_sz, m, c;
-  size_t pgmsk = wpConfig.pgsz - 1;
-  if(hdr == NULL)
-    return -1;
-  /*
-   * data points to beginning of buffer payload
-   */
-  data = ((void *)hdr) + wpConfig.pgsz;
-
-  /*
-   * position of tail within the buffer payload
-   */
-  //fprintf(stderr, "in ReadMampBuffer 7\n");
-  tail = hdr->data_tail & pgmsk;
-
-  /*
-   * size of what is available
-   *
-   * data_head, data_tail never wrap around
-   */
-  //fprintf(stderr, "in ReadMampBuffer 5\n");
-  avail_sz = hdr->data_head - hdr->data_tail;
-  if (sz > avail_sz) {
-    //printf("\n sz > avail_sz: sz = %lu, avail_sz = %lu\n", sz, avail_sz);
-    rmb();
-    return -1;
-  }
-
-  /* From perf_event_open() manpage */
-  rmb();
-
-
-  /*
-   * sz <= avail_sz, we can satisfy the request
-   */
-
-  /*
-   * c = size till end of buffer
-   *
-   * buffer payload size is necessarily
-   * a power of two, so we can do:
-   */
-  c = pgmsk + 1 -  tail;
-
-  /*
-   * min with requested size
-   */
-  m = c < sz ? c : sz;
-
-  //fprintf(stderr, "in ReadMampBuffer 4\n"); 
-  /* copy beginning */
-  memcpy(buf, data + tail, m);
-
-  /*
-   * copy wrapped around leftover
-   */
-  //fprintf(stderr, "in ReadMampBuffer 3\n");
-  if (sz > m)
-    memcpy(buf + m, data, sz - m);
-  //fprintf(stderr, "in ReadMampBuffer 2\n");
-  hdr->data_tail += sz;
-
-  return 0;
+  VictimType r = WPPolicySelectVictim(&tData.policy, policy, sampleData, location);
+  tData.policy.stats.overheadCycles += rdtsc() - start;
+  return r;
 }
 
+// Arms the slot returned by GetVictim and records it with the policy.
+static bool ArmVictim(int location, VictimType r, SampleData_t * sampleData, bool captureValue){
+  uint64_t start = rdtsc();
+  // VV IMP: Capture value before arming the WP.
+  if(captureValue) {
+    CaptureValue(sampleData, &tData.watchPointArray[location]);
+  }
+  // I know the error case that we have captured the value but ArmWatchPoint fails.
+  // I am not handling that corner case because ArmWatchPoint() will fail with a monitor_real_abort().
+  if(ArmWatchPoint(&tData.watchPointArray[location], sampleData) == false){
+    //LOG to hpcrun log
+    EMSG("ArmWatchPoint failed for address %p", sampleData->va);
+    return false;
+  }
+  WPPolicyNoteArm(&tData.policy, wpConfig.replacementPolicy, location, sampleData, r);
+  tData.policy.stats.overheadCycles += rdtsc() - start;
+  return true;
+}
 
-void
-SkipBuffer(struct perf_event_mmap_page *hdr, size_t sz){
-  if ((hdr->data_tail + sz) > hdr->data_head)
-    sz = hdr->data_head - hdr->data_tail;
-  rmb();
-  hdr->data_tail += sz;
+// Read the first record of the ring buffer of a watchpoint: its header
+// and the IP that follows it in a sample.  The records left in the
+// buffer are dropped.
+static bool ReadWatchPointRecord(void *mbuf, struct perf_event_header *hdr, void **ip) {
+  perf_ring_pass_t pass;
+  perf_ring_begin(&pass, mbuf, wpConfig.pgsz);
+  pe_header_t *record = perf_ring_next(&pass);
+  if (record == NULL) {
+    perf_ring_end(&pass);
+    return false;
+  }
+  *hdr = *record;
+  if (record->size >= sizeof(*hdr) + sizeof(uint64_t)) {
+    memcpy(ip, record + 1, sizeof(uint64_t));
+  }
+  // We must cleanup the mmap buffer if there is any data left
+  perf_ring_skip_all(&pass);
+  perf_ring_end(&pass);
+  return true;
 }
 
 static inline bool IsPCSane(void * contextPC, void *possiblePC){
@@ -1359,7 +1173,7 @@ double ProportionOfWatchpointAmongOthersSharingTheSameContext(WatchPointInfo_t *
 
 static inline void *  GetPatchedIP(void *  contextIP) {
   void * patchedIP;
-  void * excludeList[MAX_WP_SLOTS] = {0};
+  void * excludeList[MAX_ANY_WP_SLOTS] = {0};
   int numExcludes = 0;
   for(int idx = 0; idx < wpConfig.maxWP; idx++){
     if(tData.watchPointArray[idx].isActive) {
@@ -1375,7 +1189,7 @@ static inline void *  GetPatchedIPShared(void *  contextIP, int me) {
   //fprintf(stderr, "in GetPatchedIPShared\n");
   ThreadData_t threadData = threadDataTable.hashTable[me];
   void * patchedIP;
-  void * excludeList[MAX_WP_SLOTS] = {0};
+  void * excludeList[MAX_ANY_WP_SLOTS] = {0};
   int numExcludes = 0;
   for(int idx = 0; idx < wpConfig.maxWP; idx++){
     if(threadData.watchPointArray[idx].isActive) {
@@ -1387,13 +1201,31 @@ static inline void *  GetPatchedIPShared(void *  contextIP, int me) {
   return patchedIP;
 }
 
+// A software watchpoint trap carries what the page fault saw before the
+// access: the exact pc and address and the decoded access.
+static bool CollectSoftTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrigger_t *wpt, void * context){
+  const WPSoftTrigger_t *t = WPSoftCurrentTrigger();
+  if (t->id != wpi->fileHandle)
+    return false;
+  wpt->pc = t->pc;
+  wpt->accessLength = t->accessLength;
+  wpt->accessType = t->accessType;
+  wpt->floatType = t->floatType;
+  wpt->va = wpConfig.dontDisassembleWPAddress ? (void *)-1 : t->va;
+  wpt->ctxt = context;
+  return true;
+}
+
 // Gather all useful data when a WP triggers
 static bool CollectWatchPointTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrigger_t *wpt, void * context){
   //struct perf_event_mmap_page * b = wpi->mmapBuffer;
   struct perf_event_header hdr;
+  void * recordIP = (void *)-1;
+  if (wpConfig.softWP)
+    return CollectSoftTriggerInfo(wpi, wpt, context);
   //fprintf(stderr, "in CollectWatchPointTriggerInfo\n");
-  if (ReadMampBuffer(wpi->mmapBuffer, &hdr, sizeof(struct perf_event_header)) < 0) {
-    EMSG("Failed to ReadMampBuffer: %s\n", strerror(errno));
+  if (!ReadWatchPointRecord(wpi->mmapBuffer, &hdr, &recordIP)) {
+    EMSG("Failed to read the watchpoint buffer\n");
     monitor_real_abort();
   }
   //fprintf(stderr, "in CollectWatchPointTriggerInfo 1\n");
@@ -1406,10 +1238,11 @@ static bool CollectWatchPointTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrig
       void *  reliableIP = (void *)-1;
       void *  addr = (void *)-1;
       if (hdr.type & PERF_SAMPLE_IP){
-        if (ReadMampBuffer(wpi->mmapBuffer, &preciseIP, sizeof(uint64_t)) < 0) {
-          EMSG("Failed to ReadMampBuffer: %s\n", strerror(errno));
+        if (hdr.size < sizeof(hdr) + sizeof(uint64_t)) {
+          EMSG("Failed to read the sample IP\n");
           monitor_real_abort();
         }
+        preciseIP = recordIP;
 
         if(! (hdr.misc & PERF_RECORD_MISC_EXACT_IP)){
           //EMSG("PERF_SAMPLE_IP imprecise\n");
@@ -1464,13 +1297,16 @@ static bool CollectWatchPointTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrig
         FloatType * floatType = wpConfig.getFloatType? &wpt->floatType : 0;
 	//fprintf(stderr, "before: wpt->pc: %lx, wpt->accessLength: %d, wpt->accessType: %d, context: %lx, addr: %lx\n", wpt->pc, wpt->accessLength, wpt->accessType, context, addr);
 	//fprintf(stderr, "looking for precisePC: %lx in getEntryFromAccessTypeLengthCache in OnWatchPoint\n", wpt->pc);
-	if(false == getEntryFromAccessTypeLengthCache(wpt->pc, (uint32_t*) &(wpt->accessLength), &(wpt->accessType))) {
+	// A cache hit has no accessed address and falls back to the sampled
+	// one.  Clients that want the float type compare values at the exact
+	// address, so they always disassemble.
+	if(floatType || false == getEntryFromAccessTypeLengthCache(wpt->pc, (uint32_t*) &(wpt->accessLength), &(wpt->accessType), NULL)) {
 		if(false == get_mem_access_length_and_type_address(wpt->pc, (uint32_t*) &(wpt->accessLength), &(wpt->accessType), floatType, context, &addr)){
           	//EMSG("WP triggered on a non Load/Store add = %p\n", wpt->pc);
           	goto ErrExit;
         	}
 		//fprintf(stderr, "insertEntryToAccessTypeLengthCache is called in OnWatchPoint\n");
-		insertEntryToAccessTypeLengthCache(wpt->pc, wpt->accessLength, wpt->accessType); 
+		insertEntryToAccessTypeLengthCache(wpt->pc, wpt->accessLength, wpt->accessType, floatType);
 	} else {
 		//fprintf(stderr, "entry taken from AccessTypeLengthCache\n");
 		addr = wpi->va;
@@ -1505,8 +1341,6 @@ static bool CollectWatchPointTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrig
         wpt->va = (void *)-1;
       }
       wpt->ctxt = context;
-      // We must cleanup the mmap buffer if there is any data left
-      ConsumeAllRingBufferData(wpi->mmapBuffer);
       return true;
     case PERF_RECORD_EXIT:
       EMSG("PERF_RECORD_EXIT sample type %d sz=%d\n", hdr.type, hdr.size);
@@ -1531,20 +1365,20 @@ static bool CollectWatchPointTriggerInfo(WatchPointInfo_t  * wpi, WatchPointTrig
   }
 
 ErrExit:
-  // We must cleanup the mmap buffer if there is any data left
-  ConsumeAllRingBufferData(wpi->mmapBuffer);
   return false;
 }
 
 static bool CollectWatchPointTriggerInfoShared(WatchPointInfo_t  * wpi, WatchPointTrigger_t *wpt, void * context, int me){
   //struct perf_event_mmap_page * b = wpi->mmapBuffer;
   struct perf_event_header hdr;
+  void * recordIP = (void *)-1;
   //fprintf(stderr, "in CollectWatchPointTriggerInfoShared in thread %d\n", me);
+  if (wpConfig.softWP)
+    return CollectSoftTriggerInfo(wpi, wpt, context);
   if (wpi->mmapBuffer == 0)
     goto ErrExit2;
-  if (ReadMampBuffer(wpi->mmapBuffer, &hdr, sizeof(struct perf_event_header)) < 0) {
-    EMSG("Failed to ReadMampBuffer: %s\n", strerror(errno));
-    //fprintf(stderr, "error: Failed to ReadMampBuffer: %s\n", strerror(errno));
+  if (!ReadWatchPointRecord(wpi->mmapBuffer, &hdr, &recordIP)) {
+    EMSG("Failed to read the watchpoint buffer\n");
     //monitor_real_abort();
     goto ErrExit2;
   }
@@ -1558,12 +1392,12 @@ static bool CollectWatchPointTriggerInfoShared(WatchPointInfo_t  * wpi, WatchPoi
       void *  reliableIP = (void *)-1;
       void *  addr = (void *)-1;
       if (hdr.type & PERF_SAMPLE_IP){
-        if (ReadMampBuffer(wpi->mmapBuffer, &preciseIP, sizeof(uint64_t)) < 0) {
-          EMSG("Failed to ReadMampBuffer: %s\n", strerror(errno));
-          //fprintf(stderr, "error: Failed to ReadMampBuffer: %s\n", strerror(errno));
+        if (hdr.size < sizeof(hdr) + sizeof(uint64_t)) {
+          EMSG("Failed to read the sample IP\n");
           //monitor_real_abort();
           goto ErrExit2;
         }
+        preciseIP = recordIP;
 
         if(! (hdr.misc & PERF_RECORD_MISC_EXACT_IP)){
           //EMSG("PERF_SAMPLE_IP imprecise\n");
@@ -1650,8 +1484,6 @@ static bool CollectWatchPointTriggerInfoShared(WatchPointInfo_t  * wpi, WatchPoi
         wpt->va = (void *)-1;
       }
       wpt->ctxt = context;
-      // We must cleanup the mmap buffer if there is any data left
-      ConsumeAllRingBufferData(wpi->mmapBuffer);
       return true;
     case PERF_RECORD_EXIT:
       EMSG("PERF_RECORD_EXIT sample type %d sz=%d\n", hdr.type, hdr.size);
@@ -1676,20 +1508,52 @@ static bool CollectWatchPointTriggerInfoShared(WatchPointInfo_t  * wpi, WatchPoi
   }
 
 ErrExit:
-  // We must cleanup the mmap buffer if there is any data left
-  ConsumeAllRingBufferData(wpi->mmapBuffer);
 ErrExit2:
   return false;
 }
 
 void DisableWatchpointWrapper(WatchPointInfo_t *wpi){
-//#if  0
+  uint64_t start = rdtsc();
   if(wpConfig.isWPModifyEnabled) {
     DisableWatchpoint(wpi);
   } else {
-//#endif
     DisArm(wpi);
   }
+  WPCounterInc(WP_CTR_DISARMS);
+  WPCounterAdd(WP_CTR_DISARM_CYCLES, rdtsc() - start);
+}
+
+// Restricts the arming of this thread to its first n slots and disarms
+// the slots above; used by the adaptive controller.
+void WatchpointThreadSetActiveSlots(int n){
+  if (n < 1 || n > wpConfig.maxWP)
+    return;
+  for (int i = n; i < wpConfig.maxWP; i++) {
+    if (tData.watchPointArray[i].isActive)
+      DisableWatchpointWrapper(&tData.watchPointArray[i]);
+  }
+  tData.policy.maxWP = n;
+}
+
+// Hands the cct nodes held by this thread's armed watchpoints and by the
+// global reuse tables to the cct pruner, which keeps those of this
+// thread's ccts; called on the pruning thread.
+void WatchpointProtectCCTNodes(){
+  for (int i = 0; i < wpConfig.maxWP; i++) {
+    WatchPointInfo_t *wpi = &tData.watchPointArray[i];
+    if (wpi->isActive && !wpi->sample.isBackTrace)
+      hpcrun_cct_prune_protect(wpi->sample.node);
+  }
+  for (int i = 0; i < MAX_ANY_WP_SLOTS; i++) {
+    hpcrun_cct_prune_protect(globalReuseWPs.table[i].reusePairNode);
+    hpcrun_cct_prune_protect(globalReuseWPs.table[i].commReusePairNode);
+    hpcrun_cct_prune_protect(globalStoreReuseWPs.table[i].reusePairNode);
+    hpcrun_cct_prune_protect(globalStoreReuseWPs.table[i].commReusePairNode);
+    for (int j = 0; j < 4; j++) {
+      hpcrun_cct_prune_protect(globalL3ReuseWPs[j].table[i].reusePairNode);
+      hpcrun_cct_prune_protect(globalL3ReuseWPs[j].table[i].commReusePairNode);
+    }
+  }
 }
 
 WatchPointInfo_t * getWPI  (int me, int location) {
@@ -1697,7 +1561,29 @@ WatchPointInfo_t * getWPI  (int me, int location) {
 }
 
 
+// Software watchpoint traps take the path of the hardware ones, with
+// the id of the watchpoint in place of the perf event fd.
+static void OnSoftWatchPoint(int id, void *context){
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  info.si_signo = wpConfig.signalDelivered;
+  info.si_fd = id;
+  OnWatchPoint(wpConfig.signalDelivered, &info, context);
+}
+
+// Times the trap handler for the adaptive controller.
 static int OnWatchPoint(int signum, siginfo_t *info, void *context){
+  uint64_t start = rdtsc();
+  int ret = HandleWatchPoint(signum, info, context);
+  uint64_t end = rdtsc();
+  WPAdaptiveNoteTrap(end - start);
+  if (hpcrun_overhead_enabled) {
+    hpcrun_overhead_end(HPCRUN_OVH_WP_TRAP, start);
+  }
+  return ret;
+}
+
+static int HandleWatchPoint(int signum, siginfo_t *info, void *context){
   //volatile int x;
   //fprintf(stderr, "OnWatchPoint=%p\n", &x);
   //fprintf(stderr, "OnWatchPoint is executed\n");
@@ -1793,8 +1679,7 @@ static int OnWatchPoint(int signum, siginfo_t *info, void *context){
                              }
                              // Reset per WP probability
                              //wpi->samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
-                             tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
-                             threadDataTable.hashTable[me].numWatchpointArmingAttempt[location] = SAMPLES_POST_FULL_RESET_VAL;
+                             tData.policy.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
                              /*if(wpi->sample.L1Sample) { 
                                uint64_t theCounter = globalReuseWPs.table[location].counter;
                                if((theCounter & 1) == 0) {
@@ -1815,8 +1700,7 @@ static int OnWatchPoint(int signum, siginfo_t *info, void *context){
 
           case ALREADY_DISABLED: { // Already disabled, perhaps in pre-WP action
                                    //assert(wpi->isActive == false);
-                                   tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;					       
-                                   threadDataTable.hashTable[me].numWatchpointArmingAttempt[location] = SAMPLES_POST_FULL_RESET_VAL;
+                                   tData.policy.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;					       
                                    /*if(wpi->sample.L1Sample) {
                                      uint64_t theCounter = globalReuseWPs.table[location].counter;
                                      if((theCounter & 1) == 0) {
@@ -1923,6 +1807,7 @@ static int OnWatchPoint(int signum, siginfo_t *info, void *context){
   } else {
     //fprintf(stderr, "in OnWatchpoint at that point 1!!!!\n");
     tData.numActiveWatchpointTriggers++;
+    WPPolicyNoteTrap(&tData.policy, location);
     retVal = tData.fptr(wpi, 0, wpt.accessLength/* invalid*/,  &wpt);
     //fprintf(stderr, "in OnWatchpoint at that point 2!!!!\n");
   }
@@ -1937,7 +1822,7 @@ static int OnWatchPoint(int signum, siginfo_t *info, void *context){
                          DisableWatchpointWrapper(wpi);
                        }
                        //reset to tData.samplePostFull
-                       tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
+                       tData.policy.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
                        //tData.numWatchpointArmingAttempt[location] = SAMPLES_POST_FULL_RESET_VAL;
                        //fprintf(stderr, "tData.samplePostFull is reset in DISABLE_WP in thread %d\n", TD_GET(core_profile_trace_data.id));
                      }
@@ -1949,16 +1834,16 @@ static int OnWatchPoint(int signum, siginfo_t *info, void *context){
                              }
                            }
                            //reset to tData.samplePostFull to SAMPLES_POST_FULL_RESET_VAL
-                           tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
+                           tData.policy.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
                            //tData.numWatchpointArmingAttempt[location] = SAMPLES_POST_FULL_RESET_VAL;
                            //fprintf(stderr, "tData.samplePostFull is reset in DISABLE_ALL_WP in thread %d\n", TD_GET(core_profile_trace_data.id));
                          }
                          break;
     case ALREADY_DISABLED: { // Already disabled, perhaps in pre-WP action
                              assert(wpi->isActive == false);
-                             tData.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
+                             tData.policy.samplePostFull = SAMPLES_POST_FULL_RESET_VAL;
                              if (wpConfig.replacementPolicy == RDX) {
-                               tData.numWatchpointArmingAttempt[location] = SAMPLES_POST_FULL_RESET_VAL;
+                               tData.policy.slot[location].attempts = SAMPLES_POST_FULL_RESET_VAL;
                                //fprintf(stderr, "watchpoint %d is reset due to trap\n", location);
                              }
                              //fprintf(stderr, "tData.samplePostFull is reset in ALREADY_DISABLED in thread %d\n", TD_GET(core_profile_trace_data.id));
@@ -2055,43 +1940,18 @@ bool SubscribeWatchpointAlwaysReplace(SampleData_t * sampleData, OverwritePolicy
   if(ValidateWPData(sampleData) == false) {
     return false;
   }
-  //sub_wp_count2++;
-  //fprintf(stderr, "that position on address %lx\n", sampleData->va);
-//#if 0
   int victimLocation = -1;
   VictimType r = EMPTY_SLOT;
   if(!IsOveralppedReplace(&victimLocation,sampleData)){
-    //return false; // drop the sample if it overlaps an existing address
-	r = GetVictim(&victimLocation, wpConfig.replacementPolicy);
+    // No overlap, look for a victim slot
+    r = GetVictim(&victimLocation, wpConfig.replacementPolicy, sampleData);
+  } else {
+    tData.policy.stats.offered++;
   }
-//#endif
   sub_wp_count2++;
-
-  // No overlap, look for a victim slot
-  //int victimLocation = -1;
-  // Find a slot to install WP
-  //VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy);
-  //fprintf(stderr, "that position on address %lx\n", sampleData->va);
   sub_wp_count3++;
   if(r != NONE_AVAILABLE) {
-    // VV IMP: Capture value before arming the WP.
-    if(captureValue) {
-      CaptureValue(sampleData, &tData.watchPointArray[victimLocation]);
-    }
-    // I know the error case that we have captured the value but ArmWatchPoint fails.
-    // I am not handling that corner case because ArmWatchPoint() will fail with a monitor_real_abort().
-    //printf("and this region\n");
-    //printf("arming watchpoints\n");
-    //fprintf(stderr, "this position on address %lx\n", sampleData->va);
-
-    if(ArmWatchPoint(&tData.watchPointArray[victimLocation], sampleData) == false){
-      //LOG to hpcrun log
-      EMSG("ArmWatchPoint failed for address %p", sampleData->va);
-      return false;
-    }
-    //fprintf(stderr, "watchpoint has been armed\n");
-    return true;
-    //return false;
+    return ArmVictim(victimLocation, r, sampleData, captureValue);
   }
   none_available_count++;
   return false;
@@ -2102,37 +1962,17 @@ bool SubscribeWatchpoint(SampleData_t * sampleData, OverwritePolicy overwritePol
   if(ValidateWPData(sampleData) == false) {
     return false;
   }
-  //sub_wp_count2++;
-  //fprintf(stderr, "before IsOveralpped\n");
   if(IsOveralpped(sampleData)){
     return false; // drop the sample if it overlaps an existing address
   }
-  //fprintf(stderr, "after IsOveralpped\n");
   sub_wp_count2++;
 
   // No overlap, look for a victim slot
   int victimLocation = -1;
-  // Find a slot to install WP
-  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy);
+  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy, sampleData);
   sub_wp_count3++;
   if(r != NONE_AVAILABLE) {
-    // VV IMP: Capture value before arming the WP.
-    if(captureValue) {
-      CaptureValue(sampleData, &tData.watchPointArray[victimLocation]);
-    }
-    // I know the error case that we have captured the value but ArmWatchPoint fails.
-    // I am not handling that corner case because ArmWatchPoint() will fail with a monitor_real_abort().
-    //printf("and this region\n");
-    //printf("arming watchpoints\n");
-    //fprintf(stderr, "watchpoint is armed\n");
-
-    if(ArmWatchPoint(&tData.watchPointArray[victimLocation], sampleData) == false){
-      //LOG to hpcrun log
-      EMSG("ArmWatchPoint failed for address %p", sampleData->va);
-      return false;
-    }
-    return true;
-    //return false;
+    return ArmVictim(victimLocation, r, sampleData, captureValue);
   }
   none_available_count++;
   return false;
@@ -2191,28 +2031,14 @@ bool SubscribeWatchpointWithStoreTime(SampleData_t * sampleData, OverwritePolicy
 
   // No overlap, look for a victim slot
   int victimLocation = -1;
-  // Find a slot to install WP
-  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy);
+  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy, sampleData);
 
   if(r != NONE_AVAILABLE) {
-    // VV IMP: Capture value before arming the WP.
-    if(captureValue) {
-      CaptureValue(sampleData, &tData.watchPointArray[victimLocation]);
+    // the victim is kept until its bulletin board entry expires
+    WatchPointInfo_t *victim = &tData.watchPointArray[victimLocation];
+    if((curTime - victim->sample.bulletinBoardTimestamp) > victim->sample.expirationPeriod) {
+      return ArmVictim(victimLocation, r, sampleData, captureValue);
     }
-    // I know the error case that we have captured the value but ArmWatchPoint fails.
-    // I am not handling that corner case because ArmWatchPoint() will fail with a monitor_real_abort().
-    //printf("and this region\n");
-    //printf("arming watchpoints\n");
-    if((curTime - tData.watchPointArray[victimLocation].sample.bulletinBoardTimestamp) > tData.watchPointArray[victimLocation].sample.expirationPeriod) {
-      //printf("watchpoints are armed on address %lx, length: %d\n", sampleData->va, sampleData->accessLength);
-      if(ArmWatchPoint(&tData.watchPointArray[victimLocation], sampleData) == false){
-        //LOG to hpcrun log
-        EMSG("ArmWatchPoint failed for address %p", sampleData->va); 
-        return false;
-      }
-    } /*else {
-        printf("watchpoints are not armed because they are still new\n");
-        }*/
     return true;
   }
   return false;
@@ -2228,28 +2054,14 @@ bool SubscribeWatchpointWithTime(SampleData_t * sampleData, OverwritePolicy over
 
   // No overlap, look for a victim slot
   int victimLocation = -1;
-  // Find a slot to install WP
-  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy);
+  VictimType r = GetVictim(&victimLocation, wpConfig.replacementPolicy, sampleData);
 
   if(r != NONE_AVAILABLE) {
-    // VV IMP: Capture value before arming the WP.
-    if(captureValue) {
-      CaptureValue(sampleData, &tData.watchPointArray[victimLocation]);
+    // the victim is kept if it is newer than the last sampling interval
+    WatchPointInfo_t *victim = &tData.watchPointArray[victimLocation];
+    if((sampleData->bulletinBoardTimestamp - victim->bulletinBoardTimestamp) > (curTime - lastTime)) {
+      return ArmVictim(victimLocation, r, sampleData, captureValue);
     }
-    // I know the error case that we have captured the value but ArmWatchPoint fails.
-    // I am not handling that corner case because ArmWatchPoint() will fail with a monitor_real_abort().
-    //printf("and this region\n");
-    //printf("arming watchpoints\n");
-    if((sampleData->bulletinBoardTimestamp - tData.watchPointArray[victimLocation].bulletinBoardTimestamp) > (curTime - lastTime)) {
-      //printf("watchpoints are armed on address %lx, length: %d\n", sampleData->va, sampleData->accessLength);
-      if(ArmWatchPoint(&tData.watchPointArray[victimLocation], sampleData) == false){
-        //LOG to hpcrun log
-        EMSG("ArmWatchPoint failed for address %p", sampleData->va);
-        return false;
-      }
-    } /*else {
-        printf("watchpoints are not armed because they are still new\n");
-        }*/
     return true;
   }
   return false;
@@ -44,6 +44,7 @@
 #include <monitor.h>
 
 #include <hpcrun/cct/cct.h>
+#include <hpcrun/hpcrun_clock.h>
 #include <hpcrun/metrics.h>
 #include <hpcrun/sample_event.h>
 #include <hpcrun/sample_sources_registered.h>
@@ -80,7 +81,7 @@ typedef enum SampleType {ALL_LOAD, ALL_STORE, UNKNOWN_SAMPLE_TYPE} SampleType;
 typedef enum FunctionType {SAME_FN, DIFF_FN, UNKNOWN_FN} FunctionType;
 typedef enum FloatType {ELEM_TYPE_FLOAT16, ELEM_TYPE_SINGLE, ELEM_TYPE_DOUBLE, ELEM_TYPE_LONGDOUBLE, ELEM_TYPE_LONGBCD, ELEM_TYPE_UNKNOWN} FloatType;
 typedef enum WatchPointType {WP_READ, WP_WRITE, WP_RW, WP_INVALID } WatchPointType;
-typedef enum ReplacementPolicy {AUTO, EMPTY_SLOT_ONLY, OLDEST, NEWEST, RDX} ReplacementPolicy;
+typedef enum ReplacementPolicy {AUTO, EMPTY_SLOT_ONLY, OLDEST, NEWEST, RDX, WEIGHTED_RESERVOIR, AGE_DECAY, CONTEXT_FAIR, NUM_REPLACEMENT_POLICIES} ReplacementPolicy;
 typedef enum MergePolicy {AUTO_MERGE, NO_MERGE, CLIENT_ACTION} MergePolicy;
 typedef enum OverwritePolicy {OVERWRITE, NO_OVERWRITE} OverwritePolicy;
 typedef enum VictimType {EMPTY_SLOT, NON_EMPTY_SLOT, NONE_AVAILABLE} VictimType;
@@ -123,6 +124,9 @@ typedef struct SampleData{
 	uint64_t sampleTime;
 	int L3Id;
 	int L2Id;
+	double weight; // importance for the weighted replacement policies, 0 counts as 1
+	uint64_t samplingPeriod; // period the sample was taken with, 0 if unknown
+	int numWatchpoints; // watchpoints armed for the sample, 0 if unknown
 } SampleData_t;
 
 typedef struct WatchPointInfo{
@@ -162,6 +166,7 @@ typedef struct WPConfig {
 	size_t pgsz;
 	ReplacementPolicy replacementPolicy;
 	int maxWP;
+	bool softWP; // page protection instead of debug registers
 } WPConfig_t;
 
 extern WPConfig_t wpConfig;
@@ -228,16 +233,24 @@ extern void LoadSpyWPConfigOverride(void *v);
 extern bool WatchpointClientActive();
 //extern inline uint64_t GetWeightedMetricDiffAndReset(cct_node_t * ctxtNode, int pebsMetricId, double proportion);
 extern void DisableWatchpointWrapper(WatchPointInfo_t *wpi);
-extern bool getEntryFromAccessTypeLengthCache(void * pc, uint32_t *accessLen, AccessType *accessType);
-extern void insertEntryToAccessTypeLengthCache(void * pc, uint32_t accessLen, AccessType accessType);
+extern void WatchpointThreadSetActiveSlots(int n);
+extern void WatchpointProtectCCTNodes();
 
+// bulletin board and watchpoint time stamps are compared across
+// threads: TSC ticks when they are consistent across cores, else
+// nanoseconds (see hpcrun_clock.h)
 static inline  uint64_t rdtsc(){
-	unsigned int lo,hi;
-	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
-	return ((uint64_t)hi << 32) | lo;
+	return hpcrun_clock_ticks();
 }
 
+// the debug registers give at most 4 watchpoints
 #define MAX_WP_SLOTS (5)
+// the software backend gives as many as WATCHPOINT_SIZE asks for up to
+// this; its per-thread watchpoints are allocated apart from the
+// hardware ones, see WatchpointThreadInit
+#define MAX_SOFT_WP_SLOTS (16)
+// bound of a slot index under either backend
+#define MAX_ANY_WP_SLOTS (MAX_SOFT_WP_SLOTS)
 #define CACHE_LINE_SIZE (64)
 
 typedef struct globalReuseEntry{
@@ -266,24 +279,12 @@ typedef struct globalReuseEntry{
 
 typedef struct globalReuseTable{
   volatile uint64_t counter __attribute__((aligned(CACHE_LINE_SZ)));
-  struct globalReuseEntry table[MAX_WP_SLOTS];
+  struct globalReuseEntry table[MAX_ANY_WP_SLOTS];
   //struct SharedData * hashTable;
 } globalReuseTable_t;
 
 #define HASH_TABLE_SIZE 503
 
-typedef struct accessTypeLengthEntry{
-  volatile uint64_t counter __attribute__((aligned(CACHE_LINE_SZ)));
-  void * pc;
-  AccessType accessType;  
-  int accessLength; 
-  char dummy[CACHE_LINE_SZ];
-} accessTypeLengthEntry_t;
-
-typedef struct accessTypeLengthTable{
-  struct accessTypeLengthEntry table[HASH_TABLE_SIZE];
-} accessTypeLengthTable_t;
-
 #define CHANGE_THRESHOLD 50
 #define L2_MISS_RATIO_PERIOD 50
 
@@ -52,10 +52,13 @@
 
 #include <unwind/common/backtrace.h>
 #include <cct/cct.h>
+#include <cct/cct_prune.h>
 #include "hpcrun_dlfns.h"
+#include "hpcrun_overhead.h"
 #include "hpcrun_stats.h"
 #include "hpcrun-malloc.h"
 #include "fnbounds_interface.h"
+#include "loadmap.h"
 #include "main.h"
 #include "metrics_types.h"
 #include "cct2metrics.h"
@@ -69,6 +72,7 @@
 #include <utilities/arch/context-pc.h>
 #include "hpcrun-malloc.h"
 #include "sample_event.h"
+#include "snapshot.h"
 #include "sample_sources_all.h"
 #include "start-stop.h"
 #include "uw_recipe_map.h"
@@ -200,10 +204,14 @@ hpcrun_sample_callpath(void* context, int metricId,
     monitor_unblock_shootdown();
     return ret;
   }
+  if (hpcrun_dlopen_pending() > 0) {
+    hpcrun_stats_num_samples_during_dlopen_inc();
+  }
 #endif
 
   TMSG(SAMPLE_CALLPATH, "attempting sample");
   hpcrun_stats_num_samples_attempted_inc();
+  uint64_t ovh_start = hpcrun_overhead_begin();
 
   thread_data_t* td   = hpcrun_get_thread_data();
   sigjmp_buf_t* it    = &(td->bad_unwind);
@@ -222,6 +230,9 @@ hpcrun_sample_callpath(void* context, int metricId,
 
   td->btbuf_cur = NULL;
   td->deadlock_drop = false;
+  // one loadmap read section for the whole unwind; the per-frame
+  // lookups nest in it
+  int dso_epoch = hpcrun_loadmap_read_begin();
   int ljmp = sigsetjmp(it->jb, 1);
   if (ljmp == 0) {
     if (epoch != NULL) {
@@ -234,6 +245,12 @@ hpcrun_sample_callpath(void* context, int metricId,
       /* check to see if shared library loadmap (of current epoch) has changed out from under us */
       epoch = hpcrun_check_for_new_loadmap(epoch);
 
+      // over its cct budget, the thread folds cold subtrees before
+      // this sample adds to them
+      if (td->cct_bytes > td->cct_prune_limit) {
+        hpcrun_cct_prune();
+      }
+
       void *data_aux = NULL;
       if (data != NULL)
         data_aux = data->sample_data;
@@ -295,6 +312,7 @@ hpcrun_sample_callpath(void* context, int metricId,
     //fprintf(stderr, "counter in node %d becomes %d and watermark counter is %d for metric %d with index %d\n", context_sample_count[me][node_id_idx][0] - 1, context_sample_count[me][node_id_idx][sample_type+1], context_watermark_sample_count[me][node_id_idx][sample_type+1], metricId, sample_type+1);
     }*/
   }
+  hpcrun_loadmap_read_end(dso_epoch);
   td->current_jmp_buf = old;
 
   // --------------------------------------
@@ -333,6 +351,7 @@ hpcrun_sample_callpath(void* context, int metricId,
   TMSG(TRACE1, "trace ok (!deadlock drop) = %d", trace_ok);
   if (trace_ok && hpcrun_trace_isactive()) {
     TMSG(TRACE, "Sample event encountered");
+    uint64_t ovh_trace = hpcrun_overhead_begin();
 
     cct_addr_t frm;
     memset(&frm, 0, sizeof(cct_addr_t));
@@ -348,6 +367,7 @@ hpcrun_sample_callpath(void* context, int metricId,
 
     hpcrun_trace_append(&td->core_profile_trace_data, func_proxy, metricId);
     TMSG(TRACE, "Appended func_proxy node to trace");
+    hpcrun_overhead_end(HPCRUN_OVH_TRACE, ovh_trace);
   }
 
   hpcrun_clear_handling_sample(td);
@@ -355,10 +375,14 @@ hpcrun_sample_callpath(void* context, int metricId,
     hpcrun_flush_epochs(&(TD_GET(core_profile_trace_data)));
     hpcrun_reclaim_freeable_mem();
   }
+  // a snapshot requested since this thread's last one is written here,
+  // once this sample is in the cct
+  hpcrun_snapshot_poll();
 #ifndef HPCRUN_STATIC_LINK
   hpcrun_dlopen_read_unlock();
 #endif
 
+  hpcrun_overhead_end(HPCRUN_OVH_SAMPLE, ovh_start);
   TMSG(SAMPLE_CALLPATH,"done w sample, return %p", ret.sample_node);
   monitor_unblock_shootdown();
 
@@ -400,12 +424,16 @@ hpcrun_gen_thread_ctxt(void* context)
   hpcrun_set_handling_sample(td);
 
   td->btbuf_cur = NULL;
+  // the unwind reads the load map and unwind intervals that a dlclose
+  // in another thread may be retiring
+  int dso_epoch = hpcrun_loadmap_read_begin();
   int ljmp = sigsetjmp(it->jb, 1);
   backtrace_info_t bt;
   if (ljmp == 0) {
     if (epoch != NULL) {
       if (! hpcrun_generate_backtrace_no_trampoline(&bt, context,
           PTHREAD_CTXT_SKIP_INNER)) {
+        hpcrun_loadmap_read_end(dso_epoch);
         hpcrun_clear_handling_sample(td); // restore state
         EMSG("Internal error: unable to obtain backtrace for pthread context");
         return NULL;
@@ -421,7 +449,13 @@ hpcrun_gen_thread_ctxt(void* context)
     }
     node = hpcrun_cct_record_backtrace(&(epoch->csdata), false, &bt,
         bt.has_tramp);
+
+    // the new thread's creation context points here for good
+    if (node) {
+      hpcrun_cct_pin(node);
+    }
   }
+  hpcrun_loadmap_read_end(dso_epoch);
   // restore back the sigjmp
   td->current_jmp_buf = old;
 
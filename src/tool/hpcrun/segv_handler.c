@@ -100,6 +100,8 @@ typedef struct segv_list_s {
 static SLIST_HEAD(segv_list_head, segv_list_s) list_cb_head = 
 	SLIST_HEAD_INITIALIZER(segv_list_head);
 
+static hpcrun_segv_filter_t segv_filter = NULL;
+
 //***************************************************************************
 // catch SIGSEGVs
 //***************************************************************************
@@ -109,6 +111,10 @@ static SLIST_HEAD(segv_list_head, segv_list_s) list_cb_head =
 int
 hpcrun_sigsegv_handler(int sig, siginfo_t* siginfo, void* context)
 {
+  if (sig == SIGSEGV && segv_filter && segv_filter(siginfo, context)) {
+    return 0;
+  }
+
   if (hpcrun_is_handling_sample()) {
     hpcrun_stats_num_samples_segv_inc();
 
@@ -212,3 +218,10 @@ hpcrun_segv_register_cb( hpcrun_sig_callback_t cb )
 }
 
 
+// Install the filter that software watchpoints use to take their page
+// faults before hpcrun or the application sees them.
+void
+hpcrun_segv_set_filter( hpcrun_segv_filter_t filter )
+{
+  segv_filter = filter;
+}
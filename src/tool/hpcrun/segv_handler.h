@@ -47,11 +47,21 @@
 #ifndef SEGV_HANDLER_H
 #define SEGV_HANDLER_H
 
+#include <signal.h>
+#include <stdbool.h>
+
 typedef void (*hpcrun_sig_callback_t) (void);
 
+// a filter sees every SIGSEGV first; it returns true for a fault it
+// has resolved, which then returns to the faulting instruction
+typedef bool (*hpcrun_segv_filter_t) (siginfo_t* siginfo, void* context);
+
 int 
 hpcrun_segv_register_cb( hpcrun_sig_callback_t cb );
 
+void
+hpcrun_segv_set_filter( hpcrun_segv_filter_t filter );
+
 int
 hpcrun_setup_segv();
 
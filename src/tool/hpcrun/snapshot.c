@@ -0,0 +1,326 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// In-flight profile snapshots.
+//
+// A snapshot is requested either every HPCRUN_SNAPSHOT_INTERVAL seconds
+// or by sending the process HPCRUN_SNAPSHOT_SIGNAL. A request bumps a
+// process-wide generation number; each thread notices it at its next
+// sample, writes its metric deltas since its previous snapshot to
+// <profile name>.snapshot-<n>.hpcrun and zeroes its metrics. Only the
+// owning thread touches its cct, so no sampling is stopped.
+//
+// The write happens in the sample handler, so it must not take the
+// stdio or malloc locks that the interrupted code may hold. Each thread
+// gets its snapshot stream at init: a fopencookie stream with a
+// preallocated buffer, whose write hook passes the bytes to write(2) on
+// the fd of the snapshot being written. In the handler the file is
+// opened with open(2), the stream is flushed into it and the fd is
+// closed; the stream itself stays open for the thread's lifetime.
+//
+
+//***************************************************************************
+// system include files 
+//***************************************************************************
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//***************************************************************************
+// libmonitor include files
+//***************************************************************************
+
+#include <monitor.h>
+
+
+//***************************************************************************
+// user include files 
+//***************************************************************************
+
+#include "env.h"
+#include "files.h"
+#include "hpcrun_return_codes.h"
+#include "rank.h"
+#include "sample_prob.h"
+#include "snapshot.h"
+#include "thread_data.h"
+#include "write_data.h"
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+
+#include <lib/prof-lean/stdatomic.h>
+
+
+//***************************************************************************
+// macros
+//***************************************************************************
+
+#define SNAPSHOT_BUF_SIZE (64 * 1024)
+
+
+//***************************************************************************
+// local data
+//***************************************************************************
+
+static bool snapshot_enabled = false;
+static uint64_t interval_ns = 0;
+static atomic_uint_least64_t next_deadline_ns = ATOMIC_VAR_INIT(0);
+static atomic_uint snapshot_generation = ATOMIC_VAR_INIT(0);
+
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+
+// write hook of the snapshot streams: everything to the fd of the
+// snapshot being written, or fail when there is none
+static ssize_t
+snapshot_stream_write(void* cookie, const char* buf, size_t size)
+{
+  int fd = *(int*) cookie;
+  size_t done = 0;
+
+  if (fd < 0) return -1;
+  while (done < size) {
+    ssize_t n = write(fd, buf + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return done > 0 ? (ssize_t) done : -1;
+    }
+    done += n;
+  }
+  return done;
+}
+
+
+static int
+snapshot_signal_handler(int sig, siginfo_t* siginfo, void* context)
+{
+  atomic_fetch_add_explicit(&snapshot_generation, 1, memory_order_relaxed);
+  return 0;
+}
+
+
+// a signal number, or a name with or without its SIG prefix
+static int
+parse_signal(const char* s)
+{
+  static const struct { const char* name; int sig; } names[] = {
+    { "HUP", SIGHUP }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+  };
+
+  char* end;
+  long sig = strtol(s, &end, 10);
+  if (end != s && *end == '\0') {
+    return (0 < sig && sig < NSIG) ? (int) sig : -1;
+  }
+  if (strncmp(s, "SIG", 3) == 0) s += 3;
+  for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(s, names[i].name) == 0) return names[i].sig;
+  }
+  return -1;
+}
+
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+hpcrun_snapshot_init(void)
+{
+  const char* s = getenv(HPCRUN_SNAPSHOT_INTERVAL);
+  if (s && *s) {
+    char* end;
+    double secs = strtod(s, &end);
+    if (*end != '\0' || secs <= 0) {
+      EMSG("ignoring bad %s=%s", HPCRUN_SNAPSHOT_INTERVAL, s);
+    }
+    else {
+      interval_ns = (uint64_t) (secs * 1e9);
+      atomic_store_explicit(&next_deadline_ns, now_ns() + interval_ns, memory_order_relaxed);
+      snapshot_enabled = true;
+    }
+  }
+
+  s = getenv(HPCRUN_SNAPSHOT_SIGNAL);
+  if (s && *s) {
+    int sig = parse_signal(s);
+    if (sig < 0) {
+      EMSG("ignoring bad %s=%s", HPCRUN_SNAPSHOT_SIGNAL, s);
+    }
+    else if (monitor_sigaction(sig, &snapshot_signal_handler, 0, NULL) != 0) {
+      EMSG("unable to install the snapshot handler for signal %d", sig);
+    }
+    else {
+      snapshot_enabled = true;
+    }
+  }
+
+  TMSG(SNAPSHOT, "snapshots %s, interval = %"PRIu64" ns",
+       snapshot_enabled ? "on" : "off", interval_ns);
+}
+
+
+void
+hpcrun_snapshot_thread_init(void)
+{
+  thread_data_t* td = hpcrun_get_thread_data();
+
+  td->snapshot_stream = NULL;
+  td->snapshot_fd = -1;
+  if (! snapshot_enabled) return;
+
+  cookie_io_functions_t io = { .write = snapshot_stream_write };
+  FILE* fs = fopencookie(&td->snapshot_fd, "w", io);
+  void* buf = hpcrun_malloc(SNAPSHOT_BUF_SIZE);
+  if (fs == NULL || buf == NULL || setvbuf(fs, buf, _IOFBF, SNAPSHOT_BUF_SIZE) != 0) {
+    EMSG("unable to set up the snapshot stream, thread %d takes no snapshots",
+         td->core_profile_trace_data.id);
+    if (fs) fclose(fs);
+    return;
+  }
+  td->snapshot_stream = fs;
+}
+
+
+void
+hpcrun_snapshot_thread_fini(void)
+{
+  thread_data_t* td = hpcrun_get_thread_data();
+
+  if (td->snapshot_stream) {
+    fclose(td->snapshot_stream);
+    td->snapshot_stream = NULL;
+  }
+}
+
+
+bool
+hpcrun_snapshot_enabled(void)
+{
+  return snapshot_enabled;
+}
+
+
+unsigned int
+hpcrun_snapshot_generation(void)
+{
+  return atomic_load_explicit(&snapshot_generation, memory_order_relaxed);
+}
+
+
+void
+hpcrun_snapshot_poll(void)
+{
+  if (! snapshot_enabled) return;
+
+  if (interval_ns) {
+    uint64_t now = now_ns();
+    uint64_t next = atomic_load_explicit(&next_deadline_ns, memory_order_relaxed);
+    // only the thread that moves the deadline requests the snapshot
+    if (now >= next &&
+        atomic_compare_exchange_strong(&next_deadline_ns, &next, now + interval_ns)) {
+      atomic_fetch_add_explicit(&snapshot_generation, 1, memory_order_relaxed);
+    }
+  }
+
+  thread_data_t* td = hpcrun_get_thread_data();
+  unsigned int gen = hpcrun_snapshot_generation();
+  if (td->snapshot_generation == gen) return;
+
+  // requests that pile up between two samples make one snapshot
+  td->snapshot_generation = gen;
+  if (td->snapshot_stream == NULL || ! hpcrun_sample_prob_active()) return;
+
+  core_profile_trace_data_t* cptd = &td->core_profile_trace_data;
+  char path[PATH_MAX];
+  int fd = hpcrun_open_snapshot_file(hpcrun_get_rank(), cptd->id,
+                                     cptd->snapshot_index, path);
+  if (fd < 0) {
+    EMSG("unable to open snapshot file %d for thread %d: %s",
+         cptd->snapshot_index, cptd->id, strerror(errno));
+    return;
+  }
+  td->snapshot_fd = fd;
+  int ret = hpcrun_write_snapshot(cptd, td->snapshot_stream);
+  if (ret != HPCRUN_OK) {
+    // drop what a failed write left in the buffer
+    __fpurge(td->snapshot_stream);
+    clearerr(td->snapshot_stream);
+  }
+  td->snapshot_fd = -1;
+  close(fd);
+  if (ret != HPCRUN_OK) {
+    // a partial snapshot must not reach hpcprof; the next one takes
+    // its index and carries its metrics
+    unlink(path);
+  }
+}
@@ -0,0 +1,80 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+
+//
+// In-flight profile snapshots for long-running processes: every
+// HPCRUN_SNAPSHOT_INTERVAL seconds and/or on HPCRUN_SNAPSHOT_SIGNAL,
+// each thread writes the metric deltas since its previous snapshot
+// at its next sample.
+//
+// That write runs in the sample handler. It goes through a stdio
+// stream that each thread sets up at init, with a preallocated buffer
+// that is flushed to the snapshot file with write(2), so the handler
+// never opens or closes a stream or calls malloc.
+//
+
+// read HPCRUN_SNAPSHOT_INTERVAL and HPCRUN_SNAPSHOT_SIGNAL
+extern void hpcrun_snapshot_init(void);
+extern bool hpcrun_snapshot_enabled(void);
+
+// set up and release the calling thread's snapshot stream; not in a
+// signal handler
+extern void hpcrun_snapshot_thread_init(void);
+extern void hpcrun_snapshot_thread_fini(void);
+
+// requests so far; a thread that has seen fewer owes a snapshot
+extern unsigned int hpcrun_snapshot_generation(void);
+
+// called from the sample path: write the calling thread's snapshot if
+// one was requested since its last
+extern void hpcrun_snapshot_poll(void);
+
+#endif // SNAPSHOT_H
@@ -51,6 +51,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 //************************ libmonitor Include Files *************************
@@ -70,6 +71,8 @@
 #include <messages/messages.h>
 #include <trampoline/common/trampoline.h>
 #include <memory/mmap.h>
+#include <cct/cct_prune.h>
+#include "snapshot.h"
 
 //***************************************************************************
 
@@ -243,6 +246,7 @@ core_profile_trace_data_init(core_profile_trace_data_t * cptd, int id, cct_ctxt_
   // ----------------------------------------
   cptd->hpcrun_file  = NULL;
   cptd->trace_buffer = NULL;
+  cptd->snapshot_index = 0;
 
   // ----------------------------------------
   // perf event support
@@ -281,11 +285,15 @@ hpcrun_thread_data_init(int id, cct_ctxt_t* thr_ctxt, int is_child, size_t n_sou
   td->memstore = memstore;
   hpcrun_make_memstore(&td->memstore, is_child);
   td->mem_low = 0;
+  td->cct_bytes = 0;
+  td->cct_prune_limit = hpcrun_cct_budget() ? hpcrun_cct_budget() : SIZE_MAX;
+  td->snapshot_generation = hpcrun_snapshot_generation();
 
   // ----------------------------------------
   // normalized thread id (monitor-generated)
   // ----------------------------------------
   core_profile_trace_data_init(&(td->core_profile_trace_data), id, thr_ctxt);
+  hpcrun_snapshot_thread_init();
 
   td->idle = 0; // begin at work
 
@@ -145,6 +145,17 @@ typedef struct thread_data_t {
   hpcrun_meminfo_t memstore;
   int              mem_low;
 
+  // cct memory (nodes, metric sets, cct2metrics entries) counted
+  // against HPCRUN_CCT_BUDGET, and the usage that triggers a prune
+  size_t           cct_bytes;
+  size_t           cct_prune_limit;
+
+  // last snapshot request this thread has served, and the stream
+  // and file its snapshots are written through (see snapshot.h)
+  unsigned int     snapshot_generation;
+  FILE*            snapshot_stream;
+  int              snapshot_fd;
+
   // ----------------------------------------
   // sample sources
   // ----------------------------------------
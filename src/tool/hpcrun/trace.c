@@ -63,6 +63,7 @@
 #include "disabled.h"
 #include "env.h"
 #include "files.h"
+#include "hpcrun_clock.h"
 #include "monitor.h"
 #include "rank.h"
 #include "string.h"
@@ -90,7 +91,7 @@
 //*********************************************************************
 
 static void hpcrun_trace_file_validate(int valid, char *op);
-static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t microtime);
+static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t time);
 
 
 //*********************************************************************
@@ -99,6 +100,9 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
 
 static int tracing = 0;
 
+// time stamps in nanoseconds (HPCRUN_TRACE_NS) instead of microseconds
+static bool trace_ns = false;
+
 //*********************************************************************
 // interface operations
 //*********************************************************************
@@ -117,6 +121,15 @@ hpcrun_trace_init()
       tracing = 1;
       TMSG(TRACE, "Tracing is ON");
   }
+  trace_ns = (getenv(HPCRUN_TRACE_NS) != NULL);
+}
+
+
+// trace time stamp units per second
+uint64_t
+hpcrun_trace_time_units()
+{
+  return trace_ns ? 1000000000 : 1000000;
 }
 
 
@@ -152,6 +165,7 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd)
 #else
     flags.fields.isDataCentric = false;
 #endif
+    flags.fields.isNanosecond = trace_ns;
 
     ret = hpctrace_fmt_hdr_outbuf(flags, &cptd->trace_outbuf);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "write header to");
@@ -160,11 +174,13 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd)
 }
 
 
+// 'microtime' is in microseconds whatever the trace time unit
 void
 hpcrun_trace_append_with_time(core_profile_trace_data_t *st, unsigned int call_path_id, uint metric_id, uint64_t microtime)
 {
 	if (tracing && hpcrun_sample_prob_active()) {
-        hpcrun_trace_append_with_time_real(st, call_path_id, metric_id, microtime);
+        uint64_t time = trace_ns ? microtime * 1000 : microtime;
+        hpcrun_trace_append_with_time_real(st, call_path_id, metric_id, time);
 	}
 }
 
@@ -173,11 +189,10 @@ void
 hpcrun_trace_append(core_profile_trace_data_t *cptd, cct_node_t* node, uint metric_id)
 {
   if (tracing && hpcrun_sample_prob_active()) {
-    struct timeval tv;
-    int ret = gettimeofday(&tv, NULL);
-    assert(ret == 0 && "in trace_append: gettimeofday failed!");
-    uint64_t microtime = ((uint64_t)tv.tv_usec
-			  + (((uint64_t)tv.tv_sec) * 1000000));
+    uint64_t time = hpcrun_clock_ns();
+    if (! trace_ns) {
+      time /= 1000;
+    }
 
     // mark the leaf of a call path recorded in a trace record for retention
     // so that the call path associated with the trace record can be recovered.
@@ -185,7 +200,7 @@ hpcrun_trace_append(core_profile_trace_data_t *cptd, cct_node_t* node, uint metr
 
     int32_t call_path_id = hpcrun_cct_persistent_id(node);
 
-    hpcrun_trace_append_with_time_real(cptd, call_path_id, metric_id, microtime);
+    hpcrun_trace_append_with_time_real(cptd, call_path_id, metric_id, time);
   }
 }
 
@@ -215,19 +230,19 @@ hpcrun_trace_close(core_profile_trace_data_t * cptd)
 // private operations
 //*********************************************************************
 
-static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t microtime)
+static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t time)
 {
     if (cptd->trace_min_time_us == 0) {
-        cptd->trace_min_time_us = microtime;
+        cptd->trace_min_time_us = time;
     }
     
     // TODO: should we need this check???
-    if(cptd->trace_max_time_us < microtime) {
-        cptd->trace_max_time_us = microtime;
+    if(cptd->trace_max_time_us < time) {
+        cptd->trace_max_time_us = time;
     }
     
     hpctrace_fmt_datum_t trace_datum;
-    trace_datum.time = microtime;
+    trace_datum.time = time;
     trace_datum.cpId = (uint32_t)call_path_id;
     //TODO: was not in GPU version
     trace_datum.metricId = (uint32_t)metric_id;
@@ -238,6 +253,7 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
 #else
     flags.fields.isDataCentric = false;
 #endif
+    flags.fields.isNanosecond = trace_ns;
     
     int ret = hpctrace_fmt_datum_outbuf(&trace_datum, flags, &cptd->trace_outbuf);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "append");
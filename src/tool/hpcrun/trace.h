@@ -59,6 +59,7 @@ void hpcrun_trace_append_with_time(core_profile_trace_data_t *st, unsigned int c
 void hpcrun_trace_close(core_profile_trace_data_t * cptd);
 
 int hpcrun_trace_isactive();
+uint64_t hpcrun_trace_time_units();
 #endif // hpcrun_trace_h
 
 
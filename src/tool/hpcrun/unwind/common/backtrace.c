@@ -64,11 +64,13 @@
 //***************************************************************************
 
 #include <unwind/common/unw-throw.h>
+#include <unwind/common/unwind.h>
 #include <hpcrun/hpcrun_stats.h>
 
 #include <monitor.h>
 
 #include <trampoline/common/trampoline.h>
+#include <fnbounds/fnbounds_interface.h>
 #include <dbg_backtrace.h>
 
 //***************************************************************************
@@ -389,6 +391,130 @@ hpcrun_generate_backtrace(backtrace_info_t* bt,
   return true;
 }
 
+//
+// check one address of a recorded call chain against fnbounds. the
+// pc must lie in a known function of a known load module. a return
+// address must follow a call in its function: it is looked up by the
+// byte before it, since a call can be the last instruction of a
+// function that does not return, and may be the function's end but
+// not its start. a frame pointer chain that goes through code built
+// without frame pointers yields stack words that fail this check.
+//
+static bool
+call_chain_ip_check(void* ip, bool is_pc, void** func_start,
+		    load_module_t** lm)
+{
+  void* lookup = is_pc ? ip : (void*) ((char*) ip - 1);
+  void* func_end = NULL;
+
+  if (! fnbounds_enclosing_addr(lookup, func_start, &func_end, lm)
+      || *lm == NULL) {
+    return false;
+  }
+  if (is_pc) {
+    return (*func_start <= ip && ip < func_end);
+  }
+  return (*func_start < ip && ip <= func_end);
+}
+
+//
+// Build a backtrace from a call chain that was already collected,
+// e.g., the user-mode frame pointer chain the kernel records with a
+// perf sample. ips[0] is the interrupted pc, the rest are return
+// addresses, innermost first.
+//
+// The chain is accepted only if the leaf had its frame set up at the
+// interrupted pc, every address checks out against fnbounds (see
+// call_chain_ip_check) and it ends in a monitor fence (the bottom
+// frame of main or of a thread). A frame pointer walk that starts in
+// a prologue or an epilogue, or in a leaf without a frame pointer,
+// reads the caller's frame as the leaf's and drops the caller, with
+// every address still valid. A chain that stops short (missing frame
+// pointers, truncated by the kernel), holds a bogus return address or
+// starts in such a leaf returns false and leaves the precise pc in
+// place, so that the caller can fall back to hpcrun_generate_backtrace
+// on the same sample.
+//
+bool
+hpcrun_generate_backtrace_from_ips(backtrace_info_t* bt,
+				   const uint64_t* ips, int n_ips)
+{
+  TMSG(BT, "Generate backtrace from %d call chain ips", n_ips);
+  bt->has_tramp = false;
+  bt->n_trolls = 0;
+  bt->fence = FENCE_BAD;
+  bt->bottom_frame_elided = false;
+  bt->partial_unwind = true;
+
+  if (n_ips <= 0) return false;
+
+  if (! hpcrun_unw_leaf_has_fp_frame((void*) (uintptr_t) ips[0])) {
+    TMSG(BT, "call chain leaf %p has no frame pointer frame", (void*) (uintptr_t) ips[0]);
+    return false;
+  }
+
+  thread_data_t* td = hpcrun_get_thread_data();
+  td->btbuf_cur   = td->btbuf_beg; // innermost
+  td->btbuf_sav   = td->btbuf_end;
+
+  for (int i = 0; i < n_ips; i++) {
+    void* ip = (void*) (uintptr_t) ips[i];
+
+    if (ip == NULL) break;
+
+    void* func_start = NULL;
+    load_module_t* lm = NULL;
+    if (! call_chain_ip_check(ip, i == 0, &func_start, &lm)) {
+      TMSG(BT, "call chain ip %d (%p) fails the function bounds check", i, ip);
+      return false;
+    }
+
+    hpcrun_ensure_btbuf_avail();
+
+    frame_t* frm = td->btbuf_cur;
+    memset(&frm->cursor, 0, sizeof(frm->cursor));
+    frm->cursor.pc_unnorm = ip;
+    frm->cursor.pc_norm = hpcrun_normalize_ip(ip, lm);
+    frm->cursor.the_function = hpcrun_normalize_ip(func_start, lm);
+    frm->cursor.fence =
+      (monitor_unwind_process_bottom_frame(ip) ? FENCE_MAIN :
+       monitor_unwind_thread_bottom_frame(ip) ? FENCE_THREAD : FENCE_NONE);
+
+    frm->as_info = lush_assoc_info_NULL;
+    frm->ip_norm = frm->cursor.pc_norm;
+    frm->the_function = frm->cursor.the_function;
+    frm->ra_loc = NULL;
+    frm->lip = NULL;
+    td->btbuf_cur++;
+
+    if (frm->cursor.fence != FENCE_NONE) {
+      bt->fence = frm->cursor.fence;
+      break;
+    }
+  }
+
+  TMSG(FENCE, "call chain backtrace detects fence = %s", fence_enum_name(bt->fence));
+
+  if (bt->fence == FENCE_BAD) return false;
+
+  frame_t* bt_beg  = td->btbuf_beg;      // innermost, inclusive
+  frame_t* bt_last = td->btbuf_cur - 1; // outermost, inclusive
+
+  // same leaf correction as the unwinder
+  if (td->precise_pc) {
+    ip_normalized_t norm_ip = hpcrun_normalize_ip(td->precise_pc, NULL);
+    if(norm_ip.lm_id != HPCRUN_FMT_LMId_NULL) {
+      bt_beg->ip_norm = norm_ip;
+    }
+    td->precise_pc = NULL;
+  }
+
+  bt->begin = bt_beg;
+  bt->last  = bt_last;
+  bt->partial_unwind = false;
+  return true;
+}
+
 
 //***************************************************************************
 // private operations 
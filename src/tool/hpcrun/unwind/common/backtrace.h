@@ -117,4 +117,7 @@ bool hpcrun_generate_backtrace(backtrace_info_t* bt,
 bool hpcrun_generate_backtrace_no_trampoline(backtrace_info_t* bt,
 					     ucontext_t* context, int skipInner);
 
+bool hpcrun_generate_backtrace_from_ips(backtrace_info_t* bt,
+					const uint64_t* ips, int n_ips);
+
 #endif // hpcrun_backtrace_h
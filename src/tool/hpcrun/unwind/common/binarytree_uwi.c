@@ -11,32 +11,18 @@
 // local include files
 //******************************************************************************
 
-#include <lib/prof-lean/mcs-lock.h>
 #include <lib/prof-lean/binarytree.h>
 #include "binarytree_uwi.h"
 
-#define NUM_NODES 10
+// allocator of the nodes; each node is released on its own
+static mem_alloc uwi_alloc;
+static mem_free uwi_free;
 
-static struct {
-  bitree_uwi_t *tree;		// global free unwind interval tree
-  mcs_lock_t lock;		// lock for tree
-  mem_alloc alloc;
-} GF[NUM_UNWINDERS];
-
-static __thread  bitree_uwi_t *_lf_uwi_tree[NUM_UNWINDERS]; // thread local free unwind interval tree
-
-/*
- * initialize the MCS lock for the hidden global free unwind interval tree.
- */
 void
-bitree_uwi_init(mem_alloc m_alloc)
+bitree_uwi_init(mem_alloc m_alloc, mem_free m_free)
 {
-  int i;
-  for (i = 0; i < NUM_UNWINDERS; ++i) {
-    mcs_init(&GF[i].lock);
-    GF[i].tree = NULL;
-    GF[i].alloc = m_alloc;
-  }
+  uwi_alloc = m_alloc;
+  uwi_free = m_free;
 }
 
 // constructors
@@ -44,44 +30,22 @@ bitree_uwi_t*
 bitree_uwi_malloc(unwinder_t uw,
 		  size_t recipe_size)
 {
-  if (!_lf_uwi_tree[uw]) {
-    mcs_node_t me;
-    if (mcs_trylock(&GF[uw].lock, &me)) {
-      // the global free list is locked, so use it
-      _lf_uwi_tree[uw] = GF[uw].tree;
-      if (_lf_uwi_tree[uw])
-	GF[uw].tree = bitree_uwi_leftsubtree(_lf_uwi_tree[uw]);
-      mcs_unlock(&GF[uw].lock, &me);
-      if (_lf_uwi_tree[uw])
-	bitree_uwi_set_leftsubtree(_lf_uwi_tree[uw], NULL);
-    }
-    if (!_lf_uwi_tree[uw])
-      _lf_uwi_tree[uw] =
-	(bitree_uwi_t *)binarytree_listalloc(sizeof(uwi_t) + recipe_size, 
-					     NUM_NODES, GF[uw].alloc);
-  }
-
-  bitree_uwi_t *top = _lf_uwi_tree[uw];
-  if (top) {
-    _lf_uwi_tree[uw] = bitree_uwi_rightsubtree(top);
-    bitree_uwi_set_rightsubtree(top, NULL);
-  }
-  return top;
+  return (bitree_uwi_t *)binarytree_new(sizeof(uwi_t) + recipe_size,
+					uwi_alloc);
 }
 
 /*
- * link only non null tree to GF.tree
+ * free every node of a non null tree
  */
 void bitree_uwi_free(unwinder_t uw, bitree_uwi_t *tree)
 {
   if(!tree) return;
   tree = bitree_uwi_flatten(tree);
-  // link to the global free unwind interval tree:
-  mcs_node_t me;
-  mcs_lock(&GF[uw].lock, &me);
-  bitree_uwi_set_leftsubtree(tree, GF[uw].tree);
-  GF[uw].tree = tree;
-  mcs_unlock(&GF[uw].lock, &me);
+  while (tree) {
+    bitree_uwi_t *next = bitree_uwi_rightsubtree(tree);
+    uwi_free(tree);
+    tree = next;
+  }
 }
 
 // return the value at the root
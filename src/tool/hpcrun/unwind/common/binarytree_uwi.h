@@ -71,10 +71,10 @@ typedef enum unwinder_e {
 } unwinder_t;
 
 /*
- * initialize the MCS lock for the hidden global free unwind interval tree.
+ * set the allocator of the tree nodes.
  */
 void
-bitree_uwi_init(mem_alloc m_alloc);
+bitree_uwi_init(mem_alloc m_alloc, mem_free m_free);
 
 /*
  * Returns a bitree_uwi_t node whose left and right subtree nodes are NULL.
@@ -87,7 +87,7 @@ bitree_uwi_t*
 bitree_uwi_malloc(unwinder_t uw, size_t recipe_size);
 
 /*
- * If tree != NULL return tree to global free tree,
+ * If tree != NULL free all of its nodes,
  * otherwise do nothing.
  */
 void bitree_uwi_free(unwinder_t uw, bitree_uwi_t *tree);
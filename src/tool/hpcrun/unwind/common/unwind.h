@@ -60,6 +60,7 @@
 // system include files
 //***************************************************************************
 
+#include <stdbool.h>
 #include <ucontext.h>
 
 
@@ -134,6 +135,20 @@ step_state
 hpcrun_unw_step(hpcrun_unw_cursor_t* c);
 
 
+// ----------------------------------------------------------
+// hpcrun_unw_leaf_has_fp_frame: 
+//   true if, at pc in the innermost frame, the frame pointer
+//   points at the caller's saved frame pointer with the return
+//   address right above it, so that a frame pointer walk from
+//   there (e.g., the kernel's user call chain) finds the caller.
+//   false in a prologue or an epilogue, in code without a
+//   frame pointer, and where it cannot be told.
+// ----------------------------------------------------------
+
+bool
+hpcrun_unw_leaf_has_fp_frame(void* pc);
+
+
 //***************************************************************************
 //
 // services provided by HPCToolkit's unwinder
@@ -85,7 +85,6 @@
 #include "unwind-interval.h"
 #include <fnbounds/fnbounds_interface.h>
 #include <lib/prof-lean/cskiplist.h>
-#include <lib/prof-lean/mcs-lock.h>
 #include <lib/prof-lean/binarytree.h>
 #include "binarytree_uwi.h"
 #include "segv_handler.h"
@@ -108,8 +107,6 @@
 
 #define SKIPLIST_HEIGHT 8
 
-#define NUM_NODES 10
-
 //******************************************************************************
 // type
 //******************************************************************************
@@ -119,6 +116,7 @@ typedef struct ilmstat_btuwi_pair_s {
   load_module_t *lm;
   _Atomic(tree_stat_t) stat;
   bitree_uwi_t *btuwi;
+  loadmap_retired_t retired; // while waiting for readers to let go
 } ilmstat_btuwi_pair_t;
 
 //******************************************************************************
@@ -149,9 +147,6 @@ ilmstat_btuwi_pair_inrange(void *itp, void *address)
   return interval_t_inrange(&p->interval, address);
 }
 
-static ilmstat_btuwi_pair_t *GF_ilmstat_btuwi = NULL; // global free list of ilmstat_btuwi_pair_t*
-static mcs_lock_t GFL_lock;  // lock for GF_ilmstat_btuwi
-static __thread  ilmstat_btuwi_pair_t *_lf_ilmstat_btuwi = NULL;  // thread local free list of ilmstat_btuwi_pair_t*
 
 
 //******************************************************************************
@@ -181,70 +176,17 @@ ilmstat_btuwi_pair_build(uintptr_t start, uintptr_t end, load_module_t *lm,
   return ilmstat__btuwi_pair_init(node, treestat, lm, start, end);
 }
 
-static inline void
-push_free_pair(ilmstat_btuwi_pair_t **list, ilmstat_btuwi_pair_t *pair)
-{
-  pair->btuwi = (bitree_uwi_t *)*list;
-  *list = pair;
-}
-
-static inline ilmstat_btuwi_pair_t *
-pop_free_pair(ilmstat_btuwi_pair_t **list)
-{
-  ilmstat_btuwi_pair_t *head = *list;
-  *list = (ilmstat_btuwi_pair_t *)head->btuwi;
-  return head;
-}
-
+// pairs that can leave the map come from freeable memory; they are
+// released one by one, possibly by another thread
 static ilmstat_btuwi_pair_t*
 ilmstat_btuwi_pair_malloc(
 	uintptr_t start,
 	uintptr_t end,
 	load_module_t *lm,
-	tree_stat_t treestat,
-	mem_alloc m_alloc)
-{
-  if (!_lf_ilmstat_btuwi) {
-    /*
-     * Look for nodes in the global free list.
-     * If the global free list is not empty,
-     *   transfer a bunch of nodes to the local free list,
-     * otherwise add a bunch of nodes to the local free list.
-     */
-    mcs_node_t me;
-    bool acquired = mcs_trylock(&GFL_lock, &me);
-    if (acquired) {
-      if (GF_ilmstat_btuwi) {
-	// transfer a bunch of nodes the global free list to the local free list
-	int n = 0;
-	while (GF_ilmstat_btuwi && n < NUM_NODES) {
-	  ilmstat_btuwi_pair_t *head = pop_free_pair(&GF_ilmstat_btuwi);
-	  push_free_pair(&_lf_ilmstat_btuwi, head);
-	  n++;
-	}
-      }
-      mcs_unlock(&GFL_lock, &me);
-    }
-    if (!_lf_ilmstat_btuwi) {
-      /* add a bunch of nodes to _lf_ilmstat_btuwi */
-      for (int i = 0; i < NUM_NODES; i++) {
-	ilmstat_btuwi_pair_t *node = m_alloc(sizeof(*node));
-	push_free_pair(&_lf_ilmstat_btuwi, node);
-      }
-    }
-  }
-
-#if UW_RECIPE_MAP_DEBUG
-  assert (_lf_ilmstat_btuwi);
-#endif
-
-/*
- * remove the head node of the local free list
- * set its fields using the appropriate parameters
- * return the head node.
- */
-  ilmstat_btuwi_pair_t *ans = pop_free_pair(&_lf_ilmstat_btuwi);
-  return ilmstat__btuwi_pair_init(ans, treestat, lm, start, end);
+	tree_stat_t treestat)
+{
+  return ilmstat_btuwi_pair_build(start, end, lm, treestat,
+				  hpcrun_malloc_freeable);
 }
 
 //******************************************************************************
@@ -256,12 +198,7 @@ ilmstat_btuwi_pair_free(ilmstat_btuwi_pair_t* pair, unwinder_t uw)
 {
   if (!pair) return;
   bitree_uwi_free(uw, pair->btuwi);
-
-  // add pair to the front of the  global free list of ilmstat_btuwi_pair_t*:
-  mcs_node_t me;
-  mcs_lock(&GFL_lock, &me);
-  push_free_pair(&GF_ilmstat_btuwi, pair);
-  mcs_unlock(&GFL_lock, &me);
+  hpcrun_free(pair);
 }
 
 //---------------------------------------------------------------------
@@ -446,7 +383,7 @@ uw_recipe_map_poison(uintptr_t start, uintptr_t end, unwinder_t uw)
   uw_recipe_map_report("uw_recipe_map_poison", (void *) start, (void *) end);
 
   ilmstat_btuwi_pair_t* itpair =
-	  ilmstat_btuwi_pair_build(start, end, NULL, NEVER, my_alloc);
+	  ilmstat_btuwi_pair_malloc(start, end, NULL, NEVER);
   csklnode_t *node = cskl_insert(addr2recipe_map[uw], itpair, my_alloc);
   if (itpair != (ilmstat_btuwi_pair_t*)node->val)
     ilmstat_btuwi_pair_free(itpair, uw);
@@ -463,6 +400,29 @@ uw_recipe_map_inrange_find(uintptr_t addr, unwinder_t uw)
   return (ilmstat_btuwi_pair_t*)cskl_inrange_find(addr2recipe_map[uw], (void*)addr);
 }
 
+static void
+ilmstat_btuwi_pair_free_0(void *pair)
+{
+  ilmstat_btuwi_pair_free((ilmstat_btuwi_pair_t*) pair, 0);
+}
+
+
+static void
+ilmstat_btuwi_pair_free_1(void *pair)
+{
+  ilmstat_btuwi_pair_free((ilmstat_btuwi_pair_t*) pair, 1);
+}
+
+static void (*ilmstat_btuwi_pair_free_fn[])(void *pair) =
+{ilmstat_btuwi_pair_free_0, ilmstat_btuwi_pair_free_1};
+
+
+// A node removed from the map is unreachable once the deletion drops
+// the map's write lock, but a sample may still use the interval it
+// looked up before: the interval is retired with the load map and
+// freed once no read section that could have seen it remains (see
+// hpcrun_loadmap_retire()). This lets dlopen and dlclose change the
+// map while samples unwind.
 static void
 cskl_ilmstat_btuwi_free_uw(void *anode, unwinder_t uw)
 {
@@ -472,7 +432,10 @@ cskl_ilmstat_btuwi_free_uw(void *anode, unwinder_t uw)
 
   csklnode_t *node = (csklnode_t*) anode;
   ilmstat_btuwi_pair_t *ilmstat_btuwi = (ilmstat_btuwi_pair_t*)node->val;
-  ilmstat_btuwi_pair_free(ilmstat_btuwi, uw);
+  if (ilmstat_btuwi) {
+    hpcrun_loadmap_retire(&ilmstat_btuwi->retired,
+			  ilmstat_btuwi_pair_free_fn[uw], ilmstat_btuwi);
+  }
   node->val = NULL;
   cskl_free(node);
 }
@@ -608,10 +571,9 @@ uw_recipe_map_init(void)
 
   cskl_init();
 #if UW_RECIPE_MAP_DEBUG
-  fprintf(stderr, "%s: mcs_init(&GFL_lock), call bitree_uwi_init() \n", __func__);
+  fprintf(stderr, "%s: call bitree_uwi_init() \n", __func__);
 #endif
-  mcs_init(&GFL_lock);
-  bitree_uwi_init(my_alloc);
+  bitree_uwi_init(hpcrun_malloc_freeable, hpcrun_free);
 
   TMSG(UW_RECIPE_MAP, "init address-to-recipe map");
   ilmstat_btuwi_pair_t* lsentinel =
@@ -674,7 +636,7 @@ uw_recipe_map_lookup(void *addr, unwinder_t uw, unwindr_info_t *unwr_info)
 	// (bitree_uwi_t*)NULL and try to insert into map:
 	ilm_btui =
 		ilmstat_btuwi_pair_malloc((uintptr_t)fcn_start, (uintptr_t)fcn_end, lm,
-			DEFERRED, my_alloc);
+			DEFERRED);
 
 	
 	csklnode_t *node = cskl_insert(addr2recipe_map[uw], ilm_btui, my_alloc);
@@ -61,6 +61,7 @@
 //        hpcrun_unw_init
 //        hpcrun_unw_init_cursor
 //        hpcrun_unw_get_ra_loc
+//        hpcrun_unw_leaf_has_fp_frame
 //        hpcrun_unw_get_ip_reg
 //        hpcrun_unw_step
 //        hpcrun_unw_get_ip_unnorm_reg
@@ -156,6 +157,16 @@ hpcrun_unw_get_ra_loc(hpcrun_unw_cursor_t* c)
   return NULL;
 }
 
+// ----------------------------------------------------------
+// hpcrun_unw_leaf_has_fp_frame (no frame information here)
+// ----------------------------------------------------------
+
+bool
+hpcrun_unw_leaf_has_fp_frame(void* pc)
+{
+  return false;
+}
+
 // ----------------------------------------------------------
 // hpcrun_unw_init_cursor
 // ----------------------------------------------------------
@@ -224,6 +224,17 @@ hpcrun_unw_get_ra_loc(hpcrun_unw_cursor_t* cursor)
 }
 
 
+//
+// unimplemented for now: a leaf may keep its return address in the
+// link register, which a back chain walk does not see
+//
+bool
+hpcrun_unw_leaf_has_fp_frame(void* pc)
+{
+  return false;
+}
+
+
 void 
 hpcrun_unw_init_cursor(hpcrun_unw_cursor_t* cursor, void* context)
 {
@@ -276,6 +276,19 @@ hpcrun_unw_get_ra_loc(hpcrun_unw_cursor_t* cursor)
   return cursor->ra_loc;
 }
 
+bool
+hpcrun_unw_leaf_has_fp_frame(void* pc)
+{
+  unwindr_info_t unwr_info;
+  if (!uw_recipe_map_lookup(pc, NATIVE_UNWINDER, &unwr_info)
+      || unwr_info.btuwi == NULL) {
+    return false;
+  }
+  x86recipe_t *xr = UWI_RECIPE(unwr_info.btuwi);
+  return (xr->ra_status == RA_STD_FRAME || xr->ra_status == RA_BP_FRAME)
+    && xr->reg.bp_ra_pos == sizeof(void*) && xr->reg.bp_bp_pos == 0;
+}
+
 btuwi_status_t
 build_intervals(char *ins, unsigned int len, unwinder_t uw)
 {
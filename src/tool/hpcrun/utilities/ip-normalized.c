@@ -70,16 +70,20 @@ ip_normalized_t
 hpcrun_normalize_ip(void* unnormalized_ip, load_module_t* lm)
 {
   TMSG(NORM_IP, "normalizing %p, w load_module %s", unnormalized_ip, NULL_OR_NAME(lm));
+  int epoch = hpcrun_loadmap_read_begin();
   if (!lm) {
     lm = hpcrun_loadmap_findByAddr(unnormalized_ip, unnormalized_ip);
   }
   
-  if (lm && lm->dso_info) {
+  dso_info_t* dso = (lm) ? hpcrun_loadModule_dso(lm) : NULL;
+  if (dso) {
     ip_normalized_t ip_norm = (ip_normalized_t) {
       .lm_id = lm->id,
-      .lm_ip = (uintptr_t)unnormalized_ip - lm->dso_info->start_to_ref_dist };
+      .lm_ip = (uintptr_t)unnormalized_ip - dso->start_to_ref_dist };
+    hpcrun_loadmap_read_end(epoch);
     return ip_norm;
   }
+  hpcrun_loadmap_read_end(epoch);
 
   TMSG(NORM_IP, "%p not normalizable", unnormalized_ip);
   if (ENABLED(NORM_IP_DBG)){
@@ -50,7 +50,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <setjmp.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 //*****************************************************************************
 // local includes
@@ -67,6 +70,11 @@
 #include "write_data.h"
 #include "loadmap.h"
 #include "sample_prob.h"
+#include "snapshot.h"
+#include "hpcrun_stats.h"
+#include "hpcrun_clock.h"
+#include "hpcrun_overhead.h"
+#include "trace.h"
 
 #include <messages/messages.h>
 
@@ -132,30 +140,9 @@ static const uint64_t default_measurement_granularity = 1;
 //
 //***************************************************************************
 
-static FILE *
-lazy_open_data_file(core_profile_trace_data_t * cptd)
+static void
+write_file_hdr(FILE* fs, core_profile_trace_data_t * cptd, int rank, bool is_snapshot)
 {
-
-  FILE* fs = cptd->hpcrun_file;
-  if (fs) {
-    return fs;
-  }
-
-  int rank = hpcrun_get_rank();
-  if (rank < 0) {
-    rank = 0;
-  }
-  int fd = hpcrun_open_profile_file(rank, cptd->id);
-  fs = fdopen(fd, "w");
-  if (fs == NULL) {
-    EEMSG("HPCToolkit: %s: unable to open profile file", __func__);
-    return NULL;
-  }
-  cptd->hpcrun_file = fs;
-
-  if (! hpcrun_sample_prob_active())
-    return fs;
-
   const uint bufSZ = 32; // sufficient to hold a 64-bit integer in base 10
 
   const char* jobIdStr = OSUtil_jobid();
@@ -176,11 +163,28 @@ lazy_open_data_file(core_profile_trace_data_t * cptd)
   char pidStr[bufSZ];
   snprintf(pidStr, bufSZ, "%u", OSUtil_pid());
 
+  // a snapshot is not paired with the thread's trace; hpcprof takes
+  // empty trace times as "no trace"
   char traceMinTimeStr[bufSZ];
-  snprintf(traceMinTimeStr, bufSZ, "%"PRIu64, cptd->trace_min_time_us);
-
   char traceMaxTimeStr[bufSZ];
-  snprintf(traceMaxTimeStr, bufSZ, "%"PRIu64, cptd->trace_max_time_us);
+  char traceTimeUnitStr[bufSZ];
+  traceMinTimeStr[0] = traceMaxTimeStr[0] = '\0';
+  if (! is_snapshot) {
+    snprintf(traceMinTimeStr, bufSZ, "%"PRIu64, cptd->trace_min_time_us);
+    snprintf(traceMaxTimeStr, bufSZ, "%"PRIu64, cptd->trace_max_time_us);
+  }
+  snprintf(traceTimeUnitStr, bufSZ, "%"PRIu64, hpcrun_trace_time_units());
+
+  char snapshotStr[bufSZ];
+  char snapshotTimeStr[bufSZ];
+  snapshotStr[0] = snapshotTimeStr[0] = '\0';
+  if (hpcrun_snapshot_enabled()) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    snprintf(snapshotStr, bufSZ, "%d", cptd->snapshot_index);
+    snprintf(snapshotTimeStr, bufSZ, "%"PRIu64,
+             (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec);
+  }
 
   //
   // ==== file hdr =====
@@ -198,13 +202,45 @@ lazy_open_data_file(core_profile_trace_data_t * cptd)
                         HPCRUN_FMT_NV_pid, pidStr,
 			HPCRUN_FMT_NV_traceMinTime, traceMinTimeStr,
 			HPCRUN_FMT_NV_traceMaxTime, traceMaxTimeStr,
+			HPCRUN_FMT_NV_traceTimeUnit, traceTimeUnitStr,
+			HPCRUN_FMT_NV_traceClock, hpcrun_clock_describe(),
+                        HPCRUN_FMT_NV_snapshot, snapshotStr,
+                        HPCRUN_FMT_NV_snapshotTime, snapshotTimeStr,
                         NULL);
+}
+
+
+static FILE *
+lazy_open_data_file(core_profile_trace_data_t * cptd)
+{
+
+  FILE* fs = cptd->hpcrun_file;
+  if (fs) {
+    return fs;
+  }
+
+  int rank = hpcrun_get_rank();
+  if (rank < 0) {
+    rank = 0;
+  }
+  int fd = hpcrun_open_profile_file(rank, cptd->id);
+  fs = fdopen(fd, "w");
+  if (fs == NULL) {
+    EEMSG("HPCToolkit: %s: unable to open profile file", __func__);
+    return NULL;
+  }
+  cptd->hpcrun_file = fs;
+
+  if (! hpcrun_sample_prob_active())
+    return fs;
+
+  write_file_hdr(fs, cptd, rank, false);
   return fs;
 }
 
 
 static int
-write_epochs(FILE* fs, core_profile_trace_data_t * cptd, epoch_t* epoch)
+write_epochs(FILE* fs, core_profile_trace_data_t * cptd, epoch_t* epoch, bool delta)
 {
   uint32_t num_epochs = 0;
 
@@ -251,9 +287,20 @@ write_epochs(FILE* fs, core_profile_trace_data_t * cptd, epoch_t* epoch)
     TMSG(LUSH,"epoch lush flag set to %s", epoch_flags.fields.isLogicalUnwind ? "true" : "false");
     
     TMSG(DATA_WRITE,"epoch flags = %"PRIx64"", epoch_flags.bits);
+
+    const uint bufSZ = 32;
+
+    char prunedFoldsStr[bufSZ];
+    snprintf(prunedFoldsStr, bufSZ, "%lu", s->csdata.num_folds);
+
+    char prunedBytesStr[bufSZ];
+    snprintf(prunedBytesStr, bufSZ, "%lu", s->csdata.bytes_reclaimed);
+
     hpcrun_fmt_epochHdr_fwrite(fs, epoch_flags,
 			       default_measurement_granularity,
 			       "TODO:epoch-name","TODO:epoch-value",
+			       HPCRUN_FMT_NV_cctPrunedFolds, prunedFoldsStr,
+			       HPCRUN_FMT_NV_cctPrunedBytes, prunedBytesStr,
 			       NULL);
 
     //
@@ -295,7 +342,7 @@ write_epochs(FILE* fs, core_profile_trace_data_t * cptd, epoch_t* epoch)
     //
 
     cct_bundle_t* cct      = &(s->csdata);
-    int ret = hpcrun_cct_bundle_fwrite(fs, epoch_flags, cct, cptd->cct2metrics_map);
+    int ret = hpcrun_cct_bundle_fwrite(fs, epoch_flags, cct, cptd->cct2metrics_map, delta);
     if(ret != HPCRUN_OK) {
       TMSG(DATA_WRITE, "Error writing tree %#lx", cct);
       TMSG(DATA_WRITE, "Number of tree nodes lost: %ld", cct->num_nodes);
@@ -321,7 +368,7 @@ hpcrun_flush_epochs(core_profile_trace_data_t * cptd)
   if (fs == NULL)
     return;
 
-  write_epochs(fs, cptd, cptd->epoch);
+  write_epochs(fs, cptd, cptd->epoch, false);
   hpcrun_epoch_reset();
 }
 
@@ -329,19 +376,59 @@ int
 hpcrun_write_profile_data(core_profile_trace_data_t * cptd)
 {
   TMSG(DATA_WRITE,"Writing hpcrun profile data");
+  uint64_t ovh_start = hpcrun_overhead_begin();
   FILE* fs = lazy_open_data_file(cptd);
   if (fs == NULL)
     return HPCRUN_ERR;
 
-  write_epochs(fs, cptd, cptd->epoch);
+  // after snapshots, the profile holds what the last one left out
+  write_epochs(fs, cptd, cptd->epoch, cptd->snapshot_index > 0);
 
   TMSG(DATA_WRITE,"closing file");
   hpcio_fclose(fs);
   TMSG(DATA_WRITE,"Done!");
+  hpcrun_overhead_end(HPCRUN_OVH_WRITE_PROFILE, ovh_start);
 
   return HPCRUN_OK;
 }
 
+//
+// Write the calling thread's metric deltas since its previous snapshot
+// to fs, which the caller has bound to the snapshot's file, and zero
+// its metrics.  Sampling goes on, and the cct with its node ids is
+// kept, so the snapshots and the final profile of a thread add up to
+// the whole run.  On a write error the metrics and the snapshot index
+// are kept for the next snapshot.
+//
+int
+hpcrun_write_snapshot(core_profile_trace_data_t * cptd, FILE* fs)
+{
+  TMSG(SNAPSHOT, "thread %d: writing snapshot %d", cptd->id, cptd->snapshot_index);
+
+  uint64_t ovh_start = hpcrun_overhead_begin();
+  int rank = hpcrun_get_rank();
+  if (rank < 0) {
+    rank = 0;
+  }
+
+  write_file_hdr(fs, cptd, rank, true);
+  write_epochs(fs, cptd, cptd->epoch, true);
+
+  int ret = HPCRUN_OK;
+  if (fflush(fs) != 0 || ferror(fs)) {
+    EMSG("unable to write snapshot %d for thread %d", cptd->snapshot_index, cptd->id);
+    ret = HPCRUN_ERR;
+  }
+  else {
+    hpcrun_cct2metrics_zero(cptd->cct2metrics_map);
+    hpcrun_stats_num_snapshots_inc(1);
+    cptd->snapshot_index++;
+  }
+  hpcrun_overhead_end(HPCRUN_OVH_WRITE_SNAPSHOT, ovh_start);
+
+  return ret;
+}
+
 //
 // DEBUG: fetch and print current loadmap
 //
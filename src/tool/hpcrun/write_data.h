@@ -52,5 +52,6 @@
 
 extern int hpcrun_write_profile_data(core_profile_trace_data_t * cptd);
 extern void hpcrun_flush_epochs(core_profile_trace_data_t * cptd);
+extern int hpcrun_write_snapshot(core_profile_trace_data_t * cptd, FILE* fs);
 
 #endif // WRITE_DATA_H
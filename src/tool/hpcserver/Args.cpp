@@ -120,6 +120,17 @@ Options: General\n\
                            indicates that the port will be auto-negotiated with\n\
                            the client. Specifying 1 indicates that the xml will\n\
                            be transferred on the main data port.\n\
+  -m, --cache-lines    Sets the number of sampled trace lines kept in memory\n\
+                           to answer repeated, panned and zoomed requests\n\
+                           (default is 4096). Specifying 0 disables the cache.\n\
+  -r, --record <file>  Appends every request of the session to <file> so that\n\
+                           it can be replayed later (see UnitTests/Replay_bench.cpp).\n\
+  -s, --page-size <n>  Sets the approximate size in MB of the windows in which\n\
+                           the trace file is mapped (default is 64).\n\
+  -d, --page-stats     Prints page faults, hits, evictions and readaheads of\n\
+                           the trace file when a database is closed.\n\
+  -t, --stat-threads <n> Sets the number of threads that compute statistics\n\
+                           requests (default is one per online processor).\n\
 \n\
 ";
 
@@ -149,6 +160,16 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
      CLP::isOptArg_long },
   {  'x' , "xmlport",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
      CLP::isOptArg_long },
+  {  'm' , "cache-lines",   CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
+  {  'r' , "record",        CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     NULL },
+  {  's' , "page-size",     CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
+  {  'd' , "page-stats",    CLP::ARG_NONE, CLP::DUPOPT_CLOB, NULL,
+     NULL },
+  {  't' , "stat-threads",  CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
   CmdLineParser_OptArgDesc_NULL_MACRO // SGI's compiler requires this version
 };
 
@@ -178,6 +199,10 @@ Args::Ctor()
   compression = true;
   mainPort = DEFAULT_PORT;//21590
   xmlPort = 0;
+  cacheLines = 4096;
+  pageSizeMB = 64;
+  pageStats = false;
+  statThreads = 0;
 }
 
 
@@ -270,6 +295,30 @@ Args::parse(int argc, const char* const argv[])
       if (xmlPort < 1024 && xmlPort > 1)
     	   ARG_ERROR("Ports must be greater than 1024.")
     }
+    if (parser.isOpt("cache-lines")) {
+      const string& arg = parser.getOptArg("cache-lines");
+      cacheLines = (int) CmdLineParser::toLong(arg);
+      if (cacheLines < 0)
+         ARG_ERROR("The number of cached lines cannot be negative.")
+    }
+    if (parser.isOpt("record")) {
+      recordPath = parser.getOptArg("record");
+    }
+    if (parser.isOpt("page-size")) {
+      const string& arg = parser.getOptArg("page-size");
+      pageSizeMB = (int) CmdLineParser::toLong(arg);
+      if (pageSizeMB < 1)
+         ARG_ERROR("The page size must be at least 1 MB.")
+    }
+    if (parser.isOpt("page-stats")) {
+      pageStats = true;
+    }
+    if (parser.isOpt("stat-threads")) {
+      const string& arg = parser.getOptArg("stat-threads");
+      statThreads = (int) CmdLineParser::toLong(arg);
+      if (statThreads < 0)
+         ARG_ERROR("The number of statistics threads cannot be negative.")
+    }
   }
   catch (const CmdLineParser::ParseError& x) {
     ARG_ERROR(x.what());
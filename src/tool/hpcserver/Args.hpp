@@ -113,6 +113,11 @@ public:
   int mainPort;       // default: 21590
   int xmlPort;        // default: 0
   bool compression;   // default: true
+  int cacheLines;     // default: 4096
+  std::string recordPath; // default: empty (do not record)
+  int pageSizeMB;     // default: 64
+  bool pageStats;     // default: false
+  int statThreads;    // default: 0 (one per online processor)
 
 private:
   void
@@ -92,6 +92,7 @@ enum Header {
 	NODB = 0x4E4F4442,
 	EXML = 0x45584D4C,
 	FLTR = 0x464C5452,
+	STAT = 0x53544154,
 	SLAVE_REPLY = 0x534C5250,
 	SLAVE_DONE = 0x534C444E
 };
@@ -93,7 +93,7 @@ namespace TraceviewerServer
 
 	}
 
-	DataCompressionLayer::DataCompressionLayer(z_stream customCompressor, ProgressBar* _progMonitor)
+	DataCompressionLayer::DataCompressionLayer(z_stream* customCompressor, ProgressBar* _progMonitor)
 	{
 		bufferIndex = 0;
 		posInCompBuffer = 0;
@@ -103,7 +103,12 @@ namespace TraceviewerServer
 		outBufferCurrentSize = BUFFER_SIZE;
 
 		progMonitor = _progMonitor;
-		compressor = customCompressor;
+		//A z_stream cannot be copied by assignment: zlib keeps a pointer back to
+		//the stream it was initialized with. Copy the state and release the original.
+		int ret = deflateCopy(&compressor, customCompressor);
+		deflateEnd(customCompressor);
+		if (ret != Z_OK)
+			throw ret;
 	}
 
 	void DataCompressionLayer::writeInt(int toWrite)
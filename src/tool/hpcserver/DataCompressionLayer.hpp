@@ -80,7 +80,7 @@ namespace TraceviewerServer
 	public:
 		DataCompressionLayer();
 		//Advanced constructor:
-		DataCompressionLayer(z_stream customCompressor, ProgressBar* progMonitor);
+		DataCompressionLayer(z_stream* customCompressor, ProgressBar* progMonitor);
 
 		virtual ~DataCompressionLayer();
 		void writeInt(int);
@@ -68,6 +68,8 @@
 #include "DebugUtils.hpp"
 #include "FilteredBaseData.hpp"
 
+#include <lib/prof-lean/hpcrun-fmt.h>
+
 namespace TraceviewerServer {
 FilteredBaseData::FilteredBaseData(string filename, int _headerSize) {
 	baseDataFile = new BaseDataFile(filename, _headerSize);
@@ -126,6 +128,56 @@ int FilteredBaseData::getNumberOfRanks()
 	return rankMapping.size();
 }
 
+uint64_t FilteredBaseData::getTimeUnits(int pseudoRank)
+{
+	assert((unsigned int)pseudoRank < rankMapping.size());
+	return getFileTimeUnits(rankMapping[pseudoRank]);
+}
+
+uint64_t FilteredBaseData::getFileTimeUnits(int realRank)
+{
+	//Headers older than version 1.01 have no flags: microseconds
+	if (headerSize < HPCTRACE_FMT_HeaderLen)
+		return 1000000;
+	hpctrace_hdr_flags_t flags;
+	flags.bits = getLong(baseOffsets[realRank].start
+			+ HPCTRACE_FMT_HeaderLen - HPCTRACE_FMT_FlagsLen);
+	return hpctrace_hdr_flags_timeUnits(flags);
+}
+
+void FilteredBaseData::setTimeUnits(uint64_t units)
+{
+	timeMul.clear();
+	timeDiv.clear();
+	int numFiles = baseDataFile->getNumberOfFiles();
+	bool uniform = true;
+	vector<uint64_t> mul(numFiles, 1), div(numFiles, 1);
+	for (int i = 0; i < numFiles; i++) {
+		uint64_t fileUnits = getFileTimeUnits(i);
+		if (fileUnits == units)
+			continue;
+		uniform = false;
+		//The units are powers of ten, so one of them divides the other
+		if (fileUnits < units)
+			mul[i] = units / fileUnits;
+		else
+			div[i] = fileUnits / units;
+	}
+	if (!uniform) {
+		timeMul.swap(mul);
+		timeDiv.swap(div);
+	}
+}
+
+uint64_t FilteredBaseData::getTime(int pseudoRank, FileOffset position)
+{
+	uint64_t time = getLong(position);
+	if (timeMul.empty())
+		return time;
+	int realRank = rankMapping[pseudoRank];
+	return time * timeMul[realRank] / timeDiv[realRank];
+}
+
 int* FilteredBaseData::getProcessIDs()
 {
 	return baseDataFile->processIDs;
@@ -83,6 +83,12 @@ namespace TraceviewerServer
 		int64_t getLong(FileOffset position);
 		int getInt(FileOffset position);
 		int getNumberOfRanks();
+		//Time stamp units per second of the rank's trace, from its header
+		uint64_t getTimeUnits(int pseudoRank);
+		//Makes getTime return the time stamps of every rank in these units
+		void setTimeUnits(uint64_t units);
+		//The time stamp of the record at position, in the units of setTimeUnits
+		uint64_t getTime(int pseudoRank, FileOffset position);
 		int* getProcessIDs();
 		short* getThreadIDs();
 	private:
@@ -96,6 +102,11 @@ namespace TraceviewerServer
 		//pool to the real ranks from the filtered pool.
 		vector<int> rankMapping;
 		int headerSize;
+		//Per real rank: time stamps are converted by timeMul / timeDiv.
+		//Empty while every rank is in the common unit.
+		vector<uint64_t> timeMul, timeDiv;
+
+		uint64_t getFileTimeUnits(int realRank);
 	};
 
 
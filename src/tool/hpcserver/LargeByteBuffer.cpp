@@ -78,8 +78,6 @@ using namespace std;
 
 namespace TraceviewerServer
 {
-	static FileOffset mmPageSize; //= 1<<23;//1 << 30;
-	FileOffset fileSize;
 	LargeByteBuffer::LargeByteBuffer(string sPath, int headerSize)
 	{
 		//string SPath = Path.string();
@@ -94,9 +92,9 @@ namespace TraceviewerServer
 
 		FileOffset ramSizeInBytes = getRamSize();
 
-		const FileOffset _64_MEGABYTE = 1 << 26;
 		//This is a pretty arbitrary algorithm, but it works
-		mmPageSize = pageSizeMultiple * (_64_MEGABYTE/osPageSize);//This means it will get it close to 64 MB
+		//The hint defaults to 64 MB and can be changed with --page-size
+		mmPageSize = pageSizeMultiple * max((FileOffset)1, PageCache::pageSizeHint/osPageSize);
 
 		//We should take into account how many copies of this program are
 		//running on this node with something like MPI_COMM_WORLD, but I don't
@@ -105,44 +103,29 @@ namespace TraceviewerServer
 		//the specifics of, so the amount of RAM may be less important than it seems.
 		double MAX_PORTION_OF_RAM_AVAILABLE = 0.60;//Use up to 60%
 		int MaxPages = (int)(ramSizeInBytes * MAX_PORTION_OF_RAM_AVAILABLE/mmPageSize);
-		VersatileMemoryPage::setMaxPages(MaxPages);
 
+		fd = open(sPath.c_str(), O_RDONLY);
 
-		int FullPages = fileSize / mmPageSize;
-		int PartialPageSize = fileSize % mmPageSize;
-		numPages = FullPages + (PartialPageSize == 0 ? 0 : 1);
-		pageManagementList = new LRUList<VersatileMemoryPage>(numPages);
-
-		FileDescriptor fd = open(sPath.c_str(), O_RDONLY);
-
-		FileOffset sizeRemaining = fileSize;
-
-		for (int i = 0; i < numPages; i++)
-		{
-			FileOffset mapping_len = min( mmPageSize, sizeRemaining);
-
-			masterBuffer.push_back(VersatileMemoryPage(mmPageSize*i, mapping_len, fd, pageManagementList));
-
-			sizeRemaining -= mapping_len;
-
-		}
-
+		pageCache = new PageCache(fd, fileSize, mmPageSize, MaxPages);
+		numPages = pageCache->getNumPages();
 	}
 
 	int LargeByteBuffer::getInt(FileOffset pos)
 	{
 		int Page = pos / mmPageSize;
 		int loc = pos % mmPageSize;
-		char* p2D = masterBuffer[Page].get() + loc;
+		char* p2D = pageCache->acquire(Page) + loc;
 		int val = ByteUtilities::readInt(p2D);
+		pageCache->release(Page);
 		return val;
 	}
 	Long LargeByteBuffer::getLong(FileOffset pos)
 	{
 		int Page = pos / mmPageSize;
 		int loc = pos % mmPageSize;
-		char* p2D = masterBuffer[Page].get() + loc;
+		char* p2D = pageCache->acquire(Page) + loc;
 		Long val = ByteUtilities::readLong(p2D);
+		pageCache->release(Page);
 		return val;
 
 	}
@@ -194,8 +177,8 @@ namespace TraceviewerServer
 	}
 	LargeByteBuffer::~LargeByteBuffer()
 	{
-		masterBuffer.clear();
-		delete pageManagementList;
+		delete pageCache;
+		close(fd);
 
 	}
 }
@@ -60,10 +60,9 @@
 #ifndef LARGEBYTEBUFFER_H_
 #define LARGEBYTEBUFFER_H_
 
-#include "VersatileMemoryPage.hpp"
+#include "PageCache.hpp"
 #include "ByteUtilities.hpp"
 #include "FileUtils.hpp" //For FileOffset
-#include "LRUList.hpp"
 
 #include <string>
 #include <vector>
@@ -83,9 +82,11 @@ namespace TraceviewerServer
 	private:
 		static uint64_t lcm(uint64_t, uint64_t);
 		static uint64_t getRamSize();
-		vector<VersatileMemoryPage> masterBuffer;
+		PageCache* pageCache;
+		FileDescriptor fd;
+		FileOffset fileSize;
+		FileOffset mmPageSize;
 		int numPages;
-		LRUList<VersatileMemoryPage>* pageManagementList;
 
 	};
 
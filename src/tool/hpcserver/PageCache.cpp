@@ -0,0 +1,273 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Decides which windows of the merged trace file are mapped. Pages are
+//   spread over independently locked shards, each with its own LRU list and
+//   share of the mapping budget, so that several threads can read the trace
+//   at once.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "PageCache.hpp"
+#include "DebugUtils.hpp"
+
+using namespace std;
+
+namespace TraceviewerServer
+{
+	FileOffset PageCache::pageSizeHint = PageCache::DEFAULT_PAGE_SIZE_HINT;
+	bool PageCache::printStats = false;
+	//min and max take references, so the constants need storage
+	const int PageCache::MAX_SHARDS;
+	const int PageCache::MAX_EVICTION_BATCH;
+
+	PageCache::PageCache(FileDescriptor _file, FileOffset fileSize, FileOffset pageSize,
+			int maxMappedPages)
+	{
+		file = _file;
+		lastPage = -2;
+
+		int fullPages = fileSize / pageSize;
+		int partialPageSize = fileSize % pageSize;
+		int numPages = fullPages + (partialPageSize == 0 ? 0 : 1);
+
+		int numShards = max(1, min(MAX_SHARDS, numPages));
+		for (int i = 0; i < numShards; i++)
+		{
+			Shard* s = new Shard;
+			pthread_mutex_init(&s->lock, NULL);
+			s->lru = new LRUList<VersatileMemoryPage>(numPages / numShards + 1);
+			s->budget = max(1, maxMappedPages / numShards);
+			s->stats.hits = 0;
+			s->stats.faults = 0;
+			s->stats.evictions = 0;
+			s->stats.readaheads = 0;
+			shards.push_back(s);
+		}
+		DEBUGCOUT(1) << numPages << " pages of " << pageSize << " bytes in " << numShards
+				<< " shards, " << shards[0]->budget << " mapped pages per shard" << endl;
+
+		FileOffset sizeRemaining = fileSize;
+		for (int i = 0; i < numPages; i++)
+		{
+			FileOffset mappingLen = min(pageSize, sizeRemaining);
+			VersatileMemoryPage* page = new VersatileMemoryPage(pageSize * i, mappingLen, file);
+			page->index = shardOf(i)->lru->addNewUnused(page);
+			pages.push_back(page);
+			sizeRemaining -= mappingLen;
+		}
+	}
+
+	PageCache::Shard* PageCache::shardOf(int pageIndex)
+	{
+		return shards[pageIndex % shards.size()];
+	}
+
+	int PageCache::getNumPages()
+	{
+		return pages.size();
+	}
+
+	char* PageCache::acquire(int pageIndex)
+	{
+		VersatileMemoryPage* p = pages[pageIndex];
+		Shard* s = shardOf(pageIndex);
+		char* regions[MAX_EVICTION_BATCH];
+		int sizes[MAX_EVICTION_BATCH];
+		int evicted = 0;
+
+		pthread_mutex_lock(&s->lock);
+		if (p->isMapped)
+		{
+			s->lru->putOnTop(p->index);
+			s->stats.hits++;
+		}
+		else
+		{
+			if (s->lru->getUsedPageCount() >= s->budget)
+				evicted = evictBatch(s, regions, sizes);
+			p->mapPage();
+			s->lru->reAdd(p->index);
+			s->stats.faults++;
+		}
+		//Pins are only ever added while holding the lock, so an unpinned page
+		//seen by evictBatch stays unpinned until it is detached
+		__sync_fetch_and_add(&p->pins, 1);
+		char* data = p->page;
+		pthread_mutex_unlock(&s->lock);
+
+		//The evicted pages are unreachable now, so the (slow) munmap does not
+		//need to hold up other readers of the shard
+		for (int i = 0; i < evicted; i++)
+			VersatileMemoryPage::unmapRegion(regions[i], sizes[i]);
+
+		//Only a hint, so relaxed accesses are enough; it is only written when
+		//the scan moves to another page to keep the line from bouncing
+		int previous = __atomic_load_n(&lastPage, __ATOMIC_RELAXED);
+		if (previous != pageIndex)
+		{
+			__atomic_store_n(&lastPage, pageIndex, __ATOMIC_RELAXED);
+			if (previous == pageIndex - 1)
+				readahead(pageIndex + 1);
+		}
+		return data;
+	}
+
+	void PageCache::release(int pageIndex)
+	{
+		__sync_fetch_and_sub(&pages[pageIndex]->pins, 1);
+	}
+
+	/**
+	 * Detaches up to a batch of the least recently used, unpinned pages of
+	 * the shard. Must be called with the shard locked; the caller unmaps the
+	 * returned regions after unlocking.
+	 */
+	int PageCache::evictBatch(Shard* s, char** regions, int* sizes)
+	{
+		int batch = min(MAX_EVICTION_BATCH, max(1, s->budget / 8));
+		int evicted = 0;
+		int candidates = s->lru->getUsedPageCount();
+		while (evicted < batch && candidates-- > 0)
+		{
+			VersatileMemoryPage* victim = s->lru->getLast();
+			if (__sync_add_and_fetch(&victim->pins, 0) > 0)
+			{
+				s->lru->putOnTop(victim->index);
+				continue;
+			}
+			DEBUGCOUT(1) << "Kicking " << victim->startPoint << " out" << endl;
+			s->lru->removeLast();
+			sizes[evicted] = victim->size;
+			regions[evicted] = victim->detach();
+			evicted++;
+		}
+		s->stats.evictions += evicted;
+		return evicted;
+	}
+
+	/**
+	 * Tells the kernel that the page after a sequential run will be read
+	 * soon: madvise if it is already mapped, posix_fadvise on the file
+	 * otherwise. Each page is hinted at most once per mapping.
+	 */
+	void PageCache::readahead(int pageIndex)
+	{
+		if (pageIndex >= (int)pages.size())
+			return;
+		VersatileMemoryPage* p = pages[pageIndex];
+		Shard* s = shardOf(pageIndex);
+
+		pthread_mutex_lock(&s->lock);
+		if (!p->readaheadIssued)
+		{
+			p->readaheadIssued = true;
+			s->stats.readaheads++;
+			if (p->isMapped)
+				madvise(p->page, p->size, MADV_WILLNEED);
+			else
+			{
+#ifdef POSIX_FADV_WILLNEED
+				posix_fadvise(file, p->startPoint, p->size, POSIX_FADV_WILLNEED);
+#endif
+			}
+		}
+		pthread_mutex_unlock(&s->lock);
+	}
+
+	PageCache::Stats PageCache::getStats()
+	{
+		Stats total;
+		total.hits = 0;
+		total.faults = 0;
+		total.evictions = 0;
+		total.readaheads = 0;
+		for (size_t i = 0; i < shards.size(); i++)
+		{
+			pthread_mutex_lock(&shards[i]->lock);
+			total.hits += shards[i]->stats.hits;
+			total.faults += shards[i]->stats.faults;
+			total.evictions += shards[i]->stats.evictions;
+			total.readaheads += shards[i]->stats.readaheads;
+			pthread_mutex_unlock(&shards[i]->lock);
+		}
+		return total;
+	}
+
+	PageCache::~PageCache()
+	{
+		if (printStats)
+		{
+			Stats st = getStats();
+			cout << "Page cache: " << st.hits << " hits, " << st.faults << " faults, "
+					<< st.evictions << " evictions, " << st.readaheads << " readaheads" << endl;
+		}
+		for (size_t i = 0; i < pages.size(); i++)
+			delete pages[i];
+		for (size_t i = 0; i < shards.size(); i++)
+		{
+			pthread_mutex_destroy(&shards[i]->lock);
+			delete shards[i]->lru;
+			delete shards[i];
+		}
+	}
+
+} /* namespace TraceviewerServer */
@@ -0,0 +1,135 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Decides which windows of the merged trace file are mapped. Pages are
+//   spread over independently locked shards, each with its own LRU list and
+//   share of the mapping budget, so that several threads can read the trace
+//   at once.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef PAGECACHE_HPP_
+#define PAGECACHE_HPP_
+
+#include <pthread.h>
+#include <vector>
+
+#include "VersatileMemoryPage.hpp"
+#include "LRUList.hpp"
+#include "ByteUtilities.hpp" //For Long
+#include "FileUtils.hpp" //For FileOffset
+
+using std::vector;
+
+namespace TraceviewerServer
+{
+
+	class PageCache
+	{
+	public:
+		struct Stats
+		{
+			Long hits;       // page was already mapped
+			Long faults;     // page had to be mapped
+			Long evictions;  // pages unmapped to stay within the budget
+			Long readaheads; // pages hinted to the kernel ahead of a sequential scan
+		};
+
+		PageCache(FileDescriptor file, FileOffset fileSize, FileOffset pageSize, int maxMappedPages);
+		virtual ~PageCache();
+
+		/**
+		 * Returns the mapped contents of page pageIndex. The page is pinned
+		 * (it will not be unmapped) until release() is called with the same index.
+		 */
+		char* acquire(int pageIndex);
+		void release(int pageIndex);
+
+		int getNumPages();
+		Stats getStats();
+
+		// Set from the command line before any database is opened
+		static FileOffset pageSizeHint;
+		static bool printStats;
+
+		static const FileOffset DEFAULT_PAGE_SIZE_HINT = 1 << 26;//64 MB
+		static const int MAX_SHARDS = 16;
+	private:
+		struct Shard
+		{
+			pthread_mutex_t lock;
+			LRUList<VersatileMemoryPage>* lru;
+			int budget;
+			Stats stats;
+			char padding[64];//Keep the locks of two shards off the same cache line
+		};
+
+		Shard* shardOf(int pageIndex);
+		int evictBatch(Shard*, char** regions, int* sizes);
+		void readahead(int pageIndex);
+
+		FileDescriptor file;
+		vector<VersatileMemoryPage*> pages;
+		vector<Shard*> shards;
+		//Last page handed out, to detect sequential scans
+		volatile int lastPage;
+
+		//Unmap several pages at once so that a scan over new data does not
+		//pay for one eviction per fault
+		static const int MAX_EVICTION_BATCH = 8;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* PAGECACHE_HPP_ */
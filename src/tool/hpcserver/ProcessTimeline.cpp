@@ -63,9 +63,10 @@ namespace TraceviewerServer
 {
 
 	ProcessTimeline::ProcessTimeline(ImageTraceAttributes attrib, int _lineNum, FilteredBaseData* _dataTrace,
-			Time _startingTime, int _headerSize)
+			Time _startingTime, int _headerSize, TimelineCache* _cache)
 	{
 		lineNum = _lineNum;
+		cache = _cache;
 
 		timeRange = (attrib.endTime - attrib.begTime) ;
 		startingTime = _startingTime;
@@ -85,7 +86,7 @@ namespace TraceviewerServer
 	}
 	void ProcessTimeline::readInData()
 	{
-		data->getData(startingTime, timeRange, pixelLength);
+		data->getData(startingTime, timeRange, pixelLength, cache);
 	}
 
 	int ProcessTimeline::line()
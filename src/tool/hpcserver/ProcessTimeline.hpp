@@ -62,6 +62,7 @@
 #include "TraceDataByRank.hpp"
 #include "ImageTraceAttributes.hpp"
 #include "TimeCPID.hpp" // for Time
+#include "TimelineCache.hpp"
 namespace TraceviewerServer
 {
 
@@ -71,7 +72,7 @@ namespace TraceviewerServer
 	public:
 		ProcessTimeline();
 		ProcessTimeline(ImageTraceAttributes attrib, int _lineNum, FilteredBaseData* _dataTrace,
-				Time _startingTime, int _headerSize);
+				Time _startingTime, int _headerSize, TimelineCache* _cache = NULL);
 		virtual ~ProcessTimeline();
 		int line();
 		void readInData();
@@ -87,6 +88,8 @@ namespace TraceviewerServer
 		/** The amount of time that each pixel on the screen correlates to. */
 		double pixelLength;
 		ImageTraceAttributes attributes;
+		/** Shared with the other timelines of the controller. May be NULL. */
+		TimelineCache* cache;
 
 	};
 
@@ -89,6 +89,7 @@ namespace TraceviewerServer
 	bool useCompression = true;
 	int mainPortNumber = DEFAULT_PORT;
 	int xmlPortNumber = 0;
+	string sessionRecordPath;
 
 	Server::Server()
 	{
@@ -102,6 +103,13 @@ namespace TraceviewerServer
 		mainPortNumber = socketptr->getPort();
 		cout << "Received connection" << endl;
 
+		if (!sessionRecordPath.empty())
+		{
+			sessionRecord.open(sessionRecordPath.c_str(), ios::out | ios::app);
+			if (!sessionRecord.is_open())
+				cerr << "Could not open " << sessionRecordPath << " to record the session" << endl;
+		}
+
 		int command = socketptr->readInt();
 		if (command == OPEN)
 		{
@@ -206,11 +214,22 @@ namespace TraceviewerServer
 					filter(socketptr);
 #ifdef HPCTOOLKIT_PROFILE
 					hpctoolkit_sampling_stop();
+#endif
+					break;
+				case STAT:
+#ifdef HPCTOOLKIT_PROFILE
+					hpctoolkit_sampling_start();
+#endif
+					getAndSendStatistics(socketptr);
+#ifdef HPCTOOLKIT_PROFILE
+					hpctoolkit_sampling_stop();
 #endif
 					break;
 				case DONE:
+					printCacheStats();
 					return CLOSE_SERVER;
 				case OPEN:
+					printCacheStats();
 					return START_NEW_CONNECTION_IMMEDIATELY;
 				default:
 					cerr << "Unknown command received" << endl;
@@ -227,6 +246,9 @@ namespace TraceviewerServer
 		Time maxEndTime = socket->readLong();
 		int headerSize = socket->readInt();
 		controller->setInfo(minBegTime, maxEndTime, headerSize);
+		cout << "Trace time stamps: " << controller->getTimeUnits() << " per second" << endl;
+		if (sessionRecord.is_open())
+			sessionRecord << "INFO " << minBegTime << " " << maxEndTime << " " << headerSize << endl;
 
 		Communication::sendParseInfo(minBegTime, maxEndTime, headerSize);//Send to MPI if necessary
 	}
@@ -290,7 +312,7 @@ namespace TraceviewerServer
 			if (ret != Z_OK)
 				throw ret;
 
-			DataCompressionLayer compL(compressor, &prog);
+			DataCompressionLayer compL(&compressor, &prog);
 			compL.writeFile(in);
 
 			fclose(in);
@@ -337,6 +359,8 @@ namespace TraceviewerServer
 		if (controller != NULL)
 		{
 			Communication::sendParseOpenDB(pathToDB);
+			if (sessionRecord.is_open())
+				sessionRecord << "OPEN " << pathToDB << endl;
 		}
 
 		return controller;
@@ -374,6 +398,10 @@ namespace TraceviewerServer
 					<< endl;
 			throw(ERROR_INVALID_PARAMETERS);
 		}
+		if (sessionRecord.is_open())
+			sessionRecord << "DATA " << processStart << " " << processEnd << " " << timeStart << " "
+					<< timeEnd << " " << verticalResolution << " " << horizontalResolution << endl;
+
 		Communication::sendStartGetData(controller, processStart, processEnd, timeStart, timeEnd, verticalResolution, horizontalResolution);
 		LOGTIMESTAMPEDMSG("Back end received data request.")
 
@@ -384,6 +412,117 @@ namespace TraceviewerServer
 
 		Communication::sendEndGetData(stream, &prog, controller);
 
+		TimelineCache::Stats cs = controller->getTimelineCache()->getStats();
+		DEBUGCOUT(1) << "Timeline cache: " << cs.hits << " hits, " << cs.zoomHits << " zoom hits, "
+				<< cs.partialHits << " partial hits, " << cs.misses << " misses" << endl;
+	}
+
+	// In MPI mode the timelines are computed by the slaves, so the front end's
+	// cache only sees traffic when running single-threaded.
+	void Server::printCacheStats()
+	{
+		if (controller == NULL)
+			return;
+		TimelineCache::Stats cs = controller->getTimelineCache()->getStats();
+		Long lookups = cs.hits + cs.zoomHits + cs.partialHits + cs.misses;
+		if (lookups == 0)
+			return;
+		cout << "Timeline cache: " << lookups << " lookups, " << cs.hits << " hits, "
+				<< cs.zoomHits << " zoom hits, " << cs.partialHits << " partial hits, "
+				<< cs.misses << " misses, " << cs.evictions << " evictions" << endl;
+	}
+
+	/**
+	 * Writes the result of a STAT request. Used both for the compressed
+	 * buffer and directly on the socket, which have the same writers.
+	 */
+	template <typename Out>
+	static void writeStatistics(Out* out, const StatisticsQuery& q, const StatisticsResult& r)
+	{
+		if (q.type == STAT_BUSY_FRACTION)
+		{
+			out->writeInt(r.busyFraction.size());
+			for (unsigned int i = 0; i < r.busyFraction.size(); i++)
+			{
+				out->writeInt(q.processStart + i);
+				for (int b = 0; b < q.numBuckets; b++)
+					out->writeDouble(r.busyFraction[i][b]);
+			}
+		}
+		else
+		{
+			for (int b = 0; b < q.numBuckets; b++)
+			{
+				const vector<CpidTime>& bucket = r.cpidTimes[b];
+				out->writeInt(bucket.size());
+				for (unsigned int i = 0; i < bucket.size(); i++)
+				{
+					out->writeInt(bucket[i].cpid);
+					out->writeLong(bucket[i].time);
+				}
+			}
+		}
+	}
+
+	/**
+	 * STAT request: int processStart, int processEnd, long timeStart, long timeEnd,
+	 * int numBuckets, int type, int topN, int idle cpid count, then the idle cpids.
+	 * Reply: STAT, type, numBuckets, payload size, then the (compressed if enabled)
+	 * payload written by writeStatistics.
+	 *
+	 * The statistics are computed by this process with threads, also in MPI mode,
+	 * since the front end has the database open as well.
+	 */
+	void Server::getAndSendStatistics(DataSocketStream* stream)
+	{
+		StatisticsQuery q;
+		q.processStart = stream->readInt();
+		q.processEnd = stream->readInt();
+		q.timeStart = stream->readLong();
+		q.timeEnd = stream->readLong();
+		q.numBuckets = stream->readInt();
+		q.type = stream->readInt();
+		q.topN = stream->readInt();
+		int idleCount = stream->readInt();
+		for (int i = 0; i < idleCount; i++)
+			q.idleCpids.insert(stream->readInt());
+
+		if ((q.processStart < 0) || (q.processStart > q.processEnd) || (q.numBuckets <= 0)
+				|| (q.timeEnd <= q.timeStart) || (q.type < STAT_TIME_PER_CPID)
+				|| (q.type > STAT_TOP_CPIDS) || (idleCount < 0))
+		{
+			cerr << "A statistics request with invalid parameters was received. The server will now shut down." << endl;
+			throw(ERROR_INVALID_PARAMETERS);
+		}
+		LOGTIMESTAMPEDMSG("Front end received statistics request.")
+
+		StatisticsResult r;
+		controller->computeStatistics(q, &r);
+
+		stream->writeInt(STAT);
+		stream->writeInt(q.type);
+		stream->writeInt(q.numBuckets);
+		if (useCompression)
+		{
+			DataCompressionLayer compr;
+			writeStatistics(&compr, q, r);
+			compr.flush();
+			stream->writeInt(compr.getOutputLength());
+			stream->writeRawData((char*)compr.getOutputBuffer(), compr.getOutputLength());
+		}
+		else
+		{
+			Long size = 0;
+			if (q.type == STAT_BUSY_FRACTION)
+				size = SIZEOF_INT + r.busyFraction.size() * (SIZEOF_INT + q.numBuckets * SIZEOF_LONG);
+			else
+				for (int b = 0; b < q.numBuckets; b++)
+					size += SIZEOF_INT + r.cpidTimes[b].size() * (SIZEOF_INT + SIZEOF_LONG);
+			stream->writeInt(size);
+			writeStatistics(stream, q, r);
+		}
+		stream->flush();
+		LOGTIMESTAMPEDMSG("Statistics sent.")
 	}
 
 	void Server::filter(DataSocketStream* stream)
@@ -63,6 +63,9 @@
 #include "DataSocketStream.hpp"
 #include "SpaceTimeDataController.hpp"
 
+#include <fstream>
+#include <string>
+
 
 
 namespace TraceviewerServer
@@ -70,6 +73,8 @@ namespace TraceviewerServer
 	extern bool useCompression;
 	extern int mainPortNumber;
 	extern int xmlPortNumber;
+	// If not empty, every request of the session is appended to this file so that it can be replayed
+	extern std::string sessionRecordPath;
 	class Server
 	{
 
@@ -85,12 +90,15 @@ namespace TraceviewerServer
 		void parseInfo(DataSocketStream*);
 		SpaceTimeDataController* parseOpenDB(DataSocketStream*);
 		void filter(DataSocketStream*);
+		void getAndSendStatistics(DataSocketStream*);
 		void getAndSendData(DataSocketStream*);
 		void sendXML(DataSocketStream*);
 		void sendDBOpenFailed(DataSocketStream*);
 		void checkProtocolVersions(DataSocketStream* receiver);
+		void printCacheStats();
 
 		SpaceTimeDataController* controller;
+		std::ofstream sessionRecord;
 
 		//Currently not really used, but pretty necessary for future extensions
 		int agreedUponProtocolVersion;
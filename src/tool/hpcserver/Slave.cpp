@@ -141,6 +141,13 @@ namespace TraceviewerServer
 					break;
 				}
 				case DONE: //Server shutdown
+					if (controller != NULL)
+					{
+						TimelineCache::Stats cs = controller->getTimelineCache()->getStats();
+						DEBUGCOUT(1) << "Rank " << COMM_WORLD.Get_rank() << " timeline cache: "
+								<< cs.hits << " hits, " << cs.zoomHits << " zoom hits, "
+								<< cs.partialHits << " partial hits, " << cs.misses << " misses" << endl;
+					}
 					return;
 				default:
 					cerr << "Unexpected message command: " << Message.command << endl;
@@ -62,6 +62,7 @@
 using namespace std;
 namespace TraceviewerServer
 {
+	int timelineCacheSize = TimelineCache::DEFAULT_MAX_ENTRIES;
 
 //ImageTraceAttributes* Attributes;
 //ProcessTimeline** Traces;
@@ -80,6 +81,8 @@ namespace TraceviewerServer
 		experimentXML = locations->fileXML;
 		fileTrace = locations->fileTrace;
 		tracesInitialized = false;
+		timelineCache = new TimelineCache(timelineCacheSize);
+		timeUnits = 1000000;
 
 	}
 
@@ -92,6 +95,28 @@ namespace TraceviewerServer
 		headerSize = _headerSize;
 		delete dataTrace;
 		dataTrace = new FilteredBaseData(fileTrace, headerSize);
+		timelineCache->clear();
+
+		//The time stamps of all ranks are compared on one time line in
+		//the unit of the first rank, which is the unit of the database
+		int numRanks = dataTrace->getNumberOfRanks();
+		timeUnits = (numRanks > 0) ? dataTrace->getTimeUnits(0) : 1000000;
+		for (int i = 1; i < numRanks; i++)
+		{
+			if (dataTrace->getTimeUnits(i) != timeUnits)
+			{
+				cerr << "Trace of rank " << i << " has " << dataTrace->getTimeUnits(i)
+						<< " time units per second; converting all ranks to "
+						<< timeUnits << " per second" << endl;
+				break;
+			}
+		}
+		dataTrace->setTimeUnits(timeUnits);
+	}
+
+	uint64_t SpaceTimeDataController::getTimeUnits()
+	{
+		return timeUnits;
 	}
 
 	int SpaceTimeDataController::getNumRanks()
@@ -104,13 +129,26 @@ namespace TraceviewerServer
 		return experimentXML;
 	}
 
+	TimelineCache* SpaceTimeDataController::getTimelineCache()
+	{
+		return timelineCache;
+	}
+
+	void SpaceTimeDataController::computeStatistics(StatisticsQuery query, StatisticsResult* result)
+	{
+		query.timeStart += minBegTime;
+		query.timeEnd += minBegTime;
+		TraceStatistics stats(dataTrace);
+		stats.compute(query, result);
+	}
+
 	ProcessTimeline* SpaceTimeDataController::getNextTrace()
 	{
 		if (attributes->lineNum
 				< min(attributes->numPixelsV, attributes->endProcess - attributes->begProcess))
 		{
 			ProcessTimeline* toReturn  = new ProcessTimeline(*attributes, attributes->lineNum, dataTrace,
-					minBegTime + attributes->begTime, headerSize);
+					minBegTime + attributes->begTime, headerSize, timelineCache);
 			attributes->lineNum++;
 			return toReturn;
 		}
@@ -167,6 +205,8 @@ namespace TraceviewerServer
 	void SpaceTimeDataController::applyFilters(FilterSet filters)
 	{
 		dataTrace->setFilters(filters);
+		//The filters change which rank each line refers to
+		timelineCache->clear();
 	}
 	void SpaceTimeDataController::deleteTraces()
 	{
@@ -185,6 +225,7 @@ namespace TraceviewerServer
 	{
 		delete attributes;
 		delete dataTrace;
+		delete timelineCache;
 
 		//The MPI implementation actually doesn't use the Traces array at all!
 		//It does call getNextTrace, but changedBounds is always true so
@@ -64,11 +64,15 @@
 #include "FilteredBaseData.hpp"
 #include "FilterSet.hpp"
 #include "TimeCPID.hpp"
+#include "TimelineCache.hpp"
+#include "TraceStatistics.hpp"
 
 #include <string>
 
 namespace TraceviewerServer
 {
+	// Maximum number of sampled timelines each controller keeps; 0 disables the cache
+	extern int timelineCacheSize;
 
 	class SpaceTimeDataController
 	{
@@ -89,6 +93,11 @@ namespace TraceviewerServer
 		 short* getValuesXThreadID();
 
 		std::string getExperimentXML();
+		TimelineCache* getTimelineCache();
+		//Time stamp units per second of the traces (all times in requests are in these units)
+		uint64_t getTimeUnits();
+		//Times in the query are relative to the beginning of the trace, like in a DATA request
+		void computeStatistics(StatisticsQuery query, StatisticsResult* result);
 		ImageTraceAttributes* attributes;
 		ProcessTimeline** traces;
 		int tracesLength;
@@ -97,10 +106,12 @@ namespace TraceviewerServer
 		void deleteTraces();
 
 		FilteredBaseData* dataTrace;
+		TimelineCache* timelineCache;
 		int headerSize;
 
-		// The minimum beginning and maximum ending time stamp across all traces (in microseconds).
+		// The minimum beginning and maximum ending time stamp across all traces (in timeUnits).
 		Time maxEndTime, minBegTime;
+		uint64_t timeUnits;
 
 		int height;
 		string experimentXML;
@@ -0,0 +1,286 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   An LRU cache of sampled per-rank timelines so that repeated, panned or
+//   zoomed DATA requests do not have to go back to the trace file.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "TimelineCache.hpp"
+#include "DebugUtils.hpp"
+
+#include <algorithm>
+
+namespace TraceviewerServer
+{
+
+	bool TimelineCache::Key::operator<(const Key& o) const
+	{
+		if (rank != o.rank) return rank < o.rank;
+		if (begTime != o.begTime) return begTime < o.begTime;
+		if (endTime != o.endTime) return endTime < o.endTime;
+		return numPixelsH < o.numPixelsH;
+	}
+
+	TimelineCache::TimelineCache(int _maxEntries)
+	{
+		maxEntries = _maxEntries;
+		resetStats();
+	}
+
+	bool TimelineCache::enabled()
+	{
+		return maxEntries > 0;
+	}
+
+	TimelineCache::Key TimelineCache::keyOf(const Entry& e)
+	{
+		Key k;
+		k.rank = e.rank;
+		k.begTime = e.begTime;
+		k.endTime = e.endTime;
+		k.numPixelsH = e.numPixelsH;
+		return k;
+	}
+
+	void TimelineCache::touch(EntryIt it)
+	{
+		useOrder.splice(useOrder.begin(), useOrder, it);
+	}
+
+	bool TimelineCache::getExact(int rank, Time begTime, Time endTime, int numPixelsH,
+			vector<TimeCPID>* out)
+	{
+		Key k;
+		k.rank = rank;
+		k.begTime = begTime;
+		k.endTime = endTime;
+		k.numPixelsH = numPixelsH;
+
+		map<Key, EntryIt>::iterator found = index.find(k);
+		if (found == index.end())
+			return false;
+
+		touch(found->second);
+		*out = found->second->samples;
+		stats.hits++;
+		return true;
+	}
+
+	/**
+	 * Mirrors TraceDataByRank::findTimeInInterval on an in-memory list: returns
+	 * the index of the sample closest to time, preferring the right one on ties.
+	 */
+	static bool timeBeforeSample(Time time, const TimeCPID& sample)
+	{
+		return time < sample.timestamp;
+	}
+
+	static size_t nearestSample(const vector<TimeCPID>& s, Time time)
+	{
+		size_t r = std::upper_bound(s.begin(), s.end(), time, timeBeforeSample) - s.begin();
+		if (r == 0)
+			return 0;
+		size_t l = r - 1;
+		if (r == s.size())
+			return l;
+		Long leftDiff = time - s[l].timestamp;
+		Long rightDiff = s[r].timestamp - time;
+		return (leftDiff < rightDiff) ? l : r;
+	}
+
+	bool TimelineCache::getFromComplete(int rank, Time begTime, Time endTime, int numPixelsH,
+			vector<TimeCPID>* out)
+	{
+		map<int, list<EntryIt> >::iterator perRank = byRank.find(rank);
+		if (perRank == byRank.end())
+			return false;
+
+		list<EntryIt>::iterator it;
+		for (it = perRank->second.begin(); it != perRank->second.end(); ++it)
+		{
+			const Entry& e = **it;
+			if (!e.complete || begTime < e.coverBeg || endTime > e.coverEnd)
+				continue;
+
+			// Same selection TraceDataByRank::getData makes when every record
+			// fits on screen: the records nearest to both ends, the one before
+			// the start and the one after the end.
+			const vector<TimeCPID>& s = e.samples;
+			size_t startIdx = nearestSample(s, begTime);
+			size_t endIdx = std::min(nearestSample(s, endTime) + 1, s.size() - 1);
+			if ((Long)(endIdx - startIdx + 1) > numPixelsH)
+				continue;//Too dense for this resolution; it has to be sampled
+
+			size_t firstIdx = startIdx > 0 ? startIdx - 1 : 0;
+			out->assign(s.begin() + firstIdx, s.begin() + endIdx + 1);
+			touch(*it);
+			stats.zoomHits++;
+			return true;
+		}
+		return false;
+	}
+
+	bool TimelineCache::sameScale(const Entry& e, Time begTime, Time endTime, int numPixelsH)
+	{
+		return e.numPixelsH == numPixelsH && (e.endTime - e.begTime) == (endTime - begTime);
+	}
+
+	const TimelineCache::Entry* TimelineCache::findOverlap(int rank, Time begTime, Time endTime,
+			int numPixelsH)
+	{
+		map<int, list<EntryIt> >::iterator perRank = byRank.find(rank);
+		if (perRank == byRank.end())
+			return NULL;
+
+		EntryIt best = useOrder.end();
+		Time bestOverlap = 0;
+		list<EntryIt>::iterator it;
+		for (it = perRank->second.begin(); it != perRank->second.end(); ++it)
+		{
+			const Entry& e = **it;
+			if (!sameScale(e, begTime, endTime, numPixelsH))
+				continue;
+			Time lo = std::max(e.begTime, begTime);
+			Time hi = std::min(e.endTime, endTime);
+			if (hi > lo && hi - lo > bestOverlap)
+			{
+				bestOverlap = hi - lo;
+				best = *it;
+			}
+		}
+		if (best == useOrder.end())
+			return NULL;
+		touch(best);
+		return &*best;
+	}
+
+	void TimelineCache::insert(const Entry& entry)
+	{
+		if (!enabled())
+			return;
+
+		Key k = keyOf(entry);
+		map<Key, EntryIt>::iterator found = index.find(k);
+		if (found != index.end())
+		{
+			found->second->samples = entry.samples;
+			found->second->complete = entry.complete;
+			found->second->coverBeg = entry.coverBeg;
+			found->second->coverEnd = entry.coverEnd;
+			touch(found->second);
+			return;
+		}
+
+		while ((int)useOrder.size() >= maxEntries)
+			evictLast();
+
+		useOrder.push_front(entry);
+		index[k] = useOrder.begin();
+		byRank[entry.rank].push_back(useOrder.begin());
+	}
+
+	void TimelineCache::evictLast()
+	{
+		EntryIt last = --useOrder.end();
+		index.erase(keyOf(*last));
+
+		list<EntryIt>& perRank = byRank[last->rank];
+		perRank.remove(last);
+		if (perRank.empty())
+			byRank.erase(last->rank);
+
+		useOrder.erase(last);
+		stats.evictions++;
+	}
+
+	void TimelineCache::clear()
+	{
+		DEBUGCOUT(1) << "Dropping " << useOrder.size() << " cached timelines" << endl;
+		byRank.clear();
+		index.clear();
+		useOrder.clear();
+	}
+
+	void TimelineCache::countPartialHit()
+	{
+		stats.partialHits++;
+	}
+
+	void TimelineCache::countMiss()
+	{
+		stats.misses++;
+	}
+
+	TimelineCache::Stats TimelineCache::getStats()
+	{
+		return stats;
+	}
+
+	void TimelineCache::resetStats()
+	{
+		stats.hits = 0;
+		stats.zoomHits = 0;
+		stats.partialHits = 0;
+		stats.misses = 0;
+		stats.evictions = 0;
+	}
+
+	TimelineCache::~TimelineCache()
+	{
+		clear();
+	}
+
+} /* namespace TraceviewerServer */
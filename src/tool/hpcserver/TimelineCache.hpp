@@ -0,0 +1,155 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   An LRU cache of sampled per-rank timelines so that repeated, panned or
+//   zoomed DATA requests do not have to go back to the trace file.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef TIMELINECACHE_HPP_
+#define TIMELINECACHE_HPP_
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "TimeCPID.hpp"
+#include "ByteUtilities.hpp" //For Long
+
+using std::list;
+using std::map;
+using std::vector;
+
+namespace TraceviewerServer
+{
+
+	class TimelineCache
+	{
+	public:
+		/**
+		 * One sampled timeline as produced by TraceDataByRank::getData for
+		 * the time range [begTime, endTime] at numPixelsH horizontal pixels.
+		 * If complete is true, samples holds every record of the rank between
+		 * coverBeg and coverEnd (and one record on either side of the
+		 * request), so any sub-range can be answered exactly from memory.
+		 */
+		struct Entry
+		{
+			int rank;
+			Time begTime;
+			Time endTime;
+			int numPixelsH;
+			bool complete;
+			Time coverBeg;
+			Time coverEnd;
+			vector<TimeCPID> samples;
+		};
+
+		struct Stats
+		{
+			Long hits;        // exact (rank, range, resolution) matches
+			Long zoomHits;    // served by a complete entry covering the range
+			Long partialHits; // panned: overlap reused, missing edges fetched
+			Long misses;
+			Long evictions;
+		};
+
+		TimelineCache(int maxEntries);
+		virtual ~TimelineCache();
+
+		bool enabled();
+
+		bool getExact(int rank, Time begTime, Time endTime, int numPixelsH,
+				vector<TimeCPID>* out);
+		bool getFromComplete(int rank, Time begTime, Time endTime, int numPixelsH,
+				vector<TimeCPID>* out);
+		const Entry* findOverlap(int rank, Time begTime, Time endTime, int numPixelsH);
+
+		void insert(const Entry& entry);
+		void clear();
+
+		void countPartialHit();
+		void countMiss();
+		Stats getStats();
+		void resetStats();
+
+		static const int DEFAULT_MAX_ENTRIES = 4096;
+	private:
+		struct Key
+		{
+			int rank;
+			Time begTime;
+			Time endTime;
+			int numPixelsH;
+			bool operator<(const Key& o) const;
+		};
+		typedef list<Entry>::iterator EntryIt;
+
+		static Key keyOf(const Entry&);
+		static bool sameScale(const Entry&, Time begTime, Time endTime, int numPixelsH);
+		void touch(EntryIt);
+		void evictLast();
+
+		int maxEntries;
+		//Most recently used at the front
+		list<Entry> useOrder;
+		map<Key, EntryIt> index;
+		//All entries of a rank, for the pan/zoom searches
+		map<int, list<EntryIt> > byRank;
+		Stats stats;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* TIMELINECACHE_HPP_ */
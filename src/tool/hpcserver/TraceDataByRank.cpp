@@ -60,6 +60,8 @@
 #include "TraceDataByRank.hpp"
 #include <algorithm>
 #include <cstdlib> // previously: cmath but it causes ambuguity in abs function for gcc 4.4.6
+#include <cmath> // for ceil
+#include <limits>
 #include "Constants.hpp"
 #include <iostream>
 
@@ -75,6 +77,9 @@ namespace TraceviewerServer
 		minloc = data->getMinLoc(rank);
 		maxloc = data->getMaxLoc(rank);
 		numPixelsH = _numPixelH;
+		readAllRecords = false;
+		lastStartLoc = minloc;
+		lastEndLoc = maxloc;
 
 		
 		listCPID = new vector<TimeCPID>();
@@ -94,6 +99,10 @@ namespace TraceviewerServer
 		// get the number of records data to display
 		 Long numRec = 1 + getNumberOfRecords(startLoc, endLoc);
 
+		lastStartLoc = startLoc;
+		lastEndLoc = endLoc;
+		readAllRecords = (numRec <= numPixelsH);
+
 		// --------------------------------------------------------------------------------------------------
 		// if the data-to-display is fit in the display zone, we don't need to use recursive binary search
 		//	we just simply display everything from the file
@@ -136,6 +145,123 @@ namespace TraceviewerServer
 		}
 		postProcess();
 	}
+
+	/*******************************************************************************************
+	 * Same as getData above, but answers the request from the timeline cache when it can:
+	 * an identical earlier request, a fully read range that contains this one (zoom in), or
+	 * an earlier request of the same scale that overlaps this one (pan), in which case only
+	 * the missing edge is read from the file. Whatever is computed is put back in the cache.
+	 ******************************************************************************************/
+	void TraceDataByRank::getData(Time timeStart, Time timeRange, double pixelLength,
+			TimelineCache* cache)
+	{
+		if (cache == NULL || !cache->enabled())
+		{
+			getData(timeStart, timeRange, pixelLength);
+			return;
+		}
+
+		Time timeEnd = timeStart + timeRange;
+		if (cache->getExact(rank, timeStart, timeEnd, numPixelsH, listCPID))
+			return;
+
+		if (cache->getFromComplete(rank, timeStart, timeEnd, numPixelsH, listCPID))
+		{
+			postProcess();
+			return;
+		}
+
+		const TimelineCache::Entry* overlap = cache->findOverlap(rank, timeStart, timeEnd, numPixelsH);
+		if (overlap != NULL)
+		{
+			cache->countPartialHit();
+			getDataFromOverlap(overlap, timeStart, timeRange, pixelLength);
+			readAllRecords = false;
+		}
+		else
+		{
+			cache->countMiss();
+			getData(timeStart, timeRange, pixelLength);
+		}
+		cache->insert(makeCacheEntry(timeStart, timeEnd));
+	}
+
+	/*******************************************************************************************
+	 * Builds the timeline for a pan: the part that overlaps the cached timeline is copied,
+	 * and only the edge that scrolled into view is sampled from the file, at the same pixel
+	 * length. The result is equivalent to a fresh getData at pixel resolution, although the
+	 * chosen samples may differ from it by less than one pixel.
+	 ******************************************************************************************/
+	void TraceDataByRank::getDataFromOverlap(const TimelineCache::Entry* cached, Time timeStart,
+			Time timeRange, double pixelLength)
+	{
+		Time timeEnd = timeStart + timeRange;
+		bool pannedLeft = timeStart < cached->begTime;
+		Time edgeStart = pannedLeft ? timeStart : cached->endTime;
+		Time edgeEnd = pannedLeft ? cached->begTime : timeEnd;
+
+		int edgePixels = max(1, (int) ceil((edgeEnd - edgeStart) / pixelLength));
+		TraceDataByRank edge(data, rank, edgePixels, 0);
+		edge.getData(edgeStart, edgeEnd - edgeStart, pixelLength);
+		const vector<TimeCPID>& edgeData = *edge.listCPID;
+		const vector<TimeCPID>& old = cached->samples;
+
+		// Keep one cached sample on either side of the new range, just as getData does
+		size_t lo = 0, hi = old.size();
+		while (lo + 1 < old.size() && old[lo + 1].timestamp <= timeStart)
+			lo++;
+		while (hi > lo + 1 && old[hi - 2].timestamp >= timeEnd)
+			hi--;
+
+		listCPID->clear();
+		vector<TimeCPID>::const_iterator it;
+		if (pannedLeft)
+		{
+			for (it = edgeData.begin(); it != edgeData.end(); ++it)
+				if (it->timestamp < cached->begTime)
+					listCPID->push_back(*it);
+			for (size_t i = lo; i < hi; i++)
+				if (old[i].timestamp >= cached->begTime)
+					listCPID->push_back(old[i]);
+		}
+		else
+		{
+			for (size_t i = lo; i < hi; i++)
+				if (old[i].timestamp <= cached->endTime)
+					listCPID->push_back(old[i]);
+			for (it = edgeData.begin(); it != edgeData.end(); ++it)
+				if (it->timestamp > cached->endTime)
+					listCPID->push_back(*it);
+		}
+		postProcess();
+	}
+
+	/*******************************************************************************************
+	 * Describes the current contents of listCPID for the cache. When every record was read,
+	 * the entry can serve any sub-range for which it still holds both neighbouring records,
+	 * which is everything but the two outermost samples unless they are the ends of the file.
+	 ******************************************************************************************/
+	TimelineCache::Entry TraceDataByRank::makeCacheEntry(Time timeStart, Time timeEnd)
+	{
+		TimelineCache::Entry e;
+		e.rank = rank;
+		e.begTime = timeStart;
+		e.endTime = timeEnd;
+		e.numPixelsH = numPixelsH;
+		e.samples = *listCPID;
+		e.complete = readAllRecords && listCPID->size() >= 3;
+		e.coverBeg = 0;
+		e.coverEnd = 0;
+		if (e.complete)
+		{
+			size_t n = listCPID->size();
+			e.coverBeg = (lastStartLoc == minloc) ? 0 : (*listCPID)[1].timestamp;
+			e.coverEnd = (lastEndLoc >= maxloc) ? numeric_limits<Time>::max()
+					: (*listCPID)[n - 3].timestamp;
+		}
+		return e;
+	}
+
 	/*******************************************************************************************
 	 * Recursive method that fills in times and timeLine with the correct data from the file.
 	 * Takes in two pixel locations as endpoints and finds the timestamp that owns the pixel
@@ -190,8 +316,8 @@ namespace TraceviewerServer
 		FileOffset l_index = getRelativeLocation(l_boundOffset);
 		FileOffset r_index = getRelativeLocation(r_boundOffset);
 
-		Time l_time = data->getLong(l_boundOffset);
-		Time r_time = data->getLong(r_boundOffset);
+		Time l_time = data->getTime(rank, l_boundOffset);
+		Time r_time = data->getTime(rank, r_boundOffset);
 	
 		// apply "Newton's method" to find target time
 		while (r_index - l_index > 1)
@@ -220,7 +346,7 @@ namespace TraceviewerServer
 			if (predicted_index >= r_index)
 				predicted_index = r_index - 1;
 
-			Time temp = data->getLong(getAbsoluteLocation(predicted_index));
+			Time temp = data->getTime(rank, getAbsoluteLocation(predicted_index));
 			if (time >= temp)
 			{
 				l_index = predicted_index;
@@ -235,8 +361,8 @@ namespace TraceviewerServer
 		FileOffset l_offset = getAbsoluteLocation(l_index);
 		FileOffset r_offset = getAbsoluteLocation(r_index);
 
-		l_time = data->getLong(l_offset);
-		r_time = data->getLong(r_offset);
+		l_time = data->getTime(rank, l_offset);
+		r_time = data->getTime(rank, r_offset);
 
 		int leftDiff = time - l_time;
 		int rightDiff = r_time - time;
@@ -274,7 +400,7 @@ namespace TraceviewerServer
 	TimeCPID TraceDataByRank::getData(FileOffset location)
 	{
 
-		 Time time = data->getLong(location);
+		 Time time = data->getTime(rank, location);
 		 int CPID = data->getInt(location + SIZEOF_LONG);
 		TimeCPID ToReturn(time, CPID);
 		return ToReturn;
@@ -292,7 +418,9 @@ namespace TraceviewerServer
 	void TraceDataByRank::postProcess()
 	{
 		int len = listCPID->size();
-		for (int i = 0; i < len - 2; i++)
+		//The last record is usually added twice by getData, so the last pair
+		//has to be checked as well
+		for (int i = 0; i < len - 1; i++)
 		{
 
 			while (i < len - 1 && (*listCPID)[i].timestamp == (*listCPID)[i + 1].timestamp)
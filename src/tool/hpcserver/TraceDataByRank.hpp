@@ -64,6 +64,7 @@
 
 #include "TimeCPID.hpp"
 #include "FilteredBaseData.hpp"
+#include "TimelineCache.hpp"
 #include "FileUtils.hpp"//FileOffset
 
 namespace TraceviewerServer
@@ -77,6 +78,7 @@ namespace TraceviewerServer
 		virtual ~TraceDataByRank();
 
 		void getData(Time timeStart, Time timeRange, double pixelLength);
+		void getData(Time timeStart, Time timeRange, double pixelLength, TimelineCache* cache);
 		int sampleTimeLine(FileOffset minLoc, FileOffset maxLoc, int startPixel, int endPixel, int minIndex, double pixelLength, Time startingTime);
 		FileOffset findTimeInInterval(Time time, FileOffset l_boundOffset, FileOffset r_boundOffset);
 
@@ -91,9 +93,18 @@ namespace TraceviewerServer
 		FileOffset maxloc;
 		int numPixelsH;
 
+		// Set by the last getData: whether every record between the two
+		// locations was read (as opposed to sampled)
+		bool readAllRecords;
+		FileOffset lastStartLoc;
+		FileOffset lastEndLoc;
+
 		FileOffset getAbsoluteLocation(FileOffset);
 
 		FileOffset getRelativeLocation(FileOffset);
+		void getDataFromOverlap(const TimelineCache::Entry*, Time timeStart, Time timeRange,
+				double pixelLength);
+		TimelineCache::Entry makeCacheEntry(Time timeStart, Time timeEnd);
 		void addSample(unsigned int, TimeCPID);
 		TimeCPID getData(FileOffset);
 		Long getNumberOfRecords(FileOffset, FileOffset);
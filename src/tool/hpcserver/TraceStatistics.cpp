@@ -0,0 +1,255 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Computes time-bucketed summaries of the trace records (time spent in
+//   each cpid, busy fraction of each rank, top cpids) on the server, so
+//   that the viewer does not have to fetch every line at full resolution.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "TraceStatistics.hpp"
+#include "Constants.hpp"
+#include "DebugUtils.hpp"
+
+using namespace std;
+
+namespace TraceviewerServer
+{
+	int TraceStatistics::numThreads = 0;
+
+	struct TraceStatistics::Worker
+	{
+		TraceStatistics* self;
+		const StatisticsQuery* query;
+		StatisticsResult* result;
+		//Shared by all the workers: the next rank nobody has taken yet
+		volatile int* nextRank;
+		//This worker's partial sums, merged once everyone is done
+		vector<map<int, Long> > perBucket;
+	};
+
+	TraceStatistics::TraceStatistics(FilteredBaseData* _data)
+	{
+		data = _data;
+	}
+
+	static bool moreTime(const CpidTime& a, const CpidTime& b)
+	{
+		if (a.time != b.time)
+			return a.time > b.time;
+		return a.cpid < b.cpid;
+	}
+
+	void TraceStatistics::compute(const StatisticsQuery& query, StatisticsResult* result)
+	{
+		int processEnd = min(query.processEnd, data->getNumberOfRanks());
+		int numRanks = max(0, processEnd - query.processStart);
+
+		result->cpidTimes.assign(query.numBuckets, vector<CpidTime>());
+		result->busyFraction.assign(numRanks, vector<double>());
+
+		int threads = numThreads;
+		if (threads <= 0)
+			threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		threads = max(1, min(threads, numRanks));
+
+		volatile int nextRank = query.processStart;
+		vector<Worker> workers(threads);
+		vector<pthread_t> ids(threads);
+		for (int i = 0; i < threads; i++)
+		{
+			workers[i].self = this;
+			workers[i].query = &query;
+			workers[i].result = result;
+			workers[i].nextRank = &nextRank;
+			workers[i].perBucket.resize(query.numBuckets);
+		}
+		//The calling thread is worker 0
+		for (int i = 1; i < threads; i++)
+			pthread_create(&ids[i], NULL, workerMain, &workers[i]);
+		workerMain(&workers[0]);
+		for (int i = 1; i < threads; i++)
+			pthread_join(ids[i], NULL);
+
+		DEBUGCOUT(1) << "Computed statistics of " << numRanks << " ranks with " << threads
+				<< " threads" << endl;
+
+		if (query.type == STAT_BUSY_FRACTION)
+			return;
+
+		for (int b = 0; b < query.numBuckets; b++)
+		{
+			map<int, Long> total;
+			for (int i = 0; i < threads; i++)
+			{
+				map<int, Long>& part = workers[i].perBucket[b];
+				for (map<int, Long>::iterator it = part.begin(); it != part.end(); ++it)
+					total[it->first] += it->second;
+			}
+			vector<CpidTime>& out = result->cpidTimes[b];
+			for (map<int, Long>::iterator it = total.begin(); it != total.end(); ++it)
+			{
+				CpidTime ct;
+				ct.cpid = it->first;
+				ct.time = it->second;
+				out.push_back(ct);
+			}
+			sort(out.begin(), out.end(), moreTime);
+			if (query.type == STAT_TOP_CPIDS && query.topN >= 0 && (int)out.size() > query.topN)
+				out.resize(query.topN);
+		}
+	}
+
+	void* TraceStatistics::workerMain(void* arg)
+	{
+		Worker* w = (Worker*) arg;
+		int processEnd = w->query->processStart + (int)w->result->busyFraction.size();
+		while (true)
+		{
+			int rank = __sync_fetch_and_add(w->nextRank, 1);
+			if (rank >= processEnd)
+				break;
+			w->self->processRank(*w->query, rank, &w->perBucket,
+					&w->result->busyFraction[rank - w->query->processStart]);
+		}
+		return NULL;
+	}
+
+	/**
+	 * Returns the location of the last record of the rank that starts at or
+	 * before time, or the first record if they all start after it.
+	 */
+	FileOffset TraceStatistics::findFirstRecord(int rank, Time time)
+	{
+		FileOffset minLoc = data->getMinLoc(rank);
+		FileOffset maxLoc = data->getMaxLoc(rank);
+		Long lo = 0;
+		Long hi = (maxLoc - minLoc) / SIZE_OF_TRACE_RECORD;
+		while (lo < hi)
+		{
+			Long mid = lo + (hi - lo + 1) / 2;
+			if (data->getTime(rank, minLoc + mid * SIZE_OF_TRACE_RECORD) <= time)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		return minLoc + lo * SIZE_OF_TRACE_RECORD;
+	}
+
+	/**
+	 * Walks the records of one rank that overlap the query interval. Each
+	 * record lasts until the next one starts (the last record of a rank has
+	 * no duration), and its time is split over the buckets it overlaps.
+	 */
+	void TraceStatistics::processRank(const StatisticsQuery& query, int rank,
+			vector<map<int, Long> >* perBucket, vector<double>* busy)
+	{
+		Time start = query.timeStart;
+		Time end = query.timeEnd;
+		int nb = query.numBuckets;
+		double bucketLength = (end - start) / (double) nb;
+		bool wantCpids = query.type != STAT_BUSY_FRACTION;
+
+		vector<Long> busyTime(nb, 0);
+		FileOffset maxLoc = data->getMaxLoc(rank);
+		FileOffset loc = findFirstRecord(rank, start);
+
+		Time time = data->getTime(rank, loc);
+		while (loc <= maxLoc && time < end)
+		{
+			int cpid = data->getInt(loc + SIZEOF_LONG);
+			FileOffset next = loc + SIZE_OF_TRACE_RECORD;
+			Time nextTime = (next <= maxLoc) ? data->getTime(rank, next) : time;
+
+			Time s = max(time, start);
+			Time e = min(nextTime, end);
+			bool idle = query.idleCpids.count(cpid) != 0;
+			for (int b = (int)((s - start) / bucketLength); s < e && b < nb; b++)
+			{
+				Time bucketEnd = (b == nb - 1) ? end : start + (Time)((b + 1) * bucketLength);
+				Time overlapEnd = min(e, bucketEnd);
+				if (overlapEnd > s)
+				{
+					if (wantCpids)
+						(*perBucket)[b][cpid] += overlapEnd - s;
+					if (!idle)
+						busyTime[b] += overlapEnd - s;
+					s = overlapEnd;
+				}
+			}
+			loc = next;
+			time = nextTime;
+		}
+
+		busy->resize(nb);
+		for (int b = 0; b < nb; b++)
+		{
+			Time bucketBeg = start + (Time)(b * bucketLength);
+			Time bucketEnd = (b == nb - 1) ? end : start + (Time)((b + 1) * bucketLength);
+			(*busy)[b] = bucketEnd > bucketBeg ? busyTime[b] / (double)(bucketEnd - bucketBeg) : 0;
+		}
+	}
+
+	TraceStatistics::~TraceStatistics()
+	{
+	}
+
+} /* namespace TraceviewerServer */
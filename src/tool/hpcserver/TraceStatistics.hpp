@@ -0,0 +1,134 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Computes time-bucketed summaries of the trace records (time spent in
+//   each cpid, busy fraction of each rank, top cpids) on the server, so
+//   that the viewer does not have to fetch every line at full resolution.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef TRACESTATISTICS_HPP_
+#define TRACESTATISTICS_HPP_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "TimeCPID.hpp"
+#include "FilteredBaseData.hpp"
+#include "ByteUtilities.hpp" //For Long
+
+using std::map;
+using std::set;
+using std::vector;
+
+namespace TraceviewerServer
+{
+	enum StatisticsQueryType {
+		//For every bucket, the time spent in each cpid summed over the ranks
+		STAT_TIME_PER_CPID = 1,
+		//For every rank and bucket, the fraction of the bucket not spent in an idle cpid
+		STAT_BUSY_FRACTION = 2,
+		//Same as STAT_TIME_PER_CPID, but only the topN cpids of each bucket
+		STAT_TOP_CPIDS = 3
+	};
+
+	struct StatisticsQuery
+	{
+		int type;
+		int processStart, processEnd;
+		// Absolute times, i.e. already offset by the minimum begin time
+		Time timeStart, timeEnd;
+		int numBuckets;
+		int topN;
+		set<int> idleCpids;
+	};
+
+	struct CpidTime
+	{
+		int cpid;
+		Long time;
+	};
+
+	struct StatisticsResult
+	{
+		//[bucket] -> (cpid, time) sorted by decreasing time
+		vector<vector<CpidTime> > cpidTimes;
+		//[rank - processStart][bucket]
+		vector<vector<double> > busyFraction;
+	};
+
+	class TraceStatistics
+	{
+	public:
+		TraceStatistics(FilteredBaseData* data);
+		virtual ~TraceStatistics();
+
+		void compute(const StatisticsQuery& query, StatisticsResult* result);
+
+		// Number of threads compute() uses; 0 means one per online processor
+		static int numThreads;
+	private:
+		struct Worker;
+		static void* workerMain(void*);
+		void processRank(const StatisticsQuery& query, int rank,
+				vector<map<int, Long> >* perBucket, vector<double>* busy);
+		FileOffset findFirstRecord(int rank, Time time);
+
+		FilteredBaseData* data;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* TRACESTATISTICS_HPP_ */
@@ -0,0 +1,156 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Reads a scratch file through a PageCache with a tiny mapping budget,
+//   sequentially and from several threads, and checks the contents and
+//   the fault/eviction/readahead counters
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../PageCache.hpp"
+
+using namespace std;
+using namespace TraceviewerServer;
+
+#define PC_PAGES 24
+#define PC_THREADS 4
+
+static FileOffset pcPageSize;
+static FileOffset pcFileSize;
+
+static unsigned char expectedByte(FileOffset pos)
+{
+	return (unsigned char)((pos * 7 + pos / 4096) & 0xff);
+}
+
+static void* randomReader(void* arg)
+{
+	PageCache* cache = (PageCache*)arg;
+	unsigned int seed = (unsigned int)(size_t)pthread_self();
+	for (int i = 0; i < 20000; i++)
+	{
+		FileOffset pos = rand_r(&seed) % pcFileSize;
+		int page = pos / pcPageSize;
+		unsigned char* data = (unsigned char*)cache->acquire(page);
+		assert(data[pos % pcPageSize] == expectedByte(pos));
+		cache->release(page);
+	}
+	return NULL;
+}
+
+void pageCacheTest()
+{
+	pcPageSize = getpagesize();
+	pcFileSize = pcPageSize * PC_PAGES - 100;//Last page is partial
+
+	char path[] = "/tmp/pageCacheTestXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	for (FileOffset pos = 0; pos < pcFileSize; pos++)
+	{
+		unsigned char b = expectedByte(pos);
+		assert(write(fd, &b, 1) == 1);
+	}
+
+	{
+		//Two shards can only keep a couple of pages mapped
+		PageCache cache(fd, pcFileSize, pcPageSize, 2);
+		assert(cache.getNumPages() == PC_PAGES);
+
+		for (FileOffset pos = 0; pos < pcFileSize; pos += 13)
+		{
+			int page = pos / pcPageSize;
+			unsigned char* data = (unsigned char*)cache.acquire(page);
+			assert(data[pos % pcPageSize] == expectedByte(pos));
+			cache.release(page);
+		}
+		PageCache::Stats st = cache.getStats();
+		assert(st.faults == PC_PAGES);
+		assert(st.evictions > 0);
+		assert(st.readaheads > 0);
+
+		//A pinned page survives the eviction of everything else
+		unsigned char* pinned = (unsigned char*)cache.acquire(0);
+		for (int page = 1; page < PC_PAGES; page++)
+		{
+			cache.acquire(page);
+			cache.release(page);
+		}
+		assert(pinned[5] == expectedByte(5));
+		cache.release(0);
+
+		pthread_t threads[PC_THREADS];
+		for (int i = 0; i < PC_THREADS; i++)
+			pthread_create(&threads[i], NULL, randomReader, &cache);
+		for (int i = 0; i < PC_THREADS; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	close(fd);
+	unlink(path);
+	cout << "Page cache reads were correct" << endl;
+}
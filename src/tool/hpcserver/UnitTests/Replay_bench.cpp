@@ -0,0 +1,184 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Replays a session recorded with "hpcserver --record <file>" against a
+//   local database, once without and once with the timeline cache, and
+//   reports the time spent computing trace lines and the cache counters.
+//
+//   Usage: Replay_bench <session file> [cached lines]
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include <sys/time.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../DBOpener.hpp"
+#include "../SpaceTimeDataController.hpp"
+#include "../TimelineCache.hpp"
+
+using namespace std;
+using namespace TraceviewerServer;
+
+struct RecordedRequest
+{
+	int processStart, processEnd;
+	Time timeStart, timeEnd;
+	int verticalResolution, horizontalResolution;
+};
+
+static double now()
+{
+	timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+// Same attribute setup as Communication::sendStartGetData
+static void runRequest(SpaceTimeDataController* controller, const RecordedRequest& r)
+{
+	ImageTraceAttributes* attr = controller->attributes;
+	attr->begProcess = r.processStart;
+	attr->endProcess = r.processEnd;
+	attr->numPixelsH = r.horizontalResolution;
+	attr->numPixelsV = r.verticalResolution;
+	attr->begTime = r.timeStart;
+	attr->endTime = r.timeEnd;
+	attr->lineNum = 0;
+	controller->fillTraces();
+}
+
+static double replay(const string& db, Time minBeg, Time maxEnd, int headerSize,
+		const vector<RecordedRequest>& requests, int cacheLines, TimelineCache::Stats* stats)
+{
+	timelineCacheSize = cacheLines;
+	DBOpener opener;
+	SpaceTimeDataController* controller = opener.openDbAndCreateStdc(db);
+	if (controller == NULL)
+	{
+		cerr << "Could not open database " << db << endl;
+		exit(1);
+	}
+	controller->setInfo(minBeg, maxEnd, headerSize);
+
+	double start = now();
+	for (size_t i = 0; i < requests.size(); i++)
+		runRequest(controller, requests[i]);
+	double elapsed = now() - start;
+
+	*stats = controller->getTimelineCache()->getStats();
+	delete controller;
+	return elapsed;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " <session file> [cached lines]" << endl;
+		return 1;
+	}
+	int cacheLines = argc > 2 ? atoi(argv[2]) : TimelineCache::DEFAULT_MAX_ENTRIES;
+
+	ifstream session(argv[1]);
+	string db;
+	Time minBeg = 0, maxEnd = 0;
+	int headerSize = 24;
+	vector<RecordedRequest> requests;
+
+	string line;
+	while (getline(session, line))
+	{
+		istringstream in(line);
+		string command;
+		in >> command;
+		if (command == "OPEN")
+		{
+			in >> ws;
+			getline(in, db);
+		}
+		else if (command == "INFO")
+			in >> minBeg >> maxEnd >> headerSize;
+		else if (command == "DATA")
+		{
+			RecordedRequest r;
+			in >> r.processStart >> r.processEnd >> r.timeStart >> r.timeEnd
+					>> r.verticalResolution >> r.horizontalResolution;
+			requests.push_back(r);
+		}
+	}
+	if (db.empty() || requests.empty())
+	{
+		cerr << argv[1] << " does not contain a recorded session" << endl;
+		return 1;
+	}
+
+	TimelineCache::Stats uncachedStats, cachedStats;
+	double uncached = replay(db, minBeg, maxEnd, headerSize, requests, 0, &uncachedStats);
+	double cached = replay(db, minBeg, maxEnd, headerSize, requests, cacheLines, &cachedStats);
+
+	cout << "Replayed " << requests.size() << " requests on " << db << endl;
+	cout << "  without cache: " << uncached << " s" << endl;
+	cout << "  with cache (" << cacheLines << " lines): " << cached << " s" << endl;
+	cout << "  " << cachedStats.hits << " hits, " << cachedStats.zoomHits << " zoom hits, "
+			<< cachedStats.partialHits << " partial hits, " << cachedStats.misses << " misses, "
+			<< cachedStats.evictions << " evictions" << endl;
+	return 0;
+}
@@ -0,0 +1,316 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   A minimal client that opens a database on a running hpcserver, sends
+//   one STAT request over the whole trace and prints the result. It is
+//   meant for trying out statistics queries without hpctraceviewer.
+//
+//   Usage: StatClient <host> <port> <database> <min time> <max time>
+//                     <type> <buckets> [top N] [idle cpid ...]
+//
+//   The minimum and maximum times are the ones hpctraceviewer sends in its
+//   INFO message (they come from experiment.xml). The server must have been
+//   started with the XML on the main port (hpcserver -x 1).
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../ByteUtilities.hpp"
+#include "../Constants.hpp"
+#include "../TraceStatistics.hpp"
+
+using namespace std;
+using namespace TraceviewerServer;
+
+#define CLIENT_PROTOCOL_VERSION 0x00010001
+#define TRACE_HEADER_SIZE 24
+
+static FILE* conn;
+
+static void fail(const char* what)
+{
+	cerr << what << endl;
+	exit(1);
+}
+
+static void sendInt(int v)
+{
+	char buf[SIZEOF_INT];
+	ByteUtilities::writeInt(buf, v);
+	fwrite(buf, 1, SIZEOF_INT, conn);
+}
+
+static void sendLong(Long v)
+{
+	char buf[SIZEOF_LONG];
+	ByteUtilities::writeLong(buf, v);
+	fwrite(buf, 1, SIZEOF_LONG, conn);
+}
+
+static void receive(char* buf, size_t len)
+{
+	if (fread(buf, 1, len, conn) != len)
+		fail("Connection closed by the server");
+}
+
+static int receiveInt()
+{
+	char buf[SIZEOF_INT];
+	receive(buf, SIZEOF_INT);
+	return ByteUtilities::readInt(buf);
+}
+
+// Reads the values back out of a STAT payload
+class PayloadReader
+{
+public:
+	PayloadReader(const vector<char>& _data) : data(_data), pos(0) {}
+	int readInt()
+	{
+		check(SIZEOF_INT);
+		int v = ByteUtilities::readInt((char*)&data[pos]);
+		pos += SIZEOF_INT;
+		return v;
+	}
+	Long readLong()
+	{
+		check(SIZEOF_LONG);
+		Long v = ByteUtilities::readLong((char*)&data[pos]);
+		pos += SIZEOF_LONG;
+		return v;
+	}
+	double readDouble()
+	{
+		return ByteUtilities::convertLongToDouble(readLong());
+	}
+private:
+	void check(size_t len)
+	{
+		if (pos + len > data.size())
+			fail("The statistics payload is truncated");
+	}
+	const vector<char>& data;
+	size_t pos;
+};
+
+static vector<char> inflatePayload(const vector<char>& compressed)
+{
+	vector<char> out;
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if (inflateInit(&strm) != Z_OK)
+		fail("Could not initialize zlib");
+	strm.next_in = (Bytef*)&compressed[0];
+	strm.avail_in = compressed.size();
+	char chunk[1 << 16];
+	int ret;
+	do
+	{
+		strm.next_out = (Bytef*)chunk;
+		strm.avail_out = sizeof(chunk);
+		ret = inflate(&strm, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END)
+			fail("Could not decompress the statistics payload");
+		out.insert(out.end(), chunk, chunk + sizeof(chunk) - strm.avail_out);
+	} while (ret != Z_STREAM_END && strm.avail_in > 0);
+	inflateEnd(&strm);
+	return out;
+}
+
+static FILE* connectTo(const char* host, const char* port)
+{
+	addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		fail("Could not resolve the server address");
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0)
+		fail("Could not connect to the server");
+	freeaddrinfo(res);
+	return fdopen(fd, "r+");
+}
+
+static double now()
+{
+	timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 8)
+	{
+		cerr << "Usage: " << argv[0] << " <host> <port> <database> <min time> <max time>"
+				<< " <type> <buckets> [top N] [idle cpid ...]" << endl;
+		cerr << "  type: " << STAT_TIME_PER_CPID << " = time per cpid, " << STAT_BUSY_FRACTION
+				<< " = busy fraction per rank, " << STAT_TOP_CPIDS << " = top N cpids" << endl;
+		return 1;
+	}
+	string db = argv[3];
+	Time minBeg = strtoull(argv[4], NULL, 10);
+	Time maxEnd = strtoull(argv[5], NULL, 10);
+	int type = atoi(argv[6]);
+	int buckets = atoi(argv[7]);
+	int topN = argc > 8 ? atoi(argv[8]) : 10;
+	vector<int> idle;
+	for (int i = 9; i < argc; i++)
+		idle.push_back(atoi(argv[i]));
+
+	conn = connectTo(argv[1], argv[2]);
+
+	sendInt(OPEN);
+	sendInt(CLIENT_PROTOCOL_VERSION);
+	char len[SIZEOF_SHORT];
+	ByteUtilities::writeShort(len, db.length());
+	fwrite(len, 1, SIZEOF_SHORT, conn);
+	fwrite(db.c_str(), 1, db.length(), conn);
+	fflush(conn);
+
+	if (receiveInt() != DBOK)
+		fail("The server could not open the database");
+	int xmlPort = receiveInt();
+	if (xmlPort != atoi(argv[2]))
+		fail("The XML is sent on another port; start the server with -x 1");
+	int numRanks = receiveInt();
+	bool compressed = receiveInt() != 0;
+	vector<char> skip(numRanks * (SIZEOF_INT + SIZEOF_SHORT));
+	receive(&skip[0], skip.size());
+
+	if (receiveInt() != EXML)
+		fail("Expected the experiment XML");
+	vector<char> xml(receiveInt());
+	receive(&xml[0], xml.size());
+
+	sendInt(INFO);
+	sendLong(minBeg);
+	sendLong(maxEnd);
+	sendInt(TRACE_HEADER_SIZE);
+
+	double start = now();
+	sendInt(STAT);
+	sendInt(0);
+	sendInt(numRanks);
+	sendLong(0);
+	sendLong(maxEnd - minBeg);
+	sendInt(buckets);
+	sendInt(type);
+	sendInt(topN);
+	sendInt(idle.size());
+	for (unsigned int i = 0; i < idle.size(); i++)
+		sendInt(idle[i]);
+	fflush(conn);
+
+	if (receiveInt() != STAT)
+		fail("Expected a statistics reply");
+	int replyType = receiveInt();
+	int replyBuckets = receiveInt();
+	vector<char> payload(receiveInt());
+	if (!payload.empty())
+		receive(&payload[0], payload.size());
+	double elapsed = now() - start;
+	size_t wireSize = payload.size();
+	if (compressed)
+		payload = inflatePayload(payload);
+
+	PayloadReader in(payload);
+	Time bucketLength = (maxEnd - minBeg) / replyBuckets;
+	if (replyType == STAT_BUSY_FRACTION)
+	{
+		int ranks = in.readInt();
+		for (int r = 0; r < ranks; r++)
+		{
+			cout << "rank " << in.readInt() << ":";
+			for (int b = 0; b < replyBuckets; b++)
+				cout << " " << in.readDouble();
+			cout << endl;
+		}
+	}
+	else
+	{
+		for (int b = 0; b < replyBuckets; b++)
+		{
+			int count = in.readInt();
+			cout << "bucket " << b << " [" << b * bucketLength << ", " << (b + 1) * bucketLength
+					<< "): " << count << " cpids" << endl;
+			for (int i = 0; i < count; i++)
+			{
+				int cpid = in.readInt();
+				Long time = in.readLong();
+				cout << "  " << cpid << "\t" << time << endl;
+			}
+		}
+	}
+	cout << "Reply: " << wireSize << " bytes on the wire, " << payload.size()
+			<< " bytes of results, " << elapsed << " s" << endl;
+
+	sendInt(DONE);
+	fflush(conn);
+	fclose(conn);
+	return 0;
+}
@@ -0,0 +1,141 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Checks lookups, zoom/pan matching and eviction of the TimelineCache
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+
+#undef NDEBUG
+
+#include <iostream>
+#include <cassert>
+#include <vector>
+
+#include "../TimelineCache.hpp"
+
+using namespace std;
+using namespace TraceviewerServer;
+
+static TimelineCache::Entry makeEntry(int rank, Time beg, Time end, int pixels, int records)
+{
+	TimelineCache::Entry e;
+	e.rank = rank;
+	e.begTime = beg;
+	e.endTime = end;
+	e.numPixelsH = pixels;
+	e.complete = false;
+	e.coverBeg = 0;
+	e.coverEnd = 0;
+	for (int i = 0; i < records; i++)
+		e.samples.push_back(TimeCPID(beg + i * (end - beg) / records, i));
+	return e;
+}
+
+void timelineCacheTest()
+{
+	TimelineCache cache(3);
+	vector<TimeCPID> out;
+
+	// Exact hits
+	cache.insert(makeEntry(0, 1000, 2000, 100, 100));
+	assert(cache.getExact(0, 1000, 2000, 100, &out));
+	assert(out.size() == 100);
+	assert(!cache.getExact(0, 1000, 2000, 200, &out));
+	assert(!cache.getExact(1, 1000, 2000, 100, &out));
+
+	// A pan at the same scale overlaps; a zoom does not
+	assert(cache.findOverlap(0, 1500, 2500, 100) != NULL);
+	assert(cache.findOverlap(0, 1500, 2000, 100) == NULL);
+	assert(cache.findOverlap(0, 2000, 3000, 100) == NULL);
+
+	// A complete entry with records every 10 time units from 0 to 1000
+	TimelineCache::Entry full = makeEntry(1, 0, 1000, 200, 101);
+	for (int i = 0; i <= 100; i++)
+		full.samples[i] = TimeCPID(i * 10, i);
+	full.complete = true;
+	full.coverBeg = 0; //Starts at the beginning of the file
+	full.coverEnd = full.samples[98].timestamp;
+	cache.insert(full);
+
+	// Zoom in to [203, 407]: nearest records are 200 and 410, plus one on each side
+	assert(cache.getFromComplete(1, 203, 407, 200, &out));
+	assert(out.front().timestamp == 190);
+	assert(out.back().timestamp == 420);
+	// Too many records for 10 pixels
+	assert(!cache.getFromComplete(1, 203, 407, 10, &out));
+	// Outside of what the entry can answer
+	assert(!cache.getFromComplete(1, 500, 995, 200, &out));
+
+	TimelineCache::Stats s = cache.getStats();
+	assert(s.hits == 1 && s.zoomHits == 1 && s.evictions == 0);
+
+	// Eviction drops the least recently used entry (rank 0 was touched last by findOverlap,
+	// then rank 1 by the zoom)
+	cache.insert(makeEntry(2, 0, 10, 5, 5));
+	cache.insert(makeEntry(3, 0, 10, 5, 5));
+	assert(cache.getStats().evictions == 1);
+	assert(!cache.getExact(0, 1000, 2000, 100, &out));
+	assert(cache.getFromComplete(1, 203, 407, 200, &out));
+
+	cache.clear();
+	assert(!cache.getExact(3, 0, 10, 5, &out));
+
+	TimelineCache disabled(0);
+	disabled.insert(makeEntry(0, 0, 10, 5, 5));
+	assert(!disabled.getExact(0, 0, 10, 5, &out));
+
+	cout << "Timeline cache operations were successful" << endl;
+}
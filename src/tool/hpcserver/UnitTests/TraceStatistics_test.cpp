@@ -0,0 +1,187 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2019, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Runs every kind of statistics query on a small hand-made trace file and
+//   checks the sums against values worked out by hand
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <unistd.h>
+
+#include "../Constants.hpp"
+#include "../DataOutputFileStream.hpp"
+#include "../FilteredBaseData.hpp"
+#include "../TraceStatistics.hpp"
+
+using namespace std;
+using namespace TraceviewerServer;
+
+#define TS_RANKS 2
+#define TS_RECORDS 4
+//Every rank starts with a header, which the trace records follow
+#define TS_HEADER 24
+
+// rank 0: cpid 1 from 0, 2 from 100, 1 from 300, 3 at 400
+// rank 1: cpid 2 from 0, 0 from 200, 2 from 400, 2 at 400
+static const Long tsTimes[TS_RANKS][TS_RECORDS] = {{0, 100, 300, 400}, {0, 200, 400, 400}};
+static const int tsCpids[TS_RANKS][TS_RECORDS] = {{1, 2, 1, 3}, {2, 0, 2, 2}};
+
+static void writeTrace(const char* path)
+{
+	DataOutputFileStream dos(path);
+	dos.writeInt(MULTI_PROCESSES);
+	dos.writeInt(TS_RANKS);
+	Long offset = 2 * SIZEOF_INT + TS_RANKS * (2 * SIZEOF_INT + SIZEOF_LONG);
+	for (int r = 0; r < TS_RANKS; r++)
+	{
+		dos.writeInt(r);
+		dos.writeInt(0);
+		dos.writeLong(offset);
+		offset += TS_HEADER + TS_RECORDS * SIZE_OF_TRACE_RECORD;
+	}
+	for (int r = 0; r < TS_RANKS; r++)
+	{
+		for (int i = 0; i < TS_HEADER / SIZEOF_INT; i++)
+			dos.writeInt(0);
+		for (int i = 0; i < TS_RECORDS; i++)
+		{
+			dos.writeLong(tsTimes[r][i]);
+			dos.writeInt(tsCpids[r][i]);
+		}
+	}
+	dos.writeInt(0); //End of file marker
+	dos.close();
+}
+
+static Long timeOf(const vector<CpidTime>& bucket, int cpid)
+{
+	for (unsigned int i = 0; i < bucket.size(); i++)
+		if (bucket[i].cpid == cpid)
+			return bucket[i].time;
+	return 0;
+}
+
+void traceStatisticsTest()
+{
+	char path[] = "/tmp/traceStatisticsTestXXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	writeTrace(path);
+
+	FilteredBaseData data(path, TS_HEADER);
+	assert(data.getNumberOfRanks() == TS_RANKS);
+
+	StatisticsQuery q;
+	q.processStart = 0;
+	q.processEnd = TS_RANKS;
+	q.timeStart = 0;
+	q.timeEnd = 400;
+	q.numBuckets = 2;
+	q.topN = 1;
+	q.idleCpids.insert(0);
+
+	for (int threads = 1; threads <= 2; threads++)
+	{
+		TraceStatistics::numThreads = threads;
+		TraceStatistics stats(&data);
+		StatisticsResult r;
+
+		q.type = STAT_TIME_PER_CPID;
+		stats.compute(q, &r);
+		assert(r.cpidTimes.size() == 2);
+		assert(timeOf(r.cpidTimes[0], 2) == 300);
+		assert(timeOf(r.cpidTimes[0], 1) == 100);
+		assert(r.cpidTimes[0].front().cpid == 2);
+		assert(timeOf(r.cpidTimes[1], 0) == 200);
+		assert(timeOf(r.cpidTimes[1], 1) == 100);
+		assert(timeOf(r.cpidTimes[1], 2) == 100);
+		assert(timeOf(r.cpidTimes[1], 3) == 0);
+
+		q.type = STAT_TOP_CPIDS;
+		stats.compute(q, &r);
+		assert(r.cpidTimes[0].size() == 1 && r.cpidTimes[0][0].cpid == 2);
+		assert(r.cpidTimes[1].size() == 1 && r.cpidTimes[1][0].cpid == 0);
+
+		q.type = STAT_BUSY_FRACTION;
+		stats.compute(q, &r);
+		assert(r.busyFraction.size() == TS_RANKS);
+		assert(r.busyFraction[0][0] == 1.0 && r.busyFraction[0][1] == 1.0);
+		assert(r.busyFraction[1][0] == 1.0 && r.busyFraction[1][1] == 0.0);
+
+		//A window that starts in the middle of a record
+		q.type = STAT_TIME_PER_CPID;
+		q.timeStart = 150;
+		q.numBuckets = 1;
+		stats.compute(q, &r);
+		assert(timeOf(r.cpidTimes[0], 2) == 150 + 50);
+		assert(timeOf(r.cpidTimes[0], 0) == 200);
+		assert(timeOf(r.cpidTimes[0], 1) == 100);
+		q.timeStart = 0;
+		q.numBuckets = 2;
+	}
+	TraceStatistics::numThreads = 0;
+
+	unlink(path);
+	cout << "Trace statistics test passed" << endl;
+}
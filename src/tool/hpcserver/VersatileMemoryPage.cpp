@@ -61,32 +61,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstring>
-#include <list>
 #include <errno.h>
 
 #include "DebugUtils.hpp"
 #include "VersatileMemoryPage.hpp"
-#include "LRUList.hpp"
 
 namespace TraceviewerServer
 {
-	static int MAX_PAGES_TO_ALLOCATE_AT_ONCE = 0;
 
-	VersatileMemoryPage::VersatileMemoryPage(FileOffset _startPoint, int _size, FileDescriptor _file, LRUList<VersatileMemoryPage>* pageManagementList)
+	VersatileMemoryPage::VersatileMemoryPage(FileOffset _startPoint, int _size, FileDescriptor _file)
 	{
 		startPoint = _startPoint;
 		size = _size;
-		mostRecentlyUsed = pageManagementList;
-		index = mostRecentlyUsed->addNewUnused(this);
 		file = _file;
+		page = NULL;
+		index = -1;
 		isMapped = false;
-		if (MAX_PAGES_TO_ALLOCATE_AT_ONCE <1)
-			cerr<<"Set max pages before creating any VersatileMemoryPages"<<endl;
-	}
-
-	void VersatileMemoryPage::setMaxPages(int pages)
-	{
-		MAX_PAGES_TO_ALLOCATE_AT_ONCE = pages;
+		readaheadIssued = false;
+		pins = 0;
 	}
 
 	VersatileMemoryPage::~VersatileMemoryPage()
@@ -94,41 +86,17 @@ namespace TraceviewerServer
 		if (isMapped)
 			unmapPage();
 	}
-	char* VersatileMemoryPage::get()
-	{
-
-		if (!isMapped)
-		{
-			mapPage();
-		}
-		mostRecentlyUsed->putOnTop(index);
-
-		return page;
-	}
 
 	void VersatileMemoryPage::mapPage()
 	{
 
-		DEBUGCOUT(1) << "Mapping page "<< index<< " "<<mostRecentlyUsed->getUsedPageCount() << " / " << MAX_PAGES_TO_ALLOCATE_AT_ONCE << endl;
+		DEBUGCOUT(1) << "Mapping page at "<< startPoint << endl;
 
 		if (isMapped)
 		{
 			cerr << "Trying to double map!"<<endl;
 			return;
 		}
-		if (mostRecentlyUsed->getUsedPageCount() >= MAX_PAGES_TO_ALLOCATE_AT_ONCE)
-		{
-
-			VersatileMemoryPage* toRemove = mostRecentlyUsed->getLast();
-
-			DEBUGCOUT(1)<<"Kicking " << toRemove->index << " out"<<endl;
-
-			if (toRemove->isMapped != true)
-				cerr << "Least recently used one isn't even mapped?"<<endl;
-
-			toRemove->unmapPage();
-			mostRecentlyUsed->removeLast();
-		}
 		page = (char*)mmap(0, size, MAP_PROT, MAP_FLAGS, file, startPoint);
 		if (page == MAP_FAILED)
 		{
@@ -141,21 +109,34 @@ namespace TraceviewerServer
 
 
 		isMapped = true;
-		mostRecentlyUsed->reAdd(index);
+		readaheadIssued = false;
 	}
-	void VersatileMemoryPage::unmapPage()
+
+	char* VersatileMemoryPage::detach()
 	{
 		if (!isMapped)
 		{
 			cerr << "Trying to double unmap!"<<endl;
-			return;
+			return NULL;
 		}
-		munmap(page, size);
-
 		isMapped = false;
+		char* region = page;
+		page = NULL;
+		return region;
+	}
+
+	void VersatileMemoryPage::unmapRegion(char* region, int size)
+	{
+		if (region == NULL)
+			return;
+		munmap(region, size);
 
 		DEBUGCOUT(1) << "Unmapped a page"<<endl;
+	}
 
+	void VersatileMemoryPage::unmapPage()
+	{
+		unmapRegion(detach(), size);
 	}
 
 } /* namespace TraceviewerServer */
@@ -63,38 +63,50 @@
 
 #include <sys/mman.h>
 #include "FileUtils.hpp" //FileOffset
-#include "LRUList.hpp"
 
 using namespace std;
 namespace TraceviewerServer
 {
+	class PageCache;
 
+	/**
+	 * One window of the trace file that is mapped and unmapped on demand.
+	 * Which pages are mapped is decided by the PageCache that owns them;
+	 * all of the fields below are protected by the lock of the page's shard,
+	 * except for the pin count, which is atomic.
+	 */
 	class VersatileMemoryPage
 	{
 	public:
-		VersatileMemoryPage();
-		VersatileMemoryPage(FileOffset, int, FileDescriptor, LRUList<VersatileMemoryPage>* pageManagementList);
+		VersatileMemoryPage(FileOffset, int, FileDescriptor);
 		virtual ~VersatileMemoryPage();
-		static void setMaxPages(int);
-		char* get();
 	private:
+		friend class PageCache;
+
 		void mapPage();
 		void unmapPage();
+		//Unmaps a region previously returned by detach()
+		static void unmapRegion(char*, int);
+		//Marks the page as unmapped and returns the region so it can be unmapped outside of the lock
+		char* detach();
 
 		FileOffset startPoint;
 		int size;
 		char* page;
+		//Position in the LRU list of the shard
 		int index;
 		FileDescriptor file;
 
 		bool isMapped;
-		LRUList<VersatileMemoryPage>* mostRecentlyUsed;
+		bool readaheadIssued;
+		//Number of readers currently using the mapping; pinned pages are never evicted
+		volatile int pins;
 
 		// Use MAP_POPULATE if available
 #ifdef MAP_POPULATE
 		static const int MAP_FLAGS = MAP_SHARED | MAP_POPULATE;
 #else
-		static const int MAP_FLAGS = MAP_SHARED
+		static const int MAP_FLAGS = MAP_SHARED;
 #endif
 		static const int MAP_PROT = PROT_READ;
 	};
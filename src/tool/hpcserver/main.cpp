@@ -62,6 +62,8 @@
 #include "Constants.hpp"
 #include "Args.hpp"
 #include "DebugUtils.hpp"
+#include "PageCache.hpp"
+#include "TraceStatistics.hpp"
 
 using namespace std;
 
@@ -74,6 +76,11 @@ int main(int argc, char *argv[])
 	TraceviewerServer::useCompression = args.compression;
 	TraceviewerServer::xmlPortNumber = args.xmlPort;
 	TraceviewerServer::mainPortNumber = args.mainPort;
+	TraceviewerServer::timelineCacheSize = args.cacheLines;
+	TraceviewerServer::sessionRecordPath = args.recordPath;
+	TraceviewerServer::PageCache::pageSizeHint = ((TraceviewerServer::FileOffset)args.pageSizeMB) << 20;
+	TraceviewerServer::PageCache::printStats = args.pageStats;
+	TraceviewerServer::TraceStatistics::numThreads = args.statThreads;
 
 	try
 	{